@@ -0,0 +1,1136 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "debug.h"
+#include "machine_config.h"
+#include "common.h"
+#include "utility.h"
+#include "stats.h"
+#include "gaudio_error.h"
+#include "naudio.h"
+#include "adpcm_aifc.h"
+#include "wav.h"
+#include "wav_convert.h"
+#include "midi.h"
+#include "x.h"
+#include "gaudio.h"
+
+/**
+ * This file contains the implementation of the public library interface, see gaudio.h.
+ *
+ * Input buffers are opened as read only {@code struct FileInfo} and output is
+ * written to a memory stream {@code struct FileInfo}, so conversion uses the same
+ * parse and write code as the apps. The {@code _file} entry points run the same
+ * conversion on files instead. Each entry point runs through {@code gaudio_try}.
+*/
+
+/**
+ * Default keybase for {@code GAUDIO_FREQ_ADJUST_EXPLICIT}, MIDI note C4.
+*/
+#define GAUDIO_DEFAULT_KEYBASE 60
+
+/**
+ * Arguments and result passed through {@code gaudio_try}.
+*/
+struct GaudioApiCall {
+    /**
+     * Input buffer.
+    */
+    const uint8_t *in;
+    size_t in_len;
+
+    /**
+     * Optional codebook (.coef) buffer.
+    */
+    const uint8_t *coef;
+    size_t coef_len;
+
+    /**
+     * Options struct of the called function, or NULL.
+    */
+    const void *options;
+
+    /**
+     * Sample rate of PCM input or output.
+    */
+    int sample_rate;
+
+    /**
+     * Output buffer, owned by caller on success.
+    */
+    uint8_t *out;
+    size_t out_len;
+
+    /**
+     * Input and output paths, for the {@code _file} entry points.
+    */
+    const char *in_path;
+    const char *out_path;
+};
+
+/**
+ * Track callback of the current {@code gaudio_cseq_to_midi} call.
+*/
+static _Thread_local void (*_track_callback)(int track_index, const uint8_t *data, size_t len) = NULL;
+
+// forward declarations
+
+static int gaudio_api_call(f_gaudio_try_callback callback, struct GaudioApiCall *call, uint8_t **out, size_t *out_len, struct GaudioError *error);
+static int gaudio_api_file_call(f_gaudio_try_callback callback, struct GaudioApiCall *call, struct GaudioError *error);
+static struct ALADPCMBook *gaudio_book_from_coef(const uint8_t *coef, size_t coef_len);
+static uint8_t *gaudio_aifc_from_wav(struct WavFile *wav, struct ALADPCMBook *book, size_t *out_len);
+static void gaudio_resolve_inst_keymap(const struct GaudioAifcToWavOptions *options, int *keybase, int *detune);
+static struct MidiConvertOptions *gaudio_convert_options_new(const struct GaudioSeqOptions *options);
+static void gaudio_track_callback(struct GmidTrack *gtrack);
+static void gaudio_wav_to_aifc_stream(struct GaudioApiCall *call, struct FileInfo *input, struct FileInfo *output);
+static void gaudio_aifc_to_wav_stream(struct GaudioApiCall *call, struct FileInfo *input, struct FileInfo *output);
+
+static void gaudio_wav_to_aifc_callback(void *state);
+static void gaudio_wav_to_aifc_file_callback(void *state);
+static void gaudio_pcm_to_aifc_callback(void *state);
+static void gaudio_aifc_to_wav_callback(void *state);
+static void gaudio_aifc_to_wav_file_callback(void *state);
+static void gaudio_aifc_to_pcm_callback(void *state);
+static void gaudio_midi_to_cseq_callback(void *state);
+static void gaudio_cseq_to_midi_callback(void *state);
+
+// end forward declarations
+
+/**
+ * @returns: library version string, "MAJOR.MINOR.PATCH".
+*/
+const char *gaudio_version(void)
+{
+    return GAUDIO_VERSION_STRING;
+}
+
+/**
+ * @returns: library version number, see {@code GAUDIO_VERSION_NUMBER}.
+*/
+int gaudio_version_number(void)
+{
+    return GAUDIO_VERSION_NUMBER;
+}
+
+/**
+ * Sets how much the library prints to stdout. 0 is quiet, 1 is default, 2 is verbose.
+ * @param verbosity: new level.
+*/
+void gaudio_set_verbosity(int verbosity)
+{
+    g_verbosity = verbosity;
+}
+
+/**
+ * Releases output buffer returned by the library.
+ * @param buffer: buffer to free. Can be NULL.
+*/
+void gaudio_buffer_free(void *buffer)
+{
+    if (buffer != NULL)
+    {
+        gaudio_free(buffer);
+    }
+}
+
+/**
+ * Sets default options.
+ * @param options: options to initialize.
+*/
+void GaudioWavToAifcOptions_init(struct GaudioWavToAifcOptions *options)
+{
+    if (options == NULL)
+    {
+        return;
+    }
+
+    memset(options, 0, sizeof(struct GaudioWavToAifcOptions));
+
+    options->dither = 1;
+}
+
+/**
+ * Sets default options.
+ * @param options: options to initialize.
+*/
+void GaudioAifcToWavOptions_init(struct GaudioAifcToWavOptions *options)
+{
+    if (options == NULL)
+    {
+        return;
+    }
+
+    memset(options, 0, sizeof(struct GaudioAifcToWavOptions));
+
+    options->freq_adjust_mode = GAUDIO_FREQ_ADJUST_NONE;
+    options->keybase = GAUDIO_DEFAULT_KEYBASE;
+}
+
+/**
+ * Sets default options.
+ * @param options: options to initialize.
+*/
+void GaudioSeqOptions_init(struct GaudioSeqOptions *options)
+{
+    if (options == NULL)
+    {
+        return;
+    }
+
+    memset(options, 0, sizeof(struct GaudioSeqOptions));
+}
+
+/**
+ * Encodes .wav to .aifc.
+ * @param wav: .wav file contents. 8/16/24/32 bit PCM or 32/64 bit float, any number of channels.
+ * @param wav_len: length of {@code wav} in bytes.
+ * @param coef: Optional. Codebook (.coef file contents). If NULL, output is uncompressed.
+ * @param coef_len: length of {@code coef} in bytes.
+ * @param options: Optional. If NULL, defaults are used.
+ * @param aifc: out parameter. Will contain .aifc file contents.
+ * @param aifc_len: out parameter. Length of {@code aifc} in bytes.
+ * @param error: out parameter. Error details.
+ * @returns: {@code GAUDIO_OK} on success, otherwise error code.
+*/
+int gaudio_wav_to_aifc(const uint8_t *wav, size_t wav_len, const uint8_t *coef, size_t coef_len, const struct GaudioWavToAifcOptions *options, uint8_t **aifc, size_t *aifc_len, struct GaudioError *error)
+{
+    struct GaudioApiCall call;
+    int save_bswap = g_encode_bswap;
+    int code;
+
+    memset(&call, 0, sizeof(struct GaudioApiCall));
+    call.in = wav;
+    call.in_len = wav_len;
+    call.coef = coef;
+    call.coef_len = coef_len;
+    call.options = options;
+
+    g_encode_bswap = options != NULL ? options->bswap : 0;
+    code = gaudio_api_call(gaudio_wav_to_aifc_callback, &call, aifc, aifc_len, error);
+    g_encode_bswap = save_bswap;
+
+    return code;
+}
+
+/**
+ * Encodes .wav file to .aifc file. Sound data is read, converted and encoded in
+ * blocks, so memory use doesn't depend on the length of the audio.
+ * If there is an error the output file is removed.
+ * @param wav_path: path of .wav file. Same formats as {@code gaudio_wav_to_aifc}.
+ * @param aifc_path: path of .aifc file to write. Existing file is replaced.
+ * @param coef: Optional. Codebook (.coef file contents). If NULL, output is uncompressed.
+ * @param coef_len: length of {@code coef} in bytes.
+ * @param options: Optional. If NULL, defaults are used.
+ * @param error: out parameter. Error details.
+ * @returns: {@code GAUDIO_OK} on success, otherwise error code.
+*/
+int gaudio_wav_to_aifc_file(const char *wav_path, const char *aifc_path, const uint8_t *coef, size_t coef_len, const struct GaudioWavToAifcOptions *options, struct GaudioError *error)
+{
+    struct GaudioApiCall call;
+    int save_bswap = g_encode_bswap;
+    int code;
+
+    memset(&call, 0, sizeof(struct GaudioApiCall));
+    call.in_path = wav_path;
+    call.out_path = aifc_path;
+    call.coef = coef;
+    call.coef_len = coef_len;
+    call.options = options;
+
+    g_encode_bswap = options != NULL ? options->bswap : 0;
+    code = gaudio_api_file_call(gaudio_wav_to_aifc_file_callback, &call, error);
+    g_encode_bswap = save_bswap;
+
+    return code;
+}
+
+/**
+ * Encodes PCM samples to .aifc.
+ * @param samples: mono 16 bit samples, native byte order.
+ * @param sample_count: number of samples.
+ * @param sample_rate: sample rate in Hz.
+ * @param coef: Optional. Codebook (.coef file contents). If NULL, output is uncompressed.
+ * @param coef_len: length of {@code coef} in bytes.
+ * @param aifc: out parameter. Will contain .aifc file contents.
+ * @param aifc_len: out parameter. Length of {@code aifc} in bytes.
+ * @param error: out parameter. Error details.
+ * @returns: {@code GAUDIO_OK} on success, otherwise error code.
+*/
+int gaudio_pcm_to_aifc(const int16_t *samples, size_t sample_count, int sample_rate, const uint8_t *coef, size_t coef_len, uint8_t **aifc, size_t *aifc_len, struct GaudioError *error)
+{
+    struct GaudioApiCall call;
+
+    memset(&call, 0, sizeof(struct GaudioApiCall));
+    call.in = (const uint8_t *)samples;
+    call.in_len = sample_count * sizeof(int16_t);
+    call.coef = coef;
+    call.coef_len = coef_len;
+    call.sample_rate = sample_rate;
+
+    return gaudio_api_call(gaudio_pcm_to_aifc_callback, &call, aifc, aifc_len, error);
+}
+
+/**
+ * Decodes .aifc to .wav.
+ * @param aifc: .aifc file contents.
+ * @param aifc_len: length of {@code aifc} in bytes.
+ * @param options: Optional. If NULL, defaults are used.
+ * @param wav: out parameter. Will contain .wav file contents.
+ * @param wav_len: out parameter. Length of {@code wav} in bytes.
+ * @param error: out parameter. Error details.
+ * @returns: {@code GAUDIO_OK} on success, otherwise error code.
+*/
+int gaudio_aifc_to_wav(const uint8_t *aifc, size_t aifc_len, const struct GaudioAifcToWavOptions *options, uint8_t **wav, size_t *wav_len, struct GaudioError *error)
+{
+    struct GaudioApiCall call;
+    int save_loop_count = g_AdpcmLoopInfiniteExportCount;
+    int code;
+
+    memset(&call, 0, sizeof(struct GaudioApiCall));
+    call.in = aifc;
+    call.in_len = aifc_len;
+    call.options = options;
+
+    g_AdpcmLoopInfiniteExportCount = options != NULL ? options->loop_count : 0;
+    code = gaudio_api_call(gaudio_aifc_to_wav_callback, &call, wav, wav_len, error);
+    g_AdpcmLoopInfiniteExportCount = save_loop_count;
+
+    return code;
+}
+
+/**
+ * Decodes .aifc file to .wav file. Sound data is decoded and written in blocks,
+ * so memory use doesn't depend on the length of the audio (or loop expansion).
+ * If there is an error the output file is removed.
+ * @param aifc_path: path of .aifc file.
+ * @param wav_path: path of .wav file to write. Existing file is replaced.
+ * @param options: Optional. If NULL, defaults are used.
+ * @param error: out parameter. Error details.
+ * @returns: {@code GAUDIO_OK} on success, otherwise error code.
+*/
+int gaudio_aifc_to_wav_file(const char *aifc_path, const char *wav_path, const struct GaudioAifcToWavOptions *options, struct GaudioError *error)
+{
+    struct GaudioApiCall call;
+    int save_loop_count = g_AdpcmLoopInfiniteExportCount;
+    int code;
+
+    memset(&call, 0, sizeof(struct GaudioApiCall));
+    call.in_path = aifc_path;
+    call.out_path = wav_path;
+    call.options = options;
+
+    g_AdpcmLoopInfiniteExportCount = options != NULL ? options->loop_count : 0;
+    code = gaudio_api_file_call(gaudio_aifc_to_wav_file_callback, &call, error);
+    g_AdpcmLoopInfiniteExportCount = save_loop_count;
+
+    return code;
+}
+
+/**
+ * Decodes .aifc to PCM samples. Infinite loops are not repeated.
+ * @param aifc: .aifc file contents.
+ * @param aifc_len: length of {@code aifc} in bytes.
+ * @param samples: out parameter. Will contain mono 16 bit samples, native byte order.
+ * @param sample_count: out parameter. Number of samples.
+ * @param sample_rate: out parameter. Sample rate in Hz.
+ * @param error: out parameter. Error details.
+ * @returns: {@code GAUDIO_OK} on success, otherwise error code.
+*/
+int gaudio_aifc_to_pcm(const uint8_t *aifc, size_t aifc_len, int16_t **samples, size_t *sample_count, int *sample_rate, struct GaudioError *error)
+{
+    struct GaudioApiCall call;
+    int save_loop_count = g_AdpcmLoopInfiniteExportCount;
+    size_t len = 0;
+    int code;
+
+    if (sample_count == NULL || sample_rate == NULL)
+    {
+        return gaudio_api_call(NULL, NULL, NULL, NULL, error);
+    }
+
+    memset(&call, 0, sizeof(struct GaudioApiCall));
+    call.in = aifc;
+    call.in_len = aifc_len;
+
+    g_AdpcmLoopInfiniteExportCount = 0;
+    code = gaudio_api_call(gaudio_aifc_to_pcm_callback, &call, (uint8_t **)samples, &len, error);
+    g_AdpcmLoopInfiniteExportCount = save_loop_count;
+
+    *sample_count = len / sizeof(int16_t);
+    *sample_rate = call.sample_rate;
+
+    return code;
+}
+
+/**
+ * Converts standard MIDI to N64 compressed MIDI (seq).
+ * @param midi: MIDI file contents.
+ * @param midi_len: length of {@code midi} in bytes.
+ * @param options: Optional. If NULL, defaults are used.
+ * @param cseq: out parameter. Will contain seq file contents.
+ * @param cseq_len: out parameter. Length of {@code cseq} in bytes.
+ * @param error: out parameter. Error details.
+ * @returns: {@code GAUDIO_OK} on success, otherwise error code.
+*/
+int gaudio_midi_to_cseq(const uint8_t *midi, size_t midi_len, const struct GaudioSeqOptions *options, uint8_t **cseq, size_t *cseq_len, struct GaudioError *error)
+{
+    struct GaudioApiCall call;
+
+    memset(&call, 0, sizeof(struct GaudioApiCall));
+    call.in = midi;
+    call.in_len = midi_len;
+    call.options = options;
+
+    return gaudio_api_call(gaudio_midi_to_cseq_callback, &call, cseq, cseq_len, error);
+}
+
+/**
+ * Converts N64 compressed MIDI (seq) to standard MIDI.
+ * @param cseq: seq file contents.
+ * @param cseq_len: length of {@code cseq} in bytes.
+ * @param options: Optional. If NULL, defaults are used.
+ * @param midi: out parameter. Will contain MIDI file contents.
+ * @param midi_len: out parameter. Length of {@code midi} in bytes.
+ * @param error: out parameter. Error details.
+ * @returns: {@code GAUDIO_OK} on success, otherwise error code.
+*/
+int gaudio_cseq_to_midi(const uint8_t *cseq, size_t cseq_len, const struct GaudioSeqOptions *options, uint8_t **midi, size_t *midi_len, struct GaudioError *error)
+{
+    struct GaudioApiCall call;
+
+    memset(&call, 0, sizeof(struct GaudioApiCall));
+    call.in = cseq;
+    call.in_len = cseq_len;
+    call.options = options;
+
+    return gaudio_api_call(gaudio_cseq_to_midi_callback, &call, midi, midi_len, error);
+}
+
+/**
+ * Runs conversion through {@code gaudio_try} and copies out result.
+ * If any parameter is NULL the callback is not run and an error is returned.
+ * @param callback: conversion to run.
+ * @param call: callback arguments.
+ * @param out: out parameter. Set to output buffer on success, NULL on error.
+ * @param out_len: out parameter. Set to length of output buffer, 0 on error.
+ * @param error: out parameter. Error details.
+ * @returns: {@code GAUDIO_OK} on success, otherwise error code.
+*/
+static int gaudio_api_call(f_gaudio_try_callback callback, struct GaudioApiCall *call, uint8_t **out, size_t *out_len, struct GaudioError *error)
+{
+    TRACE_ENTER(__func__)
+
+    int code;
+
+    if (error == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return EXIT_CODE_NULL_REFERENCE_EXCEPTION;
+    }
+
+    if (callback == NULL || call == NULL || call->in == NULL || out == NULL || out_len == NULL)
+    {
+        error->code = EXIT_CODE_NULL_REFERENCE_EXCEPTION;
+        snprintf(error->message, GAUDIO_ERROR_MESSAGE_LEN, "%s: required parameter is NULL", __func__);
+
+        if (out != NULL)
+        {
+            *out = NULL;
+        }
+
+        if (out_len != NULL)
+        {
+            *out_len = 0;
+        }
+
+        TRACE_LEAVE(__func__)
+        return error->code;
+    }
+
+    code = gaudio_try(callback, call, error);
+
+    if (code == GAUDIO_OK)
+    {
+        *out = call->out;
+        *out_len = call->out_len;
+    }
+    else
+    {
+        *out = NULL;
+        *out_len = 0;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return code;
+}
+
+/**
+ * Runs file conversion through {@code gaudio_try}.
+ * If any parameter is NULL the callback is not run and an error is returned.
+ * If the conversion fails the output file is removed.
+ * @param callback: conversion to run.
+ * @param call: callback arguments.
+ * @param error: out parameter. Error details.
+ * @returns: {@code GAUDIO_OK} on success, otherwise error code.
+*/
+static int gaudio_api_file_call(f_gaudio_try_callback callback, struct GaudioApiCall *call, struct GaudioError *error)
+{
+    TRACE_ENTER(__func__)
+
+    int code;
+
+    if (error == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return EXIT_CODE_NULL_REFERENCE_EXCEPTION;
+    }
+
+    if (callback == NULL || call == NULL || call->in_path == NULL || call->out_path == NULL)
+    {
+        error->code = EXIT_CODE_NULL_REFERENCE_EXCEPTION;
+        snprintf(error->message, GAUDIO_ERROR_MESSAGE_LEN, "%s: required parameter is NULL", __func__);
+
+        TRACE_LEAVE(__func__)
+        return error->code;
+    }
+
+    code = gaudio_try(callback, call, error);
+
+    if (code != GAUDIO_OK)
+    {
+        // files opened during the call are closed when the error is raised.
+        remove(call->out_path);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return code;
+}
+
+/**
+ * Parses codebook.
+ * @param coef: Optional. .coef file contents.
+ * @param coef_len: length of {@code coef} in bytes.
+ * @returns: new codebook, or NULL if {@code coef} is NULL.
+*/
+static struct ALADPCMBook *gaudio_book_from_coef(const uint8_t *coef, size_t coef_len)
+{
+    TRACE_ENTER(__func__)
+
+    struct FileInfo *fi;
+    struct ALADPCMBook *book;
+
+    if (coef == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return NULL;
+    }
+
+    fi = FileInfo_fmemopen(coef, coef_len);
+    book = ALADPCMBook_new_from_coef(fi);
+    FileInfo_free(fi);
+
+    TRACE_LEAVE(__func__)
+
+    return book;
+}
+
+/**
+ * Encodes wav and writes .aifc to memory.
+ * @param wav: wav to encode.
+ * @param book: Optional. Codebook.
+ * @param out_len: out parameter. Length of result in bytes.
+ * @returns: .aifc file contents.
+*/
+static uint8_t *gaudio_aifc_from_wav(struct WavFile *wav, struct ALADPCMBook *book, size_t *out_len)
+{
+    TRACE_ENTER(__func__)
+
+    struct AdpcmAifcFile *aifc;
+    struct FileInfo *output;
+    uint8_t *result;
+
+    stats_phase_begin("encode");
+    aifc = AdpcmAifcFile_new_from_wav(wav, book);
+    stats_add_items("encode", "frames", aifc->comm_chunk->num_sample_frames);
+    stats_phase_end("encode");
+
+    output = FileInfo_open_memstream();
+    AdpcmAifcFile_fwrite(aifc, output);
+    *out_len = FileInfo_memstream_take(output, &result);
+    FileInfo_free(output);
+
+    AdpcmAifcFile_free(aifc);
+
+    TRACE_LEAVE(__func__)
+
+    return result;
+}
+
+/**
+ * Finds keybase and detune in .inst file for {@code GAUDIO_FREQ_ADJUST_SEARCH}.
+ * @param options: conversion options.
+ * @param keybase: out parameter. Keybase of keymap found.
+ * @param detune: out parameter. Detune of keymap found.
+*/
+static void gaudio_resolve_inst_keymap(const struct GaudioAifcToWavOptions *options, int *keybase, int *detune)
+{
+    TRACE_ENTER(__func__)
+
+    struct FileInfo *inst_file;
+    struct ALBankFile *bank_file;
+    struct ALKeyMap *keymap = NULL;
+    struct ALSound *sound;
+
+    if (options->inst == NULL)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "error, inst file must be specified in freq_adjust_mode=search\n");
+    }
+
+    if (options->inst_search_mode == GAUDIO_INST_SEARCH_NONE)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "error, inst search mode must be specified in freq_adjust_mode=search\n");
+    }
+
+    if (options->inst_val == NULL)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "error, inst val be specified in freq_adjust_mode=search\n");
+    }
+
+    stats_phase_begin("parse inst");
+    inst_file = FileInfo_fmemopen(options->inst, options->inst_len);
+    stats_add_bytes("parse inst", inst_file->len);
+
+    bank_file = ALBankFile_new_from_inst(inst_file);
+
+    if (options->inst_search_mode == GAUDIO_INST_SEARCH_USE)
+    {
+        sound = ALBankFile_find_sound_by_aifc_filename(bank_file, options->inst_val);
+
+        if (sound == NULL)
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "error reading .inst, cannot find wavetable referencing file \"%s\"\n", options->inst_val);
+        }
+
+        keymap = sound->keymap;
+
+        if (keymap == NULL)
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "error reading .inst, sound->keymap is NULL\n");
+        }
+    }
+    else if (options->inst_search_mode == GAUDIO_INST_SEARCH_SOUND)
+    {
+        sound = ALBankFile_find_sound_with_name(bank_file, options->inst_val);
+
+        if (sound == NULL)
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "error reading .inst, cannot find sound with id \"%s\"\n", options->inst_val);
+        }
+
+        keymap = sound->keymap;
+
+        if (keymap == NULL)
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "error reading .inst, sound->keymap is NULL\n");
+        }
+    }
+    else if (options->inst_search_mode == GAUDIO_INST_SEARCH_KEYMAP)
+    {
+        keymap = ALBankFile_find_keymap_with_name(bank_file, options->inst_val);
+
+        if (keymap == NULL)
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "error reading .inst, cannot find keymap with id \"%s\"\n", options->inst_val);
+        }
+    }
+    else
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "error, invalid inst_search_mode %d\n", options->inst_search_mode);
+    }
+
+    *keybase = keymap->key_base;
+    *detune = keymap->detune;
+
+    if (g_verbosity >= VERBOSE_DEBUG)
+    {
+        printf("search> keybase=%d, detune=%d\n", *keybase, *detune);
+    }
+
+    ALBankFile_free(bank_file);
+    FileInfo_free(inst_file);
+    stats_phase_end("parse inst");
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Creates library conversion options from public options.
+ * @param options: Optional. Public options.
+ * @returns: new conversion options.
+*/
+static struct MidiConvertOptions *gaudio_convert_options_new(const struct GaudioSeqOptions *options)
+{
+    TRACE_ENTER(__func__)
+
+    struct MidiConvertOptions *convert_options = MidiConvertOptions_new();
+
+    _track_callback = NULL;
+
+    if (options != NULL)
+    {
+        convert_options->no_pattern_compression = options->no_pattern_compression;
+        convert_options->sysex_seq_loops = options->sysex_seq_loops;
+
+        if (options->pattern_file != NULL)
+        {
+            if (options->no_pattern_compression)
+            {
+                stderr_exit(EXIT_CODE_GENERAL, "error, pattern file is not used when pattern compression is disabled\n");
+            }
+
+            convert_options->use_pattern_marker_file = 1;
+            // only read, never freed.
+            convert_options->pattern_marker_filename = (char *)options->pattern_file;
+        }
+
+        if (options->track_callback != NULL)
+        {
+            _track_callback = options->track_callback;
+            convert_options->post_unroll_action = gaudio_track_callback;
+        }
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return convert_options;
+}
+
+/**
+ * Passes unrolled track to the public track callback.
+ * @param gtrack: track.
+*/
+static void gaudio_track_callback(struct GmidTrack *gtrack)
+{
+    TRACE_ENTER(__func__)
+
+    if (_track_callback != NULL)
+    {
+        _track_callback(gtrack->cseq_track_index, gtrack->cseq_data, gtrack->cseq_data_len);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+static void gaudio_wav_to_aifc_callback(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudioApiCall *call = (struct GaudioApiCall *)state;
+    struct FileInfo *input;
+    struct FileInfo *output;
+
+    input = FileInfo_fmemopen(call->in, call->in_len);
+    output = FileInfo_open_memstream();
+
+    gaudio_wav_to_aifc_stream(call, input, output);
+
+    call->out_len = FileInfo_memstream_take(output, &call->out);
+    FileInfo_free(output);
+    FileInfo_free(input);
+
+    TRACE_LEAVE(__func__)
+}
+
+static void gaudio_wav_to_aifc_file_callback(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudioApiCall *call = (struct GaudioApiCall *)state;
+    struct FileInfo *input;
+    struct FileInfo *output;
+
+    input = FileInfo_fopen((char *)call->in_path, "rb");
+    output = FileInfo_fopen((char *)call->out_path, "wb");
+
+    gaudio_wav_to_aifc_stream(call, input, output);
+
+    FileInfo_free(output);
+    FileInfo_free(input);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Encodes .wav to .aifc, one block at a time.
+ * @param call: conversion arguments.
+ * @param input: .wav file.
+ * @param output: .aifc file to write, must be seekable.
+*/
+static void gaudio_wav_to_aifc_stream(struct GaudioApiCall *call, struct FileInfo *input, struct FileInfo *output)
+{
+    TRACE_ENTER(__func__)
+
+    const struct GaudioWavToAifcOptions *options = (const struct GaudioWavToAifcOptions *)call->options;
+    struct WavConvertOptions *convert_options;
+    struct ALADPCMBook *book;
+    struct WavReader *reader;
+    size_t frames;
+
+    book = gaudio_book_from_coef(call->coef, call->coef_len);
+
+    reader = WavReader_new(input);
+
+    convert_options = WavConvertOptions_new();
+
+    if (options != NULL)
+    {
+        convert_options->sample_rate = options->sample_rate;
+        convert_options->dither = options->dither;
+    }
+
+    stats_phase_begin("encode");
+    frames = AdpcmAifcFile_fwrite_from_wav_reader(reader, book, convert_options, output);
+    stats_add_bytes("encode", (uint64_t)input->len);
+    stats_add_items("encode", "frames", (uint64_t)frames);
+    stats_phase_end("encode");
+
+    WavConvertOptions_free(convert_options);
+    WavReader_free(reader);
+    ALADPCMBook_free(book);
+
+    TRACE_LEAVE(__func__)
+}
+
+static void gaudio_pcm_to_aifc_callback(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudioApiCall *call = (struct GaudioApiCall *)state;
+    struct ALADPCMBook *book;
+    struct WavFile *wav;
+
+    if (call->sample_rate <= 0)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid sample rate: %d\n", __func__, __LINE__, call->sample_rate);
+    }
+
+    if (call->in_len > MAX_INPUT_FILESIZE)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> error, sample data len=%ld is larger than max supported=%d\n", __func__, __LINE__, call->in_len, MAX_INPUT_FILESIZE);
+    }
+
+    book = gaudio_book_from_coef(call->coef, call->coef_len);
+
+    // same layout WavFile_new_from_file creates for mono 16 bit audio.
+    wav = WavFile_new(WAV_DEFAULT_NUM_CHUNKS);
+
+    wav->fmt_chunk = WavFmtChunk_new();
+    wav->chunks[0] = wav->fmt_chunk;
+
+    wav->fmt_chunk->audio_format = WAV_AUDIO_FORMAT;
+    wav->fmt_chunk->num_channels = 1;
+    wav->fmt_chunk->sample_rate = call->sample_rate;
+    wav->fmt_chunk->bits_per_sample = 16;
+    wav->fmt_chunk->byte_rate = wav->fmt_chunk->sample_rate * wav->fmt_chunk->num_channels * wav->fmt_chunk->bits_per_sample/8;
+    wav->fmt_chunk->block_align = wav->fmt_chunk->num_channels * wav->fmt_chunk->bits_per_sample/8;
+
+    wav->data_chunk = WavDataChunk_new();
+    wav->chunks[1] = wav->data_chunk;
+
+    wav->data_chunk->ck_data_size = (int32_t)call->in_len;
+    wav->ck_data_size =
+        4 + /* rest of FORM header */
+        WAV_FMT_CHUNK_FULL_SIZE + /* "fmt " chunk is const size */
+        8 + wav->data_chunk->ck_data_size; /* "data" chunk header, then data size*/
+    wav->data_chunk->data = (uint8_t *)malloc_zero(1, call->in_len + 1);
+    memcpy(wav->data_chunk->data, call->in, call->in_len);
+
+    call->out = gaudio_aifc_from_wav(wav, book, &call->out_len);
+
+    WavFile_free(wav);
+    ALADPCMBook_free(book);
+
+    TRACE_LEAVE(__func__)
+}
+
+static void gaudio_aifc_to_wav_callback(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudioApiCall *call = (struct GaudioApiCall *)state;
+    struct FileInfo *input;
+    struct FileInfo *output;
+
+    input = FileInfo_fmemopen(call->in, call->in_len);
+    output = FileInfo_open_memstream();
+
+    gaudio_aifc_to_wav_stream(call, input, output);
+
+    call->out_len = FileInfo_memstream_take(output, &call->out);
+    FileInfo_free(output);
+    FileInfo_free(input);
+
+    TRACE_LEAVE(__func__)
+}
+
+static void gaudio_aifc_to_wav_file_callback(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudioApiCall *call = (struct GaudioApiCall *)state;
+    struct FileInfo *input;
+    struct FileInfo *output;
+
+    input = FileInfo_fopen((char *)call->in_path, "rb");
+    output = FileInfo_fopen((char *)call->out_path, "wb");
+
+    gaudio_aifc_to_wav_stream(call, input, output);
+
+    FileInfo_free(output);
+    FileInfo_free(input);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Decodes .aifc to .wav. The .aifc is read into memory, decoded sound data
+ * is written one block at a time.
+ * @param call: conversion arguments.
+ * @param input: .aifc file.
+ * @param output: .wav file to write, must be seekable.
+*/
+static void gaudio_aifc_to_wav_stream(struct GaudioApiCall *call, struct FileInfo *input, struct FileInfo *output)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudioAifcToWavOptions default_options;
+    const struct GaudioAifcToWavOptions *options = (const struct GaudioAifcToWavOptions *)call->options;
+    struct AdpcmAifcFile *aifc_file;
+    struct WavFmtChunk *fmt_chunk;
+    struct WavSampleChunk *smpl_chunk = NULL;
+    struct WavWriter *writer;
+    int keybase;
+    int detune;
+    int skip_freq_adjust = 0;
+
+    if (options == NULL)
+    {
+        GaudioAifcToWavOptions_init(&default_options);
+        options = &default_options;
+    }
+
+    keybase = options->keybase;
+    detune = options->detune;
+
+    if (options->freq_adjust_mode == GAUDIO_FREQ_ADJUST_SEARCH)
+    {
+        gaudio_resolve_inst_keymap(options, &keybase, &detune);
+    }
+
+    aifc_file = AdpcmAifcFile_new_from_file(input);
+
+    fmt_chunk = WavFmtChunk_new_from_aifc(aifc_file);
+
+    if (options->write_smpl == 1)
+    {
+        smpl_chunk = WavSampleChunk_new_from_aifc_loop(aifc_file);
+
+        if (smpl_chunk != NULL)
+        {
+            smpl_chunk->midi_unity_note = keybase;
+        }
+    }
+
+    /**
+     * It seems the AL_RAW16_WAVE .aifc files don't adjust the frequency, maybe?
+     * So check for that here.
+    */
+    if (aifc_file->comm_chunk != NULL
+        && aifc_file->comm_chunk->compression_type == ADPCM_AIFC_NONE_COMPRESSION_TYPE_ID)
+    {
+        skip_freq_adjust = 1;
+    }
+
+    // check if freq adjustment is necessary
+    if (
+        /**
+         * if the caller passed explicit detune parameters
+        */
+        (options->freq_adjust_mode == GAUDIO_FREQ_ADJUST_EXPLICIT)
+        /**
+         * Or, the caller said to search .inst file for detune parameters.
+        */
+        || (options->freq_adjust_mode == GAUDIO_FREQ_ADJUST_SEARCH &&
+            /**
+             * And the caller said to always adjust the frequency,
+             * or to automatically adjust if this is ADPCM compression but skip `NONE`.
+            */
+            (options->force_freq_adjust == 1 || skip_freq_adjust == 0)))
+    {
+        // freq_adjust could have been set because the wav "smpl" chunk was written,
+        // so also check for override disable here.
+        if (options->no_freq_adjust == 0)
+        {
+            double freq = (double)fmt_chunk->sample_rate;
+            double new_freq = detune_frequency(freq, keybase, detune);
+
+            if (g_verbosity >= VERBOSE_DEBUG)
+            {
+                printf("adjust wav freq to %f\n", new_freq);
+            }
+
+            // Truncated to int, same as WavFile_set_frequency.
+            fmt_chunk->sample_rate = (int32_t)new_freq;
+        }
+    }
+
+    stats_phase_begin("decode");
+    writer = WavWriter_new(output, fmt_chunk);
+    AdpcmAifcFile_decode_fwrite(aifc_file, output);
+    WavWriter_close(writer, smpl_chunk);
+    stats_phase_end("decode");
+
+    if (aifc_file->comm_chunk != NULL)
+    {
+        stats_add_items("decode", "frames", aifc_file->comm_chunk->num_sample_frames);
+    }
+
+    WavWriter_free(writer);
+
+    if (smpl_chunk != NULL)
+    {
+        WavSampleChunk_free(smpl_chunk);
+    }
+
+    WavFmtChunk_free(fmt_chunk);
+    AdpcmAifcFile_free(aifc_file);
+
+    TRACE_LEAVE(__func__)
+}
+
+static void gaudio_aifc_to_pcm_callback(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudioApiCall *call = (struct GaudioApiCall *)state;
+    struct FileInfo *input;
+    struct AdpcmAifcFile *aifc_file;
+    struct WavFile *wav_file;
+
+    input = FileInfo_fmemopen(call->in, call->in_len);
+    aifc_file = AdpcmAifcFile_new_from_file(input);
+    FileInfo_free(input);
+
+    stats_phase_begin("decode");
+    wav_file = WavFile_new_from_aifc(aifc_file);
+    stats_phase_end("decode");
+
+    if (aifc_file->comm_chunk != NULL)
+    {
+        stats_add_items("decode", "frames", aifc_file->comm_chunk->num_sample_frames);
+    }
+
+    AdpcmAifcFile_free(aifc_file);
+
+    // take decoded samples from the wav.
+    call->sample_rate = (int)wav_file->fmt_chunk->sample_rate;
+    call->out = wav_file->data_chunk->data;
+    call->out_len = (size_t)wav_file->data_chunk->ck_data_size;
+    wav_file->data_chunk->data = NULL;
+
+    WavFile_free(wav_file);
+
+    TRACE_LEAVE(__func__)
+}
+
+static void gaudio_midi_to_cseq_callback(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudioApiCall *call = (struct GaudioApiCall *)state;
+    struct MidiConvertOptions *convert_options;
+    struct FileInfo *input;
+    struct FileInfo *output;
+    struct MidiFile *midi_file;
+    struct CseqFile *cseq_file;
+
+    input = FileInfo_fmemopen(call->in, call->in_len);
+    midi_file = MidiFile_new_from_file(input);
+    FileInfo_free(input);
+
+    convert_options = gaudio_convert_options_new((const struct GaudioSeqOptions *)call->options);
+
+    stats_phase_begin("convert");
+    cseq_file = CseqFile_from_MidiFile(midi_file, convert_options);
+    stats_add_bytes("convert", call->in_len);
+    stats_add_items("convert", "tracks", (uint64_t)midi_file->num_tracks);
+    stats_phase_end("convert");
+
+    MidiFile_free(midi_file);
+    MidiConvertOptions_free(convert_options);
+
+    output = FileInfo_open_memstream();
+    CseqFile_fwrite(cseq_file, output);
+    call->out_len = FileInfo_memstream_take(output, &call->out);
+    FileInfo_free(output);
+
+    CseqFile_free(cseq_file);
+
+    TRACE_LEAVE(__func__)
+}
+
+static void gaudio_cseq_to_midi_callback(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudioApiCall *call = (struct GaudioApiCall *)state;
+    struct MidiConvertOptions *convert_options;
+    struct FileInfo *input;
+    struct FileInfo *output;
+    struct MidiFile *midi_file;
+    struct CseqFile *cseq_file;
+
+    input = FileInfo_fmemopen(call->in, call->in_len);
+    cseq_file = CseqFile_new_from_file(input);
+    FileInfo_free(input);
+
+    convert_options = gaudio_convert_options_new((const struct GaudioSeqOptions *)call->options);
+
+    stats_phase_begin("convert");
+    midi_file = MidiFile_from_CseqFile(cseq_file, convert_options);
+    stats_add_bytes("convert", call->in_len);
+    stats_add_items("convert", "tracks", (uint64_t)midi_file->num_tracks);
+    stats_phase_end("convert");
+
+    CseqFile_free(cseq_file);
+    MidiConvertOptions_free(convert_options);
+
+    output = FileInfo_open_memstream();
+    MidiFile_fwrite(midi_file, output);
+    call->out_len = FileInfo_memstream_take(output, &call->out);
+    FileInfo_free(output);
+
+    MidiFile_free(midi_file);
+
+    TRACE_LEAVE(__func__)
+}
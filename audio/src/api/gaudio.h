@@ -0,0 +1,227 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#ifndef _GAUDIO_H_
+#define _GAUDIO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gaudio_error.h"
+
+/**
+ * This file contains the public interface of the gaudio shared library (libgaudio.so).
+ *
+ * Conversions read from and write to memory buffers, no files are used, except
+ * for the {@code _file} functions which read and write files in blocks. Each
+ * function returns {@code GAUDIO_OK} on success, otherwise the error code (see
+ * EXIT_CODE_* in machine_config.h) and {@code error} contains the message. Errors
+ * don't end the process and memory allocated by the failed call is released.
+ *
+ * Output buffers are allocated by the library and must be released with
+ * {@code gaudio_buffer_free}. Input buffers are not changed or kept.
+ *
+ * Conversion options are stored in library globals for the duration of a call,
+ * so calls should not be made from more than one thread at the same time.
+ *
+ * Only functions declared here are exported from the shared library. Functions
+ * are not removed or changed within a major version.
+*/
+
+#define GAUDIO_VERSION_MAJOR 1
+#define GAUDIO_VERSION_MINOR 1
+#define GAUDIO_VERSION_PATCH 0
+
+/**
+ * Library version as "MAJOR.MINOR.PATCH".
+*/
+#define GAUDIO_VERSION_STRING "1.1.0"
+
+/**
+ * Library version as a single number, MAJOR * 10000 + MINOR * 100 + PATCH.
+*/
+#define GAUDIO_VERSION_NUMBER (GAUDIO_VERSION_MAJOR * 10000 + GAUDIO_VERSION_MINOR * 100 + GAUDIO_VERSION_PATCH)
+
+/**
+ * How {@code gaudio_aifc_to_wav} adjusts the output sample rate.
+*/
+enum GAUDIO_FREQ_ADJUST_MODE {
+    /**
+     * Sample rate is copied from .aifc.
+    */
+    GAUDIO_FREQ_ADJUST_NONE = 0,
+
+    /**
+     * Sample rate is adjusted with keybase and detune options.
+    */
+    GAUDIO_FREQ_ADJUST_EXPLICIT,
+
+    /**
+     * Sample rate is adjusted with keybase and detune read from .inst file.
+    */
+    GAUDIO_FREQ_ADJUST_SEARCH
+};
+
+/**
+ * How {@code gaudio_aifc_to_wav} finds keybase and detune in .inst file.
+*/
+enum GAUDIO_INST_SEARCH_MODE {
+    GAUDIO_INST_SEARCH_NONE = 0,
+
+    /**
+     * Finds sound by trailing text of the wavetable "use" value.
+    */
+    GAUDIO_INST_SEARCH_USE,
+
+    /**
+     * Finds sound by name.
+    */
+    GAUDIO_INST_SEARCH_SOUND,
+
+    /**
+     * Finds keymap by name.
+    */
+    GAUDIO_INST_SEARCH_KEYMAP
+};
+
+/**
+ * Options for {@code gaudio_wav_to_aifc}. Set defaults with {@code GaudioWavToAifcOptions_init}.
+*/
+struct GaudioWavToAifcOptions {
+    /**
+     * Flag, byte swap audio samples before converting.
+    */
+    int bswap;
+
+    /**
+     * Sample rate to resample to before encoding. If zero, the .wav sample rate is kept.
+     * Input that isn't mono 16 bit PCM (e.g., stereo, 24 bit, or float) is always
+     * mixed down to mono 16 bit first.
+    */
+    int sample_rate;
+
+    /**
+     * Flag, add dither when converting to 16 bit. Default 1.
+    */
+    int dither;
+};
+
+/**
+ * Options for {@code gaudio_aifc_to_wav}. Set defaults with {@code GaudioAifcToWavOptions_init}.
+*/
+struct GaudioAifcToWavOptions {
+    /**
+     * Number of times an infinite ADPCM loop is repeated. Default 0.
+    */
+    int loop_count;
+
+    /**
+     * Flag, add "smpl" chunk with loop and keybase to output.
+    */
+    int write_smpl;
+
+    /**
+     * Member of {@code enum GAUDIO_FREQ_ADJUST_MODE}.
+    */
+    int freq_adjust_mode;
+
+    /**
+     * Keybase (MIDI note) for {@code GAUDIO_FREQ_ADJUST_EXPLICIT}. Default 60 (C4).
+    */
+    int keybase;
+
+    /**
+     * Detune in cents for {@code GAUDIO_FREQ_ADJUST_EXPLICIT}.
+    */
+    int detune;
+
+    /**
+     * Contents of .inst file for {@code GAUDIO_FREQ_ADJUST_SEARCH}.
+    */
+    const uint8_t *inst;
+
+    /**
+     * Length of {@code inst} in bytes.
+    */
+    size_t inst_len;
+
+    /**
+     * Member of {@code enum GAUDIO_INST_SEARCH_MODE}.
+    */
+    int inst_search_mode;
+
+    /**
+     * Text to search .inst file for.
+    */
+    const char *inst_val;
+
+    /**
+     * Flag, in search mode also adjust uncompressed .aifc.
+    */
+    int force_freq_adjust;
+
+    /**
+     * Flag, never adjust sample rate. Keybase is still resolved for "smpl" chunk.
+    */
+    int no_freq_adjust;
+};
+
+/**
+ * Options for {@code gaudio_midi_to_cseq} and {@code gaudio_cseq_to_midi}.
+ * Set defaults with {@code GaudioSeqOptions_init}.
+*/
+struct GaudioSeqOptions {
+    /**
+     * Flag, disable pattern compression (midi to cseq) or unrolling (cseq to midi).
+    */
+    int no_pattern_compression;
+
+    /**
+     * Optional. Path of pattern marker file, used instead of computing pattern markers.
+    */
+    const char *pattern_file;
+
+    /**
+     * Flag, escape invalid seq loops to gaudio sysex events (cseq to midi).
+    */
+    int sysex_seq_loops;
+
+    /**
+     * Optional. Called for each track after unroll (cseq to midi) with the
+     * seq track data. Data is only valid during the callback.
+    */
+    void (*track_callback)(int track_index, const uint8_t *data, size_t len);
+};
+
+const char *gaudio_version(void);
+int gaudio_version_number(void);
+void gaudio_set_verbosity(int verbosity);
+void gaudio_buffer_free(void *buffer);
+
+void GaudioWavToAifcOptions_init(struct GaudioWavToAifcOptions *options);
+void GaudioAifcToWavOptions_init(struct GaudioAifcToWavOptions *options);
+void GaudioSeqOptions_init(struct GaudioSeqOptions *options);
+
+int gaudio_wav_to_aifc(const uint8_t *wav, size_t wav_len, const uint8_t *coef, size_t coef_len, const struct GaudioWavToAifcOptions *options, uint8_t **aifc, size_t *aifc_len, struct GaudioError *error);
+int gaudio_pcm_to_aifc(const int16_t *samples, size_t sample_count, int sample_rate, const uint8_t *coef, size_t coef_len, uint8_t **aifc, size_t *aifc_len, struct GaudioError *error);
+int gaudio_aifc_to_wav(const uint8_t *aifc, size_t aifc_len, const struct GaudioAifcToWavOptions *options, uint8_t **wav, size_t *wav_len, struct GaudioError *error);
+int gaudio_wav_to_aifc_file(const char *wav_path, const char *aifc_path, const uint8_t *coef, size_t coef_len, const struct GaudioWavToAifcOptions *options, struct GaudioError *error);
+int gaudio_aifc_to_wav_file(const char *aifc_path, const char *wav_path, const struct GaudioAifcToWavOptions *options, struct GaudioError *error);
+int gaudio_aifc_to_pcm(const uint8_t *aifc, size_t aifc_len, int16_t **samples, size_t *sample_count, int *sample_rate, struct GaudioError *error);
+int gaudio_midi_to_cseq(const uint8_t *midi, size_t midi_len, const struct GaudioSeqOptions *options, uint8_t **cseq, size_t *cseq_len, struct GaudioError *error);
+int gaudio_cseq_to_midi(const uint8_t *cseq, size_t cseq_len, const struct GaudioSeqOptions *options, uint8_t **midi, size_t *midi_len, struct GaudioError *error);
+
+#endif
@@ -26,11 +26,13 @@
 #include "machine_config.h"
 #include "common.h"
 #include "utility.h"
+#include "stats.h"
 #include "llist.h"
 #include "naudio.h"
 #include "adpcm_aifc.h"
 #include "wav.h"
 #include "x.h"
+#include "gaudio.h"
 
 /**
  * This file contains main entry for aifc2wav app.
@@ -42,27 +44,18 @@
 #define APPNAME "aifc2wav"
 #define VERSION "1.0"
 
-enum E_FREQ_ADJUST_MODE {
-    FREQ_ADJUST_DEFAULT_UNKNOWN = 0,
-    FREQ_ADJUST_NONE,
-    FREQ_ADJUST_EXPLICIT,
-    FREQ_ADJUST_SEARCH
-};
-
+/**
+ * Indexed by {@code enum GAUDIO_FREQ_ADJUST_MODE}.
+*/
 static const char *FREQ_ADJUST_MODE_NAMES[] = {
-    "unknown",
     "none",
     "explicit",
     "search"
 };
 
-enum E_INST_FILE_SEARCH_MODE {
-    INST_FILE_SEARCH_DEFAULT_UNKNOWN = 0,
-    INST_FILE_SEARCH_USE,
-    INST_FILE_SEARCH_SOUND,
-    INST_FILE_SEARCH_KEYMAP
-};
-
+/**
+ * Indexed by {@code enum GAUDIO_INST_SEARCH_MODE}.
+*/
 static const char *INST_FILE_SEARCH_NAMES[] = {
     "unknown",
     "use",
@@ -89,13 +82,14 @@ static size_t output_filename_len = 0;
 static char *inst_filename = NULL;
 static size_t inst_filename_len = 0;
 static char inst_val[MAX_FILENAME_LEN] = { 0 };
-static int freq_adjust_mode = FREQ_ADJUST_NONE;
-static int inst_search_mode = INST_FILE_SEARCH_DEFAULT_UNKNOWN;
+static int freq_adjust_mode = GAUDIO_FREQ_ADJUST_NONE;
+static int inst_search_mode = GAUDIO_INST_SEARCH_NONE;
 static int keybase = 0;
 static int detune = 0;
 
 #define LONG_OPT_DEBUG        1003
 #define LONG_OPT_FORCE_FREQ_ADJUST        1004
+#define LONG_OPT_STATS        1005
 #define LONG_OPT_INST_FILE    1200
 #define LONG_OPT_INST_SEARCH  1210
 #define LONG_OPT_INST_VAL     1220
@@ -132,6 +126,7 @@ static struct option long_options[] =
     {"quiet",        no_argument,               NULL,  'q' },
     {"verbose",      no_argument,               NULL,  'v' },
     {"debug",        no_argument,               NULL,   LONG_OPT_DEBUG },
+    {"stats",        optional_argument,         NULL,   LONG_OPT_STATS },
     {NULL, 0, NULL, 0}
 };
 
@@ -168,6 +163,7 @@ void print_help(const char * invoke)
     printf("                                  keybase or searching .inst file to use with writing\n");
     printf("                                  wav \"smpl\" chunk.\n");
 
+    printf("    --stats[=json]                print time and throughput per phase when done.\n");
     printf("    -q,--quiet                    suppress output\n");
     printf("    -v,--verbose                  more output\n");
     printf("\n");
@@ -192,11 +188,11 @@ void print_help(const char * invoke)
     printf("\n");
     printf("    --inst-file=FILE              Input .inst file to search. Required.\n");
     printf("    --inst-search=MODE            Search method to use. Required. Available options are:\n");
-    printf("                                  - \"%s\"\n", INST_FILE_SEARCH_NAMES[INST_FILE_SEARCH_USE]);
+    printf("                                  - \"%s\"\n", INST_FILE_SEARCH_NAMES[GAUDIO_INST_SEARCH_USE]);
     printf("                                    Finds `sound` based on trailing text of \"use\" value.\n");
-    printf("                                  - \"%s\"\n", INST_FILE_SEARCH_NAMES[INST_FILE_SEARCH_SOUND]);
+    printf("                                  - \"%s\"\n", INST_FILE_SEARCH_NAMES[GAUDIO_INST_SEARCH_SOUND]);
     printf("                                    Finds `sound` with same name\n");
-    printf("                                  - \"%s\"\n", INST_FILE_SEARCH_NAMES[INST_FILE_SEARCH_KEYMAP]);
+    printf("                                  - \"%s\"\n", INST_FILE_SEARCH_NAMES[GAUDIO_INST_SEARCH_KEYMAP]);
     printf("                                    Finds `keymap` with same name\n");
     printf("    --inst-val=TEXT               Text parameter of search. Required.\n");
     printf("    --force-freq-adjust           By default, frequency adjustments will only be applied on\n");
@@ -303,11 +299,11 @@ void read_opts(int argc, char **argv)
                     stderr_exit(EXIT_CODE_GENERAL, "error, cannot parse keybase as integer: %s\n", optarg);
                 }
 
-                if (freq_adjust_mode == FREQ_ADJUST_DEFAULT_UNKNOWN || freq_adjust_mode == FREQ_ADJUST_NONE)
+                if (freq_adjust_mode == GAUDIO_FREQ_ADJUST_NONE)
                 {
-                    freq_adjust_mode = FREQ_ADJUST_EXPLICIT;
+                    freq_adjust_mode = GAUDIO_FREQ_ADJUST_EXPLICIT;
                 }
-                else if (freq_adjust_mode != FREQ_ADJUST_EXPLICIT)
+                else if (freq_adjust_mode != GAUDIO_FREQ_ADJUST_EXPLICIT)
                 {
                     stderr_exit(EXIT_CODE_GENERAL, "error, keybase can't be specified when freq_adjust_mode=%s\n", FREQ_ADJUST_MODE_NAMES[freq_adjust_mode]);
                 }
@@ -342,11 +338,11 @@ void read_opts(int argc, char **argv)
                     stderr_exit(EXIT_CODE_GENERAL, "error, cannot parse detune as integer: %s\n", optarg);
                 }
 
-                if (freq_adjust_mode == FREQ_ADJUST_DEFAULT_UNKNOWN || freq_adjust_mode == FREQ_ADJUST_NONE)
+                if (freq_adjust_mode == GAUDIO_FREQ_ADJUST_NONE)
                 {
-                    freq_adjust_mode = FREQ_ADJUST_EXPLICIT;
+                    freq_adjust_mode = GAUDIO_FREQ_ADJUST_EXPLICIT;
                 }
-                else if (freq_adjust_mode != FREQ_ADJUST_EXPLICIT)
+                else if (freq_adjust_mode != GAUDIO_FREQ_ADJUST_EXPLICIT)
                 {
                     stderr_exit(EXIT_CODE_GENERAL, "error, keybase can't be specified when freq_adjust_mode=%s\n", FREQ_ADJUST_MODE_NAMES[freq_adjust_mode]);
                 }
@@ -367,11 +363,11 @@ void read_opts(int argc, char **argv)
                 inst_filename = (char *)malloc_zero(inst_filename_len + 1, 1);
                 inst_filename_len = snprintf(inst_filename, inst_filename_len, "%s", optarg);
 
-                if (freq_adjust_mode == FREQ_ADJUST_DEFAULT_UNKNOWN || freq_adjust_mode == FREQ_ADJUST_NONE)
+                if (freq_adjust_mode == GAUDIO_FREQ_ADJUST_NONE)
                 {
-                    freq_adjust_mode = FREQ_ADJUST_SEARCH;
+                    freq_adjust_mode = GAUDIO_FREQ_ADJUST_SEARCH;
                 }
-                else if (freq_adjust_mode != FREQ_ADJUST_SEARCH)
+                else if (freq_adjust_mode != GAUDIO_FREQ_ADJUST_SEARCH)
                 {
                     stderr_exit(EXIT_CODE_GENERAL, "error, inst filename can't be specified when freq_adjust_mode=%s\n", FREQ_ADJUST_MODE_NAMES[freq_adjust_mode]);
                 }
@@ -388,28 +384,28 @@ void read_opts(int argc, char **argv)
                     stderr_exit(EXIT_CODE_GENERAL, "error, inst search not specified\n");
                 }
 
-                if (strncasecmp(optarg, INST_FILE_SEARCH_NAMES[INST_FILE_SEARCH_USE], str_len) == 0)
+                if (strncasecmp(optarg, INST_FILE_SEARCH_NAMES[GAUDIO_INST_SEARCH_USE], str_len) == 0)
                 {
-                    inst_search_mode = INST_FILE_SEARCH_USE;
+                    inst_search_mode = GAUDIO_INST_SEARCH_USE;
                 }
-                else if (strncasecmp(optarg, INST_FILE_SEARCH_NAMES[INST_FILE_SEARCH_SOUND], str_len) == 0)
+                else if (strncasecmp(optarg, INST_FILE_SEARCH_NAMES[GAUDIO_INST_SEARCH_SOUND], str_len) == 0)
                 {
-                    inst_search_mode = INST_FILE_SEARCH_SOUND;
+                    inst_search_mode = GAUDIO_INST_SEARCH_SOUND;
                 }
-                else if (strncasecmp(optarg, INST_FILE_SEARCH_NAMES[INST_FILE_SEARCH_KEYMAP], str_len) == 0)
+                else if (strncasecmp(optarg, INST_FILE_SEARCH_NAMES[GAUDIO_INST_SEARCH_KEYMAP], str_len) == 0)
                 {
-                    inst_search_mode = INST_FILE_SEARCH_KEYMAP;
+                    inst_search_mode = GAUDIO_INST_SEARCH_KEYMAP;
                 }
                 else
                 {
                     stderr_exit(EXIT_CODE_GENERAL, "error, inst search value not recognized:%s\n", optarg);
                 }
 
-                if (freq_adjust_mode == FREQ_ADJUST_DEFAULT_UNKNOWN || freq_adjust_mode == FREQ_ADJUST_NONE)
+                if (freq_adjust_mode == GAUDIO_FREQ_ADJUST_NONE)
                 {
-                    freq_adjust_mode = FREQ_ADJUST_SEARCH;
+                    freq_adjust_mode = GAUDIO_FREQ_ADJUST_SEARCH;
                 }
-                else if (freq_adjust_mode != FREQ_ADJUST_SEARCH)
+                else if (freq_adjust_mode != GAUDIO_FREQ_ADJUST_SEARCH)
                 {
                     stderr_exit(EXIT_CODE_GENERAL, "error, inst search can't be specified when freq_adjust_mode=%s\n", FREQ_ADJUST_MODE_NAMES[freq_adjust_mode]);
                 }
@@ -433,11 +429,11 @@ void read_opts(int argc, char **argv)
 
                 strncpy(inst_val, optarg, str_len);
 
-                if (freq_adjust_mode == FREQ_ADJUST_DEFAULT_UNKNOWN || freq_adjust_mode == FREQ_ADJUST_NONE)
+                if (freq_adjust_mode == GAUDIO_FREQ_ADJUST_NONE)
                 {
-                    freq_adjust_mode = FREQ_ADJUST_SEARCH;
+                    freq_adjust_mode = GAUDIO_FREQ_ADJUST_SEARCH;
                 }
-                else if (freq_adjust_mode != FREQ_ADJUST_SEARCH)
+                else if (freq_adjust_mode != GAUDIO_FREQ_ADJUST_SEARCH)
                 {
                     stderr_exit(EXIT_CODE_GENERAL, "error, inst val can't be specified when freq_adjust_mode=%s\n", FREQ_ADJUST_MODE_NAMES[freq_adjust_mode]);
                 }
@@ -468,6 +464,19 @@ void read_opts(int argc, char **argv)
                 g_verbosity = VERBOSE_DEBUG;
                 break;
 
+            case LONG_OPT_STATS:
+            {
+                int stats_format = stats_parse_format(optarg);
+
+                if (stats_format < 0)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, --stats format not recognized: %s\n", optarg);
+                }
+
+                stats_enable(stats_format);
+            }
+            break;
+
             case '?':
                 print_help(argv[0]);
                 exit(0);
@@ -478,12 +487,9 @@ void read_opts(int argc, char **argv)
 
 int main(int argc, char **argv)
 {
-    struct WavFile *wav_file;
-    struct AdpcmAifcFile *aifc_file;
-    struct FileInfo *input_file;
-    struct FileInfo *inst_file;
-    struct FileInfo *output_file;
-    int skip_freq_adjust = 0;
+    struct GaudioAifcToWavOptions options;
+    struct GaudioError error;
+    uint8_t *inst = NULL;
 
     read_opts(argc, argv);
 
@@ -493,7 +499,7 @@ int main(int argc, char **argv)
         exit(0);
     }
 
-    if (freq_adjust_mode == FREQ_ADJUST_SEARCH)
+    if (freq_adjust_mode == GAUDIO_FREQ_ADJUST_SEARCH)
     {
         if (!opt_inst_file)
         {
@@ -547,150 +553,42 @@ int main(int argc, char **argv)
         fflush(stdout);
     }
 
-    if (freq_adjust_mode == FREQ_ADJUST_SEARCH)
-    {
-        inst_file = FileInfo_fopen(inst_filename, "rb");
-
-        // parse .inst file.
-        struct ALBankFile *bank_file = ALBankFile_new_from_inst(inst_file);
-        struct ALKeyMap *keymap;
-        struct ALSound  *sound;
-     
-        if (inst_search_mode == INST_FILE_SEARCH_USE)
-        {
-            sound = ALBankFile_find_sound_by_aifc_filename(bank_file, inst_val);
-
-            if (sound == NULL)
-            {
-                stderr_exit(EXIT_CODE_GENERAL, "error reading \"%s\", cannot find wavetable referencing file \"%s\"\n", inst_filename, inst_val);
-            }
-
-            keymap = sound->keymap;
-
-            if (keymap == NULL)
-            {
-                stderr_exit(EXIT_CODE_GENERAL, "error reading \"%s\", sound->keymap is NULL\n", inst_filename);
-            }
-        }
-        else if (inst_search_mode == INST_FILE_SEARCH_SOUND)
-        {
-            sound = ALBankFile_find_sound_with_name(bank_file, inst_val);
-
-            if (sound == NULL)
-            {
-                stderr_exit(EXIT_CODE_GENERAL, "error reading \"%s\", cannot find sound with id \"%s\"\n", inst_filename, inst_val);
-            }
-
-            keymap = sound->keymap;
-
-            if (keymap == NULL)
-            {
-                stderr_exit(EXIT_CODE_GENERAL, "error reading \"%s\", sound->keymap is NULL\n", inst_filename);
-            }
-        }
-        else if (inst_search_mode == INST_FILE_SEARCH_KEYMAP)
-        {
-            keymap = ALBankFile_find_keymap_with_name(bank_file, inst_val);
+    GaudioAifcToWavOptions_init(&options);
+    options.loop_count = g_AdpcmLoopInfiniteExportCount;
+    options.write_smpl = opt_write_smpl;
+    options.freq_adjust_mode = freq_adjust_mode;
+    options.force_freq_adjust = opt_force_freq_adjust;
+    options.no_freq_adjust = opt_no_freq_adjust;
 
-            if (keymap == NULL)
-            {
-                stderr_exit(EXIT_CODE_GENERAL, "error reading \"%s\", cannot find keymap with id \"%s\"\n", inst_filename, inst_val);
-            }
-        }
-        else
-        {
-            stderr_exit(EXIT_CODE_GENERAL, "error, invalid inst_search_mode %d\n", inst_search_mode);
-        }
-
-        keybase = keymap->key_base;
-        detune = keymap->detune;
-
-        if (g_verbosity >= VERBOSE_DEBUG)
-        {
-            printf("search> keybase=%d, detune=%d\n", keybase, detune);
-        }
-
-        ALBankFile_free(bank_file);
-        FileInfo_free(inst_file);
-        inst_file = NULL;
+    if (opt_keybase)
+    {
+        options.keybase = keybase;
     }
 
-    input_file = FileInfo_fopen(input_filename, "rb");
-    aifc_file = AdpcmAifcFile_new_from_file(input_file);
-
-    // done with input file
-    FileInfo_free(input_file);
-    input_file = NULL;
-
-    wav_file = WavFile_new_from_aifc(aifc_file);
-
-    if (opt_write_smpl == 1)
+    if (opt_detune)
     {
-        WavFile_check_append_aifc_loop(wav_file, aifc_file);
-        
-        if (wav_file->smpl_chunk != NULL)
-        {
-            wav_file->smpl_chunk->midi_unity_note = keybase;
-        }
+        options.detune = detune;
     }
 
-    /**
-     * It seems the AL_RAW16_WAVE .aifc files don't adjust the frequency, maybe?
-     * So check for that here.
-    */
-    if (aifc_file->comm_chunk != NULL
-        && aifc_file->comm_chunk->compression_type == ADPCM_AIFC_NONE_COMPRESSION_TYPE_ID)
+    if (freq_adjust_mode == GAUDIO_FREQ_ADJUST_SEARCH)
     {
-        skip_freq_adjust = 1;
+        options.inst_len = get_file_contents(inst_filename, &inst);
+        options.inst = inst;
+        options.inst_search_mode = inst_search_mode;
+        options.inst_val = inst_val;
     }
 
-    // done with input aifc file
-    AdpcmAifcFile_free(aifc_file);
-    aifc_file = NULL;
-
-    // check if freq adjustment is necessary
-    if (
-        /**
-         * if the user passed explicit detune parameters
-        */
-        (freq_adjust_mode == FREQ_ADJUST_EXPLICIT)
-        /**
-         * Or, the user is automating this and said to search .inst file for
-         * detune parameters.
-        */
-        || (freq_adjust_mode == FREQ_ADJUST_SEARCH &&
-            /**
-             * And the user said to always adjust the frequency,
-             * or to automatically adjust if this is ADPCM compression but skip `NONE`.
-            */
-            (opt_force_freq_adjust == 1 || skip_freq_adjust == 0)))
+    // decoded sound data is written in blocks.
+    if (gaudio_aifc_to_wav_file(input_filename, output_filename, &options, &error) != GAUDIO_OK)
     {
-
-        // freq_adjust could have been set because the wav "smpl" chunk was written,
-        // so also check for override disable here.
-        if (opt_no_freq_adjust == 0)
-        {
-            double freq = WavFile_get_frequency(wav_file);
-            double new_freq = detune_frequency(freq, keybase, detune);
-
-            if (g_verbosity >= VERBOSE_DEBUG)
-            {
-                printf("adjust wav freq to %f\n", new_freq);
-            }
-
-            WavFile_set_frequency(wav_file, new_freq);
-        }
+        stderr_exit(error.code, "%s\n", error.message);
     }
 
-    output_file = FileInfo_fopen(output_filename, "wb");
-
-    WavFile_fwrite(wav_file, output_file);
-
-    // done with wav file
-    WavFile_free(wav_file);
-    wav_file = NULL;
-
-    FileInfo_free(output_file);
+    if (inst != NULL)
+    {
+        free(inst);
+        inst = NULL;
+    }
 
     if (input_filename != NULL)
     {
@@ -709,6 +607,8 @@ int main(int argc, char **argv)
         free(inst_filename);
         inst_filename = NULL;
     }
+
+    stats_print(stdout, APPNAME);
     
     return 0;
 }
\ No newline at end of file
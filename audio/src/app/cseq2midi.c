@@ -20,12 +20,16 @@
 #include <stdint.h>
 #include <string.h>
 #include <getopt.h>
+#include <errno.h>
 #include "debug.h"
 #include "machine_config.h"
 #include "common.h"
 #include "utility.h"
+#include "stats.h"
+#include "parallel.h"
 #include "midi.h"
 #include "x.h"
+#include "gaudio.h"
 
 /**
  * This file contains main entry for cseq2midi app.
@@ -54,11 +58,13 @@ static size_t pattern_filename_len = 0;
 
 #define LONG_OPT_DEBUG   1003
 #define LONG_OPT_PARSE_DEBUG   1004
+#define LONG_OPT_STATS   1005
 
 #define LONG_OPT_WRITE_SEQ_TRACK   2001
 #define LONG_OPT_NO_PATTERN_COMPRESSION   2002
 #define LONG_OPT_PATTERN_FILE  2003
 #define LONG_OPT_EXPORT_INVALID_LOOP  2004
+#define LONG_OPT_THREADS  2005
 
 static struct option long_options[] =
 {
@@ -69,9 +75,11 @@ static struct option long_options[] =
     {"no-pattern-compression",    no_argument,  NULL,  LONG_OPT_NO_PATTERN_COMPRESSION },
     {"pattern-file",        required_argument,  NULL,  LONG_OPT_PATTERN_FILE },
     {"export-invalid-loop", no_argument,        NULL,  LONG_OPT_EXPORT_INVALID_LOOP },
+    {"threads",             required_argument,  NULL,  LONG_OPT_THREADS },
     {"quiet",        no_argument,               NULL,  'q' },
     {"verbose",      no_argument,               NULL,  'v' },
     {"debug",        no_argument,               NULL,   LONG_OPT_DEBUG },
+    {"stats",        optional_argument,         NULL,   LONG_OPT_STATS },
     {"parsedebug",   no_argument,               NULL,   LONG_OPT_PARSE_DEBUG },
     {NULL, 0, NULL, 0}
 };
@@ -80,7 +88,7 @@ static struct option long_options[] =
 
 void print_help(const char * invoke);
 void read_opts(int argc, char **argv);
-static void write_seq_track(struct GmidTrack *gtrack);
+static void write_seq_track(int track_index, const uint8_t *data, size_t len);
 
 // end forward declarations
 
@@ -106,12 +114,16 @@ void print_help(const char * invoke)
     printf("                                  like 0xfe. This option disables that.\n");
     printf("    --pattern-file=FILE           Saves all pattern markers (with track number) to\n");
     printf("                                  specified file. Only applies when pattern compression\n");
-    printf("                                  is not disabled.\n");
+    printf("                                  is not disabled. If FILE ends with .bin the markers\n");
+    printf("                                  are written in binary format, otherwise as text.\n");
     printf("    --export-invalid-loop         The retail version of the game has 72 invalid seq loop events\n");
     printf("                                  (no start, no end, invalid offset, etc), this flag will\n");
     printf("                                  convert those events to MIDI system exclusive command to \n");
     printf("                                  include in output. Otherwise these events are not included\n");
     printf("                                  in the output file.\n");
+    printf("    --threads=INT                 Number of threads used to convert tracks. Default is\n");
+    printf("                                  the number of processors. Use 1 to disable.\n");
+    printf("    --stats[=json]                print time and throughput per phase when done.\n");
     printf("    -q,--quiet                    suppress output\n");
     printf("    -v,--verbose                  more output\n");
     printf("\n");
@@ -175,6 +187,30 @@ void read_opts(int argc, char **argv)
             }
             break;
 
+            case LONG_OPT_THREADS:
+            {
+                int res;
+                char *pend = NULL;
+
+                errno = 0;
+                res = strtol(optarg, &pend, 0);
+
+                if (pend != NULL && *pend == '\0')
+                {
+                    if (errno == ERANGE || res < 0)
+                    {
+                        stderr_exit(EXIT_CODE_GENERAL, "error, invalid number of threads: %s\n", optarg);
+                    }
+
+                    g_parallel_num_threads = res;
+                }
+                else
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, cannot parse threads as integer: %s\n", optarg);
+                }
+            }
+            break;
+
             case 'q':
                 g_verbosity = 0;
                 break;
@@ -203,6 +239,19 @@ void read_opts(int argc, char **argv)
                 g_midi_parse_debug = 1;
                 break;
 
+            case LONG_OPT_STATS:
+            {
+                int stats_format = stats_parse_format(optarg);
+
+                if (stats_format < 0)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, --stats format not recognized: %s\n", optarg);
+                }
+
+                stats_enable(stats_format);
+            }
+            break;
+
             case '?':
                 print_help(argv[0]);
                 exit(0);
@@ -213,12 +262,13 @@ void read_opts(int argc, char **argv)
 
 int main(int argc, char **argv)
 {
-    struct MidiFile *midi_file;
-    struct CseqFile *cseq_file;
-    struct FileInfo *input_file;
+    struct GaudioSeqOptions options;
+    struct GaudioError error;
     struct FileInfo *output_file;
-    struct MidiConvertOptions *convert_options;
-    f_GmidTrack_callback unroll_action = NULL;
+    uint8_t *input = NULL;
+    size_t input_len;
+    uint8_t *output;
+    size_t output_len;
 
     read_opts(argc, argv);
 
@@ -259,44 +309,42 @@ int main(int argc, char **argv)
         fflush(stdout);
     }
 
+    stats_phase_begin("read");
+    input_len = get_file_contents(input_filename, &input);
+    stats_add_bytes("read", input_len);
+    stats_phase_end("read");
+
+    GaudioSeqOptions_init(&options);
+    options.no_pattern_compression = opt_no_pattern_compression;
+    options.sysex_seq_loops = opt_export_invalid_loop;
+
     if (opt_write_seq_track)
     {
-        unroll_action = write_seq_track;
+        options.track_callback = write_seq_track;
     }
 
-    input_file = FileInfo_fopen(input_filename, "rb");
-    cseq_file = CseqFile_new_from_file(input_file);
-
-    // done with input file
-    FileInfo_free(input_file);
-    input_file = NULL;
-
-    convert_options = MidiConvertOptions_new();
-    convert_options->post_unroll_action = unroll_action;
-    convert_options->no_pattern_compression = opt_no_pattern_compression;
-    convert_options->sysex_seq_loops = opt_export_invalid_loop;
     if (opt_use_pattern_file)
     {
-        convert_options->use_pattern_marker_file = 1;
-        convert_options->pattern_marker_filename = pattern_filename;
+        options.pattern_file = pattern_filename;
     }
 
-    midi_file = MidiFile_from_CseqFile(cseq_file, convert_options);
+    if (gaudio_cseq_to_midi(input, input_len, &options, &output, &output_len, &error) != GAUDIO_OK)
+    {
+        stderr_exit(error.code, "%s\n", error.message);
+    }
 
-    // done with source cseq file
-    CseqFile_free(cseq_file);
-    cseq_file = NULL;
+    // done with input file
+    free(input);
+    input = NULL;
 
     // write to output file
+    stats_phase_begin("write");
     output_file = FileInfo_fopen(output_filename, "wb");
-    MidiFile_fwrite(midi_file, output_file);
-
-    // done with MIDI file
-    MidiFile_free(midi_file);
-    midi_file = NULL;
-
+    FileInfo_fwrite(output_file, output, output_len, 1);
+    stats_add_bytes("write", output_len);
     FileInfo_free(output_file);
-    MidiConvertOptions_free(convert_options);
+    gaudio_buffer_free(output);
+    stats_phase_end("write");
     
     if (input_filename != NULL)
     {
@@ -315,11 +363,19 @@ int main(int argc, char **argv)
         free(pattern_filename);
         pattern_filename = NULL;
     }
+
+    stats_print(stdout, APPNAME);
     
     return 0;
 }
 
-static void write_seq_track(struct GmidTrack *gtrack)
+/**
+ * Writes seq track data to file, named after the output file and track index.
+ * @param track_index: seq track index.
+ * @param data: seq track data.
+ * @param len: length of data in bytes.
+*/
+static void write_seq_track(int track_index, const uint8_t *data, size_t len)
 {
     TRACE_ENTER(__func__)
 
@@ -330,11 +386,11 @@ static void write_seq_track(struct GmidTrack *gtrack)
     memset(new_filename, 0, MAX_FILENAME_LEN);
     memset(new_extension, 0, 20);
 
-    sprintf(new_extension, "-track-%03d%s", gtrack->cseq_track_index, MIDI_N64_DEFAULT_EXTENSION);
+    sprintf(new_extension, "-track-%03d%s", track_index, MIDI_N64_DEFAULT_EXTENSION);
     change_filename_extension(output_filename, new_filename, new_extension, MAX_FILENAME_LEN);
 
     fi = FileInfo_fopen(new_filename, "wb");
-    FileInfo_fwrite(fi, gtrack->cseq_data, gtrack->cseq_data_len, 1);
+    FileInfo_fwrite(fi, data, len, 1);
     FileInfo_free(fi);
 
     TRACE_LEAVE(__func__)
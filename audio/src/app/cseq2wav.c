@@ -0,0 +1,448 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+#include "debug.h"
+#include "machine_config.h"
+#include "common.h"
+#include "utility.h"
+#include "stats.h"
+#include "naudio.h"
+#include "midi.h"
+#include "wav.h"
+#include "pcm_cache.h"
+#include "render.h"
+
+/**
+ * This file contains main entry for cseq2wav app.
+ * 
+ * This app plays a compressed MIDI for N64 playback against a sound
+ * bank (.ctl/.tbl) and writes the result to a 16 bit stereo .wav file.
+ * This is meant for previewing seq files, not an accurate recreation
+ * of the N64 audio library.
+*/
+
+#define APPNAME "cseq2wav"
+#define VERSION "1.0"
+
+static int opt_help_flag = 0;
+static int opt_input_file = 0;
+static int opt_output_file = 0;
+static int opt_ctl_file = 0;
+static int opt_tbl_file = 0;
+static int opt_bank_index = 0;
+static int opt_sample_rate = 0;
+static int opt_max_voices = RENDER_DEFAULT_MAX_VOICES;
+static int opt_tail_ms = RENDER_DEFAULT_TAIL_MS;
+static int opt_cache_size_mb = 0;
+static char *input_filename = NULL;
+static size_t input_filename_len = 0;
+static char *output_filename = NULL;
+static size_t output_filename_len = 0;
+static char *ctl_filename = NULL;
+static size_t ctl_filename_len = 0;
+static char *tbl_filename = NULL;
+static size_t tbl_filename_len = 0;
+static char *cache_dir = NULL;
+static size_t cache_dir_len = 0;
+
+#define LONG_OPT_DEBUG   1003
+#define LONG_OPT_STATS   1005
+
+#define LONG_OPT_BANK   2001
+#define LONG_OPT_SAMPLE_RATE   2002
+#define LONG_OPT_VOICES   2003
+#define LONG_OPT_TAIL   2004
+#define LONG_OPT_CACHE_DIR   2005
+#define LONG_OPT_CACHE_SIZE   2006
+
+static struct option long_options[] =
+{
+    {"help",         no_argument,     &opt_help_flag,   1  },
+    {"in",     required_argument,               NULL,  'n' },
+    {"out",    required_argument,               NULL,  'o' },
+    {"ctl",    required_argument,               NULL,  'c' },
+    {"tbl",    required_argument,               NULL,  't' },
+    {"bank",          required_argument,        NULL,  LONG_OPT_BANK },
+    {"sample-rate",   required_argument,        NULL,  LONG_OPT_SAMPLE_RATE },
+    {"voices",        required_argument,        NULL,  LONG_OPT_VOICES },
+    {"tail",          required_argument,        NULL,  LONG_OPT_TAIL },
+    {"cache-dir",     required_argument,        NULL,  LONG_OPT_CACHE_DIR },
+    {"cache-size",    required_argument,        NULL,  LONG_OPT_CACHE_SIZE },
+    {"quiet",        no_argument,               NULL,  'q' },
+    {"verbose",      no_argument,               NULL,  'v' },
+    {"debug",        no_argument,               NULL,   LONG_OPT_DEBUG },
+    {"stats",        optional_argument,         NULL,   LONG_OPT_STATS },
+    {NULL, 0, NULL, 0}
+};
+
+// forward declarations
+
+void print_help(const char * invoke);
+void read_opts(int argc, char **argv);
+static int parse_int_option(const char *name, char *value);
+static void copy_option_string(char **dest, size_t *dest_len, const char *name, char *value);
+static double elapsed_seconds(struct timespec *start);
+
+// end forward declarations
+
+void print_help(const char * invoke)
+{
+    printf("%s %s help\n", APPNAME, VERSION);
+    printf("\n");
+    printf("Renders n64 compressed format MIDI to .wav using instruments from a sound bank\n");
+    printf("usage:\n");
+    printf("\n");
+    printf("    %s --in file --ctl file --tbl file\n", invoke);
+    printf("\n");
+    printf("options:\n");
+    printf("\n");
+    printf("    --help                        print this help\n");
+    printf("    -n,--in=FILE                  input .seq file to render (required)\n");
+    printf("    -c,--ctl=FILE                 .ctl input file (required)\n");
+    printf("    -t,--tbl=FILE                 .tbl input file (required)\n");
+    printf("    -o,--out=FILE                 output file. Optional. If not provided, will\n");
+    printf("                                  reuse the input file name but change extension.\n");
+    printf("    --bank=INT                    index of bank in .ctl file to use. Default is 0.\n");
+    printf("    --sample-rate=INT             output sample rate. Default is the bank sample rate.\n");
+    printf("    --voices=INT                  max number of notes playing at the same time.\n");
+    printf("                                  Default is %d, max is %d.\n", RENDER_DEFAULT_MAX_VOICES, RENDER_MAX_VOICES);
+    printf("    --tail=INT                    max time in milliseconds to keep rendering after\n");
+    printf("                                  the last event. Default is %d.\n", RENDER_DEFAULT_TAIL_MS);
+    printf("    --cache-dir=DIR               save decoded wavetables to directory, and reuse\n");
+    printf("                                  them on later runs instead of decoding again.\n");
+    printf("    --cache-size=INT              memory budget in MB for decoded wavetables.\n");
+    printf("                                  Default is %d.\n", PCM_CACHE_DEFAULT_MAX_BYTES / (1024 * 1024));
+    printf("    --stats[=json]                print time and throughput per phase when done.\n");
+    printf("    -q,--quiet                    suppress output\n");
+    printf("    -v,--verbose                  more output\n");
+    printf("\n");
+    fflush(stdout);
+}
+
+void read_opts(int argc, char **argv)
+{
+    int option_index = 0;
+    int ch;
+
+    while ((ch = getopt_long(argc, argv, "n:o:c:t:qv", long_options, &option_index)) != -1)
+    {
+        switch (ch)
+        {
+            case 'n':
+                opt_input_file = 1;
+                copy_option_string(&input_filename, &input_filename_len, "input", optarg);
+                break;
+
+            case 'o':
+                opt_output_file = 1;
+                copy_option_string(&output_filename, &output_filename_len, "output", optarg);
+                break;
+
+            case 'c':
+                opt_ctl_file = 1;
+                copy_option_string(&ctl_filename, &ctl_filename_len, "ctl", optarg);
+                break;
+
+            case 't':
+                opt_tbl_file = 1;
+                copy_option_string(&tbl_filename, &tbl_filename_len, "tbl", optarg);
+                break;
+
+            case LONG_OPT_BANK:
+                opt_bank_index = parse_int_option("bank", optarg);
+                break;
+
+            case LONG_OPT_SAMPLE_RATE:
+                opt_sample_rate = parse_int_option("sample rate", optarg);
+                break;
+
+            case LONG_OPT_VOICES:
+            {
+                opt_max_voices = parse_int_option("voices", optarg);
+
+                if (opt_max_voices < 1 || opt_max_voices > RENDER_MAX_VOICES)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, voices must be between 1 and %d\n", RENDER_MAX_VOICES);
+                }
+            }
+            break;
+
+            case LONG_OPT_TAIL:
+                opt_tail_ms = parse_int_option("tail", optarg);
+                break;
+
+            case LONG_OPT_CACHE_DIR:
+                copy_option_string(&cache_dir, &cache_dir_len, "cache", optarg);
+                break;
+
+            case LONG_OPT_CACHE_SIZE:
+                opt_cache_size_mb = parse_int_option("cache size", optarg);
+                break;
+
+            case 'q':
+                g_verbosity = 0;
+                break;
+
+            case 'v':
+                g_verbosity = 2;
+                break;
+
+            case LONG_OPT_DEBUG:
+                g_verbosity = VERBOSE_DEBUG;
+                break;
+
+            case LONG_OPT_STATS:
+            {
+                int stats_format = stats_parse_format(optarg);
+
+                if (stats_format < 0)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, --stats format not recognized: %s\n", optarg);
+                }
+
+                stats_enable(stats_format);
+            }
+            break;
+
+            case '?':
+                print_help(argv[0]);
+                exit(0);
+                break;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct CseqFile *cseq_file;
+    struct ALBankFile *bank_file;
+    struct WavFile *wav_file;
+    struct FileInfo *input_file;
+    struct FileInfo *ctl_file;
+    struct FileInfo *output_file;
+    struct RenderOptions *render_options;
+    struct PcmCache *pcm_cache;
+    struct timespec start;
+    uint8_t *tbl_file_contents = NULL;
+    size_t tbl_file_len;
+    double render_seconds;
+    double audio_seconds;
+
+    read_opts(argc, argv);
+
+    if (opt_help_flag || !opt_input_file || !opt_ctl_file || !opt_tbl_file)
+    {
+        print_help(argv[0]);
+        exit(0);
+    }
+
+    // if the user didn't provide an output filename, reuse the input filename.
+    if (!opt_output_file)
+    {
+        output_filename_len = snprintf(NULL, 0, "%s%s", input_filename, WAV_DEFAULT_EXTENSION) + 1; // overallocate
+        output_filename = (char *)malloc_zero(output_filename_len + 1, 1);
+
+        change_filename_extension(input_filename, output_filename, WAV_DEFAULT_EXTENSION, output_filename_len);
+    }
+
+    if (g_verbosity >= VERBOSE_DEBUG)
+    {
+        printf("g_verbosity: %d\n", g_verbosity);
+        printf("opt_help_flag: %d\n", opt_help_flag);
+        printf("opt_input_file: %d\n", opt_input_file);
+        printf("opt_output_file: %d\n", opt_output_file);
+        printf("input_filename: %s\n", input_filename != NULL ? input_filename : "NULL");
+        printf("output_filename: %s\n", output_filename != NULL ? output_filename : "NULL");
+        printf("ctl_filename: %s\n", ctl_filename != NULL ? ctl_filename : "NULL");
+        printf("tbl_filename: %s\n", tbl_filename != NULL ? tbl_filename : "NULL");
+        printf("opt_bank_index: %d\n", opt_bank_index);
+        printf("opt_sample_rate: %d\n", opt_sample_rate);
+        printf("opt_max_voices: %d\n", opt_max_voices);
+        printf("opt_tail_ms: %d\n", opt_tail_ms);
+        printf("cache_dir: %s\n", cache_dir != NULL ? cache_dir : "NULL");
+        printf("opt_cache_size_mb: %d\n", opt_cache_size_mb);
+        fflush(stdout);
+    }
+
+    stats_phase_begin("read");
+    input_file = FileInfo_fopen(input_filename, "rb");
+    cseq_file = CseqFile_new_from_file(input_file);
+    stats_add_bytes("read", input_file->len);
+
+    // done with input file
+    FileInfo_free(input_file);
+    input_file = NULL;
+
+    ctl_file = FileInfo_fopen(ctl_filename, "rb");
+    bank_file = ALBankFile_new_from_ctl(ctl_file);
+    stats_add_bytes("read", ctl_file->len);
+
+    // done with ctl file
+    FileInfo_free(ctl_file);
+    ctl_file = NULL;
+
+    tbl_file_len = get_file_contents(tbl_filename, &tbl_file_contents);
+    stats_add_bytes("read", tbl_file_len);
+    stats_phase_end("read");
+
+    render_options = RenderOptions_new();
+    render_options->bank_index = opt_bank_index;
+    render_options->sample_rate = opt_sample_rate;
+    render_options->max_voices = opt_max_voices;
+    render_options->tail_ms = opt_tail_ms;
+
+    pcm_cache = PcmCache_new((size_t)opt_cache_size_mb * 1024 * 1024, cache_dir);
+    render_options->pcm_cache = pcm_cache;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    stats_phase_begin("render");
+
+    wav_file = WavFile_new_from_cseq(cseq_file, bank_file, tbl_file_contents, render_options);
+
+    stats_phase_end("render");
+    render_seconds = elapsed_seconds(&start);
+
+    stats_add_items("render", "frames", (uint64_t)wav_file->data_chunk->ck_data_size / (uint64_t)wav_file->fmt_chunk->block_align);
+
+    if (g_verbosity > 1)
+    {
+        audio_seconds = (double)wav_file->data_chunk->ck_data_size / (double)wav_file->fmt_chunk->byte_rate;
+
+        printf("rendered %.2f seconds of audio in %.3f seconds", audio_seconds, render_seconds);
+        if (render_seconds > 0)
+        {
+            printf(" (%.1fx real time)", audio_seconds / render_seconds);
+        }
+        printf("\n");
+        printf("wavetables: %d decoded, %d loaded from disk cache\n", pcm_cache->misses, pcm_cache->disk_hits);
+        fflush(stdout);
+    }
+
+    // write to output file
+    stats_phase_begin("write");
+    output_file = FileInfo_fopen(output_filename, "wb");
+    WavFile_fwrite(wav_file, output_file);
+    stats_add_bytes("write", (uint64_t)FileInfo_ftell(output_file));
+
+    FileInfo_free(output_file);
+    stats_phase_end("write");
+    WavFile_free(wav_file);
+    RenderOptions_free(render_options);
+    PcmCache_free(pcm_cache);
+    CseqFile_free(cseq_file);
+    ALBankFile_free(bank_file);
+    free(tbl_file_contents);
+
+    if (input_filename != NULL)
+    {
+        free(input_filename);
+        input_filename = NULL;
+    }
+
+    if (output_filename != NULL)
+    {
+        free(output_filename);
+        output_filename = NULL;
+    }
+
+    if (ctl_filename != NULL)
+    {
+        free(ctl_filename);
+        ctl_filename = NULL;
+    }
+
+    if (tbl_filename != NULL)
+    {
+        free(tbl_filename);
+        tbl_filename = NULL;
+    }
+
+    if (cache_dir != NULL)
+    {
+        free(cache_dir);
+        cache_dir = NULL;
+    }
+
+    stats_print(stdout, APPNAME);
+
+    return 0;
+}
+
+static int parse_int_option(const char *name, char *value)
+{
+    TRACE_ENTER(__func__)
+
+    int res;
+    char *pend = NULL;
+
+    errno = 0;
+    res = strtol(value, &pend, 0);
+
+    if (pend == NULL || *pend != '\0')
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "error, cannot parse %s as integer: %s\n", name, value);
+    }
+
+    if (errno == ERANGE || res < 0)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "error, invalid %s: %s\n", name, value);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return res;
+}
+
+static void copy_option_string(char **dest, size_t *dest_len, const char *name, char *value)
+{
+    TRACE_ENTER(__func__)
+
+    *dest_len = snprintf(NULL, 0, "%s", value) + 1;
+
+    if (*dest_len < 1)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "error, %s filename not specified\n", name);
+    }
+
+    *dest = (char *)malloc_zero(*dest_len + 1, 1);
+    *dest_len = snprintf(*dest, *dest_len, "%s", value);
+
+    TRACE_LEAVE(__func__)
+}
+
+static double elapsed_seconds(struct timespec *start)
+{
+    TRACE_ENTER(__func__)
+
+    struct timespec now;
+    double result;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    result = (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1000000000.0;
+
+    TRACE_LEAVE(__func__)
+
+    return result;
+}
@@ -0,0 +1,242 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "debug.h"
+#include "machine_config.h"
+#include "common.h"
+#include "utility.h"
+#include "ipc.h"
+
+/**
+ * This file contains main entry for gaudioc app.
+ * 
+ * This app sends a conversion request to gaudiod and prints the
+ * result. Tool options are the same as the standalone app.
+*/
+
+#define APPNAME "gaudioc"
+#define VERSION "1.0"
+
+static int opt_help_flag = 0;
+static char socket_path[PATH_MAX] = { 0 };
+
+static struct option long_options[] =
+{
+    {"help",         no_argument,     &opt_help_flag,   1  },
+    {"socket",       required_argument,         NULL,  's' },
+    {NULL, 0, NULL, 0}
+};
+
+// forward declarations
+
+void print_help(const char * invoke);
+void read_opts(int argc, char **argv);
+
+static uint32_t read_response_u32(uint8_t *response, size_t response_len, size_t *pos);
+
+// end forward declarations
+
+void print_help(const char * invoke)
+{
+    printf("%s %s help\n", APPNAME, VERSION);
+    printf("\n");
+    printf("Sends a conversion request to a running gaudiod server. Tool options are the same\n");
+    printf("as the standalone app. Relative paths are resolved from the current directory.\n");
+    printf("Output and exit code are the same as the standalone app.\n");
+    printf("usage:\n");
+    printf("\n");
+    printf("    %s [--socket path] TOOL [tool options]\n", invoke);
+    printf("\n");
+    printf("options:\n");
+    printf("\n");
+    printf("    --help                        print this help\n");
+    printf("    -s,--socket=PATH              socket path. Optional. Default is ${%s} if set,\n", IPC_SOCKET_ENV);
+    printf("                                  otherwise ${%s}/%s if set,\n", IPC_RUNTIME_DIR_ENV, IPC_SOCKET_NAME);
+    printf("                                  otherwise /tmp/gaudiod-UID/%s\n", IPC_SOCKET_NAME);
+    printf("\n");
+    printf("example:\n");
+    printf("\n");
+    printf("    %s wav2aifc --in sound.wav --coef sound.coef --out sound.aifc\n", invoke);
+    printf("\n");
+    fflush(stdout);
+}
+
+void read_opts(int argc, char **argv)
+{
+    int option_index = 0;
+    int ch;
+
+    // "+" stops at the first non-option argument, the tool name.
+    while ((ch = getopt_long(argc, argv, "+s:", long_options, &option_index)) != -1)
+    {
+        switch (ch)
+        {
+            case 's':
+            {
+                if (strlen(optarg) < 1 || strlen(optarg) >= PATH_MAX)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, invalid socket path\n");
+                }
+
+                snprintf(socket_path, PATH_MAX, "%s", optarg);
+            }
+            break;
+
+            case '?':
+                print_help(argv[0]);
+                exit(0);
+                break;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char cwd[PATH_MAX];
+    char **strings;
+    uint8_t *request;
+    size_t request_len;
+    uint8_t *response = NULL;
+    size_t response_len = 0;
+    size_t pos = 0;
+    int string_count;
+    int exit_code;
+    uint32_t text_len;
+    int fd;
+    int i;
+
+    read_opts(argc, argv);
+
+    if (opt_help_flag || optind >= argc)
+    {
+        print_help(argv[0]);
+        exit(0);
+    }
+
+    if (socket_path[0] == '\0')
+    {
+        const char *env_path = getenv(IPC_SOCKET_ENV);
+
+        if (env_path != NULL && env_path[0] != '\0')
+        {
+            snprintf(socket_path, PATH_MAX, "%s", env_path);
+        }
+        else if (ipc_default_socket_path(socket_path, PATH_MAX, 0) != IPC_OK)
+        {
+            stderr_exit(EXIT_CODE_IO, "error, cannot resolve default socket path\n");
+        }
+    }
+
+    if (getcwd(cwd, PATH_MAX) == NULL)
+    {
+        stderr_exit(EXIT_CODE_IO, "error, cannot get current directory\n");
+    }
+
+    // request is: working directory, tool name, tool options
+    string_count = 1 + (argc - optind);
+    if (string_count > IPC_MAX_STRINGS)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "error, too many arguments\n");
+    }
+
+    strings = (char **)malloc_zero(string_count, sizeof(char *));
+    strings[0] = cwd;
+    for (i=optind; i<argc; i++)
+    {
+        strings[1 + i - optind] = argv[i];
+    }
+
+    request = ipc_pack_strings(string_count, strings, &request_len);
+    free(strings);
+
+    fd = ipc_connect_unix(socket_path);
+    if (fd < 0)
+    {
+        stderr_exit(EXIT_CODE_IO, "error, cannot connect to %s (is gaudiod running?)\n", socket_path);
+    }
+
+    if (ipc_write_message(fd, request, request_len) != IPC_OK
+        || ipc_read_message(fd, &response, &response_len) != IPC_OK)
+    {
+        stderr_exit(EXIT_CODE_IO, "error, no response from %s\n", socket_path);
+    }
+
+    close(fd);
+    free(request);
+
+    exit_code = (int)read_response_u32(response, response_len, &pos);
+
+    text_len = read_response_u32(response, response_len, &pos);
+    if (text_len > response_len - pos)
+    {
+        stderr_exit(EXIT_CODE_IO, "error, invalid response\n");
+    }
+    fwrite(&response[pos], 1, text_len, stdout);
+    pos += text_len;
+
+    text_len = read_response_u32(response, response_len, &pos);
+    if (text_len > response_len - pos)
+    {
+        stderr_exit(EXIT_CODE_IO, "error, invalid response\n");
+    }
+    fwrite(&response[pos], 1, text_len, stderr);
+    pos += text_len;
+
+    free(response);
+
+    fflush(stdout);
+    fflush(stderr);
+
+    return exit_code;
+}
+
+/**
+ * Reads big endian 32 bit value from response.
+ * @param response: response message.
+ * @param response_len: length of response.
+ * @param pos: in/out parameter. Current position, incremented past value.
+ * @returns: value.
+*/
+static uint32_t read_response_u32(uint8_t *response, size_t response_len, size_t *pos)
+{
+    TRACE_ENTER(__func__)
+
+    uint32_t value;
+
+    if (response_len < 4 || *pos > response_len - 4)
+    {
+        stderr_exit(EXIT_CODE_IO, "error, invalid response\n");
+    }
+
+    value = ((uint32_t)response[*pos] << 24)
+        | ((uint32_t)response[*pos + 1] << 16)
+        | ((uint32_t)response[*pos + 2] << 8)
+        | (uint32_t)response[*pos + 3];
+
+    *pos += 4;
+
+    TRACE_LEAVE(__func__)
+
+    return value;
+}
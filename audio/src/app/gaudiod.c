@@ -0,0 +1,2620 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <getopt.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "debug.h"
+#include "machine_config.h"
+#include "common.h"
+#include "utility.h"
+#include "llist.h"
+#include "stats.h"
+#include "gaudio_error.h"
+#include "parallel.h"
+#include "ipc.h"
+#include "naudio.h"
+#include "adpcm_aifc.h"
+#include "wav.h"
+#include "wav_convert.h"
+#include "midi.h"
+#include "pcm_cache.h"
+#include "render.h"
+#include "x.h"
+#ifndef NOGSL
+#include "magic.h"
+#endif
+
+/**
+ * This file contains main entry for gaudiod app.
+ * 
+ * This app is a conversion server. It listens on a Unix domain socket
+ * and runs conversion requests sent by gaudioc, using the same arguments
+ * as the standalone apps. Parsed codebooks and sound banks are kept in
+ * memory between requests.
+ *
+ * Requests are handled by a pool of worker processes. Each request runs in
+ * {@code gaudio_try}, so a library error is sent back to the client and the worker
+ * keeps its caches. Memory allocated by the failed request is released, including
+ * anything attached to cached objects it used, so the cache entries used by the
+ * request are dropped (without freeing, see {@code GaudiodCache_drop_request}).
+ * Anything else that ends the worker still sends a response from an exit handler,
+ * and the worker is replaced.
+ *
+ * Request message: packed strings (see {@code ipc_pack_strings}):
+ *     client working directory, tool name, tool arguments...
+ *
+ * Response message:
+ *     4 byte big endian exit code
+ *     4 byte big endian length of stdout text, followed by text
+ *     4 byte big endian length of stderr text, followed by text
+*/
+
+#define APPNAME "gaudiod"
+#define VERSION "1.0"
+
+/**
+ * Listen backlog.
+*/
+#define GAUDIOD_BACKLOG 64
+
+/**
+ * Max number of entries in each worker cache.
+*/
+#define GAUDIOD_DEFAULT_CACHE_ENTRIES 32
+
+/**
+ * Max length of cache key (one or two absolute paths).
+*/
+#define GAUDIOD_CACHE_KEY_LEN (2 * PATH_MAX + 2)
+
+/**
+ * Max number of files a cache entry depends on.
+*/
+#define GAUDIOD_CACHE_MAX_STAMPS 2
+
+/**
+ * Sanity check, max number of worker processes.
+*/
+#define GAUDIOD_MAX_WORKERS 256
+
+/**
+ * Max length of captured stdout or stderr text returned to client.
+*/
+#define GAUDIOD_MAX_CAPTURE_LEN (IPC_MAX_MESSAGE_LEN / 2 - 16)
+
+static int opt_help_flag = 0;
+static int opt_num_workers = 0;
+static int opt_cache_entries = GAUDIOD_DEFAULT_CACHE_ENTRIES;
+static int opt_pcm_cache_size_mb = 0;
+static char socket_path[PATH_MAX] = { 0 };
+
+#define LONG_OPT_DEBUG        1003
+#define LONG_OPT_STATS        1005
+#define LONG_OPT_THREADS      1006
+
+#define LONG_OPT_WORKERS      2001
+#define LONG_OPT_CACHE_ENTRIES   2002
+#define LONG_OPT_CACHE_SIZE   2003
+
+static struct option long_options[] =
+{
+    {"help",         no_argument,     &opt_help_flag,   1  },
+    {"socket",       required_argument,         NULL,  's' },
+    {"workers",      required_argument,         NULL,   LONG_OPT_WORKERS },
+    {"cache-entries",  required_argument,       NULL,   LONG_OPT_CACHE_ENTRIES },
+    {"cache-size",   required_argument,         NULL,   LONG_OPT_CACHE_SIZE },
+    {"quiet",        no_argument,               NULL,  'q' },
+    {"verbose",      no_argument,               NULL,  'v' },
+    {"debug",        no_argument,               NULL,   LONG_OPT_DEBUG },
+    {NULL, 0, NULL, 0}
+};
+
+/**
+ * Identifies version of a file on disk, used to detect changes to cached files.
+*/
+struct GaudiodFileStamp {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+};
+
+typedef void (*f_GaudiodCacheEntry_free)(void *data);
+
+/**
+ * Parsed file(s) kept in memory between requests.
+*/
+struct GaudiodCacheEntry {
+    /**
+     * Absolute path(s) of source file(s).
+    */
+    char key[GAUDIOD_CACHE_KEY_LEN];
+
+    struct GaudiodFileStamp stamps[GAUDIOD_CACHE_MAX_STAMPS];
+    int stamp_count;
+
+    void *data;
+    f_GaudiodCacheEntry_free free_callback;
+
+    /**
+     * Id of the last request that used this entry.
+    */
+    unsigned int request_id;
+};
+
+/**
+ * Loads data for a cache entry.
+ * @param state: loader state.
+ * @returns: data to cache.
+*/
+typedef void *(*f_GaudiodCache_load)(void *state);
+
+/**
+ * State for {@code GaudiodCache_load_callback}.
+*/
+struct GaudiodCacheLoad {
+    struct GaudiodCache *cache;
+    const char *key;
+    struct GaudiodFileStamp *stamps;
+    int stamp_count;
+    f_GaudiodCache_load load;
+    void *load_state;
+    f_GaudiodCacheEntry_free free_callback;
+    void *data;
+};
+
+/**
+ * Source files of {@code struct GaudiodRenderBank}.
+*/
+struct GaudiodRenderBankPaths {
+    const char *ctl_path;
+    const char *tbl_path;
+};
+
+/**
+ * List of {@code struct GaudiodCacheEntry}, least recently used first.
+*/
+struct GaudiodCache {
+    struct LinkedList *entries;
+    int max_entries;
+    int hits;
+    int misses;
+};
+
+/**
+ * Parsed .ctl and .tbl pair used for rendering, along with decoded audio.
+*/
+struct GaudiodRenderBank {
+    struct ALBankFile *bank_file;
+    uint8_t *tbl_file_contents;
+    size_t tbl_file_len;
+    struct PcmCache *pcm_cache;
+};
+
+/**
+ * Library globals a request can change (through options, or by the library
+ * during a conversion). Saved when the worker starts, and restored before and
+ * after each request so one request doesn't change the next.
+*/
+struct GaudiodGlobals {
+    int verbosity;
+    int term_colors;
+    int encode_bswap;
+    char *output_dir;
+    size_t output_dir_len;
+    char *filename_prefix;
+    size_t filename_prefix_len;
+    int parallel_num_threads;
+    int adpcm_loop_infinite_export_count;
+    int adpcm_encode_exhaustive_scale_search;
+    int adpcm_encode_integer_error_metric;
+    int midi_parse_debug;
+    int midi_debug_loop_delta;
+    int strict_cseq_loop_event;
+    wavetable_init_callback wavetable_init;
+};
+
+/**
+ * Request handler. Same arguments as the standalone app main.
+ * @returns: exit code.
+*/
+typedef int (*f_gaudiod_handler)(int argc, char **argv);
+
+struct GaudiodTool {
+    const char *name;
+    f_gaudiod_handler handler;
+};
+
+/**
+ * State for {@code gaudiod_run_request}.
+*/
+struct GaudiodRequest {
+    f_gaudiod_handler handler;
+    int argc;
+    char **argv;
+    int exit_code;
+};
+
+// parent process state
+static volatile sig_atomic_t _shutdown = 0;
+static pid_t _workers[GAUDIOD_MAX_WORKERS];
+static int _listen_fd = -1;
+
+// worker process state
+static int _client_fd = -1;
+static int _request_active = 0;
+static unsigned int _request_id = 0;
+static FILE *_capture_out = NULL;
+static FILE *_capture_err = NULL;
+static int _saved_stdout_fd = -1;
+static int _saved_stderr_fd = -1;
+static struct GaudiodGlobals _server_globals;
+static struct GaudiodCache *_codebook_cache = NULL;
+static struct GaudiodCache *_inst_cache = NULL;
+static struct GaudiodCache *_render_bank_cache = NULL;
+
+// forward declarations
+
+void print_help(const char * invoke);
+void read_opts(int argc, char **argv);
+
+static void gaudiod_signal_handler(int signum);
+static pid_t gaudiod_spawn_worker(void);
+static void gaudiod_worker_main(void);
+static void gaudiod_worker_on_exit(int status, void *arg);
+static void gaudiod_handle_connection(int fd);
+static void gaudiod_run_request(void *state);
+static void gaudiod_begin_request(int fd);
+static void gaudiod_finish_request(int exit_code);
+static void gaudiod_save_globals(struct GaudiodGlobals *globals);
+static void gaudiod_restore_globals(const struct GaudiodGlobals *globals);
+static size_t gaudiod_capture_len(FILE *capture);
+static size_t gaudiod_read_capture(FILE *capture, uint8_t *dest, size_t max_len);
+static int gaudiod_common_option(int ch, const char *arg);
+static int gaudiod_parse_int(const char *arg, const char *name, int min, int max, int *value);
+static double elapsed_seconds(struct timespec *start);
+static void gaudiod_default_output(const char *input_filename, const char *extension, char *output_filename);
+
+static int GaudiodFileStamp_get(const char *path, struct GaudiodFileStamp *stamp);
+static int GaudiodFileStamp_equal(struct GaudiodFileStamp *a, struct GaudiodFileStamp *b);
+static struct GaudiodCache *GaudiodCache_new(int max_entries);
+static void *GaudiodCache_find(struct GaudiodCache *cache, const char *key, struct GaudiodFileStamp *stamps, int stamp_count);
+static void GaudiodCache_add(struct GaudiodCache *cache, const char *key, struct GaudiodFileStamp *stamps, int stamp_count, void *data, f_GaudiodCacheEntry_free free_callback);
+static void GaudiodCacheEntry_free(struct GaudiodCacheEntry *entry);
+static void *GaudiodCache_load(struct GaudiodCache *cache, const char *key, struct GaudiodFileStamp *stamps, int stamp_count, f_GaudiodCache_load load, void *load_state, f_GaudiodCacheEntry_free free_callback);
+static void GaudiodCache_load_callback(void *state);
+static void GaudiodCache_drop_request(struct GaudiodCache *cache, unsigned int request_id);
+
+static void gaudiod_ALADPCMBook_free(void *data);
+static void gaudiod_ALBankFile_free(void *data);
+static void GaudiodRenderBank_free(void *data);
+static struct ALADPCMBook *gaudiod_get_codebook(const char *path);
+static struct ALBankFile *gaudiod_get_inst_bank(const char *path);
+static struct GaudiodRenderBank *gaudiod_get_render_bank(const char *ctl_path, const char *tbl_path);
+static void *gaudiod_load_codebook(void *state);
+static void *gaudiod_load_inst_bank(void *state);
+static void *gaudiod_load_render_bank(void *state);
+
+static int gaudiod_wav2aifc(int argc, char **argv);
+static void gaudiod_wav2aifc_trials(const char *input_filename, const char *output_filename, char **coef_filenames, int coef_file_count, struct WavConvertOptions *convert_options);
+static int gaudiod_aifc2wav(int argc, char **argv);
+static int gaudiod_tabledesign(int argc, char **argv);
+static int gaudiod_midi_opts(int argc, char **argv, char **input_filename, char *output_filename, const char *default_extension, struct MidiConvertOptions *convert_options);
+static int gaudiod_midi2cseq(int argc, char **argv);
+static int gaudiod_cseq2midi(int argc, char **argv);
+static int gaudiod_gic(int argc, char **argv);
+static int gaudiod_cseq2wav(int argc, char **argv);
+
+// end forward declarations
+
+static struct GaudiodTool gaudiod_tools[] = {
+    { "wav2aifc",    gaudiod_wav2aifc },
+    { "aifc2wav",    gaudiod_aifc2wav },
+    { "tabledesign", gaudiod_tabledesign },
+    { "midi2cseq",   gaudiod_midi2cseq },
+    { "cseq2midi",   gaudiod_cseq2midi },
+    { "gic",         gaudiod_gic },
+    { "cseq2wav",    gaudiod_cseq2wav },
+};
+
+void print_help(const char * invoke)
+{
+    printf("%s %s help\n", APPNAME, VERSION);
+    printf("\n");
+    printf("Conversion server. Listens on a Unix domain socket for requests from gaudioc.\n");
+    printf("Parsed codebooks and sound banks are kept in memory between requests.\n");
+    printf("usage:\n");
+    printf("\n");
+    printf("    %s [--socket path]\n", invoke);
+    printf("\n");
+    printf("options:\n");
+    printf("\n");
+    printf("    --help                        print this help\n");
+    printf("    -s,--socket=PATH              socket path. Optional. Default is ${%s} if set,\n", IPC_SOCKET_ENV);
+    printf("                                  otherwise ${%s}/%s if set,\n", IPC_RUNTIME_DIR_ENV, IPC_SOCKET_NAME);
+    printf("                                  otherwise /tmp/gaudiod-UID/%s\n", IPC_SOCKET_NAME);
+    printf("    --workers=N                   number of worker processes. Optional. Default is\n");
+    printf("                                  number of processors.\n");
+    printf("    --cache-entries=N             max number of parsed files each worker keeps per cache.\n");
+    printf("                                  Optional. Default=%d\n", GAUDIOD_DEFAULT_CACHE_ENTRIES);
+    printf("    --cache-size=MB               memory budget for decoded audio, per rendered sound bank.\n");
+    printf("                                  Optional. Default=%d\n", PCM_CACHE_DEFAULT_MAX_BYTES / (1024 * 1024));
+    printf("    -q,--quiet                    suppress output\n");
+    printf("    -v,--verbose                  more output (log each request)\n");
+    printf("\n");
+    printf("supported tools (see each app help for options):\n");
+    printf("\n");
+    printf("    aifc2wav cseq2midi cseq2wav gic midi2cseq tabledesign wav2aifc\n");
+    printf("\n");
+    fflush(stdout);
+}
+
+void read_opts(int argc, char **argv)
+{
+    int option_index = 0;
+    int ch;
+
+    while ((ch = getopt_long(argc, argv, "s:qv", long_options, &option_index)) != -1)
+    {
+        switch (ch)
+        {
+            case 's':
+            {
+                if (strlen(optarg) < 1 || strlen(optarg) >= PATH_MAX)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, invalid socket path\n");
+                }
+
+                snprintf(socket_path, PATH_MAX, "%s", optarg);
+            }
+            break;
+
+            case LONG_OPT_WORKERS:
+            {
+                if (gaudiod_parse_int(optarg, "workers", 1, GAUDIOD_MAX_WORKERS, &opt_num_workers) != 0)
+                {
+                    exit(EXIT_CODE_GENERAL);
+                }
+            }
+            break;
+
+            case LONG_OPT_CACHE_ENTRIES:
+            {
+                if (gaudiod_parse_int(optarg, "cache-entries", 1, INT_MAX, &opt_cache_entries) != 0)
+                {
+                    exit(EXIT_CODE_GENERAL);
+                }
+            }
+            break;
+
+            case LONG_OPT_CACHE_SIZE:
+            {
+                if (gaudiod_parse_int(optarg, "cache-size", 1, INT_MAX / (1024 * 1024), &opt_pcm_cache_size_mb) != 0)
+                {
+                    exit(EXIT_CODE_GENERAL);
+                }
+            }
+            break;
+
+            case 'q':
+                g_verbosity = 0;
+                break;
+
+            case 'v':
+                g_verbosity = 2;
+                break;
+
+            case LONG_OPT_DEBUG:
+                g_verbosity = VERBOSE_DEBUG;
+                break;
+
+            case '?':
+                print_help(argv[0]);
+                exit(0);
+                break;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct sigaction action;
+    int num_workers;
+    int i;
+
+    read_opts(argc, argv);
+
+    if (opt_help_flag)
+    {
+        print_help(argv[0]);
+        exit(0);
+    }
+
+    if (socket_path[0] == '\0')
+    {
+        const char *env_path = getenv(IPC_SOCKET_ENV);
+
+        if (env_path != NULL && env_path[0] != '\0')
+        {
+            snprintf(socket_path, PATH_MAX, "%s", env_path);
+        }
+        else if (ipc_default_socket_path(socket_path, PATH_MAX, 1) != IPC_OK)
+        {
+            stderr_exit(EXIT_CODE_IO, "error, cannot resolve default socket path\n");
+        }
+    }
+
+    num_workers = opt_num_workers > 0 ? opt_num_workers : parallel_get_num_threads();
+    if (num_workers > GAUDIOD_MAX_WORKERS)
+    {
+        num_workers = GAUDIOD_MAX_WORKERS;
+    }
+
+    _listen_fd = ipc_listen_unix(socket_path, GAUDIOD_BACKLOG);
+    if (_listen_fd < 0)
+    {
+        stderr_exit(EXIT_CODE_IO, "error, cannot listen on socket: %s\n", socket_path);
+    }
+
+    // no SA_RESTART, waitpid should return when asked to stop.
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = gaudiod_signal_handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // flush before fork so buffered output isn't duplicated in workers.
+    fflush(stdout);
+    fflush(stderr);
+
+    for (i=0; i<num_workers; i++)
+    {
+        _workers[i] = gaudiod_spawn_worker();
+    }
+
+    if (g_verbosity > 0)
+    {
+        printf("%s listening on %s with %d workers\n", APPNAME, socket_path, num_workers);
+        fflush(stdout);
+    }
+
+    while (!_shutdown)
+    {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        for (i=0; i<num_workers; i++)
+        {
+            if (_workers[i] == pid)
+            {
+                if (g_verbosity > 1)
+                {
+                    printf("worker %d exited (status %d), restarting\n", (int)pid, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+                    fflush(stdout);
+                }
+
+                _workers[i] = _shutdown ? 0 : gaudiod_spawn_worker();
+                break;
+            }
+        }
+    }
+
+    for (i=0; i<num_workers; i++)
+    {
+        if (_workers[i] > 0)
+        {
+            kill(_workers[i], SIGTERM);
+        }
+    }
+
+    for (i=0; i<num_workers; i++)
+    {
+        if (_workers[i] > 0)
+        {
+            waitpid(_workers[i], NULL, 0);
+        }
+    }
+
+    close(_listen_fd);
+    unlink(socket_path);
+
+    if (g_verbosity > 0)
+    {
+        printf("%s stopped\n", APPNAME);
+        fflush(stdout);
+    }
+
+    return 0;
+}
+
+static void gaudiod_signal_handler(int signum)
+{
+    _shutdown = 1;
+}
+
+/**
+ * Starts a new worker process.
+ * @returns: pid of worker.
+*/
+static pid_t gaudiod_spawn_worker(void)
+{
+    TRACE_ENTER(__func__)
+
+    pid_t pid = fork();
+
+    if (pid < 0)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> fork failed\n", __func__, __LINE__);
+    }
+
+    if (pid == 0)
+    {
+        gaudiod_worker_main();
+        exit(0);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return pid;
+}
+
+/**
+ * Worker process loop. Accepts one connection at a time from the shared
+ * listen socket, until terminated.
+*/
+static void gaudiod_worker_main(void)
+{
+    TRACE_ENTER(__func__)
+
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = SIG_DFL;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    _capture_out = tmpfile();
+    _capture_err = tmpfile();
+    _saved_stdout_fd = dup(STDOUT_FILENO);
+    _saved_stderr_fd = dup(STDERR_FILENO);
+
+    if (_capture_out == NULL || _capture_err == NULL || _saved_stdout_fd < 0 || _saved_stderr_fd < 0)
+    {
+        stderr_exit(EXIT_CODE_IO, "%s %d> cannot create output capture files\n", __func__, __LINE__);
+    }
+
+    gaudiod_save_globals(&_server_globals);
+
+    _codebook_cache = GaudiodCache_new(opt_cache_entries);
+    _inst_cache = GaudiodCache_new(opt_cache_entries);
+    _render_bank_cache = GaudiodCache_new(opt_cache_entries);
+
+    on_exit(gaudiod_worker_on_exit, NULL);
+
+    while (1)
+    {
+        int fd = accept(_listen_fd, NULL, NULL);
+
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+
+            stderr_exit(EXIT_CODE_IO, "%s %d> accept failed, errno=%d\n", __func__, __LINE__, errno);
+        }
+
+        gaudiod_handle_connection(fd);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Called when worker exits. If this happens in the middle of a request
+ * (library error), the client still gets a response with the exit code.
+*/
+static void gaudiod_worker_on_exit(int status, void *arg)
+{
+    if (_request_active)
+    {
+        gaudiod_finish_request(status);
+    }
+}
+
+/**
+ * Reads one request from client, runs it, and sends response.
+ * @param fd: client connection.
+*/
+static void gaudiod_handle_connection(int fd)
+{
+    TRACE_ENTER(__func__)
+
+    uint8_t *message = NULL;
+    size_t message_len = 0;
+    char **strings;
+    int string_count = 0;
+    int exit_code = EXIT_CODE_GENERAL;
+    struct timespec start;
+    size_t i;
+
+    if (ipc_read_message(fd, &message, &message_len) != IPC_OK)
+    {
+        close(fd);
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    strings = ipc_unpack_strings(message, message_len, &string_count);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    gaudiod_begin_request(fd);
+
+    if (strings == NULL || string_count < 2)
+    {
+        fprintf(stderr, "%s: invalid request\n", APPNAME);
+    }
+    else if (chdir(strings[0]) != 0)
+    {
+        fprintf(stderr, "%s: cannot change to directory %s\n", APPNAME, strings[0]);
+    }
+    else
+    {
+        struct GaudiodRequest request;
+        struct GaudioError error;
+
+        memset(&request, 0, sizeof(request));
+
+        for (i=0; i<ARRAY_LENGTH(gaudiod_tools); i++)
+        {
+            if (strcmp(gaudiod_tools[i].name, strings[1]) == 0)
+            {
+                request.handler = gaudiod_tools[i].handler;
+                break;
+            }
+        }
+
+        if (request.handler == NULL)
+        {
+            fprintf(stderr, "%s: tool not supported: %s\n", APPNAME, strings[1]);
+        }
+        else
+        {
+            // tool name is argv[0] for the handler.
+            request.argc = string_count - 1;
+            request.argv = &strings[1];
+
+            if (gaudio_try(gaudiod_run_request, &request, &error) == GAUDIO_OK)
+            {
+                exit_code = request.exit_code;
+            }
+            else
+            {
+                fprintf(stderr, "%s\n", error.message);
+                exit_code = error.code;
+
+                GaudiodCache_drop_request(_codebook_cache, _request_id);
+                GaudiodCache_drop_request(_inst_cache, _request_id);
+                GaudiodCache_drop_request(_render_bank_cache, _request_id);
+            }
+        }
+    }
+
+    gaudiod_finish_request(exit_code);
+
+    if (g_verbosity > 1)
+    {
+        printf("[%d] %s exit=%d %.3f s\n",
+            (int)getpid(),
+            (strings != NULL && string_count > 1) ? strings[1] : "?",
+            exit_code,
+            elapsed_seconds(&start));
+        fflush(stdout);
+    }
+
+    if (strings != NULL)
+    {
+        free(strings);
+    }
+
+    free(message);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Runs request handler, called through {@code gaudio_try}.
+ * @param state: {@code struct GaudiodRequest}.
+*/
+static void gaudiod_run_request(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudiodRequest *request = (struct GaudiodRequest *)state;
+
+    request->exit_code = request->handler(request->argc, request->argv);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Redirects stdout and stderr to capture files and resets global options
+ * to the values the worker started with.
+ * @param fd: client connection.
+*/
+static void gaudiod_begin_request(int fd)
+{
+    TRACE_ENTER(__func__)
+
+    fflush(stdout);
+    fflush(stderr);
+
+    if (ftruncate(fileno(_capture_out), 0) != 0 || ftruncate(fileno(_capture_err), 0) != 0)
+    {
+        stderr_exit(EXIT_CODE_IO, "%s %d> cannot reset output capture files\n", __func__, __LINE__);
+    }
+
+    rewind(_capture_out);
+    rewind(_capture_err);
+
+    dup2(fileno(_capture_out), STDOUT_FILENO);
+    dup2(fileno(_capture_err), STDERR_FILENO);
+
+    gaudiod_restore_globals(&_server_globals);
+    g_verbosity = 1;
+    stats_reset();
+
+    // full getopt reinit for each request.
+    optind = 0;
+    opterr = 1;
+
+    _client_fd = fd;
+    _request_active = 1;
+    _request_id++;
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Restores stdout and stderr, sends captured output and exit code to client,
+ * and closes the connection.
+ * @param exit_code: request exit code.
+*/
+static void gaudiod_finish_request(int exit_code)
+{
+    TRACE_ENTER(__func__)
+
+    uint8_t *response;
+    size_t pos = 0;
+    size_t out_len;
+    size_t err_len;
+
+    _request_active = 0;
+
+    fflush(stdout);
+    fflush(stderr);
+
+    dup2(_saved_stdout_fd, STDOUT_FILENO);
+    dup2(_saved_stderr_fd, STDERR_FILENO);
+
+    gaudiod_restore_globals(&_server_globals);
+
+    out_len = gaudiod_capture_len(_capture_out);
+    err_len = gaudiod_capture_len(_capture_err);
+
+    response = (uint8_t *)malloc_zero(1, 12 + out_len + err_len);
+
+    response[pos++] = (uint8_t)((exit_code >> 24) & 0xff);
+    response[pos++] = (uint8_t)((exit_code >> 16) & 0xff);
+    response[pos++] = (uint8_t)((exit_code >> 8) & 0xff);
+    response[pos++] = (uint8_t)(exit_code & 0xff);
+
+    out_len = gaudiod_read_capture(_capture_out, &response[pos + 4], out_len);
+    response[pos++] = (uint8_t)((out_len >> 24) & 0xff);
+    response[pos++] = (uint8_t)((out_len >> 16) & 0xff);
+    response[pos++] = (uint8_t)((out_len >> 8) & 0xff);
+    response[pos++] = (uint8_t)(out_len & 0xff);
+    pos += out_len;
+
+    err_len = gaudiod_read_capture(_capture_err, &response[pos + 4], err_len);
+    response[pos++] = (uint8_t)((err_len >> 24) & 0xff);
+    response[pos++] = (uint8_t)((err_len >> 16) & 0xff);
+    response[pos++] = (uint8_t)((err_len >> 8) & 0xff);
+    response[pos++] = (uint8_t)(err_len & 0xff);
+    pos += err_len;
+
+    // client may have gone away, nothing else to do in that case.
+    ipc_write_message(_client_fd, response, pos);
+
+    free(response);
+    close(_client_fd);
+    _client_fd = -1;
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Copies current value of library globals.
+ * @param globals: out parameter.
+*/
+static void gaudiod_save_globals(struct GaudiodGlobals *globals)
+{
+    TRACE_ENTER(__func__)
+
+    globals->verbosity = g_verbosity;
+    globals->term_colors = g_term_colors;
+    globals->encode_bswap = g_encode_bswap;
+    globals->output_dir = g_output_dir;
+    globals->output_dir_len = g_output_dir_len;
+    globals->filename_prefix = g_filename_prefix;
+    globals->filename_prefix_len = g_filename_prefix_len;
+    globals->parallel_num_threads = g_parallel_num_threads;
+    globals->adpcm_loop_infinite_export_count = g_AdpcmLoopInfiniteExportCount;
+    globals->adpcm_encode_exhaustive_scale_search = g_AdpcmEncodeExhaustiveScaleSearch;
+    globals->adpcm_encode_integer_error_metric = g_AdpcmEncodeIntegerErrorMetric;
+    globals->midi_parse_debug = g_midi_parse_debug;
+    globals->midi_debug_loop_delta = g_midi_debug_loop_delta;
+    globals->strict_cseq_loop_event = g_strict_cseq_loop_event;
+    globals->wavetable_init = wavetable_init_callback_ptr;
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Sets library globals to saved values.
+ * @param globals: values from {@code gaudiod_save_globals}.
+*/
+static void gaudiod_restore_globals(const struct GaudiodGlobals *globals)
+{
+    TRACE_ENTER(__func__)
+
+    g_verbosity = globals->verbosity;
+    g_term_colors = globals->term_colors;
+    g_encode_bswap = globals->encode_bswap;
+    g_output_dir = globals->output_dir;
+    g_output_dir_len = globals->output_dir_len;
+    g_filename_prefix = globals->filename_prefix;
+    g_filename_prefix_len = globals->filename_prefix_len;
+    g_parallel_num_threads = globals->parallel_num_threads;
+    g_AdpcmLoopInfiniteExportCount = globals->adpcm_loop_infinite_export_count;
+    g_AdpcmEncodeExhaustiveScaleSearch = globals->adpcm_encode_exhaustive_scale_search;
+    g_AdpcmEncodeIntegerErrorMetric = globals->adpcm_encode_integer_error_metric;
+    g_midi_parse_debug = globals->midi_parse_debug;
+    g_midi_debug_loop_delta = globals->midi_debug_loop_delta;
+    g_strict_cseq_loop_event = globals->strict_cseq_loop_event;
+    wavetable_init_callback_ptr = globals->wavetable_init;
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Gets length of text written to capture file during request, up to
+ * {@code GAUDIOD_MAX_CAPTURE_LEN}.
+ * @param capture: capture file.
+ * @returns: length in bytes.
+*/
+static size_t gaudiod_capture_len(FILE *capture)
+{
+    TRACE_ENTER(__func__)
+
+    off_t len = lseek(fileno(capture), 0, SEEK_END);
+
+    if (len < 0)
+    {
+        len = 0;
+    }
+    else if (len > GAUDIOD_MAX_CAPTURE_LEN)
+    {
+        len = GAUDIOD_MAX_CAPTURE_LEN;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return (size_t)len;
+}
+
+/**
+ * Reads text written to capture file during request.
+ * @param capture: capture file.
+ * @param dest: buffer to write to.
+ * @param max_len: max number of bytes to read.
+ * @returns: number of bytes read.
+*/
+static size_t gaudiod_read_capture(FILE *capture, uint8_t *dest, size_t max_len)
+{
+    TRACE_ENTER(__func__)
+
+    int fd = fileno(capture);
+    size_t total = 0;
+
+    lseek(fd, 0, SEEK_SET);
+
+    while (total < max_len)
+    {
+        ssize_t count = read(fd, &dest[total], max_len - total);
+
+        if (count <= 0)
+        {
+            break;
+        }
+
+        total += (size_t)count;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return total;
+}
+
+/**
+ * Handles options shared by all tools.
+ * @param ch: option returned by getopt.
+ * @param arg: option argument.
+ * @returns: 1 if option was handled, 0 if not, -1 if option is invalid.
+*/
+static int gaudiod_common_option(int ch, const char *arg)
+{
+    TRACE_ENTER(__func__)
+
+    int result = 1;
+
+    switch (ch)
+    {
+        case 'q':
+            g_verbosity = 0;
+            break;
+
+        case 'v':
+            g_verbosity = 2;
+            break;
+
+        case LONG_OPT_DEBUG:
+            g_verbosity = VERBOSE_DEBUG;
+            break;
+
+        case LONG_OPT_STATS:
+        {
+            int stats_format = stats_parse_format(arg);
+
+            if (stats_format < 0)
+            {
+                fprintf(stderr, "error, --stats format not recognized: %s\n", arg);
+                result = -1;
+            }
+            else
+            {
+                stats_enable(stats_format);
+            }
+        }
+        break;
+
+        case LONG_OPT_THREADS:
+            if (gaudiod_parse_int(arg, "number of threads", 0, INT_MAX, &g_parallel_num_threads) != 0)
+            {
+                result = -1;
+            }
+            break;
+
+        case '?':
+            // getopt already printed message
+            result = -1;
+            break;
+
+        default:
+            result = 0;
+            break;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return result;
+}
+
+/**
+ * Parses integer option.
+ * @param arg: text to parse.
+ * @param name: option name, for error message.
+ * @param min: min allowed value.
+ * @param max: max allowed value.
+ * @param value: out parameter. Will contain parsed value.
+ * @returns: zero on success, -1 on error (message written to stderr).
+*/
+static int gaudiod_parse_int(const char *arg, const char *name, int min, int max, int *value)
+{
+    TRACE_ENTER(__func__)
+
+    char *pend = NULL;
+    long res;
+
+    errno = 0;
+    res = strtol(arg, &pend, 0);
+
+    if (pend == arg || *pend != '\0' || errno == ERANGE || res < min || res > max)
+    {
+        fprintf(stderr, "error, invalid %s: %s\n", name, arg);
+        TRACE_LEAVE(__func__)
+        return -1;
+    }
+
+    *value = (int)res;
+
+    TRACE_LEAVE(__func__)
+
+    return 0;
+}
+
+static double elapsed_seconds(struct timespec *start)
+{
+    TRACE_ENTER(__func__)
+
+    struct timespec now;
+    double result;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    result = (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1000000000.0;
+
+    TRACE_LEAVE(__func__)
+
+    return result;
+}
+
+/**
+ * Builds output filename from input filename when not specified, same as the standalone apps.
+ * @param input_filename: input filename.
+ * @param extension: new extension.
+ * @param output_filename: out parameter. Must be at least {@code MAX_FILENAME_LEN}.
+*/
+static void gaudiod_default_output(const char *input_filename, const char *extension, char *output_filename)
+{
+    TRACE_ENTER(__func__)
+
+    memset(output_filename, 0, MAX_FILENAME_LEN);
+    change_filename_extension((char *)input_filename, output_filename, (char *)extension, MAX_FILENAME_LEN);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Reads identifying information for file.
+ * @param path: file path.
+ * @param stamp: out parameter.
+ * @returns: zero on success, -1 if file can't be read.
+*/
+static int GaudiodFileStamp_get(const char *path, struct GaudiodFileStamp *stamp)
+{
+    TRACE_ENTER(__func__)
+
+    struct stat st;
+
+    memset(stamp, 0, sizeof(struct GaudiodFileStamp));
+
+    if (stat(path, &st) != 0)
+    {
+        TRACE_LEAVE(__func__)
+        return -1;
+    }
+
+    stamp->dev = st.st_dev;
+    stamp->ino = st.st_ino;
+    stamp->size = st.st_size;
+    stamp->mtime = st.st_mtim;
+
+    TRACE_LEAVE(__func__)
+
+    return 0;
+}
+
+static int GaudiodFileStamp_equal(struct GaudiodFileStamp *a, struct GaudiodFileStamp *b)
+{
+    return a->dev == b->dev
+        && a->ino == b->ino
+        && a->size == b->size
+        && a->mtime.tv_sec == b->mtime.tv_sec
+        && a->mtime.tv_nsec == b->mtime.tv_nsec;
+}
+
+static struct GaudiodCache *GaudiodCache_new(int max_entries)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudiodCache *cache = (struct GaudiodCache *)malloc_zero(1, sizeof(struct GaudiodCache));
+
+    cache->entries = LinkedList_new();
+    cache->max_entries = max_entries;
+
+    TRACE_LEAVE(__func__)
+
+    return cache;
+}
+
+static void GaudiodCacheEntry_free(struct GaudiodCacheEntry *entry)
+{
+    TRACE_ENTER(__func__)
+
+    if (entry == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    if (entry->data != NULL && entry->free_callback != NULL)
+    {
+        entry->free_callback(entry->data);
+    }
+
+    gaudio_free(entry);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Looks up cache entry. An entry with matching key but different file stamps is
+ * out of date and is removed.
+ * @param cache: cache to search.
+ * @param key: entry key.
+ * @param stamps: current stamps of source files.
+ * @param stamp_count: number of stamps.
+ * @returns: cached data, or NULL if not found.
+*/
+static void *GaudiodCache_find(struct GaudiodCache *cache, const char *key, struct GaudiodFileStamp *stamps, int stamp_count)
+{
+    TRACE_ENTER(__func__)
+
+    struct LinkedListNode *node;
+
+    node = cache->entries->head;
+    while (node != NULL)
+    {
+        struct GaudiodCacheEntry *entry = (struct GaudiodCacheEntry *)node->data;
+
+        if (strcmp(entry->key, key) == 0)
+        {
+            int i;
+            int same = entry->stamp_count == stamp_count;
+
+            for (i=0; same && i<stamp_count; i++)
+            {
+                same = GaudiodFileStamp_equal(&entry->stamps[i], &stamps[i]);
+            }
+
+            LinkedListNode_detach(cache->entries, node);
+
+            if (same)
+            {
+                // move to most recently used
+                LinkedList_append_node(cache->entries, node);
+                entry->request_id = _request_id;
+                cache->hits++;
+
+                TRACE_LEAVE(__func__)
+                return entry->data;
+            }
+
+            GaudiodCacheEntry_free(entry);
+            gaudio_free(node);
+            break;
+        }
+
+        node = node->next;
+    }
+
+    cache->misses++;
+
+    TRACE_LEAVE(__func__)
+
+    return NULL;
+}
+
+/**
+ * Adds entry to cache, removing the least recently used entry if full.
+ * The cache takes ownership of {@code data}.
+ * @param cache: cache.
+ * @param key: entry key.
+ * @param stamps: stamps of source files.
+ * @param stamp_count: number of stamps.
+ * @param data: data to cache.
+ * @param free_callback: used to free data when entry is removed.
+*/
+static void GaudiodCache_add(struct GaudiodCache *cache, const char *key, struct GaudiodFileStamp *stamps, int stamp_count, void *data, f_GaudiodCacheEntry_free free_callback)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudiodCacheEntry *entry;
+    struct LinkedListNode *node;
+
+    while ((int)cache->entries->count >= cache->max_entries && cache->entries->head != NULL)
+    {
+        node = cache->entries->head;
+        LinkedListNode_detach(cache->entries, node);
+        GaudiodCacheEntry_free((struct GaudiodCacheEntry *)node->data);
+        gaudio_free(node);
+    }
+
+    entry = (struct GaudiodCacheEntry *)malloc_zero(1, sizeof(struct GaudiodCacheEntry));
+    snprintf(entry->key, GAUDIOD_CACHE_KEY_LEN, "%s", key);
+    memcpy(entry->stamps, stamps, stamp_count * sizeof(struct GaudiodFileStamp));
+    entry->stamp_count = stamp_count;
+    entry->data = data;
+    entry->free_callback = free_callback;
+    entry->request_id = _request_id;
+
+    node = LinkedListNode_new();
+    node->data = entry;
+    LinkedList_append_node(cache->entries, node);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Loads data and adds it to the cache. Runs through {@code gaudio_try_keep} so
+ * the cached data isn't released if the request fails later. An error loading
+ * is passed on to the request.
+ * @param cache: cache.
+ * @param key: entry key.
+ * @param stamps: stamps of source files.
+ * @param stamp_count: number of stamps.
+ * @param load: loads data.
+ * @param load_state: passed to load.
+ * @param free_callback: used to free data when entry is removed.
+ * @returns: loaded data, owned by cache.
+*/
+static void *GaudiodCache_load(struct GaudiodCache *cache, const char *key, struct GaudiodFileStamp *stamps, int stamp_count, f_GaudiodCache_load load, void *load_state, f_GaudiodCacheEntry_free free_callback)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudiodCacheLoad cache_load;
+    struct GaudioError error;
+
+    cache_load.cache = cache;
+    cache_load.key = key;
+    cache_load.stamps = stamps;
+    cache_load.stamp_count = stamp_count;
+    cache_load.load = load;
+    cache_load.load_state = load_state;
+    cache_load.free_callback = free_callback;
+    cache_load.data = NULL;
+
+    if (gaudio_try_keep(GaudiodCache_load_callback, &cache_load, &error) != GAUDIO_OK)
+    {
+        stderr_exit(error.code, "%s\n", error.message);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return cache_load.data;
+}
+
+/**
+ * Called through {@code gaudio_try_keep} by {@code GaudiodCache_load}.
+ * @param state: {@code struct GaudiodCacheLoad}.
+*/
+static void GaudiodCache_load_callback(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudiodCacheLoad *cache_load = (struct GaudiodCacheLoad *)state;
+
+    cache_load->data = cache_load->load(cache_load->load_state);
+    GaudiodCache_add(cache_load->cache, cache_load->key, cache_load->stamps, cache_load->stamp_count, cache_load->data, cache_load->free_callback);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Removes entries used by a failed request. Memory the request attached to the
+ * cached data (e.g., decoded audio, lookup indexes) was released with the request,
+ * so the data is left as is instead of freed.
+ * @param cache: cache.
+ * @param request_id: id of failed request.
+*/
+static void GaudiodCache_drop_request(struct GaudiodCache *cache, unsigned int request_id)
+{
+    TRACE_ENTER(__func__)
+
+    struct LinkedListNode *node;
+    struct LinkedListNode *next;
+
+    node = cache->entries->head;
+    while (node != NULL)
+    {
+        struct GaudiodCacheEntry *entry = (struct GaudiodCacheEntry *)node->data;
+        next = node->next;
+
+        if (entry->request_id == request_id)
+        {
+            LinkedListNode_detach(cache->entries, node);
+            gaudio_free(entry);
+            gaudio_free(node);
+        }
+
+        node = next;
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+static void gaudiod_ALADPCMBook_free(void *data)
+{
+    ALADPCMBook_free((struct ALADPCMBook *)data);
+}
+
+static void gaudiod_ALBankFile_free(void *data)
+{
+    ALBankFile_free((struct ALBankFile *)data);
+}
+
+static void GaudiodRenderBank_free(void *data)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudiodRenderBank *render_bank = (struct GaudiodRenderBank *)data;
+
+    ALBankFile_free(render_bank->bank_file);
+    PcmCache_free(render_bank->pcm_cache);
+    gaudio_free(render_bank->tbl_file_contents);
+    gaudio_free(render_bank);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Gets parsed .coef file, from cache if unchanged since last use.
+ * @param path: .coef file path.
+ * @returns: codebook, owned by cache.
+*/
+static struct ALADPCMBook *gaudiod_get_codebook(const char *path)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudiodFileStamp stamp;
+    struct ALADPCMBook *book;
+    char key[PATH_MAX];
+
+    if (realpath(path, key) == NULL || GaudiodFileStamp_get(key, &stamp) != 0)
+    {
+        stderr_exit(EXIT_CODE_IO, "error, cannot open file: %s\n", path);
+    }
+
+    book = (struct ALADPCMBook *)GaudiodCache_find(_codebook_cache, key, &stamp, 1);
+
+    if (book == NULL)
+    {
+        book = (struct ALADPCMBook *)GaudiodCache_load(_codebook_cache, key, &stamp, 1, gaudiod_load_codebook, key, gaudiod_ALADPCMBook_free);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return book;
+}
+
+/**
+ * Gets parsed .inst file, from cache if unchanged since last use.
+ * @param path: .inst file path.
+ * @returns: bank file, owned by cache.
+*/
+static struct ALBankFile *gaudiod_get_inst_bank(const char *path)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudiodFileStamp stamp;
+    struct ALBankFile *bank_file;
+    char key[PATH_MAX];
+
+    if (realpath(path, key) == NULL || GaudiodFileStamp_get(key, &stamp) != 0)
+    {
+        stderr_exit(EXIT_CODE_IO, "error, cannot open file: %s\n", path);
+    }
+
+    bank_file = (struct ALBankFile *)GaudiodCache_find(_inst_cache, key, &stamp, 1);
+
+    if (bank_file == NULL)
+    {
+        bank_file = (struct ALBankFile *)GaudiodCache_load(_inst_cache, key, &stamp, 1, gaudiod_load_inst_bank, key, gaudiod_ALBankFile_free);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return bank_file;
+}
+
+/**
+ * Gets parsed .ctl and contents of .tbl, from cache if unchanged since last use.
+ * Decoded audio cache is kept with the bank.
+ * @param ctl_path: .ctl file path.
+ * @param tbl_path: .tbl file path.
+ * @returns: render bank, owned by cache.
+*/
+static struct GaudiodRenderBank *gaudiod_get_render_bank(const char *ctl_path, const char *tbl_path)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudiodFileStamp stamps[2];
+    struct GaudiodRenderBank *render_bank;
+    char ctl_realpath[PATH_MAX];
+    char tbl_realpath[PATH_MAX];
+    char key[GAUDIOD_CACHE_KEY_LEN];
+
+    if (realpath(ctl_path, ctl_realpath) == NULL || GaudiodFileStamp_get(ctl_realpath, &stamps[0]) != 0)
+    {
+        stderr_exit(EXIT_CODE_IO, "error, cannot open file: %s\n", ctl_path);
+    }
+
+    if (realpath(tbl_path, tbl_realpath) == NULL || GaudiodFileStamp_get(tbl_realpath, &stamps[1]) != 0)
+    {
+        stderr_exit(EXIT_CODE_IO, "error, cannot open file: %s\n", tbl_path);
+    }
+
+    snprintf(key, GAUDIOD_CACHE_KEY_LEN, "%s\n%s", ctl_realpath, tbl_realpath);
+
+    render_bank = (struct GaudiodRenderBank *)GaudiodCache_find(_render_bank_cache, key, stamps, 2);
+
+    if (render_bank == NULL)
+    {
+        struct GaudiodRenderBankPaths paths;
+
+        paths.ctl_path = ctl_realpath;
+        paths.tbl_path = tbl_realpath;
+
+        render_bank = (struct GaudiodRenderBank *)GaudiodCache_load(_render_bank_cache, key, stamps, 2, gaudiod_load_render_bank, &paths, GaudiodRenderBank_free);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return render_bank;
+}
+
+/**
+ * Parses .coef file for cache.
+ * @param state: absolute path of .coef file.
+ * @returns: codebook.
+*/
+static void *gaudiod_load_codebook(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct ALADPCMBook *book;
+    struct FileInfo *fi;
+
+    fi = FileInfo_fopen((char *)state, "rb");
+    book = ALADPCMBook_new_from_coef(fi);
+    FileInfo_free(fi);
+
+    TRACE_LEAVE(__func__)
+
+    return book;
+}
+
+/**
+ * Parses .inst file for cache.
+ * @param state: absolute path of .inst file.
+ * @returns: bank file.
+*/
+static void *gaudiod_load_inst_bank(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct ALBankFile *bank_file;
+    struct FileInfo *fi;
+
+    fi = FileInfo_fopen((char *)state, "rb");
+    bank_file = ALBankFile_new_from_inst(fi);
+    stats_add_bytes("parse inst", fi->len);
+    FileInfo_free(fi);
+
+    TRACE_LEAVE(__func__)
+
+    return bank_file;
+}
+
+/**
+ * Parses .ctl and reads .tbl for cache.
+ * @param state: {@code struct GaudiodRenderBankPaths}, absolute paths.
+ * @returns: render bank.
+*/
+static void *gaudiod_load_render_bank(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudiodRenderBankPaths *paths = (struct GaudiodRenderBankPaths *)state;
+    struct GaudiodRenderBank *render_bank;
+    struct FileInfo *fi;
+
+    render_bank = (struct GaudiodRenderBank *)malloc_zero(1, sizeof(struct GaudiodRenderBank));
+
+    fi = FileInfo_fopen((char *)paths->ctl_path, "rb");
+    render_bank->bank_file = ALBankFile_new_from_ctl(fi);
+    stats_add_bytes("read", fi->len);
+    FileInfo_free(fi);
+
+    render_bank->tbl_file_len = get_file_contents((char *)paths->tbl_path, &render_bank->tbl_file_contents);
+    stats_add_bytes("read", render_bank->tbl_file_len);
+
+    render_bank->pcm_cache = PcmCache_new((size_t)opt_pcm_cache_size_mb * 1024 * 1024, NULL);
+
+    TRACE_LEAVE(__func__)
+
+    return render_bank;
+}
+
+/**
+ * wav2aifc request. Supported options: --in, --out, --coef, --swap, --rate, --no-dither,
+ * --threads. Same as wav2aifc, {@code --coef} can be given more than once to encode with
+ * each codebook and keep the one with the smallest square error; otherwise the audio is
+ * converted in blocks. Parsed codebooks are cached.
+*/
+static int gaudiod_wav2aifc(int argc, char **argv)
+{
+    TRACE_ENTER(__func__)
+
+    static struct option options[] =
+    {
+        {"in",     required_argument,               NULL,  'n' },
+        {"out",    required_argument,               NULL,  'o' },
+        {"coef",   required_argument,               NULL,  'c' },
+        {"swap",         no_argument,               NULL,  's' },
+        {"rate",   required_argument,               NULL,  'r' },
+        {"no-dither",    no_argument,               NULL,  'd' },
+        {"threads",  required_argument,             NULL,   LONG_OPT_THREADS },
+        {"quiet",        no_argument,               NULL,  'q' },
+        {"verbose",      no_argument,               NULL,  'v' },
+        {"debug",        no_argument,               NULL,   LONG_OPT_DEBUG },
+        {"stats",        optional_argument,         NULL,   LONG_OPT_STATS },
+        {NULL, 0, NULL, 0}
+    };
+
+    char output_filename[MAX_FILENAME_LEN];
+    char *input_filename = NULL;
+    char **coef_filenames;
+    int coef_file_count = 0;
+    struct ALADPCMBook *book = NULL;
+    struct FileInfo *input_file;
+    struct FileInfo *output_file;
+    struct WavReader *reader;
+    struct WavConvertOptions *convert_options;
+    size_t frames;
+    int sample_rate = 0;
+    int dither = 1;
+    int result = 0;
+    int ch;
+
+    output_filename[0] = '\0';
+
+    // option arguments point into the request, only the list is allocated.
+    coef_filenames = (char **)malloc_zero(argc, sizeof(char *));
+
+    while ((ch = getopt_long(argc, argv, "n:o:c:qv", options, NULL)) != -1)
+    {
+        switch (ch)
+        {
+            case 'n': input_filename = optarg; break;
+            case 'o': snprintf(output_filename, MAX_FILENAME_LEN, "%s", optarg); break;
+            case 'c': coef_filenames[coef_file_count++] = optarg; break;
+            case 's': g_encode_bswap = 1; break;
+            case 'd': dither = 0; break;
+
+            case 'r':
+                if (gaudiod_parse_int(optarg, "sample rate", 1, INT_MAX, &sample_rate) != 0)
+                {
+                    result = EXIT_CODE_GENERAL;
+                }
+                break;
+
+            default:
+                if (gaudiod_common_option(ch, optarg) < 0)
+                {
+                    result = EXIT_CODE_GENERAL;
+                }
+                break;
+        }
+    }
+
+    if (result == 0 && input_filename == NULL)
+    {
+        fprintf(stderr, "error, input filename not specified\n");
+        result = EXIT_CODE_GENERAL;
+    }
+
+    if (result != 0)
+    {
+        gaudio_free(coef_filenames);
+        TRACE_LEAVE(__func__)
+        return result;
+    }
+
+    if (output_filename[0] == '\0')
+    {
+        gaudiod_default_output(input_filename, AIFC_DEFAULT_EXTENSION, output_filename);
+    }
+
+    convert_options = WavConvertOptions_new();
+    convert_options->sample_rate = sample_rate;
+    convert_options->dither = dither;
+
+    if (coef_file_count > 1)
+    {
+        gaudiod_wav2aifc_trials(input_filename, output_filename, coef_filenames, coef_file_count, convert_options);
+    }
+    else
+    {
+        if (coef_file_count == 1)
+        {
+            book = gaudiod_get_codebook(coef_filenames[0]);
+        }
+
+        // same as wav2aifc, sound data is read, encoded, and written in blocks.
+        input_file = FileInfo_fopen(input_filename, "rb");
+        reader = WavReader_new(input_file);
+        output_file = FileInfo_fopen(output_filename, "wb");
+
+        stats_phase_begin("encode");
+        frames = AdpcmAifcFile_fwrite_from_wav_reader(reader, book, convert_options, output_file);
+        stats_add_bytes("encode", (uint64_t)input_file->len);
+        stats_add_items("encode", "frames", (uint64_t)frames);
+        stats_phase_end("encode");
+
+        FileInfo_free(output_file);
+        WavReader_free(reader);
+        FileInfo_free(input_file);
+    }
+
+    WavConvertOptions_free(convert_options);
+    gaudio_free(coef_filenames);
+
+    stats_print(stdout, argv[0]);
+
+    TRACE_LEAVE(__func__)
+
+    return 0;
+}
+
+/**
+ * Encodes .wav with each codebook and writes the one with the smallest square error,
+ * same as wav2aifc with more than one codebook. The whole input and each output are
+ * kept in memory.
+ * @param input_filename: .wav file.
+ * @param output_filename: .aifc file to write.
+ * @param coef_filenames: codebook files.
+ * @param coef_file_count: number of codebooks.
+ * @param convert_options: conversion applied to .wav before encoding.
+*/
+static void gaudiod_wav2aifc_trials(const char *input_filename, const char *output_filename, char **coef_filenames, int coef_file_count, struct WavConvertOptions *convert_options)
+{
+    TRACE_ENTER(__func__)
+
+    struct FileInfo *input_file;
+    struct FileInfo *output_file;
+    struct FileInfo *coef_file;
+    struct WavFile *wav;
+    struct ALADPCMBook **books;
+    struct AdpcmAifcCodebookTrial *trials;
+    int best_index;
+    int owns_books;
+    int i;
+
+    // Cached codebooks stay valid while every one fits in the cache,
+    // otherwise adding one can free another that is still needed.
+    owns_books = coef_file_count > _codebook_cache->max_entries;
+
+    input_file = FileInfo_fopen((char *)input_filename, "rb");
+    wav = WavFile_new_from_file(input_file);
+    FileInfo_free(input_file);
+
+    stats_phase_begin("convert");
+    WavFile_convert(wav, convert_options);
+    stats_phase_end("convert");
+
+    books = (struct ALADPCMBook **)malloc_zero(coef_file_count, sizeof(struct ALADPCMBook *));
+    trials = (struct AdpcmAifcCodebookTrial *)malloc_zero(coef_file_count, sizeof(struct AdpcmAifcCodebookTrial));
+
+    for (i=0; i<coef_file_count; i++)
+    {
+        if (owns_books)
+        {
+            coef_file = FileInfo_fopen(coef_filenames[i], "rb");
+            books[i] = ALADPCMBook_new_from_coef(coef_file);
+            FileInfo_free(coef_file);
+        }
+        else
+        {
+            books[i] = gaudiod_get_codebook(coef_filenames[i]);
+        }
+    }
+
+    stats_phase_begin("encode");
+    best_index = AdpcmAifcFile_new_from_wav_trials(wav, books, coef_file_count, trials);
+    stats_add_items("encode", "frames", (uint64_t)trials[best_index].aaf->comm_chunk->num_sample_frames * (uint64_t)coef_file_count);
+    stats_phase_end("encode");
+
+    if (g_verbosity >= 1)
+    {
+        printf("  %-14s %-8s %-10s %s\n", "square error", "max clip", "size", "codebook");
+
+        for (i=0; i<coef_file_count; i++)
+        {
+            printf("%c %-14.05e %-8d %-10zu %s\n",
+                i == best_index ? '*' : ' ',
+                (double)trials[i].square_error,
+                trials[i].max_clip,
+                trials[i].aifc_size,
+                coef_filenames[i]);
+        }
+    }
+
+    output_file = FileInfo_fopen((char *)output_filename, "wb");
+    AdpcmAifcFile_fwrite(trials[best_index].aaf, output_file);
+    FileInfo_free(output_file);
+
+    for (i=0; i<coef_file_count; i++)
+    {
+        AdpcmAifcFile_free(trials[i].aaf);
+
+        if (owns_books)
+        {
+            ALADPCMBook_free(books[i]);
+        }
+    }
+
+    gaudio_free(trials);
+    gaudio_free(books);
+    WavFile_free(wav);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * aifc2wav request. Supported options: --in, --out, --write-smpl, --no-freq-adjust,
+ * --keybase, --detune, --inst-file, --inst-search, --inst-val, --force-freq-adjust.
+ * Parsed .inst files are cached.
+*/
+static int gaudiod_aifc2wav(int argc, char **argv)
+{
+    TRACE_ENTER(__func__)
+
+    enum {
+        OPT_WRITE_SMPL = 3001,
+        OPT_NO_FREQ_ADJUST,
+        OPT_INST_FILE,
+        OPT_INST_SEARCH,
+        OPT_INST_VAL,
+        OPT_FORCE_FREQ_ADJUST
+    };
+
+    static struct option options[] =
+    {
+        {"in",     required_argument,               NULL,  'n' },
+        {"out",    required_argument,               NULL,  'o' },
+        {"write-smpl",     no_argument,             NULL,  OPT_WRITE_SMPL },
+        {"no-freq-adjust", no_argument,             NULL,  OPT_NO_FREQ_ADJUST },
+        {"keybase", required_argument,              NULL,  'k' },
+        {"detune",  required_argument,              NULL,  'd' },
+        {"inst-file",   required_argument,          NULL,  OPT_INST_FILE },
+        {"inst-search", required_argument,          NULL,  OPT_INST_SEARCH },
+        {"inst-val",    required_argument,          NULL,  OPT_INST_VAL },
+        {"force-freq-adjust",   no_argument,        NULL,  OPT_FORCE_FREQ_ADJUST },
+        {"quiet",        no_argument,               NULL,  'q' },
+        {"verbose",      no_argument,               NULL,  'v' },
+        {"debug",        no_argument,               NULL,   LONG_OPT_DEBUG },
+        {"stats",        optional_argument,         NULL,   LONG_OPT_STATS },
+        {NULL, 0, NULL, 0}
+    };
+
+    char output_filename[MAX_FILENAME_LEN];
+    char *input_filename = NULL;
+    char *inst_filename = NULL;
+    char *inst_search = NULL;
+    char *inst_val = NULL;
+    int opt_explicit = 0;
+    int opt_write_smpl = 0;
+    int opt_no_freq_adjust = 0;
+    int opt_force_freq_adjust = 0;
+    int keybase = 0;
+    int detune = 0;
+    int skip_freq_adjust = 0;
+    struct FileInfo *input_file;
+    struct FileInfo *output_file;
+    struct AdpcmAifcFile *aifc_file;
+    struct WavFile *wav_file;
+    int ch;
+
+    output_filename[0] = '\0';
+
+    while ((ch = getopt_long(argc, argv, "n:o:k:d:qv", options, NULL)) != -1)
+    {
+        switch (ch)
+        {
+            case 'n': input_filename = optarg; break;
+            case 'o': snprintf(output_filename, MAX_FILENAME_LEN, "%s", optarg); break;
+            case OPT_WRITE_SMPL: opt_write_smpl = 1; break;
+            case OPT_NO_FREQ_ADJUST: opt_no_freq_adjust = 1; break;
+            case OPT_FORCE_FREQ_ADJUST: opt_force_freq_adjust = 1; break;
+            case OPT_INST_FILE: inst_filename = optarg; break;
+            case OPT_INST_SEARCH: inst_search = optarg; break;
+            case OPT_INST_VAL: inst_val = optarg; break;
+
+            case 'k':
+                opt_explicit = 1;
+                if (gaudiod_parse_int(optarg, "keybase", 0, 127, &keybase) != 0)
+                {
+                    TRACE_LEAVE(__func__)
+                    return EXIT_CODE_GENERAL;
+                }
+                break;
+
+            case 'd':
+                opt_explicit = 1;
+                if (gaudiod_parse_int(optarg, "detune", -100, 100, &detune) != 0)
+                {
+                    TRACE_LEAVE(__func__)
+                    return EXIT_CODE_GENERAL;
+                }
+                break;
+
+            default:
+                if (gaudiod_common_option(ch, optarg) < 0)
+                {
+                    TRACE_LEAVE(__func__)
+                    return EXIT_CODE_GENERAL;
+                }
+                break;
+        }
+    }
+
+    if (input_filename == NULL)
+    {
+        fprintf(stderr, "error, input filename not specified\n");
+        TRACE_LEAVE(__func__)
+        return EXIT_CODE_GENERAL;
+    }
+
+    if (opt_explicit && (inst_filename != NULL || inst_search != NULL || inst_val != NULL))
+    {
+        fprintf(stderr, "error, keybase/detune can't be used with inst file search\n");
+        TRACE_LEAVE(__func__)
+        return EXIT_CODE_GENERAL;
+    }
+
+    if ((inst_filename != NULL || inst_search != NULL || inst_val != NULL)
+        && (inst_filename == NULL || inst_search == NULL || inst_val == NULL))
+    {
+        fprintf(stderr, "error, inst file, inst search mode, and inst val must all be specified\n");
+        TRACE_LEAVE(__func__)
+        return EXIT_CODE_GENERAL;
+    }
+
+    if (output_filename[0] == '\0')
+    {
+        gaudiod_default_output(input_filename, WAV_DEFAULT_EXTENSION, output_filename);
+    }
+
+    if (inst_filename != NULL)
+    {
+        struct ALBankFile *bank_file;
+        struct ALKeyMap *keymap = NULL;
+        struct ALSound *sound = NULL;
+        size_t search_len = strlen(inst_search);
+
+        stats_phase_begin("parse inst");
+        bank_file = gaudiod_get_inst_bank(inst_filename);
+
+        if (search_len > 0 && strncasecmp(inst_search, "use", search_len) == 0)
+        {
+            sound = ALBankFile_find_sound_by_aifc_filename(bank_file, inst_val);
+            keymap = sound != NULL ? sound->keymap : NULL;
+        }
+        else if (search_len > 0 && strncasecmp(inst_search, "sound", search_len) == 0)
+        {
+            sound = ALBankFile_find_sound_with_name(bank_file, inst_val);
+            keymap = sound != NULL ? sound->keymap : NULL;
+        }
+        else if (search_len > 0 && strncasecmp(inst_search, "keymap", search_len) == 0)
+        {
+            keymap = ALBankFile_find_keymap_with_name(bank_file, inst_val);
+        }
+        else
+        {
+            fprintf(stderr, "error, inst search value not recognized:%s\n", inst_search);
+            TRACE_LEAVE(__func__)
+            return EXIT_CODE_GENERAL;
+        }
+
+        if (keymap == NULL)
+        {
+            fprintf(stderr, "error reading \"%s\", cannot resolve keymap for \"%s\"\n", inst_filename, inst_val);
+            TRACE_LEAVE(__func__)
+            return EXIT_CODE_GENERAL;
+        }
+
+        keybase = keymap->key_base;
+        detune = keymap->detune;
+        stats_phase_end("parse inst");
+    }
+
+    stats_phase_begin("read");
+    input_file = FileInfo_fopen(input_filename, "rb");
+    aifc_file = AdpcmAifcFile_new_from_file(input_file);
+    stats_add_bytes("read", input_file->len);
+    FileInfo_free(input_file);
+    stats_phase_end("read");
+
+    stats_phase_begin("decode");
+    wav_file = WavFile_new_from_aifc(aifc_file);
+    stats_phase_end("decode");
+
+    if (aifc_file->comm_chunk != NULL)
+    {
+        stats_add_items("decode", "frames", aifc_file->comm_chunk->num_sample_frames);
+    }
+
+    if (opt_write_smpl == 1)
+    {
+        WavFile_check_append_aifc_loop(wav_file, aifc_file);
+
+        if (wav_file->smpl_chunk != NULL)
+        {
+            wav_file->smpl_chunk->midi_unity_note = keybase;
+        }
+    }
+
+    // same as aifc2wav: AL_RAW16_WAVE only adjusts frequency if forced.
+    if (aifc_file->comm_chunk != NULL
+        && aifc_file->comm_chunk->compression_type == ADPCM_AIFC_NONE_COMPRESSION_TYPE_ID)
+    {
+        skip_freq_adjust = 1;
+    }
+
+    AdpcmAifcFile_free(aifc_file);
+
+    if ((opt_explicit || (inst_filename != NULL && (opt_force_freq_adjust == 1 || skip_freq_adjust == 0)))
+        && opt_no_freq_adjust == 0)
+    {
+        double freq = WavFile_get_frequency(wav_file);
+        WavFile_set_frequency(wav_file, detune_frequency(freq, keybase, detune));
+    }
+
+    stats_phase_begin("write");
+    output_file = FileInfo_fopen(output_filename, "wb");
+    WavFile_fwrite(wav_file, output_file);
+    stats_add_bytes("write", (uint64_t)FileInfo_ftell(output_file));
+    FileInfo_free(output_file);
+    stats_phase_end("write");
+
+    WavFile_free(wav_file);
+
+    stats_print(stdout, argv[0]);
+
+    TRACE_LEAVE(__func__)
+
+    return 0;
+}
+
+/**
+ * tabledesign request. Supported options: --in, --out, --order, --predictors.
+ * Only available when built with GSL.
+*/
+static int gaudiod_tabledesign(int argc, char **argv)
+{
+    TRACE_ENTER(__func__)
+
+#ifdef NOGSL
+    fprintf(stderr, "error, %s not available (built without GSL)\n", argv[0]);
+
+    TRACE_LEAVE(__func__)
+
+    return EXIT_CODE_GENERAL;
+#else
+    enum {
+        OPT_ORDER = 3001
+    };
+
+    static struct option options[] =
+    {
+        {"in",         required_argument,           NULL,  'n' },
+        {"out",        required_argument,           NULL,  'o' },
+        {"order",      required_argument,           NULL,  OPT_ORDER },
+        {"predictors", required_argument,           NULL,  'p' },
+        {"quiet",        no_argument,               NULL,  'q' },
+        {"verbose",      no_argument,               NULL,  'v' },
+        {"debug",        no_argument,               NULL,   LONG_OPT_DEBUG },
+        {"stats",        optional_argument,         NULL,   LONG_OPT_STATS },
+        {NULL, 0, NULL, 0}
+    };
+
+    char output_filename[MAX_FILENAME_LEN];
+    char *input_filename = NULL;
+    int order = TABLE_DEFAULT_LAG;
+    int predictors = TABLE_DEFAULT_PREDICTORS;
+    struct FileInfo *input_file;
+    struct FileInfo *output_file;
+    struct WavFile *wav_file = NULL;
+    struct AdpcmAifcFile *aifc_file = NULL;
+    struct ALADPCMBook *book;
+    enum DATA_ENCODING encoding;
+    uint8_t *audio_data;
+    size_t audio_data_len;
+    int ch;
+
+    output_filename[0] = '\0';
+
+    while ((ch = getopt_long(argc, argv, "n:o:p:qv", options, NULL)) != -1)
+    {
+        switch (ch)
+        {
+            case 'n': input_filename = optarg; break;
+            case 'o': snprintf(output_filename, MAX_FILENAME_LEN, "%s", optarg); break;
+
+            case OPT_ORDER:
+                if (gaudiod_parse_int(optarg, "order", 1, 8, &order) != 0)
+                {
+                    TRACE_LEAVE(__func__)
+                    return EXIT_CODE_GENERAL;
+                }
+                break;
+
+            case 'p':
+                if (gaudiod_parse_int(optarg, "predictors", 1, 8, &predictors) != 0)
+                {
+                    TRACE_LEAVE(__func__)
+                    return EXIT_CODE_GENERAL;
+                }
+                break;
+
+            default:
+                if (gaudiod_common_option(ch, optarg) < 0)
+                {
+                    TRACE_LEAVE(__func__)
+                    return EXIT_CODE_GENERAL;
+                }
+                break;
+        }
+    }
+
+    if (input_filename == NULL)
+    {
+        fprintf(stderr, "error, input filename not specified\n");
+        TRACE_LEAVE(__func__)
+        return EXIT_CODE_GENERAL;
+    }
+
+    if (output_filename[0] == '\0')
+    {
+        gaudiod_default_output(input_filename, TABLE_DEFAULT_EXTENSION, output_filename);
+    }
+
+    stats_phase_begin("read");
+    input_file = FileInfo_fopen(input_filename, "rb");
+    stats_add_bytes("read", input_file->len);
+
+    if (string_ends_with(input_filename, WAV_DEFAULT_EXTENSION))
+    {
+        wav_file = WavFile_new_from_file(input_file);
+        encoding = DATA_ENCODING_LSB;
+        audio_data = wav_file->data_chunk->data;
+        audio_data_len = wav_file->data_chunk->ck_data_size;
+    }
+    else if (string_ends_with(input_filename, AIFC_DEFAULT_EXTENSION))
+    {
+        aifc_file = AdpcmAifcFile_new_from_file(input_file);
+        encoding = DATA_ENCODING_MSB;
+        audio_data = aifc_file->sound_chunk->sound_data;
+        audio_data_len = aifc_file->sound_chunk->ck_data_size - 8;
+    }
+    else
+    {
+        fprintf(stderr, "error, file (extension) not supported: %s\n", input_filename);
+        FileInfo_free(input_file);
+        TRACE_LEAVE(__func__)
+        return EXIT_CODE_GENERAL;
+    }
+
+    stats_phase_end("read");
+
+    stats_phase_begin("estimate codebook");
+    book = estimate_codebook(audio_data, audio_data_len, encoding, NULL, order, predictors);
+    stats_add_bytes("estimate codebook", audio_data_len);
+    stats_add_items("estimate codebook", "samples", audio_data_len / 2);
+    stats_phase_end("estimate codebook");
+
+    FileInfo_free(input_file);
+    WavFile_free(wav_file);
+    AdpcmAifcFile_free(aifc_file);
+
+    stats_phase_begin("write");
+    output_file = FileInfo_fopen(output_filename, "wb");
+    ALADPCMBook_write_coef(book, output_file);
+    stats_add_bytes("write", (uint64_t)FileInfo_ftell(output_file));
+    FileInfo_free(output_file);
+    stats_phase_end("write");
+
+    ALADPCMBook_free(book);
+
+    stats_print(stdout, argv[0]);
+
+    TRACE_LEAVE(__func__)
+
+    return 0;
+#endif
+}
+
+/**
+ * Shared option parsing for midi2cseq and cseq2midi.
+ * Supported options: --in, --out, --no-pattern-compression, --pattern-file, --threads.
+ * @returns: zero on success, exit code otherwise.
+*/
+static int gaudiod_midi_opts(int argc, char **argv, char **input_filename, char *output_filename, const char *default_extension, struct MidiConvertOptions *convert_options)
+{
+    TRACE_ENTER(__func__)
+
+    enum {
+        OPT_NO_PATTERN_COMPRESSION = 3001,
+        OPT_PATTERN_FILE
+    };
+
+    static struct option options[] =
+    {
+        {"in",     required_argument,               NULL,  'n' },
+        {"out",    required_argument,               NULL,  'o' },
+        {"no-pattern-compression",    no_argument,  NULL,  OPT_NO_PATTERN_COMPRESSION },
+        {"pattern-file",        required_argument,  NULL,  OPT_PATTERN_FILE },
+        {"threads",             required_argument,  NULL,  LONG_OPT_THREADS },
+        {"quiet",        no_argument,               NULL,  'q' },
+        {"verbose",      no_argument,               NULL,  'v' },
+        {"debug",        no_argument,               NULL,   LONG_OPT_DEBUG },
+        {"stats",        optional_argument,         NULL,   LONG_OPT_STATS },
+        {NULL, 0, NULL, 0}
+    };
+
+    int ch;
+
+    *input_filename = NULL;
+    output_filename[0] = '\0';
+
+    while ((ch = getopt_long(argc, argv, "n:o:qv", options, NULL)) != -1)
+    {
+        switch (ch)
+        {
+            case 'n': *input_filename = optarg; break;
+            case 'o': snprintf(output_filename, MAX_FILENAME_LEN, "%s", optarg); break;
+            case OPT_NO_PATTERN_COMPRESSION: convert_options->no_pattern_compression = 1; break;
+
+            case OPT_PATTERN_FILE:
+                convert_options->use_pattern_marker_file = 1;
+                convert_options->pattern_marker_filename = optarg;
+                break;
+
+            default:
+                if (gaudiod_common_option(ch, optarg) < 0)
+                {
+                    TRACE_LEAVE(__func__)
+                    return EXIT_CODE_GENERAL;
+                }
+                break;
+        }
+    }
+
+    if (convert_options->use_pattern_marker_file && convert_options->no_pattern_compression)
+    {
+        fprintf(stderr, "error, pattern file is not used when pattern compression is disabled\n");
+        TRACE_LEAVE(__func__)
+        return EXIT_CODE_GENERAL;
+    }
+
+    if (*input_filename == NULL)
+    {
+        fprintf(stderr, "error, input filename not specified\n");
+        TRACE_LEAVE(__func__)
+        return EXIT_CODE_GENERAL;
+    }
+
+    if (output_filename[0] == '\0')
+    {
+        gaudiod_default_output(*input_filename, default_extension, output_filename);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return 0;
+}
+
+static int gaudiod_midi2cseq(int argc, char **argv)
+{
+    TRACE_ENTER(__func__)
+
+    char output_filename[MAX_FILENAME_LEN];
+    char *input_filename;
+    struct MidiConvertOptions *convert_options = MidiConvertOptions_new();
+    struct MidiFile *midi_file;
+    struct CseqFile *cseq_file;
+    struct FileInfo *input_file;
+    struct FileInfo *output_file;
+    size_t input_len;
+    int result;
+
+    result = gaudiod_midi_opts(argc, argv, &input_filename, output_filename, MIDI_N64_DEFAULT_EXTENSION, convert_options);
+    if (result != 0)
+    {
+        // pattern filename points into request, don't free it.
+        convert_options->pattern_marker_filename = NULL;
+        MidiConvertOptions_free(convert_options);
+        TRACE_LEAVE(__func__)
+        return result;
+    }
+
+    stats_phase_begin("read");
+    input_file = FileInfo_fopen(input_filename, "rb");
+    midi_file = MidiFile_new_from_file(input_file);
+    input_len = input_file->len;
+    stats_add_bytes("read", input_len);
+    FileInfo_free(input_file);
+    stats_phase_end("read");
+
+    stats_phase_begin("convert");
+    cseq_file = CseqFile_from_MidiFile(midi_file, convert_options);
+    stats_add_bytes("convert", input_len);
+    stats_add_items("convert", "tracks", (uint64_t)midi_file->num_tracks);
+    stats_phase_end("convert");
+
+    MidiFile_free(midi_file);
+
+    stats_phase_begin("write");
+    output_file = FileInfo_fopen(output_filename, "wb");
+    CseqFile_fwrite(cseq_file, output_file);
+    stats_add_bytes("write", (uint64_t)FileInfo_ftell(output_file));
+    FileInfo_free(output_file);
+    stats_phase_end("write");
+
+    CseqFile_free(cseq_file);
+
+    convert_options->pattern_marker_filename = NULL;
+    MidiConvertOptions_free(convert_options);
+
+    stats_print(stdout, argv[0]);
+
+    TRACE_LEAVE(__func__)
+
+    return 0;
+}
+
+static int gaudiod_cseq2midi(int argc, char **argv)
+{
+    TRACE_ENTER(__func__)
+
+    char output_filename[MAX_FILENAME_LEN];
+    char *input_filename;
+    struct MidiConvertOptions *convert_options = MidiConvertOptions_new();
+    struct MidiFile *midi_file;
+    struct CseqFile *cseq_file;
+    struct FileInfo *input_file;
+    struct FileInfo *output_file;
+    size_t input_len;
+    int result;
+
+    result = gaudiod_midi_opts(argc, argv, &input_filename, output_filename, MIDI_DEFAULT_EXTENSION, convert_options);
+    if (result != 0)
+    {
+        convert_options->pattern_marker_filename = NULL;
+        MidiConvertOptions_free(convert_options);
+        TRACE_LEAVE(__func__)
+        return result;
+    }
+
+    stats_phase_begin("read");
+    input_file = FileInfo_fopen(input_filename, "rb");
+    cseq_file = CseqFile_new_from_file(input_file);
+    input_len = input_file->len;
+    stats_add_bytes("read", input_len);
+    FileInfo_free(input_file);
+    stats_phase_end("read");
+
+    stats_phase_begin("convert");
+    midi_file = MidiFile_from_CseqFile(cseq_file, convert_options);
+    stats_add_bytes("convert", input_len);
+    stats_add_items("convert", "tracks", (uint64_t)midi_file->num_tracks);
+    stats_phase_end("convert");
+
+    CseqFile_free(cseq_file);
+
+    stats_phase_begin("write");
+    output_file = FileInfo_fopen(output_filename, "wb");
+    MidiFile_fwrite(midi_file, output_file);
+    stats_add_bytes("write", (uint64_t)FileInfo_ftell(output_file));
+    FileInfo_free(output_file);
+    stats_phase_end("write");
+
+    MidiFile_free(midi_file);
+
+    convert_options->pattern_marker_filename = NULL;
+    MidiConvertOptions_free(convert_options);
+
+    stats_print(stdout, argv[0]);
+
+    TRACE_LEAVE(__func__)
+
+    return 0;
+}
+
+/**
+ * gic request. Supported options: --in, --out, --sample-rate, --sort-natural, --sort-meta.
+ * The .inst file is parsed for every request since building the .tbl updates the bank.
+*/
+static int gaudiod_gic(int argc, char **argv)
+{
+    TRACE_ENTER(__func__)
+
+    enum {
+        OPT_SORT_NATURAL = 3001,
+        OPT_SORT_META
+    };
+
+    static struct option options[] =
+    {
+        {"in",     required_argument,               NULL,  'n' },
+        {"out",    required_argument,               NULL,  'o' },
+        {"sample-rate",  required_argument,         NULL,  'r' },
+        {"sort-natural", no_argument,               NULL,  OPT_SORT_NATURAL },
+        {"sort-meta",    no_argument,               NULL,  OPT_SORT_META },
+        {"quiet",        no_argument,               NULL,  'q' },
+        {"verbose",      no_argument,               NULL,  'v' },
+        {"debug",        no_argument,               NULL,   LONG_OPT_DEBUG },
+        {"stats",        optional_argument,         NULL,   LONG_OPT_STATS },
+        {NULL, 0, NULL, 0}
+    };
+
+    char ctl_filename[MAX_FILENAME_LEN];
+    char tbl_filename[MAX_FILENAME_LEN];
+    char *input_filename = NULL;
+    char *output_filename = NULL;
+    int opt_sample_rate = 0;
+    int sample_rate = 0;
+    int sort_method = CTL_SORT_METHOD_NATURAL;
+    struct FileInfo *input_file;
+    struct ALBankFile *bank_file;
+    int ch;
+
+    while ((ch = getopt_long(argc, argv, "n:o:r:qv", options, NULL)) != -1)
+    {
+        switch (ch)
+        {
+            case 'n': input_filename = optarg; break;
+            case 'o': output_filename = optarg; break;
+            case OPT_SORT_NATURAL: sort_method = CTL_SORT_METHOD_NATURAL; break;
+            case OPT_SORT_META: sort_method = CTL_SORT_METHOD_META; break;
+
+            case 'r':
+                opt_sample_rate = 1;
+                if (gaudiod_parse_int(optarg, "sample-rate", 1, INT_MAX, &sample_rate) != 0)
+                {
+                    TRACE_LEAVE(__func__)
+                    return EXIT_CODE_GENERAL;
+                }
+                break;
+
+            default:
+                if (gaudiod_common_option(ch, optarg) < 0)
+                {
+                    TRACE_LEAVE(__func__)
+                    return EXIT_CODE_GENERAL;
+                }
+                break;
+        }
+    }
+
+    if (input_filename == NULL)
+    {
+        fprintf(stderr, "error, input filename not specified\n");
+        TRACE_LEAVE(__func__)
+        return EXIT_CODE_GENERAL;
+    }
+
+    gaudiod_default_output(output_filename != NULL ? output_filename : input_filename, NAUDIO_CTL_DEFAULT_EXTENSION, ctl_filename);
+    gaudiod_default_output(output_filename != NULL ? output_filename : input_filename, NAUDIO_TBL_DEFAULT_EXTENSION, tbl_filename);
+
+    stats_phase_begin("parse inst");
+    input_file = FileInfo_fopen(input_filename, "rb");
+    bank_file = ALBankFile_new_from_inst(input_file);
+    stats_add_bytes("parse inst", input_file->len);
+    FileInfo_free(input_file);
+    stats_phase_end("parse inst");
+
+    if (opt_sample_rate == 1)
+    {
+        int bank_count;
+
+        for (bank_count=0; bank_count<bank_file->bank_count; bank_count++)
+        {
+            if (bank_file->banks[bank_count] != NULL)
+            {
+                bank_file->banks[bank_count]->sample_rate = sample_rate;
+            }
+        }
+    }
+
+    bank_file->ctl_sort_method = sort_method;
+
+    // .tbl first, this sets wavetable->base offsets used in .ctl
+    stats_phase_begin("write tbl");
+    ALBankFile_write_tbl(bank_file, tbl_filename);
+    stats_phase_end("write tbl");
+
+    stats_phase_begin("write ctl");
+    ALBankFile_write_ctl(bank_file, ctl_filename);
+    stats_phase_end("write ctl");
+
+    ALBankFile_free(bank_file);
+
+    stats_print(stdout, argv[0]);
+
+    TRACE_LEAVE(__func__)
+
+    return 0;
+}
+
+/**
+ * cseq2wav request. Supported options: --in, --out, --ctl, --tbl, --bank,
+ * --sample-rate, --voices, --tail. The parsed .ctl, .tbl contents, and decoded
+ * audio are cached.
+*/
+static int gaudiod_cseq2wav(int argc, char **argv)
+{
+    TRACE_ENTER(__func__)
+
+    enum {
+        OPT_BANK = 3001,
+        OPT_SAMPLE_RATE,
+        OPT_VOICES,
+        OPT_TAIL
+    };
+
+    static struct option options[] =
+    {
+        {"in",     required_argument,               NULL,  'n' },
+        {"out",    required_argument,               NULL,  'o' },
+        {"ctl",    required_argument,               NULL,  'c' },
+        {"tbl",    required_argument,               NULL,  't' },
+        {"bank",          required_argument,        NULL,  OPT_BANK },
+        {"sample-rate",   required_argument,        NULL,  OPT_SAMPLE_RATE },
+        {"voices",        required_argument,        NULL,  OPT_VOICES },
+        {"tail",          required_argument,        NULL,  OPT_TAIL },
+        {"quiet",        no_argument,               NULL,  'q' },
+        {"verbose",      no_argument,               NULL,  'v' },
+        {"debug",        no_argument,               NULL,   LONG_OPT_DEBUG },
+        {"stats",        optional_argument,         NULL,   LONG_OPT_STATS },
+        {NULL, 0, NULL, 0}
+    };
+
+    char output_filename[MAX_FILENAME_LEN];
+    char *input_filename = NULL;
+    char *ctl_filename = NULL;
+    char *tbl_filename = NULL;
+    struct RenderOptions *render_options = RenderOptions_new();
+    struct GaudiodRenderBank *render_bank;
+    struct CseqFile *cseq_file;
+    struct WavFile *wav_file;
+    struct FileInfo *input_file;
+    struct FileInfo *output_file;
+    int result = 0;
+    int ch;
+
+    output_filename[0] = '\0';
+
+    while (result == 0 && (ch = getopt_long(argc, argv, "n:o:c:t:qv", options, NULL)) != -1)
+    {
+        switch (ch)
+        {
+            case 'n': input_filename = optarg; break;
+            case 'o': snprintf(output_filename, MAX_FILENAME_LEN, "%s", optarg); break;
+            case 'c': ctl_filename = optarg; break;
+            case 't': tbl_filename = optarg; break;
+
+            case OPT_BANK:
+                result = gaudiod_parse_int(optarg, "bank", 0, INT_MAX, &render_options->bank_index);
+                break;
+
+            case OPT_SAMPLE_RATE:
+                result = gaudiod_parse_int(optarg, "sample-rate", 1, INT_MAX, &render_options->sample_rate);
+                break;
+
+            case OPT_VOICES:
+                result = gaudiod_parse_int(optarg, "voices", 1, RENDER_MAX_VOICES, &render_options->max_voices);
+                break;
+
+            case OPT_TAIL:
+                result = gaudiod_parse_int(optarg, "tail", 0, INT_MAX, &render_options->tail_ms);
+                break;
+
+            default:
+                result = gaudiod_common_option(ch, optarg) < 0 ? -1 : 0;
+                break;
+        }
+    }
+
+    if (result == 0 && (input_filename == NULL || ctl_filename == NULL || tbl_filename == NULL))
+    {
+        fprintf(stderr, "error, input, ctl, and tbl filenames are required\n");
+        result = -1;
+    }
+
+    if (result != 0)
+    {
+        RenderOptions_free(render_options);
+        TRACE_LEAVE(__func__)
+        return EXIT_CODE_GENERAL;
+    }
+
+    if (output_filename[0] == '\0')
+    {
+        gaudiod_default_output(input_filename, WAV_DEFAULT_EXTENSION, output_filename);
+    }
+
+    stats_phase_begin("read");
+    input_file = FileInfo_fopen(input_filename, "rb");
+    cseq_file = CseqFile_new_from_file(input_file);
+    stats_add_bytes("read", input_file->len);
+    FileInfo_free(input_file);
+
+    render_bank = gaudiod_get_render_bank(ctl_filename, tbl_filename);
+    stats_phase_end("read");
+
+    render_options->pcm_cache = render_bank->pcm_cache;
+
+    stats_phase_begin("render");
+    wav_file = WavFile_new_from_cseq(cseq_file, render_bank->bank_file, render_bank->tbl_file_contents, render_options);
+    stats_add_items("render", "frames", (uint64_t)wav_file->data_chunk->ck_data_size / (uint64_t)wav_file->fmt_chunk->block_align);
+    stats_phase_end("render");
+
+    stats_phase_begin("write");
+    output_file = FileInfo_fopen(output_filename, "wb");
+    WavFile_fwrite(wav_file, output_file);
+    stats_add_bytes("write", (uint64_t)FileInfo_ftell(output_file));
+    FileInfo_free(output_file);
+    stats_phase_end("write");
+
+    WavFile_free(wav_file);
+    CseqFile_free(cseq_file);
+    RenderOptions_free(render_options);
+
+    stats_print(stdout, argv[0]);
+
+    TRACE_LEAVE(__func__)
+
+    return 0;
+}
@@ -26,6 +26,7 @@
 #include "machine_config.h"
 #include "common.h"
 #include "utility.h"
+#include "stats.h"
 #include "llist.h"
 #include "naudio.h"
 #include "adpcm_aifc.h"
@@ -57,6 +58,7 @@ static char *output_filename = NULL;
 static size_t output_filename_len = 0;
 
 #define LONG_OPT_DEBUG               1003
+#define LONG_OPT_STATS               1005
 #define LONG_OPT_SORT_NATURAL        2001
 #define LONG_OPT_SORT_META           2002
 
@@ -73,6 +75,7 @@ static struct option long_options[] =
     {"quiet",        no_argument,               NULL,  'q' },
     {"verbose",      no_argument,               NULL,  'v' },
     {"debug",        no_argument,               NULL,   LONG_OPT_DEBUG },
+    {"stats",        optional_argument,         NULL,   LONG_OPT_STATS },
     {NULL, 0, NULL, 0}
 };
 
@@ -103,6 +106,7 @@ void print_help(const char * invoke)
     printf("                                  ALSound order. Default value. Incompatible with sort-meta.\n");
     printf("    --sort-meta                   write envelope and keymap according to metaCtlWriteOrder\n");
     printf("                                  property read from .inst file. Incompatible with sort-natural.\n");
+    printf("    --stats[=json]                print time and throughput per phase when done.\n");
     printf("    -q,--quiet                    suppress output\n");
     printf("    -v,--verbose                  more output\n");
     printf("\n");
@@ -211,6 +215,19 @@ void read_opts(int argc, char **argv)
                 }
                 break;
 
+            case LONG_OPT_STATS:
+            {
+                int stats_format = stats_parse_format(optarg);
+
+                if (stats_format < 0)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, --stats format not recognized: %s\n", optarg);
+                }
+
+                stats_enable(stats_format);
+            }
+            break;
+
             case '?':
                 print_help(argv[0]);
                 exit(0);
@@ -281,9 +298,12 @@ int main(int argc, char **argv)
         fflush(stdout);
     }
 
+    stats_phase_begin("parse inst");
     input_file = FileInfo_fopen(input_filename, "rb");
 
     bank_file = ALBankFile_new_from_inst(input_file);
+    stats_add_bytes("parse inst", input_file->len);
+    stats_phase_end("parse inst");
 
     if (opt_sample_rate == 1)
     {
@@ -330,8 +350,13 @@ int main(int argc, char **argv)
 
     // it's necessary to write the .tbl file first in order to set the wavetable->base
     // offset values.
+    stats_phase_begin("write tbl");
     ALBankFile_write_tbl(bank_file, tbl_filename);
+    stats_phase_end("write tbl");
+
+    stats_phase_begin("write ctl");
     ALBankFile_write_ctl(bank_file, ctl_filename);
+    stats_phase_end("write ctl");
 
     // done with input file
     FileInfo_free(input_file);
@@ -353,6 +378,8 @@ int main(int argc, char **argv)
         free(output_filename);
         output_filename = NULL;
     }
+
+    stats_print(stdout, APPNAME);
     
     return 0;
 }
\ No newline at end of file
@@ -20,12 +20,16 @@
 #include <stdint.h>
 #include <string.h>
 #include <getopt.h>
+#include <errno.h>
 #include "debug.h"
 #include "machine_config.h"
 #include "common.h"
 #include "utility.h"
+#include "stats.h"
+#include "parallel.h"
 #include "midi.h"
 #include "x.h"
+#include "gaudio.h"
 
 /**
  * This file contains main entry for midi2cseq app.
@@ -50,8 +54,10 @@ static size_t pattern_filename_len = 0;
 
 #define LONG_OPT_DEBUG   1003
 #define LONG_OPT_PARSE_DEBUG   1004
+#define LONG_OPT_STATS   1005
 #define LONG_OPT_NO_PATTERN_COMPRESSION   2001
 #define LONG_OPT_PATTERN_FILE  2003
+#define LONG_OPT_THREADS  2004
 
 static struct option long_options[] =
 {
@@ -60,9 +66,11 @@ static struct option long_options[] =
     {"out",    required_argument,               NULL,  'o' },
     {"no-pattern-compression",    no_argument,  NULL,  LONG_OPT_NO_PATTERN_COMPRESSION },
     {"pattern-file",        required_argument,  NULL,  LONG_OPT_PATTERN_FILE },
+    {"threads",             required_argument,  NULL,  LONG_OPT_THREADS },
     {"quiet",        no_argument,               NULL,  'q' },
     {"verbose",      no_argument,               NULL,  'v' },
     {"debug",        no_argument,               NULL,   LONG_OPT_DEBUG },
+    {"stats",        optional_argument,         NULL,   LONG_OPT_STATS },
     {"parsedebug",   no_argument,               NULL,   LONG_OPT_PARSE_DEBUG },
     {NULL, 0, NULL, 0}
 };
@@ -94,6 +102,10 @@ void print_help(const char * invoke)
     printf("                                  disables that.\n");
     printf("    --pattern-file=FILE           Reads pattern markers from previously saved file. Only\n");
     printf("                                  applies when pattern compression is not disabled.\n");
+    printf("                                  Text and binary (.bin) files are both accepted.\n");
+    printf("    --threads=INT                 Number of threads used to convert tracks. Default is\n");
+    printf("                                  the number of processors. Use 1 to disable.\n");
+    printf("    --stats[=json]                print time and throughput per phase when done.\n");
     printf("    -q,--quiet                    suppress output\n");
     printf("    -v,--verbose                  more output\n");
     printf("\n");
@@ -157,6 +169,30 @@ void read_opts(int argc, char **argv)
             }
             break;
 
+            case LONG_OPT_THREADS:
+            {
+                int res;
+                char *pend = NULL;
+
+                errno = 0;
+                res = strtol(optarg, &pend, 0);
+
+                if (pend != NULL && *pend == '\0')
+                {
+                    if (errno == ERANGE || res < 0)
+                    {
+                        stderr_exit(EXIT_CODE_GENERAL, "error, invalid number of threads: %s\n", optarg);
+                    }
+
+                    g_parallel_num_threads = res;
+                }
+                else
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, cannot parse threads as integer: %s\n", optarg);
+                }
+            }
+            break;
+
             case 'q':
                 g_verbosity = 0;
                 break;
@@ -177,6 +213,19 @@ void read_opts(int argc, char **argv)
                 g_midi_parse_debug = 1;
                 break;
 
+            case LONG_OPT_STATS:
+            {
+                int stats_format = stats_parse_format(optarg);
+
+                if (stats_format < 0)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, --stats format not recognized: %s\n", optarg);
+                }
+
+                stats_enable(stats_format);
+            }
+            break;
+
             case '?':
                 print_help(argv[0]);
                 exit(0);
@@ -187,11 +236,13 @@ void read_opts(int argc, char **argv)
 
 int main(int argc, char **argv)
 {
-    struct MidiFile *midi_file;
-    struct CseqFile *cseq_file;
-    struct FileInfo *input_file;
+    struct GaudioSeqOptions options;
+    struct GaudioError error;
     struct FileInfo *output_file;
-    struct MidiConvertOptions *convert_options;
+    uint8_t *input = NULL;
+    size_t input_len;
+    uint8_t *output;
+    size_t output_len;
 
     read_opts(argc, argv);
 
@@ -230,37 +281,36 @@ int main(int argc, char **argv)
         fflush(stdout);
     }
 
-    input_file = FileInfo_fopen(input_filename, "rb");
-    midi_file = MidiFile_new_from_file(input_file);
+    stats_phase_begin("read");
+    input_len = get_file_contents(input_filename, &input);
+    stats_add_bytes("read", input_len);
+    stats_phase_end("read");
 
-    // done with input file
-    FileInfo_free(input_file);
-    input_file = NULL;
+    GaudioSeqOptions_init(&options);
+    options.no_pattern_compression = opt_no_pattern_compression;
 
-    convert_options = MidiConvertOptions_new();
-    convert_options->no_pattern_compression = opt_no_pattern_compression;
     if (opt_use_pattern_file)
     {
-        convert_options->use_pattern_marker_file = 1;
-        convert_options->pattern_marker_filename = pattern_filename;
+        options.pattern_file = pattern_filename;
     }
 
-    cseq_file = CseqFile_from_MidiFile(midi_file, convert_options);
+    if (gaudio_midi_to_cseq(input, input_len, &options, &output, &output_len, &error) != GAUDIO_OK)
+    {
+        stderr_exit(error.code, "%s\n", error.message);
+    }
 
-    // done with source MIDI file
-    MidiFile_free(midi_file);
-    midi_file = NULL;
+    // done with input file
+    free(input);
+    input = NULL;
 
     // write to output file
+    stats_phase_begin("write");
     output_file = FileInfo_fopen(output_filename, "wb");
-    CseqFile_fwrite(cseq_file, output_file);
-
-    // done with cseq file
-    CseqFile_free(cseq_file);
-    cseq_file = NULL;
-
+    FileInfo_fwrite(output_file, output, output_len, 1);
+    stats_add_bytes("write", output_len);
     FileInfo_free(output_file);
-    MidiConvertOptions_free(convert_options);
+    gaudio_buffer_free(output);
+    stats_phase_end("write");
 
     if (input_filename != NULL)
     {
@@ -280,5 +330,7 @@ int main(int argc, char **argv)
         pattern_filename = NULL;
     }
 
+    stats_print(stdout, APPNAME);
+
     return 0;
 }
\ No newline at end of file
@@ -26,6 +26,7 @@
 #include "machine_config.h"
 #include "common.h"
 #include "utility.h"
+#include "stats.h"
 #include "midi.h"
 
 /**
@@ -70,6 +71,24 @@ static const char *MIDITOOL_MODE_ACTION_NAMES[] = {
 #define MIN_VALID_INSTRUMENT 0
 #define MAX_VALID_INSTRUMENT 128
 
+#define MAX_ACTIONS 32
+
+/**
+ * Action read from the command line. Parameters given before the action
+ * belong to it; any not given before use the last value on the command line.
+*/
+struct MiditoolAction {
+    int mode;
+    int opt_channel;
+    int opt_track;
+    int opt_instrument;
+    int opt_loop_number;
+    int channel;
+    int track;
+    int instrument;
+    int loop_number;
+};
+
 static int opt_help_flag = 0;
 static int opt_input_file = 0;
 static int opt_output_file = 0;
@@ -78,6 +97,7 @@ static int opt_channel = 0;
 static int opt_track = 0;
 static int opt_instrument = 0;
 static int opt_loop_number = 0;
+static int opt_stream = 0;
 //static int opt_parse_mode = 0;
 static char *input_filename = NULL;
 static size_t input_filename_len = 0;
@@ -86,6 +106,8 @@ static size_t output_filename_len = 0;
 static char *temp_filename = NULL;
 static size_t temp_filename_len = 0;
 static int tool_mode = MIDITOOL_MODE_DEFAULT_UNKNOWN;
+static struct MiditoolAction actions[MAX_ACTIONS];
+static int num_actions = 0;
 static int user_channel = 0;
 static int user_track = 0;
 static int user_instrument = 0;
@@ -93,6 +115,7 @@ static int user_loop_number = 0;
 //static int user_implementation = MIDI_IMPLEMENTATION_STANDARD;
 
 #define LONG_OPT_DEBUG   1003
+#define LONG_OPT_STATS   1005
 
 #define LONG_OPT_LOOP_NUMBER    2001
 #define LONG_OPT_PARSE_MODE     2002
@@ -107,10 +130,12 @@ static struct option long_options[] =
     {"track",         required_argument,          NULL,  't' },
     {"instrument",    required_argument,          NULL,  'i' },
     {"loop-number",   required_argument,          NULL,  LONG_OPT_LOOP_NUMBER },
+    {"stream",         no_argument,       &opt_stream,    1  },
     //{"parse-mode",    required_argument,          NULL,  LONG_OPT_PARSE_MODE },
     {"quiet",          no_argument,               NULL,  'q' },
     {"verbose",        no_argument,               NULL,  'v' },
     {"debug",          no_argument,               NULL,   LONG_OPT_DEBUG },
+    {"stats",          optional_argument,         NULL,   LONG_OPT_STATS },
     {NULL, 0, NULL, 0}
 };
 
@@ -118,6 +143,8 @@ static struct option long_options[] =
 
 void print_help(const char * invoke);
 void read_opts(int argc, char **argv);
+static int stream_set_channel_instrument(struct GmidEvent *event, int track_index, void *state);
+static int stream_make_channel_track(struct GmidEvent *event, int track_index, void *state);
 
 // end forward declarations
 
@@ -134,12 +161,19 @@ void print_help(const char * invoke)
     printf("\n");
     printf("    --help                        print this help\n");
     printf("    -n,--in=FILE                  input MIDI file\n");
-    printf("    -a,--action=TEXT              Action to perform\n");
+    printf("    -a,--action=TEXT              Action to perform. Transform actions can be given more than\n");
+    printf("                                  once, and are applied in order in a single pass. Parameters\n");
+    printf("                                  given before an action apply to that action.\n");
     printf("    -c,--channel=INT              Channel value.\n");
     printf("    -t,--track=INT                Track value.\n");
     printf("    -i,--instrument=INT           Instrument value.\n");
     //printf("    --parse-mode=TEXT             Input file format. Supported options: midi, seq\n");
     printf("    --loop-number=INT             Loop number value.\n");
+    printf("    --stream                      Read and write events one at a time instead of loading\n");
+    printf("                                  the whole file. Output is the same as without --stream.\n");
+    printf("                                  Only one action can be given. Supported actions: parse,\n");
+    printf("                                  parse-track, make-channel-track, set-channel-instrument\n");
+    printf("    --stats[=json]                print time and throughput per phase when done.\n");
     printf("    -q,--quiet                    suppress output\n");
     printf("    -v,--verbose                  more output\n");
     printf("\n");
@@ -173,6 +207,7 @@ void read_opts(int argc, char **argv)
     int option_index = 0;
     int ch;
     size_t str_len;
+    int i;
 
     while ((ch = getopt_long(argc, argv, "a:c:t:i:n:o:qv", long_options, &option_index)) != -1)
     {
@@ -319,6 +354,11 @@ void read_opts(int argc, char **argv)
                     stderr_exit(EXIT_CODE_GENERAL, "error, action not specified\n");
                 }
 
+                if (num_actions >= MAX_ACTIONS)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, too many actions, max %d\n", MAX_ACTIONS);
+                }
+
                 if (strncasecmp(optarg, MIDITOOL_MODE_ACTION_NAMES[MIDITOOL_MODE_SET_CHANNEL_INSTRUMENT], str_len) == 0)
                 {
                     tool_mode = MIDITOOL_MODE_SET_CHANNEL_INSTRUMENT;
@@ -347,6 +387,17 @@ void read_opts(int argc, char **argv)
                 {
                     stderr_exit(EXIT_CODE_GENERAL, "error, action value not recognized:%s\n", optarg);
                 }
+
+                actions[num_actions].mode = tool_mode;
+                actions[num_actions].opt_channel = opt_channel;
+                actions[num_actions].opt_track = opt_track;
+                actions[num_actions].opt_instrument = opt_instrument;
+                actions[num_actions].opt_loop_number = opt_loop_number;
+                actions[num_actions].channel = user_channel;
+                actions[num_actions].track = user_track;
+                actions[num_actions].instrument = user_instrument;
+                actions[num_actions].loop_number = user_loop_number;
+                num_actions++;
             }
             break;
 
@@ -387,12 +438,53 @@ void read_opts(int argc, char **argv)
                 g_verbosity = VERBOSE_DEBUG;
                 break;
 
+            case LONG_OPT_STATS:
+            {
+                int stats_format = stats_parse_format(optarg);
+
+                if (stats_format < 0)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, --stats format not recognized: %s\n", optarg);
+                }
+
+                stats_enable(stats_format);
+            }
+            break;
+
             case '?':
                 print_help(argv[0]);
                 exit(0);
                 break;
         }
     }
+
+    // parameters not given before an action use the last value given.
+    for (i=0; i<num_actions; i++)
+    {
+        if (!actions[i].opt_channel)
+        {
+            actions[i].opt_channel = opt_channel;
+            actions[i].channel = user_channel;
+        }
+
+        if (!actions[i].opt_track)
+        {
+            actions[i].opt_track = opt_track;
+            actions[i].track = user_track;
+        }
+
+        if (!actions[i].opt_instrument)
+        {
+            actions[i].opt_instrument = opt_instrument;
+            actions[i].instrument = user_instrument;
+        }
+
+        if (!actions[i].opt_loop_number)
+        {
+            actions[i].opt_loop_number = opt_loop_number;
+            actions[i].loop_number = user_loop_number;
+        }
+    }
 }
 
 int main(int argc, char **argv)
@@ -402,6 +494,7 @@ int main(int argc, char **argv)
     struct FileInfo *input_file;
     struct FileInfo *output_file;
     int fs_result;
+    int i;
 
     read_opts(argc, argv);
 
@@ -433,33 +526,48 @@ int main(int argc, char **argv)
         fflush(stdout);
     }
 
-    if (tool_mode == MIDITOOL_MODE_SET_CHANNEL_INSTRUMENT)
+    for (i=0; i<num_actions; i++)
     {
-        if (opt_channel == 0)
+        int mode = actions[i].mode;
+
+        if (mode == MIDITOOL_MODE_SET_CHANNEL_INSTRUMENT)
+        {
+            if (actions[i].opt_channel == 0)
+            {
+                stderr_exit(EXIT_CODE_GENERAL, "Error, channel required for action %s\n", MIDITOOL_MODE_ACTION_NAMES[mode]);
+            }
+
+            if (actions[i].opt_instrument == 0)
+            {
+                stderr_exit(EXIT_CODE_GENERAL, "Error, instrument required for action %s\n", MIDITOOL_MODE_ACTION_NAMES[mode]);
+            }
+        }
+
+        if (mode == MIDITOOL_MODE_REMOVE_LOOP || mode == MIDITOOL_MODE_ADD_NOTE_LOOP)
         {
-            stderr_exit(EXIT_CODE_GENERAL, "Error, channel required for action %s\n", MIDITOOL_MODE_ACTION_NAMES[tool_mode]);
+            if (actions[i].opt_loop_number == 0)
+            {
+                stderr_exit(EXIT_CODE_GENERAL, "Error, loop required for action %s\n", MIDITOOL_MODE_ACTION_NAMES[mode]);
+            }
         }
 
-        if (opt_instrument == 0)
+        if (mode == MIDITOOL_MODE_REMOVE_LOOP || mode == MIDITOOL_MODE_ADD_NOTE_LOOP || mode == MIDITOOL_MODE_PARSE_TRACK)
         {
-            stderr_exit(EXIT_CODE_GENERAL, "Error, instrument required for action %s\n", MIDITOOL_MODE_ACTION_NAMES[tool_mode]);
+            if (actions[i].opt_track == 0)
+            {
+                stderr_exit(EXIT_CODE_GENERAL, "Error, track required for action %s\n", MIDITOOL_MODE_ACTION_NAMES[mode]);
+            }
         }
-    }
 
-    if (tool_mode == MIDITOOL_MODE_REMOVE_LOOP || tool_mode == MIDITOOL_MODE_ADD_NOTE_LOOP)
-    {
-        if (opt_loop_number == 0)
+        if (num_actions > 1 && (mode == MIDITOOL_MODE_PARSE || mode == MIDITOOL_MODE_PARSE_TRACK))
         {
-            stderr_exit(EXIT_CODE_GENERAL, "Error, loop required for action %s\n", MIDITOOL_MODE_ACTION_NAMES[tool_mode]);
+            stderr_exit(EXIT_CODE_GENERAL, "Error, action %s can not be combined with other actions\n", MIDITOOL_MODE_ACTION_NAMES[mode]);
         }
     }
 
-    if (tool_mode == MIDITOOL_MODE_REMOVE_LOOP || tool_mode == MIDITOOL_MODE_ADD_NOTE_LOOP || tool_mode == MIDITOOL_MODE_PARSE_TRACK)
+    if (opt_stream && num_actions > 1)
     {
-        if (opt_track == 0)
-        {
-            stderr_exit(EXIT_CODE_GENERAL, "Error, track required for action %s\n", MIDITOOL_MODE_ACTION_NAMES[tool_mode]);
-        }
+        stderr_exit(EXIT_CODE_GENERAL, "Error, --stream only supports a single action\n");
     }
 
     // if (tool_mode == MIDITOOL_MODE_ADD_NOTE_LOOP || tool_mode == MIDITOOL_MODE_PARSE_TRACK)
@@ -470,6 +578,15 @@ int main(int argc, char **argv)
     //     }
     // }
 
+    if (opt_stream
+        && tool_mode != MIDITOOL_MODE_PARSE
+        && tool_mode != MIDITOOL_MODE_PARSE_TRACK
+        && tool_mode != MIDITOOL_MODE_MAKE_CHANNEL_TRACK
+        && tool_mode != MIDITOOL_MODE_SET_CHANNEL_INSTRUMENT)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "Error, --stream not supported for action %s\n", MIDITOOL_MODE_ACTION_NAMES[tool_mode]);
+    }
+
     int transform = 0;
 
     output_filename_len = snprintf(NULL, 0, "%s.~", input_filename) + 1;
@@ -482,83 +599,125 @@ int main(int argc, char **argv)
 
     input_file = FileInfo_fopen(input_filename, "rb");
 
-    // if (user_implementation == MIDI_IMPLEMENTATION_STANDARD)
-    // {
-    midi_file = MidiFile_new_from_file(input_file);
-    // }
-    // else
-    // {
-    //     cseq_file = CseqFile_new_from_file(input_file);
-    // }
-
-    // done with input file
-    FileInfo_free(input_file);
-
-    if (tool_mode == MIDITOOL_MODE_SET_CHANNEL_INSTRUMENT)
+    if (opt_stream)
     {
-        transform = 1;
+        midi_file = NULL;
 
-        struct MidiFile *new_midi_file = MidiFile_transform_set_channel_instrument(midi_file, user_channel, user_instrument);
-        MidiFile_free(midi_file);
-        midi_file = new_midi_file;
-    }
-    else if (tool_mode == MIDITOOL_MODE_MAKE_CHANNEL_TRACK)
-    {
-        transform = 1;
-        
-        struct MidiFile *new_midi_file = MidiFile_transform_make_channel_track(midi_file);
-        MidiFile_free(midi_file);
-        midi_file = new_midi_file;
-    }
-    else if (tool_mode == MIDITOOL_MODE_REMOVE_LOOP)
-    {
-        transform = 1;
-        
-        struct MidiFile *new_midi_file = MidiFile_transform_remove_loop(midi_file, user_loop_number, user_track);
-        MidiFile_free(midi_file);
-        midi_file = new_midi_file;
-    }
-    else if (tool_mode == MIDITOOL_MODE_ADD_NOTE_LOOP)
-    {
-        transform = 1;
-        
-        struct MidiFile *new_midi_file = MidiFile_transform_add_note_loop(midi_file, user_loop_number, user_track);
-        MidiFile_free(midi_file);
-        midi_file = new_midi_file;
-    }
-    else if (tool_mode == MIDITOOL_MODE_PARSE || tool_mode == MIDITOOL_MODE_PARSE_TRACK)
-    {
-        int parse_track_arg = -1;
-        if (opt_track)
+        stats_phase_begin("stream");
+        stats_add_bytes("stream", input_file->len);
+
+        if (tool_mode == MIDITOOL_MODE_PARSE || tool_mode == MIDITOOL_MODE_PARSE_TRACK)
         {
-            parse_track_arg = user_track;
+            MidiFile_stream_parse(input_file, actions[0].opt_track ? actions[0].track : -1);
         }
+        else
+        {
+            transform = 1;
 
-        // if (user_implementation == MIDI_IMPLEMENTATION_STANDARD)
-        // {
-        MidiFile_parse(midi_file, parse_track_arg);
-        // }
-        // else
-        // {
-        //     CseqFile_parse(midi_file, parse_track_arg);
-        // }
-    }
+            output_file = FileInfo_fopen(output_filename, "wb");
 
-    if (transform)
-    {
-        output_file = FileInfo_fopen(output_filename, "wb");
+            if (tool_mode == MIDITOOL_MODE_SET_CHANNEL_INSTRUMENT)
+            {
+                MidiFile_stream_transform(input_file, output_file, 0, stream_set_channel_instrument, &actions[0]);
+            }
+            else if (tool_mode == MIDITOOL_MODE_MAKE_CHANNEL_TRACK)
+            {
+                MidiFile_stream_transform(input_file, output_file, 1, stream_make_channel_track, NULL);
+            }
+
+            FileInfo_free(output_file);
+        }
 
+        FileInfo_free(input_file);
+        stats_phase_end("stream");
+    }
+    else
+    {
+        stats_phase_begin("read");
         // if (user_implementation == MIDI_IMPLEMENTATION_STANDARD)
         // {
-        MidiFile_fwrite(midi_file, output_file);
+        midi_file = MidiFile_new_from_file(input_file);
         // }
         // else
         // {
-        //     CseqFile_fwrite(cseq_file, output_file);
+        //     cseq_file = CseqFile_new_from_file(input_file);
         // }
+        stats_add_bytes("read", input_file->len);
+
+        // done with input file
+        FileInfo_free(input_file);
+        stats_phase_end("read");
+
+        if (tool_mode == MIDITOOL_MODE_PARSE || tool_mode == MIDITOOL_MODE_PARSE_TRACK)
+        {
+            int parse_track_arg = -1;
+            if (actions[0].opt_track)
+            {
+                parse_track_arg = actions[0].track;
+            }
+
+            stats_phase_begin("parse");
+            // if (user_implementation == MIDI_IMPLEMENTATION_STANDARD)
+            // {
+            MidiFile_parse(midi_file, parse_track_arg);
+            // }
+            // else
+            // {
+            //     CseqFile_parse(midi_file, parse_track_arg);
+            // }
+            stats_phase_end("parse");
+        }
+        else
+        {
+            transform = 1;
+
+            struct MidiTransformStep *steps = (struct MidiTransformStep *)malloc_zero(num_actions, sizeof(struct MidiTransformStep));
+
+            for (i=0; i<num_actions; i++)
+            {
+                switch (actions[i].mode)
+                {
+                    case MIDITOOL_MODE_SET_CHANNEL_INSTRUMENT: steps[i].transform = MIDI_TRANSFORM_SET_CHANNEL_INSTRUMENT; break;
+                    case MIDITOOL_MODE_MAKE_CHANNEL_TRACK: steps[i].transform = MIDI_TRANSFORM_MAKE_CHANNEL_TRACK; break;
+                    case MIDITOOL_MODE_REMOVE_LOOP: steps[i].transform = MIDI_TRANSFORM_REMOVE_LOOP; break;
+                    case MIDITOOL_MODE_ADD_NOTE_LOOP: steps[i].transform = MIDI_TRANSFORM_ADD_NOTE_LOOP; break;
+                }
 
-        // done with output file
-        FileInfo_free(output_file);
+                steps[i].channel = actions[i].channel;
+                steps[i].instrument = actions[i].instrument;
+                steps[i].track = actions[i].track;
+                steps[i].loop_number = actions[i].loop_number;
+            }
+
+            stats_phase_begin("transform");
+            struct MidiFile *new_midi_file = MidiFile_transform_pipeline(midi_file, steps, num_actions);
+            stats_add_items("transform", "tracks", (uint64_t)midi_file->num_tracks);
+            stats_phase_end("transform");
+            MidiFile_free(midi_file);
+            midi_file = new_midi_file;
+
+            free(steps);
+        }
+
+        if (transform)
+        {
+            stats_phase_begin("write");
+            output_file = FileInfo_fopen(output_filename, "wb");
+
+            // if (user_implementation == MIDI_IMPLEMENTATION_STANDARD)
+            // {
+            MidiFile_fwrite(midi_file, output_file);
+            // }
+            // else
+            // {
+            //     CseqFile_fwrite(cseq_file, output_file);
+            // }
+            stats_add_bytes("write", (uint64_t)FileInfo_ftell(output_file));
+
+            // done with output file
+            FileInfo_free(output_file);
+            stats_phase_end("write");
+        }
     }
 
     if (midi_file != NULL)
@@ -593,6 +752,54 @@ int main(int argc, char **argv)
             stderr_exit(EXIT_CODE_IO, "Error attempting to delete temporary file.\n");
         }
     }
+
+    stats_print(stdout, APPNAME);
     
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * Streaming callback for set-channel-instrument action.
+ * Same as {@code GmidFile_transform_set_channel_instrument}, applied to one event.
+ * @param event: event read from input.
+ * @param track_index: source track index.
+ * @param state: {@code struct MiditoolAction} with channel and instrument.
+ * @returns: 1, always keep the event.
+*/
+static int stream_set_channel_instrument(struct GmidEvent *event, int track_index, void *state)
+{
+    struct MiditoolAction *action = (struct MiditoolAction *)state;
+
+    if (event->midi_valid
+        && event->command == MIDI_COMMAND_BYTE_PROGRAM_CHANGE
+        && event->command_channel == action->channel)
+    {
+        if (g_verbosity >= 1)
+        {
+            printf("Changing MIDI \"%s\" event in track index %d, from %d to %d\n", MIDI_COMMAND_NAME_PROGRAM_CHANGE, track_index, event->midi_command_parameters[0], action->instrument);
+        }
+
+        event->midi_command_parameters[0] = action->instrument;
+        event->midi_command_parameters_raw[0] = action->instrument;
+    }
+
+    return 1;
+}
+
+/**
+ * Streaming callback for make-channel-track action.
+ * Same as {@code GmidFile_transform_make_channel_track}, applied to one event.
+ * @param event: event read from input.
+ * @param track_index: source track index.
+ * @param state: unused.
+ * @returns: 1, always keep the event.
+*/
+static int stream_make_channel_track(struct GmidEvent *event, int track_index, void *state)
+{
+    if (event->midi_valid)
+    {
+        event->command_channel = track_index;
+    }
+
+    return 1;
+}
@@ -24,6 +24,7 @@
 #include "machine_config.h"
 #include "common.h"
 #include "utility.h"
+#include "stats.h"
 
 /**
  * This file contains main entry for sbksplit app.
@@ -64,6 +65,8 @@ static char *names_filename = NULL;
 static size_t names_filename_len = 0;
 static struct LinkedList user_names = { 0 }; // init to zero
 
+#define LONG_OPT_STATS        1005
+
 static struct option long_options[] =
 {
     {"help",         no_argument,     &opt_help_flag,   1  },
@@ -73,6 +76,7 @@ static struct option long_options[] =
     {"quiet",        no_argument,               NULL,  'q' },
     {"verbose",      no_argument,               NULL,  'v' },
     {"debug",        no_argument,               NULL,  'd' },
+    {"stats",        optional_argument,         NULL,   LONG_OPT_STATS },
     {NULL, 0, NULL, 0}
 };
 
@@ -103,6 +107,7 @@ void print_help(const char * invoke)
     printf("                                  subsequent items will be given numeric id (0001, 0002, ...).\n");
     printf("                                  Non alphanumeric characters ignored.\n");
     printf("                                  Names listed in file should not include filename extension.\n");
+    printf("    --stats[=json]                print time and throughput per phase when done.\n");
     printf("    -q,--quiet                    suppress output\n");
     printf("    -v,--verbose                  more output\n");
     printf("\n");
@@ -177,6 +182,19 @@ void read_opts(int argc, char **argv)
                 g_verbosity = 3;
                 break;
 
+            case LONG_OPT_STATS:
+            {
+                int stats_format = stats_parse_format(optarg);
+
+                if (stats_format < 0)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, --stats format not recognized: %s\n", optarg);
+                }
+
+                stats_enable(stats_format);
+            }
+            break;
+
             case '?':
                 print_help(argv[0]);
                 exit(0);
@@ -234,6 +252,7 @@ int main(int argc, char **argv)
         fflush(stdout);
     }
 
+    stats_phase_begin("read");
     input = FileInfo_fopen(input_filename, "rb");
 
     input_file_contents = (uint8_t *)malloc(input->len);
@@ -245,9 +264,11 @@ int main(int argc, char **argv)
     }
 
     FileInfo_fread(input, input_file_contents, input->len, 1);
+    stats_add_bytes("read", input->len);
 
     // done with input file, it's in memory now.
     FileInfo_free(input);
+    stats_phase_end("read");
 
     in_seq_count = ((int32_t*)input_file_contents)[0];
     in_seq_count = BSWAP16_INLINE(in_seq_count);
@@ -277,6 +298,8 @@ int main(int argc, char **argv)
     // 4 is to skip the first 32 bits (seq count + padding)
     input_pos = 4;
 
+    stats_phase_begin("split");
+
     // Read the .sbk header. Read the offset and length,
     // and then use those values to copy the .seq file (in memory) to the output file.
     for (i=0; i<in_seq_count; i++)
@@ -364,12 +387,16 @@ int main(int argc, char **argv)
 
         // write to output, straight from the input file in memory
         FileInfo_fwrite(output, &input_file_contents[(size_t)seq_address], seq_len, 1);
+        stats_add_bytes("split", seq_len);
+        stats_add_items("split", "seqs", 1);
 
         FileInfo_free(output);
         free(filesystem_path);
         output = NULL;
     }
 
+    stats_phase_end("split");
+
     free(input_file_contents);
 
     LinkedListNode_free_string_data(&user_names);
@@ -394,5 +421,7 @@ int main(int argc, char **argv)
         g_filename_prefix_len = 0;
     }
 
+    stats_print(stdout, APPNAME);
+
     return 0;
 }
\ No newline at end of file
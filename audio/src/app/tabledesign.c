@@ -26,6 +26,7 @@
 #include "machine_config.h"
 #include "common.h"
 #include "utility.h"
+#include "stats.h"
 #include "llist.h"
 #include "naudio.h"
 #include "adpcm_aifc.h"
@@ -60,6 +61,7 @@ static char *output_filename = NULL;
 static size_t output_filename_len = 0;
 
 #define LONG_OPT_DEBUG        1003
+#define LONG_OPT_STATS        1005
 #define LONG_OPT_ORDER        2001
 
 #define LONG_OPT_THRESHOLD_MODE        2101
@@ -84,6 +86,7 @@ static struct option long_options[] =
     {"quiet",        no_argument,               NULL,  'q' },
     {"verbose",      no_argument,               NULL,  'v' },
     {"debug",        no_argument,               NULL,   LONG_OPT_DEBUG },
+    {"stats",        optional_argument,         NULL,   LONG_OPT_STATS },
     {NULL, 0, NULL, 0}
 };
 
@@ -119,6 +122,7 @@ void print_help(const char * invoke)
     printf("    --threshold-min=DOUBLE        Threshold filter min value. Requries mode be set.\n");
     printf("    --threshold-max=DOUBLE        Threshold filter max value. Requries mode be set.\n");
 
+    printf("    --stats[=json]                print time and throughput per phase when done.\n");
     printf("    -q,--quiet                    suppress output\n");
     printf("    -v,--verbose                  more output\n");
     printf("\n");
@@ -320,6 +324,19 @@ void read_opts(int argc, char **argv)
                 g_verbosity = VERBOSE_DEBUG;
                 break;
 
+            case LONG_OPT_STATS:
+            {
+                int stats_format = stats_parse_format(optarg);
+
+                if (stats_format < 0)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, --stats format not recognized: %s\n", optarg);
+                }
+
+                stats_enable(stats_format);
+            }
+            break;
+
             case '?':
                 print_help(argv[0]);
                 exit(0);
@@ -332,7 +349,7 @@ int main(int argc, char **argv)
 {
     struct FileInfo *input_file;
     struct FileInfo *output_file;
-    struct WavFile *wav_file = NULL;
+    struct WavReader *wav_reader = NULL;
     struct AdpcmAifcFile *aifc_file = NULL;
     uint8_t *audio_data = NULL;
     size_t audio_data_len = 0;
@@ -464,21 +481,17 @@ int main(int argc, char **argv)
     // done with threshold setup,
     // setup audio data
 
+    stats_phase_begin("read");
     input_file = FileInfo_fopen(input_filename, "rb");
+    stats_add_bytes("read", input_file->len);
 
     if (string_ends_with(input_filename, WAV_DEFAULT_EXTENSION))
     {
-        wav_file = WavFile_new_from_file(input_file);
-
-        // didn't exit, so must be valid.
-        if (wav_file->data_chunk == NULL)
-        {
-            stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> error, wav_file->data_chunk is NULL\n", __func__, __LINE__);
-        }
+        // sound data is read one frame at a time while estimating the codebook.
+        wav_reader = WavReader_new(input_file);
 
         encoding = DATA_ENCODING_LSB;
-        audio_data = wav_file->data_chunk->data;
-        audio_data_len = wav_file->data_chunk->ck_data_size;
+        audio_data_len = wav_reader->data_len;
     }
     else if (string_ends_with(input_filename, AIFC_DEFAULT_EXTENSION))
     {
@@ -499,6 +512,8 @@ int main(int argc, char **argv)
         stderr_exit(EXIT_CODE_GENERAL, "%s %d> error, file (extension) not supported: %s\n", __func__, __LINE__, input_filename);
     }
 
+    stats_phase_end("read");
+
     if (opt_run_threshold_mode != THRESHOLD_MODE_DEFAULT_UNKOWN)
     {
         threshold_parameters_ptr = &threshold_parameters;
@@ -509,20 +524,35 @@ int main(int argc, char **argv)
     }
 
     // done with setup, execute with parameters.
-    book = estimate_codebook(
-        audio_data,
-        audio_data_len,
-        encoding,
-        threshold_parameters_ptr,
-        run_order,
-        run_predictors);
+    stats_phase_begin("estimate codebook");
+    if (wav_reader != NULL)
+    {
+        book = estimate_codebook_from_wav_reader(
+            wav_reader,
+            threshold_parameters_ptr,
+            run_order,
+            run_predictors);
+    }
+    else
+    {
+        book = estimate_codebook(
+            audio_data,
+            audio_data_len,
+            encoding,
+            threshold_parameters_ptr,
+            run_order,
+            run_predictors);
+    }
+    stats_add_bytes("estimate codebook", audio_data_len);
+    stats_add_items("estimate codebook", "samples", audio_data_len / 2);
+    stats_phase_end("estimate codebook");
 
     // done with input file and audio containers
     FileInfo_free(input_file);
 
-    if (wav_file != NULL)
+    if (wav_reader != NULL)
     {
-        WavFile_free(wav_file);
+        WavReader_free(wav_reader);
     }
 
     if (aifc_file != NULL)
@@ -531,11 +561,13 @@ int main(int argc, char **argv)
     }
 
     // write result
+    stats_phase_begin("write");
     output_file = FileInfo_fopen(output_filename, "wb");
     ALADPCMBook_write_coef(book, output_file);
 
     // done with output
     FileInfo_free(output_file);
+    stats_phase_end("write");
     ALADPCMBook_free(book);
 
     if (input_filename != NULL)
@@ -550,5 +582,7 @@ int main(int argc, char **argv)
         output_filename = NULL;
     }
 
+    stats_print(stdout, APPNAME);
+
     return 0;
 }
\ No newline at end of file
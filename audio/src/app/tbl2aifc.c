@@ -25,6 +25,7 @@
 #include "machine_config.h"
 #include "common.h"
 #include "utility.h"
+#include "stats.h"
 #include "llist.h"
 #include "naudio.h"
 #include "adpcm_aifc.h"
@@ -83,6 +84,7 @@ static int generate_inst = 1;
 #define LONG_OPT_NO_AIFC 1001
 #define LONG_OPT_NO_INST 1002
 #define LONG_OPT_DEBUG   1003
+#define LONG_OPT_STATS   1005
 
 static struct option long_options[] =
 {
@@ -98,6 +100,7 @@ static struct option long_options[] =
     {"names",  required_argument,               NULL,  'n' },
     {"verbose",      no_argument,               NULL,  'v' },
     {"debug",        no_argument,               NULL,   LONG_OPT_DEBUG },
+    {"stats",        optional_argument,         NULL,   LONG_OPT_STATS },
     {NULL, 0, NULL, 0}
 };
 
@@ -134,6 +137,7 @@ void print_help(const char * invoke)
     printf("                                  subsequent items will be given numeric id (0001, 0002, ...).\n");
     printf("                                  Non alphanumeric characters ignored.\n");
     printf("                                  Do not include filename extension.\n");
+    printf("    --stats[=json]                print time and throughput per phase when done.\n");
     printf("    -q,--quiet                    suppress output\n");
     printf("    -v,--verbose                  more output\n");
     printf("\n");
@@ -295,6 +299,19 @@ void read_opts(int argc, char **argv)
                 g_verbosity = VERBOSE_DEBUG;
                 break;
 
+            case LONG_OPT_STATS:
+            {
+                int stats_format = stats_parse_format(optarg);
+
+                if (stats_format < 0)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, --stats format not recognized: %s\n", optarg);
+                }
+
+                stats_enable(stats_format);
+            }
+            break;
+
             case '?':
                 print_help(argv[0]);
                 exit(0);
@@ -463,7 +480,9 @@ int main(int argc, char **argv)
         mkpath(g_output_dir);
     }
 
+    stats_phase_begin("parse ctl");
     ctl_file = FileInfo_fopen(ctl_filename, "rb");
+    stats_add_bytes("parse ctl", ctl_file->len);
 
     if (opt_names_file)
     {
@@ -472,19 +491,26 @@ int main(int argc, char **argv)
     }
 
     bank_file = ALBankFile_new_from_ctl(ctl_file);
+    stats_phase_end("parse ctl");
 
     if (generate_inst)
     {
+        stats_phase_begin("write inst");
         ALBankFile_write_inst(bank_file, inst_filename);
+        stats_phase_end("write inst");
     }
 
     if (generate_aifc)
     {
         uint8_t *tbl_file_contents;
+        size_t tbl_file_len;
 
-        get_file_contents(tbl_filename, &tbl_file_contents);
+        stats_phase_begin("write aifc");
+        tbl_file_len = get_file_contents(tbl_filename, &tbl_file_contents);
         write_bank_to_aifc(bank_file, tbl_file_contents);
         free(tbl_file_contents);
+        stats_add_bytes("write aifc", tbl_file_len);
+        stats_phase_end("write aifc");
     }
 
     LinkedListNode_free_string_data(&user_names);
@@ -532,5 +558,7 @@ int main(int argc, char **argv)
         g_output_dir_len = 0;
     }
 
+    stats_print(stdout, APPNAME);
+
     return 0;
 }
\ No newline at end of file
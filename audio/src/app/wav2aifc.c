@@ -26,11 +26,14 @@
 #include "machine_config.h"
 #include "common.h"
 #include "utility.h"
+#include "stats.h"
+#include "parallel.h"
 #include "llist.h"
 #include "naudio.h"
 #include "adpcm_aifc.h"
 #include "wav.h"
 #include "x.h"
+#include "gaudio.h"
 
 /**
  * This file contains main entry for wav2aifc app.
@@ -38,6 +41,7 @@
  * This app converts an .wav file to .aifc file.
  * It uses a codebook that has previously been generated.
  * It accepts a file path as input and writes to the given output file path.
+ * Given more than one codebook, it encodes with each and keeps the best.
 */
 
 #define APPNAME "wav2aifc"
@@ -48,15 +52,21 @@ static int opt_coef_file = 0;
 static int opt_input_file = 0;
 static int opt_output_file = 0;
 static int opt_swap = 0;
+static int opt_sample_rate = 0;
+static int opt_no_dither = 0;
 static char *input_filename = NULL;
 static size_t input_filename_len = 0;
 static char *output_filename = NULL;
 static size_t output_filename_len = 0;
-static char *coef_filename = NULL;
-static size_t coef_filename_len = 0;
+static char **coef_filenames = NULL;
+static int coef_file_count = 0;
 
 #define LONG_OPT_DEBUG        1003
+#define LONG_OPT_STATS        1005
 #define LONG_OPT_SWAP         2001
+#define LONG_OPT_RATE         2002
+#define LONG_OPT_NO_DITHER    2003
+#define LONG_OPT_THREADS      2004
 
 static struct option long_options[] =
 {
@@ -64,12 +74,16 @@ static struct option long_options[] =
     {"in",     required_argument,               NULL,  'n' },
     {"out",    required_argument,               NULL,  'o' },
     {"swap",         no_argument,               NULL,   LONG_OPT_SWAP  },
+    {"rate",   required_argument,               NULL,   LONG_OPT_RATE  },
+    {"no-dither",    no_argument,               NULL,   LONG_OPT_NO_DITHER  },
+    {"threads",  required_argument,             NULL,   LONG_OPT_THREADS  },
 
     {"coef",    required_argument,              NULL,  'c' },
 
     {"quiet",        no_argument,               NULL,  'q' },
     {"verbose",      no_argument,               NULL,  'v' },
     {"debug",        no_argument,               NULL,   LONG_OPT_DEBUG },
+    {"stats",        optional_argument,         NULL,   LONG_OPT_STATS },
     {NULL, 0, NULL, 0}
 };
 
@@ -77,6 +91,7 @@ static struct option long_options[] =
 
 void print_help(const char * invoke);
 void read_opts(int argc, char **argv);
+void encode_codebook_trials(void);
 
 // end forward declarations
 
@@ -84,7 +99,9 @@ void print_help(const char * invoke)
 {
     printf("%s %s help\n", APPNAME, VERSION);
     printf("\n");
-    printf("Converts wav audio (mono 16 bit PCM little endian) to n64 aifc format (mono 16 bit PCM big endian) using codebook\n");
+    printf("Converts wav audio to n64 aifc format (mono 16 bit PCM big endian) using codebook\n");
+    printf("Input can be 8, 16, 24, or 32 bit PCM or 32 or 64 bit float, with any number of channels.\n");
+    printf("Input that isn't mono 16 bit PCM is mixed down to mono and dithered to 16 bits.\n");
     printf("usage:\n");
     printf("\n");
     printf("    %s --in file [-c coef_file]\n", invoke);
@@ -97,10 +114,23 @@ void print_help(const char * invoke)
     printf("                                  reuse the input file name but change extension.\n");
     printf("    -c,--coef=FILE                coef table / codebook previously generated. Optional.\n");
     printf("                                  If no codebook is provided, format will be AL_RAW16_WAVE.\n");
+    printf("                                  Can be given more than once. The audio is then encoded\n");
+    printf("                                  with each codebook, square error (decoded vs input),\n");
+    printf("                                  max clip, and size are printed for each, and the output\n");
+    printf("                                  uses the codebook with the smallest square error.\n");
+    printf("                                  The whole input, and the output for each codebook, are\n");
+    printf("                                  kept in memory. With one codebook the audio is converted\n");
+    printf("                                  in blocks instead.\n");
     printf("     --swap                       byte swap audio samples before converting to .aifc\n");
     printf("                                  This is normally determined automatically, but.\n");
     printf("                                  can be forced with this switch.\n");
-
+    printf("    --rate=HZ                     resample to this sample rate before converting.\n");
+    printf("                                  Optional. If not provided, the .wav sample rate is kept.\n");
+    printf("    --no-dither                   round to 16 bits without dither.\n");
+    printf("    --threads=INT                 Number of threads used to encode with more than one\n");
+    printf("                                  codebook. Default is the number of processors. Use 1\n");
+    printf("                                  to disable.\n");
+    printf("    --stats[=json]                print time and throughput per phase when done.\n");
     printf("    -q,--quiet                    suppress output\n");
     printf("    -v,--verbose                  more output\n");
 
@@ -151,6 +181,8 @@ void read_opts(int argc, char **argv)
 
             case 'c':
             {
+                size_t coef_filename_len;
+
                 opt_coef_file = 1;
 
                 coef_filename_len = snprintf(NULL, 0, "%s", optarg) + 1;
@@ -160,8 +192,18 @@ void read_opts(int argc, char **argv)
                     stderr_exit(EXIT_CODE_GENERAL, "error, coef filename not specified\n");
                 }
 
-                coef_filename = (char *)malloc_zero(coef_filename_len + 1, 1);
-                coef_filename_len = snprintf(coef_filename, coef_filename_len, "%s", optarg);
+                if (coef_file_count == 0)
+                {
+                    coef_filenames = (char **)malloc_zero(1, sizeof(char *));
+                }
+                else
+                {
+                    malloc_resize(coef_file_count * sizeof(char *), (void **)&coef_filenames, (coef_file_count + 1) * sizeof(char *));
+                }
+
+                coef_filenames[coef_file_count] = (char *)malloc_zero(coef_filename_len + 1, 1);
+                snprintf(coef_filenames[coef_file_count], coef_filename_len, "%s", optarg);
+                coef_file_count++;
             }
             break;
 
@@ -181,6 +223,71 @@ void read_opts(int argc, char **argv)
                 g_encode_bswap = 1;
                 break;
 
+            case LONG_OPT_RATE:
+            {
+                int res;
+                char *pend = NULL;
+
+                errno = 0;
+                res = strtol(optarg, &pend, 0);
+
+                if (pend != NULL && *pend == '\0')
+                {
+                    if (errno == ERANGE || res <= 0)
+                    {
+                        stderr_exit(EXIT_CODE_GENERAL, "error (range), invalid sample rate: %s\n", optarg);
+                    }
+
+                    opt_sample_rate = res;
+                }
+                else
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, cannot parse sample rate as integer: %s\n", optarg);
+                }
+            }
+            break;
+
+            case LONG_OPT_NO_DITHER:
+                opt_no_dither = 1;
+                break;
+
+            case LONG_OPT_THREADS:
+            {
+                int res;
+                char *pend = NULL;
+
+                errno = 0;
+                res = strtol(optarg, &pend, 0);
+
+                if (pend != NULL && *pend == '\0')
+                {
+                    if (errno == ERANGE || res < 0)
+                    {
+                        stderr_exit(EXIT_CODE_GENERAL, "error, invalid number of threads: %s\n", optarg);
+                    }
+
+                    g_parallel_num_threads = res;
+                }
+                else
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, cannot parse threads as integer: %s\n", optarg);
+                }
+            }
+            break;
+
+            case LONG_OPT_STATS:
+            {
+                int stats_format = stats_parse_format(optarg);
+
+                if (stats_format < 0)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, --stats format not recognized: %s\n", optarg);
+                }
+
+                stats_enable(stats_format);
+            }
+            break;
+
             case '?':
                 print_help(argv[0]);
                 exit(0);
@@ -189,15 +296,91 @@ void read_opts(int argc, char **argv)
     }
 }
 
-int main(int argc, char **argv)
+/**
+ * Encodes the input once with each codebook, prints the result of each, and
+ * writes the .aifc of the codebook with the smallest square error.
+*/
+void encode_codebook_trials(void)
 {
+    struct FileInfo *input;
+    struct FileInfo *output;
     struct FileInfo *coef_file;
-    struct FileInfo *input_file;
-    struct FileInfo *output_file;
-    struct AdpcmAifcFile *aifc;
     struct WavFile *wav;
+    struct WavConvertOptions *convert_options;
+    struct ALADPCMBook **books;
+    struct AdpcmAifcCodebookTrial *trials;
+    int best_index;
+    int i;
+
+    input = FileInfo_fopen(input_filename, "rb");
+    wav = WavFile_new_from_file(input);
+    FileInfo_free(input);
+
+    convert_options = WavConvertOptions_new();
+    convert_options->sample_rate = opt_sample_rate;
+    convert_options->dither = !opt_no_dither;
 
-    struct ALADPCMBook *book = NULL;
+    stats_phase_begin("convert");
+    WavFile_convert(wav, convert_options);
+    stats_phase_end("convert");
+
+    WavConvertOptions_free(convert_options);
+
+    books = (struct ALADPCMBook **)malloc_zero(coef_file_count, sizeof(struct ALADPCMBook *));
+    trials = (struct AdpcmAifcCodebookTrial *)malloc_zero(coef_file_count, sizeof(struct AdpcmAifcCodebookTrial));
+
+    for (i=0; i<coef_file_count; i++)
+    {
+        coef_file = FileInfo_fopen(coef_filenames[i], "rb");
+        books[i] = ALADPCMBook_new_from_coef(coef_file);
+        FileInfo_free(coef_file);
+    }
+
+    // every codebook encodes the whole input.
+    stats_phase_begin("encode");
+    best_index = AdpcmAifcFile_new_from_wav_trials(wav, books, coef_file_count, trials);
+    stats_add_items("encode", "frames", (uint64_t)trials[best_index].aaf->comm_chunk->num_sample_frames * (uint64_t)coef_file_count);
+    stats_phase_end("encode");
+
+    if (g_verbosity >= 1)
+    {
+        printf("  %-14s %-8s %-10s %s\n", "square error", "max clip", "size", "codebook");
+
+        for (i=0; i<coef_file_count; i++)
+        {
+            printf("%c %-14.05e %-8d %-10zu %s\n",
+                i == best_index ? '*' : ' ',
+                (double)trials[i].square_error,
+                trials[i].max_clip,
+                trials[i].aifc_size,
+                coef_filenames[i]);
+        }
+
+        fflush(stdout);
+    }
+
+    output = FileInfo_fopen(output_filename, "wb");
+    AdpcmAifcFile_fwrite(trials[best_index].aaf, output);
+    FileInfo_free(output);
+
+    for (i=0; i<coef_file_count; i++)
+    {
+        AdpcmAifcFile_free(trials[i].aaf);
+        ALADPCMBook_free(books[i]);
+    }
+
+    free(trials);
+    free(books);
+    WavFile_free(wav);
+}
+
+int main(int argc, char **argv)
+{
+    struct GaudioWavToAifcOptions options;
+    struct GaudioError error;
+    uint8_t *coef = NULL;
+    size_t coef_len = 0;
+    int i;
 
     read_opts(argc, argv);
 
@@ -221,44 +404,51 @@ int main(int argc, char **argv)
         printf("g_verbosity: %d\n", g_verbosity);
         printf("opt_help_flag: %d\n", opt_help_flag);
         printf("opt_coef_file: %d\n", opt_coef_file);
-        printf("coef_filename: %s\n", coef_filename != NULL ? coef_filename : "NULL");
+        printf("coef_file_count: %d\n", coef_file_count);
+        for (i=0; i<coef_file_count; i++)
+        {
+            printf("coef_filenames[%d]: %s\n", i, coef_filenames[i]);
+        }
         printf("opt_input_file: %d\n", opt_input_file);
         printf("input_filename: %s\n", input_filename != NULL ? input_filename : "NULL");
         printf("opt_output_file: %d\n", opt_output_file);
         printf("output_filename: %s\n", output_filename != NULL ? output_filename : "NULL");
         printf("opt_swap: %d\n", opt_swap);
         printf("g_encode_bswap: %d\n", g_encode_bswap);
+        printf("opt_sample_rate: %d\n", opt_sample_rate);
+        printf("opt_no_dither: %d\n", opt_no_dither);
         fflush(stdout);
     }
 
-    if (opt_coef_file == 1)
+    if (coef_file_count > 1)
     {
-        coef_file = FileInfo_fopen(coef_filename, "rb");
-        book = ALADPCMBook_new_from_coef(coef_file);
-        FileInfo_free(coef_file);
+        encode_codebook_trials();
     }
+    else
+    {
+        if (opt_coef_file == 1)
+        {
+            coef_len = get_file_contents(coef_filenames[0], &coef);
+        }
 
-    input_file = FileInfo_fopen(input_filename, "rb");
-    wav = WavFile_new_from_file(input_file);
-    FileInfo_free(input_file);
-
-    aifc = AdpcmAifcFile_new_from_wav(wav, book);
+        GaudioWavToAifcOptions_init(&options);
+        options.bswap = g_encode_bswap;
+        options.sample_rate = opt_sample_rate;
+        options.dither = !opt_no_dither;
 
-    output_file = FileInfo_fopen(output_filename, "wb");
-    AdpcmAifcFile_fwrite(aifc, output_file);
-    FileInfo_free(output_file);
+        // sound data is read, encoded, and written in blocks.
+        if (gaudio_wav_to_aifc_file(input_filename, output_filename, coef, coef_len, &options, &error) != GAUDIO_OK)
+        {
+            stderr_exit(error.code, "%s\n", error.message);
+        }
 
-    if (book != NULL)
-    {
-        ALADPCMBook_free(book);
+        if (coef != NULL)
+        {
+            free(coef);
+            coef = NULL;
+        }
     }
 
-    WavFile_free(wav);
-    wav = NULL;
-
-    AdpcmAifcFile_free(aifc);
-    aifc = NULL;
-
     if (input_filename != NULL)
     {
         free(input_filename);
@@ -271,11 +461,18 @@ int main(int argc, char **argv)
         output_filename = NULL;
     }
 
-    if (coef_filename != NULL)
+    if (coef_filenames != NULL)
     {
-        free(coef_filename);
-        coef_filename = NULL;
+        for (i=0; i<coef_file_count; i++)
+        {
+            free(coef_filenames[i]);
+        }
+
+        free(coef_filenames);
+        coef_filenames = NULL;
     }
 
+    stats_print(stdout, APPNAME);
+
     return 0;
 }
\ No newline at end of file
@@ -28,9 +28,14 @@
 
 /**
  * Trace debug flag.
- * If enabled, will print when entering and leaving functions.
+ * If enabled, TRACE_ENTER/TRACE_LEAVE record function enter and leave events (see trace.h).
+ * Recording only happens when turned on at runtime, either with {@code trace_start} or by
+ * setting the GAUDIO_TRACE environment variable to an output filename.
+ * Build with `make TRACE=1` to enable.
 */
+#ifndef DEBUG_TRACE
 #define DEBUG_TRACE 0
+#endif
 
 // Begin section: debug flags for individual programs/files/methods
 
@@ -62,25 +67,21 @@
 #define FLAG_THROW_NOT_IMPLEMENTED 1
 
 #if DEBUG_TRACE == 1
-extern int _trace_depth;
+#include "trace.h"
 
 /**
- * prints a message indicating control flow entered a function.
+ * records an event indicating control flow entered a function.
 */
-#define TRACE_ENTER(function_name)  if (DEBUG_TRACE) \
+#define TRACE_ENTER(function_name)  if (g_trace_state != TRACE_STATE_OFF) \
     { \
-        _trace_depth++; \
-        printf("[%d] enter %s\n", _trace_depth, function_name); \
-        fflush(stdout); \
+        trace_event(function_name, TRACE_EVENT_ENTER); \
     }
 /**
- * prints a message indicating control flow exited a function.
+ * records an event indicating control flow exited a function.
 */
-#define TRACE_LEAVE(function_name)  if (DEBUG_TRACE) \
+#define TRACE_LEAVE(function_name)  if (g_trace_state != TRACE_STATE_OFF) \
     { \
-        printf("[%d] <- %s\n", _trace_depth, function_name); \
-        _trace_depth--; \
-        fflush(stdout); \
+        trace_event(function_name, TRACE_EVENT_LEAVE); \
     }
 #else
 #define TRACE_ENTER(s)
@@ -0,0 +1,483 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include "debug.h"
+#include "machine_config.h"
+#include "gaudio_error.h"
+
+/**
+ * This file contains the error trap used by {@code gaudio_try}.
+ *
+ * Each active call has a trap on the calling thread. {@code stderr_exit} checks
+ * for a trap and jumps back to {@code gaudio_try} instead of exiting.
+ * Resources are tracked in an open addressing hash table (linear probing) per trap,
+ * keyed by address.
+ *
+ * A trap can be shared with other threads while the owning thread waits for them
+ * (see {@code parallel_for}). Each of those threads runs in a child trap, and access
+ * to the shared trap and its ancestors is serialized with a lock.
+ *
+ * This file uses plain calloc and free instead of {@code malloc_zero} and
+ * {@code gaudio_free}, those call back into here.
+*/
+
+/**
+ * Initial number of slots in resource table. Must be power of two.
+*/
+#define GAUDIO_ERROR_INITIAL_SLOTS 256
+
+struct GaudioErrorResource {
+    void *resource;
+    f_gaudio_error_cleanup cleanup;
+};
+
+struct GaudioErrorTrap {
+    jmp_buf env;
+
+    /**
+     * Where to write error details.
+    */
+    struct GaudioError *error;
+
+    /**
+     * Resource table, {@code slot_count} entries. Empty slots have NULL resource.
+    */
+    struct GaudioErrorResource *slots;
+    size_t slot_count;
+    size_t used_count;
+
+    /**
+     * Enclosing trap, for nested calls. For a child trap this belongs to another thread.
+    */
+    struct GaudioErrorTrap *prev;
+
+    /**
+     * Innermost trap of this thread before this one, restored on return.
+    */
+    struct GaudioErrorTrap *thread_prev;
+
+    /**
+     * Flag, other threads are running child traps of this trap.
+    */
+    int shared;
+};
+
+/**
+ * Innermost active trap for this thread.
+*/
+static _Thread_local struct GaudioErrorTrap *_trap = NULL;
+
+/**
+ * Guards shared traps and their ancestors.
+*/
+static pthread_mutex_t _shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// forward declarations
+
+static int gaudio_try_parent(struct GaudioErrorTrap *parent, f_gaudio_try_callback callback, void *state, struct GaudioError *error, int keep);
+static size_t GaudioErrorTrap_slot_index(struct GaudioErrorTrap *trap, void *resource);
+static void GaudioErrorTrap_add(struct GaudioErrorTrap *trap, void *resource, f_gaudio_error_cleanup cleanup);
+static int GaudioErrorTrap_remove(struct GaudioErrorTrap *trap, void *resource);
+static void GaudioErrorTrap_grow(struct GaudioErrorTrap *trap);
+static void GaudioErrorTrap_free(struct GaudioErrorTrap *trap);
+
+// end forward declarations
+
+/**
+ * Calls {@code callback}. If library code reports an error, returns to the caller
+ * instead of ending the process, and releases resources tracked during the call.
+ * Calls may be nested.
+ * @param callback: function to call.
+ * @param state: passed to callback.
+ * @param error: out parameter. Error details. Set to {@code GAUDIO_OK} and empty
+ * message on success.
+ * @returns: {@code GAUDIO_OK} on success, otherwise error exit code.
+*/
+int gaudio_try(f_gaudio_try_callback callback, void *state, struct GaudioError *error)
+{
+    return gaudio_try_parent(_trap, callback, state, error, 0);
+}
+
+/**
+ * Same as {@code gaudio_try}, but on success resources are not passed to the
+ * enclosing call, so they are kept if the enclosing call fails later. Used for
+ * objects that outlive the enclosing call, such as caches.
+ * @param callback: function to call.
+ * @param state: passed to callback.
+ * @param error: out parameter. Error details.
+ * @returns: {@code GAUDIO_OK} on success, otherwise error exit code.
+*/
+int gaudio_try_keep(f_gaudio_try_callback callback, void *state, struct GaudioError *error)
+{
+    return gaudio_try_parent(_trap, callback, state, error, 1);
+}
+
+/**
+ * Same as {@code gaudio_try}, but resources are passed to {@code parent} on success,
+ * which may belong to another thread. Used by threads started while the parent's
+ * thread waits, see {@code gaudio_error_trap_share}.
+ * @param parent: trap of waiting thread.
+ * @param callback: function to call.
+ * @param state: passed to callback.
+ * @param error: out parameter. Error details.
+ * @returns: {@code GAUDIO_OK} on success, otherwise error exit code.
+*/
+int gaudio_try_child(struct GaudioErrorTrap *parent, f_gaudio_try_callback callback, void *state, struct GaudioError *error)
+{
+    return gaudio_try_parent(parent, callback, state, error, 0);
+}
+
+/**
+ * Implementation of {@code gaudio_try}.
+ * @param keep: flag, don't pass resources to {@code parent} on success.
+*/
+static int gaudio_try_parent(struct GaudioErrorTrap *parent, f_gaudio_try_callback callback, void *state, struct GaudioError *error, int keep)
+{
+    TRACE_ENTER(__func__)
+
+    // volatile: read after longjmp.
+    struct GaudioErrorTrap * volatile trap;
+    int code;
+
+    if (callback == NULL || error == NULL)
+    {
+        fprintf(stderr, "%s %d> callback or error is NULL\n", __func__, __LINE__);
+        fflush(stderr);
+        exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION);
+    }
+
+    error->code = GAUDIO_OK;
+    error->message[0] = '\0';
+
+    trap = (struct GaudioErrorTrap *)calloc(1, sizeof(struct GaudioErrorTrap));
+    if (trap == NULL)
+    {
+        perror("calloc");
+        exit(EXIT_CODE_MALLOC);
+    }
+
+    trap->error = error;
+    trap->prev = parent;
+    trap->thread_prev = _trap;
+    trap->slot_count = GAUDIO_ERROR_INITIAL_SLOTS;
+    trap->slots = (struct GaudioErrorResource *)calloc(trap->slot_count, sizeof(struct GaudioErrorResource));
+    if (trap->slots == NULL)
+    {
+        perror("calloc");
+        exit(EXIT_CODE_MALLOC);
+    }
+
+    _trap = trap;
+
+    if (setjmp(trap->env) == 0)
+    {
+        size_t i;
+
+        callback(state);
+
+        _trap = trap->thread_prev;
+
+        // resources now belong to the enclosing call, if any.
+        if (parent != NULL && !keep)
+        {
+            if (parent->shared)
+            {
+                pthread_mutex_lock(&_shared_lock);
+            }
+
+            for (i=0; i<trap->slot_count; i++)
+            {
+                if (trap->slots[i].resource != NULL)
+                {
+                    GaudioErrorTrap_add(parent, trap->slots[i].resource, trap->slots[i].cleanup);
+                }
+            }
+
+            if (parent->shared)
+            {
+                pthread_mutex_unlock(&_shared_lock);
+            }
+        }
+    }
+    else
+    {
+        size_t i;
+
+        _trap = trap->thread_prev;
+
+        for (i=0; i<trap->slot_count; i++)
+        {
+            if (trap->slots[i].resource != NULL && trap->slots[i].cleanup != NULL)
+            {
+                trap->slots[i].cleanup(trap->slots[i].resource);
+            }
+        }
+    }
+
+    code = error->code;
+    GaudioErrorTrap_free(trap);
+
+    TRACE_LEAVE(__func__)
+
+    return code;
+}
+
+/**
+ * Checks whether the current thread is inside {@code gaudio_try}.
+ * @returns: 1 if a trap is active, 0 otherwise.
+*/
+int gaudio_error_trap_active()
+{
+    return _trap != NULL;
+}
+
+/**
+ * Allows other threads to run child traps of the current trap with
+ * {@code gaudio_try_child}. The current thread must not use the trap
+ * until {@code gaudio_error_trap_unshare} is called.
+ * @returns: current trap, or NULL if there is no active call.
+*/
+struct GaudioErrorTrap *gaudio_error_trap_share()
+{
+    if (_trap != NULL)
+    {
+        _trap->shared = 1;
+    }
+
+    return _trap;
+}
+
+/**
+ * Ends {@code gaudio_error_trap_share}, after all child traps have returned.
+ * @param trap: trap returned by {@code gaudio_error_trap_share}.
+*/
+void gaudio_error_trap_unshare(struct GaudioErrorTrap *trap)
+{
+    if (trap != NULL)
+    {
+        trap->shared = 0;
+    }
+}
+
+/**
+ * Reports error to the innermost active {@code gaudio_try} on this thread, which
+ * does not return. If there is no active call this returns and the caller
+ * should exit as usual.
+ * @param code: exit code.
+ * @param format: printf format string.
+ * @param args: format arguments.
+*/
+void gaudio_error_vraise(int code, const char *format, va_list args)
+{
+    struct GaudioError *error;
+    size_t len;
+
+    if (_trap == NULL)
+    {
+        return;
+    }
+
+    error = _trap->error;
+    error->code = code != GAUDIO_OK ? code : EXIT_CODE_GENERAL;
+
+    vsnprintf(error->message, GAUDIO_ERROR_MESSAGE_LEN, format, args);
+
+    len = strlen(error->message);
+    while (len > 0 && (error->message[len - 1] == '\n' || error->message[len - 1] == '\r'))
+    {
+        error->message[--len] = '\0';
+    }
+
+    longjmp(_trap->env, 1);
+}
+
+/**
+ * Records resource to release if the active {@code gaudio_try} fails.
+ * Does nothing if there is no active call on this thread.
+ * @param resource: resource to track.
+ * @param cleanup: function to release resource.
+*/
+void gaudio_error_track(void *resource, f_gaudio_error_cleanup cleanup)
+{
+    if (_trap == NULL || resource == NULL)
+    {
+        return;
+    }
+
+    GaudioErrorTrap_add(_trap, resource, cleanup);
+}
+
+/**
+ * Stops tracking resource, because it was released. Resources created
+ * by an enclosing call may be released by a nested call, so all active traps
+ * are checked.
+ * @param resource: resource to stop tracking.
+*/
+void gaudio_error_untrack(void *resource)
+{
+    struct GaudioErrorTrap *trap;
+    int locked = 0;
+
+    if (_trap == NULL || resource == NULL)
+    {
+        return;
+    }
+
+    for (trap = _trap; trap != NULL; trap = trap->prev)
+    {
+        // traps from a shared trap up are used by other threads too.
+        if (!locked && trap->shared)
+        {
+            pthread_mutex_lock(&_shared_lock);
+            locked = 1;
+        }
+
+        if (GaudioErrorTrap_remove(trap, resource))
+        {
+            break;
+        }
+    }
+
+    if (locked)
+    {
+        pthread_mutex_unlock(&_shared_lock);
+    }
+}
+
+/**
+ * Gets starting slot for resource.
+*/
+static size_t GaudioErrorTrap_slot_index(struct GaudioErrorTrap *trap, void *resource)
+{
+    uint64_t key = (uint64_t)(uintptr_t)resource;
+
+    // allocations are aligned, low bits carry no information.
+    key = (key >> 4) * 0x9E3779B97F4A7C15ULL;
+
+    return (size_t)(key >> 32) & (trap->slot_count - 1);
+}
+
+static void GaudioErrorTrap_add(struct GaudioErrorTrap *trap, void *resource, f_gaudio_error_cleanup cleanup)
+{
+    size_t index;
+
+    // keep load factor under 1/2
+    if ((trap->used_count + 1) * 2 > trap->slot_count)
+    {
+        GaudioErrorTrap_grow(trap);
+    }
+
+    index = GaudioErrorTrap_slot_index(trap, resource);
+
+    while (trap->slots[index].resource != NULL)
+    {
+        if (trap->slots[index].resource == resource)
+        {
+            trap->slots[index].cleanup = cleanup;
+            return;
+        }
+
+        index = (index + 1) & (trap->slot_count - 1);
+    }
+
+    trap->slots[index].resource = resource;
+    trap->slots[index].cleanup = cleanup;
+    trap->used_count++;
+}
+
+/**
+ * Removes resource from table.
+ * @returns: 1 if resource was found, 0 otherwise.
+*/
+static int GaudioErrorTrap_remove(struct GaudioErrorTrap *trap, void *resource)
+{
+    size_t mask = trap->slot_count - 1;
+    size_t index = GaudioErrorTrap_slot_index(trap, resource);
+    size_t next;
+
+    while (trap->slots[index].resource != resource)
+    {
+        if (trap->slots[index].resource == NULL)
+        {
+            return 0;
+        }
+
+        index = (index + 1) & mask;
+    }
+
+    trap->slots[index].resource = NULL;
+    trap->slots[index].cleanup = NULL;
+    trap->used_count--;
+
+    // shift following entries back so lookups don't stop at the new hole.
+    next = (index + 1) & mask;
+    while (trap->slots[next].resource != NULL)
+    {
+        size_t home = GaudioErrorTrap_slot_index(trap, trap->slots[next].resource);
+
+        // move if the hole is cyclically between home and next.
+        if (((next - home) & mask) >= ((next - index) & mask))
+        {
+            trap->slots[index] = trap->slots[next];
+            trap->slots[next].resource = NULL;
+            trap->slots[next].cleanup = NULL;
+            index = next;
+        }
+
+        next = (next + 1) & mask;
+    }
+
+    return 1;
+}
+
+static void GaudioErrorTrap_grow(struct GaudioErrorTrap *trap)
+{
+    struct GaudioErrorResource *old_slots = trap->slots;
+    size_t old_count = trap->slot_count;
+    size_t i;
+
+    trap->slot_count = old_count * 2;
+    trap->used_count = 0;
+    trap->slots = (struct GaudioErrorResource *)calloc(trap->slot_count, sizeof(struct GaudioErrorResource));
+    if (trap->slots == NULL)
+    {
+        perror("calloc");
+        exit(EXIT_CODE_MALLOC);
+    }
+
+    for (i=0; i<old_count; i++)
+    {
+        if (old_slots[i].resource != NULL)
+        {
+            GaudioErrorTrap_add(trap, old_slots[i].resource, old_slots[i].cleanup);
+        }
+    }
+
+    free(old_slots);
+}
+
+static void GaudioErrorTrap_free(struct GaudioErrorTrap *trap)
+{
+    free(trap->slots);
+    free(trap);
+}
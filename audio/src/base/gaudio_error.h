@@ -0,0 +1,92 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#ifndef _GAUDIO_ERROR_H_
+#define _GAUDIO_ERROR_H_
+
+#include <stdarg.h>
+
+/**
+ * This file contains structs and functions for running library code without
+ * ending the process on error.
+ *
+ * Library errors are reported with {@code stderr_exit}, which prints a message
+ * and exits. Code run through {@code gaudio_try} instead returns to the caller
+ * with the exit code and message in a {@code struct GaudioError}. Memory allocated
+ * with {@code malloc_zero} and files opened with {@code FileInfo_fopen} during the
+ * call are released when an error occurs. Code that frees that memory during the
+ * call must use {@code gaudio_free} so it isn't released a second time.
+ *
+ * Anything allocated during the call and attached to an object that existed before
+ * the call is also released, so such objects should not be used after an error.
+ * Objects only read by the call are unchanged.
+ *
+ * While a call is active, work items run by {@code parallel_for} on other threads
+ * are also covered by the call.
+*/
+
+/**
+ * Max length of error message, including terminating zero.
+*/
+#define GAUDIO_ERROR_MESSAGE_LEN 1024
+
+/**
+ * Return value of {@code gaudio_try} when there was no error. Otherwise
+ * the return value is the exit code the error would have ended the process with
+ * (see EXIT_CODE_* in machine_config.h).
+*/
+#define GAUDIO_OK 0
+
+/**
+ * Error details.
+*/
+struct GaudioError {
+    /**
+     * Exit code of error, or {@code GAUDIO_OK}.
+    */
+    int code;
+
+    /**
+     * Error message, without trailing newline. Empty string if no error.
+    */
+    char message[GAUDIO_ERROR_MESSAGE_LEN];
+};
+
+typedef void (*f_gaudio_try_callback)(void *state);
+
+/**
+ * Error trap of an active call. Internal.
+*/
+struct GaudioErrorTrap;
+
+/**
+ * Callback to release a resource tracked during {@code gaudio_try}.
+*/
+typedef void (*f_gaudio_error_cleanup)(void *resource);
+
+int gaudio_try(f_gaudio_try_callback callback, void *state, struct GaudioError *error);
+int gaudio_try_keep(f_gaudio_try_callback callback, void *state, struct GaudioError *error);
+int gaudio_try_child(struct GaudioErrorTrap *parent, f_gaudio_try_callback callback, void *state, struct GaudioError *error);
+int gaudio_error_trap_active(void);
+struct GaudioErrorTrap *gaudio_error_trap_share(void);
+void gaudio_error_trap_unshare(struct GaudioErrorTrap *trap);
+void gaudio_error_vraise(int code, const char *format, va_list args);
+
+void gaudio_error_track(void *resource, f_gaudio_error_cleanup cleanup);
+void gaudio_error_untrack(void *resource);
+
+#endif
@@ -201,6 +201,25 @@ int16_t forward_quantize(float x, int32_t scale)
     }
 }
 
+/**
+ * Integer version of {@code forward_quantize}, same result for any {@code x}
+ * exactly representable as float. Exact halves round toward zero.
+ * @param x: value to quantize.
+ * @param scale: power of two to divide by.
+ * @returns: 16-bit quantized amount.
+*/
+int16_t forward_quantize_i32(int32_t x, int32_t scale)
+{
+    if (x > 0)
+    {
+        return (int16_t) ((x + ((scale - 1) >> 1)) / scale);
+    }
+    else
+    {
+        return (int16_t) -((-x + ((scale - 1) >> 1)) / scale);
+    }
+}
+
 /**
  * Forward quantization step, divide by scale then add one half.
  * Unless the value is negative, then subtract one half.
@@ -313,9 +332,9 @@ void matrix_f64_free(double **mat, size_t row_count)
     {
         if (mat[i] != NULL)
         {
-            free(mat[i]);
+            gaudio_free(mat[i]);
         }
     }
 
-    free(mat);
+    gaudio_free(mat);
 }
\ No newline at end of file
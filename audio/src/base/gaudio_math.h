@@ -28,6 +28,7 @@ double clamp_f64(double val, double lt, double gt);
 void clamp_inclusive_array_f64_epsilon(double *arr, size_t len, double min, double max, double epsilon);
 int16_t forward_quantize(float x, int32_t scale);
 int16_t forward_quantize_f64(double x, int32_t scale);
+int16_t forward_quantize_i32(int32_t x, int32_t scale);
 void scale_f64_array(double *arr, size_t len, double amount);
 
 double **matrix_f64_new(size_t row_count, size_t col_count);
@@ -143,7 +143,7 @@ void IntHashTable_free(struct IntHashTable *root)
         root->internal = NULL;
     }
 
-    free(root);
+    gaudio_free(root);
 
     TRACE_LEAVE(__func__)
 }
@@ -673,11 +673,11 @@ static void IntHashTable_internal_free(struct IntHashTable_internal *root)
             }
         }
 
-        free(root->buckets);
+        gaudio_free(root->buckets);
         root->buckets = NULL;
     }
 
-    free(root);
+    gaudio_free(root);
 
     TRACE_LEAVE(__func__)
 }
@@ -736,7 +736,7 @@ static void IntHashBucket_free(struct IntHashBucket *bucket)
         bucket->entry_list = NULL;
     }
 
-    free(bucket);
+    gaudio_free(bucket);
 
     TRACE_LEAVE(__func__)
 }
@@ -771,7 +771,7 @@ static void IntHashBucketEntry_free(struct IntHashBucketEntry *entry)
         return;
     }
 
-    free(entry);
+    gaudio_free(entry);
 
     TRACE_LEAVE(__func__)
 }
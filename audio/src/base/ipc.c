@@ -0,0 +1,531 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "debug.h"
+#include "machine_config.h"
+#include "common.h"
+#include "utility.h"
+#include "ipc.h"
+
+/**
+ * This file contains functions for exchanging framed messages over
+ * a Unix domain socket.
+ *
+ * Socket errors are reported by return code instead of exiting, a server
+ * should outlive a client that disconnects early.
+*/
+
+/**
+ * Gets the socket path used when none is specified: {@code IPC_SOCKET_NAME} in
+ * {@code IPC_RUNTIME_DIR_ENV} if set, otherwise in {@code IPC_FALLBACK_DIR_FORMAT}.
+ * The fallback directory must be owned by the current user and not accessible
+ * to anyone else, so other users can't replace the socket.
+ * @param path: out parameter. Socket path.
+ * @param path_len: size of path buffer.
+ * @param create_dir: flag, create the fallback directory if it doesn't exist (server).
+ * @returns: {@code IPC_OK}, or {@code IPC_ERROR}.
+*/
+int ipc_default_socket_path(char *path, size_t path_len, int create_dir)
+{
+    TRACE_ENTER(__func__)
+
+    char dir[PATH_MAX];
+    const char *runtime_dir;
+    struct stat st;
+    uid_t uid;
+
+    if (path == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> path is NULL\n", __func__, __LINE__);
+    }
+
+    runtime_dir = getenv(IPC_RUNTIME_DIR_ENV);
+    uid = geteuid();
+
+    if (runtime_dir != NULL && runtime_dir[0] != '\0')
+    {
+        snprintf(dir, PATH_MAX, "%s", runtime_dir);
+    }
+    else
+    {
+        snprintf(dir, PATH_MAX, IPC_FALLBACK_DIR_FORMAT, (unsigned int)uid);
+
+        if (create_dir && mkdir(dir, 0700) != 0 && errno != EEXIST)
+        {
+            fprintf(stderr, "%s %d> cannot create directory %s: %s\n", __func__, __LINE__, dir, strerror(errno));
+            TRACE_LEAVE(__func__)
+            return IPC_ERROR;
+        }
+
+        // directory may have been created by someone else first.
+        if (lstat(dir, &st) == 0
+            && (!S_ISDIR(st.st_mode) || st.st_uid != uid || (st.st_mode & 077) != 0))
+        {
+            fprintf(stderr, "%s %d> %s must be a directory owned by the current user with mode 0700\n", __func__, __LINE__, dir);
+            TRACE_LEAVE(__func__)
+            return IPC_ERROR;
+        }
+    }
+
+    if ((size_t)snprintf(path, path_len, "%s/%s", dir, IPC_SOCKET_NAME) >= path_len)
+    {
+        fprintf(stderr, "%s %d> socket path too long: %s/%s\n", __func__, __LINE__, dir, IPC_SOCKET_NAME);
+        TRACE_LEAVE(__func__)
+        return IPC_ERROR;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return IPC_OK;
+}
+
+/**
+ * Creates a Unix domain stream socket listening on the given path.
+ * An existing socket at the path owned by the current user (e.g., left by a server
+ * that didn't shut down cleanly) is removed first. Any other existing file is left
+ * alone and an error is returned.
+ * The socket is only accessible to the current user (mode 0600 or stricter).
+ * @param path: socket path.
+ * @param backlog: listen backlog.
+ * @returns: socket file descriptor, or {@code IPC_ERROR}.
+*/
+int ipc_listen_unix(const char *path, int backlog)
+{
+    TRACE_ENTER(__func__)
+
+    struct sockaddr_un addr;
+    struct stat st;
+    mode_t old_mask;
+    int bind_result;
+    int fd;
+
+    if (path == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> path is NULL\n", __func__, __LINE__);
+    }
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "%s %d> socket path too long: %s\n", __func__, __LINE__, path);
+        TRACE_LEAVE(__func__)
+        return IPC_ERROR;
+    }
+
+    if (lstat(path, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            fprintf(stderr, "%s %d> path exists and is not a socket: %s\n", __func__, __LINE__, path);
+            TRACE_LEAVE(__func__)
+            return IPC_ERROR;
+        }
+
+        if (st.st_uid != geteuid())
+        {
+            fprintf(stderr, "%s %d> existing socket is owned by another user: %s\n", __func__, __LINE__, path);
+            TRACE_LEAVE(__func__)
+            return IPC_ERROR;
+        }
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        TRACE_LEAVE(__func__)
+        return IPC_ERROR;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    unlink(path);
+
+    // socket file is created with permissions from umask, only allow current user.
+    old_mask = umask(077);
+    bind_result = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+
+    if (bind_result != 0)
+    {
+        perror("bind");
+        close(fd);
+        TRACE_LEAVE(__func__)
+        return IPC_ERROR;
+    }
+
+    if (listen(fd, backlog) != 0)
+    {
+        perror("listen");
+        close(fd);
+        unlink(path);
+        TRACE_LEAVE(__func__)
+        return IPC_ERROR;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return fd;
+}
+
+/**
+ * Connects to a Unix domain stream socket.
+ * @param path: socket path.
+ * @returns: socket file descriptor, or {@code IPC_ERROR}.
+*/
+int ipc_connect_unix(const char *path)
+{
+    TRACE_ENTER(__func__)
+
+    struct sockaddr_un addr;
+    int fd;
+
+    if (path == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> path is NULL\n", __func__, __LINE__);
+    }
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        TRACE_LEAVE(__func__)
+        return IPC_ERROR;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        TRACE_LEAVE(__func__)
+        return IPC_ERROR;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        TRACE_LEAVE(__func__)
+        return IPC_ERROR;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return fd;
+}
+
+/**
+ * Writes entire buffer, retrying on short writes and interrupts.
+ * @param fd: file descriptor.
+ * @param data: data to write.
+ * @param len: number of bytes to write.
+ * @returns: {@code IPC_OK} or {@code IPC_ERROR}.
+*/
+int ipc_write_all(int fd, const void *data, size_t len)
+{
+    TRACE_ENTER(__func__)
+
+    const uint8_t *p = (const uint8_t *)data;
+
+    while (len > 0)
+    {
+        ssize_t written = send(fd, p, len, MSG_NOSIGNAL);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            TRACE_LEAVE(__func__)
+            return IPC_ERROR;
+        }
+
+        p += written;
+        len -= (size_t)written;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return IPC_OK;
+}
+
+/**
+ * Reads exactly {@code len} bytes, retrying on short reads and interrupts.
+ * @param fd: file descriptor.
+ * @param data: buffer to read into.
+ * @param len: number of bytes to read.
+ * @returns: {@code IPC_OK}, {@code IPC_CLOSED} if the other end closed before any data, or {@code IPC_ERROR}.
+*/
+int ipc_read_all(int fd, void *data, size_t len)
+{
+    TRACE_ENTER(__func__)
+
+    uint8_t *p = (uint8_t *)data;
+    size_t total = 0;
+
+    while (total < len)
+    {
+        ssize_t count = read(fd, p + total, len - total);
+
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            TRACE_LEAVE(__func__)
+            return IPC_ERROR;
+        }
+
+        if (count == 0)
+        {
+            TRACE_LEAVE(__func__)
+            return total == 0 ? IPC_CLOSED : IPC_ERROR;
+        }
+
+        total += (size_t)count;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return IPC_OK;
+}
+
+/**
+ * Writes length prefixed message.
+ * @param fd: file descriptor.
+ * @param payload: message contents. Can be NULL if {@code len} is zero.
+ * @param len: length of message contents.
+ * @returns: {@code IPC_OK} or {@code IPC_ERROR}.
+*/
+int ipc_write_message(int fd, const uint8_t *payload, size_t len)
+{
+    TRACE_ENTER(__func__)
+
+    uint8_t header[4];
+
+    if (len > IPC_MAX_MESSAGE_LEN)
+    {
+        TRACE_LEAVE(__func__)
+        return IPC_ERROR;
+    }
+
+    header[0] = (uint8_t)((len >> 24) & 0xff);
+    header[1] = (uint8_t)((len >> 16) & 0xff);
+    header[2] = (uint8_t)((len >> 8) & 0xff);
+    header[3] = (uint8_t)(len & 0xff);
+
+    if (ipc_write_all(fd, header, 4) != IPC_OK)
+    {
+        TRACE_LEAVE(__func__)
+        return IPC_ERROR;
+    }
+
+    if (len > 0 && ipc_write_all(fd, payload, len) != IPC_OK)
+    {
+        TRACE_LEAVE(__func__)
+        return IPC_ERROR;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return IPC_OK;
+}
+
+/**
+ * Reads length prefixed message.
+ * @param fd: file descriptor.
+ * @param payload: out parameter. Will contain newly allocated buffer with message contents,
+ * with an extra zero byte at the end. Caller is responsible for freeing memory.
+ * @param len: out parameter. Will contain length of message contents.
+ * @returns: {@code IPC_OK}, {@code IPC_CLOSED}, or {@code IPC_ERROR}.
+*/
+int ipc_read_message(int fd, uint8_t **payload, size_t *len)
+{
+    TRACE_ENTER(__func__)
+
+    uint8_t header[4];
+    size_t message_len;
+    int result;
+
+    if (payload == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> payload is NULL\n", __func__, __LINE__);
+    }
+
+    if (len == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> len is NULL\n", __func__, __LINE__);
+    }
+
+    *payload = NULL;
+    *len = 0;
+
+    result = ipc_read_all(fd, header, 4);
+    if (result != IPC_OK)
+    {
+        TRACE_LEAVE(__func__)
+        return result;
+    }
+
+    message_len = ((size_t)header[0] << 24) | ((size_t)header[1] << 16) | ((size_t)header[2] << 8) | (size_t)header[3];
+
+    if (message_len > IPC_MAX_MESSAGE_LEN)
+    {
+        TRACE_LEAVE(__func__)
+        return IPC_ERROR;
+    }
+
+    *payload = (uint8_t *)malloc_zero(1, message_len + 1);
+
+    if (message_len > 0 && ipc_read_all(fd, *payload, message_len) != IPC_OK)
+    {
+        gaudio_free(*payload);
+        *payload = NULL;
+        TRACE_LEAVE(__func__)
+        return IPC_ERROR;
+    }
+
+    *len = message_len;
+
+    TRACE_LEAVE(__func__)
+
+    return IPC_OK;
+}
+
+/**
+ * Packs list of strings into a single buffer, each string followed by a zero byte.
+ * @param count: number of strings.
+ * @param strings: strings to pack.
+ * @param len: out parameter. Will contain length of buffer.
+ * @returns: newly allocated buffer. Caller is responsible for freeing memory.
+*/
+uint8_t *ipc_pack_strings(int count, char **strings, size_t *len)
+{
+    TRACE_ENTER(__func__)
+
+    uint8_t *buffer;
+    size_t total = 0;
+    size_t pos = 0;
+    int i;
+
+    if (strings == NULL && count > 0)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> strings is NULL\n", __func__, __LINE__);
+    }
+
+    if (len == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> len is NULL\n", __func__, __LINE__);
+    }
+
+    for (i=0; i<count; i++)
+    {
+        total += strlen(strings[i]) + 1;
+    }
+
+    buffer = (uint8_t *)malloc_zero(1, total + 1);
+
+    for (i=0; i<count; i++)
+    {
+        size_t string_len = strlen(strings[i]) + 1;
+        memcpy(&buffer[pos], strings[i], string_len);
+        pos += string_len;
+    }
+
+    *len = total;
+
+    TRACE_LEAVE(__func__)
+
+    return buffer;
+}
+
+/**
+ * Splits buffer created by {@code ipc_pack_strings} back into strings.
+ * Strings point into {@code buffer}, which must outlive the result.
+ * @param buffer: packed strings.
+ * @param len: length of buffer.
+ * @param count: out parameter. Will contain number of strings.
+ * @returns: newly allocated array of string pointers, NULL terminated, or NULL if
+ * the buffer is not a valid packed string list. Caller is responsible for freeing array (only).
+*/
+char **ipc_unpack_strings(uint8_t *buffer, size_t len, int *count)
+{
+    TRACE_ENTER(__func__)
+
+    char **strings;
+    size_t pos;
+    int string_count = 0;
+    int i;
+
+    if (count == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> count is NULL\n", __func__, __LINE__);
+    }
+
+    *count = 0;
+
+    if (buffer == NULL || len == 0 || buffer[len - 1] != '\0')
+    {
+        TRACE_LEAVE(__func__)
+        return NULL;
+    }
+
+    for (pos=0; pos<len; pos++)
+    {
+        if (buffer[pos] == '\0')
+        {
+            string_count++;
+        }
+    }
+
+    if (string_count > IPC_MAX_STRINGS)
+    {
+        TRACE_LEAVE(__func__)
+        return NULL;
+    }
+
+    strings = (char **)malloc_zero(string_count + 1, sizeof(char *));
+
+    pos = 0;
+    for (i=0; i<string_count; i++)
+    {
+        strings[i] = (char *)&buffer[pos];
+        pos += strlen(strings[i]) + 1;
+    }
+
+    *count = string_count;
+
+    TRACE_LEAVE(__func__)
+
+    return strings;
+}
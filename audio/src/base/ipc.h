@@ -0,0 +1,82 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#ifndef _GAUDIO_IPC_H_
+#define _GAUDIO_IPC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * This file contains defines and functions for exchanging framed messages
+ * over a local (Unix domain) stream socket. Used by gaudiod and gaudioc.
+ *
+ * Each message is a 4 byte big endian length followed by that many bytes of payload.
+*/
+
+/**
+ * Socket file name, in the per user directory when no path is specified.
+*/
+#define IPC_SOCKET_NAME "gaudiod.sock"
+
+/**
+ * Per user runtime directory, used for the socket if set.
+*/
+#define IPC_RUNTIME_DIR_ENV "XDG_RUNTIME_DIR"
+
+/**
+ * Per user directory used when {@code IPC_RUNTIME_DIR_ENV} is not set, %u is the user id.
+ * Created with mode 0700.
+*/
+#define IPC_FALLBACK_DIR_FORMAT "/tmp/gaudiod-%u"
+
+/**
+ * Environment variable to override default socket path.
+*/
+#define IPC_SOCKET_ENV "GAUDIOD_SOCKET"
+
+/**
+ * Sanity check, max message payload length.
+*/
+#define IPC_MAX_MESSAGE_LEN (16 * 1024 * 1024)
+
+/**
+ * Sanity check, max number of strings in a packed string list.
+*/
+#define IPC_MAX_STRINGS 256
+
+/**
+ * Return codes.
+*/
+#define IPC_OK      0
+#define IPC_ERROR  -1
+#define IPC_CLOSED -2
+
+int ipc_default_socket_path(char *path, size_t path_len, int create_dir);
+int ipc_listen_unix(const char *path, int backlog);
+int ipc_connect_unix(const char *path);
+
+int ipc_write_all(int fd, const void *data, size_t len);
+int ipc_read_all(int fd, void *data, size_t len);
+
+int ipc_write_message(int fd, const uint8_t *payload, size_t len);
+int ipc_read_message(int fd, uint8_t **payload, size_t *len);
+
+uint8_t *ipc_pack_strings(int count, char **strings, size_t *len);
+char **ipc_unpack_strings(uint8_t *buffer, size_t len, int *count);
+
+#endif
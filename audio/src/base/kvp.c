@@ -89,11 +89,11 @@ void KeyValue_free(struct KeyValue *kvp)
 
     if (kvp->value != NULL)
     {
-        free(kvp->value);
+        gaudio_free(kvp->value);
         kvp->value = NULL;
     }
 
-    free(kvp);
+    gaudio_free(kvp);
 
     TRACE_LEAVE(__func__)
 }
@@ -147,7 +147,7 @@ void KeyValuePointer_free(struct KeyValuePointer *kvp)
         return;
     }
 
-    free(kvp);
+    gaudio_free(kvp);
 
     TRACE_LEAVE(__func__)
 }
@@ -198,7 +198,7 @@ void KeyValueInt_free(struct KeyValueInt *kvp)
         return;
     }
 
-    free(kvp);
+    gaudio_free(kvp);
 
     TRACE_LEAVE(__func__)
 }
\ No newline at end of file
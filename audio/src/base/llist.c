@@ -201,11 +201,11 @@ void string_data_free(struct string_data *sd)
 
     if (sd->text != NULL)
     {
-        free(sd->text);
+        gaudio_free(sd->text);
         sd->text = NULL;
     }
 
-    free(sd);
+    gaudio_free(sd);
 
     TRACE_LEAVE(__func__)
 }
@@ -260,7 +260,7 @@ void LinkedListNode_free(struct LinkedList *root, struct LinkedListNode *node)
 
     LinkedListNode_detach(root, node);
 
-    free(node);
+    gaudio_free(node);
 
     TRACE_LEAVE(__func__)
 }
@@ -354,7 +354,7 @@ void LinkedList_free_children(struct LinkedList *root)
     while (node != NULL)
     {
         next = node->next;
-        free(node);
+        gaudio_free(node);
         node = next;
     }
 
@@ -390,11 +390,11 @@ void LinkedListNode_free_string_data(struct LinkedList *root)
             struct string_data *sd = (struct string_data *)node->data;
             if (sd->text != NULL)
             {
-                free(sd->text);
+                gaudio_free(sd->text);
                 sd->text = NULL;
             }
 
-            free(node->data);
+            gaudio_free(node->data);
             node->data = NULL;
         }
 
@@ -427,7 +427,7 @@ void LinkedList_free(struct LinkedList *root)
     while (node != NULL)
     {
         next = node->next;
-        free(node);
+        gaudio_free(node);
         node = next;
     }
 
@@ -435,7 +435,7 @@ void LinkedList_free(struct LinkedList *root)
     root->tail = NULL;
     root->count = 0;
 
-    free(root);
+    gaudio_free(root);
 
     TRACE_LEAVE(__func__)
 }
@@ -459,7 +459,7 @@ void LinkedList_free_only_self(struct LinkedList *root)
     root->tail = NULL;
     root->count = 0;
 
-    free(root);
+    gaudio_free(root);
 
     TRACE_LEAVE(__func__)
 }
@@ -0,0 +1,227 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "debug.h"
+#include "machine_config.h"
+#include "common.h"
+#include "utility.h"
+#include "gaudio_error.h"
+#include "parallel.h"
+
+/**
+ * This file contains a minimal fork/join helper used to run independent
+ * work items (e.g., tracks) on multiple threads.
+*/
+
+int g_parallel_num_threads = 0;
+
+/**
+ * Shared state for one call to {@code parallel_for}.
+*/
+struct ParallelForState {
+    // next work item to claim.
+    int next_index;
+
+    // total number of work items.
+    int count;
+
+    f_parallel_for_callback callback;
+
+    // caller supplied state.
+    void *state;
+
+    // Optional. Trap of calling thread when called inside gaudio_try.
+    struct GaudioErrorTrap *trap;
+
+    // flag, set by the first work item that fails. Remaining items are skipped.
+    int failed;
+
+    // error of the first failed work item.
+    struct GaudioError error;
+};
+
+// forward declarations
+
+static void *parallel_for_worker(void *arg);
+static void parallel_for_run(void *arg);
+
+// end forward declarations
+
+/**
+ * Resolves {@code g_parallel_num_threads} to the number of threads to use.
+ * @returns: number of threads, at least one.
+*/
+int parallel_get_num_threads()
+{
+    TRACE_ENTER(__func__)
+
+    int result = g_parallel_num_threads;
+
+    if (result < 1)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        result = online > 0 ? (int)online : 1;
+    }
+
+    TRACE_LEAVE(__func__)
+    return result;
+}
+
+/**
+ * Calls {@code callback} once for each index in [0, count). Work items are
+ * claimed in increasing order by the calling thread and up to
+ * {@code parallel_get_num_threads()-1} additional threads. Returns after all
+ * items have completed. The order items complete in is not defined, so the
+ * callback should write results to a slot for its index.
+ * If a thread can't be created the remaining items run on the calling thread.
+ * Inside {@code gaudio_try} an error in any item is reported on the calling thread
+ * after all threads finish, items not yet started are skipped. Items must not
+ * free memory allocated by other items.
+ * @param count: number of work items.
+ * @param callback: function to call for each item.
+ * @param state: passed to callback.
+*/
+void parallel_for(int count, f_parallel_for_callback callback, void *state)
+{
+    TRACE_ENTER(__func__)
+
+    if (callback == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> callback is NULL\n", __func__, __LINE__);
+    }
+
+    struct ParallelForState pfs;
+    pthread_t *threads;
+    int num_threads;
+    int started = 0;
+    int i;
+
+    num_threads = parallel_get_num_threads();
+
+    if (num_threads > count)
+    {
+        num_threads = count;
+    }
+
+    if (num_threads <= 1)
+    {
+        for (i=0; i<count; i++)
+        {
+            callback(i, state);
+        }
+
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    pfs.next_index = 0;
+    pfs.count = count;
+    pfs.callback = callback;
+    pfs.state = state;
+    pfs.failed = 0;
+
+    threads = (pthread_t *)malloc_zero(num_threads - 1, sizeof(pthread_t));
+
+    // errors can't jump between threads, each thread runs in a child trap.
+    pfs.trap = gaudio_error_trap_share();
+
+    for (i=0; i<num_threads - 1; i++)
+    {
+        if (pthread_create(&threads[i], NULL, parallel_for_worker, &pfs) != 0)
+        {
+            break;
+        }
+
+        started++;
+    }
+
+    // calling thread works too.
+    parallel_for_worker(&pfs);
+
+    for (i=0; i<started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    gaudio_error_trap_unshare(pfs.trap);
+
+    gaudio_free(threads);
+
+    if (pfs.failed)
+    {
+        stderr_exit(pfs.error.code, "%s\n", pfs.error.message);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Thread entry point. Claims and runs work items until none remain, inside a
+ * child trap when {@code parallel_for} was called inside {@code gaudio_try}.
+ * @param arg: {@code struct ParallelForState}.
+ * @returns: NULL.
+*/
+static void *parallel_for_worker(void *arg)
+{
+    TRACE_ENTER(__func__)
+
+    struct ParallelForState *pfs = (struct ParallelForState *)arg;
+    struct GaudioError error;
+    int expected = 0;
+
+    if (pfs->trap == NULL)
+    {
+        parallel_for_run(pfs);
+    }
+    else if (gaudio_try_child(pfs->trap, parallel_for_run, pfs, &error) != GAUDIO_OK)
+    {
+        // keep the first error only.
+        if (__atomic_compare_exchange_n(&pfs->failed, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            memcpy(&pfs->error, &error, sizeof(struct GaudioError));
+        }
+    }
+
+    TRACE_LEAVE(__func__)
+    return NULL;
+}
+
+/**
+ * Claims and runs work items until none remain, or an item failed.
+ * @param arg: {@code struct ParallelForState}.
+*/
+static void parallel_for_run(void *arg)
+{
+    TRACE_ENTER(__func__)
+
+    struct ParallelForState *pfs = (struct ParallelForState *)arg;
+    int index;
+
+    while (!__atomic_load_n(&pfs->failed, __ATOMIC_RELAXED)
+        && (index = __atomic_fetch_add(&pfs->next_index, 1, __ATOMIC_RELAXED)) < pfs->count)
+    {
+        pfs->callback(index, pfs->state);
+    }
+
+    TRACE_LEAVE(__func__)
+}
@@ -0,0 +1,38 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#ifndef _GAUDIO_PARALLEL_H_
+#define _GAUDIO_PARALLEL_H_
+
+/**
+ * Number of worker threads used by {@code parallel_for}.
+ * Zero means use the number of online processors. One means run
+ * everything on the calling thread.
+*/
+extern int g_parallel_num_threads;
+
+/**
+ * Callback for {@code parallel_for}.
+ * @param index: index of work item, between zero and count-1.
+ * @param state: caller supplied state.
+*/
+typedef void (*f_parallel_for_callback)(int index, void *state);
+
+int parallel_get_num_threads(void);
+void parallel_for(int count, f_parallel_for_callback callback, void *state);
+
+#endif
@@ -0,0 +1,452 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "debug.h"
+#include "machine_config.h"
+#include "common.h"
+#include "utility.h"
+#include "stats.h"
+
+/**
+ * This file contains functions for collecting per phase performance counters.
+ * Apps enable this with the --stats option.
+*/
+
+/**
+ * Output format, or {@code STATS_FORMAT_NONE} when not collecting.
+*/
+int g_stats_format = STATS_FORMAT_NONE;
+
+static struct StatsPhase _stats_phases[STATS_MAX_PHASES];
+static int _stats_phase_count = 0;
+static uint64_t _stats_wall_start_ns = 0;
+static uint64_t _stats_cpu_start_ns = 0;
+
+// forward declarations
+
+static uint64_t stats_clock_ns(clockid_t clock_id);
+static struct StatsPhase *stats_find_or_add_phase(const char *name);
+static double stats_per_sec(uint64_t count, uint64_t elapsed_ns);
+
+// end forward declarations
+
+/**
+ * Parses the argument to the --stats option.
+ * @param arg: option argument, may be NULL.
+ * @returns: {@code STATS_FORMAT_TEXT} if {@code arg} is NULL or empty, {@code STATS_FORMAT_JSON} for "json",
+ * or -1 if not recognized.
+*/
+int stats_parse_format(const char *arg)
+{
+    TRACE_ENTER(__func__)
+
+    int format = -1;
+
+    if (arg == NULL || arg[0] == '\0' || strcmp(arg, "text") == 0)
+    {
+        format = STATS_FORMAT_TEXT;
+    }
+    else if (strcmp(arg, "json") == 0)
+    {
+        format = STATS_FORMAT_JSON;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return format;
+}
+
+/**
+ * Clears all counters and starts collecting. Process wall and cpu time
+ * are measured from here.
+ * @param format: output format used by {@code stats_print}.
+*/
+void stats_enable(int format)
+{
+    TRACE_ENTER(__func__)
+
+    stats_reset();
+
+    g_stats_format = format;
+    _stats_wall_start_ns = stats_clock_ns(CLOCK_MONOTONIC);
+    _stats_cpu_start_ns = stats_clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Clears all counters and stops collecting.
+*/
+void stats_reset(void)
+{
+    TRACE_ENTER(__func__)
+
+    memset(_stats_phases, 0, sizeof(_stats_phases));
+    _stats_phase_count = 0;
+    _stats_wall_start_ns = 0;
+    _stats_cpu_start_ns = 0;
+    g_stats_format = STATS_FORMAT_NONE;
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Starts timing a phase. Nested calls for the same phase are only counted once.
+ * @param name: phase name, must be a string literal (not copied).
+*/
+void stats_phase_begin(const char *name)
+{
+    TRACE_ENTER(__func__)
+
+    struct StatsPhase *phase;
+
+    if (g_stats_format == STATS_FORMAT_NONE)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    phase = stats_find_or_add_phase(name);
+
+    if (phase != NULL)
+    {
+        if (phase->running == 0)
+        {
+            phase->calls++;
+            phase->wall_start_ns = stats_clock_ns(CLOCK_MONOTONIC);
+            phase->cpu_start_ns = stats_clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+        }
+
+        phase->running++;
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Stops timing a phase and adds the elapsed time to the totals.
+ * @param name: phase name.
+*/
+void stats_phase_end(const char *name)
+{
+    TRACE_ENTER(__func__)
+
+    struct StatsPhase *phase;
+
+    if (g_stats_format == STATS_FORMAT_NONE)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    phase = stats_get_phase(name);
+
+    if (phase != NULL && phase->running > 0)
+    {
+        phase->running--;
+
+        if (phase->running == 0)
+        {
+            phase->wall_ns += stats_clock_ns(CLOCK_MONOTONIC) - phase->wall_start_ns;
+            phase->cpu_ns += stats_clock_ns(CLOCK_PROCESS_CPUTIME_ID) - phase->cpu_start_ns;
+        }
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Adds to the number of bytes processed by a phase.
+ * @param name: phase name, must be a string literal (not copied).
+ * @param bytes: number of bytes to add.
+*/
+void stats_add_bytes(const char *name, uint64_t bytes)
+{
+    TRACE_ENTER(__func__)
+
+    struct StatsPhase *phase;
+
+    if (g_stats_format == STATS_FORMAT_NONE)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    phase = stats_find_or_add_phase(name);
+
+    if (phase != NULL)
+    {
+        phase->bytes += bytes;
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Adds to the number of items processed by a phase.
+ * @param name: phase name, must be a string literal (not copied).
+ * @param item_unit: name of items, e.g. "frames". String literal, not copied.
+ * @param items: number of items to add.
+*/
+void stats_add_items(const char *name, const char *item_unit, uint64_t items)
+{
+    TRACE_ENTER(__func__)
+
+    struct StatsPhase *phase;
+
+    if (g_stats_format == STATS_FORMAT_NONE)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    phase = stats_find_or_add_phase(name);
+
+    if (phase != NULL)
+    {
+        phase->items += items;
+        phase->item_unit = item_unit;
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Gets counters for a phase.
+ * @param name: phase name.
+ * @returns: phase, or NULL if the phase hasn't been used.
+*/
+struct StatsPhase *stats_get_phase(const char *name)
+{
+    TRACE_ENTER(__func__)
+
+    int i;
+
+    if (name == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> name is NULL\n", __func__, __LINE__);
+    }
+
+    for (i=0; i<_stats_phase_count; i++)
+    {
+        if (_stats_phases[i].name == name || strcmp(_stats_phases[i].name, name) == 0)
+        {
+            TRACE_LEAVE(__func__)
+            return &_stats_phases[i];
+        }
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return NULL;
+}
+
+/**
+ * Gets the peak resident set size of the process.
+ * @returns: peak RSS in kilobytes, or -1 if not available.
+*/
+long stats_peak_rss_kb(void)
+{
+    TRACE_ENTER(__func__)
+
+    struct rusage usage;
+    long result = -1;
+
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        // linux reports kilobytes, macOS reports bytes.
+#if defined(__APPLE__)
+        result = (long)(usage.ru_maxrss / 1024);
+#else
+        result = (long)usage.ru_maxrss;
+#endif
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return result;
+}
+
+/**
+ * Prints all phase counters, process totals and peak RSS in the
+ * format given to {@code stats_enable}. Does nothing if not enabled.
+ * Phases are listed in the order they were first used.
+ * @param fp: file to write to.
+ * @param appname: name of app, included in output.
+*/
+void stats_print(FILE *fp, const char *appname)
+{
+    TRACE_ENTER(__func__)
+
+    int i;
+    uint64_t total_wall_ns;
+    uint64_t total_cpu_ns;
+    long peak_rss_kb;
+
+    if (fp == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> fp is NULL\n", __func__, __LINE__);
+    }
+
+    if (g_stats_format == STATS_FORMAT_NONE)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    total_wall_ns = stats_clock_ns(CLOCK_MONOTONIC) - _stats_wall_start_ns;
+    total_cpu_ns = stats_clock_ns(CLOCK_PROCESS_CPUTIME_ID) - _stats_cpu_start_ns;
+    peak_rss_kb = stats_peak_rss_kb();
+
+    if (g_stats_format == STATS_FORMAT_JSON)
+    {
+        fprintf(fp, "{\"app\":\"%s\",\"wall_ms\":%.3f,\"cpu_ms\":%.3f,\"peak_rss_kb\":%ld,\"phases\":[",
+            appname,
+            (double)total_wall_ns / 1e6,
+            (double)total_cpu_ns / 1e6,
+            peak_rss_kb);
+
+        for (i=0; i<_stats_phase_count; i++)
+        {
+            struct StatsPhase *phase = &_stats_phases[i];
+
+            fprintf(fp, "%s{\"name\":\"%s\",\"calls\":%d,\"wall_ms\":%.3f,\"cpu_ms\":%.3f,\"bytes\":%llu,\"bytes_per_sec\":%.1f,\"items\":%llu,\"item_unit\":\"%s\",\"items_per_sec\":%.1f}",
+                i > 0 ? "," : "",
+                phase->name,
+                phase->calls,
+                (double)phase->wall_ns / 1e6,
+                (double)phase->cpu_ns / 1e6,
+                (unsigned long long)phase->bytes,
+                stats_per_sec(phase->bytes, phase->wall_ns),
+                (unsigned long long)phase->items,
+                phase->item_unit != NULL ? phase->item_unit : "",
+                stats_per_sec(phase->items, phase->wall_ns));
+        }
+
+        fprintf(fp, "]}\n");
+    }
+    else
+    {
+        fprintf(fp, "%s stats\n", appname);
+        fprintf(fp, "%-20s %6s %11s %11s %12s %10s %12s %14s\n", "phase", "calls", "wall ms", "cpu ms", "bytes", "MB/s", "items", "items/s");
+
+        for (i=0; i<_stats_phase_count; i++)
+        {
+            struct StatsPhase *phase = &_stats_phases[i];
+
+            fprintf(fp, "%-20s %6d %11.3f %11.3f", phase->name, phase->calls, (double)phase->wall_ns / 1e6, (double)phase->cpu_ns / 1e6);
+
+            if (phase->bytes > 0)
+            {
+                fprintf(fp, " %12llu %10.2f", (unsigned long long)phase->bytes, stats_per_sec(phase->bytes, phase->wall_ns) / (1024.0 * 1024.0));
+            }
+            else
+            {
+                fprintf(fp, " %12s %10s", "-", "-");
+            }
+
+            if (phase->items > 0)
+            {
+                fprintf(fp, " %12llu %14.1f %s", (unsigned long long)phase->items, stats_per_sec(phase->items, phase->wall_ns), phase->item_unit != NULL ? phase->item_unit : "");
+            }
+            else
+            {
+                fprintf(fp, " %12s %14s", "-", "-");
+            }
+
+            fprintf(fp, "\n");
+        }
+
+        fprintf(fp, "%-20s %6s %11.3f %11.3f\n", "total", "", (double)total_wall_ns / 1e6, (double)total_cpu_ns / 1e6);
+        fprintf(fp, "peak rss: %ld KB\n", peak_rss_kb);
+    }
+
+    fflush(fp);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Reads a clock.
+ * @param clock_id: clock to read.
+ * @returns: clock time in nanoseconds.
+*/
+static uint64_t stats_clock_ns(clockid_t clock_id)
+{
+    TRACE_ENTER(__func__)
+
+    struct timespec ts;
+
+    clock_gettime(clock_id, &ts);
+
+    TRACE_LEAVE(__func__)
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Gets counters for a phase, adding the phase if it hasn't been used yet.
+ * @param name: phase name.
+ * @returns: phase, or NULL if {@code STATS_MAX_PHASES} are already in use.
+*/
+static struct StatsPhase *stats_find_or_add_phase(const char *name)
+{
+    TRACE_ENTER(__func__)
+
+    struct StatsPhase *phase = stats_get_phase(name);
+
+    if (phase == NULL && _stats_phase_count < STATS_MAX_PHASES)
+    {
+        phase = &_stats_phases[_stats_phase_count];
+        _stats_phase_count++;
+
+        phase->name = name;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return phase;
+}
+
+/**
+ * Computes a rate.
+ * @param count: number of things.
+ * @param elapsed_ns: elapsed time in nanoseconds.
+ * @returns: count per second, or zero if no time elapsed.
+*/
+static double stats_per_sec(uint64_t count, uint64_t elapsed_ns)
+{
+    TRACE_ENTER(__func__)
+
+    double result = 0.0;
+
+    if (elapsed_ns > 0)
+    {
+        result = (double)count * 1e9 / (double)elapsed_ns;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return result;
+}
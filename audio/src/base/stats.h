@@ -0,0 +1,118 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#ifndef _GAUDIO_STATS_H_
+#define _GAUDIO_STATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * This file contains structs and defines for collecting per phase
+ * performance counters (wall time, cpu time, bytes and items processed)
+ * and reporting them when an app finishes.
+ * 
+ * Collection is off until {@code stats_enable} is called, all other
+ * functions return immediately while off. Not thread safe, phases
+ * should be started and stopped from the main thread.
+*/
+
+/**
+ * Max number of distinct phase names tracked. Phases past this are ignored.
+*/
+#define STATS_MAX_PHASES 32
+
+enum STATS_FORMAT {
+    /**
+     * Not collecting.
+    */
+    STATS_FORMAT_NONE = 0,
+
+    /**
+     * Human readable table.
+    */
+    STATS_FORMAT_TEXT,
+
+    /**
+     * Single JSON object.
+    */
+    STATS_FORMAT_JSON
+};
+
+/**
+ * Counters for one named phase.
+*/
+struct StatsPhase {
+    /**
+     * Phase name, must be a string literal (not copied).
+    */
+    const char *name;
+
+    /**
+     * Unit name for {@code items}, e.g. "frames" or "events". String literal, not copied.
+    */
+    const char *item_unit;
+
+    /**
+     * Number of times the phase was started.
+    */
+    int calls;
+
+    /**
+     * Nesting depth of currently running begin/end pairs.
+    */
+    int running;
+
+    /**
+     * Time in nanoseconds the phase was last started.
+    */
+    uint64_t wall_start_ns;
+    uint64_t cpu_start_ns;
+
+    /**
+     * Total elapsed time in nanoseconds.
+    */
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+
+    /**
+     * Total bytes processed.
+    */
+    uint64_t bytes;
+
+    /**
+     * Total items processed, see {@code item_unit}.
+    */
+    uint64_t items;
+};
+
+extern int g_stats_format;
+
+int stats_parse_format(const char *arg);
+void stats_enable(int format);
+void stats_reset(void);
+
+void stats_phase_begin(const char *name);
+void stats_phase_end(const char *name);
+void stats_add_bytes(const char *name, uint64_t bytes);
+void stats_add_items(const char *name, const char *item_unit, uint64_t items);
+
+struct StatsPhase *stats_get_phase(const char *name);
+long stats_peak_rss_kb(void);
+void stats_print(FILE *fp, const char *appname);
+
+#endif
@@ -142,7 +142,7 @@ void StringHashTable_free(struct StringHashTable *root)
         root->internal = NULL;
     }
 
-    free(root);
+    gaudio_free(root);
 
     TRACE_LEAVE(__func__)
 }
@@ -702,11 +702,11 @@ static void StringHashTable_internal_free(struct StringHashTable_internal *root)
             }
         }
 
-        free(root->buckets);
+        gaudio_free(root->buckets);
         root->buckets = NULL;
     }
 
-    free(root);
+    gaudio_free(root);
 
     TRACE_LEAVE(__func__)
 }
@@ -765,7 +765,7 @@ static void StringHashBucket_free(struct StringHashBucket *bucket)
         bucket->entry_list = NULL;
     }
 
-    free(bucket);
+    gaudio_free(bucket);
 
     TRACE_LEAVE(__func__)
 }
@@ -815,11 +815,11 @@ static void StringHashBucketEntry_free(struct StringHashBucketEntry *entry)
 
     if (entry->key != NULL)
     {
-        free(entry->key);
+        gaudio_free(entry->key);
         entry->key = NULL;
     }
 
-    free(entry);
+    gaudio_free(entry);
 
     TRACE_LEAVE(__func__)
 }
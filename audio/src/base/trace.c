@@ -0,0 +1,659 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "trace.h"
+
+/**
+ * This file contains function tracing. Each thread records enter/leave
+ * events into its own ring buffer, so recording doesn't take a lock.
+ * Events are exported once tracing stops.
+ *
+ * Functions here are called from TRACE_ENTER/TRACE_LEAVE, so nothing in this file
+ * may call a traced function (malloc_zero, stderr_exit, etc).
+*/
+
+/**
+ * Node in call tree built when exporting folded stacks.
+*/
+struct TraceStackNode {
+    const char *name;
+    int parent;
+    int first_child;
+    int next_sibling;
+
+    /**
+     * Total time in nanoseconds spent in this call stack, excluding children.
+    */
+    uint64_t self_time;
+};
+
+/**
+ * Open call when exporting folded stacks.
+*/
+struct TraceStackFrame {
+    int node;
+    uint64_t start;
+
+    /**
+     * Total time in nanoseconds spent in child calls.
+    */
+    uint64_t child_time;
+};
+
+/**
+ * Current state. Checked by TRACE_ENTER/TRACE_LEAVE before calling into this file.
+*/
+volatile int g_trace_state = TRACE_STATE_UNINITIALIZED;
+
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_buffer_key;
+
+/**
+ * List of all thread buffers. Buffers are kept after threads exit until {@code trace_reset}.
+*/
+static struct TraceBuffer *trace_buffers = NULL;
+static int trace_next_thread_id = 0;
+static int trace_atexit_registered = 0;
+
+/**
+ * Output file written by {@code trace_stop}. Optional.
+*/
+static char *trace_output_filename = NULL;
+static int trace_output_format = TRACE_FORMAT_CHROME_JSON;
+
+/**
+ * Time tracing started, exported times are relative to this.
+*/
+static uint64_t trace_start_time = 0;
+
+// forward declarations
+
+static uint64_t trace_now(void);
+static void trace_create_key(void);
+static void trace_init_from_env(void);
+static void trace_atexit(void);
+static struct TraceBuffer *trace_get_buffer(void);
+static void trace_disable(int *previous_state);
+static int TraceStackNode_get_child(struct TraceStackNode **nodes, int *num_nodes, int *max_nodes, int parent, const char *name);
+static void TraceStackNode_fprint_stack(FILE *fp, struct TraceStackNode *nodes, int node);
+static void trace_fold_buffer(struct TraceBuffer *buffer, struct TraceStackNode **nodes, int *num_nodes, int *max_nodes);
+
+// end forward declarations
+
+/**
+ * Starts recording events.
+ * @param filename: Optional. File to write when tracing stops (or at exit).
+ * @param format: {@code enum TRACE_OUTPUT_FORMAT}, format of output file.
+*/
+void trace_start(const char *filename, int format)
+{
+    pthread_mutex_lock(&trace_mutex);
+
+    if (trace_output_filename != NULL)
+    {
+        free(trace_output_filename);
+        trace_output_filename = NULL;
+    }
+
+    if (filename != NULL)
+    {
+        size_t len = strlen(filename);
+        trace_output_filename = (char *)calloc(len + 1, 1);
+
+        if (trace_output_filename != NULL)
+        {
+            memcpy(trace_output_filename, filename, len);
+        }
+    }
+
+    trace_output_format = format;
+
+    if (!trace_atexit_registered)
+    {
+        atexit(trace_atexit);
+        trace_atexit_registered = 1;
+    }
+
+    trace_start_time = trace_now();
+    g_trace_state = TRACE_STATE_ON;
+
+    pthread_mutex_unlock(&trace_mutex);
+}
+
+/**
+ * Stops recording events. If an output file was given to {@code trace_start}
+ * the events are written to it. Recorded events are kept until {@code trace_reset}.
+*/
+void trace_stop(void)
+{
+    FILE *fp;
+
+    g_trace_state = TRACE_STATE_OFF;
+
+    pthread_mutex_lock(&trace_mutex);
+
+    if (trace_output_filename != NULL)
+    {
+        fp = fopen(trace_output_filename, "w");
+
+        if (fp == NULL)
+        {
+            fprintf(stderr, "%s %d> cannot open trace output file: %s\n", __func__, __LINE__, trace_output_filename);
+        }
+        else
+        {
+            pthread_mutex_unlock(&trace_mutex);
+
+            if (trace_output_format == TRACE_FORMAT_FOLDED)
+            {
+                trace_write_folded(fp);
+            }
+            else
+            {
+                trace_write_chrome_json(fp);
+            }
+
+            fclose(fp);
+
+            pthread_mutex_lock(&trace_mutex);
+        }
+
+        free(trace_output_filename);
+        trace_output_filename = NULL;
+    }
+
+    pthread_mutex_unlock(&trace_mutex);
+}
+
+/**
+ * Records an event for the current thread.
+ * @param name: function name, must be a string literal.
+ * @param type: {@code enum TRACE_EVENT_TYPE}.
+*/
+void trace_event(const char *name, int type)
+{
+    struct TraceBuffer *buffer;
+    struct TraceEvent *event;
+
+    if (g_trace_state == TRACE_STATE_UNINITIALIZED)
+    {
+        trace_init_from_env();
+    }
+
+    if (g_trace_state != TRACE_STATE_ON)
+    {
+        return;
+    }
+
+    buffer = trace_get_buffer();
+    if (buffer == NULL)
+    {
+        return;
+    }
+
+    event = &buffer->events[buffer->count & (TRACE_RING_BUFFER_LEN - 1)];
+    event->timestamp = trace_now();
+    event->name = name;
+    event->type = type;
+
+    buffer->count++;
+}
+
+/**
+ * Writes all recorded events in Chrome trace event format.
+ * Recording is paused while writing.
+ * @param fp: output file.
+*/
+void trace_write_chrome_json(FILE *fp)
+{
+    struct TraceBuffer *buffer;
+    int previous_state;
+    int first = 1;
+    int pid = (int)getpid();
+
+    trace_disable(&previous_state);
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+
+    pthread_mutex_lock(&trace_mutex);
+
+    for (buffer = trace_buffers; buffer != NULL; buffer = buffer->next)
+    {
+        uint64_t i = buffer->count > TRACE_RING_BUFFER_LEN ? buffer->count - TRACE_RING_BUFFER_LEN : 0;
+
+        for (; i<buffer->count; i++)
+        {
+            struct TraceEvent *event = &buffer->events[i & (TRACE_RING_BUFFER_LEN - 1)];
+            uint64_t ts = event->timestamp > trace_start_time ? event->timestamp - trace_start_time : 0;
+
+            fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d}",
+                first ? "" : ",\n",
+                event->name,
+                event->type == TRACE_EVENT_ENTER ? "B" : "E",
+                (double)ts / 1000.0,
+                pid,
+                buffer->thread_id);
+
+            first = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&trace_mutex);
+
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+    g_trace_state = previous_state;
+}
+
+/**
+ * Writes all recorded events as folded stacks: one line per unique call stack,
+ * frames separated by semicolon, followed by total self time in microseconds.
+ * Calls from all threads are merged. Recording is paused while writing.
+ * @param fp: output file.
+*/
+void trace_write_folded(FILE *fp)
+{
+    struct TraceBuffer *buffer;
+    struct TraceStackNode *nodes;
+    int num_nodes = 1;
+    int max_nodes = 1024;
+    int previous_state;
+    int i;
+
+    trace_disable(&previous_state);
+
+    nodes = (struct TraceStackNode *)calloc((size_t)max_nodes, sizeof(struct TraceStackNode));
+    if (nodes == NULL)
+    {
+        g_trace_state = previous_state;
+        return;
+    }
+
+    // node zero is the root, above any function.
+    nodes[0].parent = -1;
+    nodes[0].first_child = -1;
+    nodes[0].next_sibling = -1;
+
+    pthread_mutex_lock(&trace_mutex);
+
+    for (buffer = trace_buffers; buffer != NULL; buffer = buffer->next)
+    {
+        trace_fold_buffer(buffer, &nodes, &num_nodes, &max_nodes);
+    }
+
+    pthread_mutex_unlock(&trace_mutex);
+
+    for (i=1; i<num_nodes; i++)
+    {
+        uint64_t usec = nodes[i].self_time / 1000;
+
+        if (usec > 0)
+        {
+            TraceStackNode_fprint_stack(fp, nodes, i);
+            fprintf(fp, " %llu\n", (unsigned long long)usec);
+        }
+    }
+
+    free(nodes);
+
+    g_trace_state = previous_state;
+}
+
+/**
+ * Frees all recorded events. Threads that record new events will allocate a new buffer.
+ * Should only be called when no other threads are recording.
+*/
+void trace_reset(void)
+{
+    struct TraceBuffer *buffer;
+    int previous_state;
+
+    trace_disable(&previous_state);
+
+    pthread_once(&trace_key_once, trace_create_key);
+
+    pthread_mutex_lock(&trace_mutex);
+
+    buffer = trace_buffers;
+    while (buffer != NULL)
+    {
+        struct TraceBuffer *next = buffer->next;
+
+        free(buffer->events);
+        free(buffer);
+
+        buffer = next;
+    }
+
+    trace_buffers = NULL;
+    trace_next_thread_id = 0;
+
+    // current thread reference is now invalid. Other threads
+    // are expected to have exited.
+    pthread_setspecific(trace_buffer_key, NULL);
+
+    pthread_mutex_unlock(&trace_mutex);
+
+    g_trace_state = previous_state;
+}
+
+/**
+ * Gets monotonic time.
+ * @returns: time in nanoseconds.
+*/
+static uint64_t trace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * pthread_once callback, creates the thread local buffer key.
+*/
+static void trace_create_key(void)
+{
+    pthread_key_create(&trace_buffer_key, NULL);
+}
+
+/**
+ * Checks environment variable on first traced call, and starts tracing if set.
+*/
+static void trace_init_from_env(void)
+{
+    const char *filename;
+    int format = TRACE_FORMAT_CHROME_JSON;
+    size_t len;
+    size_t ext_len = strlen(TRACE_FOLDED_EXTENSION);
+
+    pthread_mutex_lock(&trace_mutex);
+
+    if (g_trace_state != TRACE_STATE_UNINITIALIZED)
+    {
+        // another thread got here first.
+        pthread_mutex_unlock(&trace_mutex);
+        return;
+    }
+
+    filename = getenv(TRACE_ENV_VAR);
+
+    if (filename == NULL || filename[0] == '\0')
+    {
+        g_trace_state = TRACE_STATE_OFF;
+        pthread_mutex_unlock(&trace_mutex);
+        return;
+    }
+
+    pthread_mutex_unlock(&trace_mutex);
+
+    len = strlen(filename);
+    if (len >= ext_len && strcmp(&filename[len - ext_len], TRACE_FOLDED_EXTENSION) == 0)
+    {
+        format = TRACE_FORMAT_FOLDED;
+    }
+
+    trace_start(filename, format);
+}
+
+/**
+ * atexit callback, writes output file.
+*/
+static void trace_atexit(void)
+{
+    if (g_trace_state == TRACE_STATE_ON)
+    {
+        trace_stop();
+    }
+}
+
+/**
+ * Gets the ring buffer for the current thread, allocating and registering one if needed.
+ * @returns: buffer, or NULL if out of memory.
+*/
+static struct TraceBuffer *trace_get_buffer(void)
+{
+    struct TraceBuffer *buffer;
+
+    pthread_once(&trace_key_once, trace_create_key);
+
+    buffer = (struct TraceBuffer *)pthread_getspecific(trace_buffer_key);
+    if (buffer != NULL)
+    {
+        return buffer;
+    }
+
+    buffer = (struct TraceBuffer *)calloc(1, sizeof(struct TraceBuffer));
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+
+    buffer->events = (struct TraceEvent *)calloc(TRACE_RING_BUFFER_LEN, sizeof(struct TraceEvent));
+    if (buffer->events == NULL)
+    {
+        free(buffer);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&trace_mutex);
+
+    buffer->thread_id = trace_next_thread_id++;
+    buffer->next = trace_buffers;
+    trace_buffers = buffer;
+
+    pthread_mutex_unlock(&trace_mutex);
+
+    pthread_setspecific(trace_buffer_key, buffer);
+
+    return buffer;
+}
+
+/**
+ * Pauses recording.
+ * @param previous_state: out parameter. State before pausing, to restore later.
+*/
+static void trace_disable(int *previous_state)
+{
+    *previous_state = g_trace_state;
+
+    if (*previous_state == TRACE_STATE_UNINITIALIZED)
+    {
+        // don't want to check env var after export.
+        *previous_state = TRACE_STATE_OFF;
+    }
+
+    g_trace_state = TRACE_STATE_OFF;
+}
+
+/**
+ * Finds the call tree node for a function called from parent, adding a new node if needed.
+ * @param nodes: in/out parameter. Node array, may be reallocated.
+ * @param num_nodes: in/out parameter. Number of nodes in use.
+ * @param max_nodes: in/out parameter. Number of nodes allocated.
+ * @param parent: parent node index.
+ * @param name: function name.
+ * @returns: node index, or -1 if out of memory.
+*/
+static int TraceStackNode_get_child(struct TraceStackNode **nodes, int *num_nodes, int *max_nodes, int parent, const char *name)
+{
+    struct TraceStackNode *node;
+    int child = (*nodes)[parent].first_child;
+
+    while (child >= 0)
+    {
+        if ((*nodes)[child].name == name || strcmp((*nodes)[child].name, name) == 0)
+        {
+            return child;
+        }
+
+        child = (*nodes)[child].next_sibling;
+    }
+
+    if (*num_nodes == *max_nodes)
+    {
+        struct TraceStackNode *resized = (struct TraceStackNode *)realloc(*nodes, (size_t)(*max_nodes) * 2 * sizeof(struct TraceStackNode));
+
+        if (resized == NULL)
+        {
+            return -1;
+        }
+
+        *nodes = resized;
+        *max_nodes *= 2;
+    }
+
+    child = *num_nodes;
+    (*num_nodes)++;
+
+    node = &(*nodes)[child];
+    node->name = name;
+    node->parent = parent;
+    node->first_child = -1;
+    node->next_sibling = (*nodes)[parent].first_child;
+    node->self_time = 0;
+
+    (*nodes)[parent].first_child = child;
+
+    return child;
+}
+
+/**
+ * Prints call stack of node, root first, separated by semicolon.
+ * @param fp: output file.
+ * @param nodes: node array.
+ * @param node: node index.
+*/
+static void TraceStackNode_fprint_stack(FILE *fp, struct TraceStackNode *nodes, int node)
+{
+    if (nodes[node].parent > 0)
+    {
+        TraceStackNode_fprint_stack(fp, nodes, nodes[node].parent);
+        fputc(';', fp);
+    }
+
+    fputs(nodes[node].name, fp);
+}
+
+/**
+ * Adds self time of each call in the buffer to the call tree.
+ * Leave events without a matching enter (e.g., enter was overwritten in the ring buffer) are ignored.
+ * If a function returned without a leave event, it is closed when its caller leaves.
+ * @param buffer: thread buffer.
+ * @param nodes: in/out parameter. Node array, may be reallocated.
+ * @param num_nodes: in/out parameter. Number of nodes in use.
+ * @param max_nodes: in/out parameter. Number of nodes allocated.
+*/
+static void trace_fold_buffer(struct TraceBuffer *buffer, struct TraceStackNode **nodes, int *num_nodes, int *max_nodes)
+{
+    struct TraceStackFrame stack[TRACE_MAX_STACK_DEPTH];
+    int depth = 0;
+    int overflow = 0;
+    uint64_t last_timestamp = 0;
+    uint64_t i = buffer->count > TRACE_RING_BUFFER_LEN ? buffer->count - TRACE_RING_BUFFER_LEN : 0;
+
+    for (; i<buffer->count; i++)
+    {
+        struct TraceEvent *event = &buffer->events[i & (TRACE_RING_BUFFER_LEN - 1)];
+        int match;
+
+        last_timestamp = event->timestamp;
+
+        if (event->type == TRACE_EVENT_ENTER)
+        {
+            int parent = depth > 0 ? stack[depth - 1].node : 0;
+            int node;
+
+            if (depth == TRACE_MAX_STACK_DEPTH || overflow > 0)
+            {
+                overflow++;
+                continue;
+            }
+
+            node = TraceStackNode_get_child(nodes, num_nodes, max_nodes, parent, event->name);
+            if (node < 0)
+            {
+                return;
+            }
+
+            stack[depth].node = node;
+            stack[depth].start = event->timestamp;
+            stack[depth].child_time = 0;
+            depth++;
+
+            continue;
+        }
+
+        if (overflow > 0)
+        {
+            overflow--;
+            continue;
+        }
+
+        // find the matching enter, closing any calls above it.
+        match = depth - 1;
+        while (match >= 0 && strcmp((*nodes)[stack[match].node].name, event->name) != 0)
+        {
+            match--;
+        }
+
+        if (match < 0)
+        {
+            continue;
+        }
+
+        while (depth > match)
+        {
+            struct TraceStackFrame *frame = &stack[depth - 1];
+            uint64_t duration = event->timestamp - frame->start;
+
+            (*nodes)[frame->node].self_time += duration > frame->child_time ? duration - frame->child_time : 0;
+
+            depth--;
+
+            if (depth > 0)
+            {
+                stack[depth - 1].child_time += duration;
+            }
+        }
+    }
+
+    // close calls still open when tracing stopped.
+    while (depth > 0)
+    {
+        struct TraceStackFrame *frame = &stack[depth - 1];
+        uint64_t duration = last_timestamp - frame->start;
+
+        (*nodes)[frame->node].self_time += duration > frame->child_time ? duration - frame->child_time : 0;
+
+        depth--;
+
+        if (depth > 0)
+        {
+            stack[depth - 1].child_time += duration;
+        }
+    }
+}
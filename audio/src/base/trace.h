@@ -0,0 +1,136 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#ifndef _GAUDIO_TRACE_H_
+#define _GAUDIO_TRACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * This file contains structs and defines for recording function enter/leave
+ * events. See debug.h for how this is enabled.
+*/
+
+/**
+ * Number of events kept per thread. When the buffer is full the oldest
+ * events are overwritten. Must be a power of two.
+*/
+#define TRACE_RING_BUFFER_LEN (1 << 20)
+
+/**
+ * Max call depth tracked when building folded stacks.
+*/
+#define TRACE_MAX_STACK_DEPTH 256
+
+/**
+ * Environment variable with output filename. If set, tracing starts on
+ * the first traced function call and the file is written at exit.
+*/
+#define TRACE_ENV_VAR "GAUDIO_TRACE"
+
+/**
+ * Output filenames ending with this extension are written as folded stacks,
+ * anything else is written as Chrome trace event JSON.
+*/
+#define TRACE_FOLDED_EXTENSION ".folded"
+
+enum TRACE_STATE {
+    /**
+     * Not recording. This is the only state checked on the fast path.
+    */
+    TRACE_STATE_OFF = 0,
+
+    /**
+     * Environment hasn't been checked yet.
+    */
+    TRACE_STATE_UNINITIALIZED,
+
+    TRACE_STATE_ON
+};
+
+enum TRACE_EVENT_TYPE {
+    TRACE_EVENT_ENTER = 0,
+    TRACE_EVENT_LEAVE
+};
+
+enum TRACE_OUTPUT_FORMAT {
+    /**
+     * Chrome trace event format, load in chrome://tracing or Perfetto.
+    */
+    TRACE_FORMAT_CHROME_JSON = 0,
+
+    /**
+     * One line per unique call stack with total self time in microseconds,
+     * input for flamegraph.pl.
+    */
+    TRACE_FORMAT_FOLDED
+};
+
+/**
+ * Single recorded event.
+*/
+struct TraceEvent {
+    /**
+     * Monotonic clock, nanoseconds.
+    */
+    uint64_t timestamp;
+
+    /**
+     * Function name. Not copied, must be a string literal (e.g., __func__).
+    */
+    const char *name;
+
+    /**
+     * {@code enum TRACE_EVENT_TYPE}.
+    */
+    int type;
+};
+
+/**
+ * Per thread event ring buffer.
+*/
+struct TraceBuffer {
+    /**
+     * Sequential id assigned when the thread records its first event.
+    */
+    int thread_id;
+
+    /**
+     * Total number of events recorded. Next write is at {@code count % TRACE_RING_BUFFER_LEN}.
+    */
+    uint64_t count;
+
+    struct TraceEvent *events;
+
+    /**
+     * Next registered buffer.
+    */
+    struct TraceBuffer *next;
+};
+
+extern volatile int g_trace_state;
+
+void trace_start(const char *filename, int format);
+void trace_stop(void);
+void trace_event(const char *name, int type);
+
+void trace_write_chrome_json(FILE *fp);
+void trace_write_folded(FILE *fp);
+void trace_reset(void);
+
+#endif
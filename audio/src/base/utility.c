@@ -24,6 +24,28 @@
 #include "common.h"
 #include "utility.h"
 #include "llist.h"
+#include "gaudio_error.h"
+
+/**
+ * x86 byte shuffle kernels are compiled with target attributes and selected
+ * at runtime, so they are used without building for a specific CPU.
+*/
+#if !defined(__sgi) && (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#  define BSWAP_BLOCK_X86 1
+#  include <immintrin.h>
+#endif
+
+#if defined(BSWAP_BLOCK_X86)
+#  define BSWAP_CPU_UNKNOWN -1
+#  define BSWAP_CPU_SCALAR   0
+#  define BSWAP_CPU_SSSE3    1
+#  define BSWAP_CPU_AVX2     2
+
+/**
+ * Cached result of {@code bswap_cpu_level}.
+*/
+static int _bswap_cpu_level = BSWAP_CPU_UNKNOWN;
+#endif
 
 /**
  * This file contains miscellaneous / common / utility functions.
@@ -33,6 +55,23 @@
  * - memory / bit manipulation
 */
 
+// forward declarations
+
+static uint8_t *FileInfo_write_buffer_reserve(struct FileInfo *fi, size_t num_bytes);
+static void FileInfo_write_buffer_flush(struct FileInfo *fi);
+static void FileInfo_error_cleanup(void *resource);
+static size_t bswap16_block(uint8_t *dest, const uint8_t *src, size_t num);
+static size_t bswap32_block(uint8_t *dest, const uint8_t *src, size_t num);
+#if defined(BSWAP_BLOCK_X86)
+static int bswap_cpu_level(void);
+static size_t bswap16_block_ssse3(uint8_t *dest, const uint8_t *src, size_t num);
+static size_t bswap16_block_avx2(uint8_t *dest, const uint8_t *src, size_t num);
+static size_t bswap32_block_ssse3(uint8_t *dest, const uint8_t *src, size_t num);
+static size_t bswap32_block_avx2(uint8_t *dest, const uint8_t *src, size_t num);
+#endif
+
+// end forward declarations
+
 /**
  * Write printf formatted text to stderr then exit with code.
  * @param exit_code: application exit code
@@ -41,6 +80,12 @@
 void stderr_exit(int exit_code, const char *format, ...)
 {
     va_list args;
+
+    // returns to gaudio_try instead, if active.
+    va_start(args, format);
+    gaudio_error_vraise(exit_code, format, args);
+    va_end(args);
+
     va_start(args, format);
     vfprintf(stderr, format, args);
     va_end(args);
@@ -117,11 +162,29 @@ void *malloc_zero(size_t count, size_t item_size)
     }
     memset(outp, 0, malloc_size);
 
+    gaudio_error_track(outp, free);
+
     TRACE_LEAVE(__func__)
 
     return outp;
 }
 
+/**
+ * Same as {@code free}. Memory from {@code malloc_zero} is tracked while {@code gaudio_try}
+ * is active, library code frees through this so memory released during the call
+ * isn't released again on error (see gaudio_error.h).
+ * @param ptr: memory to free.
+*/
+void gaudio_free(void *ptr)
+{
+    if (ptr != NULL)
+    {
+        gaudio_error_untrack(ptr);
+    }
+
+    free(ptr);
+}
+
 /**
  * Changes allocation for a previously allocated chunk.
  * The lesser of {@code old_size} and {@code new_size} bytes
@@ -160,7 +223,7 @@ void malloc_resize(size_t old_size, void **ref, size_t new_size)
 
     temp = malloc_zero(1, new_size);
     memcpy(temp, *ref, lesser);
-    free(*ref);
+    gaudio_free(*ref);
 
     *ref = temp;
 
@@ -376,9 +439,8 @@ size_t get_file_contents(char *path, uint8_t **buffer)
 
     if (fseek(input, 0, SEEK_END) != 0)
     {
-        fflush_printf(stderr, "%s %d> error attempting to seek to end of file %s\n", __func__, __LINE__, path);
         fclose(input);
-        exit(EXIT_CODE_IO);
+        stderr_exit(EXIT_CODE_IO, "%s %d> error attempting to seek to end of file %s\n", __func__, __LINE__, path);
     }
 
     input_filesize = ftell(input);
@@ -390,16 +452,14 @@ size_t get_file_contents(char *path, uint8_t **buffer)
 
     if(fseek(input, 0, SEEK_SET) != 0)
     {
-        fflush_printf(stderr, "%s %d> error attempting to seek to beginning of file %s\n", __func__, __LINE__, path);
         fclose(input);
-        exit(EXIT_CODE_IO);
+        stderr_exit(EXIT_CODE_IO, "%s %d> error attempting to seek to beginning of file %s\n", __func__, __LINE__, path);
     }
 
     if (input_filesize > MAX_INPUT_FILESIZE)
     {
-        fflush_printf(stderr, "%s %d> error, filesize=%ld is larger than max supported=%d\n", __func__, __LINE__, input_filesize, MAX_INPUT_FILESIZE);
         fclose(input);
-        exit(EXIT_CODE_IO);
+        stderr_exit(EXIT_CODE_IO, "%s %d> error, filesize=%ld is larger than max supported=%d\n", __func__, __LINE__, input_filesize, MAX_INPUT_FILESIZE);
     }
 
     *buffer = (uint8_t *)malloc_zero(1, input_filesize);
@@ -407,9 +467,8 @@ size_t get_file_contents(char *path, uint8_t **buffer)
     f_result = fread((void *)*buffer, 1, input_filesize, input);
     if(f_result != input_filesize || ferror(input))
     {
-        fflush_printf(stderr, "%s %d> error reading file [%s], expected to read %ld bytes, but read %ld\n", __func__, __LINE__, path, input_filesize, f_result);
-		fclose(input);
-        exit(EXIT_CODE_IO);
+        fclose(input);
+		stderr_exit(EXIT_CODE_IO, "%s %d> error reading file [%s], expected to read %ld bytes, but read %ld\n", __func__, __LINE__, path, input_filesize, f_result);
     }
 
     // done with input file, it's in memory now.
@@ -489,11 +548,13 @@ struct FileInfo *FileInfo_fopen(char *filename, const char *mode)
 
     fi->_fp_state = 1;
 
+    // filename is released along with fi.
+    gaudio_error_untrack(fi->filename);
+    gaudio_error_track(fi, FileInfo_error_cleanup);
+
     if(fseek(fi->fp, 0, SEEK_END) != 0)
     {
-        fflush_printf(stderr, "%s %d> error attempting to seek to end of file %s\n", __func__, __LINE__, filename);
-        fclose(fi->fp);
-        exit(EXIT_CODE_IO);
+        stderr_exit(EXIT_CODE_IO, "%s %d> error attempting to seek to end of file %s\n", __func__, __LINE__, filename);
     }
 
     if (g_verbosity > 2)
@@ -510,23 +571,142 @@ struct FileInfo *FileInfo_fopen(char *filename, const char *mode)
 
     if(fseek(fi->fp, 0, SEEK_SET) != 0)
     {
-        fflush_printf(stderr, "%s %d> error attempting to seek to beginning of file %s\n", __func__, __LINE__, fi->filename);
-        fclose(fi->fp);
-        exit(EXIT_CODE_IO);
+        stderr_exit(EXIT_CODE_IO, "%s %d> error attempting to seek to beginning of file %s\n", __func__, __LINE__, fi->filename);
     }
 
     if (fi->len > MAX_INPUT_FILESIZE)
     {
-        fflush_printf(stderr, "%s %d> error, filesize=%ld is larger than max supported=%d\n", __func__, __LINE__, fi->len, MAX_INPUT_FILESIZE);
-        fclose(fi->fp);
-        exit(EXIT_CODE_GENERAL);
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> error, filesize=%ld is larger than max supported=%d\n", __func__, __LINE__, fi->len, MAX_INPUT_FILESIZE);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return fi;
+}
+
+/**
+ * Opens a read only {@code struct FileInfo} on a memory buffer, so anything that
+ * parses from a FileInfo can parse from memory instead.
+ * @param data: buffer to read. Not copied, must remain valid until the FileInfo is closed.
+ * @param len: length of buffer in bytes.
+ * @returns: pointer to new FileInfo. Filename is set to {@code FILEINFO_MEMORY_FILENAME}.
+*/
+struct FileInfo *FileInfo_fmemopen(const uint8_t *data, size_t len)
+{
+    TRACE_ENTER(__func__)
+
+    if (data == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> data is NULL\n", __func__, __LINE__);
+    }
+
+    if (len == 0)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> error, buffer is empty\n", __func__, __LINE__);
+    }
+
+    if (len > MAX_INPUT_FILESIZE)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> error, buffer len=%ld is larger than max supported=%d\n", __func__, __LINE__, len, MAX_INPUT_FILESIZE);
+    }
+
+    struct FileInfo *fi = (struct FileInfo *)malloc_zero(1, sizeof(struct FileInfo));
+
+    fi->filename = (char *)malloc_zero(1, sizeof(FILEINFO_MEMORY_FILENAME));
+    strcpy(fi->filename, FILEINFO_MEMORY_FILENAME);
+
+    // fmemopen doesn't write to the buffer in read mode.
+    fi->fp = fmemopen((void *)data, len, "rb");
+    if (fi->fp == NULL)
+    {
+        stderr_exit(EXIT_CODE_IO, "%s %d> Cannot open memory buffer\n", __func__, __LINE__);
     }
 
+    fi->len = len;
+    fi->_fp_state = 1;
+
+    // filename is released along with fi.
+    gaudio_error_untrack(fi->filename);
+    gaudio_error_track(fi, FileInfo_error_cleanup);
+
     TRACE_LEAVE(__func__)
 
     return fi;
 }
 
+/**
+ * Opens a write only {@code struct FileInfo} that collects output in a memory
+ * buffer instead of a file. Use {@code FileInfo_memstream_take} to get the result.
+ * @returns: pointer to new FileInfo. Filename is set to {@code FILEINFO_MEMORY_FILENAME}.
+*/
+struct FileInfo *FileInfo_open_memstream(void)
+{
+    TRACE_ENTER(__func__)
+
+    struct FileInfo *fi = (struct FileInfo *)malloc_zero(1, sizeof(struct FileInfo));
+
+    fi->filename = (char *)malloc_zero(1, sizeof(FILEINFO_MEMORY_FILENAME));
+    strcpy(fi->filename, FILEINFO_MEMORY_FILENAME);
+
+    fi->fp = open_memstream(&fi->_memstream_buffer, &fi->_memstream_len);
+    if (fi->fp == NULL)
+    {
+        stderr_exit(EXIT_CODE_IO, "%s %d> Cannot open memory stream\n", __func__, __LINE__);
+    }
+
+    fi->_fp_state = 1;
+
+    // filename is released along with fi.
+    gaudio_error_untrack(fi->filename);
+    gaudio_error_track(fi, FileInfo_error_cleanup);
+
+    TRACE_LEAVE(__func__)
+
+    return fi;
+}
+
+/**
+ * Closes a FileInfo opened with {@code FileInfo_open_memstream} and hands
+ * the written data to the caller. The FileInfo must still be freed.
+ * @param fi: FileInfo.
+ * @param buffer: out parameter. Will contain written data. Caller is responsible for freeing memory.
+ * @returns: number of bytes written.
+*/
+size_t FileInfo_memstream_take(struct FileInfo *fi, uint8_t **buffer)
+{
+    TRACE_ENTER(__func__)
+
+    if (fi == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> error, fi is NULL\n", __func__, __LINE__);
+    }
+
+    if (buffer == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> error, buffer is NULL\n", __func__, __LINE__);
+    }
+
+    size_t len;
+
+    // the buffer and length are only updated by flush or close.
+    FileInfo_fclose(fi);
+
+    if (fi->_memstream_buffer == NULL)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> error, fi is not a memory stream\n", __func__, __LINE__);
+    }
+
+    *buffer = (uint8_t *)fi->_memstream_buffer;
+    len = fi->_memstream_len;
+
+    fi->_memstream_buffer = NULL;
+    fi->_memstream_len = 0;
+
+    TRACE_LEAVE(__func__)
+
+    return len;
+}
+
 /**
  * struct FileInfo wrapper to fread.
  * @param fi: FileInfo.
@@ -561,13 +741,13 @@ size_t FileInfo_fread(struct FileInfo *fi, void *output_buffer, size_t size, siz
         stderr_exit(EXIT_CODE_IO, "%s %d> fi->fp not valid\n", __func__, __LINE__);
     }
 
+    FileInfo_write_buffer_flush(fi);
+
     size_t f_result = fread((void *)output_buffer, size, n, fi->fp);
     
     if(f_result != n || ferror(fi->fp))
     {
-        fflush_printf(stderr, "%s %d> error reading file [%s], expected to read %ld elements, but read %ld\n", __func__, __LINE__, fi->filename, n, f_result);
-		fclose(fi->fp);
-        exit(EXIT_CODE_IO);
+        stderr_exit(EXIT_CODE_IO, "%s %d> error reading file [%s], expected to read %ld elements, but read %ld\n", __func__, __LINE__, fi->filename, n, f_result);
     }
 
     TRACE_LEAVE(__func__)
@@ -596,14 +776,14 @@ int FileInfo_fseek(struct FileInfo *fi, long __off, int __whence)
         stderr_exit(EXIT_CODE_GENERAL, "%s %d> error, fi->fp not valid\n", __func__, __LINE__);
     }
 
+    FileInfo_write_buffer_flush(fi);
+
     int ret = fseek(fi->fp, __off, __whence);
 
     if (ret != 0)
     {
         int fseek_errno = errno;
-        fflush_printf(stderr, "%s %d> error attempting to seek file %s, offset=%ld, whence=%d, return=%d, errno=%d\n", __func__, __LINE__, fi->filename, __off, __whence, ret, fseek_errno);
-        fclose(fi->fp);
-        exit(EXIT_CODE_IO);
+        stderr_exit(EXIT_CODE_IO, "%s %d> error attempting to seek file %s, offset=%ld, whence=%d, return=%d, errno=%d\n", __func__, __LINE__, fi->filename, __off, __whence, ret, fseek_errno);
     }
 
     TRACE_LEAVE(__func__)
@@ -630,6 +810,8 @@ long FileInfo_ftell(struct FileInfo *fi)
         stderr_exit(EXIT_CODE_GENERAL, "%s %d> error, fi->fp not valid\n", __func__, __LINE__);
     }
 
+    FileInfo_write_buffer_flush(fi);
+
     long ret = ftell(fi->fp);
 
     TRACE_LEAVE(__func__)
@@ -639,6 +821,7 @@ long FileInfo_ftell(struct FileInfo *fi)
 
 /**
  * struct FileInfo wrapper to fwrite.
+ * Small writes are collected in the write buffer, large writes go straight to the file.
  * @param fi: FileInfo.
  * @param data: data to write.
  * @param size: size of each element to write.
@@ -669,13 +852,24 @@ size_t FileInfo_fwrite(struct FileInfo *fi, const void *data, size_t size, size_
         stderr_exit(EXIT_CODE_GENERAL, "%s %d> element size is zero.\n", __func__, __LINE__);
     }
 
+    if (num_bytes < FILEINFO_WRITE_BUFFER_LEN)
+    {
+        uint8_t *dest = FileInfo_write_buffer_reserve(fi, num_bytes);
+        memcpy(dest, data, num_bytes);
+        fi->_write_buffer_pos += num_bytes;
+
+        TRACE_LEAVE(__func__)
+        return num_bytes;
+    }
+
+    // keep file order, anything pending goes first.
+    FileInfo_write_buffer_flush(fi);
+
     ret = fwrite(data, size, n, fi->fp);
     
     if (ret != n || ferror(fi->fp))
     {
-        fflush_printf(stderr, "%s %d> error writing to file, expected to write %ld elements, but wrote %ld\n", __func__, __LINE__, n, ret);
-		fclose(fi->fp);
-        exit(EXIT_CODE_IO);
+        stderr_exit(EXIT_CODE_IO, "%s %d> error writing to file, expected to write %ld elements, but wrote %ld\n", __func__, __LINE__, n, ret);
     }
 
     TRACE_LEAVE(__func__)
@@ -698,9 +892,7 @@ size_t FileInfo_fwrite_bswap(struct FileInfo *fi, const void *data, size_t size,
 {
     TRACE_ENTER(__func__)
     
-    size_t i;
     size_t ret = 0;
-    size_t f_result = 0;
 
     if (fi == NULL)
     {
@@ -712,52 +904,36 @@ size_t FileInfo_fwrite_bswap(struct FileInfo *fi, const void *data, size_t size,
         stderr_exit(EXIT_CODE_IO, "%s %d> error, fi->fp not valid\n", __func__, __LINE__);
     }
 
-    if (size == 2)
+    if (size == 2 || size == 4)
     {
-        for (i=0; i<n; i++)
+        const uint8_t *src = (const uint8_t *)data;
+        size_t max_elements = FILEINFO_WRITE_BUFFER_LEN / size;
+
+        // swap directly into the write buffer, one buffer length at a time.
+        while (n > 0)
         {
-            uint16_t b16 = BSWAP16_INLINE(((uint16_t*)data)[i]);
-            f_result = fwrite(&b16, size, 1, fi->fp);
+            size_t chunk = n < max_elements ? n : max_elements;
+            size_t chunk_bytes = chunk * size;
+            uint8_t *dest = FileInfo_write_buffer_reserve(fi, chunk_bytes);
 
-            if (f_result != 1 || ferror(fi->fp))
+            if (size == 2)
             {
-                fflush_printf(stderr, "%s %d> error writing to file, expected to write 1 element, but wrote %ld\n", __func__, __LINE__, f_result);
-                fclose(fi->fp);
-                exit(EXIT_CODE_IO);
+                bswap16_chunk(dest, src, chunk);
             }
-
-            ret += size;
-        }
-    }
-    else if (size == 4)
-    {
-        for (i=0; i<n; i++)
-        {
-            uint32_t b32 = BSWAP32_INLINE(((uint32_t*)data)[i]);
-            f_result = fwrite(&b32, size, 1, fi->fp);
-
-            if (f_result != 1 || ferror(fi->fp))
+            else
             {
-                fflush_printf(stderr, "%s %d> error writing to file, expected to write 1 element, but wrote %ld\n", __func__, __LINE__, 1, f_result);
-                fclose(fi->fp);
-                exit(EXIT_CODE_IO);
+                bswap32_chunk(dest, src, chunk);
             }
 
-            ret += size;
+            fi->_write_buffer_pos += chunk_bytes;
+            src += chunk_bytes;
+            n -= chunk;
+            ret += chunk_bytes;
         }
     }
     else
     {
-        f_result = fwrite(data, size, n, fi->fp);
-
-        if (f_result != n || ferror(fi->fp))
-        {
-            fflush_printf(stderr, "%s %d> error writing to file, expected to write %ld elements, but wrote %ld\n", __func__, __LINE__, n, f_result);
-            fclose(fi->fp);
-            exit(EXIT_CODE_IO);
-        }
-
-        ret += (size * n);
+        ret = FileInfo_fwrite(fi, data, size, n);
     }
 
     TRACE_LEAVE(__func__)
@@ -765,6 +941,30 @@ size_t FileInfo_fwrite_bswap(struct FileInfo *fi, const void *data, size_t size,
     return ret;
 }
 
+/**
+ * Writes any pending buffered data to the file, then calls fflush on the file handle.
+ * @param fi: FileInfo.
+*/
+void FileInfo_fflush(struct FileInfo *fi)
+{
+    TRACE_ENTER(__func__)
+
+    if (fi == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> error, fi is NULL\n", __func__, __LINE__);
+    }
+
+    if (fi->_fp_state != 1)
+    {
+        stderr_exit(EXIT_CODE_IO, "%s %d> error, fi->fp not valid\n", __func__, __LINE__);
+    }
+
+    FileInfo_write_buffer_flush(fi);
+    fflush(fi->fp);
+
+    TRACE_LEAVE(__func__)
+}
+
 /**
  * struct FileInfo wrapper to fclose.
  * @param fi: FileInfo.
@@ -783,10 +983,17 @@ int FileInfo_fclose(struct FileInfo *fi)
 
     if (fi->_fp_state == 1)
     {
+        FileInfo_write_buffer_flush(fi);
         ret = fclose(fi->fp);
         fi->_fp_state = 0;
     }
 
+    if (fi->_write_buffer != NULL)
+    {
+        gaudio_free(fi->_write_buffer);
+        fi->_write_buffer = NULL;
+    }
+
     TRACE_LEAVE(__func__)
 
     return ret;
@@ -808,19 +1015,40 @@ void FileInfo_free(struct FileInfo *fi)
         return;
     }
 
-    if (fi->filename != NULL)
+    // Write pending data and close before releasing anything, a write error
+    // reports the filename, and under gaudio_try releases fi through FileInfo_error_cleanup.
+    if (fi->_fp_state == 1)
     {
-        // Filename was malloc'd and copied when FileInfo first created.
-        free(fi->filename);
+        int f_result;
+
+        FileInfo_write_buffer_flush(fi);
+        f_result = fclose(fi->fp);
+        fi->_fp_state = 0;
+
+        if (f_result != 0)
+        {
+            stderr_exit(EXIT_CODE_IO, "%s %d> error closing file [%s]\n", __func__, __LINE__, fi->filename);
+        }
     }
 
-    if (fi->_fp_state == 1)
+    if (fi->_write_buffer != NULL)
     {
-        fclose(fi->fp);
-        fi->_fp_state = 0;
+        gaudio_free(fi->_write_buffer);
     }
 
-    free(fi);
+    if (fi->_memstream_buffer != NULL)
+    {
+        // memory stream output that was never taken.
+        gaudio_free(fi->_memstream_buffer);
+    }
+
+    if (fi->filename != NULL)
+    {
+        // Filename was malloc'd and copied when FileInfo first created.
+        gaudio_free(fi->filename);
+    }
+
+    gaudio_free(fi);
 
     TRACE_LEAVE(__func__)
 }
@@ -829,6 +1057,7 @@ void FileInfo_free(struct FileInfo *fi)
  * Copies 16 bit elements from source to destination, performing
  * byte swap on each element.
  * It is safe for dest to be the same as source (probably don't overlap otherwise though).
+ * Neither needs to be aligned.
  * @param dest: destination array.
  * @param src: source array.
  * @param num: number of elements to copy and swap. (not number of bytes!)
@@ -855,28 +1084,26 @@ void bswap16_chunk(void *dest, const void *src, size_t num)
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>error, src is NULL\n", __func__, __LINE__);
     }
 
-    if (dest == src)
-    {
-        for (i=0; i<num; i++)
-        {
-            ((uint16_t*)dest)[i] = BSWAP16_INLINE(((uint16_t*)dest)[i]);
-        }
-    }
-    else
+    // bulk of the data, then any remaining elements one at a time.
+    i = bswap16_block((uint8_t *)dest, (const uint8_t *)src, num);
+
+    // memcpy, dest may be anywhere in the FileInfo write buffer and isn't always aligned.
+    for (; i<num; i++)
     {
-        for (i=0; i<num; i++)
-        {
-            ((uint16_t*)dest)[i] = BSWAP16_INLINE(((uint16_t*)src)[i]);
-        }
+        uint16_t v;
+        memcpy(&v, (const uint8_t *)src + (i * 2), 2);
+        v = BSWAP16_INLINE(v);
+        memcpy((uint8_t *)dest + (i * 2), &v, 2);
     }
 
-
     TRACE_LEAVE(__func__)
 }
 
 /**
  * Copies 32 bit elements from source to destination, performing
  * byte swap on each element.
+ * It is safe for dest to be the same as source (probably don't overlap otherwise though).
+ * Neither needs to be aligned.
  * @param dest: destination array.
  * @param src: source array.
  * @param num: number of elements to copy and swap. (not number of bytes!)
@@ -903,9 +1130,16 @@ void bswap32_chunk(void *dest, const void *src, size_t num)
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>error, src is NULL\n", __func__, __LINE__);
     }
 
-    for (i=0; i<num; i++)
+    // bulk of the data, then any remaining elements one at a time.
+    i = bswap32_block((uint8_t *)dest, (const uint8_t *)src, num);
+
+    // memcpy, dest may be anywhere in the FileInfo write buffer and isn't always aligned.
+    for (; i<num; i++)
     {
-        ((uint32_t*)dest)[i] = BSWAP32_INLINE(((uint32_t*)src)[i]);
+        uint32_t v;
+        memcpy(&v, (const uint8_t *)src + (i * 4), 4);
+        v = BSWAP32_INLINE(v);
+        memcpy((uint8_t *)dest + (i * 4), &v, 4);
     }
 
     TRACE_LEAVE(__func__)
@@ -1214,32 +1448,10 @@ void int32_to_VarLengthInt(int32_t in, struct VarLengthInt *varint)
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> varint is NULL.\n", __func__, __LINE__);
     }
 
-    int num_bytes = 0;
-
-    memset(varint->value_bytes, 0, VAR_INT_MAX_BYTES+1);
-
-    varint->standard_value = in;
+    uint8_t encoded[VAR_INT_MAX_BYTES];
+    int num_bytes = varint_write_int32(encoded, in);
 
-    do {
-        int var7bits = in & 0x7f;
-        in >>= 7;
-        // out_result |= var7bits;
-        varint->value_bytes[num_bytes] |= var7bits;
-
-        if (in > 0)
-        {
-            varint->value_bytes[num_bytes + 1] = 0x80;
-        }
-
-        num_bytes++;
-
-        if (num_bytes > VAR_INT_MAX_BYTES)
-        {
-            stderr_exit(EXIT_CODE_GENERAL, "%s %d> varint exceed available number bytes\n", __func__, __LINE__);
-        }
-    } while (in > 0);
-    
-    varint->num_bytes = num_bytes;
+    VarLengthInt_from_buffer(varint, encoded, num_bytes, in);
 
     TRACE_LEAVE(__func__)
 }
@@ -1256,9 +1468,7 @@ void VarLengthInt_value_to_int32(uint8_t *buffer, int max_bytes, struct VarLengt
     TRACE_ENTER(__func__)
 
     int32_t ret = 0;
-    int done = 0;
-    int bytes_read = 0;
-    int i;
+    int bytes_read;
 
     if (buffer == NULL)
     {
@@ -1275,36 +1485,135 @@ void VarLengthInt_value_to_int32(uint8_t *buffer, int max_bytes, struct VarLengt
         stderr_exit(EXIT_CODE_GENERAL, "%s %d>parameter error, max_bytes=%d out of range. Max supported=%d\n", __func__, __LINE__, max_bytes, VAR_INT_MAX_BYTES);
     }
 
-    while (!done && bytes_read <= max_bytes)
+    // This has always accepted one byte more than max_bytes.
+    bytes_read = varint_read_int32(buffer, (size_t)max_bytes + 1, &ret);
+
+    if (bytes_read == 0)
     {
-        int var7bits = buffer[bytes_read] & 0x7f;
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d>parse error.\n", __func__, __LINE__);
+    }
 
-        if ((buffer[bytes_read] & 0x80) == 0)
-        {
-            done = 1;
-        }
+    VarLengthInt_from_buffer(varint, buffer, bytes_read, ret);
 
-        ret <<= 7;
-        ret |= var7bits;
+    TRACE_LEAVE(__func__)
+}
 
-        bytes_read++;
-    }
+/**
+ * Sets varint from an already encoded big endian buffer. The encoded bytes
+ * are kept as is, so non-minimal encodings are preserved when written back out.
+ * @param varint: out parameter. Will set all values.
+ * @param buffer: encoded varint, most significant byte first.
+ * @param num_bytes: length in bytes of encoded varint.
+ * @param value: decoded value.
+*/
+void VarLengthInt_from_buffer(struct VarLengthInt *varint, const uint8_t *buffer, int num_bytes, int32_t value)
+{
+    TRACE_ENTER(__func__)
+
+    int i;
 
-    if (!done)
+    if (num_bytes < 1 || num_bytes > VAR_INT_MAX_BYTES)
     {
-        stderr_exit(EXIT_CODE_GENERAL, "%s %d>parse error.\n", __func__, __LINE__);
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> num_bytes=%d out of range. Max supported=%d\n", __func__, __LINE__, num_bytes, VAR_INT_MAX_BYTES);
     }
 
     memset(varint->value_bytes, 0, VAR_INT_MAX_BYTES+1);
-    for (i=0; i<bytes_read; i++)
+
+    // value_bytes index zero is least significant byte
+    for (i=0; i<num_bytes; i++)
     {
-        varint->value_bytes[bytes_read - 1 - i] = buffer[i];
+        varint->value_bytes[num_bytes - 1 - i] = buffer[i];
     }
 
-    varint->num_bytes = bytes_read;
-    varint->standard_value = ret;
+    varint->num_bytes = num_bytes;
+    varint->standard_value = value;
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Gets the number of bytes needed to encode a value as variable length integer.
+ * Each byte holds 7 bits. Zero and negative values use a single byte, the same
+ * as {@code int32_to_VarLengthInt}.
+ * @param value: value to encode.
+ * @returns: number of bytes, 1 to 5.
+*/
+int varint_length(int32_t value)
+{
+    TRACE_ENTER(__func__)
+
+    uint32_t u = value > 0 ? (uint32_t)value : 0;
+
+    int result = 1
+        + (u >= ((uint32_t)1 << 7))
+        + (u >= ((uint32_t)1 << 14))
+        + (u >= ((uint32_t)1 << 21))
+        + (u >= ((uint32_t)1 << 28));
+
+    TRACE_LEAVE(__func__)
+    return result;
+}
+
+/**
+ * Writes value as variable length integer, most significant byte first.
+ * Same bytes as {@code int32_to_VarLengthInt} followed by {@code VarLengthInt_write_value_big}.
+ * @param dest: buffer to write to. Must have room for five bytes.
+ * @param value: value to encode.
+ * @returns: number of bytes written.
+*/
+int varint_write_int32(uint8_t *dest, int32_t value)
+{
+    TRACE_ENTER(__func__)
+
+    int num_bytes = varint_length(value);
+    uint32_t u = (uint32_t)value;
+    int i;
+
+    // last byte has the low 7 bits and no continuation flag.
+    dest[num_bytes - 1] = (uint8_t)(u & 0x7f);
+
+    for (i=num_bytes - 2; i>=0; i--)
+    {
+        u >>= 7;
+        dest[i] = (uint8_t)(0x80 | (u & 0x7f));
+    }
+
+    TRACE_LEAVE(__func__)
+    return num_bytes;
+}
+
+/**
+ * Reads variable length integer, most significant byte first.
+ * @param buffer: buffer to read.
+ * @param max_bytes: max number of bytes to read from buffer.
+ * @param value: out parameter. Decoded value.
+ * @returns: number of bytes read, or zero if the varint was not terminated
+ * within {@code max_bytes}.
+*/
+int varint_read_int32(const uint8_t *buffer, size_t max_bytes, int32_t *value)
+{
+    TRACE_ENTER(__func__)
+
+    uint32_t result = 0;
+    size_t i;
+
+    for (i=0; i<max_bytes; i++)
+    {
+        uint8_t b = buffer[i];
+
+        result = (result << 7) | (b & 0x7f);
+
+        if ((b & 0x80) == 0)
+        {
+            *value = (int32_t)result;
+
+            TRACE_LEAVE(__func__)
+            return (int)(i + 1);
+        }
+    }
 
     TRACE_LEAVE(__func__)
+    return 0;
 }
 
 /**
@@ -1639,4 +1948,299 @@ long parse_int(char *buffer)
 
     TRACE_LEAVE(__func__)
     return res;
-}
\ No newline at end of file
+}
+
+/**
+ * Gets space in the write buffer for the next write. If there isn't enough room
+ * the pending data is flushed first. Caller must update {@code fi->_write_buffer_pos}
+ * with the number of bytes actually written.
+ * @param fi: FileInfo.
+ * @param num_bytes: number of bytes needed. Must not be more than {@code FILEINFO_WRITE_BUFFER_LEN}.
+ * @returns: pointer into write buffer.
+*/
+static uint8_t *FileInfo_write_buffer_reserve(struct FileInfo *fi, size_t num_bytes)
+{
+    TRACE_ENTER(__func__)
+
+    if (fi->_write_buffer == NULL)
+    {
+        fi->_write_buffer = (uint8_t *)malloc_zero(1, FILEINFO_WRITE_BUFFER_LEN);
+
+        // fi may have been opened before gaudio_try, buffer is released along with fi.
+        gaudio_error_untrack(fi->_write_buffer);
+        fi->_write_buffer_pos = 0;
+    }
+
+    if (fi->_write_buffer_pos + num_bytes > FILEINFO_WRITE_BUFFER_LEN)
+    {
+        FileInfo_write_buffer_flush(fi);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return &fi->_write_buffer[fi->_write_buffer_pos];
+}
+
+/**
+ * Writes pending data in the write buffer to the file handle.
+ * @param fi: FileInfo.
+*/
+static void FileInfo_write_buffer_flush(struct FileInfo *fi)
+{
+    TRACE_ENTER(__func__)
+
+    size_t f_result;
+
+    if (fi->_write_buffer_pos == 0)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    f_result = fwrite(fi->_write_buffer, 1, fi->_write_buffer_pos, fi->fp);
+
+    if (f_result != fi->_write_buffer_pos || ferror(fi->fp))
+    {
+        stderr_exit(EXIT_CODE_IO, "%s %d> error writing to file [%s], expected to write %ld bytes, but wrote %ld\n", __func__, __LINE__, fi->filename, fi->_write_buffer_pos, f_result);
+    }
+
+    fi->_write_buffer_pos = 0;
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Byte swaps 16 bit elements several at a time. Uses AVX2 or SSSE3 byte shuffle
+ * when the CPU supports it, otherwise swaps within 64 bit words.
+ * Source and destination may be the same; neither needs to be aligned.
+ * @param dest: destination.
+ * @param src: source.
+ * @param num: number of elements.
+ * @returns: number of elements swapped. Caller handles the remaining elements.
+*/
+static size_t bswap16_block(uint8_t *dest, const uint8_t *src, size_t num)
+{
+    TRACE_ENTER(__func__)
+
+    size_t i = 0;
+
+#if defined(__sgi)
+    // no swap needed, only copy.
+    memmove(dest, src, num * 2);
+    i = num;
+#else
+#  if defined(BSWAP_BLOCK_X86)
+    switch (bswap_cpu_level())
+    {
+        case BSWAP_CPU_AVX2:
+        i = bswap16_block_avx2(dest, src, num);
+        break;
+
+        case BSWAP_CPU_SSSE3:
+        i = bswap16_block_ssse3(dest, src, num);
+        break;
+
+        default:
+        break;
+    }
+#  endif
+
+    for (; i + 4 <= num; i += 4)
+    {
+        uint64_t v;
+        memcpy(&v, &src[i * 2], 8);
+        v = ((v & 0x00ff00ff00ff00ffULL) << 8) | ((v >> 8) & 0x00ff00ff00ff00ffULL);
+        memcpy(&dest[i * 2], &v, 8);
+    }
+#endif
+
+    TRACE_LEAVE(__func__)
+
+    return i;
+}
+
+/**
+ * Byte swaps 32 bit elements several at a time. Uses AVX2 or SSSE3 byte shuffle
+ * when the CPU supports it, otherwise swaps within 64 bit words.
+ * Source and destination may be the same; neither needs to be aligned.
+ * @param dest: destination.
+ * @param src: source.
+ * @param num: number of elements.
+ * @returns: number of elements swapped. Caller handles the remaining elements.
+*/
+static size_t bswap32_block(uint8_t *dest, const uint8_t *src, size_t num)
+{
+    TRACE_ENTER(__func__)
+
+    size_t i = 0;
+
+#if defined(__sgi)
+    // no swap needed, only copy.
+    memmove(dest, src, num * 4);
+    i = num;
+#else
+#  if defined(BSWAP_BLOCK_X86)
+    switch (bswap_cpu_level())
+    {
+        case BSWAP_CPU_AVX2:
+        i = bswap32_block_avx2(dest, src, num);
+        break;
+
+        case BSWAP_CPU_SSSE3:
+        i = bswap32_block_ssse3(dest, src, num);
+        break;
+
+        default:
+        break;
+    }
+#  endif
+
+    for (; i + 2 <= num; i += 2)
+    {
+        uint64_t v;
+        memcpy(&v, &src[i * 4], 8);
+        v = ((v & 0x00ff00ff00ff00ffULL) << 8) | ((v >> 8) & 0x00ff00ff00ff00ffULL);
+        v = ((v & 0x0000ffff0000ffffULL) << 16) | ((v >> 16) & 0x0000ffff0000ffffULL);
+        memcpy(&dest[i * 4], &v, 8);
+    }
+#endif
+
+    TRACE_LEAVE(__func__)
+
+    return i;
+}
+
+#if defined(BSWAP_BLOCK_X86)
+
+/**
+ * Checks which byte shuffle kernels the CPU supports. Checked once, then cached.
+ * @returns: {@code BSWAP_CPU_AVX2}, {@code BSWAP_CPU_SSSE3}, or {@code BSWAP_CPU_SCALAR}.
+*/
+static int bswap_cpu_level(void)
+{
+    int level = __atomic_load_n(&_bswap_cpu_level, __ATOMIC_RELAXED);
+
+    if (level == BSWAP_CPU_UNKNOWN)
+    {
+        // may be called before constructors that would otherwise do this.
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx2"))
+        {
+            level = BSWAP_CPU_AVX2;
+        }
+        else if (__builtin_cpu_supports("ssse3"))
+        {
+            level = BSWAP_CPU_SSSE3;
+        }
+        else
+        {
+            level = BSWAP_CPU_SCALAR;
+        }
+
+        __atomic_store_n(&_bswap_cpu_level, level, __ATOMIC_RELAXED);
+    }
+
+    return level;
+}
+
+/**
+ * SSSE3 part of {@code bswap16_block}, 8 elements at a time.
+*/
+__attribute__((target("ssse3")))
+static size_t bswap16_block_ssse3(uint8_t *dest, const uint8_t *src, size_t num)
+{
+    const __m128i mask128 = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    size_t i;
+
+    for (i=0; i + 8 <= num; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)&src[i * 2]);
+        _mm_storeu_si128((__m128i *)&dest[i * 2], _mm_shuffle_epi8(v, mask128));
+    }
+
+    return i;
+}
+
+/**
+ * AVX2 part of {@code bswap16_block}, 16 elements at a time. Remaining elements
+ * use the SSSE3 kernel.
+*/
+__attribute__((target("avx2")))
+static size_t bswap16_block_avx2(uint8_t *dest, const uint8_t *src, size_t num)
+{
+    const __m256i mask256 = _mm256_setr_epi8(
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    size_t i;
+
+    for (i=0; i + 16 <= num; i += 16)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&src[i * 2]);
+        _mm256_storeu_si256((__m256i *)&dest[i * 2], _mm256_shuffle_epi8(v, mask256));
+    }
+
+    return i + bswap16_block_ssse3(&dest[i * 2], &src[i * 2], num - i);
+}
+
+/**
+ * SSSE3 part of {@code bswap32_block}, 4 elements at a time.
+*/
+__attribute__((target("ssse3")))
+static size_t bswap32_block_ssse3(uint8_t *dest, const uint8_t *src, size_t num)
+{
+    const __m128i mask128 = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i;
+
+    for (i=0; i + 4 <= num; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)&src[i * 4]);
+        _mm_storeu_si128((__m128i *)&dest[i * 4], _mm_shuffle_epi8(v, mask128));
+    }
+
+    return i;
+}
+
+/**
+ * AVX2 part of {@code bswap32_block}, 8 elements at a time. Remaining elements
+ * use the SSSE3 kernel.
+*/
+__attribute__((target("avx2")))
+static size_t bswap32_block_avx2(uint8_t *dest, const uint8_t *src, size_t num)
+{
+    const __m256i mask256 = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i;
+
+    for (i=0; i + 8 <= num; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&src[i * 4]);
+        _mm256_storeu_si256((__m256i *)&dest[i * 4], _mm256_shuffle_epi8(v, mask256));
+    }
+
+    return i + bswap32_block_ssse3(&dest[i * 4], &src[i * 4], num - i);
+}
+
+#endif
+
+/**
+ * Releases {@code struct FileInfo} opened during {@code gaudio_try} that failed.
+ * Pending writes are discarded.
+ * @param resource: {@code struct FileInfo}.
+*/
+static void FileInfo_error_cleanup(void *resource)
+{
+    struct FileInfo *fi = (struct FileInfo *)resource;
+
+    if (fi->_fp_state == 1)
+    {
+        fclose(fi->fp);
+        fi->_fp_state = 0;
+    }
+
+    gaudio_free(fi->filename);
+    gaudio_free(fi->_write_buffer);
+    gaudio_free(fi->_memstream_buffer);
+    gaudio_free(fi);
+}
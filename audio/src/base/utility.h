@@ -32,6 +32,16 @@
 */
 #define VAR_INT_MAX_BYTES 8
 
+/**
+ * Size in bytes of FileInfo write staging buffer.
+*/
+#define FILEINFO_WRITE_BUFFER_LEN 0x10000
+
+/**
+ * Filename reported by FileInfo opened on memory instead of a file.
+*/
+#define FILEINFO_MEMORY_FILENAME "(memory)"
+
 /**
  * Container for file information.
 */
@@ -58,6 +68,32 @@ struct FileInfo {
      * Memory will be released once FileInfo_free is called.
     */
     char *filename;
+
+    /**
+     * Internal state, don't touch.
+     * Pending writes are collected here and passed to the file handle in large blocks.
+     * Allocated on first write, flushed before any read/seek/tell/close.
+    */
+    uint8_t *_write_buffer;
+
+    /**
+     * Internal state, don't touch.
+     * Number of bytes pending in {@code _write_buffer}.
+    */
+    size_t _write_buffer_pos;
+
+    /**
+     * Internal state, don't touch.
+     * Output buffer when opened with {@code FileInfo_open_memstream}. Only valid
+     * after the stream is closed, see {@code FileInfo_memstream_take}.
+    */
+    char *_memstream_buffer;
+
+    /**
+     * Internal state, don't touch.
+     * Length of {@code _memstream_buffer}.
+    */
+    size_t _memstream_len;
 };
 
 /**
@@ -87,6 +123,7 @@ void fflush_printf(FILE *stream, const char *format, ...);
 void fflush_string(FILE *stream, const char *str);
 
 void *malloc_zero(size_t count, size_t item_size);
+void gaudio_free(void *ptr);
 void malloc_resize(size_t old_size, void **ref, size_t new_size);
 
 int mkpath(const char* path);
@@ -100,12 +137,16 @@ size_t dynamic_buffer_memcpy(uint8_t *data, size_t data_len, uint8_t **buffer_st
 size_t get_file_contents(char *path, uint8_t **buffer);
 
 struct FileInfo *FileInfo_fopen(char *filename, const char *mode);
+struct FileInfo *FileInfo_fmemopen(const uint8_t *data, size_t len);
+struct FileInfo *FileInfo_open_memstream(void);
+size_t FileInfo_memstream_take(struct FileInfo *fi, uint8_t **buffer);
 size_t FileInfo_fread(struct FileInfo *fi, void *output_buffer, size_t size, size_t n);
 size_t FileInfo_get_file_contents(struct FileInfo *fi, uint8_t **buffer);
 int FileInfo_fseek(struct FileInfo *fi, long __off, int __whence);
 long FileInfo_ftell(struct FileInfo *fi);
 size_t FileInfo_fwrite(struct FileInfo *fi, const void *data, size_t size, size_t n);
 size_t FileInfo_fwrite_bswap(struct FileInfo *fi, const void *data, size_t size, size_t n);
+void FileInfo_fflush(struct FileInfo *fi);
 int FileInfo_fclose(struct FileInfo *fi);
 void FileInfo_free(struct FileInfo *fi);
 
@@ -122,6 +163,11 @@ void VarLengthInt_write_value_big(uint8_t *dest, struct VarLengthInt* source);
 void VarLengthInt_write_value_little(uint8_t *dest, struct VarLengthInt* source);
 int32_t VarLengthInt_get_value_big(struct VarLengthInt* source);
 int32_t VarLengthInt_get_value_little(struct VarLengthInt* source);
+void VarLengthInt_from_buffer(struct VarLengthInt *varint, const uint8_t *buffer, int num_bytes, int32_t value);
+
+int varint_length(int32_t value);
+int varint_write_int32(uint8_t *dest, int32_t value);
+int varint_read_int32(const uint8_t *buffer, size_t max_bytes, int32_t *value);
 
 size_t fill_16bit_buffer(
     int16_t *samples,
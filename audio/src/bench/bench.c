@@ -0,0 +1,532 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include "debug.h"
+#include "machine_config.h"
+#include "common.h"
+#include "utility.h"
+#include "bench.h"
+
+/**
+ * This file contains main entry for bench app.
+ * 
+ * Runs micro and macro benchmarks against synthetic input, writes
+ * results as JSON, and optionally compares against a baseline file.
+*/
+
+#define APPNAME "bench"
+#define VERSION "1.0"
+
+/**
+ * Max length of a line in baseline file.
+*/
+#define BENCH_LINE_LEN 1024
+
+static int opt_help_flag = 0;
+static int opt_output_file = 0;
+static int opt_compare_file = 0;
+static int opt_filter = 0;
+static char output_filename[MAX_FILENAME_LEN] = {0};
+static char compare_filename[MAX_FILENAME_LEN] = {0};
+static char filter_name[BENCH_NAME_LEN] = {0};
+static int opt_warmup = BENCH_DEFAULT_WARMUP;
+static int opt_reps = BENCH_DEFAULT_REPS;
+static double opt_threshold = BENCH_DEFAULT_THRESHOLD;
+
+#define LONG_OPT_WARMUP       1001
+#define LONG_OPT_REPS         1002
+#define LONG_OPT_THRESHOLD    1003
+#define LONG_OPT_FILTER       1004
+
+static struct option long_options[] =
+{
+    {"help",         no_argument,     &opt_help_flag,   1  },
+    {"out",          required_argument,         NULL,  'o' },
+    {"compare",      required_argument,         NULL,  'c' },
+    {"warmup",       required_argument,         NULL,   LONG_OPT_WARMUP },
+    {"reps",         required_argument,         NULL,   LONG_OPT_REPS },
+    {"threshold",    required_argument,         NULL,   LONG_OPT_THRESHOLD },
+    {"filter",       required_argument,         NULL,   LONG_OPT_FILTER },
+    {"quiet",        no_argument,               NULL,  'q' },
+    {"verbose",      no_argument,               NULL,  'v' },
+    {"debug",        no_argument,               NULL,  'd' },
+    {NULL, 0, NULL, 0}
+};
+
+// forward declarations
+
+void print_help(const char * invoke);
+void read_opts(int argc, char **argv);
+static uint64_t bench_now_ns(void);
+static int bench_compare_u64(const void *a, const void *b);
+static void bench_execute(struct BenchCase *bench_case, struct BenchResult *result);
+static void bench_write_json(FILE *fp, struct BenchResult *results, int count);
+static int bench_baseline_median(const char *filename, const char *name, double *median_ns);
+static int bench_compare(struct BenchResult *results, int count);
+
+// end forward declarations
+
+void print_help(const char * invoke)
+{
+    printf("%s %s help\n", APPNAME, VERSION);
+    printf("\n");
+    printf("Runs benchmarks on synthetic input and reports time per run.\n");
+    printf("usage:\n");
+    printf("\n");
+    printf("    %s [--out file] [--compare file]\n", invoke);
+    printf("\n");
+    printf("options:\n");
+    printf("\n");
+    printf("    --help                        print this help\n");
+    printf("    -o,--out=FILE                 write results as JSON to file. (optional)\n");
+    printf("    -c,--compare=FILE             compare median times against baseline JSON file. (optional)\n");
+    printf("                                  Exit code is non-zero if any benchmark regressed.\n");
+    printf("    --threshold=FRACTION          allowed slowdown relative to baseline before reporting\n");
+    printf("                                  a regression. (optional) default=%.2f\n", BENCH_DEFAULT_THRESHOLD);
+    printf("    --warmup=N                    untimed runs before measuring. (optional) default=%d\n", BENCH_DEFAULT_WARMUP);
+    printf("    --reps=N                      timed runs. (optional) default=%d\n", BENCH_DEFAULT_REPS);
+    printf("    --filter=STRING               only run benchmarks whose name contains STRING. (optional)\n");
+    printf("    -q,--quiet                    suppress output\n");
+    printf("    -v,--verbose                  more output\n");
+    printf("\n");
+    fflush(stdout);
+}
+
+void read_opts(int argc, char **argv)
+{
+    int ch;
+
+    while ((ch = getopt_long(argc, argv, "o:c:qvd", long_options, NULL)) != -1)
+    {
+        switch (ch)
+        {
+            case 'o':
+            {
+                opt_output_file = 1;
+                snprintf(output_filename, MAX_FILENAME_LEN, "%s", optarg);
+            }
+            break;
+
+            case 'c':
+            {
+                opt_compare_file = 1;
+                snprintf(compare_filename, MAX_FILENAME_LEN, "%s", optarg);
+            }
+            break;
+
+            case LONG_OPT_WARMUP:
+            {
+                char *pend = NULL;
+                opt_warmup = (int)strtol(optarg, &pend, 10);
+
+                if (pend == optarg || opt_warmup < 0 || opt_warmup > BENCH_MAX_REPS)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, invalid --warmup: %s\n", optarg);
+                }
+            }
+            break;
+
+            case LONG_OPT_REPS:
+            {
+                char *pend = NULL;
+                opt_reps = (int)strtol(optarg, &pend, 10);
+
+                if (pend == optarg || opt_reps < 1 || opt_reps > BENCH_MAX_REPS)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, invalid --reps: %s\n", optarg);
+                }
+            }
+            break;
+
+            case LONG_OPT_THRESHOLD:
+            {
+                char *pend = NULL;
+                opt_threshold = strtod(optarg, &pend);
+
+                if (pend == optarg || opt_threshold < 0.0)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "error, invalid --threshold: %s\n", optarg);
+                }
+            }
+            break;
+
+            case LONG_OPT_FILTER:
+            {
+                opt_filter = 1;
+                snprintf(filter_name, BENCH_NAME_LEN, "%s", optarg);
+            }
+            break;
+
+            case 'q':
+                g_verbosity = 0;
+                break;
+
+            case 'v':
+                g_verbosity = 2;
+                break;
+
+            case 'd':
+                g_verbosity = 3;
+                break;
+
+            case '?':
+                print_help(argv[0]);
+                exit(0);
+                break;
+
+            default:
+                // ignore
+                break;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct BenchCase *cases;
+    struct BenchResult *results;
+    int case_count;
+    int result_count;
+    int regressions = 0;
+    int i;
+
+    read_opts(argc, argv);
+
+    if (opt_help_flag)
+    {
+        print_help(argv[0]);
+        exit(0);
+    }
+
+    cases = bench_get_cases(&case_count);
+    results = (struct BenchResult *)malloc_zero(case_count, sizeof(struct BenchResult));
+    result_count = 0;
+
+    if (g_verbosity > 0)
+    {
+        printf("%-24s %6s %14s %14s %14s %10s\n", "name", "reps", "min (us)", "median (us)", "p95 (us)", "MB/s");
+    }
+
+    for (i=0; i<case_count; i++)
+    {
+        struct BenchResult *result;
+
+        if (opt_filter && strstr(cases[i].name, filter_name) == NULL)
+        {
+            continue;
+        }
+
+        result = &results[result_count];
+        bench_execute(&cases[i], result);
+        result_count++;
+
+        if (g_verbosity > 0)
+        {
+            double mbps = 0.0;
+
+            if (result->bytes_per_run > 0 && result->median_ns > 0.0)
+            {
+                mbps = ((double)result->bytes_per_run / (1024.0 * 1024.0)) / (result->median_ns / 1e9);
+            }
+
+            printf("%-24s %6d %14.1f %14.1f %14.1f %10.1f\n",
+                result->name,
+                result->reps,
+                result->min_ns / 1000.0,
+                result->median_ns / 1000.0,
+                result->p95_ns / 1000.0,
+                mbps);
+            fflush(stdout);
+        }
+    }
+
+    if (opt_output_file)
+    {
+        struct FileInfo *fi = FileInfo_fopen(output_filename, "w");
+        bench_write_json(fi->fp, results, result_count);
+        FileInfo_free(fi);
+    }
+
+    if (opt_compare_file)
+    {
+        regressions = bench_compare(results, result_count);
+    }
+
+    free(results);
+
+    if (regressions > 0)
+    {
+        return EXIT_CODE_GENERAL;
+    }
+
+    return 0;
+}
+
+/**
+ * Gets monotonic time.
+ * @returns: time in nanoseconds.
+*/
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * qsort callback, ascending.
+*/
+static int bench_compare_u64(const void *a, const void *b)
+{
+    uint64_t first = *(const uint64_t *)a;
+    uint64_t second = *(const uint64_t *)b;
+
+    if (first < second)
+    {
+        return -1;
+    }
+    else if (first > second)
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Runs setup, warm-up runs, timed runs, and teardown for one benchmark.
+ * @param bench_case: benchmark to run.
+ * @param result: out parameter. Will contain timing summary.
+*/
+static void bench_execute(struct BenchCase *bench_case, struct BenchResult *result)
+{
+    TRACE_ENTER(__func__)
+
+    uint64_t *times;
+    uint64_t total = 0;
+    void *state;
+    int p95_index;
+    int i;
+
+    times = (uint64_t *)malloc_zero(opt_reps, sizeof(uint64_t));
+
+    state = bench_case->setup();
+
+    for (i=0; i<opt_warmup; i++)
+    {
+        bench_case->run(state);
+    }
+
+    for (i=0; i<opt_reps; i++)
+    {
+        uint64_t start = bench_now_ns();
+        bench_case->run(state);
+        times[i] = bench_now_ns() - start;
+        total += times[i];
+    }
+
+    bench_case->teardown(state);
+
+    qsort(times, (size_t)opt_reps, sizeof(uint64_t), bench_compare_u64);
+
+    // nearest rank
+    p95_index = (int)((95 * opt_reps + 99) / 100) - 1;
+    if (p95_index < 0)
+    {
+        p95_index = 0;
+    }
+
+    snprintf(result->name, BENCH_NAME_LEN, "%s", bench_case->name);
+    result->kind = bench_case->kind;
+    result->warmup = opt_warmup;
+    result->reps = opt_reps;
+    result->bytes_per_run = bench_case->bytes_per_run;
+    result->min_ns = (double)times[0];
+    result->p95_ns = (double)times[p95_index];
+    result->mean_ns = (double)total / (double)opt_reps;
+
+    if ((opt_reps & 1) == 1)
+    {
+        result->median_ns = (double)times[opt_reps / 2];
+    }
+    else
+    {
+        result->median_ns = ((double)times[opt_reps / 2 - 1] + (double)times[opt_reps / 2]) / 2.0;
+    }
+
+    free(times);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Writes results as JSON. Each result is written on a single line,
+ * which is what {@code bench_baseline_median} expects when reading.
+ * @param fp: file to write to.
+ * @param results: results to write.
+ * @param count: number of results.
+*/
+static void bench_write_json(FILE *fp, struct BenchResult *results, int count)
+{
+    TRACE_ENTER(__func__)
+
+    int i;
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"version\": 1,\n");
+    fprintf(fp, "  \"results\": [\n");
+
+    for (i=0; i<count; i++)
+    {
+        fprintf(fp, "    {\"name\": \"%s\", \"kind\": \"%s\", \"warmup\": %d, \"reps\": %d, \"bytes_per_run\": %zu, \"min_ns\": %.0f, \"median_ns\": %.0f, \"p95_ns\": %.0f, \"mean_ns\": %.0f}%s\n",
+            results[i].name,
+            results[i].kind == BENCH_KIND_MACRO ? "macro" : "micro",
+            results[i].warmup,
+            results[i].reps,
+            results[i].bytes_per_run,
+            results[i].min_ns,
+            results[i].median_ns,
+            results[i].p95_ns,
+            results[i].mean_ns,
+            (i + 1 < count) ? "," : "");
+    }
+
+    fprintf(fp, "  ]\n");
+    fprintf(fp, "}\n");
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Finds median time for benchmark in baseline file written by {@code bench_write_json}.
+ * @param filename: baseline file.
+ * @param name: benchmark name.
+ * @param median_ns: out parameter. Will contain baseline median time.
+ * @returns: 1 if found, 0 otherwise.
+*/
+static int bench_baseline_median(const char *filename, const char *name, double *median_ns)
+{
+    TRACE_ENTER(__func__)
+
+    char line[BENCH_LINE_LEN];
+    char name_key[BENCH_NAME_LEN + 16];
+    FILE *fp;
+    int found = 0;
+
+    fp = fopen(filename, "r");
+    if (fp == NULL)
+    {
+        stderr_exit(EXIT_CODE_IO, "%s %d> cannot open baseline file: %s\n", __func__, __LINE__, filename);
+    }
+
+    snprintf(name_key, sizeof(name_key), "\"name\": \"%s\"", name);
+
+    while (fgets(line, BENCH_LINE_LEN, fp) != NULL)
+    {
+        char *p;
+
+        if (strstr(line, name_key) == NULL)
+        {
+            continue;
+        }
+
+        p = strstr(line, "\"median_ns\":");
+        if (p != NULL && sscanf(p + strlen("\"median_ns\":"), "%lf", median_ns) == 1)
+        {
+            found = 1;
+        }
+
+        break;
+    }
+
+    fclose(fp);
+
+    TRACE_LEAVE(__func__)
+
+    return found;
+}
+
+/**
+ * Compares median times against baseline and prints one line per benchmark.
+ * @param results: results to compare.
+ * @param count: number of results.
+ * @returns: number of regressions.
+*/
+static int bench_compare(struct BenchResult *results, int count)
+{
+    TRACE_ENTER(__func__)
+
+    int regressions = 0;
+    int i;
+
+    printf("%-24s %14s %14s %9s\n", "name", "baseline (us)", "current (us)", "change");
+
+    for (i=0; i<count; i++)
+    {
+        double baseline_ns;
+        double change;
+        const char *status;
+
+        if (!bench_baseline_median(compare_filename, results[i].name, &baseline_ns) || baseline_ns <= 0.0)
+        {
+            printf("%-24s %14s %14.1f %9s  new\n", results[i].name, "-", results[i].median_ns / 1000.0, "-");
+            continue;
+        }
+
+        change = (results[i].median_ns - baseline_ns) / baseline_ns;
+
+        if (change > opt_threshold)
+        {
+            status = "REGRESSION";
+            regressions++;
+        }
+        else if (change < -opt_threshold)
+        {
+            status = "improved";
+        }
+        else
+        {
+            status = "ok";
+        }
+
+        printf("%-24s %14.1f %14.1f %+8.1f%%  %s\n",
+            results[i].name,
+            baseline_ns / 1000.0,
+            results[i].median_ns / 1000.0,
+            change * 100.0,
+            status);
+    }
+
+    if (regressions > 0)
+    {
+        printf("%d benchmark(s) regressed more than %.1f%%\n", regressions, opt_threshold * 100.0);
+    }
+
+    fflush(stdout);
+
+    TRACE_LEAVE(__func__)
+
+    return regressions;
+}
@@ -0,0 +1,132 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#ifndef _GAUDIO_BENCH_H_
+#define _GAUDIO_BENCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * This file contains structs and defines for the benchmark runner.
+*/
+
+/**
+ * Default number of untimed runs before measuring.
+*/
+#define BENCH_DEFAULT_WARMUP 2
+
+/**
+ * Default number of timed runs.
+*/
+#define BENCH_DEFAULT_REPS 15
+
+/**
+ * Sanity check, max number of timed runs.
+*/
+#define BENCH_MAX_REPS 10000
+
+/**
+ * Default allowed slowdown (fraction of baseline median) before a result
+ * is reported as a regression.
+*/
+#define BENCH_DEFAULT_THRESHOLD 0.10
+
+/**
+ * Max length of benchmark name.
+*/
+#define BENCH_NAME_LEN 64
+
+/**
+ * Seed for synthetic inputs. Every run of the same build generates identical inputs.
+*/
+#define BENCH_SEED 0x5eed1234u
+
+enum BENCH_KIND {
+    /**
+     * Single function or data structure.
+    */
+    BENCH_KIND_MICRO = 0,
+
+    /**
+     * End to end conversion made of several steps.
+    */
+    BENCH_KIND_MACRO
+};
+
+/**
+ * Creates synthetic input for a benchmark. Not timed.
+ * @returns: state passed to run and teardown.
+*/
+typedef void *(*f_bench_setup)(void);
+
+/**
+ * Executes one repetition of the benchmark. This is the timed part.
+ * Must leave {@code state} ready for the next repetition.
+*/
+typedef void (*f_bench_run)(void *state);
+
+/**
+ * Releases state created in setup. Not timed.
+*/
+typedef void (*f_bench_teardown)(void *state);
+
+/**
+ * Benchmark definition.
+*/
+struct BenchCase {
+    /**
+     * Unique name, used to match results against the baseline.
+    */
+    const char *name;
+
+    enum BENCH_KIND kind;
+
+    f_bench_setup setup;
+    f_bench_run run;
+    f_bench_teardown teardown;
+
+    /**
+     * Number of input bytes processed per repetition, used to report throughput.
+     * Zero if not applicable.
+    */
+    size_t bytes_per_run;
+};
+
+/**
+ * Timing summary for one benchmark.
+*/
+struct BenchResult {
+    char name[BENCH_NAME_LEN];
+    enum BENCH_KIND kind;
+    int warmup;
+    int reps;
+    size_t bytes_per_run;
+
+    /**
+     * Statistics over timed runs, in nanoseconds.
+    */
+    double min_ns;
+    double median_ns;
+    double p95_ns;
+    double mean_ns;
+};
+
+struct BenchCase *bench_get_cases(int *count);
+uint32_t bench_rand(uint32_t *seed);
+
+#endif
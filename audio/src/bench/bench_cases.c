@@ -0,0 +1,1016 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "debug.h"
+#include "machine_config.h"
+#include "common.h"
+#include "utility.h"
+#include "llist.h"
+#include "kvp.h"
+#include "int_hash.h"
+#include "string_hash.h"
+#include "naudio.h"
+#include "adpcm_aifc.h"
+#include "wav.h"
+#include "midi.h"
+#include "x.h"
+#ifndef NOGSL
+#include "magic.h"
+#endif
+#include "bench.h"
+
+/**
+ * This file contains the benchmark workloads. All inputs are generated
+ * from {@code BENCH_SEED} so every run measures the same work.
+*/
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/**
+ * Length of temp directory path buffer.
+*/
+#define BENCH_DIR_LEN 64
+
+/**
+ * Number of 16-bit samples in synthetic audio used by the codec benchmarks.
+*/
+#define BENCH_AUDIO_SAMPLES (1 << 17)
+
+/**
+ * Number of 16-bit samples in each synthetic .aifc used to build a sound bank.
+*/
+#define BENCH_BANK_AIFC_SAMPLES 4096
+
+/**
+ * Number of distinct .aifc files referenced by the synthetic sound bank.
+*/
+#define BENCH_BANK_NUM_AIFC 8
+
+/**
+ * Number of sounds in the synthetic sound bank.
+*/
+#define BENCH_BANK_NUM_SOUNDS 128
+
+/**
+ * Number of sounds per instrument in the synthetic sound bank.
+*/
+#define BENCH_BANK_SOUNDS_PER_INST 4
+
+/**
+ * Length in bytes of synthetic seq track used for pattern search.
+*/
+#define BENCH_PATTERN_TRACK_LEN 8192
+
+/**
+ * Number of keys inserted in the hash table benchmarks.
+*/
+#define BENCH_HASH_NUM_KEYS 20000
+
+/**
+ * Number of nodes sorted in the linked list benchmark.
+*/
+#define BENCH_LLIST_NUM_NODES 50000
+
+/**
+ * Synthetic MIDI file parameters.
+*/
+#define BENCH_MIDI_NUM_TRACKS 4
+#define BENCH_MIDI_PHRASE_LEN 16
+#define BENCH_MIDI_PHRASE_REPEAT 48
+#define BENCH_MIDI_DIVISION 480
+
+/**
+ * Codebook used for codec benchmarks (same as the example in wav2aifc docs).
+*/
+static const int16_t bench_book[16] = {
+     -769,   -992,   -992,   -907,   -798,   -689,   -590,   -502,
+     2643,   2641,   2416,   2126,   1836,   1571,   1338,   1137
+};
+
+struct BenchCodecState {
+    struct WavFile *wav;
+    struct ALADPCMBook *book;
+    struct AdpcmAifcFile *aifc;
+    uint8_t *decode_buffer;
+    size_t decode_buffer_len;
+};
+
+struct BenchBankState {
+    char dir[BENCH_DIR_LEN];
+    char inst_filename[MAX_FILENAME_LEN];
+    char tbl_filename[MAX_FILENAME_LEN];
+    char ctl_filename[MAX_FILENAME_LEN];
+    char aifc_filenames[BENCH_BANK_NUM_AIFC][MAX_FILENAME_LEN];
+};
+
+struct BenchPatternState {
+    struct GmidTrack *gtrack;
+    uint8_t *write_buffer;
+};
+
+struct BenchHashState {
+    uint32_t int_keys[BENCH_HASH_NUM_KEYS];
+    char *string_keys[BENCH_HASH_NUM_KEYS];
+};
+
+struct BenchLlistState {
+    struct LinkedList *list;
+};
+
+struct BenchMidiState {
+    char dir[BENCH_DIR_LEN];
+    char midi_filename[MAX_FILENAME_LEN];
+    struct MidiFile *midi;
+    struct MidiConvertOptions *options;
+};
+
+// forward declarations
+
+static struct WavFile *bench_wav_new(size_t num_samples, uint32_t *seed);
+static struct ALADPCMBook *bench_book_new(void);
+static void bench_temp_dir(char *dir);
+static void *bench_codec_setup(void);
+static void bench_codec_teardown(void *state);
+static void bench_adpcm_encode_run(void *state);
+static void bench_adpcm_decode_run(void *state);
+#ifndef NOGSL
+static void bench_estimate_codebook_run(void *state);
+#endif
+static void *bench_bank_setup(void);
+static void bench_bank_teardown(void *state);
+static void bench_parse_inst_run(void *state);
+static void bench_parse_ctl_run(void *state);
+static void bench_gic_run(void *state);
+static void *bench_pattern_setup(void);
+static void bench_pattern_teardown(void *state);
+static void bench_pattern_naive_run(void *state);
+static void *bench_hash_setup(void);
+static void bench_hash_teardown(void *state);
+static void bench_int_hash_run(void *state);
+static void bench_string_hash_run(void *state);
+static void *bench_llist_setup(void);
+static void bench_llist_teardown(void *state);
+static void bench_llist_merge_sort_run(void *state);
+static void *bench_midi_setup(void);
+static void bench_midi_teardown(void *state);
+static void bench_midi_roundtrip_run(void *state);
+static size_t bench_midi_write_track(uint8_t *buffer, int channel, uint32_t *seed);
+
+// end forward declarations
+
+static struct BenchCase bench_cases[] = {
+    { "adpcm_encode",            BENCH_KIND_MICRO, bench_codec_setup,   bench_adpcm_encode_run,      bench_codec_teardown,   BENCH_AUDIO_SAMPLES * 2 },
+    { "adpcm_decode",            BENCH_KIND_MICRO, bench_codec_setup,   bench_adpcm_decode_run,      bench_codec_teardown,   BENCH_AUDIO_SAMPLES * 2 },
+#ifndef NOGSL
+    { "estimate_codebook",       BENCH_KIND_MICRO, bench_codec_setup,   bench_estimate_codebook_run, bench_codec_teardown,   BENCH_AUDIO_SAMPLES * 2 },
+#endif
+    { "pattern_matches_naive",   BENCH_KIND_MICRO, bench_pattern_setup, bench_pattern_naive_run,     bench_pattern_teardown, BENCH_PATTERN_TRACK_LEN },
+    { "parse_inst",              BENCH_KIND_MICRO, bench_bank_setup,    bench_parse_inst_run,        bench_bank_teardown,    0 },
+    { "parse_ctl",               BENCH_KIND_MICRO, bench_bank_setup,    bench_parse_ctl_run,         bench_bank_teardown,    0 },
+    { "int_hash",                BENCH_KIND_MICRO, bench_hash_setup,    bench_int_hash_run,          bench_hash_teardown,    0 },
+    { "string_hash",             BENCH_KIND_MICRO, bench_hash_setup,    bench_string_hash_run,       bench_hash_teardown,    0 },
+    { "llist_merge_sort",        BENCH_KIND_MICRO, bench_llist_setup,   bench_llist_merge_sort_run,  bench_llist_teardown,   0 },
+    { "gic_inst_to_ctl_tbl",     BENCH_KIND_MACRO, bench_bank_setup,    bench_gic_run,               bench_bank_teardown,    0 },
+    { "midi_cseq_roundtrip",     BENCH_KIND_MACRO, bench_midi_setup,    bench_midi_roundtrip_run,    bench_midi_teardown,    0 },
+};
+
+/**
+ * Gets the list of benchmarks.
+ * @param count: out parameter. Will contain number of benchmarks.
+ * @returns: benchmark array.
+*/
+struct BenchCase *bench_get_cases(int *count)
+{
+    TRACE_ENTER(__func__)
+
+    if (count == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> count is NULL\n", __func__, __LINE__);
+    }
+
+    *count = (int)ARRAY_LENGTH(bench_cases);
+
+    TRACE_LEAVE(__func__)
+
+    return bench_cases;
+}
+
+/**
+ * Deterministic pseudo random number generator (LCG), so synthetic inputs
+ * don't depend on the C library.
+ * @param seed: in/out. Generator state.
+ * @returns: next value.
+*/
+uint32_t bench_rand(uint32_t *seed)
+{
+    *seed = *seed * 1664525u + 1013904223u;
+
+    return *seed >> 8;
+}
+
+/**
+ * Creates mono 16-bit wav with a mix of tones and noise.
+ * The tone changes every 4096 samples.
+ * @param num_samples: number of samples.
+ * @param seed: in/out. Generator state.
+ * @returns: new wav file.
+*/
+static struct WavFile *bench_wav_new(size_t num_samples, uint32_t *seed)
+{
+    TRACE_ENTER(__func__)
+
+    struct WavFile *wav;
+    int16_t *samples;
+    size_t i;
+    double freq1 = 220.0;
+    double freq2 = 330.0;
+
+    samples = (int16_t *)malloc_zero(num_samples, sizeof(int16_t));
+
+    for (i=0; i<num_samples; i++)
+    {
+        double t = (double)i / 22050.0;
+        int noise = (int)(bench_rand(seed) % 1001) - 500;
+
+        if ((i & 0xfff) == 0)
+        {
+            freq1 = 110.0 + (double)(bench_rand(seed) % 880);
+            freq2 = freq1 * 1.5;
+        }
+
+        samples[i] = (int16_t)(8000.0 * sin(2.0 * M_PI * freq1 * t) + 4000.0 * sin(2.0 * M_PI * freq2 * t) + noise);
+    }
+
+    wav = WavFile_new(WAV_DEFAULT_NUM_CHUNKS);
+
+    wav->fmt_chunk = WavFmtChunk_new();
+    wav->chunks[0] = wav->fmt_chunk;
+
+    wav->fmt_chunk->audio_format = WAV_AUDIO_FORMAT;
+    wav->fmt_chunk->num_channels = 1;
+    wav->fmt_chunk->sample_rate = 22050;
+    wav->fmt_chunk->bits_per_sample = DEFAULT_SAMPLE_SIZE;
+    wav->fmt_chunk->byte_rate = wav->fmt_chunk->sample_rate * wav->fmt_chunk->num_channels * wav->fmt_chunk->bits_per_sample/8;
+    wav->fmt_chunk->block_align = wav->fmt_chunk->num_channels * wav->fmt_chunk->bits_per_sample/8;
+
+    wav->data_chunk = WavDataChunk_new();
+    wav->chunks[1] = wav->data_chunk;
+
+    wav->data_chunk->data = (uint8_t *)samples;
+    wav->data_chunk->ck_data_size = (int32_t)(num_samples * sizeof(int16_t));
+
+    wav->ck_data_size =
+        4 + /* rest of FORM header */
+        WAV_FMT_CHUNK_FULL_SIZE + /* "fmt " chunk is const size */
+        8 + wav->data_chunk->ck_data_size; /* "data" chunk header, then data size*/
+
+    TRACE_LEAVE(__func__)
+
+    return wav;
+}
+
+/**
+ * Creates a copy of the benchmark codebook.
+ * @returns: new codebook.
+*/
+static struct ALADPCMBook *bench_book_new(void)
+{
+    TRACE_ENTER(__func__)
+
+    struct ALADPCMBook *book = ALADPCMBook_new(2, 1);
+
+    memcpy(book->book, bench_book, sizeof(bench_book));
+
+    TRACE_LEAVE(__func__)
+
+    return book;
+}
+
+/**
+ * Creates a new temp directory for benchmark files.
+ * @param dir: out parameter. Must be at least {@code BENCH_DIR_LEN}. Will contain path, without trailing slash.
+*/
+static void bench_temp_dir(char *dir)
+{
+    TRACE_ENTER(__func__)
+
+    snprintf(dir, BENCH_DIR_LEN, "/tmp/gaudio_bench_XXXXXX");
+
+    if (mkdtemp(dir) == NULL)
+    {
+        stderr_exit(EXIT_CODE_IO, "%s %d> cannot create temp directory\n", __func__, __LINE__);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+static void *bench_codec_setup(void)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchCodecState *codec = (struct BenchCodecState *)malloc_zero(1, sizeof(struct BenchCodecState));
+    uint32_t seed = BENCH_SEED;
+
+    codec->wav = bench_wav_new(BENCH_AUDIO_SAMPLES, &seed);
+    codec->book = bench_book_new();
+    codec->aifc = AdpcmAifcFile_new_from_wav(codec->wav, codec->book);
+    codec->decode_buffer_len = AdpcmAifcFile_estimate_inflate_size(codec->aifc);
+    codec->decode_buffer = (uint8_t *)malloc_zero(1, codec->decode_buffer_len);
+
+    TRACE_LEAVE(__func__)
+
+    return codec;
+}
+
+static void bench_codec_teardown(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchCodecState *codec = (struct BenchCodecState *)state;
+
+    free(codec->decode_buffer);
+    AdpcmAifcFile_free(codec->aifc);
+    ALADPCMBook_free(codec->book);
+    WavFile_free(codec->wav);
+    free(codec);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Encodes the synthetic audio (through {@code AdpcmAifcFile_encode}).
+*/
+static void bench_adpcm_encode_run(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchCodecState *codec = (struct BenchCodecState *)state;
+    struct AdpcmAifcFile *aifc;
+
+    aifc = AdpcmAifcFile_new_from_wav(codec->wav, codec->book);
+    AdpcmAifcFile_free(aifc);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Decodes the previously encoded synthetic audio.
+*/
+static void bench_adpcm_decode_run(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchCodecState *codec = (struct BenchCodecState *)state;
+
+    AdpcmAifcFile_decode(codec->aifc, codec->decode_buffer, codec->decode_buffer_len);
+
+    TRACE_LEAVE(__func__)
+}
+
+#ifndef NOGSL
+/**
+ * Estimates a codebook for the synthetic audio, same parameters as tabledesign defaults.
+*/
+static void bench_estimate_codebook_run(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchCodecState *codec = (struct BenchCodecState *)state;
+    struct ALADPCMBook *book;
+
+    book = estimate_codebook(
+        codec->wav->data_chunk->data,
+        (size_t)codec->wav->data_chunk->ck_data_size,
+        DATA_ENCODING_LSB,
+        NULL,
+        2,
+        4);
+
+    ALADPCMBook_free(book);
+
+    TRACE_LEAVE(__func__)
+}
+#endif
+
+/**
+ * Writes synthetic .aifc files and a .inst file referencing them, then builds
+ * .tbl and .ctl from those (same as gic).
+*/
+static void *bench_bank_setup(void)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchBankState *bank = (struct BenchBankState *)malloc_zero(1, sizeof(struct BenchBankState));
+    struct ALADPCMBook *book = bench_book_new();
+    struct ALBankFile *bank_file;
+    struct FileInfo *fi;
+    uint32_t seed = BENCH_SEED;
+    int i;
+
+    bench_temp_dir(bank->dir);
+
+    for (i=0; i<BENCH_BANK_NUM_AIFC; i++)
+    {
+        struct WavFile *wav = bench_wav_new(BENCH_BANK_AIFC_SAMPLES, &seed);
+        struct AdpcmAifcFile *aifc = AdpcmAifcFile_new_from_wav(wav, book);
+
+        snprintf(bank->aifc_filenames[i], MAX_FILENAME_LEN, "%s/sound%02d.aifc", bank->dir, i);
+
+        fi = FileInfo_fopen(bank->aifc_filenames[i], "wb");
+        AdpcmAifcFile_fwrite(aifc, fi);
+        FileInfo_free(fi);
+
+        AdpcmAifcFile_free(aifc);
+        WavFile_free(wav);
+    }
+
+    ALADPCMBook_free(book);
+
+    snprintf(bank->inst_filename, MAX_FILENAME_LEN, "%s/bank.inst", bank->dir);
+    snprintf(bank->tbl_filename, MAX_FILENAME_LEN, "%s/bank.tbl", bank->dir);
+    snprintf(bank->ctl_filename, MAX_FILENAME_LEN, "%s/bank.ctl", bank->dir);
+
+    fi = FileInfo_fopen(bank->inst_filename, "wb");
+
+    for (i=0; i<BENCH_BANK_NUM_SOUNDS; i++)
+    {
+        int key = (int)(bench_rand(&seed) % 100) + 12;
+
+        fprintf(fi->fp, "envelope Envelope%04d {\n    attackTime = %d;\n    attackVolume = 127;\n    decayTime = %d;\n    decayVolume = %d;\n    releaseTime = %d;\n}\n\n",
+            i, (int)(bench_rand(&seed) % 10000), (int)(bench_rand(&seed) % 500000), (int)(bench_rand(&seed) % 128), (int)(bench_rand(&seed) % 10000));
+        fprintf(fi->fp, "keymap Keymap%04d {\n    velocityMin = 1;\n    velocityMax = 127;\n    keyMin = %d;\n    keyMax = %d;\n    keyBase = %d;\n    detune = %d;\n}\n\n",
+            i, key - 12, key + 12, key, (int)(bench_rand(&seed) % 50));
+        fprintf(fi->fp, "sound Sound%04d {\n    use (\"%s\");\n    pan = %d;\n    volume = %d;\n    envelope = Envelope%04d;\n    keymap = Keymap%04d;\n}\n\n",
+            i, bank->aifc_filenames[i % BENCH_BANK_NUM_AIFC], (int)(bench_rand(&seed) % 128), (int)(bench_rand(&seed) % 128), i, i);
+    }
+
+    for (i=0; i<BENCH_BANK_NUM_SOUNDS / BENCH_BANK_SOUNDS_PER_INST; i++)
+    {
+        int sound_count;
+
+        fprintf(fi->fp, "instrument Instrument%04d {\n    volume = 100;\n    pan = 64;\n", i);
+
+        for (sound_count=0; sound_count<BENCH_BANK_SOUNDS_PER_INST; sound_count++)
+        {
+            fprintf(fi->fp, "    sound [%d] = Sound%04d;\n", sound_count, i * BENCH_BANK_SOUNDS_PER_INST + sound_count);
+        }
+
+        fprintf(fi->fp, "}\n\n");
+    }
+
+    fprintf(fi->fp, "bank Bank0000 {\n");
+
+    for (i=0; i<BENCH_BANK_NUM_SOUNDS / BENCH_BANK_SOUNDS_PER_INST; i++)
+    {
+        fprintf(fi->fp, "    instrument [%d] = Instrument%04d;\n", i, i);
+    }
+
+    fprintf(fi->fp, "}\n");
+
+    FileInfo_free(fi);
+
+    // build .tbl and .ctl once for the .ctl parse benchmark.
+    fi = FileInfo_fopen(bank->inst_filename, "rb");
+    bank_file = ALBankFile_new_from_inst(fi);
+    FileInfo_free(fi);
+
+    ALBankFile_write_tbl(bank_file, bank->tbl_filename);
+    ALBankFile_write_ctl(bank_file, bank->ctl_filename);
+    ALBankFile_free(bank_file);
+
+    TRACE_LEAVE(__func__)
+
+    return bank;
+}
+
+static void bench_bank_teardown(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchBankState *bank = (struct BenchBankState *)state;
+    int i;
+
+    for (i=0; i<BENCH_BANK_NUM_AIFC; i++)
+    {
+        unlink(bank->aifc_filenames[i]);
+    }
+
+    unlink(bank->inst_filename);
+    unlink(bank->tbl_filename);
+    unlink(bank->ctl_filename);
+    rmdir(bank->dir);
+
+    free(bank);
+
+    TRACE_LEAVE(__func__)
+}
+
+static void bench_parse_inst_run(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchBankState *bank = (struct BenchBankState *)state;
+    struct ALBankFile *bank_file;
+    struct FileInfo *fi;
+
+    fi = FileInfo_fopen(bank->inst_filename, "rb");
+    bank_file = ALBankFile_new_from_inst(fi);
+    FileInfo_free(fi);
+
+    ALBankFile_free(bank_file);
+
+    TRACE_LEAVE(__func__)
+}
+
+static void bench_parse_ctl_run(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchBankState *bank = (struct BenchBankState *)state;
+    struct ALBankFile *bank_file;
+    struct FileInfo *fi;
+
+    fi = FileInfo_fopen(bank->ctl_filename, "rb");
+    bank_file = ALBankFile_new_from_ctl(fi);
+    FileInfo_free(fi);
+
+    ALBankFile_free(bank_file);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Same steps as the gic app: parse .inst, write .tbl, write .ctl.
+*/
+static void bench_gic_run(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchBankState *bank = (struct BenchBankState *)state;
+    struct ALBankFile *bank_file;
+    struct FileInfo *fi;
+
+    fi = FileInfo_fopen(bank->inst_filename, "rb");
+    bank_file = ALBankFile_new_from_inst(fi);
+    FileInfo_free(fi);
+
+    ALBankFile_write_tbl(bank_file, bank->tbl_filename);
+    ALBankFile_write_ctl(bank_file, bank->ctl_filename);
+    ALBankFile_free(bank_file);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Creates a seq track made of short phrases that repeat with variations,
+ * so the pattern search finds both matches and misses.
+*/
+static void *bench_pattern_setup(void)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchPatternState *pattern = (struct BenchPatternState *)malloc_zero(1, sizeof(struct BenchPatternState));
+    uint8_t phrase[32];
+    uint32_t seed = BENCH_SEED;
+    size_t pos;
+    size_t i;
+
+    pattern->gtrack = GmidTrack_new();
+    pattern->gtrack->cseq_data = (uint8_t *)malloc_zero(1, BENCH_PATTERN_TRACK_LEN);
+    pattern->gtrack->cseq_data_len = BENCH_PATTERN_TRACK_LEN;
+    pattern->write_buffer = (uint8_t *)malloc_zero(1, BENCH_PATTERN_TRACK_LEN * 2);
+
+    for (i=0; i<sizeof(phrase); i++)
+    {
+        phrase[i] = (uint8_t)(bench_rand(&seed) & 0x7f);
+    }
+
+    pos = 0;
+    while (pos < BENCH_PATTERN_TRACK_LEN)
+    {
+        // new phrase one time in four
+        if ((bench_rand(&seed) & 0x3) == 0)
+        {
+            for (i=0; i<sizeof(phrase); i++)
+            {
+                phrase[i] = (uint8_t)(bench_rand(&seed) & 0x7f);
+            }
+        }
+
+        for (i=0; i<sizeof(phrase) && pos < BENCH_PATTERN_TRACK_LEN; i++, pos++)
+        {
+            pattern->gtrack->cseq_data[pos] = phrase[i];
+        }
+
+        // single byte change
+        phrase[bench_rand(&seed) % sizeof(phrase)] = (uint8_t)(bench_rand(&seed) & 0x7f);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return pattern;
+}
+
+static void bench_pattern_teardown(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchPatternState *pattern = (struct BenchPatternState *)state;
+
+    GmidTrack_free(pattern->gtrack);
+    free(pattern->write_buffer);
+    free(pattern);
+
+    TRACE_LEAVE(__func__)
+}
+
+static void bench_pattern_naive_run(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchPatternState *pattern = (struct BenchPatternState *)state;
+    struct LinkedList *matches = LinkedList_new();
+    struct LinkedListNode *node;
+    size_t buffer_pos = 0;
+
+    GmidTrack_get_pattern_matches_naive(pattern->gtrack, pattern->write_buffer, &buffer_pos, matches);
+
+    node = matches->head;
+    while (node != NULL)
+    {
+        free(node->data);
+        node->data = NULL;
+        node = node->next;
+    }
+
+    LinkedList_free(matches);
+
+    TRACE_LEAVE(__func__)
+}
+
+static void *bench_hash_setup(void)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchHashState *hash = (struct BenchHashState *)malloc_zero(1, sizeof(struct BenchHashState));
+    uint32_t seed = BENCH_SEED;
+    int i;
+
+    for (i=0; i<BENCH_HASH_NUM_KEYS; i++)
+    {
+        // multiply by odd constant is a bijection, keys are unique.
+        hash->int_keys[i] = (uint32_t)i * 2654435761u;
+
+        hash->string_keys[i] = (char *)malloc_zero(1, 32);
+        snprintf(hash->string_keys[i], 32, "Sound%04d_%06x", i, bench_rand(&seed) & 0xffffff);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return hash;
+}
+
+static void bench_hash_teardown(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchHashState *hash = (struct BenchHashState *)state;
+    int i;
+
+    for (i=0; i<BENCH_HASH_NUM_KEYS; i++)
+    {
+        free(hash->string_keys[i]);
+    }
+
+    free(hash);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Add all keys, look up all keys, then pop all keys.
+*/
+static void bench_int_hash_run(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchHashState *hash = (struct BenchHashState *)state;
+    struct IntHashTable *table = IntHashTable_new();
+    int i;
+
+    for (i=0; i<BENCH_HASH_NUM_KEYS; i++)
+    {
+        IntHashTable_add(table, hash->int_keys[i], &hash->int_keys[i]);
+    }
+
+    for (i=0; i<BENCH_HASH_NUM_KEYS; i++)
+    {
+        if (!IntHashTable_contains(table, hash->int_keys[i]))
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d> key not found: 0x%08x\n", __func__, __LINE__, hash->int_keys[i]);
+        }
+    }
+
+    for (i=0; i<BENCH_HASH_NUM_KEYS; i++)
+    {
+        IntHashTable_pop(table, hash->int_keys[i]);
+    }
+
+    IntHashTable_free(table);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Add all keys, look up all keys, then pop all keys.
+*/
+static void bench_string_hash_run(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchHashState *hash = (struct BenchHashState *)state;
+    struct StringHashTable *table = StringHashTable_new();
+    int i;
+
+    for (i=0; i<BENCH_HASH_NUM_KEYS; i++)
+    {
+        StringHashTable_add(table, hash->string_keys[i], hash->string_keys[i]);
+    }
+
+    for (i=0; i<BENCH_HASH_NUM_KEYS; i++)
+    {
+        if (!StringHashTable_contains(table, hash->string_keys[i]))
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d> key not found: %s\n", __func__, __LINE__, hash->string_keys[i]);
+        }
+    }
+
+    for (i=0; i<BENCH_HASH_NUM_KEYS; i++)
+    {
+        StringHashTable_pop(table, hash->string_keys[i]);
+    }
+
+    StringHashTable_free(table);
+
+    TRACE_LEAVE(__func__)
+}
+
+static void *bench_llist_setup(void)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchLlistState *llist = (struct BenchLlistState *)malloc_zero(1, sizeof(struct BenchLlistState));
+    int i;
+
+    llist->list = LinkedList_new();
+
+    for (i=0; i<BENCH_LLIST_NUM_NODES; i++)
+    {
+        struct LinkedListNode *node = LinkedListNode_new();
+        node->data = KeyValue_new();
+        LinkedList_append_node(llist->list, node);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return llist;
+}
+
+static void bench_llist_teardown(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchLlistState *llist = (struct BenchLlistState *)state;
+    struct LinkedListNode *node;
+
+    node = llist->list->head;
+    while (node != NULL)
+    {
+        KeyValue_free((struct KeyValue *)node->data);
+        node->data = NULL;
+        node = node->next;
+    }
+
+    LinkedList_free(llist->list);
+    free(llist);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Assigns the same sequence of random keys in list order, then sorts.
+*/
+static void bench_llist_merge_sort_run(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchLlistState *llist = (struct BenchLlistState *)state;
+    struct LinkedListNode *node;
+    uint32_t seed = BENCH_SEED;
+
+    node = llist->list->head;
+    while (node != NULL)
+    {
+        ((struct KeyValue *)node->data)->key = (int)(bench_rand(&seed) & 0xffffff);
+        node = node->next;
+    }
+
+    LinkedList_merge_sort(llist->list, LinkedListNode_KeyValue_compare_smaller_key);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Writes a synthetic standard MIDI file to a temp directory and loads it.
+*/
+static void *bench_midi_setup(void)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchMidiState *midi = (struct BenchMidiState *)malloc_zero(1, sizeof(struct BenchMidiState));
+    struct FileInfo *fi;
+    uint8_t *buffer;
+    size_t buffer_len;
+    size_t pos;
+    uint32_t seed = BENCH_SEED;
+    int track;
+
+    bench_temp_dir(midi->dir);
+    snprintf(midi->midi_filename, MAX_FILENAME_LEN, "%s/song.mid", midi->dir);
+
+    // each note is at most 4 bytes for note on + 4 bytes for note off.
+    buffer_len = 14 + BENCH_MIDI_NUM_TRACKS * (8 + 32 + BENCH_MIDI_PHRASE_LEN * BENCH_MIDI_PHRASE_REPEAT * 8);
+    buffer = (uint8_t *)malloc_zero(1, buffer_len);
+
+    pos = 0;
+    memcpy(&buffer[pos], "MThd", 4);
+    pos += 4;
+    buffer[pos + 3] = 6; // header length
+    pos += 4;
+    buffer[pos + 1] = 1; // format
+    pos += 2;
+    buffer[pos + 1] = BENCH_MIDI_NUM_TRACKS;
+    pos += 2;
+    buffer[pos] = (uint8_t)(BENCH_MIDI_DIVISION >> 8);
+    buffer[pos + 1] = (uint8_t)(BENCH_MIDI_DIVISION & 0xff);
+    pos += 2;
+
+    for (track=0; track<BENCH_MIDI_NUM_TRACKS; track++)
+    {
+        size_t track_len;
+
+        memcpy(&buffer[pos], "MTrk", 4);
+        pos += 4;
+
+        track_len = bench_midi_write_track(&buffer[pos + 4], track, &seed);
+
+        buffer[pos] = (uint8_t)((track_len >> 24) & 0xff);
+        buffer[pos + 1] = (uint8_t)((track_len >> 16) & 0xff);
+        buffer[pos + 2] = (uint8_t)((track_len >> 8) & 0xff);
+        buffer[pos + 3] = (uint8_t)(track_len & 0xff);
+        pos += 4 + track_len;
+    }
+
+    fi = FileInfo_fopen(midi->midi_filename, "wb");
+    FileInfo_fwrite(fi, buffer, pos, 1);
+    FileInfo_free(fi);
+    free(buffer);
+
+    fi = FileInfo_fopen(midi->midi_filename, "rb");
+    midi->midi = MidiFile_new_from_file(fi);
+    FileInfo_free(fi);
+
+    midi->options = MidiConvertOptions_new();
+
+    TRACE_LEAVE(__func__)
+
+    return midi;
+}
+
+static void bench_midi_teardown(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchMidiState *midi = (struct BenchMidiState *)state;
+
+    MidiFile_free(midi->midi);
+    MidiConvertOptions_free(midi->options);
+    unlink(midi->midi_filename);
+    rmdir(midi->dir);
+    free(midi);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Same steps as midi2cseq followed by cseq2midi (with pattern compression).
+*/
+static void bench_midi_roundtrip_run(void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct BenchMidiState *midi = (struct BenchMidiState *)state;
+    struct CseqFile *cseq;
+    struct MidiFile *result;
+
+    cseq = CseqFile_from_MidiFile(midi->midi, midi->options);
+    result = MidiFile_from_CseqFile(cseq, midi->options);
+
+    MidiFile_free(result);
+    CseqFile_free(cseq);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Writes MIDI track events: tempo (first track only), program change,
+ * then a phrase of notes repeated with occasional changes.
+ * @param buffer: buffer to write to.
+ * @param channel: MIDI channel for events.
+ * @param seed: in/out. Generator state.
+ * @returns: number of bytes written.
+*/
+static size_t bench_midi_write_track(uint8_t *buffer, int channel, uint32_t *seed)
+{
+    TRACE_ENTER(__func__)
+
+    uint8_t phrase[BENCH_MIDI_PHRASE_LEN];
+    size_t pos = 0;
+    int repeat;
+    int i;
+
+    if (channel == 0)
+    {
+        // tempo, 120 bpm
+        buffer[pos++] = 0x00;
+        buffer[pos++] = 0xff;
+        buffer[pos++] = 0x51;
+        buffer[pos++] = 0x03;
+        buffer[pos++] = 0x07;
+        buffer[pos++] = 0xa1;
+        buffer[pos++] = 0x20;
+    }
+
+    buffer[pos++] = 0x00;
+    buffer[pos++] = (uint8_t)(0xc0 | channel);
+    buffer[pos++] = (uint8_t)(bench_rand(seed) & 0x7f);
+
+    for (i=0; i<BENCH_MIDI_PHRASE_LEN; i++)
+    {
+        phrase[i] = (uint8_t)(36 + bench_rand(seed) % 48);
+    }
+
+    for (repeat=0; repeat<BENCH_MIDI_PHRASE_REPEAT; repeat++)
+    {
+        // change one note one time in four
+        if ((bench_rand(seed) & 0x3) == 0)
+        {
+            phrase[bench_rand(seed) % BENCH_MIDI_PHRASE_LEN] = (uint8_t)(36 + bench_rand(seed) % 48);
+        }
+
+        for (i=0; i<BENCH_MIDI_PHRASE_LEN; i++)
+        {
+            pos += (size_t)varint_write_int32(&buffer[pos], BENCH_MIDI_DIVISION / 4);
+            buffer[pos++] = (uint8_t)(0x90 | channel);
+            buffer[pos++] = phrase[i];
+            buffer[pos++] = 100;
+
+            pos += (size_t)varint_write_int32(&buffer[pos], BENCH_MIDI_DIVISION / 4);
+            buffer[pos++] = (uint8_t)(0x80 | channel);
+            buffer[pos++] = phrase[i];
+            buffer[pos++] = 0;
+        }
+    }
+
+    // end of track
+    buffer[pos++] = 0x00;
+    buffer[pos++] = 0xff;
+    buffer[pos++] = 0x2f;
+    buffer[pos++] = 0x00;
+
+    TRACE_LEAVE(__func__)
+
+    return pos;
+}
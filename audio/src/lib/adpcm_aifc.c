@@ -39,15 +39,91 @@
 */
 int g_AdpcmLoopInfiniteExportCount = 0;
 
-// measure codebook predictor error
-static double g_square_error = 0.0;
-// measure quantization error
-static long g_quantize_error = 0;
+/**
+ * When set, the encoder evaluates every scale in order instead of the pruned
+ * scale search. Both choose the same scale, this is used to verify that.
+*/
+int g_AdpcmEncodeExhaustiveScaleSearch = 0;
+
+/**
+ * When set (default), the encoder measures residuals and square error with
+ * 64-bit integers. Otherwise square error is accumulated as float, which can
+ * round differently depending on compiler and flags.
+*/
+int g_AdpcmEncodeIntegerErrorMetric = 1;
+
+/**
+ * Number of samples byte swapped at a time when decoding uncompressed audio to file.
+*/
+#define ADPCM_DECODE_OUTPUT_BLOCK_LEN 2048
+
+/**
+ * Destination of decoded audio, either a memory buffer or a file.
+*/
+struct AdpcmDecodeOutput {
+    /**
+     * Output buffer, or NULL to write to {@code fi}.
+    */
+    uint8_t *buffer;
+
+    /**
+     * Output file, used when {@code buffer} is NULL.
+    */
+    struct FileInfo *fi;
+};
+
+/**
+ * Result of encoding a single frame, see {@code AdpcmAifcFile_encode_frame}.
+*/
+struct AdpcmAifcEncodeMemoEntry {
+    // flag, set once the entry holds a result.
+    int used;
+
+    // hash of {@code samples} and {@code state_in}.
+    uint32_t hash;
+
+    // key: frame sound data.
+    int16_t samples[FRAME_DECODE_BUFFER_LEN];
+
+    // key: state before encoding the frame.
+    int32_t state_in[ADPCM_ENCODE_MEMO_MAX_ORDER];
+
+    // state after encoding the frame.
+    int32_t state_out[ADPCM_ENCODE_MEMO_MAX_ORDER];
+
+    // encoded frame.
+    uint8_t frame[ADPCM_ENCODE_FRAME_LEN];
+
+    // error stats added when the frame was encoded.
+    struct AdpcmAifcEncodeStats stats;
+};
+
+/**
+ * Frame encode results, indexed by hash. A colliding frame replaces the
+ * previous entry.
+*/
+struct AdpcmAifcEncodeMemo {
+    // codebook used to encode the entries.
+    struct AdpcmAifcCodebookChunk *codes_chunk;
+
+    struct AdpcmAifcEncodeMemoEntry entries[ADPCM_ENCODE_MEMO_SIZE];
+};
 
 // forward declarations
 
 static uint8_t get_sound_chunk_byte(struct AdpcmAifcFile *aaf, size_t *ssnd_chunk_pos, int *eof);
 static void write_frame_output(uint8_t *out, int32_t *data, size_t size);
+static size_t AdpcmAifcFile_decode_internal(struct AdpcmAifcFile *aaf, struct AdpcmDecodeOutput *out, size_t max_len);
+static void AdpcmAifcFile_fwrite_chunk(void *chunk, struct FileInfo *fi);
+static void AdpcmAifcEncoder_encode_pending(struct AdpcmAifcEncoder *encoder);
+static void AdpcmAifcEncoder_flush(struct AdpcmAifcEncoder *encoder);
+static void AdpcmAifcFile_encode_frame_search(struct AdpcmAifcFile *aaf, int16_t *samples_in, int32_t *apc_state, uint8_t *frame, struct AdpcmAifcEncodeStats *stats_out);
+static int32_t AdpcmAifcFile_encode_frame_scale(int32_t **coef, int order, int16_t *samples_in, int32_t *apc_state, int32_t scale, int32_t clip_limit, int32_t *working, int32_t *encode, long *scale_error_out);
+static int AdpcmAifcEncodeMemo_is_silence(int16_t *samples_in, int32_t *apc_state, int order);
+static uint32_t AdpcmAifcEncodeMemo_hash(int16_t *samples_in, int32_t *apc_state, int order);
+static struct AdpcmAifcEncodeMemo *AdpcmAifcFile_get_encode_memo(struct AdpcmAifcFile *aaf);
+static void decode_output_bswap16(struct AdpcmDecodeOutput *out, size_t pos, uint8_t *src, int num_16);
+static void decode_output_frame(struct AdpcmDecodeOutput *out, size_t pos, int32_t *data, size_t size);
 static struct AdpcmAifcCommChunk *AdpcmAifcCommChunk_new_from_file(struct FileInfo *fi, int32_t ck_data_size);
 static struct AdpcmAifcApplicationChunk *AdpcmAifcApplicationChunk_new_from_file(struct FileInfo *fi, int32_t ck_data_size);
 static struct AdpcmAifcSoundChunk *AdpcmAifcSoundChunk_new_from_file(struct FileInfo *fi, int32_t ck_data_size);
@@ -813,59 +889,70 @@ void AdpcmAifcFile_fwrite(struct AdpcmAifcFile *aaf, struct FileInfo *fi)
 
     for (i=0; i<aaf->chunk_count; i++)
     {
-        uint32_t ck_id = *(uint32_t*)aaf->chunks[i];
-        switch (ck_id)
+        AdpcmAifcFile_fwrite_chunk(aaf->chunks[i], fi);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Write a single .aifc chunk to disk, according to chunk type.
+ * Unsupported chunks are ignored.
+ * @param chunk: chunk to write.
+ * @param fi: FileInfo to write to. Uses current seek position.
+*/
+static void AdpcmAifcFile_fwrite_chunk(void *chunk, struct FileInfo *fi)
+{
+    TRACE_ENTER(__func__)
+
+    uint32_t ck_id = *(uint32_t*)chunk;
+    switch (ck_id)
+    {
+        case ADPCM_AIFC_COMMON_CHUNK_ID: // COMM
+        {
+            AdpcmAifcCommChunk_fwrite((struct AdpcmAifcCommChunk *)chunk, fi);
+        }
+        break;
+
+        case ADPCM_AIFC_SOUND_CHUNK_ID: // SSND
+        {
+            AdpcmAifcSoundChunk_fwrite((struct AdpcmAifcSoundChunk *)chunk, fi);
+        }
+        break;
+
+        case ADPCM_AIFC_APPLICATION_CHUNK_ID: // APPL
         {
-            case ADPCM_AIFC_COMMON_CHUNK_ID: // COMM
+            struct AdpcmAifcApplicationChunk *basechunk = (struct AdpcmAifcApplicationChunk *)chunk;
+            // code_string doesn't have terminating zero, requires explicit length
+            if (strncmp(basechunk->code_string, ADPCM_AIFC_VADPCM_CODES_NAME, ADPCM_AIFC_VADPCM_APPL_NAME_LEN) == 0)
             {
-                struct AdpcmAifcCommChunk *chunk = (struct AdpcmAifcCommChunk *)aaf->chunks[i];
-                AdpcmAifcCommChunk_fwrite(chunk, fi);
+                AdpcmAifcCodebookChunk_fwrite((struct AdpcmAifcCodebookChunk *)basechunk, fi);
             }
-            break;
-
-            case ADPCM_AIFC_SOUND_CHUNK_ID: // SSND
+            else if (strncmp(basechunk->code_string, ADPCM_AIFC_VADPCM_LOOPS_NAME, ADPCM_AIFC_VADPCM_APPL_NAME_LEN) == 0)
             {
-                struct AdpcmAifcSoundChunk *chunk = (struct AdpcmAifcSoundChunk *)aaf->chunks[i];
-                AdpcmAifcSoundChunk_fwrite(chunk, fi);
+                AdpcmAifcLoopChunk_fwrite((struct AdpcmAifcLoopChunk *)basechunk, fi);
             }
-            break;
-
-            case ADPCM_AIFC_APPLICATION_CHUNK_ID: // APPL
+            // else, ignore unsupported
+            else
             {
-                struct AdpcmAifcApplicationChunk *basechunk = (struct AdpcmAifcApplicationChunk *)aaf->chunks[i];
-                // code_string doesn't have terminating zero, requires explicit length
-                if (strncmp(basechunk->code_string, ADPCM_AIFC_VADPCM_CODES_NAME, ADPCM_AIFC_VADPCM_APPL_NAME_LEN) == 0)
-                {
-                    struct AdpcmAifcCodebookChunk *chunk = (struct AdpcmAifcCodebookChunk *)basechunk;
-                    AdpcmAifcCodebookChunk_fwrite(chunk, fi);
-                }
-                else if (strncmp(basechunk->code_string, ADPCM_AIFC_VADPCM_LOOPS_NAME, ADPCM_AIFC_VADPCM_APPL_NAME_LEN) == 0)
-                {
-                    struct AdpcmAifcLoopChunk *chunk = (struct AdpcmAifcLoopChunk *)basechunk;
-                    AdpcmAifcLoopChunk_fwrite(chunk, fi);
-                }
-                // else, ignore unsupported
-                else
+                if (g_verbosity >= 2)
                 {
-                    if (g_verbosity >= 2)
-                    {
-                        // no terminating zero, requires explicit length
-                        printf("AdpcmAifcFile_fwrite: APPL ignore code_string '%.*s'\n", ADPCM_AIFC_VADPCM_APPL_NAME_LEN, basechunk->code_string);
-                    }
+                    // no terminating zero, requires explicit length
+                    printf("AdpcmAifcFile_fwrite: APPL ignore code_string '%.*s'\n", ADPCM_AIFC_VADPCM_APPL_NAME_LEN, basechunk->code_string);
                 }
             }
-            break;
+        }
+        break;
 
-            default:
-                // ignore unsupported
+        default:
+            // ignore unsupported
+        {
+            if (g_verbosity >= 2)
             {
-                if (g_verbosity >= 2)
-                {
-                    printf("AdpcmAifcFile_fwrite: ignore ck_id 0x%08x\n", ck_id);
-                }
+                printf("AdpcmAifcFile_fwrite: ignore ck_id 0x%08x\n", ck_id);
             }
-            break;
         }
+        break;
     }
 
     TRACE_LEAVE(__func__)
@@ -921,8 +1008,7 @@ size_t AdpcmAifcFile_encode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t b
         && aaf->loop_chunk->nloops == 1
         && aaf->loop_chunk->loop_data != NULL;
 
-    g_square_error = 0.0f;
-    g_quantize_error = 0;
+    memset(&aaf->encode_stats, 0, sizeof(struct AdpcmAifcEncodeStats));
 
     /**
      * If this is uncompressed audio then there's no codebook.
@@ -950,16 +1036,18 @@ size_t AdpcmAifcFile_encode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t b
             // adjust count to 16-byte pieces.
             int num_16 = buffer_len / 2;
             bswap16_chunk(aaf->sound_chunk->sound_data, buffer, num_16);
+            write_len = num_16 * 2;
         }
         else
         {
             memcpy(aaf->sound_chunk->sound_data, buffer, buffer_len);
+            write_len = buffer_len;
         }
 
         // last debug statement, not protected by DEBUG_ADPCMAIFCFILE_DECODE
         if (g_verbosity >= VERBOSE_DEBUG)
         {
-            printf("%s %d> write_len=%ld\n", __func__, __LINE__, buffer_len);
+            printf("%s %d> write_len=%ld\n", __func__, __LINE__, write_len);
         }
     }
     else if (aaf->comm_chunk->compression_type == ADPCM_AIFC_VAPC_COMPRESSION_TYPE_ID)
@@ -1078,7 +1166,7 @@ size_t AdpcmAifcFile_encode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t b
             write_len += encode_bytes;
         }
 
-        free(apc_state);
+        gaudio_free(apc_state);
 
         // last debug statement, not protected by DEBUG_ADPCMAIFCFILE_ENCODE
         if (g_verbosity >= VERBOSE_DEBUG)
@@ -1107,10 +1195,11 @@ size_t AdpcmAifcFile_encode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t b
 
     if (g_verbosity >= 2)
     {
-        printf("g_square_error: %.05e\n", g_square_error);
+        printf("square_error: %.05e\n", aaf->encode_stats.square_error);
 
-        double dqe = (double)g_quantize_error;
-        printf("g_quantize_error: %.05e\n", dqe);
+        double dqe = (double)aaf->encode_stats.quantize_error;
+        printf("quantize_error: %.05e\n", dqe);
+        printf("max_clip: %d\n", aaf->encode_stats.max_clip);
     }
 
     TRACE_LEAVE(__func__)
@@ -1118,43 +1207,98 @@ size_t AdpcmAifcFile_encode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t b
 }
 
 /**
- * Decode .aifc audio and write to output buffer.
- * If the audio is compressed, this is the top level entry into decompressing it.
- * @param aaf: input source
- * @param buffer: output buffer. Must be previously allocated.
- * @param max_len: max number of bytes to write to output buffer.
- * @returns: number of bytes written
+ * Decodes the sound data (loops are not expanded) and measures it against the
+ * samples it was encoded from.
+ * @param aaf: .aifc with "VAPC" compressed sound data, see {@code AdpcmAifcFile_encode}.
+ * @param buffer: samples {@code aaf} was encoded from, same as passed to {@code AdpcmAifcFile_encode}.
+ * @param buffer_len: Length in bytes of {@code buffer}.
+ * @returns: sum of squared difference between decoded and source samples.
 */
-size_t AdpcmAifcFile_decode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t max_len)
+int64_t AdpcmAifcFile_decode_square_error(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t buffer_len)
 {
     TRACE_ENTER(__func__)
 
+    if (aaf == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> aaf is NULL\n", __func__, __LINE__);
+    }
+
+    if (aaf->comm_chunk == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> aaf->comm_chunk is NULL\n", __func__, __LINE__);
+    }
+
+    if (aaf->sound_chunk == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> aaf->sound_chunk is NULL\n", __func__, __LINE__);
+    }
+
     if (buffer == NULL)
     {
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> buffer is NULL\n", __func__, __LINE__);
     }
 
-    size_t write_len = 0;
+    if (aaf->comm_chunk->compression_type != ADPCM_AIFC_VAPC_COMPRESSION_TYPE_ID)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> unsupported compression type 0x%08x\n", __func__, __LINE__, aaf->comm_chunk->compression_type);
+    }
+
+    int32_t frame_buffer[FRAME_DECODE_BUFFER_LEN];
+    int16_t sample_buffer[FRAME_DECODE_BUFFER_LEN];
     size_t ssnd_chunk_pos = 0;
+    size_t sound_data_pos = 0;
+    size_t num_samples;
     int end_of_ssnd = 0;
-    int i;
-    int no_loop_chunk;
+    int64_t result = 0;
+    int64_t diff;
+    size_t i;
 
-    // counter for doing chunk-size bswap16
-    int num_16;
+    // decoder starts from zero state, same as the encoder.
+    memset(frame_buffer, 0, FRAME_DECODE_BUFFER_LEN * sizeof(int32_t));
 
-    // determine max size in bytes to read from input .aifc
-    int32_t ssnd_data_size = aaf->sound_chunk->ck_data_size - 8;
-    if (ssnd_data_size < 0)
+    while (sound_data_pos < buffer_len && end_of_ssnd == 0)
     {
-        ssnd_data_size = 0;
-    }
+        num_samples = fill_16bit_buffer(
+            sample_buffer,
+            FRAME_DECODE_BUFFER_LEN,
+            buffer,
+            &sound_data_pos,
+            buffer_len) / 2;
 
-    if ((size_t)ssnd_data_size > max_len)
-    {
-        ssnd_data_size = (int32_t)max_len;
+        if (g_encode_bswap)
+        {
+            bswap16_chunk(sample_buffer, sample_buffer, FRAME_DECODE_BUFFER_LEN); // inplace swap is ok
+        }
+
+        AdpcmAifcFile_decode_frame(aaf, frame_buffer, &ssnd_chunk_pos, &end_of_ssnd);
+
+        // same clamp as decode output.
+        for (i = 0; i < num_samples; i++)
+        {
+            diff = (int64_t)clamp(frame_buffer[i], -0x7fff, 0x7fff) - (int64_t)sample_buffer[i];
+            result += diff * diff;
+        }
     }
 
+    TRACE_LEAVE(__func__)
+    return result;
+}
+
+/**
+ * Begin encoding audio to file a block at a time. Writes the .aifc header
+ * and all chunks of {@code aaf}, followed by an empty sound chunk header.
+ * Sizes, sample count and loop state are updated by {@code AdpcmAifcEncoder_close}.
+ * This assumes "comm" chunk (and codebook, and "loop" if used) already
+ * exist with all parameters set, the same as {@code AdpcmAifcFile_encode}.
+ * @param aaf: .aifc container with header chunks. Must not have a sound chunk.
+ * Not owned by the encoder, but must remain valid until the encoder is freed.
+ * @param fi: FileInfo to write to. Uses current seek position.
+ * @returns: pointer to new encoder.
+*/
+struct AdpcmAifcEncoder *AdpcmAifcEncoder_new(struct AdpcmAifcFile *aaf, struct FileInfo *fi)
+{
+    TRACE_ENTER(__func__)
+
     if (aaf == NULL)
     {
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> aaf is NULL\n", __func__, __LINE__);
@@ -1165,93 +1309,474 @@ size_t AdpcmAifcFile_decode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t m
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> aaf->comm_chunk is NULL\n", __func__, __LINE__);
     }
 
-    no_loop_chunk = aaf->loop_chunk == NULL
-        // there is a loop chunk, but nloops is zero
-        || (aaf->loop_chunk != NULL && aaf->loop_chunk->nloops == 0)
-        // there is a loop, but it's an infinite loop, and user option is to ignore
-        || (aaf->loop_chunk != NULL && aaf->loop_chunk->loop_data != NULL && aaf->loop_chunk->loop_data->count == -1 && g_AdpcmLoopInfiniteExportCount == 0);
+    if (fi == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> fi is NULL\n", __func__, __LINE__);
+    }
+
+    if (aaf->sound_chunk != NULL)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> aaf already has sound chunk\n", __func__, __LINE__);
+    }
+
+    struct AdpcmAifcEncoder *encoder;
+    int i;
+    int32_t placeholder = 0;
+
+    encoder = (struct AdpcmAifcEncoder *)malloc_zero(1, sizeof(struct AdpcmAifcEncoder));
+    encoder->aaf = aaf;
+    encoder->fi = fi;
+    encoder->loop_offset = -1;
+
+    encoder->use_loop = aaf->loop_chunk != NULL
+        && aaf->loop_chunk->nloops == 1
+        && aaf->loop_chunk->loop_data != NULL;
+
+    memset(&aaf->encode_stats, 0, sizeof(struct AdpcmAifcEncodeStats));
 
-    /**
-     * If this is uncompressed audio then there's no codebook.
-    */
     if (aaf->comm_chunk->compression_type == ADPCM_AIFC_NONE_COMPRESSION_TYPE_ID)
     {
-        if (g_verbosity >= VERBOSE_DEBUG)
+        // no compression means there's nothing to do for the loop state.
+        encoder->use_loop = 0;
+    }
+    else if (aaf->comm_chunk->compression_type == ADPCM_AIFC_VAPC_COMPRESSION_TYPE_ID)
+    {
+        if (aaf->codes_chunk == NULL)
         {
-            printf("compression type=NONE\n");
+            stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> aaf->codes_chunk is NULL\n", __func__, __LINE__);
         }
 
-        if (ssnd_data_size & 0x1)
+        if (aaf->codes_chunk->coef_table == NULL)
         {
-            fflush_printf(stderr, "warning, ssnd_data_size is odd, truncating last byte (required for bswap)\n");
-            ssnd_data_size--;
+            stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> aaf->codes_chunk->coef_table is NULL\n", __func__, __LINE__);
         }
 
-        if (no_loop_chunk)
+        if (aaf->codes_chunk->order < 1)
         {
-            if (g_verbosity >= VERBOSE_DEBUG)
-            {
-                printf("not looping\n");
-            }
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid order: %d\n", __func__, __LINE__, aaf->codes_chunk->order);
+        }
 
-            // adjust count to 16-byte pieces.
-            num_16 = ssnd_data_size / 2;
-            bswap16_chunk(buffer, aaf->sound_chunk->sound_data, num_16);
+        if (aaf->codes_chunk->nentries < 1)
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid nentries: %d\n", __func__, __LINE__, aaf->codes_chunk->nentries);
+        }
 
-            // last debug statement, not protected by DEBUG_ADPCMAIFCFILE_DECODE
-            if (g_verbosity >= VERBOSE_DEBUG)
-            {
-                printf("%s %d> write_len=%d\n", __func__, __LINE__, num_16 * 2);
-            }
+        if (encoder->use_loop && aaf->loop_chunk->loop_data->start > aaf->loop_chunk->loop_data->end)
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d> loop start=%d > loop end=%d\n", __func__, __LINE__, aaf->loop_chunk->loop_data->start, aaf->loop_chunk->loop_data->end);
+        }
 
-            TRACE_LEAVE(__func__)
-            return ssnd_data_size;
+        encoder->apc_state = (int32_t *)malloc_zero(aaf->codes_chunk->order, sizeof(int32_t));
+    }
+    else
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> unsupported compression type 0x%08x\n", __func__, __LINE__, aaf->comm_chunk->compression_type);
+    }
+
+    if (g_verbosity >= VERBOSE_DEBUG)
+    {
+        printf("write loop data=%d\n", encoder->use_loop);
+    }
+
+    encoder->block = AdpcmAifcSoundChunk_new(ADPCM_AIFC_ENCODER_BLOCK_LEN);
+
+    encoder->form_offset = FileInfo_ftell(fi);
+    FileInfo_fwrite_bswap(fi, &aaf->ck_id, 4, 1);
+    FileInfo_fwrite_bswap(fi, &placeholder, 4, 1);
+    FileInfo_fwrite_bswap(fi, &aaf->form_type, 4, 1);
+
+    for (i=0; i<aaf->chunk_count; i++)
+    {
+        if (aaf->chunks[i] == aaf->comm_chunk)
+        {
+            encoder->comm_offset = FileInfo_ftell(fi);
         }
-        else
+        else if (aaf->chunks[i] == aaf->loop_chunk)
         {
-            /**
-             * (slightly different from AL_ADPCM_WAVE)
-             * Otherwise there are loops. Well, only one loop since the N64 only supports one loop.
-             * The logic here is roughly:
-             * - copy samples up to loop start
-             * - copy loop data for the specified number of times
-             * - copy any remaining samples after loop end marker
-            */
+            encoder->loop_offset = FileInfo_ftell(fi);
+        }
 
-            struct AdpcmAifcLoopData *loop_data;
+        AdpcmAifcFile_fwrite_chunk(aaf->chunks[i], fi);
+    }
 
-            // byte offset into ssnd chunk
-            size_t loop_start_position;
+    // sound chunk header, size is set on close.
+    encoder->sound_offset = FileInfo_ftell(fi);
+    FileInfo_fwrite_bswap(fi, &encoder->block->ck_id, 4, 1);
+    FileInfo_fwrite_bswap(fi, &placeholder, 4, 1);
+    FileInfo_fwrite_bswap(fi, &encoder->block->offset, 4, 1);
+    FileInfo_fwrite_bswap(fi, &encoder->block->block_size, 4, 1);
 
-            // byte offset into ssnd chunk
-            size_t loop_end_position;
+    TRACE_LEAVE(__func__)
 
-            size_t loop_size_bytes;
+    return encoder;
+}
 
-            size_t after_loop_bytes;
+/**
+ * Encode 16-bit PCM samples and write to file. Input may be split at any
+ * byte offset between calls; partial frames are kept until more data arrives.
+ * @param encoder: encoder.
+ * @param data: samples.
+ * @param len: length in bytes of {@code data}.
+*/
+void AdpcmAifcEncoder_write(struct AdpcmAifcEncoder *encoder, const uint8_t *data, size_t len)
+{
+    TRACE_ENTER(__func__)
 
-            // number of times to decode loop data
-            int loop_times;
+    if (encoder == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> encoder is NULL\n", __func__, __LINE__);
+    }
 
-            if (g_verbosity >= VERBOSE_DEBUG)
-            {
-                printf("loop chunk\n");
-            }
+    if (data == NULL && len > 0)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> data is NULL\n", __func__, __LINE__);
+    }
 
-            if (aaf->loop_chunk->nloops != 1)
-            {
-                stderr_exit(EXIT_CODE_GENERAL, "%s %d> N64 only supports single loop, aaf->loop_chunk->nloops=%d\n", __func__, __LINE__, aaf->loop_chunk->nloops);
-            }
+    while (len > 0)
+    {
+        size_t n = sizeof(encoder->frame) - encoder->frame_len;
 
-            loop_data = aaf->loop_chunk->loop_data;
+        if (n > len)
+        {
+            n = len;
+        }
 
-            if (loop_data == NULL)
-            {
-                stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> loop_data pointer is NULL\n", __func__, __LINE__);
-            }
+        memcpy(&encoder->frame[encoder->frame_len], data, n);
+        encoder->frame_len += n;
+        data += n;
+        len -= n;
 
-            if (loop_data->start < 0)
-            {
+        if (encoder->frame_len == sizeof(encoder->frame))
+        {
+            AdpcmAifcEncoder_encode_pending(encoder);
+        }
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Encode any remaining partial frame (zero padded), write remaining data,
+ * and update the .aifc header, comm and loop chunks, and sound chunk size.
+ * The file position is left at the end of the .aifc file.
+ * @param encoder: encoder.
+ * @returns: number of sound data bytes written.
+*/
+size_t AdpcmAifcEncoder_close(struct AdpcmAifcEncoder *encoder)
+{
+    TRACE_ENTER(__func__)
+
+    if (encoder == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> encoder is NULL\n", __func__, __LINE__);
+    }
+
+    struct AdpcmAifcFile *aaf = encoder->aaf;
+    struct FileInfo *fi = encoder->fi;
+    long end_offset;
+    int32_t size;
+
+    if (encoder->frame_len > 0)
+    {
+        AdpcmAifcEncoder_encode_pending(encoder);
+    }
+
+    AdpcmAifcEncoder_flush(encoder);
+
+    if (encoder->sound_data_pos == 0)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> no sound data\n", __func__, __LINE__);
+    }
+
+    if (encoder->use_loop)
+    {
+        if ((size_t)aaf->loop_chunk->loop_data->start * 2 > encoder->sound_data_pos)
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d> loop_start_byte=%d > buffer_len=%ld\n", __func__, __LINE__, aaf->loop_chunk->loop_data->start * 2, encoder->sound_data_pos);
+        }
+
+        if ((size_t)aaf->loop_chunk->loop_data->end * 2 > encoder->sound_data_pos)
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d> loop_end_byte=%d > buffer_len=%ld\n", __func__, __LINE__, aaf->loop_chunk->loop_data->end * 2, encoder->sound_data_pos);
+        }
+
+        if (encoder->found_loop_state == 0)
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d> expected loop state information, but that was never set\n", __func__, __LINE__);
+        }
+    }
+
+    // set the "num_sample_frames" field, which should be the size of the uncompressed data
+    aaf->comm_chunk->num_sample_frames = encoder->sound_data_pos / 2; // 16 bit samples
+
+    end_offset = FileInfo_ftell(fi);
+
+    if (end_offset - encoder->form_offset - 8 > INT32_MAX)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> .aifc too large: %ld\n", __func__, __LINE__, end_offset - encoder->form_offset);
+    }
+
+    aaf->ck_data_size = (int32_t)(end_offset - encoder->form_offset - 8);
+
+    FileInfo_fseek(fi, encoder->form_offset + 4, SEEK_SET);
+    FileInfo_fwrite_bswap(fi, &aaf->ck_data_size, 4, 1);
+
+    FileInfo_fseek(fi, encoder->comm_offset, SEEK_SET);
+    AdpcmAifcCommChunk_fwrite(aaf->comm_chunk, fi);
+
+    if (encoder->use_loop && encoder->loop_offset >= 0)
+    {
+        FileInfo_fseek(fi, encoder->loop_offset, SEEK_SET);
+        AdpcmAifcLoopChunk_fwrite(aaf->loop_chunk, fi);
+    }
+
+    size = (int32_t)(8 + encoder->write_len); // 8 = sizeof offset,block_size
+    FileInfo_fseek(fi, encoder->sound_offset + 4, SEEK_SET);
+    FileInfo_fwrite_bswap(fi, &size, 4, 1);
+
+    FileInfo_fseek(fi, end_offset, SEEK_SET);
+
+    if (g_verbosity >= 2)
+    {
+        printf("square_error: %.05e\n", aaf->encode_stats.square_error);
+
+        double dqe = (double)aaf->encode_stats.quantize_error;
+        printf("quantize_error: %.05e\n", dqe);
+        printf("max_clip: %d\n", aaf->encode_stats.max_clip);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return encoder->write_len;
+}
+
+/**
+ * Frees memory allocated to encoder. Does not free the .aifc container or file.
+ * @param encoder: object to free.
+*/
+void AdpcmAifcEncoder_free(struct AdpcmAifcEncoder *encoder)
+{
+    TRACE_ENTER(__func__)
+
+    if (encoder == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    if (encoder->block != NULL)
+    {
+        AdpcmAifcSoundChunk_free(encoder->block);
+    }
+
+    if (encoder->apc_state != NULL)
+    {
+        gaudio_free(encoder->apc_state);
+    }
+
+    gaudio_free(encoder);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Decode .aifc audio and write to output buffer.
+ * If the audio is compressed, this is the top level entry into decompressing it.
+ * @param aaf: input source
+ * @param buffer: output buffer. Must be previously allocated.
+ * @param max_len: max number of bytes to write to output buffer.
+ * @returns: number of bytes written
+*/
+size_t AdpcmAifcFile_decode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t max_len)
+{
+    TRACE_ENTER(__func__)
+
+    if (aaf == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> aaf is NULL\n", __func__, __LINE__);
+    }
+
+    if (buffer == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> buffer is NULL\n", __func__, __LINE__);
+    }
+
+    struct AdpcmDecodeOutput out;
+    size_t write_len;
+
+    memset(&out, 0, sizeof(struct AdpcmDecodeOutput));
+    out.buffer = buffer;
+
+    write_len = AdpcmAifcFile_decode_internal(aaf, &out, max_len);
+
+    TRACE_LEAVE(__func__)
+
+    return write_len;
+}
+
+/**
+ * Decode .aifc audio and write to file, without holding the decoded audio in memory.
+ * Output is the same as {@code AdpcmAifcFile_decode}, loops are expanded the same way.
+ * @param aaf: input source
+ * @param fi: File handle to write to, using current offset.
+ * @returns: number of bytes written
+*/
+size_t AdpcmAifcFile_decode_fwrite(struct AdpcmAifcFile *aaf, struct FileInfo *fi)
+{
+    TRACE_ENTER(__func__)
+
+    if (aaf == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> aaf is NULL\n", __func__, __LINE__);
+    }
+
+    if (fi == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> fi is NULL\n", __func__, __LINE__);
+    }
+
+    struct AdpcmDecodeOutput out;
+    size_t write_len;
+
+    memset(&out, 0, sizeof(struct AdpcmDecodeOutput));
+    out.fi = fi;
+
+    write_len = AdpcmAifcFile_decode_internal(aaf, &out, SIZE_MAX);
+
+    TRACE_LEAVE(__func__)
+
+    return write_len;
+}
+
+/**
+ * Decode .aifc audio, see {@code AdpcmAifcFile_decode}.
+ * @param aaf: input source
+ * @param out: destination.
+ * @param max_len: max number of bytes to write.
+ * @returns: number of bytes written
+*/
+static size_t AdpcmAifcFile_decode_internal(struct AdpcmAifcFile *aaf, struct AdpcmDecodeOutput *out, size_t max_len)
+{
+    TRACE_ENTER(__func__)
+
+    size_t write_len = 0;
+    size_t ssnd_chunk_pos = 0;
+    int end_of_ssnd = 0;
+    int i;
+    int no_loop_chunk;
+
+    // counter for doing chunk-size bswap16
+    int num_16;
+
+    // determine max size in bytes to read from input .aifc
+    int32_t ssnd_data_size = aaf->sound_chunk->ck_data_size - 8;
+    if (ssnd_data_size < 0)
+    {
+        ssnd_data_size = 0;
+    }
+
+    if ((size_t)ssnd_data_size > max_len)
+    {
+        ssnd_data_size = (int32_t)max_len;
+    }
+
+    if (aaf == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> aaf is NULL\n", __func__, __LINE__);
+    }
+
+    if (aaf->comm_chunk == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> aaf->comm_chunk is NULL\n", __func__, __LINE__);
+    }
+
+    no_loop_chunk = aaf->loop_chunk == NULL
+        // there is a loop chunk, but nloops is zero
+        || (aaf->loop_chunk != NULL && aaf->loop_chunk->nloops == 0)
+        // there is a loop, but it's an infinite loop, and user option is to ignore
+        || (aaf->loop_chunk != NULL && aaf->loop_chunk->loop_data != NULL && aaf->loop_chunk->loop_data->count == -1 && g_AdpcmLoopInfiniteExportCount == 0);
+
+    /**
+     * If this is uncompressed audio then there's no codebook.
+    */
+    if (aaf->comm_chunk->compression_type == ADPCM_AIFC_NONE_COMPRESSION_TYPE_ID)
+    {
+        if (g_verbosity >= VERBOSE_DEBUG)
+        {
+            printf("compression type=NONE\n");
+        }
+
+        if (ssnd_data_size & 0x1)
+        {
+            fflush_printf(stderr, "warning, ssnd_data_size is odd, truncating last byte (required for bswap)\n");
+            ssnd_data_size--;
+        }
+
+        if (no_loop_chunk)
+        {
+            if (g_verbosity >= VERBOSE_DEBUG)
+            {
+                printf("not looping\n");
+            }
+
+            // adjust count to 16-byte pieces.
+            num_16 = ssnd_data_size / 2;
+            decode_output_bswap16(out, 0, aaf->sound_chunk->sound_data, num_16);
+
+            // last debug statement, not protected by DEBUG_ADPCMAIFCFILE_DECODE
+            if (g_verbosity >= VERBOSE_DEBUG)
+            {
+                printf("%s %d> write_len=%d\n", __func__, __LINE__, num_16 * 2);
+            }
+
+            TRACE_LEAVE(__func__)
+            return ssnd_data_size;
+        }
+        else
+        {
+            /**
+             * (slightly different from AL_ADPCM_WAVE)
+             * Otherwise there are loops. Well, only one loop since the N64 only supports one loop.
+             * The logic here is roughly:
+             * - copy samples up to loop start
+             * - copy loop data for the specified number of times
+             * - copy any remaining samples after loop end marker
+            */
+
+            struct AdpcmAifcLoopData *loop_data;
+
+            // byte offset into ssnd chunk
+            size_t loop_start_position;
+
+            // byte offset into ssnd chunk
+            size_t loop_end_position;
+
+            size_t loop_size_bytes;
+
+            size_t after_loop_bytes;
+
+            // number of times to decode loop data
+            int loop_times;
+
+            if (g_verbosity >= VERBOSE_DEBUG)
+            {
+                printf("loop chunk\n");
+            }
+
+            if (aaf->loop_chunk->nloops != 1)
+            {
+                stderr_exit(EXIT_CODE_GENERAL, "%s %d> N64 only supports single loop, aaf->loop_chunk->nloops=%d\n", __func__, __LINE__, aaf->loop_chunk->nloops);
+            }
+
+            loop_data = aaf->loop_chunk->loop_data;
+
+            if (loop_data == NULL)
+            {
+                stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> loop_data pointer is NULL\n", __func__, __LINE__);
+            }
+
+            if (loop_data->start < 0)
+            {
                 stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid loop_data->start offset: %d\n", __func__, __LINE__, loop_data->start);
             }
 
@@ -1301,7 +1826,7 @@ size_t AdpcmAifcFile_decode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t m
                 // adjust count to 16-byte pieces.
                 num_16 = (loop_start_position - 2) / 2;
 
-                bswap16_chunk(&buffer[write_len], &aaf->sound_chunk->sound_data[0], num_16);
+                decode_output_bswap16(out, write_len, &aaf->sound_chunk->sound_data[0], num_16);
                 write_len += loop_start_position - 2;
                 ssnd_chunk_pos += loop_start_position - 2;
             }
@@ -1334,7 +1859,7 @@ size_t AdpcmAifcFile_decode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t m
                 num_16 = loop_size_bytes / 2;
 
                 ssnd_chunk_pos = loop_start_position;
-                bswap16_chunk(&buffer[write_len], &aaf->sound_chunk->sound_data[ssnd_chunk_pos], num_16);
+                decode_output_bswap16(out, write_len, &aaf->sound_chunk->sound_data[ssnd_chunk_pos], num_16);
                 write_len += loop_size_bytes;
                 ssnd_chunk_pos += loop_size_bytes;
             }
@@ -1349,7 +1874,7 @@ size_t AdpcmAifcFile_decode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t m
                 // adjust count to 16-byte pieces.
                 num_16 = after_loop_bytes / 2;
 
-                bswap16_chunk(&buffer[write_len], &aaf->sound_chunk->sound_data[ssnd_chunk_pos], num_16);
+                decode_output_bswap16(out, write_len, &aaf->sound_chunk->sound_data[ssnd_chunk_pos], num_16);
                 write_len += after_loop_bytes;
                 ssnd_chunk_pos += after_loop_bytes;
             }
@@ -1387,7 +1912,7 @@ size_t AdpcmAifcFile_decode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t m
             while (end_of_ssnd == 0 && ssnd_chunk_pos < (size_t)(ssnd_data_size) && write_len < max_len)
             {
                 AdpcmAifcFile_decode_frame(aaf, frame_buffer, &ssnd_chunk_pos, &end_of_ssnd);
-                write_frame_output(&buffer[write_len], frame_buffer, 16);
+                decode_output_frame(out, write_len, frame_buffer, 16);
                 write_len += 16 * ADPCM_WAV_OUTPUT_SAMPLE_NUM_BYTES;
             }
 
@@ -1489,7 +2014,7 @@ size_t AdpcmAifcFile_decode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t m
                 && interval16_counter < interval16_times)
             {
                 AdpcmAifcFile_decode_frame(aaf, frame_buffer, &ssnd_chunk_pos, &end_of_ssnd);
-                write_frame_output(&buffer[write_len], frame_buffer, 16);
+                decode_output_frame(out, write_len, frame_buffer, 16);
                 write_len += 16 * ADPCM_WAV_OUTPUT_SAMPLE_NUM_BYTES;
 
                 interval16_counter++;
@@ -1505,7 +2030,7 @@ size_t AdpcmAifcFile_decode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t m
             if (interval16_delta > 0)
             {
                 AdpcmAifcFile_decode_frame(aaf, frame_buffer, &ssnd_chunk_pos, &end_of_ssnd);
-                write_frame_output(&buffer[write_len], frame_buffer, interval16_delta);
+                decode_output_frame(out, write_len, frame_buffer, interval16_delta);
                 write_len += interval16_delta * ADPCM_WAV_OUTPUT_SAMPLE_NUM_BYTES;
 
                 if (DEBUG_ADPCMAIFCFILE_DECODE && g_verbosity >= VERBOSE_DEBUG)
@@ -1582,7 +2107,7 @@ size_t AdpcmAifcFile_decode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t m
 
                 // Write preliminary loop framebuffer data.
                 // This is index zero for the count of frames written.
-                write_frame_output(&buffer[write_len], &frame_buffer[interval16_delta], 16 - interval16_delta);
+                decode_output_frame(out, write_len, &frame_buffer[interval16_delta], 16 - interval16_delta);
                 write_len += (16 - interval16_delta) * ADPCM_WAV_OUTPUT_SAMPLE_NUM_BYTES;
 
                 if (DEBUG_ADPCMAIFCFILE_DECODE && g_verbosity >= VERBOSE_DEBUG)
@@ -1610,7 +2135,7 @@ size_t AdpcmAifcFile_decode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t m
                     interval16_counter++;
 
                     AdpcmAifcFile_decode_frame(aaf, frame_buffer, &ssnd_chunk_pos, &end_of_ssnd);
-                    write_frame_output(&buffer[write_len], frame_buffer, 16);
+                    decode_output_frame(out, write_len, frame_buffer, 16);
                     write_len += 16 * ADPCM_WAV_OUTPUT_SAMPLE_NUM_BYTES;
                 }
 
@@ -1625,7 +2150,7 @@ size_t AdpcmAifcFile_decode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t m
                 if (interval16_delta > 0)
                 {
                     AdpcmAifcFile_decode_frame(aaf, frame_buffer, &ssnd_chunk_pos, &end_of_ssnd);
-                    write_frame_output(&buffer[write_len], frame_buffer, interval16_delta);
+                    decode_output_frame(out, write_len, frame_buffer, interval16_delta);
                     write_len += interval16_delta * ADPCM_WAV_OUTPUT_SAMPLE_NUM_BYTES;
 
                     if (DEBUG_ADPCMAIFCFILE_DECODE && g_verbosity >= VERBOSE_DEBUG)
@@ -1644,7 +2169,7 @@ size_t AdpcmAifcFile_decode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t m
             while (end_of_ssnd == 0 && ssnd_chunk_pos < (size_t)(ssnd_data_size) && write_len < max_len)
             {
                 AdpcmAifcFile_decode_frame(aaf, frame_buffer, &ssnd_chunk_pos, &end_of_ssnd);
-                write_frame_output(&buffer[write_len], frame_buffer, 16);
+                decode_output_frame(out, write_len, frame_buffer, 16);
                 write_len += 16 * ADPCM_WAV_OUTPUT_SAMPLE_NUM_BYTES;
             }
 
@@ -1655,7 +2180,7 @@ size_t AdpcmAifcFile_decode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t m
             }
         }
 
-        free(frame_buffer);
+        gaudio_free(frame_buffer);
 
         TRACE_LEAVE(__func__)
 
@@ -1713,7 +2238,7 @@ void AdpcmAifcCommChunk_free(struct AdpcmAifcCommChunk *chunk)
         return;
     }
 
-    free(chunk);
+    gaudio_free(chunk);
 
     TRACE_LEAVE(__func__)
 }
@@ -1734,11 +2259,11 @@ void AdpcmAifcSoundChunk_free(struct AdpcmAifcSoundChunk *chunk)
 
     if (chunk->sound_data != NULL)
     {
-        free(chunk->sound_data);
+        gaudio_free(chunk->sound_data);
         chunk->sound_data = NULL;
     }
 
-    free(chunk);
+    gaudio_free(chunk);
 
     TRACE_LEAVE(__func__)
 }
@@ -1759,7 +2284,7 @@ void AdpcmAifcCodebookChunk_free(struct AdpcmAifcCodebookChunk *chunk)
 
     if (chunk->table_data != NULL)
     {
-        free(chunk->table_data);
+        gaudio_free(chunk->table_data);
         chunk->table_data = NULL;
     }
 
@@ -1775,19 +2300,19 @@ void AdpcmAifcCodebookChunk_free(struct AdpcmAifcCodebookChunk *chunk)
                 {
                     if (chunk->coef_table[i][j] != NULL)
                     {
-                        free(chunk->coef_table[i][j]);
+                        gaudio_free(chunk->coef_table[i][j]);
                     }
                 }
 
-                free(chunk->coef_table[i]);
+                gaudio_free(chunk->coef_table[i]);
             }
         }
 
-        free(chunk->coef_table);
+        gaudio_free(chunk->coef_table);
         chunk->coef_table = NULL;
     }
 
-    free(chunk);
+    gaudio_free(chunk);
 
     TRACE_LEAVE(__func__)
 }
@@ -1808,11 +2333,11 @@ void AdpcmAifcLoopChunk_free(struct AdpcmAifcLoopChunk *chunk)
 
     if (chunk->loop_data != NULL)
     {
-        free(chunk->loop_data);
+        gaudio_free(chunk->loop_data);
         chunk->loop_data = NULL;
     }
 
-    free(chunk);
+    gaudio_free(chunk);
 
     TRACE_LEAVE(__func__)
 }
@@ -1873,10 +2398,15 @@ void AdpcmAifcFile_free(struct AdpcmAifcFile *aifc_file)
             }
         }
 
-        free(aifc_file->chunks);
+        gaudio_free(aifc_file->chunks);
     }
 
-    free(aifc_file);
+    if (aifc_file->encode_memo != NULL)
+    {
+        gaudio_free(aifc_file->encode_memo);
+    }
+
+    gaudio_free(aifc_file);
 
     TRACE_LEAVE(__func__)
 }
@@ -2165,6 +2695,8 @@ void AdpcmAifcFile_append_chunk(struct AdpcmAifcFile *aifc_file, void *chunk)
  * @param ssnd_chunk_pos: The current position in {@code aaf} that will be written to.
  * @param sound_data_pos: The current position in {@code sound_data} to be read.
  * @param sound_data_len: Length in bytes of {@code sound_data}.
+ * Silence with zero state, and frames already encoded with the same samples
+ * and state, skip the predictor and scale search.
  * @returns: the number of bytes written.
 */
 int AdpcmAifcFile_encode_frame(
@@ -2207,22 +2739,110 @@ int AdpcmAifcFile_encode_frame(
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> apc_state is NULL\n", __func__, __LINE__);
     }
 
-    if (ssnd_chunk_pos == NULL)
+    if (ssnd_chunk_pos == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> ssnd_chunk_pos is NULL\n", __func__, __LINE__);
+    }
+
+    if (aaf->sound_chunk->ck_data_size < 8)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid aaf->sound_chunk size: %d\n", __func__, __LINE__, aaf->sound_chunk->ck_data_size);
+    }
+
+    if ((*ssnd_chunk_pos + 16) > (size_t)(aaf->sound_chunk->ck_data_size - 8))
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> writing frame would exceed sound chunk length, aaf->sound_chunk->ck_data_size: %d, ssnd_chunk_pos= %ld\n", __func__, __LINE__, aaf->sound_chunk->ck_data_size, *ssnd_chunk_pos);
+    }
+
+    // done validating.
+
+    struct AdpcmAifcEncodeMemo *memo;
+    struct AdpcmAifcEncodeMemoEntry *entry;
+    uint8_t frame[ADPCM_ENCODE_FRAME_LEN];
+    struct AdpcmAifcEncodeStats frame_stats;
+    uint32_t hash;
+    int order;
+    int i;
+
+    order = aaf->codes_chunk->order;
+    memset(&frame_stats, 0, sizeof(struct AdpcmAifcEncodeStats));
+
+    if (AdpcmAifcEncodeMemo_is_silence(samples_in, apc_state, order))
+    {
+        // Every predictor has zero error, so predictor 0 and scale 0 are
+        // chosen, all values are zero, and the state stays zero.
+        memset(frame, 0, ADPCM_ENCODE_FRAME_LEN);
+    }
+    else if (order <= ADPCM_ENCODE_MEMO_MAX_ORDER)
+    {
+        // Encoding only depends on the codebook, samples, and state, so
+        // an exact repeat of an earlier frame reuses that result.
+        memo = AdpcmAifcFile_get_encode_memo(aaf);
+        hash = AdpcmAifcEncodeMemo_hash(samples_in, apc_state, order);
+        entry = &memo->entries[hash & (ADPCM_ENCODE_MEMO_SIZE - 1)];
+
+        if (entry->used
+            && entry->hash == hash
+            && memcmp(entry->samples, samples_in, sizeof(entry->samples)) == 0
+            && memcmp(entry->state_in, apc_state, order * sizeof(int32_t)) == 0)
+        {
+            memcpy(apc_state, entry->state_out, order * sizeof(int32_t));
+        }
+        else
+        {
+            entry->used = 1;
+            entry->hash = hash;
+            memcpy(entry->samples, samples_in, sizeof(entry->samples));
+            memcpy(entry->state_in, apc_state, order * sizeof(int32_t));
+
+            AdpcmAifcFile_encode_frame_search(aaf, samples_in, apc_state, entry->frame, &entry->stats);
+
+            memcpy(entry->state_out, apc_state, order * sizeof(int32_t));
+        }
+
+        memcpy(frame, entry->frame, ADPCM_ENCODE_FRAME_LEN);
+        memcpy(&frame_stats, &entry->stats, sizeof(struct AdpcmAifcEncodeStats));
+    }
+    else
     {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> ssnd_chunk_pos is NULL\n", __func__, __LINE__);
+        AdpcmAifcFile_encode_frame_search(aaf, samples_in, apc_state, frame, &frame_stats);
     }
 
-    if (aaf->sound_chunk->ck_data_size < 8)
+    aaf->encode_stats.square_error += frame_stats.square_error;
+    aaf->encode_stats.quantize_error += frame_stats.quantize_error;
+
+    if (aaf->encode_stats.max_clip < frame_stats.max_clip)
     {
-        stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid aaf->sound_chunk size: %d\n", __func__, __LINE__, aaf->sound_chunk->ck_data_size);
+        aaf->encode_stats.max_clip = frame_stats.max_clip;
     }
 
-    if ((*ssnd_chunk_pos + 16) > (size_t)(aaf->sound_chunk->ck_data_size - 8))
+    for (i = 0; i < ADPCM_ENCODE_FRAME_LEN; i++)
     {
-        stderr_exit(EXIT_CODE_GENERAL, "%s %d> writing frame would exceed sound chunk length, aaf->sound_chunk->ck_data_size: %d, ssnd_chunk_pos= %ld\n", __func__, __LINE__, aaf->sound_chunk->ck_data_size, *ssnd_chunk_pos);
+        aaf->sound_chunk->sound_data[*ssnd_chunk_pos] = frame[i];
+        *ssnd_chunk_pos = *ssnd_chunk_pos + 1;
     }
 
-    // done validating.
+    TRACE_LEAVE(__func__)
+    return ADPCM_ENCODE_FRAME_LEN;
+}
+
+/**
+ * Searches every predictor and scale for the best encoding of a single frame,
+ * see {@code AdpcmAifcFile_encode_frame}.
+ * @param aaf: File with codebook.
+ * @param samples_in: Incoming sound data, one frame.
+ * @param apc_state: In/out parameter. "Adaptive Predictive Coding" state.
+ * @param frame: Out parameter. Encoded frame, {@code ADPCM_ENCODE_FRAME_LEN} bytes.
+ * @param stats_out: Out parameter. Error stats of the frame.
+*/
+static void AdpcmAifcFile_encode_frame_search(
+    struct AdpcmAifcFile *aaf,
+    int16_t *samples_in,
+    int32_t *apc_state,
+    uint8_t *frame,
+    struct AdpcmAifcEncodeStats *stats_out)
+{
+    TRACE_ENTER(__func__)
 
     // declare variables
 
@@ -2233,9 +2853,6 @@ int AdpcmAifcFile_encode_frame(
     // convenience value
     int order;
 
-    // number of bytes written
-    int write_len;
-
     // holds main values during row processing. Allocated, freed.
     int32_t *working;
 
@@ -2263,255 +2880,581 @@ int AdpcmAifcFile_encode_frame(
     // best (smallest) error seen so far
     float best_square_error;
 
+    // sum of (error * error), integer error metric
+    int64_t square_error_i64;
+
+    // best (smallest) error seen so far, integer error metric
+    int64_t best_square_error_i64;
+
+    // convenience value, see g_AdpcmEncodeIntegerErrorMetric
+    int integer_metric;
+
+    // points to the residuals of the current row in `working`
+    int32_t *residual_row;
+
+    // set if the predictor has the smallest error seen so far
+    int is_best;
+
     // max clip amount seen for this predictor
     int32_t max_clip;
 
     // best max clip value for all predictors
     int32_t best_max_clip;
 
-    // holds qanitization error for current loop iteration
-    int quantize_error;
+    // largest absolute residual for this predictor
+    int32_t peak_residual;
+
+    // largest absolute residual for the best predictor
+    int32_t best_peak_residual;
+
+    // container for prediction values
+    int32_t prediction[FRAME_DECODE_BUFFER_LEN];
+
+    // holds main output values during final row processing while iterating scales.
+    int32_t working_encode[FRAME_DECODE_BUFFER_LEN];
+
+    // holds best encoded value seen so far while iterating scales
+    int32_t best_encode[FRAME_DECODE_BUFFER_LEN];
+
+    // frame buffer row index
+    int fbri;
+
+    // sum of square error added to predictor error stats
+    double added_square_error;
+
+    float err;
+    int i;
+
+    // done declaring variables
+
+    // copy from aaf for convenience
+    order = aaf->codes_chunk->order;
+    npredictors = aaf->codes_chunk->nentries;
+    coefTable = aaf->codes_chunk->coef_table;
+    integer_metric = g_AdpcmEncodeIntegerErrorMetric;
+
+    memset(prediction, 0, FRAME_DECODE_ROW_LEN * sizeof(int32_t));
+
+    working = (int32_t *)malloc_zero(order + FRAME_DECODE_ROW_LEN, sizeof(int32_t));
+    best_state = (int32_t *)malloc_zero(order, sizeof(int32_t));
+
+    best_square_error = UINT32_MAX;
+    // UINT32_MAX rounds up to 2^32 as a float, start from the same bound.
+    best_square_error_i64 = (int64_t)UINT32_MAX + 1;
+    best_max_clip = INT32_MAX;
+    scale = 0;
+    best_scale = -1;
+    best_predictor = 0;
+    best_peak_residual = 0;
+    added_square_error = 0.0;
+
+    /**
+     * Phase 1:
+     * Iterate the predictors and find the one that generates the least square error.
+    */
+    if (npredictors > 0)
+    {
+        for (predictor = 0; predictor < npredictors; predictor++)
+        {
+            // The first `order` bytes are feedback from the previous frame.
+            for (i = 0; i < order; i++)
+            {
+                working[i] = apc_state[i];
+            }
+
+            // reset to starting row.
+            samples_in_row = &samples_in[0];
+
+            // reset variables / buffers
+            memset(prediction, 0, FRAME_DECODE_BUFFER_LEN * sizeof(int32_t));
+            square_error = 0.0f;
+            square_error_i64 = 0;
+            peak_residual = 0;
+
+            // Evaluate the frame, the important part is measuring the error.
+            // The predictor is chosen by minimizing square error (MSE).
+            // No encoding happens here.
+            for (fbri=0; fbri<2; fbri++)
+            {
+                for (i = 0; i < FRAME_DECODE_ROW_LEN; i++)
+                {
+                    prediction[i] = dot_product_i32(coefTable[predictor][i], working, order + i);
+                    prediction[i] = divide_round_down(prediction[i], FRAME_DECODE_SCALE);
+                    working[i + order] = samples_in_row[i] - prediction[i];
+                }
+
+                residual_row = &working[order];
+
+                if (integer_metric)
+                {
+                    for (i = 0; i < FRAME_DECODE_ROW_LEN; i++)
+                    {
+                        square_error_i64 += (int64_t)residual_row[i] * (int64_t)residual_row[i];
+                    }
+                }
+                else
+                {
+                    for (i = 0; i < FRAME_DECODE_ROW_LEN; i++)
+                    {
+                        err = (float) residual_row[i];
+                        square_error += err * err;
+                    }
+                }
+
+                for (i = 0; i < FRAME_DECODE_ROW_LEN; i++)
+                {
+                    if (peak_residual < abs(residual_row[i]))
+                    {
+                        peak_residual = abs(residual_row[i]);
+                    }
+                }
+
+                // Carry forward the feedback
+                for (i = 0; i < order; i++)
+                {
+                    working[i] = prediction[FRAME_DECODE_ROW_LEN - order + i] + working[FRAME_DECODE_ROW_LEN + i];
+                }
+
+                // advance to next row.
+                samples_in_row = &samples_in_row[FRAME_DECODE_ROW_LEN];
+            }
+
+            /**
+             * If this is the best error amount seen so far then
+             * mark this predictor to be used.
+            */
+            if (integer_metric)
+            {
+                is_best = square_error_i64 < best_square_error_i64;
+            }
+            else
+            {
+                is_best = square_error < best_square_error;
+            }
+
+            if (is_best)
+            {
+                best_square_error = square_error;
+                best_square_error_i64 = square_error_i64;
+                best_predictor = predictor;
+                best_peak_residual = peak_residual;
+
+                if (integer_metric)
+                {
+                    added_square_error += (double)square_error_i64;
+                }
+                else
+                {
+                    added_square_error += square_error;
+                }
+            }
+        }
+    }
+
+    // declared on the stack, so make sure this is empty.
+    memset(best_encode, 0, FRAME_DECODE_BUFFER_LEN * sizeof(int32_t));
+
+    long best_scale_error = 0;
+    long scale_error = 0;
+
+    /**
+     * Phase 2:
+     * Iterate the scales and find the first one that drops quantized
+     * error below 2. If none do, use the first scale with the smallest error.
+    */
+    if (g_AdpcmEncodeExhaustiveScaleSearch)
+    {
+        for (scale = 0; scale <= FRAME_ENCODE_MAX_POW_SCALE; scale++)
+        {
+            max_clip = AdpcmAifcFile_encode_frame_scale(coefTable[best_predictor], order, samples_in, apc_state, scale, INT32_MAX, working, working_encode, &scale_error);
+
+            /**
+             * If this is the best error amount seen so far then
+             * mark this scale to be used. Save the feedback state
+             * and the entire encoded values here, these will then
+             * be sent directly to output.
+            */
+            if (max_clip < best_max_clip)
+            {
+                best_scale_error = scale_error;
+                best_scale = scale;
+                best_max_clip = max_clip;
+                memcpy(best_state, working, order * sizeof(int32_t));
+                memcpy(best_encode, working_encode, FRAME_DECODE_BUFFER_LEN * sizeof(int32_t));
+            }
+
+            // Once the error is small enough then exit.
+            if (best_max_clip <= ADPCM_ENCODE_ACCEPT_MAX_CLIP)
+            {
+                break;
+            }
+        }
+    }
+    else
+    {
+        /**
+         * Same result as above, but pruned. The first sample's prediction only depends
+         * on the incoming state, so its clip amount at each scale is known up front.
+         * That is a lower bound on the frame's clip amount, so scales that can't be
+         * chosen are skipped, and any scale being evaluated is abandoned once its
+         * clip amount reaches the bound it needs to beat.
+         * Evaluation starts at the scale estimated from the peak residual.
+        */
+        int32_t first_clip[FRAME_ENCODE_MAX_POW_SCALE + 1];
+        int32_t first_prediction;
+        int32_t estimate_scale;
+        int32_t q;
+
+        first_prediction = dot_product_i32(coefTable[best_predictor][0], apc_state, order);
+        first_prediction = divide_round_down(first_prediction, FRAME_DECODE_SCALE);
+        err = (float)(samples_in[0] - first_prediction);
+
+        for (scale = 0; scale <= FRAME_ENCODE_MAX_POW_SCALE; scale++)
+        {
+            if (integer_metric)
+            {
+                q = forward_quantize_i32(samples_in[0] - first_prediction, 1 << scale);
+            }
+            else
+            {
+                q = forward_quantize(err, 1 << scale);
+            }
+
+            first_clip[scale] = abs((int16_t) clamp(q, ADPCM_ENCODE_VAL_SIGNED_MIN, ADPCM_ENCODE_VAL_SIGNED_MAX) - q);
+        }
+
+        estimate_scale = 0;
+        while (estimate_scale < FRAME_ENCODE_MAX_POW_SCALE && best_peak_residual > (ADPCM_ENCODE_VAL_SIGNED_MAX << estimate_scale))
+        {
+            estimate_scale++;
+        }
+
+        max_clip = AdpcmAifcFile_encode_frame_scale(coefTable[best_predictor], order, samples_in, apc_state, estimate_scale, INT32_MAX, working, working_encode, &scale_error);
+
+        if (max_clip <= ADPCM_ENCODE_ACCEPT_MAX_CLIP)
+        {
+            best_scale_error = scale_error;
+            best_scale = estimate_scale;
+            best_max_clip = max_clip;
+            memcpy(best_state, working, order * sizeof(int32_t));
+            memcpy(best_encode, working_encode, FRAME_DECODE_BUFFER_LEN * sizeof(int32_t));
+        }
+
+        // Any other scale only replaces the estimate if it is acceptable. If the estimate
+        // is acceptable, only smaller scales need to be checked.
+        for (scale = 0; scale <= FRAME_ENCODE_MAX_POW_SCALE; scale++)
+        {
+            if (scale == estimate_scale)
+            {
+                if (best_scale >= 0)
+                {
+                    break;
+                }
+
+                continue;
+            }
+
+            if (first_clip[scale] > ADPCM_ENCODE_ACCEPT_MAX_CLIP)
+            {
+                continue;
+            }
+
+            max_clip = AdpcmAifcFile_encode_frame_scale(coefTable[best_predictor], order, samples_in, apc_state, scale, ADPCM_ENCODE_ACCEPT_MAX_CLIP + 1, working, working_encode, &scale_error);
+
+            if (max_clip <= ADPCM_ENCODE_ACCEPT_MAX_CLIP)
+            {
+                best_scale_error = scale_error;
+                best_scale = scale;
+                best_max_clip = max_clip;
+                memcpy(best_state, working, order * sizeof(int32_t));
+                memcpy(best_encode, working_encode, FRAME_DECODE_BUFFER_LEN * sizeof(int32_t));
+                break;
+            }
+        }
+
+        // No scale is acceptable, so use the first scale with the smallest error.
+        if (best_scale < 0)
+        {
+            for (scale = 0; scale <= FRAME_ENCODE_MAX_POW_SCALE; scale++)
+            {
+                if (first_clip[scale] >= best_max_clip)
+                {
+                    continue;
+                }
+
+                max_clip = AdpcmAifcFile_encode_frame_scale(coefTable[best_predictor], order, samples_in, apc_state, scale, best_max_clip, working, working_encode, &scale_error);
+
+                if (max_clip < best_max_clip)
+                {
+                    best_scale_error = scale_error;
+                    best_scale = scale;
+                    best_max_clip = max_clip;
+                    memcpy(best_state, working, order * sizeof(int32_t));
+                    memcpy(best_encode, working_encode, FRAME_DECODE_BUFFER_LEN * sizeof(int32_t));
+                }
+            }
+        }
+    }
+
+    stats_out->square_error = added_square_error;
+    stats_out->quantize_error = best_scale_error * best_scale_error;
+    stats_out->max_clip = best_max_clip;
+
+    /**
+     * Copy the best decode state to the In/Out parameter.
+    */
+    for (i = 0; i < order; i++)
+    {
+        apc_state[i] = best_state[i];
+    }
+
+    if (best_scale < 0)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> could not determine scale\n", __func__, __LINE__);
+    }
+
+    // write header byte.
+    frame[0] = (uint8_t)(best_scale << 4) | (uint8_t)(best_predictor & 0xf);
+
+    // Write the output bytes.
+    for (i = 0; i < FRAME_DECODE_BUFFER_LEN; i += 2)
+    {
+        frame[1 + (i >> 1)] = (uint8_t)(best_encode[i] << 4) | (uint8_t)(best_encode[i + 1] & 0xf);
+    }
+
+    // cleanup
+    gaudio_free(working);
+    gaudio_free(best_state);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Quantizes a frame at a single scale with the chosen predictor, see
+ * {@code AdpcmAifcFile_encode_frame_search}.
+ * @param coef: Coefficient table of the predictor.
+ * @param order: Codebook order.
+ * @param samples_in: Incoming sound data, one frame.
+ * @param apc_state: "Adaptive Predictive Coding" state before the frame.
+ * @param scale: Power of two scale.
+ * @param clip_limit: Evaluation stops once the max clip amount reaches this value.
+ * @param working: Out parameter. Length is {@code order + FRAME_DECODE_ROW_LEN}. The first
+ * {@code order} elements are the state after the frame.
+ * @param encode: Out parameter. Quantized values, length is {@code FRAME_DECODE_BUFFER_LEN}.
+ * @param scale_error_out: Out parameter. Sum of quantization error.
+ * @returns: max clip amount, or a value of at least {@code clip_limit} if evaluation stopped early.
+ * Out parameters are only complete when the result is less than {@code clip_limit}.
+*/
+static int32_t AdpcmAifcFile_encode_frame_scale(
+    int32_t **coef,
+    int order,
+    int16_t *samples_in,
+    int32_t *apc_state,
+    int32_t scale,
+    int32_t clip_limit,
+    int32_t *working,
+    int32_t *encode,
+    long *scale_error_out)
+{
+    TRACE_ENTER(__func__)
 
     // container for prediction values
     int32_t prediction[FRAME_DECODE_BUFFER_LEN];
 
-    // holds main output values during final row processing while iterating scales.
-    int32_t working_encode[FRAME_DECODE_BUFFER_LEN];
+    // points to current row of the `samples_in` buffer.
+    int16_t *samples_in_row;
 
-    // holds best encoded value seen so far while iterating scales
-    int32_t best_encode[FRAME_DECODE_BUFFER_LEN];
+    // pointer to current row in encode buffer
+    int32_t *encode_row;
+
+    // holds qanitization error for current loop iteration
+    int quantize_error;
 
-    // pointer to current row in working encode buffer
-    int32_t *working_encode_row;
+    // max clip amount seen so far
+    int32_t max_clip;
 
     // frame buffer row index
     int fbri;
 
+    long scale_error;
     float err;
-    uint8_t header;
-    uint8_t c;
     int i;
 
-    // done declaring variables
-
-    // copy from aaf for convenience
-    order = aaf->codes_chunk->order;
-    npredictors = aaf->codes_chunk->nentries;
-    coefTable = aaf->codes_chunk->coef_table;
-
-    memset(prediction, 0, FRAME_DECODE_ROW_LEN * sizeof(int32_t));
+    // reset to starting row.
+    samples_in_row = &samples_in[0];
+    encode_row = &encode[0];
 
-    working = (int32_t *)malloc_zero(order + FRAME_DECODE_ROW_LEN, sizeof(int32_t));
-    best_state = (int32_t *)malloc_zero(order, sizeof(int32_t));
+    // reset variables / buffers
+    memset(prediction, 0, FRAME_DECODE_BUFFER_LEN * sizeof(int32_t));
+    memset(encode, 0, FRAME_DECODE_BUFFER_LEN * sizeof(int32_t));
+    memset(working, 0, (order + FRAME_DECODE_ROW_LEN) * sizeof(int32_t));
+    max_clip = 0;
+    scale_error = 0;
 
-    best_square_error = UINT32_MAX;
-    best_max_clip = INT32_MAX;
-    scale = 0;
-    best_scale = -1;
-    best_predictor = 0;
-    write_len = 0;
+    // The first `order` bytes are feedback from the previous frame.
+    for (i = 0; i < order; i++)
+    {
+        working[i] = apc_state[i];
+    }
 
     /**
-     * Phase 1:
-     * Iterate the predictors and find the one that generates the least square error.
+     * Evaluate the frame. This time the metric is against the quantized error.
     */
-    if (npredictors > 0)
+    for (fbri=0; fbri<2; fbri++)
     {
-        for (predictor = 0; predictor < npredictors; predictor++)
+        for (i = 0; i < FRAME_DECODE_ROW_LEN; i++)
         {
-            // The first `order` bytes are feedback from the previous frame.
-            for (i = 0; i < order; i++)
+            /**
+             * The encoder is a class of predictive coders based on error
+             * quantization against a model. The actual audio data is not encoded,
+             * only the differece between the model prediction and the sample.
+             * 
+             * This is a n'th order LPC (n = "order" parameter)
+             * that feeds back n parameters into the next audio frame predictors.
+             * 
+             * The "Adaptive" part of ADPCM comes from the fact that "scale" varies by frame.
+            */
+            prediction[i] = dot_product_i32(coef[i], working, order + i);
+            prediction[i] = divide_round_down(prediction[i], FRAME_DECODE_SCALE);
+            
+            if (g_AdpcmEncodeIntegerErrorMetric)
             {
-                working[i] = apc_state[i];
+                encode_row[i] = forward_quantize_i32(samples_in_row[i] - prediction[i], 1 << scale);
+            }
+            else
+            {
+                err = (float)(samples_in_row[i] - prediction[i]);
+                encode_row[i] = forward_quantize(err, 1 << scale);
             }
 
-            // reset to starting row.
-            samples_in_row = &samples_in[0];
+            quantize_error = (int16_t) clamp(encode_row[i], ADPCM_ENCODE_VAL_SIGNED_MIN, ADPCM_ENCODE_VAL_SIGNED_MAX) - encode_row[i];
+            encode_row[i] += quantize_error;
+            working[i + order] = encode_row[i] * (1 << scale);
 
-            // reset variables / buffers
-            memset(prediction, 0, FRAME_DECODE_BUFFER_LEN * sizeof(int32_t));
-            square_error = 0.0f;
+            scale_error += quantize_error;
 
-            // Evaluate the frame, the important part is measuring the error.
-            // The predictor is chosen by minimizing square error (MSE).
-            // No encoding happens here.
-            for (fbri=0; fbri<2; fbri++)
+            if (max_clip < abs(quantize_error))
             {
-                for (i = 0; i < FRAME_DECODE_ROW_LEN; i++)
-                {
-                    prediction[i] = dot_product_i32(coefTable[predictor][i], working, order + i);
-                    prediction[i] = divide_round_down(prediction[i], FRAME_DECODE_SCALE);
-                    working[i + order] = samples_in_row[i] - prediction[i];
-                    err = (float) working[i + order];
-                    square_error += err * err;
-                }
+                max_clip = abs(quantize_error);
 
-                // Carry forward the feedback
-                for (i = 0; i < order; i++)
+                // This scale can't be chosen, no need to finish.
+                if (max_clip >= clip_limit)
                 {
-                    working[i] = prediction[FRAME_DECODE_ROW_LEN - order + i] + working[FRAME_DECODE_ROW_LEN + i];
+                    TRACE_LEAVE(__func__)
+                    return max_clip;
                 }
-
-                // advance to next row.
-                samples_in_row = &samples_in_row[FRAME_DECODE_ROW_LEN];
-            }
-
-            /**
-             * If this is the best error amount seen so far then
-             * mark this predictor to be used.
-            */
-            if (square_error < best_square_error)
-            {
-                best_square_error = square_error;
-                best_predictor = predictor;
-
-                g_square_error += square_error;
             }
         }
-    }
-
-    // declared on the stack, so make sure this is empty.
-    memset(best_encode, 0, FRAME_DECODE_BUFFER_LEN * sizeof(int32_t));
-
-    long best_scale_error = 0;
-
-    /**
-     * Phase 2:
-     * Iterate the scales and find the first one that drops quantized
-     * error below 2.
-    */
-    for (scale = 0; scale <= FRAME_ENCODE_MAX_POW_SCALE; scale++)
-    {
-        // reset to starting row.
-        samples_in_row = &samples_in[0];
-        working_encode_row = &working_encode[0];
-
-        // reset variables / buffers
-        memset(prediction, 0, FRAME_DECODE_BUFFER_LEN * sizeof(int32_t));
-        memset(working_encode, 0, FRAME_DECODE_BUFFER_LEN * sizeof(int32_t));
-        memset(working, 0, (order + FRAME_DECODE_ROW_LEN) * sizeof(int32_t));
-        max_clip = 0;
 
-        // The first `order` bytes are feedback from the previous frame.
+        // Carry forward the feedback
         for (i = 0; i < order; i++)
         {
-            working[i] = apc_state[i];
+            working[i] = prediction[FRAME_DECODE_ROW_LEN - order + i] + working[FRAME_DECODE_ROW_LEN + i];
         }
 
-        long scale_error = 0;
-
-        /**
-         * Evaluate the frame. This time the metric is against the quantized error.
-        */
-        for (fbri=0; fbri<2; fbri++)
-        {
-            for (i = 0; i < FRAME_DECODE_ROW_LEN; i++)
-            {
-                /**
-                 * The encoder is a class of predictive coders based on error
-                 * quantization against a model. The actual audio data is not encoded,
-                 * only the differece between the model prediction and the sample.
-                 * 
-                 * This is a n'th order LPC (n = "order" parameter)
-                 * that feeds back n parameters into the next audio frame predictors.
-                 * 
-                 * The "Adaptive" part of ADPCM comes from the fact that "scale" varies by frame.
-                */
-                prediction[i] = dot_product_i32(coefTable[best_predictor][i], working, order + i);
-                prediction[i] = divide_round_down(prediction[i], FRAME_DECODE_SCALE);
-                
-                err = (float)(samples_in_row[i] - prediction[i]);
-                working_encode_row[i] = forward_quantize(err, 1 << scale);
-                quantize_error = (int16_t) clamp(working_encode_row[i], ADPCM_ENCODE_VAL_SIGNED_MIN, ADPCM_ENCODE_VAL_SIGNED_MAX) - working_encode_row[i];
-                working_encode_row[i] += quantize_error;
-                working[i + order] = working_encode_row[i] * (1 << scale);
+        // advance to next row.
+        samples_in_row = &samples_in_row[FRAME_DECODE_ROW_LEN];
+        encode_row = &encode_row[FRAME_DECODE_ROW_LEN];
+    }
 
-                scale_error += quantize_error;
+    *scale_error_out = scale_error;
 
-                if (max_clip < abs(quantize_error))
-                {
-                    max_clip = abs(quantize_error);
-                }
-            }
+    TRACE_LEAVE(__func__)
+    return max_clip;
+}
 
-            // Carry forward the feedback
-            for (i = 0; i < order; i++)
-            {
-                working[i] = prediction[FRAME_DECODE_ROW_LEN - order + i] + working[FRAME_DECODE_ROW_LEN + i];
-            }
+/**
+ * Checks if a frame is silence with no carried state.
+ * @param samples_in: Incoming sound data, one frame.
+ * @param apc_state: "Adaptive Predictive Coding" state.
+ * @param order: Number of elements in {@code apc_state}.
+ * @returns: 1 if all samples and state are zero, 0 otherwise.
+*/
+static int AdpcmAifcEncodeMemo_is_silence(int16_t *samples_in, int32_t *apc_state, int order)
+{
+    TRACE_ENTER(__func__)
 
-            // advance to next row.
-            samples_in_row = &samples_in_row[FRAME_DECODE_ROW_LEN];
-            working_encode_row = &working_encode_row[FRAME_DECODE_ROW_LEN];
-        }
+    int i;
 
-        /**
-         * If this is the best error amount seen so far then
-         * mark this scale to be used. Save the feedback state
-         * and the entire encoded values here, these will then
-         * be sent directly to output.
-        */
-        if (max_clip < best_max_clip)
+    for (i = 0; i < FRAME_DECODE_BUFFER_LEN; i++)
+    {
+        if (samples_in[i] != 0)
         {
-            best_scale_error = scale_error;
-
-            best_scale = scale;
-            best_max_clip = max_clip;
-
-            for (i = 0; i < order; i++)
-            {
-                best_state[i] = working[i];
-            }
-
-            for (i = 0; i < FRAME_DECODE_BUFFER_LEN; i++)
-            {
-                best_encode[i] = working_encode[i];
-            }
+            TRACE_LEAVE(__func__)
+            return 0;
         }
+    }
 
-        // Once the error is small enough then exit.
-        if (best_max_clip <= 2)
+    for (i = 0; i < order; i++)
+    {
+        if (apc_state[i] != 0)
         {
-            break;
+            TRACE_LEAVE(__func__)
+            return 0;
         }
     }
 
-    g_quantize_error += best_scale_error * best_scale_error;
+    TRACE_LEAVE(__func__)
+    return 1;
+}
 
-    /**
-     * Copy the best decode state to the In/Out parameter.
-    */
-    for (i = 0; i < order; i++)
+/**
+ * FNV-1a hash of frame samples and state, used to find the memo entry.
+ * @param samples_in: Incoming sound data, one frame.
+ * @param apc_state: "Adaptive Predictive Coding" state.
+ * @param order: Number of elements in {@code apc_state}.
+ * @returns: hash.
+*/
+static uint32_t AdpcmAifcEncodeMemo_hash(int16_t *samples_in, int32_t *apc_state, int order)
+{
+    TRACE_ENTER(__func__)
+
+    uint32_t hash = 0x811c9dc5;
+    uint8_t *p;
+    size_t len;
+    size_t i;
+
+    p = (uint8_t *)samples_in;
+    len = FRAME_DECODE_BUFFER_LEN * sizeof(int16_t);
+    for (i = 0; i < len; i++)
     {
-        apc_state[i] = best_state[i];
+        hash = (hash ^ p[i]) * 0x01000193;
     }
 
-    if (best_scale < 0)
+    p = (uint8_t *)apc_state;
+    len = order * sizeof(int32_t);
+    for (i = 0; i < len; i++)
     {
-        stderr_exit(EXIT_CODE_GENERAL, "%s %d> could not determine scale\n", __func__, __LINE__);
+        hash = (hash ^ p[i]) * 0x01000193;
     }
 
-    // write header byte.
-    header = (uint8_t)(best_scale << 4) | (uint8_t)(best_predictor & 0xf);
-    aaf->sound_chunk->sound_data[*ssnd_chunk_pos] = header;
-    *ssnd_chunk_pos = *ssnd_chunk_pos + 1;
-    write_len++;
+    TRACE_LEAVE(__func__)
+    return hash;
+}
 
-    // Write the output bytes.
-    for (i = 0; i < FRAME_DECODE_BUFFER_LEN; i += 2)
+/**
+ * Gets the frame encode memo for the file, allocating it on first use.
+ * Entries are cleared if the codebook changed since they were added.
+ * @param aaf: File being encoded.
+ * @returns: memo.
+*/
+static struct AdpcmAifcEncodeMemo *AdpcmAifcFile_get_encode_memo(struct AdpcmAifcFile *aaf)
+{
+    TRACE_ENTER(__func__)
+
+    if (aaf->encode_memo == NULL)
     {
-        c = (uint8_t)(best_encode[i] << 4) | (uint8_t)(best_encode[i + 1] & 0xf);
-        aaf->sound_chunk->sound_data[*ssnd_chunk_pos] = c;
-        *ssnd_chunk_pos = *ssnd_chunk_pos + 1;
-        write_len++;
+        aaf->encode_memo = (struct AdpcmAifcEncodeMemo *)malloc_zero(1, sizeof(struct AdpcmAifcEncodeMemo));
+        aaf->encode_memo->codes_chunk = aaf->codes_chunk;
+    }
+    else if (aaf->encode_memo->codes_chunk != aaf->codes_chunk)
+    {
+        memset(aaf->encode_memo, 0, sizeof(struct AdpcmAifcEncodeMemo));
+        aaf->encode_memo->codes_chunk = aaf->codes_chunk;
     }
-
-    // cleanup
-    free(working);
-    free(best_state);
 
     TRACE_LEAVE(__func__)
-    return write_len;
+    return aaf->encode_memo;
 }
 
 /**
@@ -2668,7 +3611,7 @@ void AdpcmAifcFile_decode_frame(struct AdpcmAifcFile *aaf, int32_t *frame_buffer
         frame_buffer_row = &frame_buffer_row[FRAME_DECODE_ROW_LEN];
     }
 
-    free(convl_frame);
+    gaudio_free(convl_frame);
 
     TRACE_LEAVE(__func__)
 }
@@ -2754,7 +3697,7 @@ static struct AdpcmAifcApplicationChunk *AdpcmAifcApplicationChunk_new_from_file
         stderr_exit(EXIT_CODE_GENERAL, "%s %d> Invalid APPL chunk data size: %d\n", __func__, __LINE__, ck_data_size);
     }
 
-    struct AdpcmAifcApplicationChunk *ret;
+    struct AdpcmAifcApplicationChunk *ret = NULL;
     int i;
 
     uint32_t application_signature;
@@ -2958,4 +3901,169 @@ static void write_frame_output(uint8_t *out, int32_t *data, size_t size)
     }
 
     TRACE_LEAVE(__func__)
-}
\ No newline at end of file
+}
+
+/**
+ * Writes byte swapped 16 bit samples to decode output.
+ * @param out: destination.
+ * @param pos: byte offset into output buffer. Not used when writing to file.
+ * @param src: big endian samples.
+ * @param num_16: number of samples.
+*/
+static void decode_output_bswap16(struct AdpcmDecodeOutput *out, size_t pos, uint8_t *src, int num_16)
+{
+    TRACE_ENTER(__func__)
+
+    uint16_t block[ADPCM_DECODE_OUTPUT_BLOCK_LEN];
+
+    if (out->buffer != NULL)
+    {
+        bswap16_chunk(&out->buffer[pos], src, num_16);
+
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    while (num_16 > 0)
+    {
+        int len = num_16 < ADPCM_DECODE_OUTPUT_BLOCK_LEN ? num_16 : ADPCM_DECODE_OUTPUT_BLOCK_LEN;
+
+        bswap16_chunk(block, src, len);
+        FileInfo_fwrite(out->fi, block, len * ADPCM_WAV_OUTPUT_SAMPLE_NUM_BYTES, 1);
+
+        src += len * ADPCM_WAV_OUTPUT_SAMPLE_NUM_BYTES;
+        num_16 -= len;
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Writes decoded frame to decode output, see {@code write_frame_output}.
+ * @param out: destination.
+ * @param pos: byte offset into output buffer. Not used when writing to file.
+ * @param data: data to clamp and write.
+ * @param size: number of 16 bit elements to write.
+*/
+static void decode_output_frame(struct AdpcmDecodeOutput *out, size_t pos, int32_t *data, size_t size)
+{
+    TRACE_ENTER(__func__)
+
+    uint8_t frame[FRAME_DECODE_BUFFER_LEN * ADPCM_WAV_OUTPUT_SAMPLE_NUM_BYTES];
+
+    if (out->buffer != NULL)
+    {
+        write_frame_output(&out->buffer[pos], data, size);
+    }
+    else
+    {
+        write_frame_output(frame, data, size);
+        FileInfo_fwrite(out->fi, frame, size * ADPCM_WAV_OUTPUT_SAMPLE_NUM_BYTES, 1);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Encode the pending input frame of {@code struct AdpcmAifcEncoder}.
+ * A partial frame is padded with zeros.
+ * @param encoder: encoder.
+*/
+static void AdpcmAifcEncoder_encode_pending(struct AdpcmAifcEncoder *encoder)
+{
+    TRACE_ENTER(__func__)
+
+    struct AdpcmAifcFile *aaf = encoder->aaf;
+    int16_t sample_buffer[FRAME_DECODE_BUFFER_LEN];
+    size_t frame_pos = 0;
+
+    if (aaf->comm_chunk->compression_type == ADPCM_AIFC_NONE_COMPRESSION_TYPE_ID)
+    {
+        size_t len = encoder->frame_len;
+
+        if (g_encode_bswap)
+        {
+            // adjust count to 16-byte pieces.
+            int num_16 = len / 2;
+            bswap16_chunk(sample_buffer, encoder->frame, num_16);
+            len = num_16 * 2;
+            FileInfo_fwrite(encoder->fi, sample_buffer, len, 1);
+        }
+        else
+        {
+            FileInfo_fwrite(encoder->fi, encoder->frame, len, 1);
+        }
+
+        encoder->write_len += len;
+        encoder->sound_data_pos += encoder->frame_len;
+    }
+    else
+    {
+        // The loop state information should be the state before the beginning of the loop
+        // is processed, same as AdpcmAifcFile_encode.
+        if (encoder->use_loop && encoder->found_loop_state == 0)
+        {
+            if ((encoder->sound_data_pos + 16) > (size_t)aaf->loop_chunk->loop_data->start * 2)
+            {
+                int loop_state_index;
+                int order = aaf->codes_chunk->order;
+
+                encoder->found_loop_state = 1;
+
+                for (loop_state_index=0; loop_state_index<order; loop_state_index++)
+                {
+                    aaf->loop_chunk->loop_data->state[ADPCM_AIFC_LOOP_STATE_LEN - order - loop_state_index] = encoder->apc_state[loop_state_index];
+                }
+            }
+        }
+
+        memset(sample_buffer, 0, FRAME_DECODE_BUFFER_LEN * sizeof(int16_t));
+
+        fill_16bit_buffer(
+            sample_buffer,
+            FRAME_DECODE_BUFFER_LEN,
+            encoder->frame,
+            &frame_pos,
+            encoder->frame_len);
+
+        if (g_encode_bswap)
+        {
+            // conversion needs to happen before encoding.
+            bswap16_chunk(sample_buffer, sample_buffer, FRAME_DECODE_BUFFER_LEN); // inplace swap is ok
+        }
+
+        // encode_frame writes to aaf->sound_chunk, which is the encoder block while encoding.
+        aaf->sound_chunk = encoder->block;
+        encoder->write_len += AdpcmAifcFile_encode_frame(aaf, sample_buffer, encoder->apc_state, &encoder->block_pos);
+        aaf->sound_chunk = NULL;
+
+        encoder->sound_data_pos += encoder->frame_len;
+
+        if (encoder->block_pos + FRAME_DECODE_BUFFER_LEN > ADPCM_AIFC_ENCODER_BLOCK_LEN)
+        {
+            AdpcmAifcEncoder_flush(encoder);
+        }
+    }
+
+    encoder->frame_len = 0;
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Write encoded data collected in {@code struct AdpcmAifcEncoder} block to file.
+ * @param encoder: encoder.
+*/
+static void AdpcmAifcEncoder_flush(struct AdpcmAifcEncoder *encoder)
+{
+    TRACE_ENTER(__func__)
+
+    if (encoder->block_pos > 0)
+    {
+        FileInfo_fwrite(encoder->fi, encoder->block->sound_data, encoder->block_pos, 1);
+        encoder->block_pos = 0;
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
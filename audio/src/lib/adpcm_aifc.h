@@ -152,6 +152,27 @@
 */
 #define FRAME_DECODE_SCALE (1 << 11) /* 2048 */
 
+/**
+ * The encoder uses the first (smallest) scale where no value is clipped
+ * by more than this amount.
+*/
+#define ADPCM_ENCODE_ACCEPT_MAX_CLIP 2
+
+/**
+ * Size in bytes of an encoded frame, header byte followed by 16 4-bit values.
+*/
+#define ADPCM_ENCODE_FRAME_LEN 9
+
+/**
+ * Number of entries in the frame encode memo. Must be a power of 2.
+*/
+#define ADPCM_ENCODE_MEMO_SIZE 256
+
+/**
+ * Largest codebook order that frame encode results are saved for.
+*/
+#define ADPCM_ENCODE_MEMO_MAX_ORDER 8
+
 /**
  * Loops version number, required to be 1 by some applications.
 */
@@ -470,6 +491,26 @@ struct AdpcmAifcCommChunk {
     /* end file format ------------------------------------------------------------------- */
 };
 
+/**
+ * Error tallies from encoding sound data, see {@code AdpcmAifcFile_encode}.
+*/
+struct AdpcmAifcEncodeStats {
+    /**
+     * Sum of codebook predictor square error.
+    */
+    double square_error;
+
+    /**
+     * Sum of squared quantization error, per frame.
+    */
+    long quantize_error;
+
+    /**
+     * Largest amount an encoded value was clipped by, in any frame.
+    */
+    int32_t max_clip;
+};
+
 /**
  * Base container for aifc file.
 */
@@ -532,9 +573,112 @@ struct AdpcmAifcFile {
      * May be NULL.
     */
     struct AdpcmAifcLoopChunk *loop_chunk;
+
+    /**
+     * Not part of file format, used at runtime.
+     * Results of previously encoded frames. Allocated on first encode.
+    */
+    struct AdpcmAifcEncodeMemo *encode_memo;
+
+    /**
+     * Not part of file format, used at runtime.
+     * Error tallies of the last encode into this file. Reset when encoding starts.
+    */
+    struct AdpcmAifcEncodeStats encode_stats;
+};
+
+/**
+ * Number of bytes of encoded sound data collected before writing to file
+ * when encoding with {@code struct AdpcmAifcEncoder}.
+*/
+#define ADPCM_AIFC_ENCODER_BLOCK_LEN 0x1000
+
+/**
+ * Encodes 16-bit PCM audio to .aifc a block at a time, writing each block to file
+ * as it is encoded instead of holding all sound data in memory.
+ * Output is the same as {@code AdpcmAifcFile_encode} followed by {@code AdpcmAifcFile_fwrite}.
+*/
+struct AdpcmAifcEncoder {
+    /**
+     * Container with header chunks (comm, codebook, loop). Not owned by the encoder.
+     * Must not have a sound chunk.
+    */
+    struct AdpcmAifcFile *aaf;
+
+    /**
+     * Output file.
+    */
+    struct FileInfo *fi;
+
+    /**
+     * Whether loop state should be captured during encode.
+    */
+    int use_loop;
+
+    /**
+     * Flag set once loop state has been captured.
+    */
+    int found_loop_state;
+
+    /**
+     * Encoder state carried between frames. Length is codebook order.
+    */
+    int32_t *apc_state;
+
+    /**
+     * Encoded sound data waiting to be written to file.
+    */
+    struct AdpcmAifcSoundChunk *block;
+
+    /**
+     * Number of bytes used in {@code block}.
+    */
+    size_t block_pos;
+
+    /**
+     * Input bytes waiting for a complete frame.
+    */
+    uint8_t frame[FRAME_DECODE_BUFFER_LEN * 2];
+
+    /**
+     * Number of bytes used in {@code frame}.
+    */
+    size_t frame_len;
+
+    /**
+     * Total number of input bytes consumed.
+    */
+    size_t sound_data_pos;
+
+    /**
+     * Total number of sound data bytes written.
+    */
+    size_t write_len;
+
+    /**
+     * File offset of the FORM header.
+    */
+    long form_offset;
+
+    /**
+     * File offset of the comm chunk.
+    */
+    long comm_offset;
+
+    /**
+     * File offset of the loop chunk, or -1.
+    */
+    long loop_offset;
+
+    /**
+     * File offset of the sound chunk.
+    */
+    long sound_offset;
 };
 
 extern int g_AdpcmLoopInfiniteExportCount;
+extern int g_AdpcmEncodeExhaustiveScaleSearch;
+extern int g_AdpcmEncodeIntegerErrorMetric;
 
 struct AdpcmAifcFile *AdpcmAifcFile_new_simple(size_t chunk_count);
 struct AdpcmAifcFile *AdpcmAifcFile_new_from_file(struct FileInfo *fi);
@@ -562,7 +706,14 @@ void AdpcmAifcFile_append_chunk(struct AdpcmAifcFile *aifc_file, void *chunk);
 void AdpcmAifcFile_add_codebook_from_ALADPCMBook(struct AdpcmAifcFile *aaf, struct ALADPCMBook *book);
 void AdpcmAifcCodebookChunk_decode_aifc_codebook(struct AdpcmAifcCodebookChunk *chunk);
 size_t AdpcmAifcFile_encode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t buffer_len);
+int64_t AdpcmAifcFile_decode_square_error(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t buffer_len);
 size_t AdpcmAifcFile_decode(struct AdpcmAifcFile *aaf, uint8_t *buffer, size_t max_len);
+size_t AdpcmAifcFile_decode_fwrite(struct AdpcmAifcFile *aaf, struct FileInfo *fi);
+
+struct AdpcmAifcEncoder *AdpcmAifcEncoder_new(struct AdpcmAifcFile *aaf, struct FileInfo *fi);
+void AdpcmAifcEncoder_write(struct AdpcmAifcEncoder *encoder, const uint8_t *data, size_t len);
+size_t AdpcmAifcEncoder_close(struct AdpcmAifcEncoder *encoder);
+void AdpcmAifcEncoder_free(struct AdpcmAifcEncoder *encoder);
 
 int32_t AdpcmAifcFile_get_int_sample_rate(struct AdpcmAifcFile *aaf);
 size_t AdpcmAifcFile_estimate_inflate_size(struct AdpcmAifcFile *aifc_file);
@@ -0,0 +1,330 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "debug.h"
+#include "machine_config.h"
+#include "common.h"
+#include "utility.h"
+#include "gaudio_error.h"
+#include "naudio.h"
+#include "adpcm_aifc.h"
+#include "wav.h"
+#include "midi.h"
+#include "x.h"
+#include "gaudio_try.h"
+
+/**
+ * This file contains error returning variants of the main library entry points,
+ * see gaudio_try.h.
+*/
+
+/**
+ * Arguments and result passed through {@code gaudio_try}.
+*/
+struct GaudioTryCall {
+    void *arg1;
+    void *arg2;
+    const char *mode;
+    void *result;
+};
+
+// forward declarations
+
+static int gaudio_try_call(f_gaudio_try_callback callback, struct GaudioTryCall *call, void **result, struct GaudioError *error);
+
+static void FileInfo_fopen_callback(void *state);
+static void WavFile_new_from_file_callback(void *state);
+static void AdpcmAifcFile_new_from_file_callback(void *state);
+static void ALADPCMBook_new_from_coef_callback(void *state);
+static void ALBankFile_new_from_ctl_callback(void *state);
+static void ALBankFile_new_from_inst_callback(void *state);
+static void MidiFile_new_from_file_callback(void *state);
+static void CseqFile_new_from_file_callback(void *state);
+static void WavFile_new_from_aifc_callback(void *state);
+static void AdpcmAifcFile_new_from_wav_callback(void *state);
+static void CseqFile_from_MidiFile_callback(void *state);
+static void MidiFile_from_CseqFile_callback(void *state);
+static void WavFile_fwrite_callback(void *state);
+static void AdpcmAifcFile_fwrite_callback(void *state);
+static void MidiFile_fwrite_callback(void *state);
+static void CseqFile_fwrite_callback(void *state);
+
+// end forward declarations
+
+/**
+ * Runs callback through {@code gaudio_try} and copies out result.
+ * @param callback: function to call.
+ * @param call: callback arguments.
+ * @param result: optional out parameter. Set to {@code call->result} on success, NULL on error.
+ * @param error: out parameter. Error details.
+ * @returns: {@code GAUDIO_OK} on success, otherwise error exit code.
+*/
+static int gaudio_try_call(f_gaudio_try_callback callback, struct GaudioTryCall *call, void **result, struct GaudioError *error)
+{
+    TRACE_ENTER(__func__)
+
+    int code;
+
+    call->result = NULL;
+
+    code = gaudio_try(callback, call, error);
+
+    if (result != NULL)
+    {
+        *result = code == GAUDIO_OK ? call->result : NULL;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return code;
+}
+
+int FileInfo_fopen_try(char *filename, const char *mode, struct FileInfo **result, struct GaudioError *error)
+{
+    struct GaudioTryCall call = { filename, NULL, mode, NULL };
+    return gaudio_try_call(FileInfo_fopen_callback, &call, (void **)result, error);
+}
+
+int WavFile_new_from_file_try(struct FileInfo *fi, struct WavFile **result, struct GaudioError *error)
+{
+    struct GaudioTryCall call = { fi, NULL, NULL, NULL };
+    return gaudio_try_call(WavFile_new_from_file_callback, &call, (void **)result, error);
+}
+
+int AdpcmAifcFile_new_from_file_try(struct FileInfo *fi, struct AdpcmAifcFile **result, struct GaudioError *error)
+{
+    struct GaudioTryCall call = { fi, NULL, NULL, NULL };
+    return gaudio_try_call(AdpcmAifcFile_new_from_file_callback, &call, (void **)result, error);
+}
+
+int ALADPCMBook_new_from_coef_try(struct FileInfo *fi, struct ALADPCMBook **result, struct GaudioError *error)
+{
+    struct GaudioTryCall call = { fi, NULL, NULL, NULL };
+    return gaudio_try_call(ALADPCMBook_new_from_coef_callback, &call, (void **)result, error);
+}
+
+int ALBankFile_new_from_ctl_try(struct FileInfo *fi, struct ALBankFile **result, struct GaudioError *error)
+{
+    struct GaudioTryCall call = { fi, NULL, NULL, NULL };
+    return gaudio_try_call(ALBankFile_new_from_ctl_callback, &call, (void **)result, error);
+}
+
+int ALBankFile_new_from_inst_try(struct FileInfo *fi, struct ALBankFile **result, struct GaudioError *error)
+{
+    struct GaudioTryCall call = { fi, NULL, NULL, NULL };
+    return gaudio_try_call(ALBankFile_new_from_inst_callback, &call, (void **)result, error);
+}
+
+int MidiFile_new_from_file_try(struct FileInfo *fi, struct MidiFile **result, struct GaudioError *error)
+{
+    struct GaudioTryCall call = { fi, NULL, NULL, NULL };
+    return gaudio_try_call(MidiFile_new_from_file_callback, &call, (void **)result, error);
+}
+
+int CseqFile_new_from_file_try(struct FileInfo *fi, struct CseqFile **result, struct GaudioError *error)
+{
+    struct GaudioTryCall call = { fi, NULL, NULL, NULL };
+    return gaudio_try_call(CseqFile_new_from_file_callback, &call, (void **)result, error);
+}
+
+int WavFile_new_from_aifc_try(struct AdpcmAifcFile *aifc_file, struct WavFile **result, struct GaudioError *error)
+{
+    struct GaudioTryCall call = { aifc_file, NULL, NULL, NULL };
+    return gaudio_try_call(WavFile_new_from_aifc_callback, &call, (void **)result, error);
+}
+
+int AdpcmAifcFile_new_from_wav_try(struct WavFile *wav_file, struct ALADPCMBook *book, struct AdpcmAifcFile **result, struct GaudioError *error)
+{
+    struct GaudioTryCall call = { wav_file, book, NULL, NULL };
+    return gaudio_try_call(AdpcmAifcFile_new_from_wav_callback, &call, (void **)result, error);
+}
+
+/**
+ * The pattern marker file opened by the conversion is kept in {@code options},
+ * along with the patterns read from it. On error these have already been
+ * released, so the references are restored.
+*/
+int CseqFile_from_MidiFile_try(struct MidiFile *midi, struct MidiConvertOptions *options, struct CseqFile **result, struct GaudioError *error)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudioTryCall call = { midi, options, NULL, NULL };
+    struct FileInfo *runtime_pattern_file = options != NULL ? options->runtime_pattern_file : NULL;
+    struct LinkedList *runtime_patterns_list = options != NULL ? options->runtime_patterns_list : NULL;
+    struct SeqPatternMarkerIndex *runtime_pattern_index = options != NULL ? options->runtime_pattern_index : NULL;
+    int code;
+
+    code = gaudio_try_call(CseqFile_from_MidiFile_callback, &call, (void **)result, error);
+
+    if (code != GAUDIO_OK && options != NULL)
+    {
+        options->runtime_pattern_file = runtime_pattern_file;
+        options->runtime_patterns_list = runtime_patterns_list;
+        options->runtime_pattern_index = runtime_pattern_index;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return code;
+}
+
+/**
+ * See {@code CseqFile_from_MidiFile_try} about pattern marker file.
+*/
+int MidiFile_from_CseqFile_try(struct CseqFile *cseq, struct MidiConvertOptions *options, struct MidiFile **result, struct GaudioError *error)
+{
+    TRACE_ENTER(__func__)
+
+    struct GaudioTryCall call = { cseq, options, NULL, NULL };
+    struct FileInfo *runtime_pattern_file = options != NULL ? options->runtime_pattern_file : NULL;
+    int code;
+
+    code = gaudio_try_call(MidiFile_from_CseqFile_callback, &call, (void **)result, error);
+
+    if (code != GAUDIO_OK && options != NULL)
+    {
+        options->runtime_pattern_file = runtime_pattern_file;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return code;
+}
+
+int WavFile_fwrite_try(struct WavFile *wav_file, struct FileInfo *fi, struct GaudioError *error)
+{
+    struct GaudioTryCall call = { wav_file, fi, NULL, NULL };
+    return gaudio_try_call(WavFile_fwrite_callback, &call, NULL, error);
+}
+
+int AdpcmAifcFile_fwrite_try(struct AdpcmAifcFile *aaf, struct FileInfo *fi, struct GaudioError *error)
+{
+    struct GaudioTryCall call = { aaf, fi, NULL, NULL };
+    return gaudio_try_call(AdpcmAifcFile_fwrite_callback, &call, NULL, error);
+}
+
+int MidiFile_fwrite_try(struct MidiFile *midi_file, struct FileInfo *fi, struct GaudioError *error)
+{
+    struct GaudioTryCall call = { midi_file, fi, NULL, NULL };
+    return gaudio_try_call(MidiFile_fwrite_callback, &call, NULL, error);
+}
+
+int CseqFile_fwrite_try(struct CseqFile *cseq, struct FileInfo *fi, struct GaudioError *error)
+{
+    struct GaudioTryCall call = { cseq, fi, NULL, NULL };
+    return gaudio_try_call(CseqFile_fwrite_callback, &call, NULL, error);
+}
+
+static void FileInfo_fopen_callback(void *state)
+{
+    struct GaudioTryCall *call = (struct GaudioTryCall *)state;
+    call->result = FileInfo_fopen((char *)call->arg1, call->mode);
+}
+
+static void WavFile_new_from_file_callback(void *state)
+{
+    struct GaudioTryCall *call = (struct GaudioTryCall *)state;
+    call->result = WavFile_new_from_file((struct FileInfo *)call->arg1);
+}
+
+static void AdpcmAifcFile_new_from_file_callback(void *state)
+{
+    struct GaudioTryCall *call = (struct GaudioTryCall *)state;
+    call->result = AdpcmAifcFile_new_from_file((struct FileInfo *)call->arg1);
+}
+
+static void ALADPCMBook_new_from_coef_callback(void *state)
+{
+    struct GaudioTryCall *call = (struct GaudioTryCall *)state;
+    call->result = ALADPCMBook_new_from_coef((struct FileInfo *)call->arg1);
+}
+
+static void ALBankFile_new_from_ctl_callback(void *state)
+{
+    struct GaudioTryCall *call = (struct GaudioTryCall *)state;
+    call->result = ALBankFile_new_from_ctl((struct FileInfo *)call->arg1);
+}
+
+static void ALBankFile_new_from_inst_callback(void *state)
+{
+    struct GaudioTryCall *call = (struct GaudioTryCall *)state;
+    call->result = ALBankFile_new_from_inst((struct FileInfo *)call->arg1);
+}
+
+static void MidiFile_new_from_file_callback(void *state)
+{
+    struct GaudioTryCall *call = (struct GaudioTryCall *)state;
+    call->result = MidiFile_new_from_file((struct FileInfo *)call->arg1);
+}
+
+static void CseqFile_new_from_file_callback(void *state)
+{
+    struct GaudioTryCall *call = (struct GaudioTryCall *)state;
+    call->result = CseqFile_new_from_file((struct FileInfo *)call->arg1);
+}
+
+static void WavFile_new_from_aifc_callback(void *state)
+{
+    struct GaudioTryCall *call = (struct GaudioTryCall *)state;
+    call->result = WavFile_new_from_aifc((struct AdpcmAifcFile *)call->arg1);
+}
+
+static void AdpcmAifcFile_new_from_wav_callback(void *state)
+{
+    struct GaudioTryCall *call = (struct GaudioTryCall *)state;
+    call->result = AdpcmAifcFile_new_from_wav((struct WavFile *)call->arg1, (struct ALADPCMBook *)call->arg2);
+}
+
+static void CseqFile_from_MidiFile_callback(void *state)
+{
+    struct GaudioTryCall *call = (struct GaudioTryCall *)state;
+    call->result = CseqFile_from_MidiFile((struct MidiFile *)call->arg1, (struct MidiConvertOptions *)call->arg2);
+}
+
+static void MidiFile_from_CseqFile_callback(void *state)
+{
+    struct GaudioTryCall *call = (struct GaudioTryCall *)state;
+    call->result = MidiFile_from_CseqFile((struct CseqFile *)call->arg1, (struct MidiConvertOptions *)call->arg2);
+}
+
+static void WavFile_fwrite_callback(void *state)
+{
+    struct GaudioTryCall *call = (struct GaudioTryCall *)state;
+    WavFile_fwrite((struct WavFile *)call->arg1, (struct FileInfo *)call->arg2);
+}
+
+static void AdpcmAifcFile_fwrite_callback(void *state)
+{
+    struct GaudioTryCall *call = (struct GaudioTryCall *)state;
+    AdpcmAifcFile_fwrite((struct AdpcmAifcFile *)call->arg1, (struct FileInfo *)call->arg2);
+}
+
+static void MidiFile_fwrite_callback(void *state)
+{
+    struct GaudioTryCall *call = (struct GaudioTryCall *)state;
+    MidiFile_fwrite((struct MidiFile *)call->arg1, (struct FileInfo *)call->arg2);
+}
+
+static void CseqFile_fwrite_callback(void *state)
+{
+    struct GaudioTryCall *call = (struct GaudioTryCall *)state;
+    CseqFile_fwrite((struct CseqFile *)call->arg1, (struct FileInfo *)call->arg2);
+}
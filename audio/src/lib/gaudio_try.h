@@ -0,0 +1,62 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#ifndef _GAUDIO_TRY_H_
+#define _GAUDIO_TRY_H_
+
+#include "gaudio_error.h"
+#include "utility.h"
+#include "naudio.h"
+#include "adpcm_aifc.h"
+#include "wav.h"
+#include "midi.h"
+
+/**
+ * This file contains error returning variants of the main library entry points.
+ *
+ * Each function calls the function of the same name without the {@code _try}
+ * suffix through {@code gaudio_try}. On success the result is written to the
+ * {@code result} parameter and {@code GAUDIO_OK} is returned. On error the process
+ * keeps running: the exit code is returned, {@code error} contains the message,
+ * {@code result} is set to NULL, and memory allocated by the call is released.
+ * Arguments are still owned by the caller and can be freed as usual.
+ *
+ * Functions that add to an existing object (e.g., {@code ALBankFile_write_ctl})
+ * don't have a variant here, see gaudio_error.h to run those with {@code gaudio_try}.
+*/
+
+int FileInfo_fopen_try(char *filename, const char *mode, struct FileInfo **result, struct GaudioError *error);
+
+int WavFile_new_from_file_try(struct FileInfo *fi, struct WavFile **result, struct GaudioError *error);
+int AdpcmAifcFile_new_from_file_try(struct FileInfo *fi, struct AdpcmAifcFile **result, struct GaudioError *error);
+int ALADPCMBook_new_from_coef_try(struct FileInfo *fi, struct ALADPCMBook **result, struct GaudioError *error);
+int ALBankFile_new_from_ctl_try(struct FileInfo *fi, struct ALBankFile **result, struct GaudioError *error);
+int ALBankFile_new_from_inst_try(struct FileInfo *fi, struct ALBankFile **result, struct GaudioError *error);
+int MidiFile_new_from_file_try(struct FileInfo *fi, struct MidiFile **result, struct GaudioError *error);
+int CseqFile_new_from_file_try(struct FileInfo *fi, struct CseqFile **result, struct GaudioError *error);
+
+int WavFile_new_from_aifc_try(struct AdpcmAifcFile *aifc_file, struct WavFile **result, struct GaudioError *error);
+int AdpcmAifcFile_new_from_wav_try(struct WavFile *wav_file, struct ALADPCMBook *book, struct AdpcmAifcFile **result, struct GaudioError *error);
+int CseqFile_from_MidiFile_try(struct MidiFile *midi, struct MidiConvertOptions *options, struct CseqFile **result, struct GaudioError *error);
+int MidiFile_from_CseqFile_try(struct CseqFile *cseq, struct MidiConvertOptions *options, struct MidiFile **result, struct GaudioError *error);
+
+int WavFile_fwrite_try(struct WavFile *wav_file, struct FileInfo *fi, struct GaudioError *error);
+int AdpcmAifcFile_fwrite_try(struct AdpcmAifcFile *aaf, struct FileInfo *fi, struct GaudioError *error);
+int MidiFile_fwrite_try(struct MidiFile *midi_file, struct FileInfo *fi, struct GaudioError *error);
+int CseqFile_fwrite_try(struct CseqFile *cseq, struct FileInfo *fi, struct GaudioError *error);
+
+#endif
@@ -28,6 +28,7 @@
 #include "gaudio_math.h"
 #include "magic.h"
 #include "adpcm_aifc.h"
+#include "wav.h"
 
 /**
  * This file contains code to process audio signals and generate a codebook
@@ -42,11 +43,24 @@ struct frame_data {
     double *vec;
 };
 
+/**
+ * Audio frames read by {@code estimate_codebook}, either from a buffer or a wav file.
+*/
+struct codebook_frame_source {
+    uint8_t *buffer;
+    size_t buffer_len;
+    size_t sound_data_pos;
+    struct WavReader *reader;
+    enum DATA_ENCODING encoding;
+};
+
 // forward declarations
 
 static int get_bucket_from_frame(int current_frame, int num_buckets, int num_frames);
 static struct frame_data* frame_data_new(size_t origin_frame, double norm, double *vec, size_t vec_length);
 static void frame_data_free(struct frame_data *fd);
+static struct ALADPCMBook *estimate_codebook_from_source(struct codebook_frame_source *source, struct codebook_threshold_parameters *threshold, int order, int npredictors);
+static int codebook_frame_source_read(struct codebook_frame_source *source, int16_t *frame_buffer);
 
 // end forward declarations
 
@@ -68,6 +82,78 @@ struct ALADPCMBook *estimate_codebook(
     struct codebook_threshold_parameters *threshold,
     int order,
     int npredictors)
+{
+    TRACE_ENTER(__func__)
+
+    if (buffer == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> buffer is NULL\n", __func__, __LINE__);
+    }
+
+    struct codebook_frame_source source;
+    struct ALADPCMBook *result;
+
+    memset(&source, 0, sizeof(struct codebook_frame_source));
+    source.buffer = buffer;
+    source.buffer_len = buffer_len;
+    source.encoding = buffer_encoding;
+
+    result = estimate_codebook_from_source(&source, threshold, order, npredictors);
+
+    TRACE_LEAVE(__func__)
+
+    return result;
+}
+
+/**
+ * Evaluates .wav sound data to generate codebook. Sound data is read
+ * one frame at a time, it is not loaded into memory.
+ * @param reader: wav to read, positioned at the start of sound data. Must be mono 16 bit PCM.
+ * @param threshold: Optional. See {@code estimate_codebook}.
+ * @param order: Generate nth order predictors.
+ * @param npredictors: The number of predictors to generate.
+ * @returns: new codebook.
+*/
+struct ALADPCMBook *estimate_codebook_from_wav_reader(
+    struct WavReader *reader,
+    struct codebook_threshold_parameters *threshold,
+    int order,
+    int npredictors)
+{
+    TRACE_ENTER(__func__)
+
+    if (reader == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> reader is NULL\n", __func__, __LINE__);
+    }
+
+    struct codebook_frame_source source;
+    struct ALADPCMBook *result;
+
+    memset(&source, 0, sizeof(struct codebook_frame_source));
+    source.reader = reader;
+    source.encoding = DATA_ENCODING_LSB;
+
+    result = estimate_codebook_from_source(&source, threshold, order, npredictors);
+
+    TRACE_LEAVE(__func__)
+
+    return result;
+}
+
+/**
+ * Generates codebook, see {@code estimate_codebook}.
+ * @param source: audio frames to predict.
+ * @param threshold: Optional. See {@code estimate_codebook}.
+ * @param order: Generate nth order predictors.
+ * @param npredictors: The number of predictors to generate.
+ * @returns: new codebook.
+*/
+static struct ALADPCMBook *estimate_codebook_from_source(
+    struct codebook_frame_source *source,
+    struct codebook_threshold_parameters *threshold,
+    int order,
+    int npredictors)
 {
     /**
      * where are you now:
@@ -154,11 +240,6 @@ struct ALADPCMBook *estimate_codebook(
 
     TRACE_ENTER(__func__)
 
-    if (buffer == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> buffer is NULL\n", __func__, __LINE__);
-    }
-
     const int frame_buffer_s16_byte_size = FRAME_DECODE_BUFFER_LEN * sizeof(int16_t);
     const int frame_buffer_f64_byte_size = FRAME_DECODE_BUFFER_LEN * sizeof(double);
     const double epsilon = 1e-6;
@@ -191,7 +272,6 @@ struct ALADPCMBook *estimate_codebook(
     double frame_measure_threshold_max = 1e300;
     double frame_measure_quantile_min = 0.0;
     double frame_measure_quantile_max = 1.0;
-    size_t sound_data_pos;
     int ar_frame_count;
     int axb_solved;
     int stable;
@@ -264,7 +344,6 @@ struct ALADPCMBook *estimate_codebook(
 
     // more init
 
-    sound_data_pos = 0;
     ar_frame_count = 0;
     main_while_count = 0;
     tally_index = 0;
@@ -275,7 +354,7 @@ struct ALADPCMBook *estimate_codebook(
         main_while_count++;
 
         // read next frame.
-        int sample_bytes_read = fill_16bit_buffer(frame_buffer, FRAME_DECODE_BUFFER_LEN, buffer, &sound_data_pos, buffer_len);
+        int sample_bytes_read = codebook_frame_source_read(source, frame_buffer);
 
         // if there's not a full frame then exit the while loop.
         if (sample_bytes_read != frame_buffer_s16_byte_size)
@@ -284,7 +363,7 @@ struct ALADPCMBook *estimate_codebook(
         }
 
         // convert endianess if needed
-        if (buffer_encoding == DATA_ENCODING_MSB)
+        if (source->encoding == DATA_ENCODING_MSB)
         {
             bswap16_chunk(frame_buffer, frame_buffer, FRAME_DECODE_BUFFER_LEN);
         }
@@ -477,7 +556,7 @@ continue_while_frame_read:
 
         ALADPCMBook_set_predictor(result, row, tally_index);
 
-        free(row);
+        gaudio_free(row);
     }
 
     // cleanup
@@ -496,23 +575,23 @@ continue_while_frame_read:
     }
     LinkedList_free(ar_frames);
 
-    free(frame_buffer);
-    free(previous_frame_buffer_f64);
-    free(frame_buffer_f64);
-    free(correlation_arr);
-    free(transfer_coefficients_arr);
-    free(reflection_coefficients);
-    free(ar_parameters);
-    free(acf_r);
-    free(predictor_coefficients);
-    free(frame_measures);
+    gaudio_free(frame_buffer);
+    gaudio_free(previous_frame_buffer_f64);
+    gaudio_free(frame_buffer_f64);
+    gaudio_free(correlation_arr);
+    gaudio_free(transfer_coefficients_arr);
+    gaudio_free(reflection_coefficients);
+    gaudio_free(ar_parameters);
+    gaudio_free(acf_r);
+    gaudio_free(predictor_coefficients);
+    gaudio_free(frame_measures);
 
     for (i=0; i<TABLE_MAX_PREDICTORS; i++)
     {
-        free(tally_container[i]);
+        gaudio_free(tally_container[i]);
     }
 
-    free(tally_container);
+    gaudio_free(tally_container);
 
     matrix_f64_free(correlation_mat, (size_t)order);
 
@@ -761,7 +840,7 @@ int lu_decomp_solve(double **a, double *b, size_t n, double *x)
 lu_decomp_solve_cleanup_return:
     gsl_permutation_free(gsl_p);
     gsl_vector_free(gsl_x);
-    free(a_copy);
+    gaudio_free(a_copy);
 
     TRACE_LEAVE(__func__)
     return result;
@@ -885,8 +964,8 @@ out[0] = temp[0];
 
 cleanup_return:
 
-    free(temp);
-    free(copy);
+    gaudio_free(temp);
+    gaudio_free(copy);
 
     TRACE_LEAVE(__func__)
     return result;
@@ -1169,7 +1248,7 @@ div *= 1.0 - temp[3] * temp[3];
         reflection_coefficients[i] = temp[i];
     }
 
-    free(temp);
+    gaudio_free(temp);
 
     TRACE_LEAVE(__func__)
 }
@@ -1368,11 +1447,42 @@ static void frame_data_free(struct frame_data *fd)
 
     if (fd->vec != NULL)
     {
-        free(fd->vec);
+        gaudio_free(fd->vec);
         fd->vec = NULL;
     }
 
-    free(fd);
+    gaudio_free(fd);
     
     TRACE_LEAVE(__func__)
-}
\ No newline at end of file
+}
+
+/**
+ * Reads the next frame of samples for {@code estimate_codebook}.
+ * @param source: frame source.
+ * @param frame_buffer: out parameter. Must have room for {@code FRAME_DECODE_BUFFER_LEN} samples.
+ * @returns: number of bytes read.
+*/
+static int codebook_frame_source_read(struct codebook_frame_source *source, int16_t *frame_buffer)
+{
+    TRACE_ENTER(__func__)
+
+    int sample_bytes_read;
+
+    if (source->reader != NULL)
+    {
+        uint8_t frame_bytes[FRAME_DECODE_BUFFER_LEN * sizeof(int16_t)];
+        size_t frame_bytes_len;
+        size_t frame_bytes_pos = 0;
+
+        frame_bytes_len = WavReader_read(source->reader, frame_bytes, sizeof(frame_bytes));
+        sample_bytes_read = fill_16bit_buffer(frame_buffer, FRAME_DECODE_BUFFER_LEN, frame_bytes, &frame_bytes_pos, frame_bytes_len);
+    }
+    else
+    {
+        sample_bytes_read = fill_16bit_buffer(frame_buffer, FRAME_DECODE_BUFFER_LEN, source->buffer, &source->sound_data_pos, source->buffer_len);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return sample_bytes_read;
+}
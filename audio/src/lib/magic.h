@@ -19,6 +19,7 @@
 #define _GAUDIO_MAGIC_H_
 
 #include <float.h>
+#include "wav.h"
 
 /**
  * Max number of feedback states used for prediction.
@@ -83,6 +84,12 @@ struct ALADPCMBook *estimate_codebook(
     int order,
     int npredictors);
 
+struct ALADPCMBook *estimate_codebook_from_wav_reader(
+    struct WavReader *reader,
+    struct codebook_threshold_parameters *threshold,
+    int order,
+    int npredictors);
+
 
 // declarations made public for testing
 
@@ -22,6 +22,7 @@
 #include "common.h"
 #include "machine_config.h"
 #include "utility.h"
+#include "parallel.h"
 #include "midi.h"
 #include "parse.h"
 
@@ -44,6 +45,12 @@ static const int g_max_pattern_distance = 0xfdff; // according to programmer man
 
 #define NUM_BUFFER_SIZE 12
 
+/**
+ * Max bytes read for a varint delta time or note duration. The format allows
+ * four bytes, parsing has always accepted one more.
+*/
+#define MIDI_DELTA_TIME_MAX_READ_BYTES 5
+
 // give every event a unique id
 static int g_event_id = 0;
 
@@ -84,6 +91,77 @@ struct SeqPatternMatch {
     enum CSEQ_PATTERN_TYPE type;
 };
 
+/**
+ * Pattern markers loaded from a binary pattern marker file.
+ * Matches are stored contiguously and grouped by cseq track, so
+ * each track can be loaded without scanning the other tracks.
+*/
+struct SeqPatternMarkerIndex {
+    // all matches in file, grouped by track.
+    struct SeqPatternMatch *matches;
+
+    // number of elements in {@code matches}.
+    size_t match_count;
+
+    // index into {@code matches} of first match for each cseq track.
+    size_t track_start[CSEQ_FILE_NUM_TRACKS];
+
+    // number of matches for each cseq track.
+    size_t track_count[CSEQ_FILE_NUM_TRACKS];
+};
+
+/**
+ * Shared state when converting cseq tracks to MIDI tracks.
+ * Each track writes only to its own slot, so tracks can be converted
+ * in any order.
+*/
+struct CseqToMidiJob {
+    struct CseqFile *cseq;
+    int opt_pattern_substitution;
+    int no_create_sysex;
+    f_GmidTrack_callback post_unroll_action;
+
+    // number of tracks to convert.
+    int num_tracks;
+
+    // cseq track index of each track to convert.
+    int cseq_track_index[CSEQ_FILE_NUM_TRACKS];
+
+    // result, MIDI track for each converted track.
+    struct MidiTrack *midi_tracks[CSEQ_FILE_NUM_TRACKS];
+
+    // result, patterns found unrolling each track, or NULL.
+    struct LinkedList *patterns[CSEQ_FILE_NUM_TRACKS];
+};
+
+/**
+ * Shared state when parsing MIDI tracks into common events.
+ * Each source track writes only to its own slot.
+*/
+struct MidiToGmidJob {
+    struct MidiFile *midi;
+    int force_track;
+
+    // result, destination track of each source track, or -1 if not resolved.
+    int *destination_track;
+
+    // result, events parsed from each source track, or NULL if track is missing.
+    struct LinkedList **events;
+};
+
+/**
+ * Shared state when converting common tracks to cseq format.
+*/
+struct GmidToCseqJob {
+    struct GmidFile *gmid_file;
+
+    // number of tracks to convert.
+    int num_tracks;
+
+    // gmid track index of each track to convert.
+    int track_index[CSEQ_FILE_NUM_TRACKS];
+};
+
 // forward declarations
 
 int LinkedListNode_gmidevent_compare_larger(struct LinkedListNode *first, struct LinkedListNode *second);
@@ -94,8 +172,24 @@ static int measure_unroll_adjust(struct LinkedList *patterns, int start_pos, int
 static struct SeqPatternMatch *SeqPatternMatch_new_values(int start_pattern_pos, int diff, int pattern_length);
 static struct SeqPatternMatch *SeqPatternMatch_new(void);
 static void SeqPatternMatch_free(struct SeqPatternMatch *obj);
+static size_t CseqFile_unroll_measure(struct CseqFile *cseq, int cseq_track_index, size_t start_pos, size_t end_pos);
+static int pattern_marker_file_is_binary(struct FileInfo *file);
+static struct SeqPatternMarkerIndex *SeqPatternMarkerIndex_new_from_file(struct FileInfo *file);
+static void SeqPatternMarkerIndex_free(struct SeqPatternMarkerIndex *obj);
+static void SeqPatternMarkerIndex_get_track(struct SeqPatternMarkerIndex *index, int track_number, struct LinkedList *matches);
 static void GmidTrack_debug_print(struct GmidTrack *track, enum MIDI_IMPLEMENTATION type);
 static void GmidTrack_print(struct GmidTrack *track, enum MIDI_IMPLEMENTATION type);
+static int midi_parallel_allowed(void);
+static void MidiFile_from_CseqFile_track(int index, void *state);
+static void GmidFile_new_from_midi_track(int index, void *state);
+static void CseqFile_from_MidiFile_track(int index, void *state);
+static int MidiTransformStep_force_track(struct MidiTransformStep *step);
+static int MidiTransformStep_is_event_local(struct MidiTransformStep *step);
+static void GmidEvent_apply_transform_step(struct GmidEvent *event, struct GmidTrack *gtrack, struct MidiTransformStep *step);
+static int GmidFile_retrack_plan(struct GmidFile *gmid_file, int force_track, int *destination);
+static void GmidFile_retrack(struct GmidFile *gmid_file, int *destination);
+static void GmidTrack_absolute_from_midi_delta(struct GmidTrack *gtrack);
+static int GmidEvent_write_delta_time(uint8_t *buffer, struct VarLengthInt *delta_time);
 
 // end forward declarations
 
@@ -580,6 +674,7 @@ struct CseqFile *CseqFile_new_from_file(struct FileInfo *fi)
     data_len = fi->len - CSEQ_FILE_HEADER_SIZE_BYTES;
 
     p->compressed_data = (uint8_t *)malloc_zero(1, data_len);
+    p->compressed_data_len = data_len;
     FileInfo_fread(fi, p->compressed_data, data_len, 1);
 
     // Now load track contents.
@@ -735,125 +830,40 @@ struct GmidFile *GmidFile_new_from_midi(struct MidiFile *midi, int force_track)
     }
 
     struct GmidFile *gmid_file;
-    struct LinkedList *track_event_holder;
+    struct MidiToGmidJob job;
     int source_track_index;
-    char *debug_printf_buffer;
     struct LinkedListNode *node;
 
-    debug_printf_buffer = (char *)malloc_zero(1, WRITE_BUFFER_LEN);
-
     gmid_file = GmidFile_new();
 
-    // collect events seen while parsing the current track.
-    track_event_holder = LinkedList_new();
+    job.midi = midi;
+    job.force_track = force_track;
+    job.destination_track = (int *)malloc_zero(midi->num_tracks + 1, sizeof(int));
+    job.events = (struct LinkedList **)malloc_zero(midi->num_tracks + 1, sizeof(struct LinkedList *));
 
-    for (source_track_index=0; source_track_index<midi->num_tracks; source_track_index++)
+    // Source tracks are independent until events are moved to the destination
+    // track, so parse them concurrently.
+    if (midi_parallel_allowed())
     {
-        struct MidiTrack *source_track = midi->tracks[source_track_index];
-        struct GmidEvent *event;
-        size_t track_pos;
-        size_t buffer_len;
-        int32_t command;
-        int destination_track = -1;
-
-        /** 
-         * running count of absolute time.
-         * Every delta event read is added to this value.
-         * The first delta event read sets the very first absolute time (not necessarily zero).
-        */
-        long absolute_time = 0;
-
-        if (g_verbosity >= VERBOSE_DEBUG)
-        {
-            printf("\n");
-            printf("begin parse track %d\n", source_track_index);
-        }
-
-        if (source_track == NULL)
+        parallel_for(midi->num_tracks, GmidFile_new_from_midi_track, &job);
+    }
+    else
+    {
+        for (source_track_index=0; source_track_index<midi->num_tracks; source_track_index++)
         {
-            if (g_verbosity >= VERBOSE_DEBUG)
-            {
-                printf("empty track\n");
-            }
-
-            continue;
+            GmidFile_new_from_midi_track(source_track_index, &job);
         }
+    }
 
-        command = 0;
-        track_pos = 0;
-        buffer_len = source_track->ck_data_size;
-
-        /**
-         * Iterate the events in this track and add to track_event_holder.
-         * This addresses two problems.
-         * 1) Some seq tracks are null, and this isn't captured in output MIDI,
-         *    the only way to recognize this is by looking at the command channel
-         *    in the track events.
-         * 2) A track might start with meta events which don't have a command
-         *    channel, so the destination seq track won't be known yet.
-         * 
-         * After all the events from the track are added to the temp list,
-         * the command channel should have been seen at least once.
-         * Use the first read command channel to determine which seq
-         * track these events belong to.
-        */
-        while (track_pos < buffer_len)
-        {
-            int bytes_read = 0;
-            
-            // track position will be updated according to how many bytes read.
-            event = GmidEvent_new_from_buffer(source_track->data, &track_pos, buffer_len, MIDI_IMPLEMENTATION_STANDARD, command, &bytes_read);
-
-            if (event == NULL)
-            {
-                stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: event is NULL\n", __func__, __LINE__);
-            }
-
-            if (bytes_read == 0)
-            {
-                stderr_exit(EXIT_CODE_GENERAL, "%s %d>: invalid bytes_read (0) from GmidEvent_new_from_buffer\n", __func__, __LINE__);
-            }
-
-            absolute_time += event->midi_delta_time.standard_value;
-            event->absolute_time = absolute_time;
-
-            if (g_verbosity >= VERBOSE_DEBUG)
-            {
-                memset(debug_printf_buffer, 0, WRITE_BUFFER_LEN);
-                size_t debug_str_len = GmidEvent_to_string(event, debug_printf_buffer, WRITE_BUFFER_LEN - 2, MIDI_IMPLEMENTATION_STANDARD);
-                debug_printf_buffer[debug_str_len] = '\n';
-                fflush_string(stdout, debug_printf_buffer);
-            }
-
-            if (force_track)
-            {
-                destination_track = source_track_index;
-            }
-            else
-            {
-                // Set destination track to first seen command channel.
-                if (destination_track == -1 && event->command_channel > -1)
-                {
-                    destination_track = event->command_channel;
-                }
-            }
-
-            command = GmidEvent_get_midi_command(event);
-
-            // only allow running status for the "regular" MIDI commands (commands with channels)
-            if ((command & 0xffffff00) != 0 || (command & 0xfffffff0) >= 0xf0)
-            {
-                command = 0;
-            }
-
-            node = LinkedListNode_new();
-            node->data = event;
-            LinkedList_append_node(track_event_holder, node);
-        }
+    for (source_track_index=0; source_track_index<midi->num_tracks; source_track_index++)
+    {
+        // collect events seen while parsing the current track.
+        struct LinkedList *track_event_holder = job.events[source_track_index];
+        int destination_track = job.destination_track[source_track_index];
 
-        if (g_verbosity >= VERBOSE_DEBUG)
+        if (track_event_holder == NULL)
         {
-            printf("finish parse track %d\n", source_track_index);
+            continue;
         }
 
         if (destination_track == -1)
@@ -878,11 +888,14 @@ struct GmidFile *GmidFile_new_from_midi(struct MidiFile *midi, int force_track)
             LinkedListNode_move(gmid_file->tracks[destination_track]->events, track_event_holder, node);
         }
 
+        LinkedList_free(track_event_holder);
+
         // estimate total track size in bytes.
         GmidTrack_set_track_size_bytes(gmid_file->tracks[destination_track]);
     }
 
-    free(debug_printf_buffer);
+    gaudio_free(job.events);
+    gaudio_free(job.destination_track);
 
     TRACE_LEAVE(__func__)
     return gmid_file;
@@ -906,16 +919,23 @@ struct MidiFile *MidiFile_from_CseqFile(struct CseqFile *cseq, struct MidiConver
 
     int i;
     int allocated_tracks = 0;
+    int binary_pattern_file = 0;
     struct FileInfo *pattern_file = NULL;
-    f_GmidTrack_callback post_unroll_action = NULL;
-    int opt_pattern_substitution = 1; // enable by default
-    int no_create_sysex = 1; // do not create by default
+    struct CseqToMidiJob job;
+    struct LinkedListNode *pattern_node = NULL;
+    struct SeqPatternMatch *pattern = NULL;
+
+    memset(&job, 0, sizeof(struct CseqToMidiJob));
+
+    job.cseq = cseq;
+    job.opt_pattern_substitution = 1; // enable by default
+    job.no_create_sysex = 1; // do not create by default
 
     if (options != NULL)
     {
-        post_unroll_action = options->post_unroll_action;
-        opt_pattern_substitution = !options->no_pattern_compression; // negate
-        no_create_sysex = !options->sysex_seq_loops; // negate
+        job.post_unroll_action = options->post_unroll_action;
+        job.opt_pattern_substitution = !options->no_pattern_compression; // negate
+        job.no_create_sysex = !options->sysex_seq_loops; // negate
     }
 
     struct MidiFile *midi = MidiFile_new_tracks(MIDI_FORMAT_SIMULTANEOUS, cseq->non_empty_num_tracks);
@@ -929,116 +949,83 @@ struct MidiFile *MidiFile_from_CseqFile(struct CseqFile *cseq, struct MidiConver
             continue;
         }
 
-        if (g_verbosity >= VERBOSE_DEBUG)
+        job.cseq_track_index[job.num_tracks] = i;
+        job.num_tracks++;
+    }
+
+    // Tracks are independent, so convert them concurrently. The user callback
+    // and debug output are not safe to interleave, so those run in order.
+    if (job.post_unroll_action == NULL && midi_parallel_allowed())
+    {
+        parallel_for(job.num_tracks, MidiFile_from_CseqFile_track, &job);
+    }
+    else
+    {
+        for (i=0; i<job.num_tracks; i++)
         {
-            printf("MidiFile_from_CseqFile: parse track %d\n", i);
+            MidiFile_from_CseqFile_track(i, &job);
         }
+    }
 
-        struct GmidTrack *gtrack = GmidTrack_new();
-        struct LinkedList *patterns = NULL;
-        struct LinkedListNode *pattern_node = NULL;
-        struct SeqPatternMatch *pattern = NULL;
-
-        gtrack->midi_track_index = allocated_tracks;
-        gtrack->cseq_track_index = i;
+    // The binary format stores all tracks behind a single index, so it is written once, up front.
+    if (options != NULL
+        && options->use_pattern_marker_file
+        && string_ends_with(options->pattern_marker_filename, PATTERN_MARKER_BINARY_EXTENSION))
+    {
+        binary_pattern_file = 1;
 
-        if (opt_pattern_substitution)
+        for (i=0; i<job.num_tracks; i++)
         {
-            patterns = LinkedList_new();
-            CseqFile_unroll(cseq, gtrack, patterns);
-
-            // only write patterns if user specified.
-            if (options != NULL && options->use_pattern_marker_file)
+            if (job.patterns[i] != NULL && LinkedList_any(job.patterns[i], LinkedListNode_SeqPatternMatch_is_unroll))
             {
-                // Only write patterns (and create file) if there's anything to write.
-                if (LinkedList_any(patterns, LinkedListNode_SeqPatternMatch_is_unroll))
-                {
-                    // only open file once, then preserve reference for future tracks.
-                    if (pattern_file == NULL)
-                    {
-                        // seq->midi is write
-                        pattern_file = FileInfo_fopen(options->pattern_marker_filename, "wb");
-                    }
-
-                    write_patterns_to_file(patterns, pattern_file);
-                }
+                pattern_file = FileInfo_fopen(options->pattern_marker_filename, "wb");
+                write_patterns_to_file_binary(job.patterns, job.num_tracks, pattern_file);
+                break;
             }
         }
-        else
-        {
-            CseqFile_no_unroll_copy(cseq, gtrack);
-        }
+    }
 
-        // parse seq format into common events
-        GmidTrack_parse_CseqTrack(gtrack);
+    // assemble results in track order.
+    for (i=0; i<job.num_tracks; i++)
+    {
+        midi->tracks[allocated_tracks] = job.midi_tracks[i];
+        allocated_tracks++;
 
-        if (post_unroll_action != NULL)
+        if (job.patterns[i] == NULL)
         {
-            post_unroll_action(gtrack);
+            continue;
         }
 
-        // The seq loop end event contains the loop iteration count, but that's needed in the MIDI
-        // loop start event, so resolve all dual pointers to make that available. One complication
-        // is that pattern substitution is applied before loop end offset is calculated, so
-        // unrolling above means the loop end offsets are now wrong. Pass in the list of patterns
-        // found unrolling the track to this method to adjust loop end offsets.
-        // This needs to happen before any nodes are added, and before
-        // delta events are changed in order to calculate offsets correctly.
-        GmidTrack_pair_cseq_loop_events(gtrack, patterns);
-
-        // Mark invalid seq loops as invalid.
-        // Create MIDI sysex events (custom events) for invalid seq loop events according to user option.
-        // This needs to happen after GmidTrack_pair_cseq_loop_events.
-        GmidTrack_invalid_cseq_loop_to_sysex(gtrack, no_create_sysex);
-
-        // Create midi note off events from the seq note-on events.
-        // This will break delta events for the track.
-        GmidTrack_midi_note_off_from_cseq(gtrack);
-
-        // Sort events by absolute time. This is needed because
-        // the applied duration from the note-on can move
-        // the new note-off event substantially.
-        LinkedList_merge_sort(gtrack->events, LinkedListNode_gmidevent_compare_smaller);
-
-        // Fix delta times, due to adding note-off events.
-        GmidTrack_delta_from_absolute(gtrack);
-
-        // Convert cseq loop markers into non-standard controller events
-        GmidTrack_cseq_to_midi_loop(gtrack);
-
-        // Fix delta times, due to adding MIDI controller events for looping.
-        GmidTrack_delta_from_absolute(gtrack);
-
-        if (g_verbosity >= VERBOSE_DEBUG)
+        // only write patterns if user specified.
+        if (options != NULL && options->use_pattern_marker_file && !binary_pattern_file)
         {
-            GmidTrack_debug_print(gtrack, MIDI_IMPLEMENTATION_STANDARD);
-        }
-
-        // estimate total track size in bytes.
-        GmidTrack_set_track_size_bytes(gtrack);
-
-        midi->tracks[allocated_tracks] = MidiTrack_new_from_GmidTrack(gtrack);
-        allocated_tracks++;
+            // Only write patterns (and create file) if there's anything to write.
+            if (LinkedList_any(job.patterns[i], LinkedListNode_SeqPatternMatch_is_unroll))
+            {
+                // only open file once, then preserve reference for future tracks.
+                if (pattern_file == NULL)
+                {
+                    // seq->midi is write
+                    pattern_file = FileInfo_fopen(options->pattern_marker_filename, "wb");
+                }
 
-        // cleanup
-        GmidTrack_free(gtrack);
+                write_patterns_to_file(job.patterns[i], pattern_file);
+            }
+        }
 
-        if (patterns != NULL)
+        pattern_node = job.patterns[i]->head;
+        while (pattern_node != NULL)
         {
-            pattern_node = patterns->head;
-            while (pattern_node != NULL)
+            pattern = (struct SeqPatternMatch *)pattern_node->data;
+            if (pattern != NULL)
             {
-                pattern = (struct SeqPatternMatch *)pattern_node->data;
-                if (pattern != NULL)
-                {
-                    SeqPatternMatch_free(pattern);
-                    pattern_node->data = NULL;
-                }
-                pattern_node = pattern_node->next;
+                SeqPatternMatch_free(pattern);
+                pattern_node->data = NULL;
             }
-            
-            LinkedList_free(patterns);
+            pattern_node = pattern_node->next;
         }
+
+        LinkedList_free(job.patterns[i]);
     }
 
     if (pattern_file != NULL)
@@ -1047,9 +1034,9 @@ struct MidiFile *MidiFile_from_CseqFile(struct CseqFile *cseq, struct MidiConver
         pattern_file = NULL;
     }
 
-    return midi;
-
     TRACE_LEAVE(__func__)
+
+    return midi;
 }
 
 /**
@@ -1088,7 +1075,9 @@ struct CseqFile *CseqFile_from_MidiFile(struct MidiFile *midi, struct MidiConver
 
     struct CseqFile *result;
     struct GmidFile *gmid_file;
+    struct GmidToCseqJob job;
     int i;
+    int track_num;
     char *debug_printf_buffer;
     uint8_t *cseq_data_buffer = NULL;
     size_t cseq_buffer_pos = 0;
@@ -1114,10 +1103,12 @@ struct CseqFile *CseqFile_from_MidiFile(struct MidiFile *midi, struct MidiConver
 
     // All events from source midi have been added to appropriate tracks.
     // Now process each track and convert from midi to seq format.
+    // Tracks are independent until pattern substitution, so convert them concurrently.
+    job.gmid_file = gmid_file;
+    job.num_tracks = 0;
+
     for (i=0; i<CSEQ_FILE_NUM_TRACKS; i++)
     {
-        size_t write_len;
-
         // If no events were added to this track above, then don't processes
         // this track.
         if (gmid_file->tracks[i] == NULL
@@ -1127,44 +1118,26 @@ struct CseqFile *CseqFile_from_MidiFile(struct MidiFile *midi, struct MidiConver
             continue;
         }
 
-        // Transform MIDI sysex escaped cseq event into real cseq event.
-        GmidTrack_midi_sysex_to_cseq(gmid_file->tracks[i]);
-
-        // Convert note-off and implicit note-off to cseq format.
-        // Absolute times must be accurate in order to calculate duration.
-        GmidTrack_cseq_note_on_from_midi(gmid_file->tracks[i]);
-
-        // Sort events by absolute time
-        LinkedList_merge_sort(gmid_file->tracks[i]->events, LinkedListNode_gmidevent_compare_smaller);
-
-        GmidTrack_delta_from_absolute(gmid_file->tracks[i]);
-
-        /**
-         * cseq2midi needed loop end to be linked to loop start to resolve
-         * the loop count, but the other direction can just check that
-         * the loop count event follows the loop start event (this is how gaudio converts).
-         * This should be done last because the byte offset from the end to the
-         * start node needs to be set, and adding additional nodes will break
-         * the count.
-        */
-        GmidTrack_midi_to_cseq_loop(gmid_file->tracks[i]);
-
-        // fix delta times for loop events just added.
-        GmidTrack_delta_from_absolute(gmid_file->tracks[i]);
-
-        // Now that delta events are correct, fix seq loop end events.
-        // This calculates a byte offset to the start loop event, which
-        // requires delta events be correct.
-        GmidTrack_seq_fix_loop_end_delta(gmid_file->tracks[i]);
+        job.track_index[job.num_tracks] = i;
+        job.num_tracks++;
+    }
 
-        GmidTrack_set_track_size_bytes(gmid_file->tracks[i]);
+    if (midi_parallel_allowed())
+    {
+        parallel_for(job.num_tracks, CseqFile_from_MidiFile_track, &job);
+    }
+    else
+    {
+        for (i=0; i<job.num_tracks; i++)
+        {
+            CseqFile_from_MidiFile_track(i, &job);
+        }
+    }
 
-        // allocate memory for compressed data, add a margin of error
-        gmid_file->tracks[i]->cseq_data = (uint8_t *)malloc_zero(1, gmid_file->tracks[i]->cseq_track_size_bytes + 50);
-        
-        // extract seq events to byte values and write to buffer
-        write_len = GmidTrack_write_to_cseq_buffer(gmid_file->tracks[i], gmid_file->tracks[i]->cseq_data, gmid_file->tracks[i]->cseq_track_size_bytes + 50);
-        gmid_file->tracks[i]->cseq_data_len = write_len;
+    // Pattern substitution can refer back to earlier tracks, so this runs in order.
+    for (track_num=0; track_num<job.num_tracks; track_num++)
+    {
+        i = job.track_index[track_num];
 
         /**
          * The pattern substitution algorithm can match byte patterns from previous
@@ -1187,7 +1160,7 @@ struct CseqFile *CseqFile_from_MidiFile(struct MidiFile *midi, struct MidiConver
             }
             else
             {
-                size_t new_size = cseq_buffer_size + write_len;
+                size_t new_size = cseq_buffer_size + gmid_file->tracks[i]->cseq_data_len;
                 malloc_resize(cseq_buffer_size, (void**)&cseq_data_buffer, new_size);
                 cseq_buffer_size = new_size;
             }
@@ -1220,11 +1193,11 @@ struct CseqFile *CseqFile_from_MidiFile(struct MidiFile *midi, struct MidiConver
 
     GmidFile_free(gmid_file);
 
-    free(debug_printf_buffer);
+    gaudio_free(debug_printf_buffer);
 
     if (cseq_data_buffer != NULL)
     {
-        free(cseq_data_buffer);
+        gaudio_free(cseq_data_buffer);
     }
 
     TRACE_LEAVE(__func__)
@@ -1241,7 +1214,7 @@ struct GmidEvent *GmidEvent_new()
 
     struct GmidEvent *event = (struct GmidEvent *)malloc_zero(1, sizeof(struct GmidEvent));
     
-    event->id = g_event_id++;
+    event->id = __atomic_fetch_add(&g_event_id, 1, __ATOMIC_RELAXED);
     
     // default to invalid command channel.
     event->command_channel = -1;
@@ -1288,7 +1261,7 @@ void GmidEvent_free(struct GmidEvent *event)
         event->dual->dual = NULL;
     }
 
-    free(event);
+    gaudio_free(event);
 
     TRACE_LEAVE(__func__)
 }
@@ -1332,11 +1305,11 @@ void GmidTrack_free(struct GmidTrack *track)
 
     if (track->cseq_data != NULL)
     {
-        free(track->cseq_data);
+        gaudio_free(track->cseq_data);
         track->cseq_data = NULL;
     }
 
-    free(track);
+    gaudio_free(track);
 
     TRACE_LEAVE(__func__)
 }
@@ -1357,11 +1330,11 @@ void CseqFile_free(struct CseqFile *cseq)
 
     if (cseq->compressed_data != NULL)
     {
-        free(cseq->compressed_data);
+        gaudio_free(cseq->compressed_data);
         cseq->compressed_data = NULL;
     }
 
-    free(cseq);
+    gaudio_free(cseq);
 
     TRACE_LEAVE(__func__)
 }
@@ -1382,11 +1355,11 @@ void MidiTrack_free(struct MidiTrack *track)
 
     if (track->ck_data_size > 0 && track->data != NULL)
     {
-        free(track->data);
+        gaudio_free(track->data);
         track->data = NULL;
     }
 
-    free(track);
+    gaudio_free(track);
 
     TRACE_LEAVE(__func__)
 }
@@ -1418,11 +1391,11 @@ void MidiFile_free(struct MidiFile *midi)
 
     if (midi->tracks != NULL)
     {
-        free(midi->tracks);
+        gaudio_free(midi->tracks);
         midi->tracks = NULL;
     }
 
-    free(midi);
+    gaudio_free(midi);
 
     TRACE_LEAVE(__func__)
 }
@@ -1433,6 +1406,8 @@ void MidiFile_free(struct MidiFile *midi)
  * Both containers must have been previously instantiated.
  * The container track should have position and length values set,
  * these will be used to read the cseq data.
+ * The track is scanned once to measure the unrolled size, then filled by
+ * copying runs of regular bytes and pattern references as blocks.
  * @param cseq: Existing n64 compressed seq file with compressed MIDI data.
  * {@code cseq->track_offset} and {@code cseq->track_lengths} must be set.
  * @param track: Existing Gmidtrack, cseq_data should be unallocated.
@@ -1455,11 +1430,14 @@ void CseqFile_unroll(struct CseqFile *cseq, struct GmidTrack *track, struct Link
     }
 
     size_t pos = 0;
+    size_t start_pos = 0;
+    size_t end_pos = 0;
+    size_t run_len = 0;
     size_t unrolled_pos = 0;
-    size_t cseq_len = 0;
-    uint8_t *temp_ptr;
-    size_t compressed_read_len = 0;
+    size_t unrolled_len = 0;
     size_t total_pattern_unroll = 0;
+    uint8_t *data;
+    uint8_t *run_end;
 
     struct LinkedListNode *node;
     struct SeqPatternMatch *pattern;
@@ -1467,52 +1445,43 @@ void CseqFile_unroll(struct CseqFile *cseq, struct GmidTrack *track, struct Link
 
     if (track->cseq_data != NULL)
     {
-        free(track->cseq_data);
+        gaudio_free(track->cseq_data);
+        track->cseq_data = NULL;
     }
 
-    // rough guess here, might resize during iteration, will adjust at the end too.
-    size_t new_size = (size_t)((float)cseq->track_lengths[track->cseq_track_index] * 1.5f);
-    track->cseq_data = (uint8_t *)malloc_zero(1, new_size);
-
     if (cseq->track_offset[track->cseq_track_index] < CSEQ_FILE_HEADER_SIZE_BYTES)
     {
         stderr_exit(EXIT_CODE_GENERAL, "%s %d> track %d, invalid size %d\n", __func__, __LINE__, track->cseq_track_index, cseq->track_offset[track->cseq_track_index]);
     }
 
-    pos = cseq->track_offset[track->cseq_track_index] - CSEQ_FILE_HEADER_SIZE_BYTES;
-    cseq_len = cseq->track_lengths[track->cseq_track_index];
+    start_pos = cseq->track_offset[track->cseq_track_index] - CSEQ_FILE_HEADER_SIZE_BYTES;
+    end_pos = start_pos + cseq->track_lengths[track->cseq_track_index];
+    data = cseq->compressed_data;
+
+    unrolled_len = CseqFile_unroll_measure(cseq, track->cseq_track_index, start_pos, end_pos);
+    track->cseq_data = (uint8_t *)malloc_zero(1, unrolled_len);
 
-    while (compressed_read_len < cseq_len)
+    pos = start_pos;
+    while (pos < end_pos)
     {
         int diff;
         int length;
-        int i;
-
-        // ensure allocated size can accept at least two bytes, otherwise resize.
-        if (unrolled_pos + 2 >= new_size)
-        {
-            new_size = (size_t)((float)new_size * 1.5f);
-            temp_ptr = (uint8_t *)malloc_zero(1, new_size);
-            memcpy(temp_ptr, track->cseq_data, unrolled_pos);
-            free(track->cseq_data);
-            track->cseq_data = temp_ptr;
-        }
 
-        // else this is a regular byte
-        if (cseq->compressed_data[pos] != 0xfe)
+        // copy regular bytes up to the next marker (or end of track).
+        run_end = (uint8_t *)memchr(&data[pos], 0xfe, end_pos - pos);
+        run_len = (run_end == NULL ? end_pos : (size_t)(run_end - data)) - pos;
+        if (run_len > 0)
         {
-            track->cseq_data[unrolled_pos] = cseq->compressed_data[pos];
-            pos++;
-            compressed_read_len++;
-            unrolled_pos++;
+            memcpy(&track->cseq_data[unrolled_pos], &data[pos], run_len);
+            pos += run_len;
+            unrolled_pos += run_len;
             continue;
         }
 
         // else this is an escape sequence, read two bytes write one.
-        // size check for +2 bytes occurred at the beginning of the loop.
-        if (cseq->compressed_data[pos+1] == 0xfe)
+        if (data[pos+1] == 0xfe)
         {
-            track->cseq_data[unrolled_pos] = cseq->compressed_data[pos];
+            track->cseq_data[unrolled_pos] = data[pos];
 
             if (patterns != NULL)
             {
@@ -1528,33 +1497,23 @@ void CseqFile_unroll(struct CseqFile *cseq, struct GmidTrack *track, struct Link
 
             if (g_verbosity >=  VERBOSE_DEBUG)
             {
-                printf("found escape sequence. File offset=%ld, track pos=%ld. Total pattern unroll=%ld\n", pos, compressed_read_len, total_pattern_unroll);
+                printf("found escape sequence. File offset=%ld, track pos=%ld. Total pattern unroll=%ld\n", pos, pos - start_pos, total_pattern_unroll);
             }
 
             pos += 2;
-            compressed_read_len += 2;
             unrolled_pos++;
             continue;
         }
 
         // else, pattern marker.
-        diff = 0;
-        diff |= cseq->compressed_data[pos + 1];
-        diff <<= 8;
-        diff |= cseq->compressed_data[pos + 2];
-
-        length = cseq->compressed_data[pos + 3];
+        diff = (data[pos + 1] << 8) | data[pos + 2];
+        length = data[pos + 3];
         pattern_counts++;
         total_pattern_unroll += length;
 
         if (g_verbosity >=  VERBOSE_DEBUG)
         {
-            printf("found pattern. File offset=%ld, track pos=%ld, length=%d, diff=%d, pattern_counts=%d. Total pattern unroll=%ld\n", pos, compressed_read_len, length, diff, pattern_counts, total_pattern_unroll);
-        }
-
-        if ((int)pos - diff < 0)
-        {
-            stderr_exit(EXIT_CODE_GENERAL, "%s %d> cseq_track %d references diff %d before start of file, position %ld.\n", __func__, __LINE__, track->cseq_track_index, diff, pos);
+            printf("found pattern. File offset=%ld, track pos=%ld, length=%d, diff=%d, pattern_counts=%d. Total pattern unroll=%ld\n", pos, pos - start_pos, length, diff, pattern_counts, total_pattern_unroll);
         }
 
         // save pattern if needed
@@ -1568,39 +1527,91 @@ void CseqFile_unroll(struct CseqFile *cseq, struct GmidTrack *track, struct Link
             LinkedList_append_node(patterns, node);
         }
 
-        // ensure pattern bytes can fit in current allocation, otherwise resize.
-        if (unrolled_pos + length >= new_size)
+        // The reference is into the compressed data, not the output, so the
+        // source and destination never overlap even when diff < length.
+        memcpy(&track->cseq_data[unrolled_pos], &data[pos - diff], length);
+        unrolled_pos += length;
+
+        pos += 4;
+    }
+
+    // set data length
+    track->cseq_data_len = unrolled_pos;
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Measures the size of a track after pattern markers are unrolled, see {@code CseqFile_unroll}.
+ * This also checks that every marker is within the track, and every referenced pattern
+ * starts within the compressed data and ends within the track.
+ * @param cseq: Existing n64 compressed seq file with compressed MIDI data.
+ * @param cseq_track_index: Track index, for error messages.
+ * @param start_pos: Offset into {@code cseq->compressed_data} of first byte of track.
+ * @param end_pos: Offset into {@code cseq->compressed_data} one past last byte of track.
+ * @returns: unrolled size in bytes.
+*/
+static size_t CseqFile_unroll_measure(struct CseqFile *cseq, int cseq_track_index, size_t start_pos, size_t end_pos)
+{
+    TRACE_ENTER(__func__)
+
+    uint8_t *data = cseq->compressed_data;
+    uint8_t *run_end;
+    size_t data_len = cseq->compressed_data_len;
+    size_t pos;
+    size_t result = 0;
+    int diff;
+    int length;
+
+    if (end_pos > data_len)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> cseq_track %d ends at %ld, past end of data %ld.\n", __func__, __LINE__, cseq_track_index, end_pos, data_len);
+    }
+
+    pos = start_pos;
+    while (pos < end_pos)
+    {
+        run_end = (uint8_t *)memchr(&data[pos], 0xfe, end_pos - pos);
+        if (run_end == NULL)
+        {
+            result += end_pos - pos;
+            break;
+        }
+
+        result += (size_t)(run_end - data) - pos;
+        pos = (size_t)(run_end - data);
+
+        if (pos + 1 < end_pos && data[pos + 1] == 0xfe)
         {
-            new_size = (size_t)((float)new_size * 1.5f);
-            temp_ptr = (uint8_t *)malloc_zero(1, new_size);
-            memcpy(temp_ptr, track->cseq_data, unrolled_pos);
-            free(track->cseq_data);
-            track->cseq_data = temp_ptr;
+            result++;
+            pos += 2;
+            continue;
         }
 
-        // now copy pattern bytes into buffer
-        for (i=0; i<length; i++)
+        if (pos + 3 >= end_pos)
         {
-            track->cseq_data[unrolled_pos] = cseq->compressed_data[pos - diff + i];
-            unrolled_pos++;
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d> cseq_track %d pattern marker at position %ld is truncated.\n", __func__, __LINE__, cseq_track_index, pos);
         }
 
-        pos += 4;
-        compressed_read_len += 4;
-    }
+        diff = (data[pos + 1] << 8) | data[pos + 2];
+        length = data[pos + 3];
 
-    // resize to actual data length.
-    temp_ptr = (uint8_t *)malloc_zero(1, unrolled_pos);
-    memcpy(temp_ptr, track->cseq_data, unrolled_pos);
-    free(track->cseq_data);
-    track->cseq_data = temp_ptr;
+        if ((size_t)diff > pos)
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d> cseq_track %d references diff %d before start of file, position %ld.\n", __func__, __LINE__, cseq_track_index, diff, pos);
+        }
 
-    // set data length
-    track->cseq_data_len = unrolled_pos;
+        if (pos - diff + length > end_pos)
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d> cseq_track %d references diff %d, length %d past end of track, position %ld.\n", __func__, __LINE__, cseq_track_index, diff, length, pos);
+        }
 
-    // cleanup
+        result += length;
+        pos += 4;
+    }
 
     TRACE_LEAVE(__func__)
+    return result;
 }
 
 /**
@@ -1644,36 +1655,165 @@ void write_patterns_to_file(struct LinkedList *patterns, struct FileInfo *file)
 }
 
 /**
- * Instead of performing pattern substitution to inflate a file, this copies
- * the track data. This is used when converting between MIDI and seq
- * without pattern substitution. (No 0xfe escaped).
- * @param cseq: Source file (from {@code cseq->compressed_data}).
- * @param track: Destination container (into {@code track->cseq_data}).
+ * Writes patterns to file in binary format. This is the same information
+ * as {@code write_patterns_to_file}, but with an index of where each track's
+ * patterns begin, so the file can be loaded without parsing text.
+ * All values are big endian. Layout:
+ *     header: id "GPMK", uint16 version, uint16 number of tracks.
+ *     index: for each track, uint32 file offset of first record, uint32 number of records.
+ *     records: int32 start_pattern_pos, int32 diff, int32 pattern_length.
+ * Records are grouped by {@code track_number}, in list order within each track.
+ * @param patterns: Array of lists of {@code struct SeqPatternMatch} to write. Elements may be NULL.
+ * @param num_lists: Number of elements in {@code patterns}.
+ * @param file: File to write to.
 */
-void CseqFile_no_unroll_copy(struct CseqFile *cseq, struct GmidTrack *track)
+void write_patterns_to_file_binary(struct LinkedList **patterns, int num_lists, struct FileInfo *file)
 {
     TRACE_ENTER(__func__)
 
-    if (cseq == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> cseq is null\n", __func__, __LINE__);
-    }
-
-    if (track == NULL)
+    if (patterns == NULL)
     {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> track is null\n", __func__, __LINE__);
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> patterns is null\n", __func__, __LINE__);
     }
 
-    if (track->cseq_data != NULL)
+    if (file == NULL)
     {
-        free(track->cseq_data);
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> file is null\n", __func__, __LINE__);
     }
 
-    size_t cseq_len;
+    struct LinkedListNode *node;
+    struct SeqPatternMatch *pattern;
+    size_t track_count[CSEQ_FILE_NUM_TRACKS];
+    size_t track_pos[CSEQ_FILE_NUM_TRACKS];
+    size_t buffer_len;
     size_t pos;
+    uint8_t *buffer;
+    uint32_t t32;
+    uint16_t t16;
+    int i;
 
-    // allocate destination contain
-    cseq_len = cseq->track_lengths[track->cseq_track_index];
+    memset(track_count, 0, sizeof(track_count));
+
+    // count records for each track.
+    for (i=0; i<num_lists; i++)
+    {
+        if (patterns[i] == NULL)
+        {
+            continue;
+        }
+
+        node = patterns[i]->head;
+        while (node != NULL)
+        {
+            pattern = (struct SeqPatternMatch *)node->data;
+            if (pattern != NULL && pattern->type == CSEQ_PATTERN_UNROLL)
+            {
+                if (pattern->track_number < 0 || pattern->track_number >= CSEQ_FILE_NUM_TRACKS)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid track_number=%d\n", __func__, __LINE__, pattern->track_number);
+                }
+
+                track_count[pattern->track_number]++;
+            }
+            node = node->next;
+        }
+    }
+
+    // index, and file offset of first record for each track.
+    pos = PATTERN_MARKER_BINARY_HEADER_SIZE + (CSEQ_FILE_NUM_TRACKS * PATTERN_MARKER_BINARY_INDEX_ENTRY_SIZE);
+    for (i=0; i<CSEQ_FILE_NUM_TRACKS; i++)
+    {
+        track_pos[i] = pos;
+        pos += track_count[i] * PATTERN_MARKER_BINARY_RECORD_SIZE;
+    }
+
+    buffer_len = pos;
+    buffer = (uint8_t *)malloc_zero(1, buffer_len);
+
+    t32 = BSWAP32_INLINE(PATTERN_MARKER_BINARY_ID);
+    memcpy(&buffer[0], &t32, 4);
+    t16 = BSWAP16_INLINE((uint16_t)PATTERN_MARKER_BINARY_VERSION);
+    memcpy(&buffer[4], &t16, 2);
+    t16 = BSWAP16_INLINE((uint16_t)CSEQ_FILE_NUM_TRACKS);
+    memcpy(&buffer[6], &t16, 2);
+
+    pos = PATTERN_MARKER_BINARY_HEADER_SIZE;
+    for (i=0; i<CSEQ_FILE_NUM_TRACKS; i++)
+    {
+        t32 = BSWAP32_INLINE((uint32_t)track_pos[i]);
+        memcpy(&buffer[pos], &t32, 4);
+        t32 = BSWAP32_INLINE((uint32_t)track_count[i]);
+        memcpy(&buffer[pos + 4], &t32, 4);
+        pos += PATTERN_MARKER_BINARY_INDEX_ENTRY_SIZE;
+    }
+
+    // records.
+    for (i=0; i<num_lists; i++)
+    {
+        if (patterns[i] == NULL)
+        {
+            continue;
+        }
+
+        node = patterns[i]->head;
+        while (node != NULL)
+        {
+            pattern = (struct SeqPatternMatch *)node->data;
+            if (pattern != NULL && pattern->type == CSEQ_PATTERN_UNROLL)
+            {
+                pos = track_pos[pattern->track_number];
+
+                t32 = BSWAP32_INLINE((uint32_t)pattern->start_pattern_pos);
+                memcpy(&buffer[pos], &t32, 4);
+                t32 = BSWAP32_INLINE((uint32_t)pattern->diff);
+                memcpy(&buffer[pos + 4], &t32, 4);
+                t32 = BSWAP32_INLINE((uint32_t)pattern->pattern_length);
+                memcpy(&buffer[pos + 8], &t32, 4);
+
+                track_pos[pattern->track_number] += PATTERN_MARKER_BINARY_RECORD_SIZE;
+            }
+            node = node->next;
+        }
+    }
+
+    FileInfo_fwrite(file, buffer, buffer_len, 1);
+
+    gaudio_free(buffer);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Instead of performing pattern substitution to inflate a file, this copies
+ * the track data. This is used when converting between MIDI and seq
+ * without pattern substitution. (No 0xfe escaped).
+ * @param cseq: Source file (from {@code cseq->compressed_data}).
+ * @param track: Destination container (into {@code track->cseq_data}).
+*/
+void CseqFile_no_unroll_copy(struct CseqFile *cseq, struct GmidTrack *track)
+{
+    TRACE_ENTER(__func__)
+
+    if (cseq == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> cseq is null\n", __func__, __LINE__);
+    }
+
+    if (track == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> track is null\n", __func__, __LINE__);
+    }
+
+    if (track->cseq_data != NULL)
+    {
+        gaudio_free(track->cseq_data);
+    }
+
+    size_t cseq_len;
+    size_t pos;
+
+    // allocate destination contain
+    cseq_len = cseq->track_lengths[track->cseq_track_index];
     track->cseq_data = (uint8_t *)malloc_zero(1, cseq_len);
 
     // check that size makes sense
@@ -1887,7 +2027,7 @@ void GmidTrack_get_pattern_matches_naive(struct GmidTrack *gtrack, uint8_t *writ
         pos += pos_increment_amount;
     }
 
-    free(copy);
+    gaudio_free(copy);
 
     TRACE_LEAVE(__func__)
 }
@@ -2151,7 +2291,7 @@ void GmidTrack_roll_apply_patterns(struct GmidTrack *gtrack, uint8_t *write_buff
     // overwriting the pointer.
     if (gtrack->cseq_data != NULL)
     {
-        free(gtrack->cseq_data);
+        gaudio_free(gtrack->cseq_data);
     }
 
     // find the number of bytes written to output buffer.
@@ -2415,7 +2555,7 @@ void GmidTrack_get_pattern_matches_file(struct MidiConvertOptions *options, stru
     }
 
     // cleanup.
-    free(file_contents);
+    gaudio_free(file_contents);
 
     TRACE_LEAVE(__func__)
 }
@@ -2505,13 +2645,40 @@ void GmidTrack_roll_entry(struct GmidTrack *gtrack, uint8_t *write_buffer, size_
             options->runtime_pattern_file = FileInfo_fopen(options->pattern_marker_filename, "rb");
         }
 
-        if (options->runtime_patterns_list == NULL)
+        if (options->runtime_pattern_index == NULL && options->runtime_patterns_list == NULL)
+        {
+            if (pattern_marker_file_is_binary(options->runtime_pattern_file))
+            {
+                options->runtime_pattern_index = SeqPatternMarkerIndex_new_from_file(options->runtime_pattern_file);
+            }
+            else
+            {
+                options->runtime_patterns_list = LinkedList_new();
+                GmidTrack_get_pattern_matches_file(options, options->runtime_patterns_list);
+            }
+        }
+
+        if (options->runtime_pattern_index != NULL)
+        {
+            SeqPatternMarkerIndex_get_track(options->runtime_pattern_index, gtrack->cseq_track_index, matches);
+
+            // Records are sorted and don't overlap (checked when the file was read), only the last
+            // one needs to be checked against the track length.
+            if (matches->tail != NULL)
+            {
+                match = (struct SeqPatternMatch *)matches->tail->data;
+
+                if ((size_t)match->start_pattern_pos + (size_t)match->pattern_length > gtrack->cseq_data_len)
+                {
+                    stderr_exit(EXIT_CODE_GENERAL, "%s %d> pattern exceeds track %d length %ld, start_pattern_pos=%d, pattern_length=%d\n", __func__, __LINE__, gtrack->cseq_track_index, gtrack->cseq_data_len, match->start_pattern_pos, match->pattern_length);
+                }
+            }
+        }
+        else
         {
-            options->runtime_patterns_list = LinkedList_new();
-            GmidTrack_get_pattern_matches_file(options, options->runtime_patterns_list);
+            LinkedList_where_i(matches, options->runtime_patterns_list, where_SeqPatternMatch_is_track, gtrack->cseq_track_index);
         }
 
-        LinkedList_where_i(matches, options->runtime_patterns_list, where_SeqPatternMatch_is_track, gtrack->cseq_track_index);
         is_double_reference = 1;
     }
     else if (options->no_pattern_compression == 0)
@@ -2697,8 +2864,14 @@ struct GmidEvent *GmidEvent_new_from_buffer(
     // most recent command channel
     int command_channel = -1;
     int command_without_channel = 0;
-    // temp varint for parsing/copying values
-    struct VarLengthInt varint;
+    // event delta time, and the number of bytes it was encoded in
+    int32_t delta_time = 0;
+    int delta_num_bytes;
+    size_t delta_max_bytes;
+    size_t duration_max_bytes;
+    // note on duration, and the number of bytes it was encoded in
+    int32_t duration = 0;
+    int duration_num_bytes = 0;
     // debug print buffer
     char print_buffer[MIDI_PARSE_DEBUG_PRINT_BUFFER_LEN];
     // debug print buffer
@@ -2728,40 +2901,46 @@ struct GmidEvent *GmidEvent_new_from_buffer(
         command_without_channel = current_command & 0xf0;
     }
 
-    memset(&varint, 0, sizeof(struct VarLengthInt));
-    VarLengthInt_value_to_int32(&buffer[pos], 4, &varint);
-
-    if (varint.num_bytes < 1)
+    if (pos > buffer_len)
     {
-        stderr_exit(EXIT_CODE_GENERAL, "%s %d> parse error, could not read variable length integer. pos=%ld\n", __func__, __LINE__, pos);
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> parse error, exceed buffer length when reading delta time pos=%ld\n", __func__, __LINE__, pos);
     }
 
-    if (pos > buffer_len)
+    // Delta time is at most four bytes, but this has always accepted one more.
+    delta_max_bytes = buffer_len - pos;
+    if (delta_max_bytes > MIDI_DELTA_TIME_MAX_READ_BYTES)
     {
-        stderr_exit(EXIT_CODE_GENERAL, "%s %d> parse error, exceed buffer length when reading delta time pos=%ld\n", __func__, __LINE__, pos);
+        delta_max_bytes = MIDI_DELTA_TIME_MAX_READ_BYTES;
     }
 
-    pos += varint.num_bytes;
-    local_bytes_read += varint.num_bytes;
+    delta_num_bytes = varint_read_int32(&buffer[pos], delta_max_bytes, &delta_time);
 
-    if (g_midi_parse_debug)
+    if (delta_num_bytes < 1)
     {
-        memset(print_buffer, 0, MIDI_PARSE_DEBUG_PRINT_BUFFER_LEN);
-
-        int32_t varint_value = VarLengthInt_get_value_big(&varint);
-        snprintf(print_buffer, MIDI_DESCRIPTION_TEXT_BUFFER_LEN, "delta time: %d (varint=0x%06x)", varint.standard_value, varint_value);
-        fflush_printf(stdout, "%s\n", print_buffer);
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> parse error, could not read variable length integer. pos=%ld\n", __func__, __LINE__, pos);
     }
 
     event = GmidEvent_new();
 
-    // Set the file offset the event begins at. pos was updated, but the pointer
+    // Set the file offset the event begins at. pos will be updated, but the pointer
     // of the argument won't be updated until the end of this method.
     event->file_offset = *pos_ptr;
 
     // Set delta time. Absolute time won't be set until all events are added to the track.
-    VarLengthInt_copy(&event->cseq_delta_time, &varint);
-    VarLengthInt_copy(&event->midi_delta_time, &varint);
+    VarLengthInt_from_buffer(&event->midi_delta_time, &buffer[pos], delta_num_bytes, delta_time);
+    event->cseq_delta_time = event->midi_delta_time;
+
+    pos += delta_num_bytes;
+    local_bytes_read += delta_num_bytes;
+
+    if (g_midi_parse_debug)
+    {
+        memset(print_buffer, 0, MIDI_PARSE_DEBUG_PRINT_BUFFER_LEN);
+
+        int32_t varint_value = VarLengthInt_get_value_big(&event->midi_delta_time);
+        snprintf(print_buffer, MIDI_DESCRIPTION_TEXT_BUFFER_LEN, "delta time: %d (varint=0x%06x)", delta_time, varint_value);
+        fflush_printf(stdout, "%s\n", print_buffer);
+    }
 
     /**
      * If current command channel is known, set that on event.
@@ -3395,7 +3574,7 @@ struct GmidEvent *GmidEvent_new_from_buffer(
                 memset(description_buffer, 0, MIDI_DESCRIPTION_TEXT_BUFFER_LEN);
 
                 midi_note_to_name(note, description_buffer, MIDI_DESCRIPTION_TEXT_BUFFER_LEN);
-                snprintf(print_buffer, MIDI_PARSE_DEBUG_PRINT_BUFFER_LEN, "%s: channel %d, %s velocity=%d, duration=%d", MIDI_COMMAND_NAME_NOTE_OFF, command_channel, description_buffer, velocity, varint.standard_value);
+                snprintf(print_buffer, MIDI_PARSE_DEBUG_PRINT_BUFFER_LEN, "%s: channel %d, %s velocity=%d, duration=%d", MIDI_COMMAND_NAME_NOTE_OFF, command_channel, description_buffer, velocity, delta_time);
                 fflush_printf(stdout, "%s\n", print_buffer);
             }
 
@@ -3429,17 +3608,32 @@ struct GmidEvent *GmidEvent_new_from_buffer(
             int velocity = buffer[pos++];
             local_bytes_read++;
 
-            memset(&varint, 0, sizeof(struct VarLengthInt));
-            VarLengthInt_value_to_int32(&buffer[pos], 4, &varint);
-            pos += varint.num_bytes;
-            local_bytes_read += varint.num_bytes;
+            if (pos < buffer_len)
+            {
+                // same limit as delta time.
+                duration_max_bytes = buffer_len - pos;
+                if (duration_max_bytes > MIDI_DELTA_TIME_MAX_READ_BYTES)
+                {
+                    duration_max_bytes = MIDI_DELTA_TIME_MAX_READ_BYTES;
+                }
+
+                duration_num_bytes = varint_read_int32(&buffer[pos], duration_max_bytes, &duration);
+            }
+
+            if (duration_num_bytes < 1)
+            {
+                stderr_exit(EXIT_CODE_GENERAL, "%s %d> parse error, could not read note duration. pos=%ld\n", __func__, __LINE__, pos);
+            }
+
+            pos += duration_num_bytes;
+            local_bytes_read += duration_num_bytes;
 
             if (pos > buffer_len)
             {
                 stderr_exit(EXIT_CODE_GENERAL, "%s %d> parse error, exceed buffer length when reading delta time pos=%ld\n", __func__, __LINE__, pos);
             }
 
-            int param_len = 2 + varint.num_bytes;
+            int param_len = 2 + duration_num_bytes;
 
             // copy raw value in same endian, other values set at end.
             memcpy(event->cseq_command_parameters_raw, &buffer[pos - param_len], param_len);
@@ -3452,7 +3646,7 @@ struct GmidEvent *GmidEvent_new_from_buffer(
                 memset(description_buffer, 0, MIDI_DESCRIPTION_TEXT_BUFFER_LEN);
 
                 midi_note_to_name(note, description_buffer, MIDI_DESCRIPTION_TEXT_BUFFER_LEN);
-                snprintf(print_buffer, MIDI_PARSE_DEBUG_PRINT_BUFFER_LEN, "%s: channel %d, %s velocity=%d, duration=%d", MIDI_COMMAND_NAME_NOTE_ON, command_channel, description_buffer, velocity, varint.standard_value);
+                snprintf(print_buffer, MIDI_PARSE_DEBUG_PRINT_BUFFER_LEN, "%s: channel %d, %s velocity=%d, duration=%d", MIDI_COMMAND_NAME_NOTE_ON, command_channel, description_buffer, velocity, duration);
                 fflush_printf(stdout, "%s\n", print_buffer);
             }
 
@@ -3467,7 +3661,7 @@ struct GmidEvent *GmidEvent_new_from_buffer(
             event->cseq_command_parameters_raw_len = param_len;
             event->cseq_command_parameters[0] = note;
             event->cseq_command_parameters[1] = velocity;
-            event->cseq_command_parameters[2] = varint.standard_value; // duration
+            event->cseq_command_parameters[2] = duration;
             event->cseq_command_parameters_len = CSEQ_COMMAND_NUM_PARAM_NOTE_ON;
 
             // convert to MIDI format
@@ -3503,7 +3697,7 @@ struct GmidEvent *GmidEvent_new_from_buffer(
                 memset(description_buffer, 0, MIDI_DESCRIPTION_TEXT_BUFFER_LEN);
 
                 midi_note_to_name(note, description_buffer, MIDI_DESCRIPTION_TEXT_BUFFER_LEN);
-                snprintf(print_buffer, MIDI_PARSE_DEBUG_PRINT_BUFFER_LEN, "%s: channel %d, %s velocity=%d, duration=%d", MIDI_COMMAND_NAME_NOTE_ON, command_channel, description_buffer, velocity, varint.standard_value);
+                snprintf(print_buffer, MIDI_PARSE_DEBUG_PRINT_BUFFER_LEN, "%s: channel %d, %s velocity=%d, duration=%d", MIDI_COMMAND_NAME_NOTE_ON, command_channel, description_buffer, velocity, delta_time);
                 fflush_printf(stdout, "%s\n", print_buffer);
             }
 
@@ -3997,7 +4191,7 @@ void GmidTrack_midi_to_cseq_loop(struct GmidTrack *gtrack)
         node = node->next;
     }
 
-    free(debug_printf_buffer);
+    gaudio_free(debug_printf_buffer);
 
     TRACE_LEAVE(__func__)
 }
@@ -4198,7 +4392,7 @@ void GmidTrack_seq_fix_loop_end_delta(struct GmidTrack *gtrack)
 
     LinkedList_free(fix_end_delta_list);
 
-    free(debug_printf_buffer);
+    gaudio_free(debug_printf_buffer);
 
     TRACE_LEAVE(__func__)
 }
@@ -5122,7 +5316,6 @@ void GmidTrack_cseq_note_on_from_midi(struct GmidTrack *gtrack)
     struct GmidEvent *event_off;
     struct LinkedListNode *node;
     struct LinkedListNode *node_off;
-    struct VarLengthInt varint;
 
     char *debug_printf_buffer;
     debug_printf_buffer = (char *)malloc_zero(1, WRITE_BUFFER_LEN);
@@ -5183,16 +5376,12 @@ void GmidTrack_cseq_note_on_from_midi(struct GmidTrack *gtrack)
                             if (duplicate_stack == 0)
                             {
                                 long absolute_delta = event_off->absolute_time - event->absolute_time;
-                                memset(&varint, 0, sizeof(struct VarLengthInt));
-                                int32_to_VarLengthInt((int32_t)absolute_delta, &varint);
 
                                 // set "easy access" value for duration.
                                 // Offset 0 and 1 are note and velocity, so start at 2.
                                 event->cseq_command_parameters[2] = (int32_t)absolute_delta;
-                                // write duration into cseq parameters.
-                                VarLengthInt_write_value_big(&event->cseq_command_parameters_raw[2], &varint);
-                                // update byte length of parameters to write.
-                                event->cseq_command_parameters_raw_len += varint.num_bytes;
+                                // write duration into cseq parameters, and update byte length of parameters to write.
+                                event->cseq_command_parameters_raw_len += varint_write_int32(&event->cseq_command_parameters_raw[2], (int32_t)absolute_delta);
                                 // flag cseq now as valid.
                                 event->cseq_valid = 1;
 
@@ -5200,8 +5389,7 @@ void GmidTrack_cseq_note_on_from_midi(struct GmidTrack *gtrack)
 
                                 if (g_verbosity >= VERBOSE_DEBUG)
                                 {
-                                    int32_t varint_value = VarLengthInt_get_value_big(&varint);
-                                    printf("set valid cseq note on, duration=%ld, varint=0x%08x\n", absolute_delta, varint_value);
+                                    printf("set valid cseq note on, duration=%ld\n", absolute_delta);
                                     
                                     memset(debug_printf_buffer, 0, WRITE_BUFFER_LEN);
                                     size_t debug_str_len = GmidEvent_to_string(event, debug_printf_buffer, WRITE_BUFFER_LEN - 2, MIDI_IMPLEMENTATION_SEQ);
@@ -5225,7 +5413,7 @@ void GmidTrack_cseq_note_on_from_midi(struct GmidTrack *gtrack)
         node = node->next;
     }
 
-    free(debug_printf_buffer);
+    gaudio_free(debug_printf_buffer);
 
     if (g_verbosity >= VERBOSE_DEBUG)
     {
@@ -5314,7 +5502,7 @@ void GmidTrack_parse_CseqTrack(struct GmidTrack *gtrack)
         LinkedList_append_node(gtrack->events, node);
     }
 
-    free(debug_printf_buffer);
+    gaudio_free(debug_printf_buffer);
 
     TRACE_LEAVE(__func__)
 }
@@ -5622,6 +5810,80 @@ int32_t GmidEvent_get_cseq_command(struct GmidEvent *event)
     return -1;
 }
 
+/**
+ * Writes a single event to out buffer in standard MIDI format: delta time,
+ * command (unless running status applies), then command parameters.
+ * The caller is responsible for ensuring the buffer has enough space
+ * for the event.
+ * @param event: event to write.
+ * @param buffer: buffer to write to. Must be previously allocated.
+ * @param previous_command: In/Out parameter. Most recent command written,
+ * used to determine running status. Should be zero at the start of a track.
+ * @returns: number of bytes written to buffer.
+*/
+size_t GmidEvent_write_to_midi_buffer(struct GmidEvent *event, uint8_t *buffer, int32_t *previous_command)
+{
+    TRACE_ENTER(__func__)
+
+    if (event == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> event is NULL\n", __func__, __LINE__);
+    }
+
+    if (buffer == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> buffer is NULL\n", __func__, __LINE__);
+    }
+
+    if (previous_command == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> previous_command is NULL\n", __func__, __LINE__);
+    }
+
+    size_t write_len = 0;
+    uint8_t rev[4];
+    int32_t command;
+
+    command = GmidEvent_get_midi_command(event);
+
+    if (event->midi_delta_time.num_bytes == 0)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid midi delta time (0)\n", __func__, __LINE__);
+    }
+
+    // write varint delta time value
+    write_len += GmidEvent_write_delta_time(&buffer[write_len], &event->midi_delta_time);
+
+    // if this is a "running status" then no need to write command, otherwise write command bytes
+    if (*previous_command != command)
+    {
+        memset(rev, 0, 4);
+        memcpy(rev, &command, event->midi_command_len);
+        // byte swap
+        reverse_inplace(rev, event->midi_command_len);
+        memcpy(&buffer[write_len], rev, event->midi_command_len);
+        write_len += event->midi_command_len;
+        *previous_command = command;
+    }
+
+    // only allow running status for the "regular" MIDI commands (commands with channels)
+    if ((command & 0xffffff00) != 0 || (command & 0xfffffff0) >= 0xf0)
+    {
+        *previous_command = 0;
+    }
+
+    // write command parameters
+    if (event->midi_command_parameters_raw_len > 0)
+    {
+        memcpy(&buffer[write_len], event->midi_command_parameters_raw, event->midi_command_parameters_raw_len);
+        write_len += event->midi_command_parameters_raw_len;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return write_len;
+}
+
 /**
  * Iterates {@code struct GmidTrack} events list and writes to out buffer
  * in standard MIDI format. This is writing the track data without the track header.
@@ -5649,8 +5911,6 @@ size_t GmidTrack_write_to_midi_buffer(struct GmidTrack *gtrack, uint8_t *buffer,
     size_t write_len = 0;
     int32_t previous_command = 0;
     struct LinkedListNode *node = gtrack->events->head;
-    uint8_t rev[4];
-    int32_t command;
 
     for (; node != NULL && write_len < max_len; node = node->next)
     {
@@ -5663,41 +5923,7 @@ size_t GmidTrack_write_to_midi_buffer(struct GmidTrack *gtrack, uint8_t *buffer,
 
         event->file_offset = write_len;
 
-        command = GmidEvent_get_midi_command(event);
-
-        if (event->midi_delta_time.num_bytes == 0)
-        {
-            stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid midi delta time (0)\n", __func__, __LINE__);
-        }
-
-        // write varint delta time value
-        VarLengthInt_write_value_big(&buffer[write_len], &event->midi_delta_time);
-        write_len += event->midi_delta_time.num_bytes;
-
-        // if this is a "running status" then no need to write command, otherwise write command bytes
-        if (previous_command != command)
-        {
-            memset(rev, 0, 4);
-            memcpy(rev, &command, event->midi_command_len);
-            // byte swap
-            reverse_inplace(rev, event->midi_command_len);
-            memcpy(&buffer[write_len], rev, event->midi_command_len);
-            write_len += event->midi_command_len;
-            previous_command = command;
-        }
-
-        // only allow running status for the "regular" MIDI commands (commands with channels)
-        if ((command & 0xffffff00) != 0 || (command & 0xfffffff0) >= 0xf0)
-        {
-            previous_command = 0;
-        }
-
-        // write command parameters
-        if (event->midi_command_parameters_raw_len > 0)
-        {
-            memcpy(&buffer[write_len], event->midi_command_parameters_raw, event->midi_command_parameters_raw_len);
-            write_len += event->midi_command_parameters_raw_len;
-        }
+        write_len += GmidEvent_write_to_midi_buffer(event, &buffer[write_len], &previous_command);
     }
 
     if (write_len > max_len)
@@ -5761,8 +5987,7 @@ size_t GmidTrack_write_to_cseq_buffer(struct GmidTrack *gtrack, uint8_t *buffer,
         }
 
         // write varint delta time value
-        VarLengthInt_write_value_big(&buffer[write_len], &event->cseq_delta_time);
-        write_len += event->cseq_delta_time.num_bytes;
+        write_len += GmidEvent_write_delta_time(&buffer[write_len], &event->cseq_delta_time);
 
         // if this is a "running status" then no need to write command, otherwise write command bytes
         if (previous_command != command)
@@ -6020,6 +6245,7 @@ struct MidiConvertOptions *MidiConvertOptions_new(void)
 /**
  * Frees memory associated to options and all child objects.
  * This will free any {@code struct SeqPatternMatch} in {@code options->runtime_patterns_list}.
+ * This will free {@code options->runtime_pattern_index}.
  * This will free {@code options->runtime_pattern_file}.
  * @param optons: Options to free.
 */
@@ -6054,13 +6280,19 @@ void MidiConvertOptions_free(struct MidiConvertOptions *options)
         options->runtime_patterns_list = NULL;
     }
     
+    if (options->runtime_pattern_index != NULL)
+    {
+        SeqPatternMarkerIndex_free(options->runtime_pattern_index);
+        options->runtime_pattern_index = NULL;
+    }
+
     if (options->runtime_pattern_file != NULL)
     {
         FileInfo_free(options->runtime_pattern_file);
         options->runtime_pattern_file = NULL;
     }
 
-    free(options);
+    gaudio_free(options);
 
     TRACE_LEAVE(__func__)
 }
@@ -6192,13 +6424,20 @@ struct MidiFile *MidiFile_transform_add_note_loop(struct MidiFile *midi_file, in
 }
 
 /**
- * Convenience method to parse MIDI file and print events to stdout.
- * @param midi_file: source file to parse.
- * @param parse_track_arg: Controls which tracks are parsed. If this is equal to -1,
- * all tracks are parsed. Otherwise, this will search for a matching track index and
- * only parse that single track.
+ * Top level entry point.
+ * Applies a list of transforms to a MIDI file. The result is the same as calling
+ * the individual {@code MidiFile_transform_*} methods one after another, but the
+ * file is only parsed once and encoded once. Steps that only edit single events
+ * (set channel instrument, make channel track) are combined into a single walk
+ * of each track when possible.
+ * This parses the file into a new container, alters the contents, and returns the
+ * new container.
+ * @param midi_file: source file to transform.
+ * @param steps: list of transforms to apply, in order.
+ * @param num_steps: number of elements in steps.
+ * @returns: Pointer to new file.
 */
-void MidiFile_parse(struct MidiFile *midi_file, int parse_track_arg)
+struct MidiFile *MidiFile_transform_pipeline(struct MidiFile *midi_file, struct MidiTransformStep *steps, int num_steps)
 {
     TRACE_ENTER(__func__)
 
@@ -6207,54 +6446,227 @@ void MidiFile_parse(struct MidiFile *midi_file, int parse_track_arg)
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> midi_file is NULL\n", __func__, __LINE__);
     }
 
-    struct GmidFile *gmid_file = GmidFile_new_from_midi(midi_file, 0);
+    if (steps == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> steps is NULL\n", __func__, __LINE__);
+    }
+
+    if (num_steps < 1)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid num_steps: %d\n", __func__, __LINE__, num_steps);
+    }
+
+    struct GmidFile *gmid_file;
+    int *destination;
+    int step_index;
+    int run_end;
+    int have_plan;
+    int channels_changed;
+    int merged_tracks;
     int i;
-    int print_count = 0;
 
-    if (parse_track_arg == -1)
+    gmid_file = GmidFile_new_from_midi(midi_file, MidiTransformStep_force_track(&steps[0]));
+
+    // If more than one source track was placed in the same track, absolute times
+    // restart partway through. Parsing the encoded result would not, so check
+    // for that before the second step.
+    merged_tracks = 0;
+    for (i=0; i<midi_file->num_tracks; i++)
     {
-        for (i=0; i<gmid_file->num_tracks; i++)
+        if (midi_file->tracks[i] != NULL && midi_file->tracks[i]->ck_data_size > 0)
         {
-            if (gmid_file->tracks[i] != NULL
-                && gmid_file->tracks[i]->events != NULL
-                && gmid_file->tracks[i]->events->count > 0)
-            {
-                GmidTrack_print(gmid_file->tracks[i], MIDI_IMPLEMENTATION_STANDARD);
-                print_count++;
-            }
+            merged_tracks++;
         }
     }
-    else
+
+    for (i=0; i<gmid_file->num_tracks; i++)
     {
-        for (i=0; i<gmid_file->num_tracks; i++)
+        if (gmid_file->tracks[i] != NULL
+            && gmid_file->tracks[i]->events != NULL
+            && gmid_file->tracks[i]->events->count > 0)
         {
-            if (gmid_file->tracks[i] != NULL
-                && gmid_file->tracks[i]->events != NULL
-                && gmid_file->tracks[i]->events->count > 0
-                && gmid_file->tracks[i]->midi_track_index == parse_track_arg)
-            {
-                GmidTrack_print(gmid_file->tracks[i], MIDI_IMPLEMENTATION_STANDARD);
-                print_count++;
-            }
+            merged_tracks--;
         }
     }
 
-    if (print_count == 0)
-    {
-        stderr_exit(EXIT_CODE_GENERAL, "%s %d> could not find any matching tracks to print\n", __func__, __LINE__);
-    }
+    destination = (int *)malloc_zero(CSEQ_FILE_NUM_TRACKS, sizeof(int));
 
-    TRACE_LEAVE(__func__)
-}
+    step_index = 0;
+    have_plan = 0;
 
-/**
- * Common format entry point.
- * Will force events that specify a channel number to be the same as the track index.
- * @param gmid_file: source file to transform.
-*/
-void GmidFile_transform_make_channel_track(struct GmidFile *gmid_file)
-{
-    TRACE_ENTER(__func__)
+    while (step_index < num_steps)
+    {
+        // Applying transforms separately would encode the intermediate result and
+        // parse it again, which can move tracks around. Do the same thing in memory.
+        if (step_index == 1 && merged_tracks > 0)
+        {
+            for (i=0; i<gmid_file->num_tracks; i++)
+            {
+                GmidTrack_absolute_from_midi_delta(gmid_file->tracks[i]);
+            }
+        }
+
+        if (step_index > 0)
+        {
+            if (have_plan || !GmidFile_retrack_plan(gmid_file, MidiTransformStep_force_track(&steps[step_index]), destination))
+            {
+                GmidFile_retrack(gmid_file, destination);
+            }
+        }
+
+        have_plan = 0;
+
+        if (!MidiTransformStep_is_event_local(&steps[step_index]))
+        {
+            if (steps[step_index].transform == MIDI_TRANSFORM_REMOVE_LOOP)
+            {
+                GmidFile_transform_remove_loop(gmid_file, steps[step_index].loop_number, steps[step_index].track);
+            }
+            else if (steps[step_index].transform == MIDI_TRANSFORM_ADD_NOTE_LOOP)
+            {
+                GmidFile_transform_add_note_loop(gmid_file, steps[step_index].loop_number, steps[step_index].track);
+            }
+            else
+            {
+                stderr_exit(EXIT_CODE_GENERAL, "%s %d> unsupported transform: %d\n", __func__, __LINE__, steps[step_index].transform);
+            }
+
+            step_index++;
+            continue;
+        }
+
+        /**
+         * Collect following single event steps into the same walk. This is only
+         * allowed if the track layout would not change between the steps.
+         * Single event steps do not move tracks, and set channel instrument does
+         * not change channels, so the layout check can be done up front.
+         * After make channel track, every track is at its MIDI track index with
+         * matching channels, so the layout can't change again.
+        */
+        channels_changed = steps[step_index].transform == MIDI_TRANSFORM_MAKE_CHANNEL_TRACK;
+        run_end = step_index + 1;
+
+        while (run_end < num_steps && MidiTransformStep_is_event_local(&steps[run_end]))
+        {
+            if (!channels_changed && !GmidFile_retrack_plan(gmid_file, MidiTransformStep_force_track(&steps[run_end]), destination))
+            {
+                have_plan = 1;
+                break;
+            }
+
+            if (steps[run_end].transform == MIDI_TRANSFORM_MAKE_CHANNEL_TRACK)
+            {
+                channels_changed = 1;
+            }
+
+            run_end++;
+        }
+
+        for (i=0; i<gmid_file->num_tracks; i++)
+        {
+            if (gmid_file->tracks[i] != NULL
+                && gmid_file->tracks[i]->events != NULL
+                && gmid_file->tracks[i]->events->count > 0)
+            {
+                struct GmidEvent *event;
+                struct LinkedListNode *node;
+                int run_index;
+
+                node = gmid_file->tracks[i]->events->head;
+                while (node != NULL)
+                {
+                    event = (struct GmidEvent *)node->data;
+                    if (event != NULL
+                        && event->midi_valid)
+                    {
+                        for (run_index=step_index; run_index<run_end; run_index++)
+                        {
+                            GmidEvent_apply_transform_step(event, gmid_file->tracks[i], &steps[run_index]);
+                        }
+                    }
+                    node = node->next;
+                }
+            }
+        }
+
+        step_index = run_end;
+    }
+
+    struct MidiFile *result = MidiFile_new_from_gmid(gmid_file);
+
+    result->division = midi_file->division;
+
+    gaudio_free(destination);
+    GmidFile_free(gmid_file);
+
+    TRACE_LEAVE(__func__)
+    return result;
+}
+
+/**
+ * Convenience method to parse MIDI file and print events to stdout.
+ * @param midi_file: source file to parse.
+ * @param parse_track_arg: Controls which tracks are parsed. If this is equal to -1,
+ * all tracks are parsed. Otherwise, this will search for a matching track index and
+ * only parse that single track.
+*/
+void MidiFile_parse(struct MidiFile *midi_file, int parse_track_arg)
+{
+    TRACE_ENTER(__func__)
+
+    if (midi_file == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> midi_file is NULL\n", __func__, __LINE__);
+    }
+
+    struct GmidFile *gmid_file = GmidFile_new_from_midi(midi_file, 0);
+    int i;
+    int print_count = 0;
+
+    if (parse_track_arg == -1)
+    {
+        for (i=0; i<gmid_file->num_tracks; i++)
+        {
+            if (gmid_file->tracks[i] != NULL
+                && gmid_file->tracks[i]->events != NULL
+                && gmid_file->tracks[i]->events->count > 0)
+            {
+                GmidTrack_print(gmid_file->tracks[i], MIDI_IMPLEMENTATION_STANDARD);
+                print_count++;
+            }
+        }
+    }
+    else
+    {
+        for (i=0; i<gmid_file->num_tracks; i++)
+        {
+            if (gmid_file->tracks[i] != NULL
+                && gmid_file->tracks[i]->events != NULL
+                && gmid_file->tracks[i]->events->count > 0
+                && gmid_file->tracks[i]->midi_track_index == parse_track_arg)
+            {
+                GmidTrack_print(gmid_file->tracks[i], MIDI_IMPLEMENTATION_STANDARD);
+                print_count++;
+            }
+        }
+    }
+
+    if (print_count == 0)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> could not find any matching tracks to print\n", __func__, __LINE__);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Common format entry point.
+ * Will force events that specify a channel number to be the same as the track index.
+ * @param gmid_file: source file to transform.
+*/
+void GmidFile_transform_make_channel_track(struct GmidFile *gmid_file)
+{
+    TRACE_ENTER(__func__)
 
     if (gmid_file == NULL)
     {
@@ -6767,11 +7179,11 @@ void GmidFile_free(struct GmidFile *gmid_file)
 
         gmid_file->num_tracks = 0;
 
-        free(gmid_file->tracks);
+        gaudio_free(gmid_file->tracks);
         gmid_file->tracks = NULL;
     }
 
-    free(gmid_file);
+    gaudio_free(gmid_file);
     
     TRACE_LEAVE(__func__)
 }
@@ -6868,106 +7280,912 @@ static void SeqPatternMatch_free(struct SeqPatternMatch *obj)
 
     if (obj != NULL)
     {
-        free(obj);
+        gaudio_free(obj);
     }
 
     TRACE_LEAVE(__func__)
 }
 
 /**
- * Debug filtered method to print all events in a track.
- * @param track: Track to print events for.
- * @param type: Type of events to print (MIDI or seq).
+ * Checks whether a pattern marker file is in binary format (see {@code write_patterns_to_file_binary}).
+ * @param file: File to check.
+ * @returns: 1 if file begins with binary pattern marker id, 0 otherwise.
 */
-static void GmidTrack_debug_print(struct GmidTrack *track, enum MIDI_IMPLEMENTATION type)
+static int pattern_marker_file_is_binary(struct FileInfo *file)
 {
     TRACE_ENTER(__func__)
 
-    if (track == NULL)
+    if (file == NULL)
     {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> track is NULL\n", __func__, __LINE__);
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> file is null\n", __func__, __LINE__);
     }
 
-    if (g_verbosity >= VERBOSE_DEBUG)
-    {
-        char *debug_printf_buffer;
-        struct LinkedListNode *node;
-        struct GmidEvent *event;
-
-        debug_printf_buffer = (char *)malloc_zero(1, WRITE_BUFFER_LEN);
-
-        printf("Print track midi # %d, cseq # %d\n", track->midi_track_index, track->cseq_track_index);
-
-        node = track->events->head;
-        while (node != NULL)
-        {
-            event = (struct GmidEvent *)node->data;
-            if (event != NULL)
-            {
-                memset(debug_printf_buffer, 0, WRITE_BUFFER_LEN);
-                size_t debug_str_len = GmidEvent_to_string(event, debug_printf_buffer, WRITE_BUFFER_LEN - 2, type);
-                debug_printf_buffer[debug_str_len] = '\n';
-                fflush_string(stdout, debug_printf_buffer);
-            }
-
-            node = node->next;
-        }
+    uint32_t t32;
 
-        free(debug_printf_buffer);
+    if (file->len < 4)
+    {
+        TRACE_LEAVE(__func__)
+        return 0;
     }
 
+    FileInfo_fseek(file, 0, SEEK_SET);
+    FileInfo_fread(file, &t32, 4, 1);
+    BSWAP32(t32);
+
     TRACE_LEAVE(__func__)
+    return t32 == PATTERN_MARKER_BINARY_ID;
 }
 
 /**
- * Method to print all events in a track, ignores {@code g_verbosity} and
- * prints to stdout.
- * This is the end-user friendly version called by miditool.
- * @param track: Track to print events for.
- * @param type: Type of events to print (MIDI or seq).
+ * Reads a binary pattern marker file (see {@code write_patterns_to_file_binary}).
+ * This allocates memory for the index and all matches.
+ * @param file: File to read.
+ * @returns: pointer to new object.
 */
-static void GmidTrack_print(struct GmidTrack *track, enum MIDI_IMPLEMENTATION type)
+static struct SeqPatternMarkerIndex *SeqPatternMarkerIndex_new_from_file(struct FileInfo *file)
 {
     TRACE_ENTER(__func__)
 
-    if (track == NULL)
+    if (file == NULL)
     {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> track is NULL\n", __func__, __LINE__);
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> file is null\n", __func__, __LINE__);
     }
 
-    char *debug_printf_buffer;
-    struct LinkedListNode *node;
-    struct GmidEvent *event;
+    struct SeqPatternMarkerIndex *result;
+    struct SeqPatternMatch *match;
+    uint8_t *file_contents;
+    size_t len;
+    size_t data_start;
+    size_t track_offset[CSEQ_FILE_NUM_TRACKS];
+    size_t pos;
+    size_t i;
+    uint32_t t32;
+    uint16_t t16;
+    int num_tracks;
+    int track;
+    int track_pos;
 
-    debug_printf_buffer = (char *)malloc_zero(1, WRITE_BUFFER_LEN);
+    len = file->len;
+    data_start = PATTERN_MARKER_BINARY_HEADER_SIZE + (CSEQ_FILE_NUM_TRACKS * PATTERN_MARKER_BINARY_INDEX_ENTRY_SIZE);
 
-    if (type == MIDI_IMPLEMENTATION_STANDARD)
+    if (len < data_start)
     {
-        printf("Print MIDI track # %d\n", track->midi_track_index);
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> pattern file too short, len=%ld\n", __func__, __LINE__, len);
     }
-    else if (type == MIDI_IMPLEMENTATION_SEQ)
+
+    file_contents = (uint8_t *)malloc_zero(1, len);
+    FileInfo_fseek(file, 0, SEEK_SET);
+    FileInfo_fread(file, file_contents, len, 1);
+
+    memcpy(&t32, &file_contents[0], 4);
+    BSWAP32(t32);
+    if (t32 != PATTERN_MARKER_BINARY_ID)
     {
-        printf("Print seq track # %d\n", track->cseq_track_index);
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid pattern file id. Expected 0x%08x, actual 0x%08x.\n", __func__, __LINE__, PATTERN_MARKER_BINARY_ID, t32);
     }
 
-    node = track->events->head;
-    while (node != NULL)
+    memcpy(&t16, &file_contents[4], 2);
+    BSWAP16(t16);
+    if (t16 != PATTERN_MARKER_BINARY_VERSION)
     {
-        event = (struct GmidEvent *)node->data;
-        if (event != NULL)
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> unsupported pattern file version %d\n", __func__, __LINE__, t16);
+    }
+
+    memcpy(&t16, &file_contents[6], 2);
+    BSWAP16(t16);
+    num_tracks = t16;
+    if (num_tracks != CSEQ_FILE_NUM_TRACKS)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid pattern file track count. Expected %d, actual %d.\n", __func__, __LINE__, CSEQ_FILE_NUM_TRACKS, num_tracks);
+    }
+
+    result = (struct SeqPatternMarkerIndex *)malloc_zero(1, sizeof(struct SeqPatternMarkerIndex));
+
+    pos = PATTERN_MARKER_BINARY_HEADER_SIZE;
+    for (track=0; track<CSEQ_FILE_NUM_TRACKS; track++)
+    {
+        memcpy(&t32, &file_contents[pos], 4);
+        BSWAP32(t32);
+        track_offset[track] = t32;
+
+        memcpy(&t32, &file_contents[pos + 4], 4);
+        BSWAP32(t32);
+        result->track_count[track] = t32;
+
+        pos += PATTERN_MARKER_BINARY_INDEX_ENTRY_SIZE;
+
+        // check offset before the subtraction, size_t would wrap around.
+        if (track_offset[track] < data_start
+            || track_offset[track] > len
+            || result->track_count[track] > (len - track_offset[track]) / PATTERN_MARKER_BINARY_RECORD_SIZE)
         {
-            memset(debug_printf_buffer, 0, WRITE_BUFFER_LEN);
-            size_t debug_str_len = GmidEvent_to_string(event, debug_printf_buffer, WRITE_BUFFER_LEN - 2, type);
-            debug_printf_buffer[debug_str_len] = '\n';
-            fflush_string(stdout, debug_printf_buffer);
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d> track %d records out of range, offset=0x%lx, count=%ld, len=%ld\n", __func__, __LINE__, track, track_offset[track], result->track_count[track], len);
         }
 
-        node = node->next;
+        result->track_start[track] = result->match_count;
+        result->match_count += result->track_count[track];
     }
 
-    printf("\n");
+    if (result->match_count > 0)
+    {
+        result->matches = (struct SeqPatternMatch *)malloc_zero(result->match_count, sizeof(struct SeqPatternMatch));
+    }
+
+    for (track=0; track<CSEQ_FILE_NUM_TRACKS; track++)
+    {
+        pos = track_offset[track];
+        match = &result->matches[result->track_start[track]];
+        track_pos = 0;
+
+        for (i=0; i<result->track_count[track]; i++, match++)
+        {
+            match->track_number = track;
+            match->type = CSEQ_PATTERN_UNROLL;
+
+            memcpy(&t32, &file_contents[pos], 4);
+            BSWAP32(t32);
+            match->start_pattern_pos = (int32_t)t32;
+
+            memcpy(&t32, &file_contents[pos + 4], 4);
+            BSWAP32(t32);
+            match->diff = (int32_t)t32;
+
+            memcpy(&t32, &file_contents[pos + 8], 4);
+            BSWAP32(t32);
+            match->pattern_length = (int32_t)t32;
+
+            // Records are sorted by position and can't overlap. The pattern marker stores
+            // the diff in two bytes and the length in one byte.
+            if (match->start_pattern_pos < track_pos
+                || match->diff < 1
+                || match->diff > 0xffff
+                || match->pattern_length < 1
+                || match->pattern_length > 0xff)
+            {
+                stderr_exit(EXIT_CODE_GENERAL, "%s %d> track %d record %ld invalid, start_pattern_pos=%d, diff=%d, pattern_length=%d\n", __func__, __LINE__, track, i, match->start_pattern_pos, match->diff, match->pattern_length);
+            }
+
+            track_pos = match->start_pattern_pos + match->pattern_length;
+
+            pos += PATTERN_MARKER_BINARY_RECORD_SIZE;
+        }
+    }
+
+    gaudio_free(file_contents);
+
+    TRACE_LEAVE(__func__)
+    return result;
+}
 
-    free(debug_printf_buffer);
+/**
+ * Frees memory allocated to index and all matches.
+ * @param obj: Object to free.
+*/
+static void SeqPatternMarkerIndex_free(struct SeqPatternMarkerIndex *obj)
+{
+    TRACE_ENTER(__func__)
+
+    if (obj == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    if (obj->matches != NULL)
+    {
+        gaudio_free(obj->matches);
+    }
+
+    gaudio_free(obj);
 
     TRACE_LEAVE(__func__)
-}
\ No newline at end of file
+}
+
+/**
+ * Appends all matches for a single track to a list. The list nodes
+ * refer to matches owned by the index, they should not be freed.
+ * @param index: Index to read from.
+ * @param track_number: cseq track index.
+ * @param matches: List to append results to. Must be previously allocated.
+*/
+static void SeqPatternMarkerIndex_get_track(struct SeqPatternMarkerIndex *index, int track_number, struct LinkedList *matches)
+{
+    TRACE_ENTER(__func__)
+
+    if (index == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> index is null\n", __func__, __LINE__);
+    }
+
+    if (matches == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> matches is null\n", __func__, __LINE__);
+    }
+
+    struct LinkedListNode *node;
+    size_t i;
+
+    if (track_number < 0 || track_number >= CSEQ_FILE_NUM_TRACKS)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    for (i=0; i<index->track_count[track_number]; i++)
+    {
+        node = LinkedListNode_new();
+        node->data = &index->matches[index->track_start[track_number] + i];
+        LinkedList_append_node(matches, node);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Debug filtered method to print all events in a track.
+ * @param track: Track to print events for.
+ * @param type: Type of events to print (MIDI or seq).
+*/
+static void GmidTrack_debug_print(struct GmidTrack *track, enum MIDI_IMPLEMENTATION type)
+{
+    TRACE_ENTER(__func__)
+
+    if (track == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> track is NULL\n", __func__, __LINE__);
+    }
+
+    if (g_verbosity >= VERBOSE_DEBUG)
+    {
+        char *debug_printf_buffer;
+        struct LinkedListNode *node;
+        struct GmidEvent *event;
+
+        debug_printf_buffer = (char *)malloc_zero(1, WRITE_BUFFER_LEN);
+
+        printf("Print track midi # %d, cseq # %d\n", track->midi_track_index, track->cseq_track_index);
+
+        node = track->events->head;
+        while (node != NULL)
+        {
+            event = (struct GmidEvent *)node->data;
+            if (event != NULL)
+            {
+                memset(debug_printf_buffer, 0, WRITE_BUFFER_LEN);
+                size_t debug_str_len = GmidEvent_to_string(event, debug_printf_buffer, WRITE_BUFFER_LEN - 2, type);
+                debug_printf_buffer[debug_str_len] = '\n';
+                fflush_string(stdout, debug_printf_buffer);
+            }
+
+            node = node->next;
+        }
+
+        gaudio_free(debug_printf_buffer);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Method to print all events in a track, ignores {@code g_verbosity} and
+ * prints to stdout.
+ * This is the end-user friendly version called by miditool.
+ * @param track: Track to print events for.
+ * @param type: Type of events to print (MIDI or seq).
+*/
+static void GmidTrack_print(struct GmidTrack *track, enum MIDI_IMPLEMENTATION type)
+{
+    TRACE_ENTER(__func__)
+
+    if (track == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> track is NULL\n", __func__, __LINE__);
+    }
+
+    char *debug_printf_buffer;
+    struct LinkedListNode *node;
+    struct GmidEvent *event;
+
+    debug_printf_buffer = (char *)malloc_zero(1, WRITE_BUFFER_LEN);
+
+    if (type == MIDI_IMPLEMENTATION_STANDARD)
+    {
+        printf("Print MIDI track # %d\n", track->midi_track_index);
+    }
+    else if (type == MIDI_IMPLEMENTATION_SEQ)
+    {
+        printf("Print seq track # %d\n", track->cseq_track_index);
+    }
+
+    node = track->events->head;
+    while (node != NULL)
+    {
+        event = (struct GmidEvent *)node->data;
+        if (event != NULL)
+        {
+            memset(debug_printf_buffer, 0, WRITE_BUFFER_LEN);
+            size_t debug_str_len = GmidEvent_to_string(event, debug_printf_buffer, WRITE_BUFFER_LEN - 2, type);
+            debug_printf_buffer[debug_str_len] = '\n';
+            fflush_string(stdout, debug_printf_buffer);
+        }
+
+        node = node->next;
+    }
+
+    printf("\n");
+
+    gaudio_free(debug_printf_buffer);
+
+    TRACE_LEAVE(__func__)
+}
+/**
+ * Gets the force_track argument the single transform method would use
+ * when calling {@code GmidFile_new_from_midi}.
+ * @param step: transform step.
+ * @returns: 1 if tracks are placed by track index, 0 if placed by channel.
+*/
+static int MidiTransformStep_force_track(struct MidiTransformStep *step)
+{
+    TRACE_ENTER(__func__)
+
+    int result = step->transform == MIDI_TRANSFORM_MAKE_CHANNEL_TRACK;
+
+    TRACE_LEAVE(__func__)
+    return result;
+}
+
+/**
+ * Checks whether transform step only edits events in place, without adding,
+ * removing, or moving events.
+ * @param step: transform step.
+ * @returns: 1 if step only edits single events, 0 otherwise.
+*/
+static int MidiTransformStep_is_event_local(struct MidiTransformStep *step)
+{
+    TRACE_ENTER(__func__)
+
+    int result = step->transform == MIDI_TRANSFORM_SET_CHANNEL_INSTRUMENT
+        || step->transform == MIDI_TRANSFORM_MAKE_CHANNEL_TRACK;
+
+    TRACE_LEAVE(__func__)
+    return result;
+}
+
+/**
+ * Applies a single event transform step to an event.
+ * Same as {@code GmidFile_transform_set_channel_instrument} or
+ * {@code GmidFile_transform_make_channel_track}, but for one event.
+ * @param event: event to update. Must be MIDI valid.
+ * @param gtrack: track containing the event.
+ * @param step: transform step.
+*/
+static void GmidEvent_apply_transform_step(struct GmidEvent *event, struct GmidTrack *gtrack, struct MidiTransformStep *step)
+{
+    TRACE_ENTER(__func__)
+
+    if (step->transform == MIDI_TRANSFORM_SET_CHANNEL_INSTRUMENT)
+    {
+        if (event->command == MIDI_COMMAND_BYTE_PROGRAM_CHANGE
+            && event->command_channel == step->channel)
+        {
+            if (g_verbosity >= 1)
+            {
+                printf("Changing MIDI \"%s\" event in track index %d, from %d to %d\n", MIDI_COMMAND_NAME_PROGRAM_CHANGE, gtrack->midi_track_index, event->midi_command_parameters[0], step->instrument);
+            }
+
+            event->midi_command_parameters[0] = step->instrument;
+            event->midi_command_parameters_raw[0] = step->instrument;
+        }
+    }
+    else if (step->transform == MIDI_TRANSFORM_MAKE_CHANNEL_TRACK)
+    {
+        event->command_channel = gtrack->midi_track_index;
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Determines where each track would be placed if the file were written to MIDI
+ * and then parsed again with {@code GmidFile_new_from_midi}.
+ * @param gmid_file: file to check.
+ * @param force_track: force_track argument for {@code GmidFile_new_from_midi}.
+ * @param destination: out parameter. Array of length {@code CSEQ_FILE_NUM_TRACKS}.
+ * Set to the new track index of each track, or -1 if the track is empty.
+ * @returns: 1 if no track would change, 0 otherwise.
+*/
+static int GmidFile_retrack_plan(struct GmidFile *gmid_file, int force_track, int *destination)
+{
+    TRACE_ENTER(__func__)
+
+    int i;
+    int midi_track_index = 0;
+    int unchanged = 1;
+
+    for (i=0; i<CSEQ_FILE_NUM_TRACKS; i++)
+    {
+        struct LinkedListNode *node;
+        struct GmidEvent *event;
+        int destination_track = -1;
+
+        destination[i] = -1;
+
+        if (i >= gmid_file->num_tracks
+            || gmid_file->tracks[i] == NULL
+            || gmid_file->tracks[i]->events == NULL
+            || gmid_file->tracks[i]->events->count == 0)
+        {
+            continue;
+        }
+
+        if (force_track)
+        {
+            destination_track = midi_track_index;
+        }
+        else
+        {
+            // Set destination track to first seen command channel.
+            node = gmid_file->tracks[i]->events->head;
+            while (node != NULL)
+            {
+                event = (struct GmidEvent *)node->data;
+                if (event != NULL && event->command_channel > -1)
+                {
+                    destination_track = event->command_channel;
+                    break;
+                }
+                node = node->next;
+            }
+        }
+
+        if (destination_track == -1)
+        {
+            fflush_printf(stderr, "destination track not resolved, assuming midi track %d\n", midi_track_index);
+            destination_track = midi_track_index;
+        }
+
+        if (destination_track >= CSEQ_FILE_NUM_TRACKS)
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d>: invalid destination_track %d resolved from nth midi track %d\n", __func__, __LINE__, destination_track, midi_track_index);
+        }
+
+        destination[i] = destination_track;
+
+        if (destination_track != i
+            || gmid_file->tracks[i]->midi_track_index != midi_track_index
+            || gmid_file->tracks[i]->cseq_track_index != destination_track)
+        {
+            unchanged = 0;
+        }
+
+        midi_track_index++;
+    }
+
+    TRACE_LEAVE(__func__)
+    return unchanged;
+}
+
+/**
+ * Moves tracks according to plan from {@code GmidFile_retrack_plan}.
+ * Tracks resolving to the same destination are appended in order, and the
+ * absolute times recalculated, the same as {@code GmidFile_new_from_midi}.
+ * @param gmid_file: file to update.
+ * @param destination: new track index of each track, or -1 if the track is empty.
+*/
+static void GmidFile_retrack(struct GmidFile *gmid_file, int *destination)
+{
+    TRACE_ENTER(__func__)
+
+    struct GmidTrack **tracks;
+    int source_count[CSEQ_FILE_NUM_TRACKS];
+    int i;
+    int midi_track_index = 0;
+
+    tracks = (struct GmidTrack **)malloc_zero(CSEQ_FILE_NUM_TRACKS, sizeof(struct GmidTrack *));
+    memset(source_count, 0, sizeof(source_count));
+
+    for (i=0; i<CSEQ_FILE_NUM_TRACKS; i++)
+    {
+        tracks[i] = GmidTrack_new();
+    }
+
+    for (i=0; i<CSEQ_FILE_NUM_TRACKS; i++)
+    {
+        int destination_track = destination[i];
+
+        if (destination_track == -1)
+        {
+            continue;
+        }
+
+        tracks[destination_track]->midi_track_index = midi_track_index;
+        tracks[destination_track]->cseq_track_index = destination_track;
+        tracks[destination_track]->midi_track_size_bytes = gmid_file->tracks[i]->midi_track_size_bytes;
+        source_count[destination_track]++;
+
+        while (gmid_file->tracks[i]->events->count > 0)
+        {
+            LinkedListNode_move(tracks[destination_track]->events, gmid_file->tracks[i]->events, gmid_file->tracks[i]->events->head);
+        }
+
+        midi_track_index++;
+    }
+
+    for (i=0; i<CSEQ_FILE_NUM_TRACKS; i++)
+    {
+        if (source_count[i] > 1)
+        {
+            GmidTrack_absolute_from_midi_delta(tracks[i]);
+            GmidTrack_set_track_size_bytes(tracks[i]);
+        }
+    }
+
+    for (i=0; i<gmid_file->num_tracks; i++)
+    {
+        GmidTrack_free(gmid_file->tracks[i]);
+    }
+
+    gaudio_free(gmid_file->tracks);
+    gmid_file->tracks = tracks;
+    gmid_file->num_tracks = CSEQ_FILE_NUM_TRACKS;
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Sets absolute time of every event in the track from the running total of MIDI
+ * delta times, the same as when the track is parsed.
+ * @param gtrack: track to update.
+*/
+static void GmidTrack_absolute_from_midi_delta(struct GmidTrack *gtrack)
+{
+    TRACE_ENTER(__func__)
+
+    struct LinkedListNode *node;
+    struct GmidEvent *event;
+    long absolute_time = 0;
+
+    node = gtrack->events->head;
+    while (node != NULL)
+    {
+        event = (struct GmidEvent *)node->data;
+        absolute_time += event->midi_delta_time.standard_value;
+        event->absolute_time = absolute_time;
+        node = node->next;
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Checks whether track level work can be run on multiple threads. Debug output
+ * is printed while parsing, so that runs in order.
+ * @returns: 1 if parallel is allowed, 0 otherwise.
+*/
+static int midi_parallel_allowed()
+{
+    TRACE_ENTER(__func__)
+
+    int result = g_verbosity < VERBOSE_DEBUG && !g_midi_parse_debug;
+
+    TRACE_LEAVE(__func__)
+    return result;
+}
+
+/**
+ * {@code parallel_for} callback, converts a single cseq track to MIDI.
+ * @param index: index into {@code job->cseq_track_index}.
+ * @param state: {@code struct CseqToMidiJob}.
+*/
+static void MidiFile_from_CseqFile_track(int index, void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct CseqToMidiJob *job = (struct CseqToMidiJob *)state;
+    int cseq_track_index = job->cseq_track_index[index];
+    struct GmidTrack *gtrack;
+    struct LinkedList *patterns = NULL;
+
+    if (g_verbosity >= VERBOSE_DEBUG)
+    {
+        printf("MidiFile_from_CseqFile: parse track %d\n", cseq_track_index);
+    }
+
+    gtrack = GmidTrack_new();
+
+    gtrack->midi_track_index = index;
+    gtrack->cseq_track_index = cseq_track_index;
+
+    if (job->opt_pattern_substitution)
+    {
+        patterns = LinkedList_new();
+        CseqFile_unroll(job->cseq, gtrack, patterns);
+    }
+    else
+    {
+        CseqFile_no_unroll_copy(job->cseq, gtrack);
+    }
+
+    // parse seq format into common events
+    GmidTrack_parse_CseqTrack(gtrack);
+
+    if (job->post_unroll_action != NULL)
+    {
+        job->post_unroll_action(gtrack);
+    }
+
+    // The seq loop end event contains the loop iteration count, but that's needed in the MIDI
+    // loop start event, so resolve all dual pointers to make that available. One complication
+    // is that pattern substitution is applied before loop end offset is calculated, so
+    // unrolling above means the loop end offsets are now wrong. Pass in the list of patterns
+    // found unrolling the track to this method to adjust loop end offsets.
+    // This needs to happen before any nodes are added, and before
+    // delta events are changed in order to calculate offsets correctly.
+    GmidTrack_pair_cseq_loop_events(gtrack, patterns);
+
+    // Mark invalid seq loops as invalid.
+    // Create MIDI sysex events (custom events) for invalid seq loop events according to user option.
+    // This needs to happen after GmidTrack_pair_cseq_loop_events.
+    GmidTrack_invalid_cseq_loop_to_sysex(gtrack, job->no_create_sysex);
+
+    // Create midi note off events from the seq note-on events.
+    // This will break delta events for the track.
+    GmidTrack_midi_note_off_from_cseq(gtrack);
+
+    // Sort events by absolute time. This is needed because
+    // the applied duration from the note-on can move
+    // the new note-off event substantially.
+    LinkedList_merge_sort(gtrack->events, LinkedListNode_gmidevent_compare_smaller);
+
+    // Fix delta times, due to adding note-off events.
+    GmidTrack_delta_from_absolute(gtrack);
+
+    // Convert cseq loop markers into non-standard controller events
+    GmidTrack_cseq_to_midi_loop(gtrack);
+
+    // Fix delta times, due to adding MIDI controller events for looping.
+    GmidTrack_delta_from_absolute(gtrack);
+
+    if (g_verbosity >= VERBOSE_DEBUG)
+    {
+        GmidTrack_debug_print(gtrack, MIDI_IMPLEMENTATION_STANDARD);
+    }
+
+    // estimate total track size in bytes.
+    GmidTrack_set_track_size_bytes(gtrack);
+
+    job->midi_tracks[index] = MidiTrack_new_from_GmidTrack(gtrack);
+    job->patterns[index] = patterns;
+
+    // cleanup
+    GmidTrack_free(gtrack);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * {@code parallel_for} callback, parses a single MIDI track into a list of events
+ * and resolves the destination track.
+ * @param index: source track index.
+ * @param state: {@code struct MidiToGmidJob}.
+*/
+static void GmidFile_new_from_midi_track(int index, void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct MidiToGmidJob *job = (struct MidiToGmidJob *)state;
+    struct MidiTrack *source_track = job->midi->tracks[index];
+    struct LinkedList *track_event_holder;
+    struct LinkedListNode *node;
+    struct GmidEvent *event;
+    char *debug_printf_buffer = NULL;
+    size_t track_pos;
+    size_t buffer_len;
+    int32_t command;
+    int destination_track = -1;
+
+    /** 
+     * running count of absolute time.
+     * Every delta event read is added to this value.
+     * The first delta event read sets the very first absolute time (not necessarily zero).
+    */
+    long absolute_time = 0;
+
+    job->destination_track[index] = -1;
+    job->events[index] = NULL;
+
+    if (g_verbosity >= VERBOSE_DEBUG)
+    {
+        printf("\n");
+        printf("begin parse track %d\n", index);
+    }
+
+    if (source_track == NULL)
+    {
+        if (g_verbosity >= VERBOSE_DEBUG)
+        {
+            printf("empty track\n");
+        }
+
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    if (g_verbosity >= VERBOSE_DEBUG)
+    {
+        debug_printf_buffer = (char *)malloc_zero(1, WRITE_BUFFER_LEN);
+    }
+
+    track_event_holder = LinkedList_new();
+
+    command = 0;
+    track_pos = 0;
+    buffer_len = source_track->ck_data_size;
+
+    /**
+     * Iterate the events in this track and add to track_event_holder.
+     * This addresses two problems.
+     * 1) Some seq tracks are null, and this isn't captured in output MIDI,
+     *    the only way to recognize this is by looking at the command channel
+     *    in the track events.
+     * 2) A track might start with meta events which don't have a command
+     *    channel, so the destination seq track won't be known yet.
+     * 
+     * After all the events from the track are added to the temp list,
+     * the command channel should have been seen at least once.
+     * Use the first read command channel to determine which seq
+     * track these events belong to.
+    */
+    while (track_pos < buffer_len)
+    {
+        int bytes_read = 0;
+        
+        // track position will be updated according to how many bytes read.
+        event = GmidEvent_new_from_buffer(source_track->data, &track_pos, buffer_len, MIDI_IMPLEMENTATION_STANDARD, command, &bytes_read);
+
+        if (event == NULL)
+        {
+            stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: event is NULL\n", __func__, __LINE__);
+        }
+
+        if (bytes_read == 0)
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d>: invalid bytes_read (0) from GmidEvent_new_from_buffer\n", __func__, __LINE__);
+        }
+
+        absolute_time += event->midi_delta_time.standard_value;
+        event->absolute_time = absolute_time;
+
+        if (g_verbosity >= VERBOSE_DEBUG)
+        {
+            memset(debug_printf_buffer, 0, WRITE_BUFFER_LEN);
+            size_t debug_str_len = GmidEvent_to_string(event, debug_printf_buffer, WRITE_BUFFER_LEN - 2, MIDI_IMPLEMENTATION_STANDARD);
+            debug_printf_buffer[debug_str_len] = '\n';
+            fflush_string(stdout, debug_printf_buffer);
+        }
+
+        if (job->force_track)
+        {
+            destination_track = index;
+        }
+        else
+        {
+            // Set destination track to first seen command channel.
+            if (destination_track == -1 && event->command_channel > -1)
+            {
+                destination_track = event->command_channel;
+            }
+        }
+
+        command = GmidEvent_get_midi_command(event);
+
+        // only allow running status for the "regular" MIDI commands (commands with channels)
+        if ((command & 0xffffff00) != 0 || (command & 0xfffffff0) >= 0xf0)
+        {
+            command = 0;
+        }
+
+        node = LinkedListNode_new();
+        node->data = event;
+        LinkedList_append_node(track_event_holder, node);
+    }
+
+    if (g_verbosity >= VERBOSE_DEBUG)
+    {
+        printf("finish parse track %d\n", index);
+    }
+
+    job->destination_track[index] = destination_track;
+    job->events[index] = track_event_holder;
+
+    if (debug_printf_buffer != NULL)
+    {
+        gaudio_free(debug_printf_buffer);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * {@code parallel_for} callback, converts a single common track to
+ * cseq format, without pattern substitution.
+ * @param index: index into {@code job->track_index}.
+ * @param state: {@code struct GmidToCseqJob}.
+*/
+static void CseqFile_from_MidiFile_track(int index, void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct GmidToCseqJob *job = (struct GmidToCseqJob *)state;
+    struct GmidTrack *gtrack = job->gmid_file->tracks[job->track_index[index]];
+    size_t write_len;
+
+    // Transform MIDI sysex escaped cseq event into real cseq event.
+    GmidTrack_midi_sysex_to_cseq(gtrack);
+
+    // Convert note-off and implicit note-off to cseq format.
+    // Absolute times must be accurate in order to calculate duration.
+    GmidTrack_cseq_note_on_from_midi(gtrack);
+
+    // Sort events by absolute time
+    LinkedList_merge_sort(gtrack->events, LinkedListNode_gmidevent_compare_smaller);
+
+    GmidTrack_delta_from_absolute(gtrack);
+
+    /**
+     * cseq2midi needed loop end to be linked to loop start to resolve
+     * the loop count, but the other direction can just check that
+     * the loop count event follows the loop start event (this is how gaudio converts).
+     * This should be done last because the byte offset from the end to the
+     * start node needs to be set, and adding additional nodes will break
+     * the count.
+    */
+    GmidTrack_midi_to_cseq_loop(gtrack);
+
+    // fix delta times for loop events just added.
+    GmidTrack_delta_from_absolute(gtrack);
+
+    // Now that delta events are correct, fix seq loop end events.
+    // This calculates a byte offset to the start loop event, which
+    // requires delta events be correct.
+    GmidTrack_seq_fix_loop_end_delta(gtrack);
+
+    GmidTrack_set_track_size_bytes(gtrack);
+
+    // allocate memory for compressed data, add a margin of error
+    gtrack->cseq_data = (uint8_t *)malloc_zero(1, gtrack->cseq_track_size_bytes + 50);
+    
+    // extract seq events to byte values and write to buffer
+    write_len = GmidTrack_write_to_cseq_buffer(gtrack, gtrack->cseq_data, gtrack->cseq_track_size_bytes + 50);
+    gtrack->cseq_data_len = write_len;
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Writes event delta time to buffer as varint, most significant byte first.
+ * Encodes directly from the value when the stored encoding is the minimal one,
+ * otherwise the stored bytes are written as they were read.
+ * @param buffer: buffer to write to.
+ * @param delta_time: delta time to write.
+ * @returns: number of bytes written.
+*/
+static int GmidEvent_write_delta_time(uint8_t *buffer, struct VarLengthInt *delta_time)
+{
+    TRACE_ENTER(__func__)
+
+    int write_len;
+
+    if (delta_time->num_bytes == varint_length(delta_time->standard_value))
+    {
+        write_len = varint_write_int32(buffer, delta_time->standard_value);
+    }
+    else
+    {
+        VarLengthInt_write_value_big(buffer, delta_time);
+        write_len = delta_time->num_bytes;
+    }
+
+    TRACE_LEAVE(__func__)
+    return write_len;
+}
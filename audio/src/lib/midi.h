@@ -55,6 +55,34 @@
 
 #define CSEQ_FILE_NUM_TRACKS 16
 
+/**
+ * Pattern marker files with this extension are written in binary
+ * format, any other extension is written as text.
+*/
+#define PATTERN_MARKER_BINARY_EXTENSION ".bin"
+
+/**
+ * Binary pattern marker file, fourcc id.
+*/
+#define PATTERN_MARKER_BINARY_ID 0x47504D4B /* 0x47504D4B = "GPMK" */
+
+#define PATTERN_MARKER_BINARY_VERSION 1
+
+/**
+ * Binary pattern marker file, size in bytes of id, version, and number of tracks.
+*/
+#define PATTERN_MARKER_BINARY_HEADER_SIZE 8
+
+/**
+ * Binary pattern marker file, size in bytes of track offset and record count.
+*/
+#define PATTERN_MARKER_BINARY_INDEX_ENTRY_SIZE 8
+
+/**
+ * Binary pattern marker file, size in bytes of a single pattern.
+*/
+#define PATTERN_MARKER_BINARY_RECORD_SIZE 12
+
 #define CSEQ_FILE_HEADER_SIZE_BYTES 0x44
 
 #define MIDI_COMMAND_LEN_NOTE_OFF 1
@@ -662,6 +690,144 @@ struct MidiConvertOptions {
     // not a configuration option, used at runtime.
     struct FileInfo *runtime_pattern_file;
     struct LinkedList *runtime_patterns_list;
+    struct SeqPatternMarkerIndex *runtime_pattern_index;
+};
+
+/**
+ * Size in bytes of the read window used by {@code struct MidiEventReader}.
+ * This must be larger than the longest single event the parser supports.
+*/
+#define MIDI_EVENT_READER_WINDOW_LEN 256
+
+/**
+ * Forward-only reader over a standard MIDI file. Events are parsed directly
+ * from the file through a small window, so only the current event is held
+ * in memory instead of every track.
+*/
+struct MidiEventReader {
+    /**
+     * Input file. Not owned by the reader.
+    */
+    struct FileInfo *fi;
+
+    /**
+     * MIDI file format, read from header.
+    */
+    int16_t format;
+
+    /**
+     * Number of tracks, read from header.
+    */
+    int16_t num_tracks;
+
+    /**
+     * MIDI division, read from header.
+    */
+    int16_t division;
+
+    /**
+     * Zero based index of the current track, or -1 if no track has been started.
+    */
+    int track_index;
+
+    /**
+     * Size in bytes of the current track data.
+    */
+    size_t track_len;
+
+    /**
+     * File offset of the first byte of the current track data.
+    */
+    size_t track_file_offset;
+
+    /**
+     * Absolute time of the most recent event read in the current track.
+    */
+    long absolute_time;
+
+    /**
+     * Most recent command read, used for running status.
+    */
+    int32_t running_status;
+
+    /**
+     * Track offset of {@code window[0]}.
+    */
+    size_t window_track_offset;
+
+    /**
+     * Read position within the window.
+    */
+    size_t window_pos;
+
+    /**
+     * Number of valid bytes in the window.
+    */
+    size_t window_len;
+
+    /**
+     * Window of track data. Padded so a varint read at the very end of
+     * a track can't read past the allocation.
+    */
+    uint8_t window[MIDI_EVENT_READER_WINDOW_LEN + VAR_INT_MAX_BYTES];
+};
+
+/**
+ * Callback used when streaming events from one MIDI file to another.
+ * The event may be modified in place. The absolute time may be increased
+ * but must not be earlier than the previous event kept.
+ * @param event: event just read.
+ * @param track_index: zero based index of the source track.
+ * @param state: caller supplied state.
+ * @returns: non-zero to write the event, zero to drop it.
+*/
+typedef int (*f_GmidEvent_stream_callback)(struct GmidEvent *event, int track_index, void *state);
+
+/**
+ * Transforms supported by {@code MidiFile_transform_pipeline}.
+*/
+enum MIDI_TRANSFORM {
+    MIDI_TRANSFORM_NONE = 0,
+
+    /**
+     * Same as {@code MidiFile_transform_set_channel_instrument}.
+    */
+    MIDI_TRANSFORM_SET_CHANNEL_INSTRUMENT,
+
+    /**
+     * Same as {@code MidiFile_transform_make_channel_track}.
+    */
+    MIDI_TRANSFORM_MAKE_CHANNEL_TRACK,
+
+    /**
+     * Same as {@code MidiFile_transform_remove_loop}.
+    */
+    MIDI_TRANSFORM_REMOVE_LOOP,
+
+    /**
+     * Same as {@code MidiFile_transform_add_note_loop}.
+    */
+    MIDI_TRANSFORM_ADD_NOTE_LOOP
+};
+
+/**
+ * Single step of a transform pipeline. Only the parameters used by the
+ * transform need to be set.
+*/
+struct MidiTransformStep {
+    enum MIDI_TRANSFORM transform;
+
+    // set-channel-instrument: channel of Program Change event to search for.
+    int channel;
+
+    // set-channel-instrument: new instrument value.
+    int instrument;
+
+    // remove-loop, add-note-loop: track index.
+    int track;
+
+    // remove-loop, add-note-loop: loop number.
+    int loop_number;
 };
 
 #define MIDI_PARSE_DEBUG_PRINT_BUFFER_LEN 255
@@ -693,6 +859,13 @@ void MidiTrack_fwrite(struct MidiTrack *track, struct FileInfo *fi);
 void MidiFile_fwrite(struct MidiFile *midi_file, struct FileInfo *fi);
 void MidiFile_parse(struct MidiFile *midi_file, int parse_track_arg);
 
+struct MidiEventReader *MidiEventReader_new(struct FileInfo *fi);
+int MidiEventReader_next_track(struct MidiEventReader *reader);
+struct GmidEvent *MidiEventReader_next_event(struct MidiEventReader *reader);
+void MidiEventReader_free(struct MidiEventReader *reader);
+void MidiFile_stream_transform(struct FileInfo *input, struct FileInfo *output, int force_track, f_GmidEvent_stream_callback callback, void *callback_state);
+void MidiFile_stream_parse(struct FileInfo *input, int parse_track_arg);
+
 struct MidiFile *MidiFile_transform_set_channel_instrument(struct MidiFile *midi_file, int existing_channel, int new_instrument);
 void GmidFile_transform_set_channel_instrument(struct GmidFile *gmid_file, int existing_channel, int new_instrument);
 struct MidiFile *MidiFile_transform_make_channel_track(struct MidiFile *midi_file);
@@ -701,6 +874,7 @@ struct MidiFile *MidiFile_transform_remove_loop(struct MidiFile *midi_file, int
 void GmidFile_transform_remove_loop(struct GmidFile *gmid_file, int loop_number, int track);
 struct MidiFile *MidiFile_transform_add_note_loop(struct MidiFile *midi_file, int loop_number, int track);
 void GmidFile_transform_add_note_loop(struct GmidFile *gmid_file, int loop_number, int track);
+struct MidiFile *MidiFile_transform_pipeline(struct MidiFile *midi_file, struct MidiTransformStep *steps, int num_steps);
 
 // common (GmidFile, GmidTrack, GmidEvent) declarations
 
@@ -722,6 +896,7 @@ void GmidEvent_free(struct GmidEvent *event);
 int32_t GmidEvent_get_midi_command(struct GmidEvent *event);
 int32_t GmidEvent_get_cseq_command(struct GmidEvent *event);
 void GmidTrack_parse_CseqTrack(struct GmidTrack *gtrack);
+size_t GmidEvent_write_to_midi_buffer(struct GmidEvent *event, uint8_t *buffer, int32_t *previous_command);
 size_t GmidTrack_write_to_midi_buffer(struct GmidTrack *gtrack, uint8_t *buffer, size_t max_len);
 void GmidTrack_delta_from_absolute(struct GmidTrack *gtrack);
 void GmidTrack_midi_to_cseq_loop(struct GmidTrack *gtrack);
@@ -751,6 +926,7 @@ void MidiConvertOptions_free(struct MidiConvertOptions *obj);
 // helper methods
 
 void write_patterns_to_file(struct LinkedList *patterns, struct FileInfo *file);
+void write_patterns_to_file_binary(struct LinkedList **patterns, int num_lists, struct FileInfo *file);
 void midi_controller_to_name(int controller, char *result, size_t max_length);
 void midi_note_to_name(int note, char* result, size_t max_length);
 size_t GmidEvent_to_string(struct GmidEvent *event, char *buffer, size_t bufer_len, enum MIDI_IMPLEMENTATION type);
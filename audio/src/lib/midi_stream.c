@@ -0,0 +1,670 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ *
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debug.h"
+#include "common.h"
+#include "machine_config.h"
+#include "utility.h"
+#include "midi.h"
+
+/**
+ * This file contains a forward-only streaming reader for standard MIDI files.
+ *
+ * Unlike {@code MidiFile_new_from_file} followed by {@code GmidFile_new_from_midi},
+ * track data is never loaded in full. Events are parsed one at a time from a small
+ * window over the file, decoding delta times and running status as they are read.
+ * Memory use is bounded by the window size regardless of file size.
+ *
+ * Tracks are placed the same way as {@code GmidFile_new_from_midi}, so streamed
+ * output matches the in-memory methods. Each track is read once to find where it
+ * goes, then again to write or print it.
+*/
+
+/**
+ * When fewer than this many unread bytes remain in the window, the window is refilled.
+*/
+#define MIDI_EVENT_READER_REFILL_LEN (MIDI_EVENT_READER_WINDOW_LEN / 2)
+
+/**
+ * Location of a source track in the file, and the track it is placed in.
+*/
+struct MidiStreamSourceTrack {
+    size_t file_offset;
+    size_t len;
+
+    /**
+     * Destination track, see {@code GmidFile_new_from_midi}.
+    */
+    int destination;
+};
+
+// forward declarations
+
+static void MidiEventReader_fill_window(struct MidiEventReader *reader);
+static void MidiEventReader_begin_track(struct MidiEventReader *reader, int track_index, size_t file_offset, size_t len);
+static int MidiEventReader_place_tracks(struct MidiEventReader *reader, int force_track, struct MidiStreamSourceTrack *sources);
+
+// end forward declarations
+
+/**
+ * Allocates memory for a new {@code struct MidiEventReader} and reads the MIDI
+ * header chunk from the file. No track data is read.
+ * @param fi: File to read. Must remain open for the lifetime of the reader.
+ * @returns: pointer to new object.
+*/
+struct MidiEventReader *MidiEventReader_new(struct FileInfo *fi)
+{
+    TRACE_ENTER(__func__)
+
+    if (fi == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> fi is NULL\n", __func__, __LINE__);
+    }
+
+    if (fi->len < 20)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> MIDI file \"%s\" too short\n", __func__, __LINE__, fi->filename);
+    }
+
+    uint32_t t32;
+    struct MidiEventReader *reader = (struct MidiEventReader *)malloc_zero(1, sizeof(struct MidiEventReader));
+
+    reader->fi = fi;
+    reader->track_index = -1;
+
+    // make sure to begin reading at the beginning of the file.
+    FileInfo_fseek(fi, 0, SEEK_SET);
+
+    // root chunk id
+    FileInfo_fread(fi, &t32, 4, 1);
+    BSWAP32(t32);
+    if (t32 != MIDI_ROOT_CHUNK_ID)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid MIDI root chunk id. Expected 0x%08x, actual 0x%08x.\n", __func__, __LINE__, MIDI_ROOT_CHUNK_ID, t32);
+    }
+
+    // root chunk size
+    FileInfo_fread(fi, &t32, 4, 1);
+    BSWAP32(t32);
+    if (t32 != MIDI_ROOT_CHUNK_BODY_SIZE)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid MIDI root chunk size. Expected 0x%08x, actual 0x%08x.\n", __func__, __LINE__, MIDI_ROOT_CHUNK_BODY_SIZE, t32);
+    }
+
+    // format
+    FileInfo_fread(fi, &reader->format, 2, 1);
+    BSWAP16(reader->format);
+    if (reader->format != MIDI_FORMAT_SIMULTANEOUS)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> Unsupported MIDI format %d. Only %d is supported.\n", __func__, __LINE__, reader->format, MIDI_FORMAT_SIMULTANEOUS);
+    }
+
+    // number of tracks
+    FileInfo_fread(fi, &reader->num_tracks, 2, 1);
+    BSWAP16(reader->num_tracks);
+    if (reader->num_tracks > CSEQ_FILE_NUM_TRACKS)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> Only %d tracks supported, but MIDI file has %d\n", __func__, __LINE__, CSEQ_FILE_NUM_TRACKS, reader->num_tracks);
+    }
+
+    // ticks per quarter note (when positive)
+    FileInfo_fread(fi, &reader->division, 2, 1);
+    BSWAP16(reader->division);
+    if (reader->division < 0)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> MIDI SMPTE division not supported, should be ticks per quarter. Division: 0x%04x\n", __func__, __LINE__, reader->division);
+    }
+
+    // first track chunk begins immediately after the header.
+    reader->track_file_offset = MIDI_ROOT_CHUNK_FULL_SIZE;
+    reader->track_len = 0;
+
+    if (g_verbosity >= VERBOSE_DEBUG)
+    {
+        printf("read MIDI header: format=%d, num tracks=%d, division=%d\n", reader->format, reader->num_tracks, reader->division);
+    }
+
+    TRACE_LEAVE(__func__)
+    return reader;
+}
+
+/**
+ * Advances the reader to the next track chunk. Any unread events in the
+ * current track are skipped. Non-track chunks are skipped.
+ * @param reader: reader to advance.
+ * @returns: 1 if a track was found, 0 if the end of the file was reached.
+*/
+int MidiEventReader_next_track(struct MidiEventReader *reader)
+{
+    TRACE_ENTER(__func__)
+
+    if (reader == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> reader is NULL\n", __func__, __LINE__);
+    }
+
+    uint32_t t32;
+    int32_t chunk_size;
+    size_t file_pos;
+
+    // end of the current track (or end of header if no track has been read).
+    file_pos = reader->track_file_offset + reader->track_len;
+
+    while (1)
+    {
+        if (file_pos + 8 >= reader->fi->len)
+        {
+            if (reader->track_index + 1 != reader->num_tracks)
+            {
+                stderr_exit(EXIT_CODE_GENERAL, "%s %d> MIDI header specified %d tracks, but only %d tracks were read\n", __func__, __LINE__, reader->num_tracks, reader->track_index + 1);
+            }
+
+            TRACE_LEAVE(__func__)
+            return 0;
+        }
+
+        FileInfo_fseek(reader->fi, (long)file_pos, SEEK_SET);
+
+        FileInfo_fread(reader->fi, &t32, 4, 1);
+        BSWAP32(t32);
+
+        FileInfo_fread(reader->fi, &chunk_size, 4, 1);
+        BSWAP32(chunk_size);
+
+        file_pos += 8;
+
+        if (chunk_size < 0 || file_pos + (size_t)chunk_size > reader->fi->len)
+        {
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d> Invalid track size %d at offset %ld, exceeds file length %ld.\n", __func__, __LINE__, chunk_size, file_pos - 4, reader->fi->len);
+        }
+
+        if (t32 == MIDI_TRACK_CHUNK_ID)
+        {
+            break;
+        }
+
+        file_pos += (size_t)chunk_size;
+    }
+
+    if (reader->track_index + 1 >= CSEQ_FILE_NUM_TRACKS)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> Only %d tracks supported\n", __func__, __LINE__, CSEQ_FILE_NUM_TRACKS);
+    }
+
+    MidiEventReader_begin_track(reader, reader->track_index + 1, file_pos, (size_t)chunk_size);
+
+    TRACE_LEAVE(__func__)
+    return 1;
+}
+
+/**
+ * Reads the next event from the current track.
+ * Delta time, absolute time, and running status are resolved the same
+ * way as {@code GmidFile_new_from_midi}. The event {@code file_offset}
+ * is relative to the start of the track data.
+ * This allocates memory, the caller is responsible for freeing the event.
+ * @param reader: reader to read from.
+ * @returns: new event, or NULL if the end of the track was reached.
+*/
+struct GmidEvent *MidiEventReader_next_event(struct MidiEventReader *reader)
+{
+    TRACE_ENTER(__func__)
+
+    if (reader == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> reader is NULL\n", __func__, __LINE__);
+    }
+
+    struct GmidEvent *event;
+    size_t pos;
+    int bytes_read = 0;
+    int32_t command;
+
+    if (reader->track_index < 0
+        || reader->window_track_offset + reader->window_pos >= reader->track_len)
+    {
+        TRACE_LEAVE(__func__)
+        return NULL;
+    }
+
+    if (reader->window_len - reader->window_pos < MIDI_EVENT_READER_REFILL_LEN
+        && reader->window_track_offset + reader->window_len < reader->track_len)
+    {
+        MidiEventReader_fill_window(reader);
+    }
+
+    pos = reader->window_pos;
+
+    // window position will be updated according to how many bytes read.
+    event = GmidEvent_new_from_buffer(reader->window, &pos, reader->window_len, MIDI_IMPLEMENTATION_STANDARD, reader->running_status, &bytes_read);
+
+    if (event == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: event is NULL\n", __func__, __LINE__);
+    }
+
+    if (bytes_read == 0)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d>: invalid bytes_read (0) from GmidEvent_new_from_buffer\n", __func__, __LINE__);
+    }
+
+    // offset was relative to window, change to relative to track.
+    event->file_offset = reader->window_track_offset + reader->window_pos;
+    reader->window_pos = pos;
+
+    reader->absolute_time += event->midi_delta_time.standard_value;
+    event->absolute_time = reader->absolute_time;
+
+    command = GmidEvent_get_midi_command(event);
+
+    // only allow running status for the "regular" MIDI commands (commands with channels)
+    if ((command & 0xffffff00) != 0 || (command & 0xfffffff0) >= 0xf0)
+    {
+        command = 0;
+    }
+
+    reader->running_status = command;
+
+    TRACE_LEAVE(__func__)
+    return event;
+}
+
+/**
+ * Frees memory allocated to reader. The underlying file is not closed.
+ * @param reader: object to free.
+*/
+void MidiEventReader_free(struct MidiEventReader *reader)
+{
+    TRACE_ENTER(__func__)
+
+    if (reader == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    gaudio_free(reader);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Streams every event of a MIDI file through a callback and writes the result to
+ * a new MIDI file. Events are written as they are read, and each track chunk size
+ * (and the header track count) is patched once known, so the output must be seekable.
+ * Delta times are recomputed from absolute time only when an event was dropped
+ * or moved, otherwise the original encoding is kept.
+ * Tracks are placed the same as {@code GmidFile_new_from_midi}: empty tracks are
+ * removed, and source tracks placed in the same track are written one after the
+ * other. The result is the same as the {@code MidiFile_transform_*} methods.
+ * @param input: MIDI file to read.
+ * @param output: file to write to, using current offset.
+ * @param force_track: force_track argument for {@code GmidFile_new_from_midi}.
+ * @param callback: Optional. Called for each event read.
+ * @param callback_state: Optional. Passed to callback.
+*/
+void MidiFile_stream_transform(struct FileInfo *input, struct FileInfo *output, int force_track, f_GmidEvent_stream_callback callback, void *callback_state)
+{
+    TRACE_ENTER(__func__)
+
+    if (input == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> input is NULL\n", __func__, __LINE__);
+    }
+
+    if (output == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> output is NULL\n", __func__, __LINE__);
+    }
+
+    struct MidiEventReader *reader;
+    struct GmidEvent *event;
+    struct MidiStreamSourceTrack sources[CSEQ_FILE_NUM_TRACKS];
+    uint8_t write_buffer[MIDI_EVENT_READER_WINDOW_LEN];
+    uint32_t t32;
+    int16_t num_tracks;
+    int32_t track_size;
+    int32_t previous_command;
+    int source_count;
+    int destination;
+    int source_index;
+    long header_pos;
+    long size_pos;
+    long end_pos;
+    long prev_absolute_time;
+    size_t write_len;
+
+    reader = MidiEventReader_new(input);
+    source_count = MidiEventReader_place_tracks(reader, force_track, sources);
+
+    header_pos = FileInfo_ftell(output);
+    num_tracks = 0;
+
+    t32 = MIDI_ROOT_CHUNK_ID;
+    FileInfo_fwrite_bswap(output, &t32, 4, 1);
+    t32 = MIDI_ROOT_CHUNK_BODY_SIZE;
+    FileInfo_fwrite_bswap(output, &t32, 4, 1);
+    FileInfo_fwrite_bswap(output, &reader->format, 2, 1);
+    // placeholder, patched once all tracks are written.
+    FileInfo_fwrite_bswap(output, &num_tracks, 2, 1);
+    FileInfo_fwrite_bswap(output, &reader->division, 2, 1);
+
+    for (destination=0; destination<CSEQ_FILE_NUM_TRACKS; destination++)
+    {
+        size_pos = -1;
+        track_size = 0;
+        previous_command = 0;
+
+        for (source_index=0; source_index<source_count; source_index++)
+        {
+            if (sources[source_index].destination != destination || sources[source_index].len == 0)
+            {
+                continue;
+            }
+
+            if (size_pos < 0)
+            {
+                t32 = MIDI_TRACK_CHUNK_ID;
+                FileInfo_fwrite_bswap(output, &t32, 4, 1);
+
+                // placeholder, patched once the track is written.
+                size_pos = FileInfo_ftell(output);
+                FileInfo_fwrite_bswap(output, &track_size, 4, 1);
+            }
+
+            MidiEventReader_begin_track(reader, source_index, sources[source_index].file_offset, sources[source_index].len);
+
+            // absolute time starts over with each source track.
+            prev_absolute_time = 0;
+
+            while ((event = MidiEventReader_next_event(reader)) != NULL)
+            {
+                int keep = 1;
+
+                if (callback != NULL)
+                {
+                    keep = callback(event, source_index, callback_state);
+                }
+
+                if (keep && event->midi_valid)
+                {
+                    long delta = event->absolute_time - prev_absolute_time;
+
+                    if (delta < 0)
+                    {
+                        stderr_exit(EXIT_CODE_GENERAL, "%s %d> event absolute time %ld is before previous event %ld, track %d\n", __func__, __LINE__, event->absolute_time, prev_absolute_time, source_index);
+                    }
+
+                    if (delta != event->midi_delta_time.standard_value)
+                    {
+                        int32_to_VarLengthInt((int32_t)delta, &event->midi_delta_time);
+                    }
+
+                    write_len = GmidEvent_write_to_midi_buffer(event, write_buffer, &previous_command);
+                    FileInfo_fwrite(output, write_buffer, write_len, 1);
+
+                    track_size += (int32_t)write_len;
+                    prev_absolute_time = event->absolute_time;
+                }
+
+                GmidEvent_free(event);
+            }
+        }
+
+        if (size_pos >= 0)
+        {
+            end_pos = FileInfo_ftell(output);
+            FileInfo_fseek(output, size_pos, SEEK_SET);
+            FileInfo_fwrite_bswap(output, &track_size, 4, 1);
+            FileInfo_fseek(output, end_pos, SEEK_SET);
+
+            num_tracks++;
+        }
+    }
+
+    if (num_tracks == 0)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d>: error, no tracks found in MIDI file\n", __func__, __LINE__);
+    }
+
+    // number of tracks is after root chunk id, size, and format.
+    end_pos = FileInfo_ftell(output);
+    FileInfo_fseek(output, header_pos + 10, SEEK_SET);
+    FileInfo_fwrite_bswap(output, &num_tracks, 2, 1);
+    FileInfo_fseek(output, end_pos, SEEK_SET);
+
+    MidiEventReader_free(reader);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Streaming version of {@code MidiFile_parse}. Prints events to stdout as they
+ * are read, without loading the file. Output is the same as {@code MidiFile_parse}.
+ * @param input: MIDI file to read.
+ * @param parse_track_arg: Controls which tracks are printed. If this is equal to -1,
+ * all tracks are printed. Otherwise only the track with matching index is printed.
+*/
+void MidiFile_stream_parse(struct FileInfo *input, int parse_track_arg)
+{
+    TRACE_ENTER(__func__)
+
+    if (input == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> input is NULL\n", __func__, __LINE__);
+    }
+
+    struct MidiEventReader *reader;
+    struct GmidEvent *event;
+    struct MidiStreamSourceTrack sources[CSEQ_FILE_NUM_TRACKS];
+    char *debug_printf_buffer;
+    int print_count = 0;
+    int source_count;
+    int destination;
+    int source_index;
+
+    debug_printf_buffer = (char *)malloc_zero(1, WRITE_BUFFER_LEN);
+
+    reader = MidiEventReader_new(input);
+    source_count = MidiEventReader_place_tracks(reader, 0, sources);
+
+    for (destination=0; destination<CSEQ_FILE_NUM_TRACKS; destination++)
+    {
+        // Same as GmidFile_new_from_midi, the track is numbered by the last
+        // source track placed in it (even if empty).
+        int midi_track_index = -1;
+        int has_events = 0;
+
+        for (source_index=0; source_index<source_count; source_index++)
+        {
+            if (sources[source_index].destination == destination)
+            {
+                midi_track_index = source_index;
+                has_events |= sources[source_index].len > 0;
+            }
+        }
+
+        if (!has_events || (parse_track_arg != -1 && parse_track_arg != midi_track_index))
+        {
+            continue;
+        }
+
+        printf("Print MIDI track # %d\n", midi_track_index);
+
+        for (source_index=0; source_index<source_count; source_index++)
+        {
+            if (sources[source_index].destination != destination)
+            {
+                continue;
+            }
+
+            MidiEventReader_begin_track(reader, source_index, sources[source_index].file_offset, sources[source_index].len);
+
+            while ((event = MidiEventReader_next_event(reader)) != NULL)
+            {
+                memset(debug_printf_buffer, 0, WRITE_BUFFER_LEN);
+                size_t debug_str_len = GmidEvent_to_string(event, debug_printf_buffer, WRITE_BUFFER_LEN - 2, MIDI_IMPLEMENTATION_STANDARD);
+                debug_printf_buffer[debug_str_len] = '\n';
+                fflush_string(stdout, debug_printf_buffer);
+
+                GmidEvent_free(event);
+            }
+        }
+
+        printf("\n");
+        print_count++;
+    }
+
+    MidiEventReader_free(reader);
+    gaudio_free(debug_printf_buffer);
+
+    if (print_count == 0)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> could not find any matching tracks to print\n", __func__, __LINE__);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Shifts unread bytes to the start of the window, then reads track data from
+ * the file until the window is full or the end of the track is reached.
+ * @param reader: reader to update.
+*/
+static void MidiEventReader_fill_window(struct MidiEventReader *reader)
+{
+    TRACE_ENTER(__func__)
+
+    size_t unread = reader->window_len - reader->window_pos;
+    size_t track_remaining;
+    size_t read_len;
+
+    if (unread > 0 && reader->window_pos > 0)
+    {
+        memmove(reader->window, &reader->window[reader->window_pos], unread);
+    }
+
+    reader->window_track_offset += reader->window_pos;
+    reader->window_pos = 0;
+    reader->window_len = unread;
+
+    track_remaining = reader->track_len - (reader->window_track_offset + unread);
+    read_len = MIDI_EVENT_READER_WINDOW_LEN - unread;
+    if (read_len > track_remaining)
+    {
+        read_len = track_remaining;
+    }
+
+    if (read_len > 0)
+    {
+        FileInfo_fseek(reader->fi, (long)(reader->track_file_offset + reader->window_track_offset + unread), SEEK_SET);
+        FileInfo_fread(reader->fi, &reader->window[unread], read_len, 1);
+        reader->window_len += read_len;
+    }
+
+    // clear padding so a varint read past the end of the track terminates.
+    memset(&reader->window[reader->window_len], 0, sizeof(reader->window) - reader->window_len);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Sets the reader to the start of a track.
+ * @param reader: reader to update.
+ * @param track_index: zero based index of the track.
+ * @param file_offset: file offset of the first byte of track data.
+ * @param len: size in bytes of the track data.
+*/
+static void MidiEventReader_begin_track(struct MidiEventReader *reader, int track_index, size_t file_offset, size_t len)
+{
+    TRACE_ENTER(__func__)
+
+    reader->track_index = track_index;
+    reader->track_file_offset = file_offset;
+    reader->track_len = len;
+    reader->absolute_time = 0;
+    reader->running_status = 0;
+    reader->window_track_offset = 0;
+    reader->window_pos = 0;
+    reader->window_len = 0;
+
+    if (g_verbosity >= VERBOSE_DEBUG)
+    {
+        printf("begin stream track %d, size=%ld\n", reader->track_index, reader->track_len);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Reads every track in the file and finds the track it is placed in, the same as
+ * {@code GmidFile_new_from_midi}. Without {@code force_track} events are read until
+ * one with a channel is found.
+ * @param reader: new reader, no track started.
+ * @param force_track: force_track argument for {@code GmidFile_new_from_midi}.
+ * @param sources: out parameter. Array of length {@code CSEQ_FILE_NUM_TRACKS}.
+ * @returns: number of tracks read.
+*/
+static int MidiEventReader_place_tracks(struct MidiEventReader *reader, int force_track, struct MidiStreamSourceTrack *sources)
+{
+    TRACE_ENTER(__func__)
+
+    struct GmidEvent *event;
+    int count = 0;
+
+    while (MidiEventReader_next_track(reader))
+    {
+        int destination = -1;
+
+        if (force_track)
+        {
+            if (reader->track_len > 0)
+            {
+                destination = reader->track_index;
+            }
+        }
+        else
+        {
+            while (destination == -1 && (event = MidiEventReader_next_event(reader)) != NULL)
+            {
+                if (event->command_channel > -1)
+                {
+                    destination = event->command_channel;
+                }
+
+                GmidEvent_free(event);
+            }
+        }
+
+        if (destination == -1)
+        {
+            fflush_printf(stderr, "destination track not resolved, assuming midi track %d\n", reader->track_index);
+            destination = reader->track_index;
+        }
+
+        sources[count].file_offset = reader->track_file_offset;
+        sources[count].len = reader->track_len;
+        sources[count].destination = destination;
+        count++;
+    }
+
+    TRACE_LEAVE(__func__)
+    return count;
+}
@@ -40,6 +40,33 @@ struct CtlParseContext {
     struct IntHashTable *seen_keymap;
 };
 
+/**
+ * Lookup tables for a bank file, see {@code ALBankFile_get_index}.
+*/
+struct ALBankFileIndex {
+    /**
+     * Key is sound {@code text_id}, value is {@code struct ALSound}.
+    */
+    struct StringHashTable *sounds;
+
+    /**
+     * Key is keymap {@code text_id}, value is {@code struct ALKeyMap}.
+    */
+    struct StringHashTable *keymaps;
+
+    /**
+     * Key is the filename part of wavetable {@code aifc_path}, value is the first
+     * {@code struct ALSound} with a filename part ending in the key. Other endings
+     * are not indexed.
+    */
+    struct StringHashTable *aifc_filenames;
+
+    /**
+     * Value of bank file {@code change_count} when the index was built.
+    */
+    uint32_t change_count;
+};
+
 /**
  * Callback to initialize wavetable object.
  * If not set externally, will be set to {@code ALWaveTable_init_default_set_aifc_path}.
@@ -66,20 +93,14 @@ struct ALSound *ALSound_new_from_ctl(struct CtlParseContext *context, uint8_t *c
 struct ALInstrument *ALInstrument_new_from_ctl(struct CtlParseContext *context, uint8_t *ctl_file_contents, int32_t load_from_offset, struct ALBank *parent);
 struct ALBank *ALBank_new_from_ctl(struct CtlParseContext *context, uint8_t *ctl_file_contents, int32_t load_from_offset);
 
-void ALEnvelope_write_inst(struct ALEnvelope *envelope, struct FileInfo *fi);
-void ALKeyMap_write_inst(struct ALKeyMap *keymap, struct FileInfo *fi);
-void ALSound_write_inst(struct ALSound *sound, struct FileInfo *fi);
-void ALInstrument_write_inst(struct ALInstrument *instrument, struct FileInfo *fi);
-void ALBank_write_inst(struct ALBank *bank, struct FileInfo *fi);
+void ALEnvelope_write_inst(struct ALEnvelope *envelope, struct FileInfo *fi, uint32_t generation);
+void ALKeyMap_write_inst(struct ALKeyMap *keymap, struct FileInfo *fi, uint32_t generation);
+void ALSound_write_inst(struct ALSound *sound, struct FileInfo *fi, uint32_t generation);
+void ALInstrument_write_inst(struct ALInstrument *instrument, struct FileInfo *fi, uint32_t generation);
+void ALBank_write_inst(struct ALBank *bank, struct FileInfo *fi, uint32_t generation);
 
 void ALADPCMLoop_free(struct ALADPCMLoop *loop);
 void ALRawLoop_free(struct ALRawLoop *loop);
-void ALEnvelope_free(struct ALEnvelope *envelope);
-void ALKeyMap_free(struct ALKeyMap *keymap);
-void ALWaveTable_free(struct ALWaveTable *wavetable);
-void ALSound_free(struct ALSound *sound);
-void ALInstrument_free(struct ALInstrument *instrument);
-void ALBank_free(struct ALBank *bank);
 
 void ALEnvelope_notify_parents_null(struct ALEnvelope *envelope);
 void ALKeyMap_notify_parents_null(struct ALKeyMap *keymap);
@@ -91,6 +112,17 @@ static struct CtlParseContext *CtlParseContext_new(void);
 static void CtlParseContext_free(struct CtlParseContext *context);
 static void ALWaveTable_init_default_set_aifc_path(struct ALWaveTable *wavetable);
 static void ALBankFile_set_write_order_by_offset(struct ALBankFile *bank_file);
+static struct ALBankFileIndex *ALBankFileIndex_new(struct ALBankFile *bank_file);
+static void ALBankFileIndex_free(struct ALBankFileIndex *index);
+static void ALBankFileIndex_add(struct StringHashTable *table, const char *key, void *data);
+static void *ALBankFileIndex_get(struct StringHashTable *table, const char *key);
+static const char *ALBankFileIndex_filename(const char *path);
+static struct ALBankFileIndex *ALBankFile_get_index(struct ALBankFile *bank_file);
+static void ALBank_notify_changed(struct ALBank *bank);
+static void ALInstrument_notify_changed(struct ALInstrument *instrument);
+static void ALSound_notify_changed(struct ALSound *sound);
+static void ALSound_list_notify_changed(struct LinkedList *sounds);
+static int ALBankFileLayoutEntry_compare(const void *first, const void *second);
 
 // end forward declarations
 
@@ -397,8 +429,9 @@ void ALADPCMBook_write_coef(struct ALADPCMBook *book, struct FileInfo *fi)
  * Writes any child information as well.
  * @param envelope: object to write.
  * @param fi: FileInfo.
+ * @param generation: current traversal generation, see {@code ALBankFile_begin_visit}.
 */
-void ALEnvelope_write_inst(struct ALEnvelope *envelope, struct FileInfo *fi)
+void ALEnvelope_write_inst(struct ALEnvelope *envelope, struct FileInfo *fi, uint32_t generation)
 {
     TRACE_ENTER(__func__)
     
@@ -414,7 +447,7 @@ void ALEnvelope_write_inst(struct ALEnvelope *envelope, struct FileInfo *fi)
 
     int len;
 
-    envelope->visited = 1;
+    envelope->visited_generation = generation;
 
     memset(g_write_buffer, 0, WRITE_BUFFER_LEN);
     len = snprintf(g_write_buffer, WRITE_BUFFER_LEN, "envelope %s", envelope->text_id);
@@ -542,8 +575,9 @@ struct ALKeyMap *ALKeyMap_new_from_ctl(uint8_t *ctl_file_contents, int32_t load_
  * Writes any child information as well.
  * @param keymap: object to write.
  * @param fi: FileInfo.
+ * @param generation: current traversal generation, see {@code ALBankFile_begin_visit}.
 */
-void ALKeyMap_write_inst(struct ALKeyMap *keymap, struct FileInfo *fi)
+void ALKeyMap_write_inst(struct ALKeyMap *keymap, struct FileInfo *fi, uint32_t generation)
 {
     TRACE_ENTER(__func__)
     
@@ -559,7 +593,7 @@ void ALKeyMap_write_inst(struct ALKeyMap *keymap, struct FileInfo *fi)
 
     int len;
 
-    keymap->visited = 1;
+    keymap->visited_generation = generation;
 
     memset(g_write_buffer, 0, WRITE_BUFFER_LEN);
     len = snprintf(g_write_buffer, WRITE_BUFFER_LEN, "keymap %s", keymap->text_id);
@@ -653,6 +687,8 @@ void ALKeyMap_add_parent(struct ALKeyMap *keymap, struct ALSound *parent)
 
     LinkedList_append_node(keymap->parents, node);
 
+    ALSound_notify_changed(parent);
+
     TRACE_LEAVE(__func__)
 }
 
@@ -745,6 +781,8 @@ void ALWaveTable_add_parent(struct ALWaveTable *wavetable, struct ALSound *paren
 
     LinkedList_append_node(wavetable->parents, node);
 
+    ALSound_notify_changed(parent);
+
     TRACE_LEAVE(__func__)
 }
 
@@ -791,6 +829,8 @@ void ALSound_add_parent(struct ALSound *sound, struct ALInstrument *parent)
 
     LinkedList_append_node(sound->parents, node);
 
+    ALInstrument_notify_changed(parent);
+
     TRACE_LEAVE(__func__)
 }
 
@@ -837,6 +877,8 @@ void ALInstrument_add_parent(struct ALInstrument *instrument, struct ALBank *par
 
     LinkedList_append_node(instrument->parents, node);
 
+    ALBank_notify_changed(parent);
+
     TRACE_LEAVE(__func__)
 }
 
@@ -1097,8 +1139,9 @@ struct ALSound *ALSound_new_from_ctl(struct CtlParseContext *context, uint8_t *c
  * Writes any child information as well.
  * @param sound: object to write.
  * @param fi: FileInfo.
+ * @param generation: current traversal generation, see {@code ALBankFile_begin_visit}.
 */
-void ALSound_write_inst(struct ALSound *sound, struct FileInfo *fi)
+void ALSound_write_inst(struct ALSound *sound, struct FileInfo *fi, uint32_t generation)
 {
     TRACE_ENTER(__func__)
     
@@ -1114,18 +1157,18 @@ void ALSound_write_inst(struct ALSound *sound, struct FileInfo *fi)
 
     int len;
 
-    sound->visited = 1;
+    sound->visited_generation = generation;
 
     // don't write declaration more than once.
-    if (sound->envelope != NULL && sound->envelope->visited == 0)
+    if (sound->envelope != NULL && sound->envelope->visited_generation != generation)
     {
-        ALEnvelope_write_inst(sound->envelope, fi);
+        ALEnvelope_write_inst(sound->envelope, fi, generation);
     }
 
     // don't write declaration more than once.
-    if (sound->keymap != NULL && sound->keymap->visited == 0)
+    if (sound->keymap != NULL && sound->keymap->visited_generation != generation)
     {
-        ALKeyMap_write_inst(sound->keymap, fi);
+        ALKeyMap_write_inst(sound->keymap, fi, generation);
     }
 
     memset(g_write_buffer, 0, WRITE_BUFFER_LEN);
@@ -1365,8 +1408,9 @@ struct ALInstrument *ALInstrument_new_from_ctl(struct CtlParseContext *context,
  * Writes any child information as well.
  * @param instrument: object to write.
  * @param fi: FileInfo.
+ * @param generation: current traversal generation, see {@code ALBankFile_begin_visit}.
 */
-void ALInstrument_write_inst(struct ALInstrument *instrument, struct FileInfo *fi)
+void ALInstrument_write_inst(struct ALInstrument *instrument, struct FileInfo *fi, uint32_t generation)
 {
     TRACE_ENTER(__func__)
     
@@ -1383,14 +1427,14 @@ void ALInstrument_write_inst(struct ALInstrument *instrument, struct FileInfo *f
     int len;
     int i;
 
-    instrument->visited = 1;
+    instrument->visited_generation = generation;
 
     for (i=0; i<instrument->sound_count; i++)
     {
         // don't write declaration more than once.
-        if (instrument->sounds[i]->visited == 0)
+        if (instrument->sounds[i]->visited_generation != generation)
         {
-            ALSound_write_inst(instrument->sounds[i], fi);
+            ALSound_write_inst(instrument->sounds[i], fi, generation);
         }
     }
 
@@ -1635,8 +1679,9 @@ struct ALBank *ALBank_new_from_ctl(struct CtlParseContext *context, uint8_t *ctl
  * Writes any child information as well.
  * @param bank: object to write.
  * @param fi: FileInfo.
+ * @param generation: current traversal generation, see {@code ALBankFile_begin_visit}.
 */
-void ALBank_write_inst(struct ALBank *bank, struct FileInfo *fi)
+void ALBank_write_inst(struct ALBank *bank, struct FileInfo *fi, uint32_t generation)
 {
     TRACE_ENTER(__func__)
     
@@ -1656,9 +1701,9 @@ void ALBank_write_inst(struct ALBank *bank, struct FileInfo *fi)
     for (i=0; i<bank->inst_count; i++)
     {
         // don't write declaration more than once.
-        if (bank->instruments[i]->visited == 0)
+        if (bank->instruments[i]->visited_generation != generation)
         {
-            ALInstrument_write_inst(bank->instruments[i], fi);
+            ALInstrument_write_inst(bank->instruments[i], fi, generation);
         }
     }
 
@@ -1777,10 +1822,11 @@ struct ALBankFile *ALBankFile_new_from_ctl(struct FileInfo *ctl_file)
         if (bank_file->bank_offsets[i] > 0)
         {
             bank_file->banks[i] = ALBank_new_from_ctl(context, ctl_file_contents, bank_file->bank_offsets[i]);
+            bank_file->banks[i]->bank_file = bank_file;
         }
     }
 
-    free(ctl_file_contents);
+    gaudio_free(ctl_file_contents);
     CtlParseContext_free(context);
 
     // At this point everything from the .ctl is read and loaded into the bank_file.
@@ -1818,14 +1864,15 @@ void ALBankFile_write_inst(struct ALBankFile *bank_file, char* inst_filename)
 
     struct FileInfo *output;
     int i;
+    uint32_t generation;
 
-    ALBankFile_clear_visited_flags(bank_file);
+    generation = ALBankFile_begin_visit(bank_file);
 
     output = FileInfo_fopen(inst_filename, "w");
 
     for (i=0; i<bank_file->bank_count; i++)
     {
-        ALBank_write_inst(bank_file->banks[i], output);
+        ALBank_write_inst(bank_file->banks[i], output, generation);
     }
 
     FileInfo_free(output);
@@ -1847,7 +1894,7 @@ void ALADPCMLoop_free(struct ALADPCMLoop *loop)
         return;
     }
 
-    free(loop);
+    gaudio_free(loop);
 
     TRACE_LEAVE(__func__)
 }
@@ -1868,10 +1915,10 @@ void ALADPCMBook_free(struct ALADPCMBook *book)
 
     if (book->book != NULL)
     {
-        free(book->book);
+        gaudio_free(book->book);
     }
 
-    free(book);
+    gaudio_free(book);
 
     TRACE_LEAVE(__func__)
 }
@@ -1890,7 +1937,7 @@ void ALRawLoop_free(struct ALRawLoop *loop)
         return;
     }
 
-    free(loop);
+    gaudio_free(loop);
 
     TRACE_LEAVE(__func__)
 }
@@ -1955,7 +2002,7 @@ void ALEnvelope_free(struct ALEnvelope *envelope)
         envelope->parents= NULL;
     }
 
-    free(envelope);
+    gaudio_free(envelope);
 
     TRACE_LEAVE(__func__)
 }
@@ -2012,6 +2059,8 @@ void ALKeyMap_free(struct ALKeyMap *keymap)
         return;
     }
 
+    ALSound_list_notify_changed(keymap->parents);
+
     ALKeyMap_notify_parents_null(keymap);
 
     if (keymap->parents != NULL)
@@ -2020,7 +2069,7 @@ void ALKeyMap_free(struct ALKeyMap *keymap)
         keymap->parents= NULL;
     }
 
-    free(keymap);
+    gaudio_free(keymap);
 
     TRACE_LEAVE(__func__)
 }
@@ -2077,6 +2126,8 @@ void ALWaveTable_free(struct ALWaveTable *wavetable)
         return;
     }
 
+    ALSound_list_notify_changed(wavetable->parents);
+
     if (wavetable->type == AL_ADPCM_WAVE)
     {
         if (wavetable->wave_info.adpcm_wave.loop != NULL)
@@ -2102,7 +2153,7 @@ void ALWaveTable_free(struct ALWaveTable *wavetable)
 
     if (wavetable->aifc_path != NULL)
     {
-        free(wavetable->aifc_path);
+        gaudio_free(wavetable->aifc_path);
     }
 
     ALWaveTable_notify_parents_null(wavetable);
@@ -2113,7 +2164,7 @@ void ALWaveTable_free(struct ALWaveTable *wavetable)
         wavetable->parents= NULL;
     }
 
-    free(wavetable);
+    gaudio_free(wavetable);
 
     TRACE_LEAVE(__func__)
 }
@@ -2189,6 +2240,8 @@ void ALSound_free(struct ALSound *sound)
         return;
     }
 
+    ALSound_notify_changed(sound);
+
     if (sound->envelope != NULL)
     {
         ALEnvelope_free(sound->envelope);
@@ -2215,7 +2268,7 @@ void ALSound_free(struct ALSound *sound)
         sound->parents= NULL;
     }
 
-    free(sound);
+    gaudio_free(sound);
 
     TRACE_LEAVE(__func__)
 }
@@ -2293,9 +2346,11 @@ void ALInstrument_free(struct ALInstrument *instrument)
         return;
     }
 
+    ALInstrument_notify_changed(instrument);
+
     if (instrument->sound_offsets != NULL)
     {
-        free(instrument->sound_offsets);
+        gaudio_free(instrument->sound_offsets);
         instrument->sound_offsets = NULL;
     }
 
@@ -2310,7 +2365,7 @@ void ALInstrument_free(struct ALInstrument *instrument)
             }
         }
 
-        free(instrument->sounds);
+        gaudio_free(instrument->sounds);
     }
 
     ALInstrument_notify_parents_null(instrument);
@@ -2321,7 +2376,7 @@ void ALInstrument_free(struct ALInstrument *instrument)
         instrument->parents= NULL;
     }
 
-    free(instrument);
+    gaudio_free(instrument);
 
     TRACE_LEAVE(__func__)
 }
@@ -2342,9 +2397,11 @@ void ALBank_free(struct ALBank *bank)
         return;
     }
 
+    ALBank_notify_changed(bank);
+
     if (bank->inst_offsets != NULL)
     {
-        free(bank->inst_offsets);
+        gaudio_free(bank->inst_offsets);
         bank->inst_offsets = NULL;
     }
 
@@ -2359,10 +2416,10 @@ void ALBank_free(struct ALBank *bank)
             }
         }
 
-        free(bank->instruments);
+        gaudio_free(bank->instruments);
     }
 
-    free(bank);
+    gaudio_free(bank);
 
     TRACE_LEAVE(__func__)
 }
@@ -2385,7 +2442,7 @@ void ALBankFile_free(struct ALBankFile *bank_file)
 
     if (bank_file->bank_offsets != NULL)
     {
-        free(bank_file->bank_offsets);
+        gaudio_free(bank_file->bank_offsets);
         bank_file->bank_offsets = NULL;
     }
 
@@ -2400,10 +2457,16 @@ void ALBankFile_free(struct ALBankFile *bank_file)
             }
         }
 
-        free(bank_file->banks);
+        gaudio_free(bank_file->banks);
     }
 
-    free(bank_file);
+    if (bank_file->index != NULL)
+    {
+        ALBankFileIndex_free(bank_file->index);
+        bank_file->index = NULL;
+    }
+
+    gaudio_free(bank_file);
 
     TRACE_LEAVE(__func__)
 }
@@ -2457,6 +2520,7 @@ double detune_frequency(double hw_sample_rate, int keybase, int detune)
 
 /**
  * Searches a {@code ALBankFile}, returns the {@code ALKeyMap} with matching {@code text_id}.
+ * If more than one keymap has the same {@code text_id}, the first one (in bank, instrument, sound order) is returned.
  * @param bank_file: bank file to search.
  * @param keymap_text_id: text id of keymap to find.
  * @returns: keymap or NULL.
@@ -2475,51 +2539,16 @@ struct ALKeyMap *ALBankFile_find_keymap_with_name(struct ALBankFile *bank_file,
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> keymap_text_id is NULL\n", __func__, __LINE__);
     }
 
-    int bank_index;
-    int instrument_index;
-    int sound_index;
-
-    for (bank_index=0; bank_index<bank_file->bank_count; bank_index++)
-    {
-        struct ALBank *bank = bank_file->banks[bank_index];
-
-        if (bank != NULL)
-        {
-            for (instrument_index=0; instrument_index<bank->inst_count; instrument_index++)
-            {
-                struct ALInstrument *instrument = bank->instruments[instrument_index];
-
-                if (instrument != NULL)
-                {
-                    for (sound_index=0; sound_index<instrument->sound_count; sound_index++)
-                    {
-                        struct ALSound *sound = instrument->sounds[sound_index];
-
-                        if (sound != NULL)
-                        {
-                            struct ALKeyMap *keymap = sound->keymap;
-
-                            if (keymap != NULL)
-                            {
-                                if (strcmp(keymap->text_id, keymap_text_id) == 0)
-                                {
-                                    TRACE_LEAVE(__func__)
-                                    return keymap;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
+    struct ALBankFileIndex *index = ALBankFile_get_index(bank_file);
+    struct ALKeyMap *keymap = (struct ALKeyMap *)ALBankFileIndex_get(index->keymaps, keymap_text_id);
 
     TRACE_LEAVE(__func__)
-    return NULL;
+    return keymap;
 }
 
 /**
  * Searches a {@code ALBankFile}, returns the {@code ALSound} with matching {@code text_id}.
+ * If more than one sound has the same {@code text_id}, the first one (in bank, instrument, sound order) is returned.
  * @param bank_file: bank file to search.
  * @param sound_text_id: text id of sound to find.
  * @returns: sound or NULL.
@@ -2538,48 +2567,21 @@ struct ALSound *ALBankFile_find_sound_with_name(struct ALBankFile *bank_file, co
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> sound_text_id is NULL\n", __func__, __LINE__);
     }
 
-    int bank_index;
-    int instrument_index;
-    int sound_index;
-
-    for (bank_index=0; bank_index<bank_file->bank_count; bank_index++)
-    {
-        struct ALBank *bank = bank_file->banks[bank_index];
-
-        if (bank != NULL)
-        {
-            for (instrument_index=0; instrument_index<bank->inst_count; instrument_index++)
-            {
-                struct ALInstrument *instrument = bank->instruments[instrument_index];
-
-                if (instrument != NULL)
-                {
-                    for (sound_index=0; sound_index<instrument->sound_count; sound_index++)
-                    {
-                        struct ALSound *sound = instrument->sounds[sound_index];
-
-                        if (sound != NULL)
-                        {
-                            if (strcmp(sound->text_id, sound_text_id) == 0)
-                            {
-                                TRACE_LEAVE(__func__)
-                                return sound;
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
+    struct ALBankFileIndex *index = ALBankFile_get_index(bank_file);
+    struct ALSound *sound = (struct ALSound *)ALBankFileIndex_get(index->sounds, sound_text_id);
 
     TRACE_LEAVE(__func__)
-    return NULL;
+    return sound;
 }
 
 /**
  * Searches a {@code ALBankFile}. Sounds are iterated and child wavetable searched. If
  * the wavetable {@code aifc_path} ends with (or equals) {@code search_filename} then the parent
- * {@code ALSound} is returned.
+ * {@code ALSound} is returned. If more than one sound matches, the first one (in bank,
+ * instrument, sound order) is returned.
+ * Sounds are looked up by the filename part of {@code search_filename} first. If
+ * that isn't the filename part of any wavetable {@code aifc_path}, or {@code search_filename}
+ * has a path part that doesn't match the first sound found that way, all sounds are searched.
  * @param bank_file: bank file to search.
  * @param search_filename: filename in aifc_path.
  * @returns: sound or NULL.
@@ -2598,6 +2600,24 @@ struct ALSound *ALBankFile_find_sound_by_aifc_filename(struct ALBankFile *bank_f
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> search_filename is NULL\n", __func__, __LINE__);
     }
 
+    struct ALBankFileIndex *index = ALBankFile_get_index(bank_file);
+    struct ALSound *sound;
+    const char *search_key = ALBankFileIndex_filename(search_filename);
+
+    // Any sound with an aifc_path ending in search_filename also has a filename ending in
+    // search_key. If search_key is a whole filename the index has the first such sound.
+    // Without a path part that is the answer, otherwise it is only the answer if the
+    // path part matches too.
+    sound = (struct ALSound *)ALBankFileIndex_get(index->aifc_filenames, search_key);
+
+    if (sound != NULL
+        && (search_key == search_filename
+            || string_ends_with(sound->wavetable->aifc_path, search_filename)))
+    {
+        TRACE_LEAVE(__func__)
+        return sound;
+    }
+
     int bank_index;
     int instrument_index;
     int sound_index;
@@ -2616,7 +2636,7 @@ struct ALSound *ALBankFile_find_sound_by_aifc_filename(struct ALBankFile *bank_f
                 {
                     for (sound_index=0; sound_index<instrument->sound_count; sound_index++)
                     {
-                        struct ALSound *sound = instrument->sounds[sound_index];
+                        sound = instrument->sounds[sound_index];
 
                         if (sound != NULL)
                         {
@@ -2642,7 +2662,67 @@ struct ALSound *ALBankFile_find_sound_by_aifc_filename(struct ALBankFile *bank_f
 }
 
 /**
- * Visits all child elements and clears the `visited` flag.
+ * Releases the lookup tables used by the {@code ALBankFile_find_*} functions. They are
+ * built again on the next lookup.
+ * The tables are rebuilt automatically after any bank, instrument, sound, keymap, or
+ * wavetable is freed or added to a parent with the library functions. This only needs
+ * to be called after changing the tree directly, e.g. setting a {@code text_id} or
+ * {@code aifc_path}, or assigning into a {@code sounds} or {@code instruments} array.
+ * @param bank_file: bank file.
+*/
+void ALBankFile_invalidate_index(struct ALBankFile *bank_file)
+{
+    TRACE_ENTER(__func__)
+    
+    if (bank_file == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> bank_file is NULL\n", __func__, __LINE__);
+    }
+
+    if (bank_file->index != NULL)
+    {
+        ALBankFileIndex_free(bank_file->index);
+        bank_file->index = NULL;
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Starts a new traversal of the bank file. Objects visited during the traversal
+ * are marked by setting {@code visited_generation} to the returned value; any
+ * object with a different value has not been visited yet. Nothing needs to be
+ * reset between traversals.
+ * Only one traversal of a bank file can be in progress at a time.
+ * @param bank_file: bank file to traverse.
+ * @returns: generation of the new traversal, never zero.
+*/
+uint32_t ALBankFile_begin_visit(struct ALBankFile *bank_file)
+{
+    TRACE_ENTER(__func__)
+    
+    if (bank_file == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> bank_file is NULL\n", __func__, __LINE__);
+    }
+
+    bank_file->visit_generation++;
+
+    // On wrap around, old stamps could match again, so reset everything once.
+    if (bank_file->visit_generation == 0)
+    {
+        ALBankFile_clear_visited_flags(bank_file);
+        bank_file->visit_generation = 1;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return bank_file->visit_generation;
+}
+
+/**
+ * Visits all child elements and resets {@code visited_generation} to zero.
+ * This is only needed when the traversal generation wraps around, see {@code ALBankFile_begin_visit}.
  * @param bank_file: bank file to clear.
 */
 void ALBankFile_clear_visited_flags(struct ALBankFile *bank_file)
@@ -2671,7 +2751,7 @@ void ALBankFile_clear_visited_flags(struct ALBankFile *bank_file)
                 {
                     int sound_count;
 
-                    instrument->visited = 0;
+                    instrument->visited_generation = 0;
 
                     for (sound_count=0; sound_count<instrument->sound_count; sound_count++)
                     {
@@ -2683,21 +2763,21 @@ void ALBankFile_clear_visited_flags(struct ALBankFile *bank_file)
                             struct ALKeyMap *keymap = sound->keymap;
                             struct ALWaveTable *wavetable = sound->wavetable;
 
-                            sound->visited = 0;
+                            sound->visited_generation = 0;
 
                             if (envelope != NULL)
                             {
-                                envelope->visited = 0;
+                                envelope->visited_generation = 0;
                             }
 
                             if (keymap != NULL)
                             {
-                                keymap->visited = 0;
+                                keymap->visited_generation = 0;
                             }
 
                             if (wavetable != NULL)
                             {
-                                wavetable->visited = 0;
+                                wavetable->visited_generation = 0;
                             }
                         }
                     }
@@ -2710,28 +2790,28 @@ void ALBankFile_clear_visited_flags(struct ALBankFile *bank_file)
 }
 
 /**
- * Attempts to guess the .ctl file size that would result from
- * writing this bank file to disk. This is an over estimate.
- * @param bank_file: bank file to estimate size for.
- * @returns: size in bytes the bank file should fit into.
+ * Iterates the bank file once and collects every instrument, sound, envelope,
+ * keymap, and wavetable into arrays. Each object is listed once, in the order first
+ * encountered, along with the first object referencing it.
+ * @param bank_file: bank file to flatten.
+ * @returns: pointer to new layout.
 */
-size_t ALBankFile_estimate_ctl_filesize(struct ALBankFile *bank_file)
+struct ALBankFileLayout *ALBankFileLayout_new(struct ALBankFile *bank_file)
 {
     TRACE_ENTER(__func__)
 
-    size_t len = 0;
-    int bank_count;
-
     if (bank_file == NULL)
     {
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> bank_file is NULL\n", __func__, __LINE__);
     }
 
-    ALBankFile_clear_visited_flags(bank_file);
-
-    len += 4; /* magic bytes, count */
-    len += 4 * bank_file->bank_count; /* offsets */
+    struct ALBankFileLayout *layout = (struct ALBankFileLayout *)malloc_zero(1, sizeof(struct ALBankFileLayout));
+    size_t max_instruments = 0;
+    size_t max_sounds = 0;
+    int bank_count;
+    uint32_t generation;
 
+    // Count references (including duplicates) to size the arrays.
     for (bank_count=0; bank_count<bank_file->bank_count; bank_count++)
     {
         struct ALBank *bank = bank_file->banks[bank_count];
@@ -2740,108 +2820,206 @@ size_t ALBankFile_estimate_ctl_filesize(struct ALBankFile *bank_file)
         {
             int inst_count;
 
-            len += 12; /* instrument data */
-            len += 4 * bank->inst_count; /* offsets */
+            max_instruments += bank->inst_count;
+
+            for (inst_count=0; inst_count<bank->inst_count; inst_count++)
+            {
+                struct ALInstrument *instrument = bank->instruments[inst_count];
+
+                if (instrument != NULL)
+                {
+                    max_sounds += instrument->sound_count;
+                }
+            }
+        }
+    }
+
+    // +1 so an empty bank file still allocates.
+    layout->instruments = (struct ALBankFileLayoutEntry *)malloc_zero(max_instruments + 1, sizeof(struct ALBankFileLayoutEntry));
+    layout->sounds = (struct ALBankFileLayoutEntry *)malloc_zero(max_sounds + 1, sizeof(struct ALBankFileLayoutEntry));
+    layout->envelopes = (struct ALBankFileLayoutEntry *)malloc_zero(max_sounds + 1, sizeof(struct ALBankFileLayoutEntry));
+    layout->keymaps = (struct ALBankFileLayoutEntry *)malloc_zero(max_sounds + 1, sizeof(struct ALBankFileLayoutEntry));
+    layout->wavetables = (struct ALBankFileLayoutEntry *)malloc_zero(max_sounds + 1, sizeof(struct ALBankFileLayoutEntry));
 
-            // I think there's a final zero word?
-            len += 4;
+    generation = ALBankFile_begin_visit(bank_file);
 
-            // I think this is 16-byte aligned? pad the estimate here just in case.
-            len += 12;
+    for (bank_count=0; bank_count<bank_file->bank_count; bank_count++)
+    {
+        struct ALBank *bank = bank_file->banks[bank_count];
+
+        if (bank != NULL)
+        {
+            int inst_count;
 
             for (inst_count=0; inst_count<bank->inst_count; inst_count++)
             {
                 struct ALInstrument *instrument = bank->instruments[inst_count];
+                struct ALBankFileLayoutEntry *entry;
+                int sound_count;
 
-                if (instrument != NULL)
+                if (instrument == NULL || instrument->visited_generation == generation)
                 {
-                    int sound_count;
+                    continue;
+                }
+
+                instrument->visited_generation = generation;
+
+                entry = &layout->instruments[layout->instrument_count];
+                entry->item = instrument;
+                entry->parent = bank;
+                entry->parent_index = inst_count;
+                entry->position = layout->instrument_count;
+                layout->instrument_count++;
 
-                    if (instrument->visited == 1)
+                for (sound_count=0; sound_count<instrument->sound_count; sound_count++)
+                {
+                    struct ALSound *sound = instrument->sounds[sound_count];
+
+                    if (sound == NULL || sound->visited_generation == generation)
                     {
                         continue;
                     }
 
-                    instrument->visited = 1;
+                    sound->visited_generation = generation;
 
-                    len += 16; /* instrument data */
-                    len += 4 * instrument->sound_count; /* offsets */
+                    entry = &layout->sounds[layout->sound_count];
+                    entry->item = sound;
+                    entry->parent = instrument;
+                    entry->parent_index = sound_count;
+                    entry->position = layout->sound_count;
+                    layout->sound_count++;
 
-                    // I think there's a final zero word?
-                    len += 4;
+                    if (sound->envelope != NULL && sound->envelope->visited_generation != generation)
+                    {
+                        sound->envelope->visited_generation = generation;
 
-                    // I think this is 16-byte aligned? pad the estimate here just in case.
-                    len += 12;
+                        entry = &layout->envelopes[layout->envelope_count];
+                        entry->item = sound->envelope;
+                        entry->parent = sound;
+                        entry->position = layout->envelope_count;
+                        layout->envelope_count++;
+                    }
 
-                    for (sound_count=0; sound_count<instrument->sound_count; sound_count++)
+                    if (sound->keymap != NULL && sound->keymap->visited_generation != generation)
                     {
-                        struct ALSound *sound = instrument->sounds[sound_count];
+                        sound->keymap->visited_generation = generation;
 
-                        if (sound != NULL)
-                        {
-                            struct ALEnvelope *envelope = sound->envelope;
-                            struct ALKeyMap *keymap = sound->keymap;
-                            struct ALWaveTable *wavetable = sound->wavetable;
+                        entry = &layout->keymaps[layout->keymap_count];
+                        entry->item = sound->keymap;
+                        entry->parent = sound;
+                        entry->position = layout->keymap_count;
+                        layout->keymap_count++;
+                    }
 
-                            if (sound->visited == 1)
-                            {
-                                continue;
-                            }
+                    if (sound->wavetable != NULL && sound->wavetable->visited_generation != generation)
+                    {
+                        sound->wavetable->visited_generation = generation;
 
-                            sound->visited = 1;
+                        entry = &layout->wavetables[layout->wavetable_count];
+                        entry->item = sound->wavetable;
+                        entry->parent = sound;
+                        entry->position = layout->wavetable_count;
+                        layout->wavetable_count++;
+                    }
+                }
+            }
+        }
+    }
 
-                            len += 16; /* sound data */
+    TRACE_LEAVE(__func__)
 
-                            if (envelope != NULL && envelope->visited == 0)
-                            {
-                                envelope->visited = 1;
+    return layout;
+}
 
-                                len += 16; /* envelope data (and padding) */
-                            }
+/**
+ * Sorts layout entries by {@code sort_key}, smallest first. Entries with the
+ * same key keep their current order (the sort is stable). Afterwards
+ * {@code position} is set to the new index, so sorts can be chained.
+ * @param entries: array to sort.
+ * @param count: number of elements in array.
+*/
+void ALBankFileLayoutEntry_sort(struct ALBankFileLayoutEntry *entries, size_t count)
+{
+    TRACE_ENTER(__func__)
 
-                            if (keymap != NULL && keymap->visited == 0)
-                            {
-                                keymap->visited = 1;
+    size_t i;
 
-                                len += 8; /* keymap data */
-                            }
+    if (count == 0)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
 
-                            if (wavetable != NULL && wavetable->visited == 0)
-                            {
-                                wavetable->visited = 1;
+    if (entries == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> entries is NULL\n", __func__, __LINE__);
+    }
 
-                                len += 24; /* wavetable data (and padding) */
+    for (i=0; i<count; i++)
+    {
+        entries[i].position = i;
+    }
 
-                                // always assume there is a ALADPCMWaveInfo loop.
-                                // note that the raw wave writes the state (`ADPCM_STATE_SIZE` number of bytes) but all zeros.
-                                // loop:
-                                len += 12 + 32; /* start, end, count + state */ 
+    qsort(entries, count, sizeof(struct ALBankFileLayoutEntry), ALBankFileLayoutEntry_compare);
 
-                                if (wavetable->type == AL_ADPCM_WAVE)
-                                {
-                                    struct ALADPCMWaveInfo *info = &wavetable->wave_info.adpcm_wave;
+    for (i=0; i<count; i++)
+    {
+        entries[i].position = i;
+    }
+
+    TRACE_LEAVE(__func__)
+}
 
-                                    if (info->book != NULL)
-                                    {
-                                        len += 8 + (info->book->order * info->book->npredictors * 16); /* order, predictors + state */
+/**
+ * Frees memory allocated to layout. The referenced bank file objects are not freed.
+ * @param layout: object to free.
+*/
+void ALBankFileLayout_free(struct ALBankFileLayout *layout)
+{
+    TRACE_ENTER(__func__)
 
-                                        // I don't think this is 16-byte align, I think
-                                        // it just adds 8 bytes?
-                                        len += 8;
-                                    }
-                                }
-                                // else, AL_RAW16_WAVE, but this is less space than AL_ADPCM_WAVE
-                            }
-                        }
-                    }
-                }
-            }
-        }
+    if (layout == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    gaudio_free(layout->instruments);
+    gaudio_free(layout->sounds);
+    gaudio_free(layout->envelopes);
+    gaudio_free(layout->keymaps);
+    gaudio_free(layout->wavetables);
+    gaudio_free(layout);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * qsort comparison function. Sorts by sort key, then position.
+ * @param first: first entry.
+ * @param second: second entry.
+ * @returns: comparison result.
+*/
+static int ALBankFileLayoutEntry_compare(const void *first, const void *second)
+{
+    TRACE_ENTER(__func__)
+
+    const struct ALBankFileLayoutEntry *a = (const struct ALBankFileLayoutEntry *)first;
+    const struct ALBankFileLayoutEntry *b = (const struct ALBankFileLayoutEntry *)second;
+    int ret;
+
+    if (a->sort_key != b->sort_key)
+    {
+        ret = a->sort_key < b->sort_key ? -1 : 1;
+    }
+    else
+    {
+        ret = a->position < b->position ? -1 : (a->position > b->position ? 1 : 0);
     }
 
     TRACE_LEAVE(__func__)
 
-    return len;
+    return ret;
 }
 
 /**
@@ -2879,277 +3057,376 @@ static void CtlParseContext_free(struct CtlParseContext *context)
     IntHashTable_free(context->seen_wavetable);
     IntHashTable_free(context->seen_keymap);
 
-    free(context);
+    gaudio_free(context);
 
     TRACE_LEAVE(__func__)
 }
 
 
-
 /**
- * Default wavetable_init method if not set externally.
- * Sets text id to 4 digit id without any filename.
- * Allocates memory for {@code wavetable->aifc_path}.
- * @param wavetable: wavetable to init.
+ * Allocates memory for a new bank file index, and adds every sound, keymap,
+ * and wavetable aifc filename from the bank file. Banks are set to report
+ * changes to {@code bank_file}.
+ * @param bank_file: bank file to index.
+ * @returns: pointer to new index.
 */
-static void ALWaveTable_init_default_set_aifc_path(struct ALWaveTable *wavetable)
+static struct ALBankFileIndex *ALBankFileIndex_new(struct ALBankFile *bank_file)
 {
     TRACE_ENTER(__func__)
-    
-    if (wavetable == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> wavetable is NULL\n", __func__, __LINE__);
-    }
 
-    struct ALSound* sound = NULL;
-    struct ALInstrument *instrument = NULL;
-
-    size_t filesystem_path_len = 0;
-    char *filesystem_path;
+    struct ALBankFileIndex *index = (struct ALBankFileIndex *)malloc_zero(1, sizeof(struct ALBankFileIndex));
+    struct StringHashTable *filenames;
+    int bank_index;
+    int instrument_index;
+    int sound_index;
+    int pass;
 
-    char *local_output_dir = ""; // empty string
-    char *local_filename_prefix = ""; // empty string
+    index->sounds = StringHashTable_new();
+    index->keymaps = StringHashTable_new();
+    index->aifc_filenames = StringHashTable_new();
+    index->change_count = bank_file->change_count;
 
-    if (g_output_dir != NULL)
-    {
-        local_output_dir = g_output_dir;
-    }
+    // filename part of every wavetable aifc_path.
+    filenames = StringHashTable_new();
 
-    if (g_filename_prefix != NULL)
+    // The first pass adds names and collects filenames. The second pass adds each
+    // filename with the first sound (in bank, instrument, sound order) that has a
+    // filename ending in it, which could be a longer filename.
+    for (pass=0; pass<2; pass++)
     {
-        local_filename_prefix = g_filename_prefix;
-    }
+        for (bank_index=0; bank_index<bank_file->bank_count; bank_index++)
+        {
+            struct ALBank *bank = bank_file->banks[bank_index];
 
-    if (wavetable->parents != NULL
-        && wavetable->parents->head != NULL
-        && wavetable->parents->head->data != NULL)
-    {
-        sound = (struct ALSound*)wavetable->parents->head->data;
-    }
+            if (bank == NULL)
+            {
+                continue;
+            }
 
-    if (sound != NULL
-        && sound->parents != NULL
-        && sound->parents->head != NULL
-        && sound->parents->head->data != NULL)
-    {
-        instrument = (struct ALInstrument *)sound->parents->head->data;
+            bank->bank_file = bank_file;
+
+            for (instrument_index=0; instrument_index<bank->inst_count; instrument_index++)
+            {
+                struct ALInstrument *instrument = bank->instruments[instrument_index];
+
+                if (instrument == NULL)
+                {
+                    continue;
+                }
+
+                for (sound_index=0; sound_index<instrument->sound_count; sound_index++)
+                {
+                    struct ALSound *sound = instrument->sounds[sound_index];
+                    const char *filename = NULL;
+
+                    if (sound == NULL)
+                    {
+                        continue;
+                    }
+
+                    if (sound->wavetable != NULL && sound->wavetable->aifc_path != NULL)
+                    {
+                        filename = ALBankFileIndex_filename(sound->wavetable->aifc_path);
+                    }
+
+                    if (pass == 0)
+                    {
+                        ALBankFileIndex_add(index->sounds, sound->text_id, sound);
+
+                        if (sound->keymap != NULL)
+                        {
+                            ALBankFileIndex_add(index->keymaps, sound->keymap->text_id, sound->keymap);
+                        }
+
+                        if (filename != NULL)
+                        {
+                            ALBankFileIndex_add(filenames, filename, sound);
+                        }
+                    }
+                    else if (filename != NULL)
+                    {
+                        for (; *filename != '\0'; filename++)
+                        {
+                            if (StringHashTable_contains(filenames, (char *)filename))
+                            {
+                                ALBankFileIndex_add(index->aifc_filenames, filename, sound);
+                            }
+                        }
+                    }
+                }
+            }
+        }
     }
 
-    if (instrument != NULL)
+    StringHashTable_free(filenames);
+
+    TRACE_LEAVE(__func__)
+
+    return index;
+}
+
+/**
+ * Frees all memory associated with index.
+ * @param index: object to free.
+*/
+static void ALBankFileIndex_free(struct ALBankFileIndex *index)
+{
+    TRACE_ENTER(__func__)
+
+    StringHashTable_free(index->sounds);
+    StringHashTable_free(index->keymaps);
+    StringHashTable_free(index->aifc_filenames);
+
+    gaudio_free(index);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Adds an item to an index table. Empty keys are skipped. If the key is
+ * already in the table the existing item is kept.
+ * @param table: index table.
+ * @param key: lookup key.
+ * @param data: item.
+*/
+static void ALBankFileIndex_add(struct StringHashTable *table, const char *key, void *data)
+{
+    TRACE_ENTER(__func__)
+
+    if (key[0] == '\0' || StringHashTable_contains(table, (char *)key))
     {
-        filesystem_path_len = snprintf(NULL, 0, "%s%sinst_%04d_%04d%s", local_output_dir, local_filename_prefix, instrument->id, wavetable->id, NAUDIO_AIFC_OUT_DEFAULT_EXTENSION) + 1;
-        filesystem_path = (char *)malloc_zero(filesystem_path_len + 1, 1);
-        filesystem_path_len = snprintf(filesystem_path, filesystem_path_len, "%s%sinst_%04d_%04d%s", local_output_dir, local_filename_prefix, instrument->id, wavetable->id, NAUDIO_AIFC_OUT_DEFAULT_EXTENSION);
+        TRACE_LEAVE(__func__)
+        return;
     }
-    else
+
+    StringHashTable_add(table, (char *)key, data);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Gets an item from an index table.
+ * @param table: index table.
+ * @param key: lookup key.
+ * @returns: item, or NULL if key is empty or not found.
+*/
+static void *ALBankFileIndex_get(struct StringHashTable *table, const char *key)
+{
+    TRACE_ENTER(__func__)
+
+    if (key[0] == '\0' || !StringHashTable_contains(table, (char *)key))
     {
-        filesystem_path_len = snprintf(NULL, 0, "%s%s%04d%s", local_output_dir, local_filename_prefix, wavetable->id, NAUDIO_AIFC_OUT_DEFAULT_EXTENSION) + 1;
-        filesystem_path = (char *)malloc_zero(filesystem_path_len + 1, 1);
-        filesystem_path_len = snprintf(filesystem_path, filesystem_path_len, "%s%s%04d%s", local_output_dir, local_filename_prefix, wavetable->id, NAUDIO_AIFC_OUT_DEFAULT_EXTENSION);
+        TRACE_LEAVE(__func__)
+        return NULL;
     }
 
-    wavetable->aifc_path = filesystem_path;
-
     TRACE_LEAVE(__func__)
+
+    return StringHashTable_get(table, (char *)key);
 }
 
 /**
- * Merge sort comparison function.
- * Sorts on sound->keymap->self_offset.
- * Use this to sort smallest to largest.
- * @param first: first node
- * @param second: second node
- * @returns: comparison result
+ * Returns the filename part of a path (everything after the last path separator).
+ * @param path: path.
+ * @returns: pointer into {@code path}.
 */
-static int LinkedListNode_sound_keymap_offset_compare_smaller(struct LinkedListNode *first, struct LinkedListNode *second)
+static const char *ALBankFileIndex_filename(const char *path)
 {
     TRACE_ENTER(__func__)
 
-    int ret;
+    const char *filename = strrchr(path, PATH_SEPERATOR);
+
+    TRACE_LEAVE(__func__)
+
+    return filename != NULL ? filename + 1 : path;
+}
 
-    if (first == NULL && second == NULL)
+/**
+ * Returns the bank file lookup tables, building them if needed, or if any bank object
+ * has changed since they were built.
+ * @param bank_file: bank file.
+ * @returns: index.
+*/
+static struct ALBankFileIndex *ALBankFile_get_index(struct ALBankFile *bank_file)
+{
+    TRACE_ENTER(__func__)
+
+    if (bank_file->index != NULL
+        && bank_file->index->change_count != bank_file->change_count)
     {
-        ret = 0;
+        ALBankFileIndex_free(bank_file->index);
+        bank_file->index = NULL;
     }
-    else if (first == NULL && second != NULL)
+
+    if (bank_file->index == NULL)
     {
-        ret = 1;
+        bank_file->index = ALBankFileIndex_new(bank_file);
     }
-    else if (first != NULL && second == NULL)
+
+    TRACE_LEAVE(__func__)
+
+    return bank_file->index;
+}
+
+/**
+ * Marks the index of the bank file containing the bank as out of date.
+ * @param bank: bank that changed.
+*/
+static void ALBank_notify_changed(struct ALBank *bank)
+{
+    TRACE_ENTER(__func__)
+
+    if (bank->bank_file != NULL)
     {
-        ret = -1;
+        bank->bank_file->change_count++;
     }
-    else
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Marks the index of each bank file containing the instrument as out of date.
+ * @param instrument: instrument that changed.
+*/
+static void ALInstrument_notify_changed(struct ALInstrument *instrument)
+{
+    TRACE_ENTER(__func__)
+
+    struct LinkedListNode *node;
+
+    if (instrument->parents != NULL)
     {
-        struct ALSound *sound_first = (struct ALSound *)first->data;
-        struct ALSound *sound_second = (struct ALSound *)second->data;
-       
-        if ((sound_first == NULL || sound_first->keymap == NULL) && (sound_second == NULL || sound_second->keymap == NULL))
-        {
-            ret = 0;
-        }
-        else if ((sound_first == NULL || sound_first->keymap == NULL) && sound_second != NULL)
-        {
-            ret = 1;
-        }
-        else if (sound_first != NULL && (sound_second == NULL || sound_second->keymap == NULL))
-        {
-            ret = -1;
-        }
-        else
+        for (node = instrument->parents->head; node != NULL; node = node->next)
         {
-            if (sound_first->keymap->self_offset < sound_second->keymap->self_offset)
-            {
-                ret = -1;
-            }
-            else if (sound_first->keymap->self_offset > sound_second->keymap->self_offset)
-            {
-                ret = 1;
-            }
-            else
+            if (node->data != NULL)
             {
-                ret = 0;
+                ALBank_notify_changed((struct ALBank *)node->data);
             }
         }
     }
 
     TRACE_LEAVE(__func__)
-
-    return ret;
 }
 
 /**
- * Merge sort comparison function.
- * Sorts on sound->envelope->self_offset.
- * Use this to sort smallest to largest.
- * @param first: first node
- * @param second: second node
- * @returns: comparison result
+ * Marks the index of each bank file containing the sound as out of date.
+ * @param sound: sound that changed.
 */
-static int LinkedListNode_sound_envelope_offset_compare_smaller(struct LinkedListNode *first, struct LinkedListNode *second)
+static void ALSound_notify_changed(struct ALSound *sound)
 {
     TRACE_ENTER(__func__)
 
-    int ret;
+    struct LinkedListNode *node;
 
-    if (first == NULL && second == NULL)
-    {
-        ret = 0;
-    }
-    else if (first == NULL && second != NULL)
-    {
-        ret = 1;
-    }
-    else if (first != NULL && second == NULL)
-    {
-        ret = -1;
-    }
-    else
+    if (sound->parents != NULL)
     {
-        struct ALSound *sound_first = (struct ALSound *)first->data;
-        struct ALSound *sound_second = (struct ALSound *)second->data;
-       
-        if ((sound_first == NULL || sound_first->envelope == NULL) && (sound_second == NULL || sound_second->envelope == NULL))
-        {
-            ret = 0;
-        }
-        else if ((sound_first == NULL || sound_first->envelope == NULL) && sound_second != NULL)
-        {
-            ret = 1;
-        }
-        else if (sound_first != NULL && (sound_second == NULL || sound_second->envelope == NULL))
-        {
-            ret = -1;
-        }
-        else
+        for (node = sound->parents->head; node != NULL; node = node->next)
         {
-            if (sound_first->envelope->self_offset < sound_second->envelope->self_offset)
+            if (node->data != NULL)
             {
-                ret = -1;
+                ALInstrument_notify_changed((struct ALInstrument *)node->data);
             }
-            else if (sound_first->envelope->self_offset > sound_second->envelope->self_offset)
-            {
-                ret = 1;
-            }
-            else
+        }
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Marks the index of each bank file containing any sound in the list as out of date.
+ * Used for keymaps and wavetables.
+ * @param sounds: list of {@code struct ALSound}, or NULL.
+*/
+static void ALSound_list_notify_changed(struct LinkedList *sounds)
+{
+    TRACE_ENTER(__func__)
+
+    struct LinkedListNode *node;
+
+    if (sounds != NULL)
+    {
+        for (node = sounds->head; node != NULL; node = node->next)
+        {
+            if (node->data != NULL)
             {
-                ret = 0;
+                ALSound_notify_changed((struct ALSound *)node->data);
             }
         }
     }
 
     TRACE_LEAVE(__func__)
-
-    return ret;
 }
 
+
 /**
- * Merge sort comparison function.
- * Sorts on sound->self_offset.
- * Use this to sort smallest to largest.
- * @param first: first node
- * @param second: second node
- * @returns: comparison result
+ * Default wavetable_init method if not set externally.
+ * Sets text id to 4 digit id without any filename.
+ * Allocates memory for {@code wavetable->aifc_path}.
+ * @param wavetable: wavetable to init.
 */
-static int LinkedListNode_sound_offset_compare_smaller(struct LinkedListNode *first, struct LinkedListNode *second)
+static void ALWaveTable_init_default_set_aifc_path(struct ALWaveTable *wavetable)
 {
     TRACE_ENTER(__func__)
+    
+    if (wavetable == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> wavetable is NULL\n", __func__, __LINE__);
+    }
 
-    int ret;
+    struct ALSound* sound = NULL;
+    struct ALInstrument *instrument = NULL;
+
+    size_t filesystem_path_len = 0;
+    char *filesystem_path;
+
+    char *local_output_dir = ""; // empty string
+    char *local_filename_prefix = ""; // empty string
+
+    if (g_output_dir != NULL)
+    {
+        local_output_dir = g_output_dir;
+    }
+
+    if (g_filename_prefix != NULL)
+    {
+        local_filename_prefix = g_filename_prefix;
+    }
 
-    if (first == NULL && second == NULL)
+    if (wavetable->parents != NULL
+        && wavetable->parents->head != NULL
+        && wavetable->parents->head->data != NULL)
     {
-        ret = 0;
+        sound = (struct ALSound*)wavetable->parents->head->data;
     }
-    else if (first == NULL && second != NULL)
+
+    if (sound != NULL
+        && sound->parents != NULL
+        && sound->parents->head != NULL
+        && sound->parents->head->data != NULL)
     {
-        ret = 1;
+        instrument = (struct ALInstrument *)sound->parents->head->data;
     }
-    else if (first != NULL && second == NULL)
+
+    if (instrument != NULL)
     {
-        ret = -1;
+        filesystem_path_len = snprintf(NULL, 0, "%s%sinst_%04d_%04d%s", local_output_dir, local_filename_prefix, instrument->id, wavetable->id, NAUDIO_AIFC_OUT_DEFAULT_EXTENSION) + 1;
+        filesystem_path = (char *)malloc_zero(filesystem_path_len + 1, 1);
+        filesystem_path_len = snprintf(filesystem_path, filesystem_path_len, "%s%sinst_%04d_%04d%s", local_output_dir, local_filename_prefix, instrument->id, wavetable->id, NAUDIO_AIFC_OUT_DEFAULT_EXTENSION);
     }
     else
     {
-        struct ALSound *sound_first = (struct ALSound *)first->data;
-        struct ALSound *sound_second = (struct ALSound *)second->data;
-       
-        if (sound_first == NULL && sound_second == NULL)
-        {
-            ret = 0;
-        }
-        else if (sound_first == NULL && sound_second != NULL)
-        {
-            ret = 1;
-        }
-        else if (sound_first != NULL && sound_second == NULL)
-        {
-            ret = -1;
-        }
-        else
-        {
-            if (sound_first->self_offset < sound_second->self_offset)
-            {
-                ret = -1;
-            }
-            else if (sound_first->self_offset > sound_second->self_offset)
-            {
-                ret = 1;
-            }
-            else
-            {
-                ret = 0;
-            }
-        }
+        filesystem_path_len = snprintf(NULL, 0, "%s%s%04d%s", local_output_dir, local_filename_prefix, wavetable->id, NAUDIO_AIFC_OUT_DEFAULT_EXTENSION) + 1;
+        filesystem_path = (char *)malloc_zero(filesystem_path_len + 1, 1);
+        filesystem_path_len = snprintf(filesystem_path, filesystem_path_len, "%s%s%04d%s", local_output_dir, local_filename_prefix, wavetable->id, NAUDIO_AIFC_OUT_DEFAULT_EXTENSION);
     }
 
-    TRACE_LEAVE(__func__)
+    wavetable->aifc_path = filesystem_path;
 
-    return ret;
+    TRACE_LEAVE(__func__)
 }
 
 /**
- * Iterate the bank file and update envelope and keymap write_order
+ * Iterate the bank file and update sound, envelope, and keymap write_order
  * based on their offsets.
  * @param bank_file: bank_file to order.
 */
@@ -3158,13 +3435,8 @@ static void ALBankFile_set_write_order_by_offset(struct ALBankFile *bank_file)
     TRACE_ENTER(__func__)
 
     /**
-     * Iterate bank_file and collect all sounds into a list.
-     * 
-     * sort the sounds list by wavetable offset.
-     * iterate sounds list and set wavetable write_order from sort order.
-     * 
-     * sort the sounds list by envelope offset.
-     * iterate sounds list and set envelope write_order from sort order.
+     * Flatten bank_file into arrays of unique sounds, envelopes, and keymaps.
+     * Sort each array by .ctl offset and set write_order from sort order.
     */
     
     if (bank_file == NULL)
@@ -3172,123 +3444,49 @@ static void ALBankFile_set_write_order_by_offset(struct ALBankFile *bank_file)
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> bank_file is NULL\n", __func__, __LINE__);
     }
 
-    struct LinkedList *list_sounds = LinkedList_new();
-    struct LinkedListNode *node;
-    int bank_count;
-    int write_order;
+    struct ALBankFileLayout *layout;
+    size_t i;
 
-    ALBankFile_clear_visited_flags(bank_file);
+    layout = ALBankFileLayout_new(bank_file);
 
-    for (bank_count=0; bank_count<bank_file->bank_count; bank_count++)
+    for (i=0; i<layout->sound_count; i++)
     {
-        struct ALBank *bank = bank_file->banks[bank_count];
-
-        if (bank != NULL)
-        {
-            int inst_count;
-
-            for (inst_count=0; inst_count<bank->inst_count; inst_count++)
-            {
-                struct ALInstrument *instrument = bank->instruments[inst_count];
-
-                if (instrument != NULL)
-                {
-                    int sound_count;
-
-                    if (instrument->visited == 1)
-                    {
-                        continue;
-                    }
-
-                    instrument->visited = 1;
-
-                    for (sound_count=0; sound_count<instrument->sound_count; sound_count++)
-                    {
-                        struct ALSound *sound = instrument->sounds[sound_count];
-
-                        if (sound != NULL)
-                        {
-                            if (sound->visited == 1)
-                            {
-                                continue;
-                            }
-
-                            sound->visited = 1;
-
-                            node = LinkedListNode_new();
-                            node->data = sound;
-                            LinkedList_append_node(list_sounds, node);
-                        }
-                    }
-                }
-            }
-        }
+        layout->sounds[i].sort_key = ((struct ALSound *)layout->sounds[i].item)->self_offset;
     }
 
-    LinkedList_merge_sort(list_sounds, LinkedListNode_sound_offset_compare_smaller);
-    ALBankFile_clear_visited_flags(bank_file);
+    ALBankFileLayoutEntry_sort(layout->sounds, layout->sound_count);
 
     // start at non-zero.
-    write_order = 1;
-
-    node = list_sounds->head;
-    while (node != NULL)
+    for (i=0; i<layout->sound_count; i++)
     {
-        struct ALSound *sound = (struct ALSound *)node->data;
-
-        if (sound->visited == 0)
-        {
-            sound->ctl_write_order = write_order;
-            write_order++;
-            sound->visited = 1;
-        }
-
-        node = node->next;
+        ((struct ALSound *)layout->sounds[i].item)->ctl_write_order = (int)i + 1;
     }
 
-    LinkedList_merge_sort(list_sounds, LinkedListNode_sound_envelope_offset_compare_smaller);
-    ALBankFile_clear_visited_flags(bank_file);
-
-    // start at non-zero.
-    write_order = 1;
-
-    node = list_sounds->head;
-    while (node != NULL)
+    for (i=0; i<layout->envelope_count; i++)
     {
-        struct ALSound *sound = (struct ALSound *)node->data;
-
-        if (sound->envelope != NULL && sound->envelope->visited == 0)
-        {
-            sound->envelope->ctl_write_order = write_order;
-            write_order++;
-            sound->envelope->visited = 1;
-        }
-
-        node = node->next;
+        layout->envelopes[i].sort_key = ((struct ALEnvelope *)layout->envelopes[i].item)->self_offset;
     }
 
-    LinkedList_merge_sort(list_sounds, LinkedListNode_sound_keymap_offset_compare_smaller);
-    ALBankFile_clear_visited_flags(bank_file);
+    ALBankFileLayoutEntry_sort(layout->envelopes, layout->envelope_count);
 
-    // start at non-zero.
-    write_order = 1;
+    for (i=0; i<layout->envelope_count; i++)
+    {
+        ((struct ALEnvelope *)layout->envelopes[i].item)->ctl_write_order = (int)i + 1;
+    }
 
-    node = list_sounds->head;
-    while (node != NULL)
+    for (i=0; i<layout->keymap_count; i++)
     {
-        struct ALSound *sound = (struct ALSound *)node->data;
+        layout->keymaps[i].sort_key = ((struct ALKeyMap *)layout->keymaps[i].item)->self_offset;
+    }
 
-        if (sound->keymap != NULL && sound->keymap->visited == 0)
-        {
-            sound->keymap->ctl_write_order = write_order;
-            write_order++;
-            sound->keymap->visited = 1;
-        }
+    ALBankFileLayoutEntry_sort(layout->keymaps, layout->keymap_count);
 
-        node = node->next;
+    for (i=0; i<layout->keymap_count; i++)
+    {
+        ((struct ALKeyMap *)layout->keymaps[i].item)->ctl_write_order = (int)i + 1;
     }
 
-    LinkedList_free(list_sounds);
+    ALBankFileLayout_free(layout);
 
     TRACE_LEAVE(__func__)
 }
\ No newline at end of file
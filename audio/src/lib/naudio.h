@@ -295,11 +295,11 @@ struct ALWaveTable {
     struct LinkedList *parents;
 
     /**
-     * Flag to indicate if this object has been written to destination yet.
+     * Generation of the last traversal that visited this object, see {@code ALBankFile_begin_visit}.
      * This is used during converstion to .inst or .ctl in case this
      * object is referenced multiple times.
     */
-    int visited;
+    uint32_t visited_generation;
 
     /**
      * This may have more than one parent, so just track relevant file offsets
@@ -369,11 +369,11 @@ struct ALKeyMap {
     struct LinkedList *parents;
 
     /**
-     * Flag to indicate if this object has been written to destination yet.
+     * Generation of the last traversal that visited this object, see {@code ALBankFile_begin_visit}.
      * This is used during converstion to .inst or .ctl in case this
      * object is referenced multiple times.
     */
-    int visited;
+    uint32_t visited_generation;
 
     /**
      * Meta property, used to write .ctl from .inst in correct order.
@@ -441,11 +441,11 @@ struct ALEnvelope {
     struct LinkedList *parents;
 
     /**
-     * Flag to indicate if this object has been written to destination yet.
+     * Generation of the last traversal that visited this object, see {@code ALBankFile_begin_visit}.
      * This is used during converstion to .inst or .ctl in case this
      * object is referenced multiple times.
     */
-    int visited;
+    uint32_t visited_generation;
 
     /**
      * Meta property, used to write .ctl from .inst in correct order.
@@ -538,11 +538,11 @@ struct ALSound {
     struct LinkedList *parents;
 
     /**
-     * Flag to indicate if this object has been written to destination yet.
+     * Generation of the last traversal that visited this object, see {@code ALBankFile_begin_visit}.
      * This is used during converstion to .inst or .ctl in case this
      * object is referenced multiple times.
     */
-    int visited;
+    uint32_t visited_generation;
 
     /**
      * Meta property, used to write .ctl from .inst in correct order.
@@ -638,11 +638,11 @@ struct ALInstrument {
     struct LinkedList *parents;
 
     /**
-     * Flag to indicate if this object has been written to destination yet.
+     * Generation of the last traversal that visited this object, see {@code ALBankFile_begin_visit}.
      * This is used during converstion to .inst or .ctl in case this
      * object is referenced multiple times.
     */
-    int visited;
+    uint32_t visited_generation;
 
     /**
      * This may have more than one parent, so just track relevant file offsets
@@ -651,6 +651,8 @@ struct ALInstrument {
     int self_offset;
 };
 
+struct ALBankFile;
+
 /**
  * Modified libultra struct.
 */
@@ -712,8 +714,16 @@ struct ALBank {
      * Array of pointers to each instrument.
     */
     struct ALInstrument **instruments;
+
+    /**
+     * Bank file containing this bank. Changes to the bank or its children are
+     * reported to this bank file, see {@code ALBankFile_get_index}.
+    */
+    struct ALBankFile *bank_file;
 };
 
+struct ALBankFileIndex;
+
 /**
  * Modified libultra struct.
  * Base container for bank.
@@ -763,6 +773,81 @@ struct ALBankFile {
      * See {@code enum CTL_SORT_METHOD}.
     */
     int ctl_sort_method;
+
+    /**
+     * Lookup tables used by the {@code ALBankFile_find_*} functions.
+     * Built on first lookup, and again after bank objects change, see
+     * {@code ALBankFile_invalidate_index}.
+    */
+    struct ALBankFileIndex *index;
+
+    /**
+     * Incremented whenever a bank, instrument, sound, keymap, or wavetable in this
+     * bank file is freed or gets a new parent. An index built at an older value is rebuilt.
+    */
+    uint32_t change_count;
+
+    /**
+     * Generation of the current (or last) traversal, see {@code ALBankFile_begin_visit}.
+    */
+    uint32_t visit_generation;
+};
+
+/**
+ * One object in a {@code struct ALBankFileLayout}.
+*/
+struct ALBankFileLayoutEntry {
+    /**
+     * The object: {@code struct ALInstrument}, {@code struct ALSound},
+     * {@code struct ALEnvelope}, {@code struct ALKeyMap}, or {@code struct ALWaveTable}.
+    */
+    void *item;
+
+    /**
+     * First object found referencing {@code item}. This is the bank for
+     * an instrument, the instrument for a sound, and the sound for
+     * an envelope, keymap, or wavetable.
+    */
+    void *parent;
+
+    /**
+     * Index of {@code item} in the parent child array. Only set
+     * for instruments and sounds.
+    */
+    int parent_index;
+
+    /**
+     * Sort key, see {@code ALBankFileLayoutEntry_sort}.
+    */
+    int32_t sort_key;
+
+    /**
+     * Index of the entry in the array before sorting.
+     * Entries with the same sort key keep this order.
+    */
+    size_t position;
+};
+
+/**
+ * Flattened view of a bank file. Every instrument, sound, envelope, keymap, and wavetable
+ * is listed once, in the order first encountered iterating
+ * banks, then instruments, then sounds.
+*/
+struct ALBankFileLayout {
+    struct ALBankFileLayoutEntry *instruments;
+    size_t instrument_count;
+
+    struct ALBankFileLayoutEntry *sounds;
+    size_t sound_count;
+
+    struct ALBankFileLayoutEntry *envelopes;
+    size_t envelope_count;
+
+    struct ALBankFileLayoutEntry *keymaps;
+    size_t keymap_count;
+
+    struct ALBankFileLayoutEntry *wavetables;
+    size_t wavetable_count;
 };
 
 /**
@@ -801,10 +886,15 @@ void ALADPCMBook_write_coef(struct ALADPCMBook *book, struct FileInfo *fi);
 struct ALKeyMap *ALBankFile_find_keymap_with_name(struct ALBankFile *bank_file, const char *keymap_text_id);
 struct ALSound *ALBankFile_find_sound_with_name(struct ALBankFile *bank_file, const char *sound_text_id);
 struct ALSound *ALBankFile_find_sound_by_aifc_filename(struct ALBankFile *bank_file, const char *search_filename);
+void ALBankFile_invalidate_index(struct ALBankFile *bank_file);
 
-size_t ALBankFile_estimate_ctl_filesize(struct ALBankFile *bank_file);
+uint32_t ALBankFile_begin_visit(struct ALBankFile *bank_file);
 void ALBankFile_clear_visited_flags(struct ALBankFile *bank_file);
 
+struct ALBankFileLayout *ALBankFileLayout_new(struct ALBankFile *bank_file);
+void ALBankFileLayoutEntry_sort(struct ALBankFileLayoutEntry *entries, size_t count);
+void ALBankFileLayout_free(struct ALBankFileLayout *layout);
+
 void ALADPCMBook_free(struct ALADPCMBook *book);
 
 /**
@@ -825,4 +915,11 @@ void ALWaveTable_add_parent(struct ALWaveTable *wavetable, struct ALSound *paren
 void ALSound_add_parent(struct ALSound *sound, struct ALInstrument *parent);
 void ALInstrument_add_parent(struct ALInstrument *instrument, struct ALBank *parent);
 
+void ALEnvelope_free(struct ALEnvelope *envelope);
+void ALKeyMap_free(struct ALKeyMap *keymap);
+void ALWaveTable_free(struct ALWaveTable *wavetable);
+void ALSound_free(struct ALSound *sound);
+void ALInstrument_free(struct ALInstrument *instrument);
+void ALBank_free(struct ALBank *bank);
+
 #endif
\ No newline at end of file
@@ -221,14 +221,14 @@ static void CoefParseContext_free(struct CoefParseContext *context)
 {
     TRACE_ENTER(__func__)
 
-    free(context->current_property);
+    gaudio_free(context->current_property);
 
-    free(context->property_value_buffer);
-    free(context->property_name_buffer);
+    gaudio_free(context->property_value_buffer);
+    gaudio_free(context->property_name_buffer);
 
     LinkedList_free(context->book_val);
     
-    free(context);
+    gaudio_free(context);
 
     TRACE_LEAVE(__func__)
 }
@@ -910,7 +910,7 @@ struct ALADPCMBook *ALADPCMBook_new_from_coef(struct FileInfo *fi)
     }
 
     // Done with reading file, can release memory.
-    free(file_contents);
+    gaudio_free(file_contents);
 
     // last check, and put the codebook array into the book.
     check_resolve(context);
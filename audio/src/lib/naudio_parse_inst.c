@@ -217,6 +217,12 @@ struct InstParseContext {
      * Hash table of ALSound that need to have keymap reference resolved.
     */
     struct IntHashTable *sound_missing_keymap;
+
+    /**
+     * Traversal generation used to mark objects referenced while
+     * resolving references, see {@code ALBankFile_begin_visit}.
+    */
+    uint32_t visit_generation;
 };
 
 /**
@@ -779,6 +785,7 @@ static void resolve_references(struct InstParseContext *context, struct ALBankFi
 
 /**
  * Foreach `any` callback method.
+ * Objects are created by the parse, so a zero generation means it was never referenced.
  * @param vp: hashtable value pointer.
  * @returns: true if unvisitied, zero otherwise.
 */
@@ -788,7 +795,7 @@ static inline int StringHash_instrument_unvisited(void *vp)
 
     if (instrument != NULL)
     {
-        return instrument->visited == 0;
+        return instrument->visited_generation == 0;
     }
 
     return 0;
@@ -796,6 +803,7 @@ static inline int StringHash_instrument_unvisited(void *vp)
 
 /**
  * Foreach `any` callback method.
+ * Objects are created by the parse, so a zero generation means it was never referenced.
  * @param vp: hashtable value pointer.
  * @returns: true if unvisitied, zero otherwise.
 */
@@ -805,7 +813,7 @@ static inline int StringHash_sound_unvisited(void *vp)
 
     if (sound != NULL)
     {
-        return sound->visited == 0;
+        return sound->visited_generation == 0;
     }
 
     return 0;
@@ -813,6 +821,7 @@ static inline int StringHash_sound_unvisited(void *vp)
 
 /**
  * Foreach `any` callback method.
+ * Objects are created by the parse, so a zero generation means it was never referenced.
  * @param vp: hashtable value pointer.
  * @returns: true if unvisitied, zero otherwise.
 */
@@ -822,7 +831,7 @@ static inline int StringHash_keymap_unvisited(void *vp)
 
     if (keymap != NULL)
     {
-        return keymap->visited == 0;
+        return keymap->visited_generation == 0;
     }
 
     return 0;
@@ -830,6 +839,7 @@ static inline int StringHash_keymap_unvisited(void *vp)
 
 /**
  * Foreach `any` callback method.
+ * Objects are created by the parse, so a zero generation means it was never referenced.
  * @param vp: hashtable value pointer.
  * @returns: true if unvisitied, zero otherwise.
 */
@@ -839,7 +849,7 @@ static inline int StringHash_envelope_unvisited(void *vp)
 
     if (envelope != NULL)
     {
-        return envelope->visited == 0;
+        return envelope->visited_generation == 0;
     }
 
     return 0;
@@ -890,11 +900,11 @@ void MissingRef_free(struct MissingRef *ref)
 
     if (ref->ref_id != NULL)
     {
-        free(ref->ref_id);
+        gaudio_free(ref->ref_id);
         ref->ref_id = NULL;
     }
 
-    free(ref);
+    gaudio_free(ref);
 
     TRACE_LEAVE(__func__)
 }
@@ -983,16 +993,16 @@ static void InstParseContext_free(struct InstParseContext *context)
         IntHashTable_free(context->sound_missing_keymap);
     }
 
-    free(context->current_type);
-    free(context->current_property);
+    gaudio_free(context->current_type);
+    gaudio_free(context->current_property);
 
-    free(context->property_value_buffer);
-    free(context->array_index_value);
-    free(context->property_name_buffer);
-    free(context->instance_name_buffer);
-    free(context->type_name_buffer);
+    gaudio_free(context->property_value_buffer);
+    gaudio_free(context->array_index_value);
+    gaudio_free(context->property_name_buffer);
+    gaudio_free(context->instance_name_buffer);
+    gaudio_free(context->type_name_buffer);
     
-    free(context);
+    gaudio_free(context);
 
     TRACE_LEAVE(__func__)
 }
@@ -2194,7 +2204,7 @@ static void resolve_references_sound(struct InstParseContext *context, struct AL
 
             sound->wavetable = wavetable;
             ALWaveTable_add_parent(wavetable, sound);
-            wavetable->visited = 1;
+            wavetable->visited_generation = context->visit_generation;
 
             // dependency is satisfied, so free memory
             MissingRef_free(ref);
@@ -2233,7 +2243,7 @@ static void resolve_references_sound(struct InstParseContext *context, struct AL
 
             sound->envelope = envelope;
             ALEnvelope_add_parent(envelope, sound);
-            envelope->visited = 1;
+            envelope->visited_generation = context->visit_generation;
 
             // dependency is satisfied, so free memory
             MissingRef_free(ref);
@@ -2271,7 +2281,7 @@ static void resolve_references_sound(struct InstParseContext *context, struct AL
 
             sound->keymap = keymap;
             ALKeyMap_add_parent(keymap, sound);
-            keymap->visited = 1;
+            keymap->visited_generation = context->visit_generation;
 
             // dependency is satisfied, so free memory
             MissingRef_free(ref);
@@ -2352,7 +2362,7 @@ static void resolve_references_instrument(struct InstParseContext *context, stru
 
         instrument->sounds[i] = sound;
         ALSound_add_parent(sound, instrument);
-        sound->visited = 1;
+        sound->visited_generation = context->visit_generation;
 
         resolve_references_sound(context, sound);
 
@@ -2443,7 +2453,7 @@ static void resolve_references_bank(struct InstParseContext *context, struct ALB
 
         bank->instruments[i] = instrument;
         ALInstrument_add_parent(instrument, bank);
-        instrument->visited = 1;
+        instrument->visited_generation = context->visit_generation;
 
         resolve_references_instrument(context, instrument);
 
@@ -2479,6 +2489,8 @@ static void resolve_references(struct InstParseContext *context, struct ALBankFi
     int count;
     int i;
 
+    context->visit_generation = ALBankFile_begin_visit(bank_file);
+
     count = StringHashTable_count(context->orphaned_banks);
     
     bank_file->bank_count = count;
@@ -2504,6 +2516,7 @@ static void resolve_references(struct InstParseContext *context, struct ALBankFi
         }
 
         bank_file->banks[i] = bank;
+        bank->bank_file = bank_file;
 
         resolve_references_bank(context, bank);
     }
@@ -3509,7 +3522,7 @@ struct ALBankFile *ALBankFile_new_from_inst(struct FileInfo *fi)
     }
 
     // Done with reading file, can release memory.
-    free(file_contents);
+    gaudio_free(file_contents);
 
     /**
      * Iterate all the "orphaned" hash tables and resolve text ref id
@@ -3537,7 +3550,7 @@ struct ALBankFile *ALBankFile_new_from_inst(struct FileInfo *fi)
     /**
      * instruments, sounds, envelope, and keymaps are only _get from hashtable,
      * as these can be referenced more than once.
-     * Check that each item in these hash tables is marked as `visited` (used by something).
+     * Check that each item in these hash tables was visited (used by something).
     */
 
     if (StringHashTable_any(context->orphaned_instruments, StringHash_instrument_unvisited, &any_first))
@@ -0,0 +1,651 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "debug.h"
+#include "machine_config.h"
+#include "common.h"
+#include "utility.h"
+#include "llist.h"
+#include "string_hash.h"
+#include "md5.h"
+#include "naudio.h"
+#include "adpcm_aifc.h"
+#include "x.h"
+#include "pcm_cache.h"
+
+/**
+ * This file contains a cache of decoded wavetable audio.
+ * Decoding ADPCM is the expensive part of playing a sound, so anything
+ * that needs PCM for a bank sound more than once should go through here.
+*/
+
+/**
+ * Length in bytes of md5 digest.
+*/
+#define PCM_CACHE_DIGEST_LEN 16
+
+// forward declarations
+
+static uint32_t ALADPCMBook_hash(struct ALADPCMBook *book);
+static void PcmCache_make_key(struct ALWaveTable *wavetable, char *key);
+static void PcmCache_make_disk_filename(struct PcmCache *cache, struct PcmCacheEntry *entry, uint8_t *tbl_file_contents, struct ALWaveTable *wavetable, char *source_digest, char *filename);
+static void PcmCache_header_set_u32(uint8_t *buffer, uint32_t value);
+static uint32_t PcmCache_header_get_u32(const uint8_t *buffer);
+static int PcmCacheEntry_disk_load(struct PcmCacheEntry *entry, char *filename, const char *source_digest);
+static void PcmCacheEntry_disk_save(struct PcmCacheEntry *entry, char *filename, const char *source_digest);
+static void PcmCacheEntry_decode(struct PcmCacheEntry *entry, struct ALSound *sound, struct ALBank *bank, uint8_t *tbl_file_contents);
+static void PcmCacheEntry_free(struct PcmCacheEntry *entry);
+static void PcmCache_trim(struct PcmCache *cache);
+
+// end forward declarations
+
+/**
+ * Allocates memory for a new cache.
+ * @param max_bytes: memory budget in bytes for decoded audio. If zero, the default is used.
+ * @param disk_dir: Optional. Directory to save decoded audio in. Will be created if it doesn't exist.
+ * @returns: pointer to new cache.
+*/
+struct PcmCache *PcmCache_new(size_t max_bytes, const char *disk_dir)
+{
+    TRACE_ENTER(__func__)
+
+    struct PcmCache *cache = (struct PcmCache *)malloc_zero(1, sizeof(struct PcmCache));
+
+    cache->max_bytes = max_bytes > 0 ? max_bytes : PCM_CACHE_DEFAULT_MAX_BYTES;
+    cache->entries = StringHashTable_new();
+    cache->lru = LinkedList_new();
+
+    if (disk_dir != NULL && disk_dir[0] != '\0')
+    {
+        size_t len = strlen(disk_dir);
+
+        cache->disk_dir = (char *)malloc_zero(len + 1, 1);
+        memcpy(cache->disk_dir, disk_dir, len);
+
+        // remove trailing separator, it's added back when building filenames.
+        if (len > 1 && cache->disk_dir[len - 1] == PATH_SEPERATOR)
+        {
+            cache->disk_dir[len - 1] = '\0';
+        }
+
+        mkpath(cache->disk_dir);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return cache;
+}
+
+/**
+ * Frees memory allocated to cache and all entries.
+ * Entries should be released before the cache is freed.
+ * @param cache: object to free.
+*/
+void PcmCache_free(struct PcmCache *cache)
+{
+    TRACE_ENTER(__func__)
+
+    struct LinkedListNode *node;
+
+    if (cache == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    node = cache->lru->head;
+    while (node != NULL)
+    {
+        PcmCacheEntry_free((struct PcmCacheEntry *)node->data);
+        node->data = NULL;
+        node = node->next;
+    }
+
+    LinkedList_free(cache->lru);
+    StringHashTable_free(cache->entries);
+
+    if (cache->disk_dir != NULL)
+    {
+        gaudio_free(cache->disk_dir);
+    }
+
+    gaudio_free(cache);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Gets the decoded audio for a sound. If the wavetable isn't in memory it is loaded from
+ * the disk cache, or else decoded (and saved to the disk cache).
+ * The entry is in use until {@code PcmCache_release} is called.
+ * @param cache: cache.
+ * @param sound: sound to get audio for. Must have a wavetable.
+ * @param bank: bank the sound belongs to.
+ * @param tbl_file_contents: .tbl file contents for the bank.
+ * @returns: cache entry.
+*/
+struct PcmCacheEntry *PcmCache_get(struct PcmCache *cache, struct ALSound *sound, struct ALBank *bank, uint8_t *tbl_file_contents)
+{
+    TRACE_ENTER(__func__)
+
+    struct PcmCacheEntry *entry;
+    char key[PCM_CACHE_KEY_LEN];
+    char filename[MAX_FILENAME_LEN];
+    char source_digest[PCM_CACHE_DIGEST_LEN];
+    int loaded = 0;
+
+    if (cache == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> cache is NULL\n", __func__, __LINE__);
+    }
+
+    if (sound == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> sound is NULL\n", __func__, __LINE__);
+    }
+
+    if (sound->wavetable == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> sound->wavetable is NULL\n", __func__, __LINE__);
+    }
+
+    if (tbl_file_contents == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> tbl_file_contents is NULL\n", __func__, __LINE__);
+    }
+
+    PcmCache_make_key(sound->wavetable, key);
+
+    if (StringHashTable_contains(cache->entries, key))
+    {
+        entry = (struct PcmCacheEntry *)StringHashTable_get(cache->entries, key);
+
+        // move to most recently used
+        LinkedListNode_detach(cache->lru, entry->lru_node);
+        LinkedList_append_node(cache->lru, entry->lru_node);
+
+        entry->ref_count++;
+        cache->hits++;
+
+        TRACE_LEAVE(__func__)
+        return entry;
+    }
+
+    entry = (struct PcmCacheEntry *)malloc_zero(1, sizeof(struct PcmCacheEntry));
+    memcpy(entry->key, key, PCM_CACHE_KEY_LEN);
+
+    if (cache->disk_dir != NULL)
+    {
+        PcmCache_make_disk_filename(cache, entry, tbl_file_contents, sound->wavetable, source_digest, filename);
+        loaded = PcmCacheEntry_disk_load(entry, filename, source_digest);
+    }
+
+    if (loaded)
+    {
+        cache->disk_hits++;
+    }
+    else
+    {
+        PcmCacheEntry_decode(entry, sound, bank, tbl_file_contents);
+        cache->misses++;
+
+        if (cache->disk_dir != NULL)
+        {
+            PcmCacheEntry_disk_save(entry, filename, source_digest);
+        }
+    }
+
+    entry->ref_count = 1;
+    entry->lru_node = LinkedListNode_new();
+    entry->lru_node->data = entry;
+    LinkedList_append_node(cache->lru, entry->lru_node);
+    StringHashTable_add(cache->entries, entry->key, entry);
+
+    cache->used_bytes += entry->num_samples * sizeof(int16_t);
+
+    PcmCache_trim(cache);
+
+    TRACE_LEAVE(__func__)
+
+    return entry;
+}
+
+/**
+ * Marks the entry as no longer in use by the caller. Once all users have
+ * released the entry it can be evicted.
+ * @param cache: cache the entry belongs to.
+ * @param entry: entry to release.
+*/
+void PcmCache_release(struct PcmCache *cache, struct PcmCacheEntry *entry)
+{
+    TRACE_ENTER(__func__)
+
+    if (cache == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> cache is NULL\n", __func__, __LINE__);
+    }
+
+    if (entry == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> entry is NULL\n", __func__, __LINE__);
+    }
+
+    if (entry->ref_count > 0)
+    {
+        entry->ref_count--;
+    }
+
+    PcmCache_trim(cache);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Hashes codebook contents.
+ * @param book: codebook. Optional.
+ * @returns: hash, or zero if book is NULL.
+*/
+static uint32_t ALADPCMBook_hash(struct ALADPCMBook *book)
+{
+    TRACE_ENTER(__func__)
+
+    char digest[PCM_CACHE_DIGEST_LEN];
+    uint8_t *buffer;
+    size_t book_bytes;
+    uint32_t result;
+
+    if (book == NULL || book->book == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return 0;
+    }
+
+    book_bytes = (size_t)book->order * (size_t)book->npredictors * 8 * sizeof(int16_t);
+
+    buffer = (uint8_t *)malloc_zero(book_bytes + 8, 1);
+    memcpy(&buffer[0], &book->order, 4);
+    memcpy(&buffer[4], &book->npredictors, 4);
+    memcpy(&buffer[8], book->book, book_bytes);
+
+    md5_hash((char *)buffer, book_bytes + 8, digest);
+    memcpy(&result, digest, 4);
+
+    gaudio_free(buffer);
+
+    TRACE_LEAVE(__func__)
+
+    return result;
+}
+
+/**
+ * Builds cache key for a wavetable.
+ * @param wavetable: wavetable.
+ * @param key: out parameter. Must be at least {@code PCM_CACHE_KEY_LEN} bytes.
+*/
+static void PcmCache_make_key(struct ALWaveTable *wavetable, char *key)
+{
+    TRACE_ENTER(__func__)
+
+    uint32_t book_hash = 0;
+
+    if (wavetable->type == AL_ADPCM_WAVE)
+    {
+        book_hash = ALADPCMBook_hash(wavetable->wave_info.adpcm_wave.book);
+    }
+
+    snprintf(key, PCM_CACHE_KEY_LEN, "%08x-%08x-%d-%08x", (uint32_t)wavetable->base, (uint32_t)wavetable->len, wavetable->type, book_hash);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Builds filename in the disk cache directory for an entry. The filename
+ * is the entry key plus a hash of the wavetable data in the .tbl file.
+ * @param cache: cache.
+ * @param entry: entry with key set.
+ * @param tbl_file_contents: .tbl file contents.
+ * @param wavetable: wavetable.
+ * @param source_digest: out parameter. Hash of the wavetable data. Must be at least {@code PCM_CACHE_DIGEST_LEN} bytes.
+ * @param filename: out parameter. Must be at least {@code MAX_FILENAME_LEN} bytes.
+*/
+static void PcmCache_make_disk_filename(struct PcmCache *cache, struct PcmCacheEntry *entry, uint8_t *tbl_file_contents, struct ALWaveTable *wavetable, char *source_digest, char *filename)
+{
+    TRACE_ENTER(__func__)
+
+    char digest_text[PCM_CACHE_DIGEST_LEN * 2 + 1];
+    int i;
+
+    memset(source_digest, 0, PCM_CACHE_DIGEST_LEN);
+
+    if (wavetable->len > 0)
+    {
+        md5_hash((char *)&tbl_file_contents[wavetable->base], (size_t)wavetable->len, source_digest);
+    }
+
+    for (i=0; i<PCM_CACHE_DIGEST_LEN; i++)
+    {
+        sprintf(&digest_text[i * 2], "%02x", (uint8_t)source_digest[i]);
+    }
+
+    if (snprintf(filename, MAX_FILENAME_LEN, "%s%c%s-%s%s", cache->disk_dir, PATH_SEPERATOR, entry->key, digest_text, PCM_CACHE_FILE_EXTENSION) >= MAX_FILENAME_LEN)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> cache filename too long, cache dir: %s\n", __func__, __LINE__, cache->disk_dir);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Writes little endian 32 bit value to disk cache file header.
+ * @param buffer: position in header to write to.
+ * @param value: value to write.
+*/
+static void PcmCache_header_set_u32(uint8_t *buffer, uint32_t value)
+{
+    TRACE_ENTER(__func__)
+
+    buffer[0] = (uint8_t)(value & 0xff);
+    buffer[1] = (uint8_t)((value >> 8) & 0xff);
+    buffer[2] = (uint8_t)((value >> 16) & 0xff);
+    buffer[3] = (uint8_t)((value >> 24) & 0xff);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Reads little endian 32 bit value from disk cache file header.
+ * @param buffer: position in header to read from.
+ * @returns: value.
+*/
+static uint32_t PcmCache_header_get_u32(const uint8_t *buffer)
+{
+    TRACE_ENTER(__func__)
+
+    uint32_t result = (uint32_t)buffer[0]
+        | ((uint32_t)buffer[1] << 8)
+        | ((uint32_t)buffer[2] << 16)
+        | ((uint32_t)buffer[3] << 24);
+
+    TRACE_LEAVE(__func__)
+
+    return result;
+}
+
+/**
+ * Loads decoded audio from disk cache. The file header is checked against
+ * the source wavetable data and the file contents; if anything doesn't match
+ * the file is ignored (and will be replaced after the audio is decoded again).
+ * @param entry: entry to load into.
+ * @param filename: disk cache file.
+ * @param source_digest: hash of the wavetable data, see {@code PcmCache_make_disk_filename}.
+ * @returns: 1 if loaded, 0 if the file doesn't exist or isn't valid.
+*/
+static int PcmCacheEntry_disk_load(struct PcmCacheEntry *entry, char *filename, const char *source_digest)
+{
+    TRACE_ENTER(__func__)
+
+    struct stat st;
+    struct FileInfo *fi;
+    uint8_t *file_contents;
+    size_t file_len;
+    size_t num_samples;
+    char digest[PCM_CACHE_DIGEST_LEN];
+    const char *reason = NULL;
+
+    if (stat(filename, &st) != 0)
+    {
+        TRACE_LEAVE(__func__)
+        return 0;
+    }
+
+    file_len = (size_t)st.st_size;
+
+    if (file_len < PCM_CACHE_FILE_HEADER_SIZE)
+    {
+        fflush_printf(stderr, "%s %d> warning, ignoring disk cache file %s: too short\n", __func__, __LINE__, filename);
+
+        TRACE_LEAVE(__func__)
+        return 0;
+    }
+
+    file_contents = (uint8_t *)malloc_zero(file_len, 1);
+
+    fi = FileInfo_fopen(filename, "rb");
+    FileInfo_fread(fi, file_contents, file_len, 1);
+    FileInfo_free(fi);
+
+    num_samples = (size_t)PcmCache_header_get_u32(&file_contents[8]);
+
+    if (memcmp(&file_contents[0], PCM_CACHE_FILE_ID, 4) != 0)
+    {
+        reason = "invalid file id";
+    }
+    else if (PcmCache_header_get_u32(&file_contents[4]) != PCM_CACHE_FILE_VERSION)
+    {
+        reason = "unsupported version";
+    }
+    else if (num_samples == 0 || file_len != PCM_CACHE_FILE_HEADER_SIZE + (num_samples * sizeof(int16_t)))
+    {
+        reason = "length doesn't match header";
+    }
+    else if (memcmp(&file_contents[16], source_digest, PCM_CACHE_DIGEST_LEN) != 0)
+    {
+        reason = "source data doesn't match";
+    }
+    else
+    {
+        md5_hash((char *)&file_contents[PCM_CACHE_FILE_HEADER_SIZE], num_samples * sizeof(int16_t), digest);
+
+        if (memcmp(&file_contents[32], digest, PCM_CACHE_DIGEST_LEN) != 0)
+        {
+            reason = "checksum doesn't match";
+        }
+    }
+
+    if (reason != NULL)
+    {
+        fflush_printf(stderr, "%s %d> warning, ignoring disk cache file %s: %s\n", __func__, __LINE__, filename, reason);
+        gaudio_free(file_contents);
+
+        TRACE_LEAVE(__func__)
+        return 0;
+    }
+
+    entry->num_samples = num_samples;
+    entry->samples = (int16_t *)malloc_zero(entry->num_samples, sizeof(int16_t));
+    memcpy(entry->samples, &file_contents[PCM_CACHE_FILE_HEADER_SIZE], num_samples * sizeof(int16_t));
+
+    gaudio_free(file_contents);
+
+#ifdef __sgi
+    // disk cache is little endian
+    bswap16_chunk(entry->samples, entry->samples, entry->num_samples);
+#endif
+
+    if (g_verbosity >= VERBOSE_DEBUG)
+    {
+        printf("%s: loaded %s\n", __func__, filename);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return 1;
+}
+
+/**
+ * Saves decoded audio to disk cache. The file is written under a temporary
+ * name then renamed, so a partial file is never read.
+ * @param entry: entry to save.
+ * @param filename: disk cache file.
+ * @param source_digest: hash of the wavetable data, see {@code PcmCache_make_disk_filename}.
+*/
+static void PcmCacheEntry_disk_save(struct PcmCacheEntry *entry, char *filename, const char *source_digest)
+{
+    TRACE_ENTER(__func__)
+
+    struct FileInfo *fi;
+    char temp_filename[MAX_FILENAME_LEN + 8];
+    uint8_t *file_contents;
+    size_t data_len;
+
+    if (entry->num_samples == 0)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    data_len = entry->num_samples * sizeof(int16_t);
+    file_contents = (uint8_t *)malloc_zero(PCM_CACHE_FILE_HEADER_SIZE + data_len, 1);
+
+#ifdef __sgi
+    // disk cache is little endian
+    bswap16_chunk(&file_contents[PCM_CACHE_FILE_HEADER_SIZE], entry->samples, entry->num_samples);
+#else
+    memcpy(&file_contents[PCM_CACHE_FILE_HEADER_SIZE], entry->samples, data_len);
+#endif
+
+    memcpy(&file_contents[0], PCM_CACHE_FILE_ID, 4);
+    PcmCache_header_set_u32(&file_contents[4], PCM_CACHE_FILE_VERSION);
+    PcmCache_header_set_u32(&file_contents[8], (uint32_t)entry->num_samples);
+    memcpy(&file_contents[16], source_digest, PCM_CACHE_DIGEST_LEN);
+    md5_hash((char *)&file_contents[PCM_CACHE_FILE_HEADER_SIZE], data_len, (char *)&file_contents[32]);
+
+    snprintf(temp_filename, MAX_FILENAME_LEN + 8, "%s.tmp", filename);
+
+    fi = FileInfo_fopen(temp_filename, "wb");
+    FileInfo_fwrite(fi, file_contents, PCM_CACHE_FILE_HEADER_SIZE + data_len, 1);
+    FileInfo_free(fi);
+
+    gaudio_free(file_contents);
+
+    if (rename(temp_filename, filename) != 0)
+    {
+        fflush_printf(stderr, "%s %d> warning, could not rename %s to %s\n", __func__, __LINE__, temp_filename, filename);
+        remove(temp_filename);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Decodes wavetable audio for a sound into the entry.
+ * Audio is decoded straight through, loop points are left to the caller.
+ * @param entry: entry to decode into.
+ * @param sound: sound.
+ * @param bank: bank the sound belongs to.
+ * @param tbl_file_contents: .tbl file contents.
+*/
+static void PcmCacheEntry_decode(struct PcmCacheEntry *entry, struct ALSound *sound, struct ALBank *bank, uint8_t *tbl_file_contents)
+{
+    TRACE_ENTER(__func__)
+
+    struct AdpcmAifcFile *aaf;
+    struct AdpcmAifcLoopChunk *loop_chunk;
+    size_t buffer_len;
+    size_t decode_len;
+
+    if (sound->wavetable->len <= 0)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    aaf = AdpcmAifcFile_new_full(sound, bank);
+    load_aifc_from_sound(aaf, sound, tbl_file_contents, bank);
+
+    // Decode straight through. The loop chunk is still owned by
+    // the chunk list, so it's freed normally.
+    loop_chunk = aaf->loop_chunk;
+    aaf->loop_chunk = NULL;
+
+    buffer_len = AdpcmAifcFile_estimate_inflate_size(aaf);
+    entry->samples = (int16_t *)malloc_zero(buffer_len + sizeof(int16_t), 1);
+
+    decode_len = AdpcmAifcFile_decode(aaf, (uint8_t *)entry->samples, buffer_len);
+    entry->num_samples = decode_len / sizeof(int16_t);
+
+    aaf->loop_chunk = loop_chunk;
+    AdpcmAifcFile_free(aaf);
+
+    if (g_verbosity >= VERBOSE_DEBUG)
+    {
+        printf("%s: decoded %s, %ld samples\n", __func__, entry->key, (long)entry->num_samples);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Frees memory allocated to entry.
+ * @param entry: object to free.
+*/
+static void PcmCacheEntry_free(struct PcmCacheEntry *entry)
+{
+    TRACE_ENTER(__func__)
+
+    if (entry == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    if (entry->samples != NULL)
+    {
+        gaudio_free(entry->samples);
+    }
+
+    gaudio_free(entry);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Evicts least recently used entries that aren't in use until
+ * the cache is within the memory budget.
+ * @param cache: cache.
+*/
+static void PcmCache_trim(struct PcmCache *cache)
+{
+    TRACE_ENTER(__func__)
+
+    struct LinkedListNode *node = cache->lru->head;
+
+    while (node != NULL && cache->used_bytes > cache->max_bytes)
+    {
+        struct LinkedListNode *next = node->next;
+        struct PcmCacheEntry *entry = (struct PcmCacheEntry *)node->data;
+
+        if (entry->ref_count == 0)
+        {
+            cache->used_bytes -= entry->num_samples * sizeof(int16_t);
+            cache->evictions++;
+
+            StringHashTable_pop(cache->entries, entry->key);
+            LinkedListNode_free(cache->lru, node);
+            PcmCacheEntry_free(entry);
+        }
+
+        node = next;
+    }
+
+    TRACE_LEAVE(__func__)
+}
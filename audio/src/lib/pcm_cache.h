@@ -0,0 +1,159 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#ifndef _GAUDIO_PCM_CACHE_H_
+#define _GAUDIO_PCM_CACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "llist.h"
+#include "string_hash.h"
+#include "naudio.h"
+
+/**
+ * This file contains structs and defines for caching decoded wavetable audio.
+*/
+
+/**
+ * Default memory budget in bytes for decoded audio.
+*/
+#define PCM_CACHE_DEFAULT_MAX_BYTES (64 * 1024 * 1024)
+
+/**
+ * Max length of cache key, including terminating zero.
+*/
+#define PCM_CACHE_KEY_LEN 40
+
+/**
+ * Extension of decoded audio files in the disk cache directory.
+*/
+#define PCM_CACHE_FILE_EXTENSION ".pcm"
+
+/**
+ * Disk cache file id, first four bytes of file.
+*/
+#define PCM_CACHE_FILE_ID "GPCM"
+
+/**
+ * Disk cache file format version. Files with a different version are decoded again.
+*/
+#define PCM_CACHE_FILE_VERSION 1
+
+/**
+ * Size in bytes of disk cache file header:
+ *     char[4] id, uint32 version, uint32 number of samples, uint32 reserved (zero),
+ *     md5 of source wavetable data, md5 of samples.
+ * Header values are little endian.
+*/
+#define PCM_CACHE_FILE_HEADER_SIZE 48
+
+/**
+ * Single decoded wavetable.
+*/
+struct PcmCacheEntry {
+    /**
+     * Cache key. Built from wavetable base, len, type and codebook hash.
+    */
+    char key[PCM_CACHE_KEY_LEN];
+
+    /**
+     * Decoded audio, 16 bit, host byte order.
+     * Decoded straight through, loop points are not applied.
+    */
+    int16_t *samples;
+
+    /**
+     * Number of samples in {@code samples}.
+    */
+    size_t num_samples;
+
+    /**
+     * Number of users of this entry. Entries in use are never evicted.
+    */
+    int ref_count;
+
+    /**
+     * Node in the cache LRU list.
+    */
+    struct LinkedListNode *lru_node;
+};
+
+/**
+ * Decoded audio cache. Entries are kept in memory until the total size exceeds
+ * the budget, then the least recently used entries (not in use) are evicted.
+ * If a directory is set, decoded audio is also saved to (and loaded from) disk
+ * as little endian 16 bit PCM, after a short header. A disk cache file that doesn't
+ * match the header (wrong version, length, or source data) is ignored.
+ *
+ * The in-memory key doesn't include the .tbl file, so a cache should
+ * only be used with a single .tbl file. Files in the disk cache also include
+ * a hash of the source data in the name, so a disk cache directory can be shared.
+*/
+struct PcmCache {
+    /**
+     * Memory budget in bytes.
+    */
+    size_t max_bytes;
+
+    /**
+     * Current size in bytes of all decoded audio in memory.
+    */
+    size_t used_bytes;
+
+    /**
+     * Optional. Directory for the disk cache.
+    */
+    char *disk_dir;
+
+    /**
+     * Lookup, key is {@code struct PcmCacheEntry} key.
+    */
+    struct StringHashTable *entries;
+
+    /**
+     * List of {@code struct PcmCacheEntry}, least recently used first.
+    */
+    struct LinkedList *lru;
+
+    /**
+     * Number of lookups found in memory.
+    */
+    int hits;
+
+    /**
+     * Number of lookups loaded from disk cache.
+    */
+    int disk_hits;
+
+    /**
+     * Number of lookups that required decoding.
+    */
+    int misses;
+
+    /**
+     * Number of entries removed from memory to stay within budget.
+    */
+    int evictions;
+};
+
+struct PcmCache *PcmCache_new(size_t max_bytes, const char *disk_dir);
+void PcmCache_free(struct PcmCache *cache);
+
+struct PcmCacheEntry *PcmCache_get(struct PcmCache *cache, struct ALSound *sound, struct ALBank *bank, uint8_t *tbl_file_contents);
+void PcmCache_release(struct PcmCache *cache, struct PcmCacheEntry *entry);
+
+#endif
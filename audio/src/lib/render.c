@@ -0,0 +1,1427 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "debug.h"
+#include "machine_config.h"
+#include "common.h"
+#include "utility.h"
+#include "llist.h"
+#include "int_hash.h"
+#include "naudio.h"
+#include "midi.h"
+#include "wav.h"
+#include "pcm_cache.h"
+#include "render.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/**
+ * This file contains an offline renderer for seq files. Events from every
+ * track are merged into a single timeline, then played against the instruments
+ * in a bank. Output is 16 bit stereo PCM.
+ *
+ * This is a preview, not an emulation of the audio microcode. In particular:
+ * - wavetables are decoded once, straight through, and voices loop over
+ *   the decoded samples. The ADPCM loop state is not used.
+ * - seq loop markers are ignored, the (unrolled) track is played once.
+ * - resampling is linear interpolation.
+*/
+
+/**
+ * Internal event types. Declared in the order events at the same tick are applied.
+*/
+enum RENDER_EVENT_TYPE {
+    RENDER_EVENT_NOTE_OFF = 0,
+    RENDER_EVENT_TEMPO,
+    RENDER_EVENT_PROGRAM_CHANGE,
+    RENDER_EVENT_CONTROL_CHANGE,
+    RENDER_EVENT_PITCH_BEND,
+    RENDER_EVENT_NOTE_ON,
+
+    /**
+     * Doesn't change state, but output is rendered at least until end of track.
+    */
+    RENDER_EVENT_END_OF_TRACK
+};
+
+enum RENDER_ENVELOPE_PHASE {
+    RENDER_ENVELOPE_ATTACK = 0,
+    RENDER_ENVELOPE_DECAY,
+    RENDER_ENVELOPE_SUSTAIN,
+    RENDER_ENVELOPE_RELEASE,
+    RENDER_ENVELOPE_DONE
+};
+
+/**
+ * Single event in the merged timeline.
+*/
+struct RenderEvent {
+    /**
+     * Absolute time in ticks.
+    */
+    long tick;
+
+    /**
+     * {@code enum RENDER_EVENT_TYPE}.
+    */
+    int type;
+
+    /**
+     * Order the event was added in, to keep sort stable.
+    */
+    int sequence;
+
+    int channel;
+
+    /**
+     * Note, controller, program, tempo or pitch bend value, depending on type.
+    */
+    int param1;
+
+    /**
+     * Velocity or controller value, depending on type.
+    */
+    int param2;
+};
+
+/**
+ * Decoded wavetable. One per wavetable, shared by all voices playing it.
+*/
+struct RenderSample {
+    /**
+     * Cache the decoded audio belongs to.
+    */
+    struct PcmCache *cache;
+
+    /**
+     * Cache entry, held until the render is complete.
+    */
+    struct PcmCacheEntry *entry;
+
+    /**
+     * Decoded audio, host byte order. Owned by {@code entry}.
+    */
+    int16_t *samples;
+
+    int32_t num_samples;
+
+    /**
+     * Loop start sample. Only valid if {@code loop_count} is non zero.
+    */
+    int32_t loop_start;
+
+    /**
+     * Loop end sample. Only valid if {@code loop_count} is non zero.
+    */
+    int32_t loop_end;
+
+    /**
+     * Number of times to loop, -1 is infinite, zero is no loop.
+    */
+    int32_t loop_count;
+};
+
+/**
+ * Current state of a MIDI channel.
+*/
+struct RenderChannel {
+    struct ALInstrument *instrument;
+    int volume;
+    int pan;
+    int sustain;
+
+    /**
+     * Pitch bend in cents, already scaled by instrument bend range.
+    */
+    double bend_cents;
+};
+
+/**
+ * Single playing note.
+*/
+struct RenderVoice {
+    int active;
+    int channel;
+    int note;
+
+    /**
+     * Note-off was received while the sustain pedal was down.
+    */
+    int sustained;
+
+    /**
+     * Order the voice was started in, oldest voice is stolen first.
+    */
+    long start_order;
+
+    struct ALSound *sound;
+    struct RenderSample *sample;
+
+    /**
+     * Current read position in {@code sample}, in samples.
+    */
+    double position;
+
+    /**
+     * Pitch in cents, relative to the wavetable keybase, without pitch bend.
+    */
+    double cents;
+
+    /**
+     * Number of samples to advance per output sample.
+    */
+    double step;
+
+    int loops_remaining;
+
+    /**
+     * Velocity and sound volume, range 0-1.
+    */
+    float gain;
+
+    /**
+     * {@code enum RENDER_ENVELOPE_PHASE}.
+    */
+    int env_phase;
+    float env_level;
+    float env_delta;
+    long env_remaining;
+};
+
+/**
+ * Renderer state.
+*/
+struct Renderer {
+    struct ALBank *bank;
+    uint8_t *tbl_file_contents;
+
+    int sample_rate;
+    int max_voices;
+
+    /**
+     * Wavetable sample rate divided by output sample rate.
+    */
+    double rate_ratio;
+
+    /**
+     * Decoded audio source.
+    */
+    struct PcmCache *pcm_cache;
+
+    /**
+     * Decoded wavetables used by this render, key is wavetable id.
+    */
+    struct IntHashTable *samples;
+
+    struct RenderChannel channels[RENDER_NUM_MIDI_CHANNELS];
+    struct RenderVoice *voices;
+    long voice_counter;
+
+    /**
+     * Gain applied to left and right channels by pan position.
+    */
+    float pan_left[128];
+    float pan_right[128];
+
+    /**
+     * Block buffers.
+    */
+    float *voice_buffer;
+    float *mix_left;
+    float *mix_right;
+
+    /**
+     * Output, interleaved 16 bit stereo.
+    */
+    int16_t *output;
+    size_t output_max_samples;
+    size_t output_pos;
+};
+
+// forward declarations
+
+static struct RenderEvent *RenderEvent_list_from_cseq(struct CseqFile *cseq, size_t *num_events);
+static int RenderEvent_compare(const void *first, const void *second);
+static double render_samples_per_tick(int tempo, int division, int sample_rate);
+static struct RenderSample *Renderer_get_sample(struct Renderer *renderer, struct ALSound *sound);
+static void RenderSample_free(void *data);
+static void Renderer_apply_event(struct Renderer *renderer, struct RenderEvent *event);
+static void Renderer_note_on(struct Renderer *renderer, int channel, int note, int velocity);
+static void Renderer_note_off(struct Renderer *renderer, int channel, int note);
+static struct RenderVoice *Renderer_allocate_voice(struct Renderer *renderer);
+static void RenderVoice_set_step(struct Renderer *renderer, struct RenderVoice *voice);
+static void RenderVoice_release(struct RenderVoice *voice);
+static void RenderVoice_next_envelope_phase(struct RenderVoice *voice, int sample_rate);
+static void RenderVoice_set_ramp(struct RenderVoice *voice, float target, int32_t time_usec, int sample_rate);
+static int RenderVoice_render(struct RenderVoice *voice, float *buffer, int len, int sample_rate);
+static int Renderer_any_active(struct Renderer *renderer);
+static void Renderer_render_until(struct Renderer *renderer, size_t end_sample);
+
+// end forward declarations
+
+/**
+ * Allocates memory for a new {@code struct RenderOptions} and sets default values.
+ * @returns: pointer to new object.
+*/
+struct RenderOptions *RenderOptions_new(void)
+{
+    TRACE_ENTER(__func__)
+
+    struct RenderOptions *options = (struct RenderOptions *)malloc_zero(1, sizeof(struct RenderOptions));
+
+    options->max_voices = RENDER_DEFAULT_MAX_VOICES;
+    options->tail_ms = RENDER_DEFAULT_TAIL_MS;
+
+    TRACE_LEAVE(__func__)
+
+    return options;
+}
+
+/**
+ * Frees memory allocated to options.
+ * @param options: object to free.
+*/
+void RenderOptions_free(struct RenderOptions *options)
+{
+    TRACE_ENTER(__func__)
+
+    if (options == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    gaudio_free(options);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Plays a seq against a bank and returns the rendered audio as a wav file.
+ * This is the main entry point for rendering.
+ * @param cseq: seq to play. Track offsets and lengths must be set (e.g., read from file).
+ * @param bank_file: bank file containing instruments.
+ * @param tbl_file_contents: .tbl file contents for the bank.
+ * @param options: Optional. Render options, defaults are used if NULL.
+ * @returns: pointer to new wav file, 16 bit stereo.
+*/
+struct WavFile *WavFile_new_from_cseq(struct CseqFile *cseq, struct ALBankFile *bank_file, uint8_t *tbl_file_contents, struct RenderOptions *options)
+{
+    TRACE_ENTER(__func__)
+
+    struct Renderer renderer;
+    struct RenderEvent *events;
+    struct WavFile *wav;
+    size_t num_events = 0;
+    size_t i;
+    int bank_index = 0;
+    int bank_sample_rate;
+    int tail_ms = RENDER_DEFAULT_TAIL_MS;
+    int tempo = RENDER_DEFAULT_TEMPO;
+    long current_tick = 0;
+    double samples_per_tick;
+    double current_time;
+    size_t tail_samples;
+    size_t data_size;
+
+    if (cseq == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> cseq is NULL\n", __func__, __LINE__);
+    }
+
+    if (bank_file == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> bank_file is NULL\n", __func__, __LINE__);
+    }
+
+    if (tbl_file_contents == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> tbl_file_contents is NULL\n", __func__, __LINE__);
+    }
+
+    if (cseq->division <= 0)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid seq division: %d\n", __func__, __LINE__, cseq->division);
+    }
+
+    memset(&renderer, 0, sizeof(struct Renderer));
+
+    renderer.max_voices = RENDER_DEFAULT_MAX_VOICES;
+
+    if (options != NULL)
+    {
+        bank_index = options->bank_index;
+        renderer.sample_rate = options->sample_rate;
+        tail_ms = options->tail_ms;
+
+        if (options->max_voices > 0)
+        {
+            renderer.max_voices = options->max_voices;
+        }
+    }
+
+    if (bank_index < 0 || bank_index >= bank_file->bank_count || bank_file->banks[bank_index] == NULL)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid bank index %d, bank count=%d\n", __func__, __LINE__, bank_index, bank_file->bank_count);
+    }
+
+    if (renderer.max_voices > RENDER_MAX_VOICES)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> max voices %d exceeds max supported %d\n", __func__, __LINE__, renderer.max_voices, RENDER_MAX_VOICES);
+    }
+
+    renderer.bank = bank_file->banks[bank_index];
+    renderer.tbl_file_contents = tbl_file_contents;
+
+    bank_sample_rate = renderer.bank->sample_rate;
+
+    if (bank_sample_rate <= 0)
+    {
+        if (g_verbosity >= VERBOSE_DEBUG)
+        {
+            printf("%s: bank sample rate not set, using %d\n", __func__, RENDER_DEFAULT_SAMPLE_RATE);
+        }
+
+        bank_sample_rate = RENDER_DEFAULT_SAMPLE_RATE;
+    }
+
+    if (renderer.sample_rate <= 0)
+    {
+        renderer.sample_rate = bank_sample_rate;
+    }
+
+    renderer.rate_ratio = (double)bank_sample_rate / (double)renderer.sample_rate;
+    renderer.samples = IntHashTable_new();
+
+    if (options != NULL && options->pcm_cache != NULL)
+    {
+        renderer.pcm_cache = options->pcm_cache;
+    }
+    else
+    {
+        renderer.pcm_cache = PcmCache_new(0, NULL);
+    }
+    renderer.voices = (struct RenderVoice *)malloc_zero(renderer.max_voices, sizeof(struct RenderVoice));
+    renderer.voice_buffer = (float *)malloc_zero(RENDER_BLOCK_LEN, sizeof(float));
+    renderer.mix_left = (float *)malloc_zero(RENDER_BLOCK_LEN, sizeof(float));
+    renderer.mix_right = (float *)malloc_zero(RENDER_BLOCK_LEN, sizeof(float));
+
+    for (i=0; i<RENDER_NUM_MIDI_CHANNELS; i++)
+    {
+        renderer.channels[i].volume = 127;
+        renderer.channels[i].pan = 64;
+
+        if (renderer.bank->inst_count > 0 && renderer.bank->instruments != NULL)
+        {
+            renderer.channels[i].instrument = renderer.bank->instruments[0];
+        }
+    }
+
+    // equal power pan law.
+    for (i=0; i<128; i++)
+    {
+        double angle = ((double)i / 127.0) * (M_PI / 2.0);
+        renderer.pan_left[i] = (float)cos(angle);
+        renderer.pan_right[i] = (float)sin(angle);
+    }
+
+    events = RenderEvent_list_from_cseq(cseq, &num_events);
+
+    // The output length depends on the tempo map, so walk the events once
+    // to find the time of the last event.
+    samples_per_tick = render_samples_per_tick(tempo, cseq->division, renderer.sample_rate);
+    current_time = 0;
+    for (i=0; i<num_events; i++)
+    {
+        current_time += (double)(events[i].tick - current_tick) * samples_per_tick;
+        current_tick = events[i].tick;
+
+        if (events[i].type == RENDER_EVENT_TEMPO && events[i].param1 > 0)
+        {
+            samples_per_tick = render_samples_per_tick(events[i].param1, cseq->division, renderer.sample_rate);
+        }
+    }
+
+    tail_samples = tail_ms > 0 ? ((size_t)tail_ms * (size_t)renderer.sample_rate) / 1000 : 0;
+    renderer.output_max_samples = (size_t)current_time + 1 + tail_samples;
+    renderer.output = (int16_t *)malloc_zero(renderer.output_max_samples * RENDER_NUM_OUTPUT_CHANNELS, sizeof(int16_t));
+
+    // now play the events.
+    current_tick = 0;
+    current_time = 0;
+    samples_per_tick = render_samples_per_tick(tempo, cseq->division, renderer.sample_rate);
+    for (i=0; i<num_events; i++)
+    {
+        if (events[i].tick > current_tick)
+        {
+            current_time += (double)(events[i].tick - current_tick) * samples_per_tick;
+            current_tick = events[i].tick;
+
+            Renderer_render_until(&renderer, (size_t)current_time);
+        }
+
+        if (events[i].type == RENDER_EVENT_TEMPO && events[i].param1 > 0)
+        {
+            samples_per_tick = render_samples_per_tick(events[i].param1, cseq->division, renderer.sample_rate);
+        }
+
+        Renderer_apply_event(&renderer, &events[i]);
+    }
+
+    // let release envelopes finish, up to the tail length.
+    while (renderer.output_pos < renderer.output_max_samples && Renderer_any_active(&renderer))
+    {
+        Renderer_render_until(&renderer, renderer.output_pos + RENDER_BLOCK_LEN);
+    }
+
+    if (g_verbosity >= VERBOSE_DEBUG)
+    {
+        printf("%s: %ld events, %ld samples rendered at %d Hz\n", __func__, (long)num_events, (long)renderer.output_pos, renderer.sample_rate);
+    }
+
+    // wav container takes ownership of output buffer
+    data_size = renderer.output_pos * RENDER_NUM_OUTPUT_CHANNELS * sizeof(int16_t);
+
+    wav = WavFile_new(WAV_DEFAULT_NUM_CHUNKS);
+
+    wav->fmt_chunk = WavFmtChunk_new();
+    wav->chunks[0] = wav->fmt_chunk;
+
+    wav->fmt_chunk->audio_format = WAV_AUDIO_FORMAT;
+    wav->fmt_chunk->num_channels = RENDER_NUM_OUTPUT_CHANNELS;
+    wav->fmt_chunk->sample_rate = renderer.sample_rate;
+    wav->fmt_chunk->bits_per_sample = DEFAULT_SAMPLE_SIZE;
+    wav->fmt_chunk->byte_rate = wav->fmt_chunk->sample_rate * wav->fmt_chunk->num_channels * wav->fmt_chunk->bits_per_sample/8;
+    wav->fmt_chunk->block_align = wav->fmt_chunk->num_channels * wav->fmt_chunk->bits_per_sample/8;
+
+    wav->data_chunk = WavDataChunk_new();
+    wav->chunks[1] = wav->data_chunk;
+
+    wav->data_chunk->data = (uint8_t *)renderer.output;
+    wav->data_chunk->ck_data_size = (int32_t)data_size;
+
+    wav->ck_data_size =
+        4 + /* rest of FORM header */
+        WAV_FMT_CHUNK_FULL_SIZE + /* "fmt " chunk is const size */
+        8 + wav->data_chunk->ck_data_size; /* "data" chunk header, then data size*/
+
+    // cleanup
+    IntHashTable_foreach(renderer.samples, RenderSample_free);
+    IntHashTable_free(renderer.samples);
+
+    if (options == NULL || options->pcm_cache == NULL)
+    {
+        PcmCache_free(renderer.pcm_cache);
+    }
+    gaudio_free(renderer.voices);
+    gaudio_free(renderer.voice_buffer);
+    gaudio_free(renderer.mix_left);
+    gaudio_free(renderer.mix_right);
+    gaudio_free(events);
+
+    TRACE_LEAVE(__func__)
+
+    return wav;
+}
+
+/**
+ * Unrolls and parses every track in the seq, and merges the events
+ * needed for playback into a single list sorted by time.
+ * Note-on events get a matching note-off event from their duration.
+ * @param cseq: seq file.
+ * @param num_events: out parameter. Number of events in the list.
+ * @returns: pointer to new array of events, sorted by time.
+*/
+static struct RenderEvent *RenderEvent_list_from_cseq(struct CseqFile *cseq, size_t *num_events)
+{
+    TRACE_ENTER(__func__)
+
+    struct GmidTrack *tracks[CSEQ_FILE_NUM_TRACKS];
+    struct RenderEvent *events;
+    struct LinkedListNode *node;
+    size_t count = 0;
+    size_t pos = 0;
+    int i;
+
+    memset(tracks, 0, sizeof(tracks));
+
+    for (i=0; i<CSEQ_FILE_NUM_TRACKS; i++)
+    {
+        if (cseq->track_offset[i] == 0)
+        {
+            continue;
+        }
+
+        tracks[i] = GmidTrack_new();
+        tracks[i]->cseq_track_index = i;
+
+        CseqFile_unroll(cseq, tracks[i], NULL);
+        GmidTrack_parse_CseqTrack(tracks[i]);
+
+        // note-on events need a second slot for the note-off.
+        node = tracks[i]->events->head;
+        while (node != NULL)
+        {
+            struct GmidEvent *event = (struct GmidEvent *)node->data;
+            count += (event->command == CSEQ_COMMAND_BYTE_NOTE_ON) ? 2 : 1;
+            node = node->next;
+        }
+    }
+
+    events = (struct RenderEvent *)malloc_zero(count > 0 ? count : 1, sizeof(struct RenderEvent));
+
+    for (i=0; i<CSEQ_FILE_NUM_TRACKS; i++)
+    {
+        if (tracks[i] == NULL)
+        {
+            continue;
+        }
+
+        node = tracks[i]->events->head;
+        while (node != NULL)
+        {
+            struct GmidEvent *event = (struct GmidEvent *)node->data;
+            struct RenderEvent *render_event = &events[pos];
+            int add = 1;
+
+            render_event->tick = event->absolute_time;
+            render_event->channel = event->command_channel & 0xf;
+            render_event->sequence = (int)pos;
+
+            switch (event->command)
+            {
+                case CSEQ_COMMAND_BYTE_NOTE_ON:
+                {
+                    render_event->type = RENDER_EVENT_NOTE_ON;
+                    render_event->param1 = event->cseq_command_parameters[0];
+                    render_event->param2 = event->cseq_command_parameters[1];
+
+                    pos++;
+                    events[pos] = *render_event;
+                    events[pos].type = RENDER_EVENT_NOTE_OFF;
+                    events[pos].tick = event->absolute_time + event->cseq_command_parameters[2];
+                    events[pos].sequence = (int)pos;
+                }
+                break;
+
+                case MIDI_COMMAND_BYTE_CONTROL_CHANGE:
+                    render_event->type = RENDER_EVENT_CONTROL_CHANGE;
+                    render_event->param1 = event->cseq_command_parameters[0];
+                    render_event->param2 = event->cseq_command_parameters[1];
+                    break;
+
+                case MIDI_COMMAND_BYTE_PROGRAM_CHANGE:
+                    render_event->type = RENDER_EVENT_PROGRAM_CHANGE;
+                    render_event->param1 = event->cseq_command_parameters[0];
+                    break;
+
+                case MIDI_COMMAND_BYTE_PITCH_BEND:
+                    render_event->type = RENDER_EVENT_PITCH_BEND;
+                    render_event->param1 = (event->cseq_command_parameters[1] << 7) | event->cseq_command_parameters[0];
+                    break;
+
+                case CSEQ_COMMAND_BYTE_TEMPO_WITH_META:
+                    render_event->type = RENDER_EVENT_TEMPO;
+                    render_event->param1 = event->cseq_command_parameters[0];
+                    break;
+
+                case CSEQ_COMMAND_BYTE_END_OF_TRACK_WITH_META:
+                    render_event->type = RENDER_EVENT_END_OF_TRACK;
+                    break;
+
+                default:
+                    // not needed for playback
+                    add = 0;
+                    break;
+            }
+
+            if (add)
+            {
+                pos++;
+            }
+
+            node = node->next;
+        }
+
+        GmidTrack_free(tracks[i]);
+    }
+
+    qsort(events, pos, sizeof(struct RenderEvent), RenderEvent_compare);
+
+    *num_events = pos;
+
+    TRACE_LEAVE(__func__)
+
+    return events;
+}
+
+/**
+ * qsort comparison function. Sorts by tick, then event type, then insertion order.
+ * @param first: first event.
+ * @param second: second event.
+ * @returns: comparison result.
+*/
+static int RenderEvent_compare(const void *first, const void *second)
+{
+    TRACE_ENTER(__func__)
+
+    const struct RenderEvent *a = (const struct RenderEvent *)first;
+    const struct RenderEvent *b = (const struct RenderEvent *)second;
+    int ret;
+
+    if (a->tick != b->tick)
+    {
+        ret = a->tick < b->tick ? -1 : 1;
+    }
+    else if (a->type != b->type)
+    {
+        ret = a->type < b->type ? -1 : 1;
+    }
+    else
+    {
+        ret = a->sequence < b->sequence ? -1 : (a->sequence > b->sequence ? 1 : 0);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return ret;
+}
+
+/**
+ * Converts tempo to number of output samples per tick.
+ * @param tempo: microseconds per quarter note.
+ * @param division: ticks per quarter note.
+ * @param sample_rate: output sample rate.
+ * @returns: samples per tick.
+*/
+static double render_samples_per_tick(int tempo, int division, int sample_rate)
+{
+    TRACE_ENTER(__func__)
+
+    double result = ((double)tempo / 1000000.0) * (double)sample_rate / (double)division;
+
+    TRACE_LEAVE(__func__)
+
+    return result;
+}
+
+/**
+ * Gets the decoded wavetable for a sound. Audio comes from the pcm cache the first
+ * time the wavetable is played, then is reused for the rest of the render.
+ * @param renderer: renderer.
+ * @param sound: sound to get wavetable from.
+ * @returns: decoded wavetable, or NULL if the sound doesn't have audio.
+*/
+static struct RenderSample *Renderer_get_sample(struct Renderer *renderer, struct ALSound *sound)
+{
+    TRACE_ENTER(__func__)
+
+    struct ALWaveTable *wavetable = sound->wavetable;
+    struct RenderSample *sample;
+    uint32_t loop_start = 0;
+    uint32_t loop_end = 0;
+    uint32_t loop_count = 0;
+
+    if (wavetable == NULL || wavetable->len <= 0)
+    {
+        TRACE_LEAVE(__func__)
+        return NULL;
+    }
+
+    if (IntHashTable_contains(renderer->samples, (uint32_t)wavetable->id))
+    {
+        TRACE_LEAVE(__func__)
+        return (struct RenderSample *)IntHashTable_get(renderer->samples, (uint32_t)wavetable->id);
+    }
+
+    sample = (struct RenderSample *)malloc_zero(1, sizeof(struct RenderSample));
+    sample->cache = renderer->pcm_cache;
+    sample->entry = PcmCache_get(renderer->pcm_cache, sound, renderer->bank, renderer->tbl_file_contents);
+    sample->samples = sample->entry->samples;
+    sample->num_samples = (int32_t)sample->entry->num_samples;
+
+    if (wavetable->type == AL_ADPCM_WAVE && wavetable->wave_info.adpcm_wave.loop != NULL)
+    {
+        loop_start = wavetable->wave_info.adpcm_wave.loop->start;
+        loop_end = wavetable->wave_info.adpcm_wave.loop->end;
+        loop_count = wavetable->wave_info.adpcm_wave.loop->count;
+    }
+    else if (wavetable->type == AL_RAW16_WAVE && wavetable->wave_info.raw_wave.loop != NULL)
+    {
+        loop_start = wavetable->wave_info.raw_wave.loop->start;
+        loop_end = wavetable->wave_info.raw_wave.loop->end;
+        loop_count = wavetable->wave_info.raw_wave.loop->count;
+    }
+
+    if (loop_end > (uint32_t)sample->num_samples)
+    {
+        loop_end = (uint32_t)sample->num_samples;
+    }
+
+    if (loop_count != 0 && loop_start < loop_end)
+    {
+        sample->loop_start = (int32_t)loop_start;
+        sample->loop_end = (int32_t)loop_end;
+        sample->loop_count = (int32_t)loop_count;
+    }
+
+    IntHashTable_add(renderer->samples, (uint32_t)wavetable->id, sample);
+
+    if (g_verbosity >= VERBOSE_DEBUG)
+    {
+        printf("%s: wavetable %d, %d samples, loop start=%d end=%d count=%d\n", __func__, wavetable->id, sample->num_samples, sample->loop_start, sample->loop_end, sample->loop_count);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return sample;
+}
+
+/**
+ * {@code IntHashTable_foreach} callback, releases a decoded wavetable back to the cache.
+ * @param data: {@code struct RenderSample} to free.
+*/
+static void RenderSample_free(void *data)
+{
+    TRACE_ENTER(__func__)
+
+    struct RenderSample *sample = (struct RenderSample *)data;
+
+    if (sample != NULL)
+    {
+        if (sample->entry != NULL)
+        {
+            PcmCache_release(sample->cache, sample->entry);
+        }
+
+        gaudio_free(sample);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Applies a single timeline event to the renderer state.
+ * @param renderer: renderer.
+ * @param event: event to apply.
+*/
+static void Renderer_apply_event(struct Renderer *renderer, struct RenderEvent *event)
+{
+    TRACE_ENTER(__func__)
+
+    struct RenderChannel *channel = &renderer->channels[event->channel];
+    int i;
+
+    switch (event->type)
+    {
+        case RENDER_EVENT_NOTE_ON:
+            Renderer_note_on(renderer, event->channel, event->param1, event->param2);
+            break;
+
+        case RENDER_EVENT_NOTE_OFF:
+            Renderer_note_off(renderer, event->channel, event->param1);
+            break;
+
+        case RENDER_EVENT_PROGRAM_CHANGE:
+        {
+            // same as libultra, the instrument sets the channel volume and pan.
+            if (event->param1 >= 0
+                && event->param1 < renderer->bank->inst_count
+                && renderer->bank->instruments[event->param1] != NULL)
+            {
+                channel->instrument = renderer->bank->instruments[event->param1];
+                channel->volume = channel->instrument->volume;
+                channel->pan = channel->instrument->pan;
+            }
+        }
+        break;
+
+        case RENDER_EVENT_CONTROL_CHANGE:
+        {
+            if (event->param1 == MIDI_CONTROLLER_CHANNEL_VOLUME)
+            {
+                channel->volume = event->param2 & 0x7f;
+            }
+            else if (event->param1 == MIDI_CONTROLLER_CHANNEL_PAN)
+            {
+                channel->pan = event->param2 & 0x7f;
+            }
+            else if (event->param1 == MIDI_CONTROLLER_SUSTAIN)
+            {
+                channel->sustain = event->param2 >= 64;
+
+                if (!channel->sustain)
+                {
+                    for (i=0; i<renderer->max_voices; i++)
+                    {
+                        struct RenderVoice *voice = &renderer->voices[i];
+                        if (voice->active && voice->sustained && voice->channel == event->channel)
+                        {
+                            voice->sustained = 0;
+                            RenderVoice_release(voice);
+                        }
+                    }
+                }
+            }
+        }
+        break;
+
+        case RENDER_EVENT_PITCH_BEND:
+        {
+            int bend_range = channel->instrument != NULL ? channel->instrument->bend_range : 200;
+
+            channel->bend_cents = ((double)(event->param1 - 8192) / 8192.0) * (double)bend_range;
+
+            for (i=0; i<renderer->max_voices; i++)
+            {
+                if (renderer->voices[i].active && renderer->voices[i].channel == event->channel)
+                {
+                    RenderVoice_set_step(renderer, &renderer->voices[i]);
+                }
+            }
+        }
+        break;
+
+        default:
+            // tempo and end of track are handled by the caller.
+            break;
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Starts a new note on a channel, using the first sound in the channel
+ * instrument with a keymap that contains the note and velocity.
+ * @param renderer: renderer.
+ * @param channel: MIDI channel.
+ * @param note: MIDI note.
+ * @param velocity: note velocity.
+*/
+static void Renderer_note_on(struct Renderer *renderer, int channel, int note, int velocity)
+{
+    TRACE_ENTER(__func__)
+
+    struct ALInstrument *instrument = renderer->channels[channel].instrument;
+    struct ALSound *sound = NULL;
+    struct RenderSample *sample;
+    struct RenderVoice *voice;
+    int key_base = 60;
+    int detune = 0;
+    int i;
+
+    if (instrument == NULL || instrument->sounds == NULL || velocity <= 0)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    for (i=0; i<instrument->sound_count; i++)
+    {
+        struct ALSound *candidate = instrument->sounds[i];
+        struct ALKeyMap *keymap;
+
+        if (candidate == NULL)
+        {
+            continue;
+        }
+
+        keymap = candidate->keymap;
+
+        if (keymap == NULL
+            || (note >= keymap->key_min && note <= keymap->key_max
+                && velocity >= keymap->velocity_min && velocity <= keymap->velocity_max))
+        {
+            sound = candidate;
+            break;
+        }
+    }
+
+    if (sound == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    sample = Renderer_get_sample(renderer, sound);
+
+    if (sample == NULL || sample->num_samples == 0)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    if (sound->keymap != NULL)
+    {
+        key_base = sound->keymap->key_base;
+        detune = sound->keymap->detune;
+    }
+
+    voice = Renderer_allocate_voice(renderer);
+
+    if (voice == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    memset(voice, 0, sizeof(struct RenderVoice));
+
+    voice->active = 1;
+    voice->channel = channel;
+    voice->note = note;
+    voice->start_order = renderer->voice_counter++;
+    voice->sound = sound;
+    voice->sample = sample;
+    voice->loops_remaining = sample->loop_count;
+    voice->cents = (double)(note - key_base) * 100.0 + (double)detune;
+    voice->gain = ((float)velocity / 127.0f) * ((float)sound->sample_volume / 127.0f);
+
+    RenderVoice_set_step(renderer, voice);
+
+    voice->env_phase = RENDER_ENVELOPE_ATTACK;
+    voice->env_level = 0;
+
+    if (sound->envelope != NULL)
+    {
+        RenderVoice_set_ramp(voice, (float)sound->envelope->attack_volume / 127.0f, sound->envelope->attack_time, renderer->sample_rate);
+    }
+    else
+    {
+        // no envelope, play at full volume until note off.
+        voice->env_phase = RENDER_ENVELOPE_SUSTAIN;
+        voice->env_level = 1.0f;
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Releases the oldest playing voice for the note on the channel.
+ * @param renderer: renderer.
+ * @param channel: MIDI channel.
+ * @param note: MIDI note.
+*/
+static void Renderer_note_off(struct Renderer *renderer, int channel, int note)
+{
+    TRACE_ENTER(__func__)
+
+    struct RenderVoice *oldest = NULL;
+    int i;
+
+    for (i=0; i<renderer->max_voices; i++)
+    {
+        struct RenderVoice *voice = &renderer->voices[i];
+
+        if (voice->active
+            && voice->channel == channel
+            && voice->note == note
+            && !voice->sustained
+            && voice->env_phase < RENDER_ENVELOPE_RELEASE)
+        {
+            if (oldest == NULL || voice->start_order < oldest->start_order)
+            {
+                oldest = voice;
+            }
+        }
+    }
+
+    if (oldest != NULL)
+    {
+        if (renderer->channels[channel].sustain)
+        {
+            oldest->sustained = 1;
+        }
+        else
+        {
+            RenderVoice_release(oldest);
+        }
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Gets a free voice. If all voices are in use, the quietest releasing voice
+ * is stopped and reused, otherwise the oldest voice.
+ * @param renderer: renderer.
+ * @returns: voice to use.
+*/
+static struct RenderVoice *Renderer_allocate_voice(struct Renderer *renderer)
+{
+    TRACE_ENTER(__func__)
+
+    struct RenderVoice *quietest_release = NULL;
+    struct RenderVoice *oldest = NULL;
+    int i;
+
+    for (i=0; i<renderer->max_voices; i++)
+    {
+        struct RenderVoice *voice = &renderer->voices[i];
+
+        if (!voice->active)
+        {
+            TRACE_LEAVE(__func__)
+            return voice;
+        }
+
+        if (voice->env_phase == RENDER_ENVELOPE_RELEASE
+            && (quietest_release == NULL || voice->env_level < quietest_release->env_level))
+        {
+            quietest_release = voice;
+        }
+
+        if (oldest == NULL || voice->start_order < oldest->start_order)
+        {
+            oldest = voice;
+        }
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return quietest_release != NULL ? quietest_release : oldest;
+}
+
+/**
+ * Sets voice resample step from note pitch and channel pitch bend.
+ * @param renderer: renderer.
+ * @param voice: voice to update.
+*/
+static void RenderVoice_set_step(struct Renderer *renderer, struct RenderVoice *voice)
+{
+    TRACE_ENTER(__func__)
+
+    double cents = voice->cents + renderer->channels[voice->channel].bend_cents;
+
+    voice->step = pow(2.0, cents / 1200.0) * renderer->rate_ratio;
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Starts the release segment of the voice envelope.
+ * @param voice: voice to release.
+*/
+static void RenderVoice_release(struct RenderVoice *voice)
+{
+    TRACE_ENTER(__func__)
+
+    // release time is applied when the next block is rendered.
+    voice->env_phase = RENDER_ENVELOPE_RELEASE;
+    voice->env_remaining = -1;
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Sets a linear envelope ramp from the current level.
+ * @param voice: voice to update.
+ * @param target: target level, range 0-1.
+ * @param time_usec: ramp time in microseconds.
+ * @param sample_rate: output sample rate.
+*/
+static void RenderVoice_set_ramp(struct RenderVoice *voice, float target, int32_t time_usec, int sample_rate)
+{
+    TRACE_ENTER(__func__)
+
+    long len = time_usec > 0 ? (long)(((double)time_usec * (double)sample_rate) / 1000000.0) : 0;
+
+    if (len < 1)
+    {
+        len = 1;
+    }
+
+    voice->env_delta = (target - voice->env_level) / (float)len;
+    voice->env_remaining = len;
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Moves the voice envelope to the next segment once the current ramp completes.
+ * @param voice: voice to update.
+ * @param sample_rate: output sample rate.
+*/
+static void RenderVoice_next_envelope_phase(struct RenderVoice *voice, int sample_rate)
+{
+    TRACE_ENTER(__func__)
+
+    struct ALEnvelope *envelope = voice->sound->envelope;
+
+    switch (voice->env_phase)
+    {
+        case RENDER_ENVELOPE_ATTACK:
+            voice->env_phase = RENDER_ENVELOPE_DECAY;
+            RenderVoice_set_ramp(voice, (float)envelope->decay_volume / 127.0f, envelope->decay_time, sample_rate);
+            break;
+
+        case RENDER_ENVELOPE_DECAY:
+            voice->env_phase = RENDER_ENVELOPE_SUSTAIN;
+            voice->env_delta = 0;
+            voice->env_remaining = 0;
+            break;
+
+        case RENDER_ENVELOPE_RELEASE:
+            if (voice->env_remaining < 0)
+            {
+                // just released, start the ramp down.
+                RenderVoice_set_ramp(voice, 0, envelope != NULL ? envelope->release_time : 0, sample_rate);
+            }
+            else
+            {
+                voice->env_phase = RENDER_ENVELOPE_DONE;
+                voice->env_level = 0;
+                voice->env_delta = 0;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Renders a voice into a mono buffer: resample, then apply envelope and gain.
+ * The buffer is overwritten, not mixed.
+ * @param voice: voice to render.
+ * @param buffer: output buffer.
+ * @param len: number of samples to render.
+ * @param sample_rate: output sample rate.
+ * @returns: number of samples written. Less than {@code len} if the voice ended.
+*/
+static int RenderVoice_render(struct RenderVoice *voice, float *buffer, int len, int sample_rate)
+{
+    TRACE_ENTER(__func__)
+
+    struct RenderSample *sample = voice->sample;
+    const int16_t *samples = sample->samples;
+    double position = voice->position;
+    double step = voice->step;
+    float level = voice->env_level;
+    float gain = voice->gain;
+    int pos = 0;
+
+    while (pos < len)
+    {
+        long span;
+        int i;
+
+        // resolve envelope segment changes before rendering.
+        while (voice->env_phase != RENDER_ENVELOPE_SUSTAIN && voice->env_phase != RENDER_ENVELOPE_DONE && voice->env_remaining <= 0)
+        {
+            voice->env_level = level;
+            RenderVoice_next_envelope_phase(voice, sample_rate);
+            level = voice->env_level;
+        }
+
+        if (voice->env_phase == RENDER_ENVELOPE_DONE)
+        {
+            voice->active = 0;
+            break;
+        }
+
+        // render up to the end of the envelope segment (or end of buffer).
+        span = len - pos;
+        if (voice->env_phase != RENDER_ENVELOPE_SUSTAIN && voice->env_remaining < span)
+        {
+            span = voice->env_remaining;
+        }
+
+        for (i=0; i<span; i++)
+        {
+            int32_t index = (int32_t)position;
+            float frac;
+            float s0;
+            float s1;
+            int32_t next;
+
+            if (sample->loop_count != 0 && voice->loops_remaining != 0 && index >= sample->loop_end)
+            {
+                position -= (double)(sample->loop_end - sample->loop_start);
+                index = (int32_t)position;
+
+                if (voice->loops_remaining > 0)
+                {
+                    voice->loops_remaining--;
+                }
+            }
+
+            if (index >= sample->num_samples)
+            {
+                voice->active = 0;
+                break;
+            }
+
+            next = index + 1;
+            if (sample->loop_count != 0 && voice->loops_remaining != 0 && next == sample->loop_end)
+            {
+                next = sample->loop_start;
+            }
+
+            frac = (float)(position - (double)index);
+            s0 = (float)samples[index];
+            s1 = next < sample->num_samples ? (float)samples[next] : 0.0f;
+
+            buffer[pos + i] = (s0 + (s1 - s0) * frac) * level * gain;
+
+            level += voice->env_delta;
+            position += step;
+        }
+
+        pos += i;
+
+        if (voice->env_phase != RENDER_ENVELOPE_SUSTAIN)
+        {
+            voice->env_remaining -= i;
+        }
+
+        if (!voice->active)
+        {
+            break;
+        }
+    }
+
+    voice->position = position;
+    voice->env_level = level;
+
+    TRACE_LEAVE(__func__)
+
+    return pos;
+}
+
+/**
+ * Checks if any voice is still playing.
+ * @param renderer: renderer.
+ * @returns: 1 if any voice is active, 0 otherwise.
+*/
+static int Renderer_any_active(struct Renderer *renderer)
+{
+    TRACE_ENTER(__func__)
+
+    int i;
+
+    for (i=0; i<renderer->max_voices; i++)
+    {
+        if (renderer->voices[i].active)
+        {
+            TRACE_LEAVE(__func__)
+            return 1;
+        }
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return 0;
+}
+
+/**
+ * Renders all active voices up to the given output sample, one block at a time.
+ * Each voice is rendered to a mono buffer, then added to the left and right
+ * mix buffers. The mix loops are kept simple so the compiler can vectorize them.
+ * @param renderer: renderer.
+ * @param end_sample: output sample to stop at (exclusive). Limited to output buffer size.
+*/
+static void Renderer_render_until(struct Renderer *renderer, size_t end_sample)
+{
+    TRACE_ENTER(__func__)
+
+    float *voice_buffer = renderer->voice_buffer;
+    float *mix_left = renderer->mix_left;
+    float *mix_right = renderer->mix_right;
+
+    if (end_sample > renderer->output_max_samples)
+    {
+        end_sample = renderer->output_max_samples;
+    }
+
+    while (renderer->output_pos < end_sample)
+    {
+        size_t remaining = end_sample - renderer->output_pos;
+        int len = remaining < RENDER_BLOCK_LEN ? (int)remaining : RENDER_BLOCK_LEN;
+        int16_t *out = &renderer->output[renderer->output_pos * RENDER_NUM_OUTPUT_CHANNELS];
+        int v;
+        int i;
+
+        memset(mix_left, 0, len * sizeof(float));
+        memset(mix_right, 0, len * sizeof(float));
+
+        for (v=0; v<renderer->max_voices; v++)
+        {
+            struct RenderVoice *voice = &renderer->voices[v];
+            struct RenderChannel *channel;
+            float channel_gain;
+            float gain_left;
+            float gain_right;
+            int pan;
+            int n;
+
+            if (!voice->active)
+            {
+                continue;
+            }
+
+            channel = &renderer->channels[voice->channel];
+
+            pan = channel->pan + voice->sound->sample_pan - 64;
+            if (pan < 0)
+            {
+                pan = 0;
+            }
+            else if (pan > 127)
+            {
+                pan = 127;
+            }
+
+            channel_gain = (float)channel->volume / 127.0f;
+            gain_left = renderer->pan_left[pan] * channel_gain;
+            gain_right = renderer->pan_right[pan] * channel_gain;
+
+            n = RenderVoice_render(voice, voice_buffer, len, renderer->sample_rate);
+
+            for (i=0; i<n; i++)
+            {
+                mix_left[i] += voice_buffer[i] * gain_left;
+                mix_right[i] += voice_buffer[i] * gain_right;
+            }
+        }
+
+        for (i=0; i<len; i++)
+        {
+            float l = mix_left[i];
+            float r = mix_right[i];
+
+            l = l > 32767.0f ? 32767.0f : (l < -32768.0f ? -32768.0f : l);
+            r = r > 32767.0f ? 32767.0f : (r < -32768.0f ? -32768.0f : r);
+
+            out[i * 2] = (int16_t)l;
+            out[i * 2 + 1] = (int16_t)r;
+        }
+
+        renderer->output_pos += len;
+    }
+
+    TRACE_LEAVE(__func__)
+}
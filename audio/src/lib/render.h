@@ -0,0 +1,111 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#ifndef _GAUDIO_RENDER_H_
+#define _GAUDIO_RENDER_H_
+
+#include <stdint.h>
+#include "naudio.h"
+#include "midi.h"
+#include "wav.h"
+#include "pcm_cache.h"
+
+/**
+ * This file contains structs and defines for rendering a seq against
+ * a sound bank (.ctl/.tbl) to audio.
+*/
+
+/**
+ * Number of voices allocated when not otherwise specified.
+*/
+#define RENDER_DEFAULT_MAX_VOICES 32
+
+/**
+ * Sanity check, max number of voices.
+*/
+#define RENDER_MAX_VOICES 256
+
+/**
+ * Time in milliseconds to keep rendering after the last event, to
+ * allow release envelopes to finish.
+*/
+#define RENDER_DEFAULT_TAIL_MS 2000
+
+/**
+ * Sample rate used for banks that don't specify one.
+*/
+#define RENDER_DEFAULT_SAMPLE_RATE 22050
+
+/**
+ * Number of samples mixed at a time.
+*/
+#define RENDER_BLOCK_LEN 256
+
+/**
+ * Output is always stereo.
+*/
+#define RENDER_NUM_OUTPUT_CHANNELS 2
+
+/**
+ * Number of MIDI channels tracked.
+*/
+#define RENDER_NUM_MIDI_CHANNELS 16
+
+/**
+ * Tempo used until the seq sets one, in microseconds per quarter note (120 bpm).
+*/
+#define RENDER_DEFAULT_TEMPO 500000
+
+/**
+ * Options for {@code WavFile_new_from_cseq}.
+*/
+struct RenderOptions {
+    /**
+     * Output sample rate. If zero, the bank sample rate is used.
+    */
+    int sample_rate;
+
+    /**
+     * Index of bank in the bank file to play instruments from.
+    */
+    int bank_index;
+
+    /**
+     * Number of voices that can play at the same time. When all voices
+     * are in use the quietest releasing voice, or else the oldest voice, is stopped.
+    */
+    int max_voices;
+
+    /**
+     * Max time in milliseconds to keep rendering after the last event.
+    */
+    int tail_ms;
+
+    /**
+     * Optional. Cache to get decoded wavetables from. Reusing the cache between
+     * renders (with the same .tbl file) avoids decoding the same audio again.
+     * If NULL, a cache is created for the render. Not freed by {@code RenderOptions_free}.
+    */
+    struct PcmCache *pcm_cache;
+};
+
+struct RenderOptions *RenderOptions_new(void);
+void RenderOptions_free(struct RenderOptions *options);
+
+struct WavFile *WavFile_new_from_cseq(struct CseqFile *cseq, struct ALBankFile *bank_file, uint8_t *tbl_file_contents, struct RenderOptions *options);
+
+#endif
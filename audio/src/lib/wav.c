@@ -260,11 +260,14 @@ struct WavFile *WavFile_new_from_file(struct FileInfo *fi)
                 {
                     chunk_count--;
                 }
-                FileInfo_fseek(fi, chunk_size, SEEK_CUR);
                 break;
             }
 
-            pos += chunk_size;
+            // Chunks are word aligned, odd sized chunks are followed by a pad byte.
+            // Seek from the chunk start, chunk readers don't always read the full chunk
+            // (e.g., "fmt " chunk with extension).
+            pos += chunk_size + (chunk_size & 1);
+            FileInfo_fseek(fi, (long)pos, SEEK_SET);
         }
         else
         {
@@ -343,7 +346,7 @@ void WavSampleLoop_free(struct WavSampleLoop *loop)
         return;
     }
 
-    free(loop);
+    gaudio_free(loop);
 
     TRACE_LEAVE(__func__)
 }
@@ -375,11 +378,11 @@ void WavSampleChunk_free(struct WavSampleChunk *chunk)
 
     if (chunk->loops != NULL)
     {
-        free(chunk->loops);
+        gaudio_free(chunk->loops);
         chunk->loops = 0;
     }
 
-    free(chunk);
+    gaudio_free(chunk);
 
     TRACE_LEAVE(__func__)
 }
@@ -400,10 +403,10 @@ void WavDataChunk_free(struct WavDataChunk *chunk)
 
     if (chunk->data != NULL)
     {
-        free(chunk->data);
+        gaudio_free(chunk->data);
     }
 
-    free(chunk);
+    gaudio_free(chunk);
 
     TRACE_LEAVE(__func__)
 }
@@ -422,7 +425,7 @@ void WavFmtChunk_free(struct WavFmtChunk *chunk)
         return;
     }
 
-    free(chunk);
+    gaudio_free(chunk);
 
     TRACE_LEAVE(__func__)
 }
@@ -479,10 +482,10 @@ void WavFile_free(struct WavFile *wav_file)
             wav_file->chunks[i] = NULL;
         }
 
-        free(wav_file->chunks);
+        gaudio_free(wav_file->chunks);
     }
 
-    free(wav_file);
+    gaudio_free(wav_file);
 
     TRACE_LEAVE(__func__)
 }
@@ -782,6 +785,344 @@ void WavFile_append_smpl_chunk(struct WavFile *wav_file, struct WavSampleChunk *
     TRACE_LEAVE(__func__)
 }
 
+/**
+ * Opens a wav file for reading sound data in blocks.
+ * The "fmt " and "smpl" chunks are parsed, then the file is positioned at the
+ * start of sound data. Sound data is not loaded into memory.
+ * @param fi: wav file. Must be seekable. Not owned by the reader, and the file
+ * position should not be changed while reading sound data.
+ * @returns: pointer to new reader.
+*/
+struct WavReader *WavReader_new(struct FileInfo *fi)
+{
+    TRACE_ENTER(__func__)
+
+    if (fi == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> fi is NULL\n", __func__, __LINE__);
+    }
+
+    struct WavReader *reader;
+    size_t pos;
+    uint32_t ck_id;
+    uint32_t form_type;
+    uint32_t chunk_size;
+    int seen_data = 0;
+
+    if (fi->len < 12)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> Invalid .wav file: header too short\n", __func__, __LINE__);
+    }
+
+    FileInfo_fseek(fi, 0, SEEK_SET);
+
+    FileInfo_fread(fi, &ck_id, 4, 1);
+    BSWAP32(ck_id);
+
+    // RIFF size isn't needed, the chunks are scanned to the end of the file.
+    FileInfo_fread(fi, &chunk_size, 4, 1);
+
+    FileInfo_fread(fi, &form_type, 4, 1);
+    BSWAP32(form_type);
+
+    if (ck_id != WAV_RIFF_CHUNK_ID)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> Invalid .wav file: FORM chunk id failed. Expected 0x%08x, read 0x%08x.\n", __func__, __LINE__, WAV_RIFF_CHUNK_ID, ck_id);
+    }
+
+    if (form_type != WAV_RIFF_TYPE_ID)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> Invalid .wav file: FORM type id failed. Expected 0x%08x, read 0x%08x.\n", __func__, __LINE__, WAV_RIFF_TYPE_ID, form_type);
+    }
+
+    reader = (struct WavReader *)malloc_zero(1, sizeof(struct WavReader));
+    reader->fi = fi;
+
+    pos = 12;
+
+    // Same chunk scan as WavFile_new_from_file, except the "data" chunk is skipped.
+    // Chunk size is unsigned here so sound data up to 4GB can be read.
+    while (pos + 8 < fi->len)
+    {
+        FileInfo_fread(fi, &ck_id, 4, 1);
+        BSWAP32(ck_id);
+
+        FileInfo_fread(fi, &chunk_size, 4, 1);
+
+        pos += 8;
+
+        switch (ck_id)
+        {
+            case WAV_FMT_CHUNK_ID:
+            WavFmtChunk_free(reader->fmt_chunk);
+            reader->fmt_chunk = WavFmtChunk_new_from_file(fi, (int32_t)chunk_size);
+            break;
+
+            case WAV_DATA_CHUNK_ID:
+            if (chunk_size <= 8)
+            {
+                stderr_exit(EXIT_CODE_GENERAL, "%s %d> Invalid data chunk data size: %u\n", __func__, __LINE__, chunk_size);
+            }
+
+            if (pos + chunk_size > fi->len)
+            {
+                stderr_exit(EXIT_CODE_GENERAL, "%s %d> Invalid .wav file: data chunk size %u is past end of file\n", __func__, __LINE__, chunk_size);
+            }
+
+            seen_data = 1;
+            reader->data_offset = (long)pos;
+            reader->data_len = chunk_size;
+            break;
+
+            case WAV_SMPL_CHUNK_ID:
+            WavSampleChunk_free(reader->smpl_chunk);
+            reader->smpl_chunk = WavSampleChunk_new_from_file(fi, (int32_t)chunk_size);
+            break;
+
+            default:
+            // ignore unsupported chunks
+            if (g_verbosity >= VERBOSE_DEBUG)
+            {
+                printf("ignore chunk_id=0x%08x\n", ck_id);
+            }
+            break;
+        }
+
+        // Chunks are word aligned, odd sized chunks are followed by a pad byte.
+        pos += (size_t)chunk_size + (chunk_size & 1);
+        FileInfo_fseek(fi, (long)pos, SEEK_SET);
+    }
+
+    if (reader->fmt_chunk == NULL)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> Invalid .wav file: missing fmt chunk\n", __func__, __LINE__);
+    }
+
+    if (seen_data == 0)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> Invalid .wav file: missing data chunk\n", __func__, __LINE__);
+    }
+
+    FileInfo_fseek(fi, reader->data_offset, SEEK_SET);
+
+    TRACE_LEAVE(__func__)
+
+    return reader;
+}
+
+/**
+ * Reads the next block of sound data.
+ * @param reader: reader.
+ * @param buffer: out parameter. Must be previously allocated.
+ * @param max_len: max number of bytes to read.
+ * @returns: number of bytes read, zero at the end of sound data.
+*/
+size_t WavReader_read(struct WavReader *reader, uint8_t *buffer, size_t max_len)
+{
+    TRACE_ENTER(__func__)
+
+    if (reader == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> reader is NULL\n", __func__, __LINE__);
+    }
+
+    if (buffer == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> buffer is NULL\n", __func__, __LINE__);
+    }
+
+    size_t len = reader->data_len - reader->data_pos;
+
+    if (len > max_len)
+    {
+        len = max_len;
+    }
+
+    if (len > 0)
+    {
+        FileInfo_fread(reader->fi, buffer, len, 1);
+        reader->data_pos += len;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return len;
+}
+
+/**
+ * Frees memory allocated to reader and parsed chunks. The file is not closed.
+ * @param reader: object to free.
+*/
+void WavReader_free(struct WavReader *reader)
+{
+    TRACE_ENTER(__func__)
+
+    if (reader == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    WavFmtChunk_free(reader->fmt_chunk);
+    WavSampleChunk_free(reader->smpl_chunk);
+
+    gaudio_free(reader);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Starts writing a wav file. Writes the RIFF header, "fmt " chunk, and
+ * "data" chunk header. Sound data is then written with {@code WavWriter_write},
+ * or directly to {@code fi}, until {@code WavWriter_close}.
+ * @param fi: File handle to write to, using current offset. Must be seekable.
+ * Not owned by the writer.
+ * @param fmt_chunk: format of sound data.
+ * @returns: pointer to new writer.
+*/
+struct WavWriter *WavWriter_new(struct FileInfo *fi, struct WavFmtChunk *fmt_chunk)
+{
+    TRACE_ENTER(__func__)
+
+    if (fi == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> fi is NULL\n", __func__, __LINE__);
+    }
+
+    if (fmt_chunk == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> fmt_chunk is NULL\n", __func__, __LINE__);
+    }
+
+    struct WavWriter *writer = (struct WavWriter *)malloc_zero(1, sizeof(struct WavWriter));
+    uint32_t ck_id;
+    uint32_t size = 0;
+
+    writer->fi = fi;
+    writer->riff_offset = FileInfo_ftell(fi);
+
+    // sizes are set on close.
+    ck_id = WAV_RIFF_CHUNK_ID;
+    FileInfo_fwrite_bswap(fi, &ck_id, 4, 1);
+    FileInfo_fwrite(fi, &size, 4, 1);
+    ck_id = WAV_RIFF_TYPE_ID;
+    FileInfo_fwrite_bswap(fi, &ck_id, 4, 1);
+
+    WavFmtChunk_fwrite(fmt_chunk, fi);
+
+    ck_id = WAV_DATA_CHUNK_ID;
+    FileInfo_fwrite_bswap(fi, &ck_id, 4, 1);
+    FileInfo_fwrite(fi, &size, 4, 1);
+
+    writer->data_offset = FileInfo_ftell(fi);
+
+    TRACE_LEAVE(__func__)
+
+    return writer;
+}
+
+/**
+ * Appends sound data to the "data" chunk.
+ * @param writer: writer.
+ * @param data: sound data, in the format given when the writer was created.
+ * @param len: length of {@code data} in bytes.
+*/
+void WavWriter_write(struct WavWriter *writer, const uint8_t *data, size_t len)
+{
+    TRACE_ENTER(__func__)
+
+    if (writer == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> writer is NULL\n", __func__, __LINE__);
+    }
+
+    if (len > 0)
+    {
+        FileInfo_fwrite(writer->fi, data, len, 1);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Ends the "data" chunk, writes the optional "smpl" chunk, then sets the
+ * RIFF and "data" chunk sizes. The file position is left at the end of the wav.
+ * @param writer: writer.
+ * @param smpl_chunk: Optional. "smpl" chunk to write after sound data.
+ * @returns: size in bytes of sound data.
+*/
+size_t WavWriter_close(struct WavWriter *writer, struct WavSampleChunk *smpl_chunk)
+{
+    TRACE_ENTER(__func__)
+
+    if (writer == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> writer is NULL\n", __func__, __LINE__);
+    }
+
+    struct FileInfo *fi = writer->fi;
+    size_t data_len;
+    size_t riff_len;
+    long end;
+    uint32_t size;
+
+    end = FileInfo_ftell(fi);
+    data_len = (size_t)(end - writer->data_offset);
+
+    // odd sized chunks are followed by a pad byte.
+    if (data_len & 1)
+    {
+        uint8_t pad = 0;
+        FileInfo_fwrite(fi, &pad, 1, 1);
+    }
+
+    if (smpl_chunk != NULL)
+    {
+        WavSampleChunk_fwrite(smpl_chunk, fi);
+    }
+
+    end = FileInfo_ftell(fi);
+    riff_len = (size_t)(end - writer->riff_offset) - 8;
+
+    if (riff_len > UINT32_MAX)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> wav size %ld is larger than max supported=%u\n", __func__, __LINE__, (long)riff_len, UINT32_MAX);
+    }
+
+    size = (uint32_t)riff_len;
+    FileInfo_fseek(fi, writer->riff_offset + 4, SEEK_SET);
+    FileInfo_fwrite(fi, &size, 4, 1);
+
+    size = (uint32_t)data_len;
+    FileInfo_fseek(fi, writer->data_offset - 4, SEEK_SET);
+    FileInfo_fwrite(fi, &size, 4, 1);
+
+    FileInfo_fseek(fi, end, SEEK_SET);
+
+    TRACE_LEAVE(__func__)
+
+    return data_len;
+}
+
+/**
+ * Frees memory allocated to writer. The file is not closed.
+ * @param writer: object to free.
+*/
+void WavWriter_free(struct WavWriter *writer)
+{
+    TRACE_ENTER(__func__)
+
+    if (writer == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    gaudio_free(writer);
+
+    TRACE_LEAVE(__func__)
+}
+
 /**
  * Creates new {@code struct WavDataChunk} from wav file contents.
  * @param fi: wav file. Reads from current seek position.
@@ -847,6 +1188,25 @@ static struct WavFmtChunk *WavFmtChunk_new_from_file(struct FileInfo *fi, int32_
     FileInfo_fread(fi, &p->block_align, 2, 1);
     FileInfo_fread(fi, &p->bits_per_sample, 2, 1);
 
+    // WAVE_FORMAT_EXTENSIBLE: the actual format is the first two bytes of the
+    // sub format GUID. Only the base fields are kept, so the chunk is
+    // treated as plain format from here on.
+    if (p->audio_format == WAV_AUDIO_FORMAT_EXTENSIBLE && ck_data_size >= WAV_FMT_CHUNK_EXTENSIBLE_BODY_SIZE)
+    {
+        uint8_t extension[WAV_FMT_CHUNK_EXTENSIBLE_BODY_SIZE - WAV_FMT_CHUNK_BODY_SIZE];
+
+        FileInfo_fread(fi, extension, sizeof(extension), 1);
+
+        // skip cbSize (2), wValidBitsPerSample (2), dwChannelMask (4)
+        p->audio_format = (int16_t)(extension[8] | (extension[9] << 8));
+        p->ck_data_size = WAV_FMT_CHUNK_BODY_SIZE;
+    }
+    else if (ck_data_size > WAV_FMT_CHUNK_BODY_SIZE)
+    {
+        // cbSize and any extra format bytes are not kept.
+        p->ck_data_size = WAV_FMT_CHUNK_BODY_SIZE;
+    }
+
     TRACE_LEAVE(__func__)
 
     return p;
@@ -89,11 +89,34 @@
 */
 #define WAV_SAMPLE_LOOP_SIZE 24
 
+/**
+ * wav file, size of "fmt " chunk without ck_id or ck_data_size,
+ * for WAV_AUDIO_FORMAT_EXTENSIBLE.
+*/
+#define WAV_FMT_CHUNK_EXTENSIBLE_BODY_SIZE 40
+
 /**
  * wav file default audio format
 */
 #define WAV_AUDIO_FORMAT 1 /* PCM (uncompressed) */
 
+/**
+ * wav file audio format, 32 or 64 bit float samples.
+*/
+#define WAV_AUDIO_FORMAT_IEEE_FLOAT 3
+
+/**
+ * wav file audio format, actual format is in the fmt chunk extension.
+ * This is converted to the actual format when the file is read.
+*/
+#define WAV_AUDIO_FORMAT_EXTENSIBLE ((int16_t)0xfffe)
+
+/**
+ * Number of sound data bytes read or written at a time when streaming
+ * with {@code struct WavReader} or {@code struct WavWriter}.
+*/
+#define WAV_STREAM_BLOCK_LEN 0x10000
+
 enum SAMPLE_LOOP_TYPE {
     SAMPLE_LOOP_FORWARD = 0,
     SAMPLE_LOOP_ALTERNATING,
@@ -149,14 +172,15 @@ struct WavFmtChunk {
 
     /**
      * Audio format.
-     * currently only WAV_AUDIO_FORMAT is supported.
+     * WAV_AUDIO_FORMAT or WAV_AUDIO_FORMAT_IEEE_FLOAT.
+     * Only 16 bit PCM is encoded, see {@code WavFile_convert}.
      * little endian.
     */
     int16_t audio_format;
 
     /**
      * Number of channels.
-     * currently only mono (1 channel) is supported.
+     * Only mono (1 channel) is encoded, see {@code WavFile_convert}.
      * little endian.
     */
     int16_t num_channels;
@@ -371,6 +395,65 @@ struct WavFile {
     struct WavSampleChunk *smpl_chunk;
 };
 
+/**
+ * Reads a wav file without loading the sound data into memory.
+ * The "fmt " and "smpl" chunks are parsed when the reader is created,
+ * sound data is then read from the "data" chunk in blocks.
+*/
+struct WavReader {
+    /**
+     * File being read. Not owned by the reader.
+    */
+    struct FileInfo *fi;
+
+    /**
+     * Parsed "fmt " chunk.
+    */
+    struct WavFmtChunk *fmt_chunk;
+
+    /**
+     * Parsed "smpl" chunk, or NULL if the file doesn't have one.
+    */
+    struct WavSampleChunk *smpl_chunk;
+
+    /**
+     * File offset of the start of sound data.
+    */
+    long data_offset;
+
+    /**
+     * Size in bytes of sound data.
+    */
+    size_t data_len;
+
+    /**
+     * Number of sound data bytes read so far.
+    */
+    size_t data_pos;
+};
+
+/**
+ * Writes a wav file one block of sound data at a time. The RIFF and "data"
+ * chunk sizes are written as zero and set when the writer is closed, so
+ * the output must be seekable.
+*/
+struct WavWriter {
+    /**
+     * File being written. Not owned by the writer.
+    */
+    struct FileInfo *fi;
+
+    /**
+     * File offset of the RIFF header.
+    */
+    long riff_offset;
+
+    /**
+     * File offset of the start of sound data.
+    */
+    long data_offset;
+};
+
 struct WavSampleLoop *WavSampleLoop_new(void);
 struct WavSampleChunk *WavSampleChunk_new(int number_loops);
 struct WavDataChunk *WavDataChunk_new(void);
@@ -394,4 +477,13 @@ double WavFile_get_frequency(struct WavFile *wav_file);
 void WavFile_set_frequency(struct WavFile *wav_file, double frequency);
 void WavFile_append_smpl_chunk(struct WavFile *wav_file, struct WavSampleChunk *chunk);
 
+struct WavReader *WavReader_new(struct FileInfo *fi);
+size_t WavReader_read(struct WavReader *reader, uint8_t *buffer, size_t max_len);
+void WavReader_free(struct WavReader *reader);
+
+struct WavWriter *WavWriter_new(struct FileInfo *fi, struct WavFmtChunk *fmt_chunk);
+void WavWriter_write(struct WavWriter *writer, const uint8_t *data, size_t len);
+size_t WavWriter_close(struct WavWriter *writer, struct WavSampleChunk *smpl_chunk);
+void WavWriter_free(struct WavWriter *writer);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,1171 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "debug.h"
+#include "machine_config.h"
+#include "common.h"
+#include "utility.h"
+#include "wav.h"
+#include "wav_convert.h"
+
+#if defined(__AVX__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/**
+ * This file contains code to convert .wav sound data into mono 16 bit PCM,
+ * for .aifc encoding.
+ * 
+ * Conversion is done a block at a time: decode to float, mix down to mono,
+ * resample, then dither and round to 16 bits. The input is read once, and
+ * the only full length buffer allocated is the output.
+ * 
+ * Float samples are scaled to the 16 bit range, so dither is one LSB.
+*/
+
+// forward declarations
+
+static uint32_t gcd_u32(uint32_t a, uint32_t b);
+static double bessel_i0(double x);
+static float dot_product_f32(const float *a, const float *b, int len);
+static size_t WavResampler_run(struct WavResampler *resampler, float *out, uint64_t limit);
+static void WavConverter_decode(struct WavConverter *converter, const uint8_t *data, size_t sample_count, float *out);
+static void WavConverter_downmix(struct WavConverter *converter, const float *in, size_t frame_count, float *out);
+static void WavConverter_quantize(struct WavConverter *converter, const float *in, size_t len, int16_t *out);
+
+// end forward declarations
+
+/**
+ * Allocates memory for a new {@code struct WavConvertOptions} and sets default values.
+ * @returns: pointer to new object.
+*/
+struct WavConvertOptions *WavConvertOptions_new(void)
+{
+    TRACE_ENTER(__func__)
+
+    struct WavConvertOptions *options = (struct WavConvertOptions *)malloc_zero(1, sizeof(struct WavConvertOptions));
+
+    options->dither = 1;
+    options->dither_seed = WAV_CONVERT_DEFAULT_DITHER_SEED;
+
+    TRACE_LEAVE(__func__)
+
+    return options;
+}
+
+/**
+ * Frees memory allocated to options.
+ * @param options: object to free.
+*/
+void WavConvertOptions_free(struct WavConvertOptions *options)
+{
+    TRACE_ENTER(__func__)
+
+    if (options == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    gaudio_free(options);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Creates a new resampler. The filter is a Kaiser windowed sinc, with cutoff below
+ * the lower of the two nyquist frequencies.
+ * @param in_rate: input sample rate.
+ * @param out_rate: output sample rate.
+ * @returns: pointer to new resampler.
+*/
+struct WavResampler *WavResampler_new(int in_rate, int out_rate)
+{
+    TRACE_ENTER(__func__)
+
+    struct WavResampler *resampler;
+    uint32_t divisor;
+    uint32_t phase;
+    double ratio;
+    double cutoff;
+    double i0_beta;
+    int tap;
+
+    if (in_rate <= 0 || out_rate <= 0)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid sample rate: in=%d, out=%d\n", __func__, __LINE__, in_rate, out_rate);
+    }
+
+    resampler = (struct WavResampler *)malloc_zero(1, sizeof(struct WavResampler));
+
+    divisor = gcd_u32((uint32_t)in_rate, (uint32_t)out_rate);
+    resampler->up = (uint32_t)out_rate / divisor;
+    resampler->down = (uint32_t)in_rate / divisor;
+    resampler->phase_count = resampler->up <= WAV_RESAMPLE_MAX_PHASES ? resampler->up : WAV_RESAMPLE_MAX_PHASES;
+
+    // When downsampling, the filter is stretched to the output rate.
+    ratio = (double)resampler->up / (double)resampler->down;
+    if (ratio > 1.0)
+    {
+        ratio = 1.0;
+    }
+
+    cutoff = ratio * WAV_RESAMPLE_ROLLOFF;
+
+    // round up so taps is a multiple of 8, for the dot product.
+    resampler->half_width = (int)ceil((double)WAV_RESAMPLE_HALF_TAPS / ratio);
+    resampler->half_width = (resampler->half_width + 3) & ~3;
+    resampler->taps = resampler->half_width * 2;
+
+    resampler->coef = (float *)malloc_zero((size_t)resampler->phase_count * (size_t)resampler->taps, sizeof(float));
+
+    i0_beta = bessel_i0(WAV_RESAMPLE_KAISER_BETA);
+
+    for (phase = 0; phase < resampler->phase_count; phase++)
+    {
+        float *row = &resampler->coef[(size_t)phase * (size_t)resampler->taps];
+        double sum = 0.0;
+
+        for (tap = 0; tap < resampler->taps; tap++)
+        {
+            // distance from the output sample to the input sample of this tap, in input samples.
+            double d = (double)phase / (double)resampler->phase_count + (double)(resampler->half_width - 1 - tap);
+            double w = d / (double)resampler->half_width;
+            double value;
+
+            if (w <= -1.0 || w >= 1.0)
+            {
+                value = 0.0;
+            }
+            else
+            {
+                double x = cutoff * d;
+                double sinc = x == 0.0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+
+                value = cutoff * sinc * bessel_i0(WAV_RESAMPLE_KAISER_BETA * sqrt(1.0 - w * w)) / i0_beta;
+            }
+
+            row[tap] = (float)value;
+            sum += value;
+        }
+
+        // unity gain at DC for every phase.
+        for (tap = 0; tap < resampler->taps; tap++)
+        {
+            row[tap] = (float)((double)row[tap] / sum);
+        }
+    }
+
+    // The buffer only needs to hold the filter history plus one block, zero padded
+    // so the first output sample is centered on the first input sample.
+    resampler->buffer_size = (size_t)resampler->taps + WAV_CONVERT_BLOCK_LEN;
+    resampler->buffer = (float *)malloc_zero(resampler->buffer_size, sizeof(float));
+    resampler->buffer_len = (size_t)(resampler->half_width - 1);
+    resampler->buffer_start = -(int64_t)(resampler->half_width - 1);
+
+    TRACE_LEAVE(__func__)
+
+    return resampler;
+}
+
+/**
+ * Gets the most samples a single call to {@code WavResampler_process} can produce.
+ * @param resampler: resampler.
+ * @param in_count: number of input samples.
+ * @returns: max number of output samples.
+*/
+size_t WavResampler_max_output(struct WavResampler *resampler, size_t in_count)
+{
+    TRACE_ENTER(__func__)
+
+    if (resampler == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> resampler is NULL\n", __func__, __LINE__);
+    }
+
+    size_t result = (size_t)(((uint64_t)in_count * resampler->up) / resampler->down) + 2;
+
+    TRACE_LEAVE(__func__)
+
+    return result;
+}
+
+/**
+ * Pushes samples into the resampler and reads out any samples that are ready.
+ * @param resampler: resampler.
+ * @param in: input samples.
+ * @param in_count: number of input samples.
+ * @param out: out parameter. Must have room for {@code WavResampler_max_output(resampler, in_count)} samples.
+ * @returns: number of samples written to {@code out}.
+*/
+size_t WavResampler_process(struct WavResampler *resampler, const float *in, size_t in_count, float *out)
+{
+    TRACE_ENTER(__func__)
+
+    if (resampler == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> resampler is NULL\n", __func__, __LINE__);
+    }
+
+    if (in == NULL && in_count > 0)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> in is NULL\n", __func__, __LINE__);
+    }
+
+    size_t total = 0;
+
+    while (in_count > 0)
+    {
+        size_t len = resampler->buffer_size - resampler->buffer_len;
+
+        if (len > in_count)
+        {
+            len = in_count;
+        }
+
+        memcpy(&resampler->buffer[resampler->buffer_len], in, len * sizeof(float));
+        resampler->buffer_len += len;
+        resampler->in_count += len;
+        in += len;
+        in_count -= len;
+
+        total += WavResampler_run(resampler, &out[total], UINT64_MAX);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return total;
+}
+
+/**
+ * Reads out the remaining samples, after all input has been pushed.
+ * The total output length is the input length scaled by the rate ratio, rounded up.
+ * @param resampler: resampler.
+ * @param out: out parameter. Must have room for {@code WavResampler_max_output(resampler, resampler->half_width)} samples.
+ * @returns: number of samples written to {@code out}.
+*/
+size_t WavResampler_flush(struct WavResampler *resampler, float *out)
+{
+    TRACE_ENTER(__func__)
+
+    if (resampler == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> resampler is NULL\n", __func__, __LINE__);
+    }
+
+    size_t total = 0;
+    uint64_t target = (resampler->in_count * resampler->up + resampler->down - 1) / resampler->down;
+
+    // pad the end of the input with silence.
+    while (resampler->out_count < target)
+    {
+        size_t len = resampler->buffer_size - resampler->buffer_len;
+
+        if (len > (size_t)resampler->half_width)
+        {
+            len = (size_t)resampler->half_width;
+        }
+
+        memset(&resampler->buffer[resampler->buffer_len], 0, len * sizeof(float));
+        resampler->buffer_len += len;
+
+        total += WavResampler_run(resampler, &out[total], target - resampler->out_count);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return total;
+}
+
+/**
+ * Frees memory allocated to resampler.
+ * @param resampler: object to free.
+*/
+void WavResampler_free(struct WavResampler *resampler)
+{
+    TRACE_ENTER(__func__)
+
+    if (resampler == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    if (resampler->coef != NULL)
+    {
+        gaudio_free(resampler->coef);
+        resampler->coef = NULL;
+    }
+
+    if (resampler->buffer != NULL)
+    {
+        gaudio_free(resampler->buffer);
+        resampler->buffer = NULL;
+    }
+
+    gaudio_free(resampler);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Creates a new converter for sound data in the given format.
+ * @param fmt_chunk: format of input sound data.
+ * @param options: Optional. Conversion options. If NULL, defaults are used.
+ * @returns: pointer to new converter.
+*/
+struct WavConverter *WavConverter_new(struct WavFmtChunk *fmt_chunk, const struct WavConvertOptions *options)
+{
+    TRACE_ENTER(__func__)
+
+    if (fmt_chunk == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> fmt_chunk is NULL\n", __func__, __LINE__);
+    }
+
+    struct WavConverter *converter;
+    int supported;
+
+    if (fmt_chunk->audio_format == WAV_AUDIO_FORMAT)
+    {
+        supported = fmt_chunk->bits_per_sample == 8
+            || fmt_chunk->bits_per_sample == 16
+            || fmt_chunk->bits_per_sample == 24
+            || fmt_chunk->bits_per_sample == 32;
+    }
+    else if (fmt_chunk->audio_format == WAV_AUDIO_FORMAT_IEEE_FLOAT)
+    {
+        supported = fmt_chunk->bits_per_sample == 32
+            || fmt_chunk->bits_per_sample == 64;
+    }
+    else
+    {
+        supported = 0;
+    }
+
+    if (!supported)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> unsupported .wav format: audio format %d, %d bits per sample\n", __func__, __LINE__, fmt_chunk->audio_format, fmt_chunk->bits_per_sample);
+    }
+
+    if (fmt_chunk->num_channels < 1)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid number of channels: %d\n", __func__, __LINE__, fmt_chunk->num_channels);
+    }
+
+    if (fmt_chunk->block_align != fmt_chunk->num_channels * (fmt_chunk->bits_per_sample / 8))
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> unsupported block align %d for %d channels, %d bits per sample\n", __func__, __LINE__, fmt_chunk->block_align, fmt_chunk->num_channels, fmt_chunk->bits_per_sample);
+    }
+
+    if (fmt_chunk->sample_rate <= 0)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> invalid sample rate: %d\n", __func__, __LINE__, fmt_chunk->sample_rate);
+    }
+
+    converter = (struct WavConverter *)malloc_zero(1, sizeof(struct WavConverter));
+
+    converter->audio_format = fmt_chunk->audio_format;
+    converter->bits_per_sample = fmt_chunk->bits_per_sample;
+    converter->num_channels = fmt_chunk->num_channels;
+    converter->block_align = fmt_chunk->block_align;
+    converter->in_rate = fmt_chunk->sample_rate;
+    converter->out_rate = fmt_chunk->sample_rate;
+    converter->dither = 1;
+    converter->rng = WAV_CONVERT_DEFAULT_DITHER_SEED;
+
+    if (options != NULL)
+    {
+        if (options->sample_rate > 0)
+        {
+            converter->out_rate = options->sample_rate;
+        }
+
+        converter->dither = options->dither;
+
+        // xorshift state can't be zero.
+        if (options->dither_seed != 0)
+        {
+            converter->rng = options->dither_seed;
+        }
+    }
+
+    if (converter->num_channels > 1)
+    {
+        converter->decoded = (float *)malloc_zero((size_t)WAV_CONVERT_BLOCK_LEN * (size_t)converter->num_channels, sizeof(float));
+    }
+
+    converter->mono = (float *)malloc_zero(WAV_CONVERT_BLOCK_LEN, sizeof(float));
+
+    if (converter->out_rate != converter->in_rate)
+    {
+        size_t flush_size;
+
+        converter->resampler = WavResampler_new(converter->in_rate, converter->out_rate);
+
+        converter->resampled_size = WavResampler_max_output(converter->resampler, WAV_CONVERT_BLOCK_LEN);
+        flush_size = WavResampler_max_output(converter->resampler, (size_t)converter->resampler->half_width);
+        if (flush_size > converter->resampled_size)
+        {
+            converter->resampled_size = flush_size;
+        }
+
+        converter->resampled = (float *)malloc_zero(converter->resampled_size, sizeof(float));
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return converter;
+}
+
+/**
+ * Gets the total number of output samples for the given input length.
+ * @param converter: converter.
+ * @param frame_count: total number of input frames.
+ * @returns: total number of samples written by {@code WavConverter_process} and {@code WavConverter_flush}.
+*/
+size_t WavConverter_output_len(struct WavConverter *converter, size_t frame_count)
+{
+    TRACE_ENTER(__func__)
+
+    if (converter == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> converter is NULL\n", __func__, __LINE__);
+    }
+
+    size_t result = frame_count;
+
+    if (converter->resampler != NULL)
+    {
+        result = (size_t)(((uint64_t)frame_count * converter->resampler->up + converter->resampler->down - 1) / converter->resampler->down);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return result;
+}
+
+/**
+ * Converts input frames and writes any output samples that are ready.
+ * @param converter: converter.
+ * @param data: sound data, in the format given when the converter was created.
+ * @param frame_count: number of frames in {@code data}.
+ * @param out: out parameter. 16 bit mono samples, native byte order.
+ * Must have room for {@code WavConverter_output_len(converter, frame_count) + 2} samples.
+ * @returns: number of samples written to {@code out}.
+*/
+size_t WavConverter_process(struct WavConverter *converter, const uint8_t *data, size_t frame_count, int16_t *out)
+{
+    TRACE_ENTER(__func__)
+
+    if (converter == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> converter is NULL\n", __func__, __LINE__);
+    }
+
+    if (data == NULL && frame_count > 0)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> data is NULL\n", __func__, __LINE__);
+    }
+
+    size_t total = 0;
+
+    while (frame_count > 0)
+    {
+        size_t len = frame_count < WAV_CONVERT_BLOCK_LEN ? frame_count : WAV_CONVERT_BLOCK_LEN;
+
+        if (converter->num_channels == 1)
+        {
+            WavConverter_decode(converter, data, len, converter->mono);
+        }
+        else
+        {
+            WavConverter_decode(converter, data, len * (size_t)converter->num_channels, converter->decoded);
+            WavConverter_downmix(converter, converter->decoded, len, converter->mono);
+        }
+
+        if (converter->resampler != NULL)
+        {
+            size_t resampled_len = WavResampler_process(converter->resampler, converter->mono, len, converter->resampled);
+            WavConverter_quantize(converter, converter->resampled, resampled_len, &out[total]);
+            total += resampled_len;
+        }
+        else
+        {
+            WavConverter_quantize(converter, converter->mono, len, &out[total]);
+            total += len;
+        }
+
+        data += len * (size_t)converter->block_align;
+        frame_count -= len;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return total;
+}
+
+/**
+ * Writes the remaining output samples, after all input has been processed.
+ * @param converter: converter.
+ * @param out: out parameter. 16 bit mono samples, native byte order.
+ * @returns: number of samples written to {@code out}.
+*/
+size_t WavConverter_flush(struct WavConverter *converter, int16_t *out)
+{
+    TRACE_ENTER(__func__)
+
+    if (converter == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> converter is NULL\n", __func__, __LINE__);
+    }
+
+    size_t total = 0;
+
+    if (converter->resampler != NULL)
+    {
+        total = WavResampler_flush(converter->resampler, converter->resampled);
+        WavConverter_quantize(converter, converter->resampled, total, out);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return total;
+}
+
+/**
+ * Frees memory allocated to converter.
+ * @param converter: object to free.
+*/
+void WavConverter_free(struct WavConverter *converter)
+{
+    TRACE_ENTER(__func__)
+
+    if (converter == NULL)
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    WavResampler_free(converter->resampler);
+    converter->resampler = NULL;
+
+    if (converter->decoded != NULL)
+    {
+        gaudio_free(converter->decoded);
+        converter->decoded = NULL;
+    }
+
+    if (converter->mono != NULL)
+    {
+        gaudio_free(converter->mono);
+        converter->mono = NULL;
+    }
+
+    if (converter->resampled != NULL)
+    {
+        gaudio_free(converter->resampled);
+        converter->resampled = NULL;
+    }
+
+    gaudio_free(converter);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Checks whether wav sound data needs to be converted before encoding.
+ * @param wav_file: wav file.
+ * @param options: Optional. Conversion options.
+ * @returns: 1 if the sound data is not mono 16 bit PCM at the requested sample rate, 0 otherwise.
+*/
+int WavFile_needs_convert(struct WavFile *wav_file, const struct WavConvertOptions *options)
+{
+    TRACE_ENTER(__func__)
+
+    if (wav_file == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> wav_file is NULL\n", __func__, __LINE__);
+    }
+
+    if (wav_file->fmt_chunk == NULL)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> fmt chunk not found\n", __func__, __LINE__);
+    }
+
+    int result = WavFmtChunk_needs_convert(wav_file->fmt_chunk, options);
+
+    TRACE_LEAVE(__func__)
+
+    return result;
+}
+
+/**
+ * Checks whether sound data in the given format needs to be converted before encoding.
+ * @param fmt: "fmt " chunk describing the sound data.
+ * @param options: Optional. Conversion options.
+ * @returns: 1 if the sound data is not mono 16 bit PCM at the requested sample rate, 0 otherwise.
+*/
+int WavFmtChunk_needs_convert(struct WavFmtChunk *fmt, const struct WavConvertOptions *options)
+{
+    TRACE_ENTER(__func__)
+
+    if (fmt == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> fmt is NULL\n", __func__, __LINE__);
+    }
+
+    int result;
+
+    result = fmt->audio_format != WAV_AUDIO_FORMAT
+        || fmt->bits_per_sample != 16
+        || fmt->num_channels != 1
+        || (options != NULL && options->sample_rate > 0 && options->sample_rate != fmt->sample_rate);
+
+    TRACE_LEAVE(__func__)
+
+    return result;
+}
+
+/**
+ * Updates "fmt " and "smpl" chunks to describe the converter output: the fmt chunk
+ * is set to mono 16 bit PCM at the output sample rate, and "smpl" loop points are
+ * scaled to the new sample rate.
+ * @param converter: converter.
+ * @param fmt: fmt chunk to update.
+ * @param smpl: Optional. smpl chunk to update.
+*/
+void WavConverter_update_chunks(struct WavConverter *converter, struct WavFmtChunk *fmt, struct WavSampleChunk *smpl)
+{
+    TRACE_ENTER(__func__)
+
+    if (converter == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> converter is NULL\n", __func__, __LINE__);
+    }
+
+    if (fmt == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> fmt is NULL\n", __func__, __LINE__);
+    }
+
+    int in_rate = converter->in_rate;
+    int out_rate = converter->out_rate;
+
+    fmt->ck_data_size = WAV_FMT_CHUNK_BODY_SIZE;
+    fmt->audio_format = WAV_AUDIO_FORMAT;
+    fmt->num_channels = 1;
+    fmt->bits_per_sample = 16;
+    fmt->block_align = 2;
+    fmt->sample_rate = out_rate;
+    fmt->byte_rate = fmt->sample_rate * fmt->block_align;
+
+    if (smpl != NULL && in_rate != out_rate)
+    {
+        int i;
+
+        if (smpl->sample_period != 0)
+        {
+            smpl->sample_period = (int32_t)(1000000000 / out_rate);
+        }
+
+        for (i = 0; i < smpl->num_sample_loops; i++)
+        {
+            struct WavSampleLoop *loop = smpl->loops[i];
+
+            loop->start = (uint32_t)(((uint64_t)loop->start * (uint64_t)out_rate + (uint64_t)(in_rate / 2)) / (uint64_t)in_rate);
+            loop->end = (uint32_t)(((uint64_t)loop->end * (uint64_t)out_rate + (uint64_t)(in_rate / 2)) / (uint64_t)in_rate);
+        }
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Converts wav sound data to mono 16 bit PCM at the requested sample rate, in place.
+ * The fmt chunk is updated to match, and "smpl" loop points are scaled to the
+ * new sample rate. Does nothing if the sound data is already in the requested format.
+ * @param wav_file: wav file to convert.
+ * @param options: Optional. Conversion options. If NULL, defaults are used.
+*/
+void WavFile_convert(struct WavFile *wav_file, const struct WavConvertOptions *options)
+{
+    TRACE_ENTER(__func__)
+
+    if (wav_file == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> wav_file is NULL\n", __func__, __LINE__);
+    }
+
+    if (wav_file->data_chunk == NULL)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> data chunk not found\n", __func__, __LINE__);
+    }
+
+    if (!WavFile_needs_convert(wav_file, options))
+    {
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    struct WavFmtChunk *fmt = wav_file->fmt_chunk;
+    struct WavConverter *converter;
+    int16_t *samples;
+    size_t frame_count;
+    size_t sample_count;
+    size_t len;
+    int in_rate;
+    int out_rate;
+
+    converter = WavConverter_new(fmt, options);
+
+    in_rate = converter->in_rate;
+    out_rate = converter->out_rate;
+    frame_count = (size_t)wav_file->data_chunk->ck_data_size / (size_t)converter->block_align;
+    sample_count = WavConverter_output_len(converter, frame_count);
+
+    if (g_verbosity >= VERBOSE_DEBUG)
+    {
+        printf("convert %d channel(s), %d bit %s, %d Hz to mono 16 bit, %d Hz\n",
+            fmt->num_channels,
+            fmt->bits_per_sample,
+            fmt->audio_format == WAV_AUDIO_FORMAT_IEEE_FLOAT ? "float" : "PCM",
+            in_rate,
+            out_rate);
+    }
+
+    // extra room for WavConverter_process.
+    samples = (int16_t *)malloc_zero(sample_count + 2, sizeof(int16_t));
+
+    len = WavConverter_process(converter, wav_file->data_chunk->data, frame_count, samples);
+    len += WavConverter_flush(converter, &samples[len]);
+
+    if (len != sample_count)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> converted %ld samples, expected %ld\n", __func__, __LINE__, (long)len, (long)sample_count);
+    }
+
+    // RIFF size changes by the difference in data size.
+    wav_file->ck_data_size -= wav_file->data_chunk->ck_data_size;
+    wav_file->ck_data_size += (int32_t)(sample_count * sizeof(int16_t));
+
+    gaudio_free(wav_file->data_chunk->data);
+    wav_file->data_chunk->data = (uint8_t *)samples;
+    wav_file->data_chunk->ck_data_size = (int32_t)(sample_count * sizeof(int16_t));
+
+    WavConverter_update_chunks(converter, fmt, wav_file->smpl_chunk);
+
+    WavConverter_free(converter);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Greatest common divisor.
+ * @param a: first value.
+ * @param b: second value.
+ * @returns: greatest common divisor.
+*/
+static uint32_t gcd_u32(uint32_t a, uint32_t b)
+{
+    TRACE_ENTER(__func__)
+
+    while (b != 0)
+    {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return a;
+}
+
+/**
+ * Zeroth order modified Bessel function of the first kind, for the Kaiser window.
+ * @param x: value.
+ * @returns: I0(x).
+*/
+static double bessel_i0(double x)
+{
+    TRACE_ENTER(__func__)
+
+    double sum = 1.0;
+    double term = 1.0;
+    double half = x / 2.0;
+    int k;
+
+    for (k = 1; k < 64; k++)
+    {
+        term *= (half / k) * (half / k);
+        sum += term;
+
+        if (term < sum * 1e-12)
+        {
+            break;
+        }
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return sum;
+}
+
+/**
+ * Dot product of two float arrays. Uses AVX or SSE when the compiler targets it.
+ * @param a: first array.
+ * @param b: second array.
+ * @param len: number of elements.
+ * @returns: dot product.
+*/
+static float dot_product_f32(const float *a, const float *b, int len)
+{
+    TRACE_ENTER(__func__)
+
+    float result = 0.0f;
+    int i = 0;
+
+#if defined(__SSE2__)
+    __m128 acc = _mm_setzero_ps();
+
+#  if defined(__AVX__)
+    __m256 acc256 = _mm256_setzero_ps();
+
+    for (; i + 8 <= len; i += 8)
+    {
+        acc256 = _mm256_add_ps(acc256, _mm256_mul_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i])));
+    }
+
+    acc = _mm_add_ps(_mm256_castps256_ps128(acc256), _mm256_extractf128_ps(acc256, 1));
+#  endif
+
+    for (; i + 4 <= len; i += 4)
+    {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(&a[i]), _mm_loadu_ps(&b[i])));
+    }
+
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    result = _mm_cvtss_f32(acc);
+#endif
+
+    for (; i < len; i++)
+    {
+        result += a[i] * b[i];
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return result;
+}
+
+/**
+ * Writes output samples until the buffered input runs out or the limit is reached,
+ * then drops input history that is no longer needed.
+ * @param resampler: resampler.
+ * @param out: out parameter.
+ * @param limit: max number of samples to write.
+ * @returns: number of samples written to {@code out}.
+*/
+static size_t WavResampler_run(struct WavResampler *resampler, float *out, uint64_t limit)
+{
+    TRACE_ENTER(__func__)
+
+    size_t count = 0;
+    int64_t buffer_end = resampler->buffer_start + (int64_t)resampler->buffer_len;
+    int64_t keep;
+
+    while (count < limit)
+    {
+        // output sample n is at input position n * down / up.
+        uint64_t position = resampler->out_count * resampler->down;
+        int64_t index = (int64_t)(position / resampler->up);
+        uint64_t phase = position % resampler->up;
+
+        if (index + resampler->half_width >= buffer_end)
+        {
+            break;
+        }
+
+        if (resampler->phase_count != resampler->up)
+        {
+            phase = (phase * resampler->phase_count) / resampler->up;
+        }
+
+        out[count] = dot_product_f32(
+            &resampler->buffer[index - resampler->half_width + 1 - resampler->buffer_start],
+            &resampler->coef[phase * (uint64_t)resampler->taps],
+            resampler->taps);
+
+        count++;
+        resampler->out_count++;
+    }
+
+    // first input sample needed by the next output sample.
+    keep = (int64_t)((resampler->out_count * resampler->down) / resampler->up) - resampler->half_width + 1;
+
+    if (keep > resampler->buffer_start)
+    {
+        size_t drop = (size_t)(keep - resampler->buffer_start);
+
+        if (drop > resampler->buffer_len)
+        {
+            drop = resampler->buffer_len;
+        }
+
+        memmove(resampler->buffer, &resampler->buffer[drop], (resampler->buffer_len - drop) * sizeof(float));
+        resampler->buffer_len -= drop;
+        resampler->buffer_start += (int64_t)drop;
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return count;
+}
+
+/**
+ * Decodes little endian samples to float, scaled to the 16 bit range.
+ * @param converter: converter.
+ * @param data: sound data.
+ * @param sample_count: number of samples (frames times channels).
+ * @param out: out parameter.
+*/
+static void WavConverter_decode(struct WavConverter *converter, const uint8_t *data, size_t sample_count, float *out)
+{
+    TRACE_ENTER(__func__)
+
+    size_t i = 0;
+
+    if (converter->audio_format == WAV_AUDIO_FORMAT_IEEE_FLOAT)
+    {
+        if (converter->bits_per_sample == 32)
+        {
+#if defined(__SSE2__)
+            const __m128 scale = _mm_set1_ps(32768.0f);
+
+            for (; i + 4 <= sample_count; i += 4)
+            {
+                _mm_storeu_ps(&out[i], _mm_mul_ps(_mm_loadu_ps((const float *)&data[i * 4]), scale));
+            }
+#endif
+            for (; i < sample_count; i++)
+            {
+                float f;
+                memcpy(&f, &data[i * 4], 4);
+                out[i] = f * 32768.0f;
+            }
+        }
+        else
+        {
+            for (; i < sample_count; i++)
+            {
+                double d;
+                memcpy(&d, &data[i * 8], 8);
+                out[i] = (float)(d * 32768.0);
+            }
+        }
+
+        TRACE_LEAVE(__func__)
+        return;
+    }
+
+    switch (converter->bits_per_sample)
+    {
+        case 8:
+        // 8 bit PCM is unsigned.
+        for (; i < sample_count; i++)
+        {
+            out[i] = (float)(((int)data[i] - 128) * 256);
+        }
+        break;
+
+        case 16:
+#if defined(__SSE2__)
+        for (; i + 8 <= sample_count; i += 8)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)&data[i * 2]);
+
+            // sign extend to 32 bits
+            _mm_storeu_ps(&out[i], _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)));
+            _mm_storeu_ps(&out[i + 4], _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)));
+        }
+#endif
+        for (; i < sample_count; i++)
+        {
+            int16_t s;
+            memcpy(&s, &data[i * 2], 2);
+            out[i] = (float)s;
+        }
+        break;
+
+        case 24:
+        for (; i < sample_count; i++)
+        {
+            const uint8_t *p = &data[i * 3];
+            uint32_t u = ((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24);
+            out[i] = (float)(int32_t)u * (1.0f / 65536.0f);
+        }
+        break;
+
+        case 32:
+        {
+#if defined(__SSE2__)
+            const __m128 scale = _mm_set1_ps(1.0f / 65536.0f);
+
+            for (; i + 4 <= sample_count; i += 4)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i *)&data[i * 4]);
+                _mm_storeu_ps(&out[i], _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+            }
+#endif
+            for (; i < sample_count; i++)
+            {
+                int32_t s;
+                memcpy(&s, &data[i * 4], 4);
+                out[i] = (float)s * (1.0f / 65536.0f);
+            }
+        }
+        break;
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Mixes interleaved channels down to mono, each channel with equal gain.
+ * @param converter: converter.
+ * @param in: interleaved samples.
+ * @param frame_count: number of frames.
+ * @param out: out parameter.
+*/
+static void WavConverter_downmix(struct WavConverter *converter, const float *in, size_t frame_count, float *out)
+{
+    TRACE_ENTER(__func__)
+
+    size_t i = 0;
+    int channels = converter->num_channels;
+
+    if (channels == 2)
+    {
+#if defined(__SSE2__)
+        const __m128 half = _mm_set1_ps(0.5f);
+
+        for (; i + 4 <= frame_count; i += 4)
+        {
+            __m128 a = _mm_loadu_ps(&in[i * 2]);
+            __m128 b = _mm_loadu_ps(&in[i * 2 + 4]);
+            __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+
+            _mm_storeu_ps(&out[i], _mm_mul_ps(_mm_add_ps(left, right), half));
+        }
+#endif
+        for (; i < frame_count; i++)
+        {
+            out[i] = (in[i * 2] + in[i * 2 + 1]) * 0.5f;
+        }
+    }
+    else
+    {
+        float gain = 1.0f / (float)channels;
+
+        for (; i < frame_count; i++)
+        {
+            const float *frame = &in[i * (size_t)channels];
+            float sum = 0.0f;
+            int c;
+
+            for (c = 0; c < channels; c++)
+            {
+                sum += frame[c];
+            }
+
+            out[i] = sum * gain;
+        }
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Rounds to 16 bit samples, with optional triangular (TPDF) dither of one LSB.
+ * @param converter: converter.
+ * @param in: samples, scaled to the 16 bit range.
+ * @param len: number of samples.
+ * @param out: out parameter.
+*/
+static void WavConverter_quantize(struct WavConverter *converter, const float *in, size_t len, int16_t *out)
+{
+    TRACE_ENTER(__func__)
+
+    size_t i;
+    uint32_t rng = converter->rng;
+
+    for (i = 0; i < len; i++)
+    {
+        float x = in[i];
+        long v;
+
+        if (converter->dither)
+        {
+            float r1;
+            float r2;
+
+            // xorshift32
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            r1 = (float)(rng >> 8) * (1.0f / 16777216.0f);
+
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            r2 = (float)(rng >> 8) * (1.0f / 16777216.0f);
+
+            x += r1 - r2;
+        }
+
+        v = lrintf(x);
+
+        if (v > INT16_MAX)
+        {
+            v = INT16_MAX;
+        }
+        else if (v < INT16_MIN)
+        {
+            v = INT16_MIN;
+        }
+
+        out[i] = (int16_t)v;
+    }
+
+    converter->rng = rng;
+
+    TRACE_LEAVE(__func__)
+}
@@ -0,0 +1,245 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#ifndef _GAUDIO_WAV_CONVERT_H_
+#define _GAUDIO_WAV_CONVERT_H_
+
+#include <stdint.h>
+#include "wav.h"
+
+/**
+ * This file contains structs and defines for converting .wav sound data
+ * into the format accepted by the .aifc encoder: mono 16 bit PCM.
+ * 
+ * Supported input is 8, 16, 24, or 32 bit integer PCM, or 32 or 64 bit float,
+ * with any number of channels. Channels are mixed down to mono, the result is
+ * optionally resampled to a new sample rate, then dithered to 16 bits.
+*/
+
+/**
+ * Number of frames converted at a time.
+*/
+#define WAV_CONVERT_BLOCK_LEN 1024
+
+/**
+ * Dither seed used when not otherwise specified.
+ * Fixed, so converting the same file gives the same output.
+*/
+#define WAV_CONVERT_DEFAULT_DITHER_SEED 0x2545f491
+
+/**
+ * Resampler, number of filter taps on each side of the output sample
+ * when upsampling. Downsampling scales this up by the rate ratio.
+*/
+#define WAV_RESAMPLE_HALF_TAPS 16
+
+/**
+ * Resampler, max number of filter phases. Rate ratios that need more
+ * phases than this use the nearest phase below.
+*/
+#define WAV_RESAMPLE_MAX_PHASES 4096
+
+/**
+ * Resampler, cutoff frequency as a fraction of the lower nyquist frequency.
+*/
+#define WAV_RESAMPLE_ROLLOFF 0.945
+
+/**
+ * Resampler, Kaiser window beta parameter.
+*/
+#define WAV_RESAMPLE_KAISER_BETA 9.0
+
+/**
+ * Options for {@code WavFile_convert}.
+*/
+struct WavConvertOptions {
+    /**
+     * Output sample rate. If zero, the input sample rate is kept.
+    */
+    int sample_rate;
+
+    /**
+     * Flag, add triangular dither before rounding to 16 bits.
+     * Default 1.
+    */
+    int dither;
+
+    /**
+     * Dither random number seed.
+    */
+    uint32_t dither_seed;
+};
+
+/**
+ * Polyphase windowed sinc resampler, converts between two sample rates
+ * with a rational ratio. Samples are pushed in blocks, only the filter
+ * history is kept between blocks.
+*/
+struct WavResampler {
+    /**
+     * Upsample factor, output rate divided by greatest common divisor.
+    */
+    uint32_t up;
+
+    /**
+     * Downsample factor, input rate divided by greatest common divisor.
+    */
+    uint32_t down;
+
+    /**
+     * Number of filter phases, {@code up} or {@code WAV_RESAMPLE_MAX_PHASES}.
+    */
+    uint32_t phase_count;
+
+    /**
+     * Number of input samples on each side of an output sample.
+    */
+    int half_width;
+
+    /**
+     * Number of coefficients per phase, twice {@code half_width}.
+    */
+    int taps;
+
+    /**
+     * Filter coefficients, {@code phase_count} rows of {@code taps}.
+    */
+    float *coef;
+
+    /**
+     * Input history.
+    */
+    float *buffer;
+
+    /**
+     * Number of samples in {@code buffer}.
+    */
+    size_t buffer_len;
+
+    /**
+     * Allocated length of {@code buffer}.
+    */
+    size_t buffer_size;
+
+    /**
+     * Input sample index of {@code buffer[0]}. Negative at the start of the
+     * input, when the history is zero padding.
+    */
+    int64_t buffer_start;
+
+    /**
+     * Number of samples pushed.
+    */
+    uint64_t in_count;
+
+    /**
+     * Number of samples produced.
+    */
+    uint64_t out_count;
+};
+
+/**
+ * Converts blocks of .wav sound data to mono 16 bit PCM.
+*/
+struct WavConverter {
+    /**
+     * Input audio format, see {@code struct WavFmtChunk}.
+    */
+    int audio_format;
+
+    /**
+     * Input bits per sample.
+    */
+    int bits_per_sample;
+
+    /**
+     * Input number of channels.
+    */
+    int num_channels;
+
+    /**
+     * Input bytes per frame.
+    */
+    int block_align;
+
+    /**
+     * Input sample rate.
+    */
+    int in_rate;
+
+    /**
+     * Output sample rate.
+    */
+    int out_rate;
+
+    /**
+     * Flag, add dither when rounding.
+    */
+    int dither;
+
+    /**
+     * Dither random number state.
+    */
+    uint32_t rng;
+
+    /**
+     * Resampler, or NULL if the input and output rate are the same.
+    */
+    struct WavResampler *resampler;
+
+    /**
+     * Block of decoded samples, all channels.
+    */
+    float *decoded;
+
+    /**
+     * Block of mono samples.
+    */
+    float *mono;
+
+    /**
+     * Block of resampled samples.
+    */
+    float *resampled;
+
+    /**
+     * Allocated length of {@code resampled}.
+    */
+    size_t resampled_size;
+};
+
+struct WavConvertOptions *WavConvertOptions_new(void);
+void WavConvertOptions_free(struct WavConvertOptions *options);
+
+struct WavResampler *WavResampler_new(int in_rate, int out_rate);
+size_t WavResampler_max_output(struct WavResampler *resampler, size_t in_count);
+size_t WavResampler_process(struct WavResampler *resampler, const float *in, size_t in_count, float *out);
+size_t WavResampler_flush(struct WavResampler *resampler, float *out);
+void WavResampler_free(struct WavResampler *resampler);
+
+struct WavConverter *WavConverter_new(struct WavFmtChunk *fmt_chunk, const struct WavConvertOptions *options);
+size_t WavConverter_output_len(struct WavConverter *converter, size_t frame_count);
+size_t WavConverter_process(struct WavConverter *converter, const uint8_t *data, size_t frame_count, int16_t *out);
+size_t WavConverter_flush(struct WavConverter *converter, int16_t *out);
+void WavConverter_update_chunks(struct WavConverter *converter, struct WavFmtChunk *fmt, struct WavSampleChunk *smpl);
+void WavConverter_free(struct WavConverter *converter);
+
+int WavFmtChunk_needs_convert(struct WavFmtChunk *fmt, const struct WavConvertOptions *options);
+int WavFile_needs_convert(struct WavFile *wav_file, const struct WavConvertOptions *options);
+void WavFile_convert(struct WavFile *wav_file, const struct WavConvertOptions *options);
+
+#endif
@@ -23,9 +23,11 @@
 #include "debug.h"
 #include "common.h"
 #include "utility.h"
+#include "parallel.h"
 #include "naudio.h"
 #include "adpcm_aifc.h"
 #include "wav.h"
+#include "wav_convert.h"
 #include "int_hash.h"
 #include "string_hash.h"
 #include "x.h"
@@ -34,25 +36,31 @@
  * This contains code that converts between audio formats.
 */
 
+/**
+ * Shared state when encoding .wav sound data with several codebooks.
+*/
+struct AdpcmAifcTrialJob {
+    struct WavFile *wav_file;
+
+    // result for each codebook.
+    struct AdpcmAifcCodebookTrial *trials;
+};
+
 // forward declarations
 
-static void ALBankFile_write_natural_order_envelope_ctl(struct ALBankFile *bank_file, uint8_t *buffer, size_t buffer_size, int *pos_ptr);
-static void ALBankFile_write_natural_order_keymap_ctl(struct ALBankFile *bank_file, uint8_t *buffer, size_t buffer_size, int *pos_ptr);
-static void ALBankFile_write_natural_order_sound_ctl(struct ALBankFile *bank_file, uint8_t *buffer, size_t buffer_size, int *pos_ptr);
-static void ALBankFile_write_instrument_ctl(struct ALBankFile *bank_file, uint8_t *buffer, size_t buffer_size, int *pos_ptr);
-static void ALBankFile_write_bank_ctl(struct ALBankFile *bank_file, uint8_t *buffer, size_t buffer_size, int *pos_ptr);
+static struct AdpcmAifcFile *AdpcmAifcFile_new_header_from_wav(struct WavFmtChunk *fmt_chunk, struct WavSampleChunk *smpl_chunk, struct ALADPCMBook *book, size_t *ck_data_size);
+static void AdpcmAifcFile_new_from_wav_trial(int index, void *state);
+static int32_t ALWaveTable_plan_ctl(struct ALWaveTable *wavetable, int32_t pos);
+static void ALSound_write_ctl(struct ALSound *sound, uint8_t *buffer);
+static void ALWaveTable_write_ctl(struct ALWaveTable *wavetable, uint8_t *buffer);
+static void ALEnvelope_write_ctl(struct ALEnvelope *envelope, uint8_t *buffer);
+static void ALKeyMap_write_ctl(struct ALKeyMap *keymap, uint8_t *buffer);
+static void ALInstrument_write_ctl(struct ALInstrument *instrument, uint8_t *buffer);
+static void ALBank_write_ctl(struct ALBank *bank, uint8_t *buffer, int32_t offset);
 
 static void ALBankFile_populate_wavetables_from_aifc(struct ALBankFile *bank_file);
 static void ALWaveTable_populate_from_aifc(struct ALWaveTable *wavetable, struct AdpcmAifcFile *aifc_file);
 
-static void ALBankFile_write_meta_order_envelope_ctl(struct ALBankFile *bank_file, uint8_t *buffer, size_t buffer_size, int *pos_ptr);
-static void ALBankFile_write_meta_order_keymap_ctl(struct ALBankFile *bank_file, uint8_t *buffer, size_t buffer_size, int *pos_ptr);
-static void ALBankFile_write_meta_order_sound_ctl(struct ALBankFile *bank_file, uint8_t *buffer, size_t buffer_size, int *pos_ptr);
-
-static int LinkedListNode_sound_keymap_write_order_compare_smaller(struct LinkedListNode *first, struct LinkedListNode *second);
-static int LinkedListNode_sound_envelope_write_order_compare_smaller(struct LinkedListNode *first, struct LinkedListNode *second);
-static int LinkedListNode_sound_write_order_compare_smaller(struct LinkedListNode *first, struct LinkedListNode *second);
-
 // end forward declarations
 
 /**
@@ -378,8 +386,9 @@ void write_bank_to_aifc(struct ALBankFile *bank_file, uint8_t *tbl_file_contents
 
     struct FileInfo *output;
     int i,j,k;
+    uint32_t generation;
 
-    ALBankFile_clear_visited_flags(bank_file);
+    generation = ALBankFile_begin_visit(bank_file);
 
     for (i=0; i<bank_file->bank_count; i++)
     {
@@ -401,9 +410,9 @@ void write_bank_to_aifc(struct ALBankFile *bank_file, uint8_t *tbl_file_contents
                     stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d> sound->wavetable is NULL\n", __func__, __LINE__);
                 }
 
-                if (sound->wavetable->visited == 0)
+                if (sound->wavetable->visited_generation != generation)
                 {
-                    sound->wavetable->visited = 1;
+                    sound->wavetable->visited_generation = generation;
 
                     if (g_verbosity >= VERBOSE_DEBUG)
                     {
@@ -445,20 +454,40 @@ void AdpcmAifcFile_add_partial_loop_from_wav(struct AdpcmAifcFile *aaf, struct W
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: aaf is NULL\n", __func__, __LINE__);
     }
 
-    if (wav->smpl_chunk == NULL)
+    AdpcmAifcFile_add_partial_loop_from_smpl(aaf, wav->smpl_chunk);
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Helper method.
+ * If the "smpl" chunk has a loop then an application loop chunk is appended
+ * to the .aifc file. This only partially sets the loop data in the .aifc file
+ * because decode state information is not available here.
+ * @param aaf: aifc file to append chunk to.
+ * @param smpl_chunk: Optional. wav "smpl" chunk to get loop from.
+*/
+void AdpcmAifcFile_add_partial_loop_from_smpl(struct AdpcmAifcFile *aaf, struct WavSampleChunk *smpl_chunk)
+{
+    TRACE_ENTER(__func__)
+
+    if (aaf == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: aaf is NULL\n", __func__, __LINE__);
+    }
+
+    if (smpl_chunk == NULL)
     {
         TRACE_LEAVE(__func__)
         return;
     }
 
-    if (wav->smpl_chunk->num_sample_loops == 0)
+    if (smpl_chunk->num_sample_loops == 0)
     {
         TRACE_LEAVE(__func__)
         return;
     }
 
-    struct WavSampleChunk *smpl_chunk = wav->smpl_chunk;
-
     // Should only be one loop.
     // Checked for zero loops above.
     if (smpl_chunk->num_sample_loops != 1)
@@ -522,16 +551,42 @@ void WavFile_check_append_aifc_loop(struct WavFile *wav, struct AdpcmAifcFile *a
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: aaf is NULL\n", __func__, __LINE__);
     }
 
+    struct WavSampleChunk *wav_sample_chunk = WavSampleChunk_new_from_aifc_loop(aaf);
+
+    // done with conversion. Add to wav.
+    if (wav_sample_chunk != NULL)
+    {
+        WavFile_append_smpl_chunk(wav, wav_sample_chunk);
+    }
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Helper method.
+ * Creates a wav "smpl" chunk from the .aifc loop.
+ * @param aaf: aifc file to get loop information from.
+ * @returns: new smpl chunk, or NULL if the .aifc file doesn't have a loop.
+*/
+struct WavSampleChunk *WavSampleChunk_new_from_aifc_loop(struct AdpcmAifcFile *aaf)
+{
+    TRACE_ENTER(__func__)
+
+    if (aaf == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: aaf is NULL\n", __func__, __LINE__);
+    }
+
     if (aaf->loop_chunk == NULL)
     {
         TRACE_LEAVE(__func__)
-        return;
+        return NULL;
     }
 
     if (aaf->loop_chunk->nloops == 0)
     {
         TRACE_LEAVE(__func__)
-        return;
+        return NULL;
     }
 
     struct AdpcmAifcLoopChunk *aifc_loop_chunk = aaf->loop_chunk;
@@ -550,7 +605,7 @@ void WavFile_check_append_aifc_loop(struct WavFile *wav, struct AdpcmAifcFile *a
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: aifc_loop_data is NULL\n", __func__, __LINE__);
     }
 
-    // ok, made it this far, try to add this to the wav file.
+    // ok, made it this far, convert to wav loop.
     struct WavSampleChunk *wav_sample_chunk = WavSampleChunk_new(1);
     struct WavSampleLoop *wav_loop = wav_sample_chunk->loops[0];
 
@@ -572,10 +627,9 @@ void WavFile_check_append_aifc_loop(struct WavFile *wav, struct AdpcmAifcFile *a
         wav_loop->play_count = aifc_loop_data->count;
     }
 
-    // done with conversion. Add to wav.
-    WavFile_append_smpl_chunk(wav, wav_sample_chunk);
-
     TRACE_LEAVE(__func__)
+
+    return wav_sample_chunk;
 }
 
 /**
@@ -600,16 +654,9 @@ struct WavFile *WavFile_new_from_aifc(struct AdpcmAifcFile *aifc_file)
     struct WavFile *wav = WavFile_new(WAV_DEFAULT_NUM_CHUNKS);
 
     // "fmt " chunk
-    wav->fmt_chunk = WavFmtChunk_new();
+    wav->fmt_chunk = WavFmtChunk_new_from_aifc(aifc_file);
     wav->chunks[0] = wav->fmt_chunk;
 
-    wav->fmt_chunk->audio_format = WAV_AUDIO_FORMAT;
-    wav->fmt_chunk->num_channels = 1;
-    wav->fmt_chunk->sample_rate = AdpcmAifcFile_get_int_sample_rate(aifc_file);
-    wav->fmt_chunk->bits_per_sample = aifc_file->comm_chunk->sample_size;
-    wav->fmt_chunk->byte_rate = wav->fmt_chunk->sample_rate * wav->fmt_chunk->num_channels * wav->fmt_chunk->bits_per_sample/8;
-    wav->fmt_chunk->block_align = wav->fmt_chunk->num_channels * wav->fmt_chunk->bits_per_sample/8;
-
     // "data" chunk
     wav->data_chunk = WavDataChunk_new();
     wav->chunks[1] = wav->data_chunk;
@@ -631,6 +678,39 @@ struct WavFile *WavFile_new_from_aifc(struct AdpcmAifcFile *aifc_file)
     return wav;
 }
 
+/**
+ * Creates wav "fmt " chunk describing the decoded .aifc audio.
+ * @param aifc_file: aifc file.
+ * @returns: new fmt chunk.
+*/
+struct WavFmtChunk *WavFmtChunk_new_from_aifc(struct AdpcmAifcFile *aifc_file)
+{
+    TRACE_ENTER(__func__)
+
+    if (aifc_file == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: aifc_file is NULL\n", __func__, __LINE__);
+    }
+
+    if (aifc_file->comm_chunk == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: aifc_file->comm_chunk is NULL\n", __func__, __LINE__);
+    }
+
+    struct WavFmtChunk *fmt_chunk = WavFmtChunk_new();
+
+    fmt_chunk->audio_format = WAV_AUDIO_FORMAT;
+    fmt_chunk->num_channels = 1;
+    fmt_chunk->sample_rate = AdpcmAifcFile_get_int_sample_rate(aifc_file);
+    fmt_chunk->bits_per_sample = aifc_file->comm_chunk->sample_size;
+    fmt_chunk->byte_rate = fmt_chunk->sample_rate * fmt_chunk->num_channels * fmt_chunk->bits_per_sample/8;
+    fmt_chunk->block_align = fmt_chunk->num_channels * fmt_chunk->bits_per_sample/8;
+
+    TRACE_LEAVE(__func__)
+
+    return fmt_chunk;
+}
+
 /**
  * Converts .wav to .aifc.
  * This is the main entry point for .wav to .aifc conversion.
@@ -664,14 +744,162 @@ struct AdpcmAifcFile *AdpcmAifcFile_new_from_wav(struct WavFile *wav_file, struc
     }
 
     struct AdpcmAifcFile *aaf;
-    struct AdpcmAifcCommChunk *comm;
-    uint32_t compression_type;
-    f80 extended_float_sample_rate;
     size_t aifc_root_ck_data_size = 0;
     size_t sound_data_len = 0;
 
     sound_data_len = wav_file->data_chunk->ck_data_size - 8;
 
+    aaf = AdpcmAifcFile_new_header_from_wav(wav_file->fmt_chunk, wav_file->smpl_chunk, book, &aifc_root_ck_data_size);
+
+    // Load sound data. When codebook was created the incoming format was validated,
+    // so it should be safe to copy straight from wav sound data without any processing here.
+    AdpcmAifcFile_encode(aaf, wav_file->data_chunk->data, sound_data_len);
+    
+    // chunk ck_data_size doesn't count bytes for id + ck_data_size so add 8.
+    aifc_root_ck_data_size += 8 + aaf->sound_chunk->ck_data_size;
+
+    // set total file size
+    aaf->ck_data_size = (int32_t)aifc_root_ck_data_size;
+
+    TRACE_LEAVE(__func__)
+
+    return aaf;
+}
+
+/**
+ * Converts .wav to .aifc once with each codebook, and measures the result.
+ * The codebooks are encoded concurrently, see {@code parallel_for}.
+ * @param wav_file: wav file and sound data to convert, mono 16 bit PCM.
+ * @param books: codebooks to try.
+ * @param book_count: number of elements in {@code books}, at least one.
+ * @param trials: out parameter. Array of {@code book_count} elements, result for each codebook.
+ * The caller frees each {@code aaf}.
+ * @returns: index of the best result. This is the smallest square error, then
+ * the smallest max clip, then the smallest file, then the first codebook.
+*/
+int AdpcmAifcFile_new_from_wav_trials(struct WavFile *wav_file, struct ALADPCMBook **books, int book_count, struct AdpcmAifcCodebookTrial *trials)
+{
+    TRACE_ENTER(__func__)
+
+    if (wav_file == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: wav_file is NULL\n", __func__, __LINE__);
+    }
+
+    if (books == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: books is NULL\n", __func__, __LINE__);
+    }
+
+    if (trials == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: trials is NULL\n", __func__, __LINE__);
+    }
+
+    if (book_count < 1)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d>: invalid book_count: %d\n", __func__, __LINE__, book_count);
+    }
+
+    struct AdpcmAifcTrialJob job;
+    struct AdpcmAifcCodebookTrial *best;
+    struct AdpcmAifcCodebookTrial *trial;
+    int best_index;
+    int i;
+
+    for (i=0; i<book_count; i++)
+    {
+        if (books[i] == NULL)
+        {
+            stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: books[%d] is NULL\n", __func__, __LINE__, i);
+        }
+
+        memset(&trials[i], 0, sizeof(struct AdpcmAifcCodebookTrial));
+        trials[i].book = books[i];
+    }
+
+    job.wav_file = wav_file;
+    job.trials = trials;
+
+    // Each encode only writes to its own .aifc, debug output is not safe to interleave.
+    if (g_verbosity < VERBOSE_DEBUG)
+    {
+        parallel_for(book_count, AdpcmAifcFile_new_from_wav_trial, &job);
+    }
+    else
+    {
+        for (i=0; i<book_count; i++)
+        {
+            AdpcmAifcFile_new_from_wav_trial(i, &job);
+        }
+    }
+
+    best_index = 0;
+
+    for (i=1; i<book_count; i++)
+    {
+        best = &trials[best_index];
+        trial = &trials[i];
+
+        if (trial->square_error < best->square_error
+            || (trial->square_error == best->square_error && trial->max_clip < best->max_clip)
+            || (trial->square_error == best->square_error && trial->max_clip == best->max_clip && trial->aifc_size < best->aifc_size))
+        {
+            best_index = i;
+        }
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return best_index;
+}
+
+/**
+ * {@code parallel_for} callback, encodes .wav with a single codebook and measures the result.
+ * @param index: index into {@code job->trials}.
+ * @param state: {@code struct AdpcmAifcTrialJob}.
+*/
+static void AdpcmAifcFile_new_from_wav_trial(int index, void *state)
+{
+    TRACE_ENTER(__func__)
+
+    struct AdpcmAifcTrialJob *job = (struct AdpcmAifcTrialJob *)state;
+    struct AdpcmAifcCodebookTrial *trial = &job->trials[index];
+    struct WavFile *wav_file = job->wav_file;
+
+    trial->aaf = AdpcmAifcFile_new_from_wav(wav_file, trial->book);
+
+    // same length AdpcmAifcFile_new_from_wav encodes.
+    trial->square_error = AdpcmAifcFile_decode_square_error(trial->aaf, wav_file->data_chunk->data, wav_file->data_chunk->ck_data_size - 8);
+    trial->max_clip = trial->aaf->encode_stats.max_clip;
+
+    // FORM chunk id and size are not included in ck_data_size.
+    trial->aifc_size = 8 + (size_t)trial->aaf->ck_data_size;
+
+    TRACE_LEAVE(__func__)
+}
+
+/**
+ * Helper method.
+ * Creates .aifc container with "COMM", codebook, and partial loop chunks for
+ * the given .wav format, but no sound chunk.
+ * @param fmt_chunk: wav "fmt " chunk.
+ * @param smpl_chunk: Optional. wav "smpl" chunk.
+ * @param book: Optional. Codebook data. If present, sound data will be encoded
+ * using "VAPC" compression, otherwise uncompressed.
+ * @param ck_data_size: out parameter. Size of the .aifc root chunk for the chunks added.
+ * @returns: pointer to new .aifc file.
+*/
+static struct AdpcmAifcFile *AdpcmAifcFile_new_header_from_wav(struct WavFmtChunk *fmt_chunk, struct WavSampleChunk *smpl_chunk, struct ALADPCMBook *book, size_t *ck_data_size)
+{
+    TRACE_ENTER(__func__)
+
+    struct AdpcmAifcFile *aaf;
+    struct AdpcmAifcCommChunk *comm;
+    uint32_t compression_type;
+    f80 extended_float_sample_rate;
+    size_t aifc_root_ck_data_size = 0;
+
     aaf = AdpcmAifcFile_new_simple(0);
     aifc_root_ck_data_size = 4; // ck_data_size for empty .aifc file
 
@@ -685,12 +913,12 @@ struct AdpcmAifcFile *AdpcmAifcFile_new_from_wav(struct WavFile *wav_file, struc
     }
 
     comm = AdpcmAifcCommChunk_new(compression_type);
-    comm->num_channels = wav_file->fmt_chunk->num_channels;
-    extended_float_sample_rate = (f80)wav_file->fmt_chunk->sample_rate;
+    comm->num_channels = fmt_chunk->num_channels;
+    extended_float_sample_rate = (f80)fmt_chunk->sample_rate;
 
     reverse_into(comm->sample_rate, (uint8_t *)&extended_float_sample_rate, 10);
 
-    comm->sample_size = wav_file->fmt_chunk->bits_per_sample;
+    comm->sample_size = fmt_chunk->bits_per_sample;
 
     aaf->comm_chunk = comm;
     AdpcmAifcFile_append_chunk(aaf, comm);
@@ -706,14 +934,14 @@ struct AdpcmAifcFile *AdpcmAifcFile_new_from_wav(struct WavFile *wav_file, struc
         aifc_root_ck_data_size += 8 + aaf->codes_chunk->base.ck_data_size;
 
         // verify the wav audio is in a format that can be encoded
-        if (wav_file->fmt_chunk->bits_per_sample != AIFC_ENCODE_BIT_SAMPLE_SUPPORT)
+        if (fmt_chunk->bits_per_sample != AIFC_ENCODE_BIT_SAMPLE_SUPPORT)
         {
-            stderr_exit(EXIT_CODE_GENERAL, "%s %d> can only encode audio in %d bits per sample, but input audio is in %d\n", __func__, __LINE__, AIFC_ENCODE_BIT_SAMPLE_SUPPORT, wav_file->fmt_chunk->bits_per_sample);
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d> can only encode audio in %d bits per sample, but input audio is in %d\n", __func__, __LINE__, AIFC_ENCODE_BIT_SAMPLE_SUPPORT, fmt_chunk->bits_per_sample);
         }
 
-        if (wav_file->fmt_chunk->num_channels > AIFC_ENCODE_MAX_CHANNEL_SUPPORT)
+        if (fmt_chunk->num_channels > AIFC_ENCODE_MAX_CHANNEL_SUPPORT)
         {
-            stderr_exit(EXIT_CODE_GENERAL, "%s %d> can only encode audio with up to %d channel(s), but input audio has %d\n", __func__, __LINE__, AIFC_ENCODE_MAX_CHANNEL_SUPPORT, wav_file->fmt_chunk->num_channels);
+            stderr_exit(EXIT_CODE_GENERAL, "%s %d> can only encode audio with up to %d channel(s), but input audio has %d\n", __func__, __LINE__, AIFC_ENCODE_MAX_CHANNEL_SUPPORT, fmt_chunk->num_channels);
         }
     }
 
@@ -721,29 +949,161 @@ struct AdpcmAifcFile *AdpcmAifcFile_new_from_wav(struct WavFile *wav_file, struc
     // should be required. This adds the outline of required data to the .aifc file,
     // but the decoder state information won't be available until processing the audio.
     // This needs to be added before encoding audio.
-    if (wav_file->smpl_chunk != NULL)
+    AdpcmAifcFile_add_partial_loop_from_smpl(aaf, smpl_chunk);
+
+    if (aaf->loop_chunk != NULL)
     {
-        AdpcmAifcFile_add_partial_loop_from_wav(aaf, wav_file);
-        
         // chunk ck_data_size doesn't count bytes for id + ck_data_size so add 8.
         aifc_root_ck_data_size += 8 + aaf->loop_chunk->base.ck_data_size;
     }
 
-    // Load sound data. When codebook was created the incoming format was validated,
-    // so it should be safe to copy straight from wav sound data without any processing here.
-    AdpcmAifcFile_encode(aaf, wav_file->data_chunk->data, sound_data_len);
-    
-    // chunk ck_data_size doesn't count bytes for id + ck_data_size so add 8.
-    aifc_root_ck_data_size += 8 + aaf->sound_chunk->ck_data_size;
-
-    // set total file size
-    aaf->ck_data_size = (int32_t)aifc_root_ck_data_size;
+    *ck_data_size = aifc_root_ck_data_size;
 
     TRACE_LEAVE(__func__)
 
     return aaf;
 }
 
+/**
+ * Converts .wav to .aifc and writes the .aifc file, reading and encoding
+ * sound data in blocks. Sound data that isn't mono 16 bit PCM (or needs
+ * resampling) is converted as it is read.
+ * Output is the same as {@code WavFile_convert} followed by
+ * {@code AdpcmAifcFile_new_from_wav} and {@code AdpcmAifcFile_fwrite}.
+ * @param reader: wav to convert, positioned at the start of sound data.
+ * The fmt and smpl chunks are updated if sound data is converted.
+ * @param book: Optional. Codebook data. If present, sound data will be encoded
+ * using "VAPC" compression, otherwise uncompressed.
+ * @param options: Optional. Conversion options.
+ * @param fi: FileInfo to write to. Uses current seek position.
+ * @returns: number of sample frames encoded.
+*/
+size_t AdpcmAifcFile_fwrite_from_wav_reader(struct WavReader *reader, struct ALADPCMBook *book, const struct WavConvertOptions *options, struct FileInfo *fi)
+{
+    TRACE_ENTER(__func__)
+
+    if (reader == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: reader is NULL\n", __func__, __LINE__);
+    }
+
+    if (fi == NULL)
+    {
+        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: fi is NULL\n", __func__, __LINE__);
+    }
+
+    struct WavConverter *converter = NULL;
+    struct AdpcmAifcFile *aaf;
+    struct AdpcmAifcEncoder *encoder;
+    uint8_t *in_buffer;
+    int16_t *out_buffer = NULL;
+    size_t block_frames = 0;
+    size_t sound_data_len;
+    size_t remaining;
+    size_t len;
+    size_t unused;
+    size_t sample_frames;
+    int flushed = 0;
+
+    if (WavFmtChunk_needs_convert(reader->fmt_chunk, options))
+    {
+        size_t out_size;
+
+        converter = WavConverter_new(reader->fmt_chunk, options);
+        block_frames = WAV_STREAM_BLOCK_LEN / (size_t)converter->block_align;
+        sound_data_len = WavConverter_output_len(converter, reader->data_len / (size_t)converter->block_align) * 2;
+
+        // extra room for WavConverter_process, and enough for WavConverter_flush.
+        out_size = WavConverter_output_len(converter, block_frames) + 2;
+        if (out_size < converter->resampled_size)
+        {
+            out_size = converter->resampled_size;
+        }
+
+        out_buffer = (int16_t *)malloc_zero(out_size, sizeof(int16_t));
+
+        WavConverter_update_chunks(converter, reader->fmt_chunk, reader->smpl_chunk);
+    }
+    else
+    {
+        sound_data_len = reader->data_len;
+    }
+
+    if (sound_data_len < 8)
+    {
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d>: sound data too short: %ld\n", __func__, __LINE__, sound_data_len);
+    }
+
+    // Same length AdpcmAifcFile_new_from_wav encodes.
+    remaining = sound_data_len - 8;
+
+    aaf = AdpcmAifcFile_new_header_from_wav(reader->fmt_chunk, reader->smpl_chunk, book, &unused);
+    encoder = AdpcmAifcEncoder_new(aaf, fi);
+
+    in_buffer = (uint8_t *)malloc_zero(1, WAV_STREAM_BLOCK_LEN);
+
+    while (remaining > 0)
+    {
+        if (converter != NULL)
+        {
+            len = WavReader_read(reader, in_buffer, block_frames * (size_t)converter->block_align);
+
+            if (len > 0)
+            {
+                len = WavConverter_process(converter, in_buffer, len / (size_t)converter->block_align, out_buffer);
+            }
+            else if (flushed == 0)
+            {
+                len = WavConverter_flush(converter, out_buffer);
+                flushed = 1;
+            }
+            else
+            {
+                break;
+            }
+
+            len *= 2;
+            if (len > remaining)
+            {
+                len = remaining;
+            }
+
+            AdpcmAifcEncoder_write(encoder, (uint8_t *)out_buffer, len);
+        }
+        else
+        {
+            len = remaining < WAV_STREAM_BLOCK_LEN ? remaining : WAV_STREAM_BLOCK_LEN;
+            len = WavReader_read(reader, in_buffer, len);
+
+            if (len == 0)
+            {
+                break;
+            }
+
+            AdpcmAifcEncoder_write(encoder, in_buffer, len);
+        }
+
+        remaining -= len;
+    }
+
+    AdpcmAifcEncoder_close(encoder);
+    sample_frames = aaf->comm_chunk->num_sample_frames;
+
+    AdpcmAifcEncoder_free(encoder);
+    AdpcmAifcFile_free(aaf);
+    gaudio_free(in_buffer);
+
+    if (converter != NULL)
+    {
+        WavConverter_free(converter);
+        gaudio_free(out_buffer);
+    }
+
+    TRACE_LEAVE(__func__)
+
+    return sample_frames;
+}
+
 /**
  * This is the main entry point for writing a .tbl file.
  * This traverses the bank_file looking for wavetable objects. Foreach
@@ -775,109 +1135,51 @@ void ALBankFile_write_tbl(struct ALBankFile *bank_file, char* tbl_filename)
     */
 
     struct FileInfo *output;
-    int bank_count;
-    struct LinkedList *list_sounds = LinkedList_new();
-    struct LinkedListNode *node;
+    struct ALBankFileLayout *layout;
     struct StringHashTable *seen = StringHashTable_new();
+    size_t i;
 
-    // first step, collect everything
-    for (bank_count=0; bank_count<bank_file->bank_count; bank_count++)
+    // collect everything (each sound once), in .ctl write order.
+    layout = ALBankFile_new_ctl_layout(bank_file);
+
+    // now write output and set `base` offset.
+
+    output = FileInfo_fopen(tbl_filename, "w");
+
+    for (i=0; i<layout->sound_count; i++)
     {
-        struct ALBank *bank = bank_file->banks[bank_count];
+        struct ALSound *sound = (struct ALSound *)layout->sounds[i].item;
+        struct ALWaveTable *wavetable = sound->wavetable;
 
-        if (bank != NULL)
+        if (wavetable == NULL || wavetable->aifc_path == NULL || wavetable->aifc_path[0] == '\0')
         {
-            int inst_count;
+            continue;
+        }
 
-            for (inst_count=0; inst_count<bank->inst_count; inst_count++)
-            {
-                struct ALInstrument *instrument = bank->instruments[inst_count];
+        if (!StringHashTable_contains(seen, wavetable->aifc_path))
+        {
+            int32_t wavetable_base = (int32_t)FileInfo_ftell(output);
+            size_t sound_data_size;
 
-                if (instrument != NULL)
-                {
-                    int sound_count;
-
-                    for (sound_count=0; sound_count<instrument->sound_count; sound_count++)
-                    {
-                        struct ALSound *sound = instrument->sounds[sound_count];
-
-                        if (sound != NULL)
-                        {
-                            struct ALWaveTable *wavetable = sound->wavetable;
+            AdpcmAifcFile_path_write_tbl(wavetable->aifc_path, output, &sound_data_size);
 
-                            if (wavetable != NULL && wavetable->aifc_path != NULL && wavetable->aifc_path[0] != '\0')
-                            {
-                                sound->visited = 1;
+            wavetable->base = wavetable_base;
+            wavetable->len = (int)sound_data_size;
 
-                                node = LinkedListNode_new();
-                                node->data = sound;
-                                LinkedList_append_node(list_sounds, node);
-                            }
-                        }
-                    }
-                }
-            }
+            StringHashTable_add(seen, wavetable->aifc_path, wavetable);
         }
-    }
-
-    // apply sort method if needed.
-    if (bank_file->ctl_sort_method == CTL_SORT_METHOD_NATURAL)
-    {
-        // nothing to do, use the order iterated above.
-    }
-    else if (bank_file->ctl_sort_method == CTL_SORT_METHOD_META)
-    {
-        LinkedList_merge_sort(list_sounds, LinkedListNode_sound_write_order_compare_smaller);
-    }
-    else
-    {
-        stderr_exit(EXIT_CODE_GENERAL, "%s %d> bank_file->ctl_sort_method not supported: %d\n", __func__, __LINE__, bank_file->ctl_sort_method);
-    }
-
-    ALBankFile_clear_visited_flags(bank_file);
-
-    // now write output and set `base` offset.
-
-    output = FileInfo_fopen(tbl_filename, "w");
-
-    node = list_sounds->head;
-    while (node != NULL)
-    {
-        struct ALSound *sound = (struct ALSound *)node->data;
-
-        if (sound->visited == 0)
+        else
         {
-            struct ALWaveTable *wavetable = sound->wavetable;
-            
-            sound->visited = 1;
-
-            if (!StringHashTable_contains(seen, wavetable->aifc_path))
-            {
-                int32_t wavetable_base = (int32_t)FileInfo_ftell(output);
-                size_t sound_data_size;
-
-                AdpcmAifcFile_path_write_tbl(wavetable->aifc_path, output, &sound_data_size);
-
-                wavetable->base = wavetable_base;
-                wavetable->len = (int)sound_data_size;
-
-                StringHashTable_add(seen, wavetable->aifc_path, wavetable);
-            }
-            else
-            {
-                struct ALWaveTable *ht_wavetable = StringHashTable_get(seen, wavetable->aifc_path);
+            struct ALWaveTable *ht_wavetable = StringHashTable_get(seen, wavetable->aifc_path);
 
-                wavetable->base = ht_wavetable->base;
-                wavetable->len = ht_wavetable->len;
-            }
+            wavetable->base = ht_wavetable->base;
+            wavetable->len = ht_wavetable->len;
         }
-
-        node = node->next;
     }
 
     // done, cleanup.
 
-    LinkedList_free(list_sounds);
+    ALBankFileLayout_free(layout);
 
     FileInfo_free(output);
 
@@ -909,76 +1211,30 @@ void ALBankFile_write_ctl(struct ALBankFile *bank_file, char* ctl_filename)
     }
 
     /**
-     * Generally the `offset` doesn't need to be written until after
-     * is has been defined, with the exception of the bank offsets
-     * at the start of the .ctl. The approach here is to write
-     * everything into a buffer in memory then go back and fix
-     * up any unknown offsets.
+     * Two passes. The first decides the write order and sets the .ctl offset
+     * of every object (so the exact file size is known). The second writes
+     * each object straight into its final position, including references
+     * to objects that appear later in the file.
     */
 
     struct FileInfo *output;
     
-    // temp buffer to store output in. Once entire bank_file is processed
+    // buffer to store output in. Once entire bank_file is processed
     // this will be written to disk.
     uint8_t *buffer;
-    size_t buffer_size;
-    int pos;
-    int file_size;
-    uint32_t t32; // temp
-    uint16_t t16; // temp
-    int bank_count;
+    size_t file_size;
+    struct ALBankFileLayout *layout;
 
     // iterate all the wavetables (again ...) and load the loop
     // and book information.
     ALBankFile_populate_wavetables_from_aifc(bank_file);
 
-    buffer_size = ALBankFile_estimate_ctl_filesize(bank_file);
-    buffer = (uint8_t *)malloc_zero(1, buffer_size);
-
-    // start writing data to buffer.
-    pos = 0;
-
-    t16 = BSWAP16_INLINE(BANKFILE_MAGIC_BYTES);
-    memcpy(&buffer[pos], &t16, 2);
-    pos += 2;
-
-    t16 = BSWAP16_INLINE(bank_file->bank_count);
-    memcpy(&buffer[pos], &t16, 2);
-    pos += 2;
-
-    // Bank offsets are not known at this time. Skip ahead (fill with zero for now).
-    pos += 4 * bank_file->bank_count;
-
-    if (bank_file->ctl_sort_method == CTL_SORT_METHOD_NATURAL)
-    {
-        ALBankFile_write_natural_order_envelope_ctl(bank_file, buffer, buffer_size, &pos);
-        ALBankFile_write_natural_order_keymap_ctl(bank_file, buffer, buffer_size, &pos);
-        ALBankFile_write_natural_order_sound_ctl(bank_file, buffer, buffer_size, &pos);
-    }
-    else if (bank_file->ctl_sort_method == CTL_SORT_METHOD_META)
-    {
-        ALBankFile_write_meta_order_envelope_ctl(bank_file, buffer, buffer_size, &pos);
-        ALBankFile_write_meta_order_keymap_ctl(bank_file, buffer, buffer_size, &pos);
-        ALBankFile_write_meta_order_sound_ctl(bank_file, buffer, buffer_size, &pos);
-    }
-    else
-    {
-        stderr_exit(EXIT_CODE_GENERAL, "%s %d> bank_file->ctl_sort_method not supported: %d\n", __func__, __LINE__, bank_file->ctl_sort_method);
-    }
-
-    ALBankFile_write_instrument_ctl(bank_file, buffer, buffer_size, &pos);
-    ALBankFile_write_bank_ctl(bank_file, buffer, buffer_size, &pos);
+    layout = ALBankFile_new_ctl_layout(bank_file);
+    file_size = ALBankFileLayout_plan_ctl(bank_file, layout);
 
-    file_size = pos;
+    buffer = (uint8_t *)malloc_zero(1, file_size);
 
-    // reset to beginning of file to write bank offsets.
-    pos = 4;
-    for (bank_count=0; bank_count<bank_file->bank_count; bank_count++)
-    {
-        t32 = BSWAP32_INLINE(bank_file->bank_offsets[bank_count]);
-        memcpy(&buffer[pos], &t32, 4);
-        pos += 4;
-    }
+    ALBankFileLayout_fill_ctl(bank_file, layout, buffer);
 
     // done writing bank_file to buffer.
     output = FileInfo_fopen(ctl_filename, "w");
@@ -987,10 +1243,11 @@ void ALBankFile_write_ctl(struct ALBankFile *bank_file, char* ctl_filename)
 
     if (g_verbosity >= VERBOSE_DEBUG)
     {
-        printf("wrote %d bytes to .ctl\n", file_size);
+        printf("wrote %ld bytes to .ctl\n", file_size);
     }
 
-    free(buffer);
+    gaudio_free(buffer);
+    ALBankFileLayout_free(layout);
 
     TRACE_LEAVE(__func__)
 }
@@ -1115,83 +1372,37 @@ struct ALRawLoop *ALRawLoop_new_from_aifc_loop(struct AdpcmAifcLoopChunk *loop_c
 }
 
 /**
- * Helper method, writes the sound into the buffer at the position.
+ * Helper method, writes the sound into the buffer at {@code sound->self_offset}.
+ * Offsets of all referenced objects must already be set, see {@code ALBankFileLayout_plan_ctl}.
  * @param sound: sound to write.
  * @param buffer: buffer to write to.
- * @param buffer_size: max size in bytes of the buffer.
- * @param pos_ptr: in/out parameter. Start position of buffer to write
- * to, will contain offset of next position to write to.
 */
-static void ALSound_write_ctl(struct ALSound *sound, uint8_t *buffer, size_t buffer_size, int *pos_ptr)
+static void ALSound_write_ctl(struct ALSound *sound, uint8_t *buffer)
 {
     TRACE_ENTER(__func__)
 
-    if (sound == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: sound is NULL\n", __func__, __LINE__);
-    }
-
-    if (buffer == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: buffer is NULL\n", __func__, __LINE__);
-    }
-
-    if (pos_ptr == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: pos_ptr is NULL\n", __func__, __LINE__);
-    }
-
     uint32_t t32; // temp
-    int pos = *pos_ptr;
-
-    // write sound properties first.
-    struct ALWaveTable *wavetable = sound->wavetable;
-
-    if ((size_t)(pos + 16) > buffer_size)
-    {
-        stderr_exit(EXIT_CODE_GENERAL, "%s %d> exceed buffer length at position %ld writing sound \"%s\"\n", __func__, __LINE__, pos, sound->text_id);
-    }
+    int pos = sound->self_offset;
 
     if (sound->envelope != NULL)
     {
         t32 = BSWAP32_INLINE(sound->envelope->self_offset);
+        memcpy(&buffer[pos], &t32, 4);
     }
-    else
-    {
-        t32 = 0;
-    }
-    memcpy(&buffer[pos], &t32, 4);
     pos += 4;
 
     if (sound->keymap != NULL)
     {
         t32 = BSWAP32_INLINE(sound->keymap->self_offset);
+        memcpy(&buffer[pos], &t32, 4);
     }
-    else
-    {
-        t32 = 0;
-    }
-    memcpy(&buffer[pos], &t32, 4);
     pos += 4;
 
-    if (wavetable != NULL)
+    if (sound->wavetable != NULL)
     {
-        if (wavetable->visited == 0)
-        {
-            // time travel to the future to get the wavetable offset
-            sound->wavetable_offset = pos + 8;
-
-            // set offset available to all parents.
-            sound->wavetable->self_offset = pos + 8;
-        }
-
         t32 = BSWAP32_INLINE(sound->wavetable->self_offset);
+        memcpy(&buffer[pos], &t32, 4);
     }
-    else
-    {
-        t32 = 0;
-    }
-    memcpy(&buffer[pos], &t32, 4);
     pos += 4;
 
     buffer[pos] = sound->sample_pan;
@@ -1201,213 +1412,134 @@ static void ALSound_write_ctl(struct ALSound *sound, uint8_t *buffer, size_t buf
     pos++;
 
     buffer[pos] = sound->flags;
-    pos++;
 
     // 1 byte padding
-    pos++;
 
-    // Done with top level sound properties.
-    // Now write wavetable properties.
+    TRACE_LEAVE(__func__)
+}
 
-    if (wavetable != NULL && wavetable->visited == 0)
-    {
-        int wavetable_size_guess = 24;
+/**
+ * Helper method, writes the wavetable, followed by loop and book, into the buffer
+ * at {@code wavetable->self_offset}. Offsets must already be set, see {@code ALWaveTable_plan_ctl}.
+ * @param wavetable: wavetable to write.
+ * @param buffer: buffer to write to.
+*/
+static void ALWaveTable_write_ctl(struct ALWaveTable *wavetable, uint8_t *buffer)
+{
+    TRACE_ENTER(__func__)
 
-        // offset to adjust for whether or not there's loop info.
-        int book_delta = 0;
+    uint32_t t32; // temp
+    int pos = wavetable->self_offset;
 
-        wavetable->visited = 1;
+    t32 = BSWAP32_INLINE(wavetable->base);
+    memcpy(&buffer[pos], &t32, 4);
+    pos += 4;
 
-        // A little bit annoying, but calculate whether this will overflow the buffer,
-        // then do the same calculations again to write the data...
-        if (wavetable->type == AL_RAW16_WAVE)
-        {
-            if (wavetable->wave_info.raw_wave.loop != NULL)
-            {
-                wavetable_size_guess += 12 + 4 + ADPCM_STATE_SIZE;
+    t32 = BSWAP32_INLINE(wavetable->len);
+    memcpy(&buffer[pos], &t32, 4);
+    pos += 4;
 
-                book_delta = 16 + ADPCM_STATE_SIZE; // this isn't possible ...
-            }
-        }
-        else if (wavetable->type == AL_ADPCM_WAVE)
-        {
-            if (wavetable->wave_info.adpcm_wave.loop != NULL)
-            {
-                wavetable_size_guess += 12 + 32 + 4;
+    buffer[pos] = wavetable->type;
+    pos++;
 
-                book_delta = 48;
-            }
+    buffer[pos] = wavetable->flags;
+    pos++;
 
-            if (wavetable->wave_info.adpcm_wave.book != NULL)
-            {
-                wavetable_size_guess +=
-                    16 * wavetable->wave_info.adpcm_wave.book->order * wavetable->wave_info.adpcm_wave.book->npredictors;
+    // 2 bytes of padding
+    pos += 2;
 
-                wavetable_size_guess += 8;
-            }
-        }
+    if (wavetable->type == AL_RAW16_WAVE)
+    {
+        struct ALRawLoop *loop = wavetable->wave_info.raw_wave.loop;
 
-        // overflow check
-        if ((size_t)(pos + wavetable_size_guess) > buffer_size)
+        if (loop != NULL)
         {
-            stderr_exit(EXIT_CODE_GENERAL, "%s %d> exceed buffer length at position %ld writing wavetable \"%s\"\n", __func__, __LINE__, pos, wavetable->text_id);
-        }
-
-        // set wavetable .ctl file offset (not needed now)
-        wavetable->self_offset = pos;
+            t32 = BSWAP32_INLINE(wavetable->wave_info.raw_wave.loop_offset);
+            memcpy(&buffer[pos], &t32, 4);
 
-        t32 = BSWAP32_INLINE(wavetable->base);
-        memcpy(&buffer[pos], &t32, 4);
-        pos += 4;
+            pos = wavetable->wave_info.raw_wave.loop_offset;
 
-        t32 = BSWAP32_INLINE(wavetable->len);
-        memcpy(&buffer[pos], &t32, 4);
-        pos += 4;
+            t32 = BSWAP32_INLINE(loop->start);
+            memcpy(&buffer[pos], &t32, 4);
+            pos += 4;
 
-        buffer[pos] = wavetable->type;
-        pos++;
+            t32 = BSWAP32_INLINE(loop->end);
+            memcpy(&buffer[pos], &t32, 4);
+            pos += 4;
 
-        buffer[pos] = wavetable->flags;
-        pos++;
+            t32 = BSWAP32_INLINE(loop->count);
+            memcpy(&buffer[pos], &t32, 4);
 
-        // 2 bytes of padding
-        pos += 2;
+            // raw loop uses space for the state but just writes zeros.
+        }
+    }
+    else if (wavetable->type == AL_ADPCM_WAVE)
+    {
+        struct ALADPCMLoop *loop = wavetable->wave_info.adpcm_wave.loop;
+        struct ALADPCMBook *book = wavetable->wave_info.adpcm_wave.book;
 
-        // time travel to the future to get the loop offset
-        if ((wavetable->type == AL_RAW16_WAVE && wavetable->wave_info.raw_wave.loop != NULL)
-            || (wavetable->type == AL_ADPCM_WAVE && wavetable->wave_info.adpcm_wave.loop != NULL))
+        if (loop != NULL)
         {
-            t32 = BSWAP32_INLINE(pos + 12);
+            t32 = BSWAP32_INLINE(wavetable->wave_info.adpcm_wave.loop_offset);
             memcpy(&buffer[pos], &t32, 4);
         }
         pos += 4;
 
-        // time travel to the future to get the book offset
-        if (wavetable->type == AL_ADPCM_WAVE && wavetable->wave_info.adpcm_wave.book != NULL)
+        if (book != NULL)
         {
-            t32 = BSWAP32_INLINE(pos + 8 + book_delta);
+            t32 = BSWAP32_INLINE(wavetable->wave_info.adpcm_wave.book_offset);
             memcpy(&buffer[pos], &t32, 4);
         }
-        pos += 4;
-
-        // padding
-        pos += 4;
-
-        // Done with wavetable info.
-        // Now write loop and book values.
-        // overflow check for these was handled above.
 
-        if (wavetable->type == AL_RAW16_WAVE)
+        if (loop != NULL)
         {
-            if (wavetable->wave_info.raw_wave.loop != NULL)
-            {
-                struct ALRawLoop *loop = wavetable->wave_info.raw_wave.loop;
-
-                t32 = BSWAP32_INLINE(loop->start);
-                memcpy(&buffer[pos], &t32, 4);
-                pos += 4;
+            pos = wavetable->wave_info.adpcm_wave.loop_offset;
 
-                t32 = BSWAP32_INLINE(loop->end);
-                memcpy(&buffer[pos], &t32, 4);
-                pos += 4;
+            t32 = BSWAP32_INLINE(loop->start);
+            memcpy(&buffer[pos], &t32, 4);
+            pos += 4;
 
-                t32 = BSWAP32_INLINE(loop->count);
-                memcpy(&buffer[pos], &t32, 4);
-                pos += 4;
+            t32 = BSWAP32_INLINE(loop->end);
+            memcpy(&buffer[pos], &t32, 4);
+            pos += 4;
 
-                // raw loop uses space for the state but just writes zeros.
-                pos += ADPCM_STATE_SIZE;
+            t32 = BSWAP32_INLINE(loop->count);
+            memcpy(&buffer[pos], &t32, 4);
+            pos += 4;
 
-                // padding
-                pos += 4;
-            }
+            memcpy(&buffer[pos], loop->state, ADPCM_STATE_SIZE);
         }
-        else if (wavetable->type == AL_ADPCM_WAVE)
-        {
-            if (wavetable->wave_info.adpcm_wave.loop != NULL)
-            {
-                struct ALADPCMLoop *loop = wavetable->wave_info.adpcm_wave.loop;
-
-                t32 = BSWAP32_INLINE(loop->start);
-                memcpy(&buffer[pos], &t32, 4);
-                pos += 4;
-
-                t32 = BSWAP32_INLINE(loop->end);
-                memcpy(&buffer[pos], &t32, 4);
-                pos += 4;
-
-                t32 = BSWAP32_INLINE(loop->count);
-                memcpy(&buffer[pos], &t32, 4);
-                pos += 4;
-
-                memcpy(&buffer[pos], loop->state, ADPCM_STATE_SIZE);
-                pos += ADPCM_STATE_SIZE;
-
-                // padding
-                pos += 4;
-            }
-
-            if (wavetable->wave_info.adpcm_wave.book != NULL)
-            {
-                struct ALADPCMBook *book = wavetable->wave_info.adpcm_wave.book;
-                int state_size = book->order * book->npredictors * 16;
 
-                t32 = BSWAP32_INLINE(book->order);
-                memcpy(&buffer[pos], &t32, 4);
-                pos += 4;
+        if (book != NULL)
+        {
+            pos = wavetable->wave_info.adpcm_wave.book_offset;
 
-                t32 = BSWAP32_INLINE(book->npredictors);
-                memcpy(&buffer[pos], &t32, 4);
-                pos += 4;
+            t32 = BSWAP32_INLINE(book->order);
+            memcpy(&buffer[pos], &t32, 4);
+            pos += 4;
 
-                memcpy(&buffer[pos], book->book, state_size);
-                pos += state_size;
+            t32 = BSWAP32_INLINE(book->npredictors);
+            memcpy(&buffer[pos], &t32, 4);
+            pos += 4;
 
-                // padding
-                pos += 8;
-            }
+            memcpy(&buffer[pos], book->book, book->order * book->npredictors * 16);
         }
     }
 
-    *pos_ptr = pos;
-
     TRACE_LEAVE(__func__)
 }
 
 /**
- * Helper method, writes the envelope into the buffer at the position.
+ * Helper method, writes the envelope into the buffer at {@code envelope->self_offset}.
  * @param envelope: envelope to write.
  * @param buffer: buffer to write to.
- * @param buffer_size: max size in bytes of the buffer.
- * @param pos_ptr: in/out parameter. Start position of buffer to write
- * to, will contain offset of next position to write to.
 */
-static void ALEnvelope_write_ctl(struct ALEnvelope *envelope, uint8_t *buffer, size_t buffer_size, int *pos_ptr)
+static void ALEnvelope_write_ctl(struct ALEnvelope *envelope, uint8_t *buffer)
 {
     TRACE_ENTER(__func__)
 
-    if (envelope == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: envelope is NULL\n", __func__, __LINE__);
-    }
-
-    if (buffer == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: buffer is NULL\n", __func__, __LINE__);
-    }
-
-    if (pos_ptr == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: pos_ptr is NULL\n", __func__, __LINE__);
-    }
-
     uint32_t t32; // temp
-    int pos = *pos_ptr;
-
-    if ((size_t)(pos + 16) > buffer_size)
-    {
-        stderr_exit(EXIT_CODE_GENERAL, "%s %d> exceed buffer length at position %ld writing envelope \"%s\"\n", __func__, __LINE__, pos, envelope->text_id);
-    }
+    int pos = envelope->self_offset;
 
     t32 = BSWAP32_INLINE(envelope->attack_time);
     memcpy(&buffer[pos], &t32, 4);
@@ -1425,49 +1557,22 @@ static void ALEnvelope_write_ctl(struct ALEnvelope *envelope, uint8_t *buffer, s
     pos++;
 
     buffer[pos] = envelope->decay_volume;
-    pos++;
 
     // there are two bytes of padding
-    pos += 2;
 
-    *pos_ptr = pos;
-    
     TRACE_LEAVE(__func__)
 }
 
 /**
- * Helper method, writes the keymap into the buffer at the position.
+ * Helper method, writes the keymap into the buffer at {@code keymap->self_offset}.
  * @param keymap: keymap to write.
  * @param buffer: buffer to write to.
- * @param buffer_size: max size in bytes of the buffer.
- * @param pos_ptr: in/out parameter. Start position of buffer to write
- * to, will contain offset of next position to write to.
 */
-static void ALKeyMap_write_ctl(struct ALKeyMap *keymap, uint8_t *buffer, size_t buffer_size, int *pos_ptr)
+static void ALKeyMap_write_ctl(struct ALKeyMap *keymap, uint8_t *buffer)
 {
     TRACE_ENTER(__func__)
 
-    if (keymap == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: keymap is NULL\n", __func__, __LINE__);
-    }
-
-    if (buffer == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: buffer is NULL\n", __func__, __LINE__);
-    }
-
-    if (pos_ptr == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: pos_ptr is NULL\n", __func__, __LINE__);
-    }
-
-    int pos = *pos_ptr;
-
-    if ((size_t)(pos + 8) > buffer_size)
-    {
-        stderr_exit(EXIT_CODE_GENERAL, "%s %d> exceed buffer length at position %ld writing keymap \"%s\"\n", __func__, __LINE__, pos, keymap->text_id);
-    }
+    int pos = keymap->self_offset;
 
     buffer[pos] = keymap->velocity_min;
     pos++;
@@ -1485,728 +1590,317 @@ static void ALKeyMap_write_ctl(struct ALKeyMap *keymap, uint8_t *buffer, size_t
     pos++;
 
     buffer[pos] = (uint8_t)keymap->detune;
-    pos++;
 
     // there are two bytes of padding
-    pos += 2;
 
-    *pos_ptr = pos;
-    
     TRACE_LEAVE(__func__)
 }
 
 /**
- * Iterates the bank file and writes all envelopes
- * into the buffer in the order encountered.
- * @param bank_file: bank file containing envelopes.
+ * Helper method, writes the instrument into the buffer at {@code instrument->self_offset}.
+ * Sound offsets must already be set, see {@code ALBankFileLayout_plan_ctl}.
+ * @param instrument: instrument to write.
  * @param buffer: buffer to write to.
- * @param buffer_size: max size in bytes of the buffer.
- * @param pos_ptr: in/out parameter. Start position of buffer to write
- * to, will contain offset of next position to write to.
 */
-static void ALBankFile_write_natural_order_envelope_ctl(struct ALBankFile *bank_file, uint8_t *buffer, size_t buffer_size, int *pos_ptr)
+static void ALInstrument_write_ctl(struct ALInstrument *instrument, uint8_t *buffer)
 {
     TRACE_ENTER(__func__)
 
-    if (bank_file == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: bank_file is NULL\n", __func__, __LINE__);
-    }
-
-    if (buffer == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: buffer is NULL\n", __func__, __LINE__);
-    }
+    uint32_t t32;
+    uint16_t t16;
+    int pos = instrument->self_offset;
+    int sound_count;
 
-    if (pos_ptr == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: pos_ptr is NULL\n", __func__, __LINE__);
-    }
+    buffer[pos] = instrument->volume;
+    pos++;
 
-    int bank_count;
-    int pos = *pos_ptr;
+    buffer[pos] = instrument->pan;
+    pos++;
 
-    ALBankFile_clear_visited_flags(bank_file);
+    buffer[pos] = instrument->priority;
+    pos++;
 
-    if (g_verbosity >= VERBOSE_DEBUG)
-    {
-        printf(".ctl begin writing envelopes position %d\n", pos);
-    }
+    buffer[pos] = instrument->flags;
+    pos++;
 
-    for (bank_count=0; bank_count<bank_file->bank_count; bank_count++)
-    {
-        struct ALBank *bank = bank_file->banks[bank_count];
+    buffer[pos] = instrument->trem_type;
+    pos++;
 
-        if (bank != NULL)
-        {
-            int inst_count;
+    buffer[pos] = instrument->trem_rate;
+    pos++;
 
-            for (inst_count=0; inst_count<bank->inst_count; inst_count++)
-            {
-                struct ALInstrument *instrument = bank->instruments[inst_count];
+    buffer[pos] = instrument->trem_depth;
+    pos++;
 
-                if (instrument != NULL && instrument->visited == 0)
-                {
-                    int sound_count;
+    buffer[pos] = instrument->trem_delay;
+    pos++;
 
-                    instrument->visited = 1;
+    buffer[pos] = instrument->vib_type;
+    pos++;
 
-                    for (sound_count=0; sound_count<instrument->sound_count; sound_count++)
-                    {
-                        struct ALSound *sound = instrument->sounds[sound_count];
+    buffer[pos] = instrument->vib_rate;
+    pos++;
 
-                        if (sound != NULL && sound->visited == 0)
-                        {
-                            struct ALEnvelope *envelope = sound->envelope;
+    buffer[pos] = instrument->vib_depth;
+    pos++;
 
-                            sound->visited = 1;
+    buffer[pos] = instrument->vib_delay;
+    pos++;
 
-                            if (envelope != NULL && envelope->visited == 0)
-                            {
-                                envelope->visited = 1;
-
-                                // set envelope parent .ctl file offset
-                                sound->envelope_offset = pos;
+    t16 = BSWAP16_INLINE(instrument->bend_range);
+    memcpy(&buffer[pos], &t16, 2);
+    pos += 2;
 
-                                // set offset available to all parents.
-                                envelope->self_offset = pos;
+    t16 = BSWAP16_INLINE(instrument->sound_count);
+    memcpy(&buffer[pos], &t16, 2);
+    pos += 2;
 
-                                ALEnvelope_write_ctl(envelope, buffer, buffer_size, &pos);
-                            }
-                        }
-                    }
-                }
-            }
+    for (sound_count=0; sound_count<instrument->sound_count; sound_count++)
+    {
+        if (instrument->sounds[sound_count] != NULL)
+        {
+            t32 = BSWAP32_INLINE(instrument->sounds[sound_count]->self_offset);
+        }
+        else
+        {
+            t32 = BSWAP32_INLINE(instrument->sound_offsets[sound_count]);
         }
+        memcpy(&buffer[pos], &t32, 4);
+        pos += 4;
     }
 
-    *pos_ptr = pos;
-
     TRACE_LEAVE(__func__)
 }
 
 /**
- * Iterates the bank file and writes all keymaps
- * into the buffer in the order encountered.
- * @param bank_file: bank file containing keymaps.
+ * Helper method, writes the bank into the buffer.
+ * Instrument offsets must already be set, see {@code ALBankFileLayout_plan_ctl}.
+ * @param bank: bank to write.
  * @param buffer: buffer to write to.
- * @param buffer_size: max size in bytes of the buffer.
- * @param pos_ptr: in/out parameter. Start position of buffer to write
- * to, will contain offset of next position to write to.
+ * @param offset: position in buffer to write to.
 */
-static void ALBankFile_write_natural_order_keymap_ctl(struct ALBankFile *bank_file, uint8_t *buffer, size_t buffer_size, int *pos_ptr)
+static void ALBank_write_ctl(struct ALBank *bank, uint8_t *buffer, int32_t offset)
 {
     TRACE_ENTER(__func__)
 
-    if (bank_file == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: bank_file is NULL\n", __func__, __LINE__);
-    }
+    uint32_t t32;
+    uint16_t t16;
+    int pos = offset;
+    int inst_count;
 
-    if (buffer == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: buffer is NULL\n", __func__, __LINE__);
-    }
+    t16 = BSWAP16_INLINE(bank->inst_count);
+    memcpy(&buffer[pos], &t16, 2);
+    pos += 2;
 
-    if (pos_ptr == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: pos_ptr is NULL\n", __func__, __LINE__);
-    }
+    buffer[pos] = bank->flags;
+    pos++;
 
-    int bank_count;
-    int pos = *pos_ptr;
+    // unused padding.
+    pos++;
 
-    ALBankFile_clear_visited_flags(bank_file);
+    t32 = BSWAP32_INLINE(bank->sample_rate);
+    memcpy(&buffer[pos], &t32, 4);
+    pos += 4;
 
-    if (g_verbosity >= VERBOSE_DEBUG)
-    {
-        printf(".ctl begin writing keymaps position %d\n", pos);
-    }
+    t32 = BSWAP32_INLINE(bank->percussion);
+    memcpy(&buffer[pos], &t32, 4);
+    pos += 4;
 
-    for (bank_count=0; bank_count<bank_file->bank_count; bank_count++)
+    for (inst_count=0; inst_count<bank->inst_count; inst_count++)
     {
-        struct ALBank *bank = bank_file->banks[bank_count];
-
-        if (bank != NULL)
-        {
-            int inst_count;
-
-            for (inst_count=0; inst_count<bank->inst_count; inst_count++)
-            {
-                struct ALInstrument *instrument = bank->instruments[inst_count];
-
-                if (instrument != NULL && instrument->visited == 0)
-                {
-                    int sound_count;
-
-                    instrument->visited = 1;
-
-                    for (sound_count=0; sound_count<instrument->sound_count; sound_count++)
-                    {
-                        struct ALSound *sound = instrument->sounds[sound_count];
-
-                        if (sound != NULL && sound->visited == 0)
-                        {
-                            struct ALKeyMap *keymap = sound->keymap;
-
-                            sound->visited = 1;
-
-                            if (keymap != NULL && keymap->visited == 0)
-                            {
-                                keymap->visited = 1;
-
-                                // set keymap parent .ctl file offset
-                                sound->keymap_offset = pos;
-
-                                // set offset available to all parents.
-                                keymap->self_offset = pos;
-
-                                ALKeyMap_write_ctl(keymap, buffer, buffer_size, &pos);
-                            }
-                        }
-                    }
-                }
-            }
-        }
+        t32 = BSWAP32_INLINE(bank->inst_offsets[inst_count]);
+        memcpy(&buffer[pos], &t32, 4);
+        pos += 4;
     }
 
-    *pos_ptr = pos;
+    // followed by an empty inst offset, maybe?
 
     TRACE_LEAVE(__func__)
 }
 
 /**
- * Merge sort comparison function.
- * Sorts on sound->keymap->ctl_write_order.
- * Use this to sort smallest to largest.
- * @param first: first node
- * @param second: second node
- * @returns: comparison result
+ * Flattens the bank file and orders envelopes, keymaps, and sounds
+ * according to the bank file sort method.
+ * @param bank_file: bank file to plan.
+ * @returns: pointer to new layout, in .ctl write order.
 */
-static int LinkedListNode_sound_keymap_write_order_compare_smaller(struct LinkedListNode *first, struct LinkedListNode *second)
+struct ALBankFileLayout *ALBankFile_new_ctl_layout(struct ALBankFile *bank_file)
 {
     TRACE_ENTER(__func__)
 
-    int ret;
+    struct ALBankFileLayout *layout;
+    size_t i;
 
-    if (first == NULL && second == NULL)
+    if (bank_file->ctl_sort_method != CTL_SORT_METHOD_NATURAL && bank_file->ctl_sort_method != CTL_SORT_METHOD_META)
     {
-        ret = 0;
-    }
-    else if (first == NULL && second != NULL)
-    {
-        ret = 1;
-    }
-    else if (first != NULL && second == NULL)
-    {
-        ret = -1;
-    }
-    else
-    {
-        struct ALSound *sound_first = (struct ALSound *)first->data;
-        struct ALSound *sound_second = (struct ALSound *)second->data;
-       
-        if ((sound_first == NULL || sound_first->keymap == NULL) && (sound_second == NULL || sound_second->keymap == NULL))
-        {
-            ret = 0;
-        }
-        else if ((sound_first == NULL || sound_first->keymap == NULL) && sound_second != NULL)
-        {
-            ret = 1;
-        }
-        else if (sound_first != NULL && (sound_second == NULL || sound_second->keymap == NULL))
-        {
-            ret = -1;
-        }
-        else
-        {
-            if (sound_first->keymap->ctl_write_order < sound_second->keymap->ctl_write_order)
-            {
-                ret = -1;
-            }
-            else if (sound_first->keymap->ctl_write_order > sound_second->keymap->ctl_write_order)
-            {
-                ret = 1;
-            }
-            else
-            {
-                ret = 0;
-            }
-        }
+        stderr_exit(EXIT_CODE_GENERAL, "%s %d> bank_file->ctl_sort_method not supported: %d\n", __func__, __LINE__, bank_file->ctl_sort_method);
     }
 
-    TRACE_LEAVE(__func__)
-
-    return ret;
-}
-
-/**
- * Merge sort comparison function.
- * Sorts on sound->envelope->ctl_write_order.
- * Use this to sort smallest to largest.
- * @param first: first node
- * @param second: second node
- * @returns: comparison result
-*/
-static int LinkedListNode_sound_envelope_write_order_compare_smaller(struct LinkedListNode *first, struct LinkedListNode *second)
-{
-    TRACE_ENTER(__func__)
-
-    int ret;
+    // natural order is the order iterated, nothing else to do.
+    layout = ALBankFileLayout_new(bank_file);
 
-    if (first == NULL && second == NULL)
-    {
-        ret = 0;
-    }
-    else if (first == NULL && second != NULL)
-    {
-        ret = 1;
-    }
-    else if (first != NULL && second == NULL)
+    if (bank_file->ctl_sort_method == CTL_SORT_METHOD_META)
     {
-        ret = -1;
-    }
-    else
-    {
-        struct ALSound *sound_first = (struct ALSound *)first->data;
-        struct ALSound *sound_second = (struct ALSound *)second->data;
-       
-        if ((sound_first == NULL || sound_first->envelope == NULL) && (sound_second == NULL || sound_second->envelope == NULL))
-        {
-            ret = 0;
-        }
-        else if ((sound_first == NULL || sound_first->envelope == NULL) && sound_second != NULL)
+        for (i=0; i<layout->envelope_count; i++)
         {
-            ret = 1;
+            layout->envelopes[i].sort_key = ((struct ALEnvelope *)layout->envelopes[i].item)->ctl_write_order;
         }
-        else if (sound_first != NULL && (sound_second == NULL || sound_second->envelope == NULL))
-        {
-            ret = -1;
-        }
-        else
-        {
-            if (sound_first->envelope->ctl_write_order < sound_second->envelope->ctl_write_order)
-            {
-                ret = -1;
-            }
-            else if (sound_first->envelope->ctl_write_order > sound_second->envelope->ctl_write_order)
-            {
-                ret = 1;
-            }
-            else
-            {
-                ret = 0;
-            }
-        }
-    }
-
-    TRACE_LEAVE(__func__)
-
-    return ret;
-}
-
-/**
- * Merge sort comparison function.
- * Sorts on sound->ctl_write_order.
- * Use this to sort smallest to largest.
- * @param first: first node
- * @param second: second node
- * @returns: comparison result
-*/
-static int LinkedListNode_sound_write_order_compare_smaller(struct LinkedListNode *first, struct LinkedListNode *second)
-{
-    TRACE_ENTER(__func__)
 
-    int ret;
-
-    if (first == NULL && second == NULL)
-    {
-        ret = 0;
-    }
-    else if (first == NULL && second != NULL)
-    {
-        ret = 1;
-    }
-    else if (first != NULL && second == NULL)
-    {
-        ret = -1;
-    }
-    else
-    {
-        struct ALSound *sound_first = (struct ALSound *)first->data;
-        struct ALSound *sound_second = (struct ALSound *)second->data;
-       
-        if (sound_first == NULL && sound_second == NULL)
-        {
-            ret = 0;
-        }
-        else if (sound_first == NULL && sound_second != NULL)
+        for (i=0; i<layout->keymap_count; i++)
         {
-            ret = 1;
+            layout->keymaps[i].sort_key = ((struct ALKeyMap *)layout->keymaps[i].item)->ctl_write_order;
         }
-        else if (sound_first != NULL && sound_second == NULL)
+
+        for (i=0; i<layout->sound_count; i++)
         {
-            ret = -1;
-        }
-        else
-        {
-            if (sound_first->ctl_write_order < sound_second->ctl_write_order)
-            {
-                ret = -1;
-            }
-            else if (sound_first->ctl_write_order > sound_second->ctl_write_order)
-            {
-                ret = 1;
-            }
-            else
-            {
-                ret = 0;
-            }
+            layout->sounds[i].sort_key = ((struct ALSound *)layout->sounds[i].item)->ctl_write_order;
         }
+
+        ALBankFileLayoutEntry_sort(layout->envelopes, layout->envelope_count);
+        ALBankFileLayoutEntry_sort(layout->keymaps, layout->keymap_count);
+        ALBankFileLayoutEntry_sort(layout->sounds, layout->sound_count);
     }
 
     TRACE_LEAVE(__func__)
 
-    return ret;
+    return layout;
 }
 
 /**
- * Collects all envelopes in the bank file, then sorts them according
- * to the ctl_write_order property. Then writes them to the buffer
- * in this order.
- * @param bank_file: bank file containing envelopes.
- * @param buffer: buffer to write to.
- * @param buffer_size: max size in bytes of the buffer.
- * @param pos_ptr: in/out parameter. Start position of buffer to write
- * to, will contain offset of next position to write to.
+ * Sets the .ctl offset of the wavetable and its loop and book.
+ * The wavetable header is followed by the loop, then the book.
+ * @param wavetable: wavetable to place.
+ * @param pos: offset to place the wavetable at.
+ * @returns: offset after the wavetable, loop, and book.
 */
-static void ALBankFile_write_meta_order_envelope_ctl(struct ALBankFile *bank_file, uint8_t *buffer, size_t buffer_size, int *pos_ptr)
+static int32_t ALWaveTable_plan_ctl(struct ALWaveTable *wavetable, int32_t pos)
 {
     TRACE_ENTER(__func__)
 
-    if (bank_file == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: bank_file is NULL\n", __func__, __LINE__);
-    }
-
-    if (buffer == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: buffer is NULL\n", __func__, __LINE__);
-    }
+    wavetable->self_offset = pos;
+    pos += 24;
 
-    if (pos_ptr == NULL)
+    if (wavetable->type == AL_RAW16_WAVE)
     {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: pos_ptr is NULL\n", __func__, __LINE__);
-    }
-
-    int bank_count;
-    int pos = *pos_ptr;
-    struct LinkedList *list_sounds = LinkedList_new();
-    struct LinkedListNode *node;
-
-    ALBankFile_clear_visited_flags(bank_file);
+        if (wavetable->wave_info.raw_wave.loop != NULL)
+        {
+            wavetable->wave_info.raw_wave.loop_offset = pos;
 
-    if (g_verbosity >= VERBOSE_DEBUG)
-    {
-        printf(".ctl begin writing envelopes position %d\n", pos);
+            // start, end, count, (unused) state, padding
+            pos += 12 + ADPCM_STATE_SIZE + 4;
+        }
     }
-
-    for (bank_count=0; bank_count<bank_file->bank_count; bank_count++)
+    else if (wavetable->type == AL_ADPCM_WAVE)
     {
-        struct ALBank *bank = bank_file->banks[bank_count];
-
-        if (bank != NULL)
+        if (wavetable->wave_info.adpcm_wave.loop != NULL)
         {
-            int inst_count;
-
-            for (inst_count=0; inst_count<bank->inst_count; inst_count++)
-            {
-                struct ALInstrument *instrument = bank->instruments[inst_count];
-
-                if (instrument != NULL && instrument->visited == 0)
-                {
-                    int sound_count;
-
-                    instrument->visited = 1;
-
-                    for (sound_count=0; sound_count<instrument->sound_count; sound_count++)
-                    {
-                        struct ALSound *sound = instrument->sounds[sound_count];
-
-                        if (sound != NULL && sound->visited == 0)
-                        {
-                            sound->visited = 1;
+            wavetable->wave_info.adpcm_wave.loop_offset = pos;
 
-                            node = LinkedListNode_new();
-                            node->data = sound;
-                            LinkedList_append_node(list_sounds, node);
-                        }
-                    }
-                }
-            }
+            // start, end, count, state, padding
+            pos += 12 + ADPCM_STATE_SIZE + 4;
         }
-    }
 
-    LinkedList_merge_sort(list_sounds, LinkedListNode_sound_envelope_write_order_compare_smaller);
-    ALBankFile_clear_visited_flags(bank_file);
-
-    node = list_sounds->head;
-    while (node != NULL)
-    {
-        struct ALSound *sound = (struct ALSound *)node->data;
-
-        if (sound->envelope != NULL && sound->envelope->visited == 0)
+        if (wavetable->wave_info.adpcm_wave.book != NULL)
         {
-            sound->envelope->visited = 1;
-
-            // set envelope parent .ctl file offset
-            sound->envelope_offset = pos;
+            struct ALADPCMBook *book = wavetable->wave_info.adpcm_wave.book;
 
-            // set offset available to all parents.
-            sound->envelope->self_offset = pos;
+            wavetable->wave_info.adpcm_wave.book_offset = pos;
 
-            ALEnvelope_write_ctl(sound->envelope, buffer, buffer_size, &pos);
+            // order, npredictors, book, padding
+            pos += 8 + (16 * book->order * book->npredictors) + 8;
         }
-
-        node = node->next;
     }
 
-    *pos_ptr = pos;
-
-    // cleanup
-    LinkedList_free(list_sounds);
-
     TRACE_LEAVE(__func__)
+
+    return pos;
 }
 
 /**
- * Collects all keymaps in the bank file, then sorts them according
- * to the ctl_write_order property. Then writes them to the buffer
- * in this order.
- * @param bank_file: bank file containing keymaps.
- * @param buffer: buffer to write to.
- * @param buffer_size: max size in bytes of the buffer.
- * @param pos_ptr: in/out parameter. Start position of buffer to write
- * to, will contain offset of next position to write to.
+ * Sizing pass for writing .ctl. Sets the .ctl offset of every bank, instrument,
+ * sound, envelope, keymap, and wavetable in the layout, without writing anything.
+ * Objects are placed in the same order as the .ctl file: envelopes, keymaps,
+ * sounds (each wavetable follows the first sound that references it), instruments,
+ * then banks.
+ * @param bank_file: bank file being written.
+ * @param layout: planned write order.
+ * @returns: exact size in bytes of the .ctl file.
 */
-static void ALBankFile_write_meta_order_keymap_ctl(struct ALBankFile *bank_file, uint8_t *buffer, size_t buffer_size, int *pos_ptr)
+size_t ALBankFileLayout_plan_ctl(struct ALBankFile *bank_file, struct ALBankFileLayout *layout)
 {
     TRACE_ENTER(__func__)
 
-    if (bank_file == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: bank_file is NULL\n", __func__, __LINE__);
-    }
-
-    if (buffer == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: buffer is NULL\n", __func__, __LINE__);
-    }
-
-    if (pos_ptr == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: pos_ptr is NULL\n", __func__, __LINE__);
-    }
-
+    int32_t pos;
+    size_t i;
     int bank_count;
-    int pos = *pos_ptr;
-    struct LinkedList *list_sounds = LinkedList_new();
-    struct LinkedListNode *node;
+    uint32_t generation;
 
-    ALBankFile_clear_visited_flags(bank_file);
+    // magic bytes, bank count, bank offsets
+    pos = 4 + (4 * bank_file->bank_count);
 
-    if (g_verbosity >= VERBOSE_DEBUG)
+    for (i=0; i<layout->envelope_count; i++)
     {
-        printf(".ctl begin writing keymaps position %d\n", pos);
-    }
-
-    for (bank_count=0; bank_count<bank_file->bank_count; bank_count++)
-    {
-        struct ALBank *bank = bank_file->banks[bank_count];
-
-        if (bank != NULL)
-        {
-            int inst_count;
-
-            for (inst_count=0; inst_count<bank->inst_count; inst_count++)
-            {
-                struct ALInstrument *instrument = bank->instruments[inst_count];
-
-                if (instrument != NULL && instrument->visited == 0)
-                {
-                    int sound_count;
-
-                    instrument->visited = 1;
+        struct ALEnvelope *envelope = (struct ALEnvelope *)layout->envelopes[i].item;
+        struct ALSound *sound = (struct ALSound *)layout->envelopes[i].parent;
 
-                    for (sound_count=0; sound_count<instrument->sound_count; sound_count++)
-                    {
-                        struct ALSound *sound = instrument->sounds[sound_count];
+        // set envelope parent .ctl file offset
+        sound->envelope_offset = pos;
 
-                        if (sound != NULL && sound->visited == 0)
-                        {
-                            sound->visited = 1;
+        // set offset available to all parents.
+        envelope->self_offset = pos;
 
-                            node = LinkedListNode_new();
-                            node->data = sound;
-                            LinkedList_append_node(list_sounds, node);
-                        }
-                    }
-                }
-            }
-        }
+        pos += 16;
     }
 
-    LinkedList_merge_sort(list_sounds, LinkedListNode_sound_keymap_write_order_compare_smaller);
-    ALBankFile_clear_visited_flags(bank_file);
-
-    node = list_sounds->head;
-    while (node != NULL)
+    for (i=0; i<layout->keymap_count; i++)
     {
-        struct ALSound *sound = (struct ALSound *)node->data;
-
-        if (sound->keymap != NULL && sound->keymap->visited == 0)
-        {
-            sound->keymap->visited = 1;
-
-            // set keymap parent .ctl file offset
-            sound->keymap_offset = pos;
+        struct ALKeyMap *keymap = (struct ALKeyMap *)layout->keymaps[i].item;
+        struct ALSound *sound = (struct ALSound *)layout->keymaps[i].parent;
 
-            // set offset available to all parents.
-            sound->keymap->self_offset = pos;
-
-            ALKeyMap_write_ctl(sound->keymap, buffer, buffer_size, &pos);
-        }
-
-        node = node->next;
-    }
-
-    *pos_ptr = pos;
-
-    // cleanup
-    LinkedList_free(list_sounds);
-
-    TRACE_LEAVE(__func__)
-}
-
-/**
- * Iterates the bank file and writes all sounds
- * into the buffer in the order encountered.
- * No child information is written.
- * @param bank_file: bank file containing sounds.
- * @param buffer: buffer to write to.
- * @param buffer_size: max size in bytes of the buffer.
- * @param pos_ptr: in/out parameter. Start position of buffer to write
- * to, will contain offset of next position to write to.
-*/
-static void ALBankFile_write_natural_order_sound_ctl(struct ALBankFile *bank_file, uint8_t *buffer, size_t buffer_size, int *pos_ptr)
-{
-    TRACE_ENTER(__func__)
+        sound->keymap_offset = pos;
+        keymap->self_offset = pos;
 
-    if (bank_file == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: bank_file is NULL\n", __func__, __LINE__);
+        pos += 8;
     }
 
-    if (buffer == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: buffer is NULL\n", __func__, __LINE__);
-    }
+    // wavetables are shared between sounds, track which have been placed.
+    generation = ALBankFile_begin_visit(bank_file);
 
-    if (pos_ptr == NULL)
+    for (i=0; i<layout->sound_count; i++)
     {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: pos_ptr is NULL\n", __func__, __LINE__);
-    }
-
-    int bank_count;
-    int pos = *pos_ptr;
+        struct ALSound *sound = (struct ALSound *)layout->sounds[i].item;
+        struct ALInstrument *instrument = (struct ALInstrument *)layout->sounds[i].parent;
+        struct ALWaveTable *wavetable = sound->wavetable;
 
-    ALBankFile_clear_visited_flags(bank_file);
+        instrument->sound_offsets[layout->sounds[i].parent_index] = pos;
+        sound->self_offset = pos;
 
-    if (g_verbosity >= VERBOSE_DEBUG)
-    {
-        printf(".ctl begin writing sounds position %d\n", pos);
-    }
-
-    for (bank_count=0; bank_count<bank_file->bank_count; bank_count++)
-    {
-        struct ALBank *bank = bank_file->banks[bank_count];
+        pos += 16;
 
-        if (bank != NULL)
+        if (wavetable != NULL && wavetable->visited_generation != generation)
         {
-            int inst_count;
-
-            for (inst_count=0; inst_count<bank->inst_count; inst_count++)
-            {
-                struct ALInstrument *instrument = bank->instruments[inst_count];
+            wavetable->visited_generation = generation;
 
-                if (instrument != NULL && instrument->visited == 0)
-                {
-                    int sound_count;
-
-                    instrument->visited = 1;
-
-                    for (sound_count=0; sound_count<instrument->sound_count; sound_count++)
-                    {
-                        struct ALSound *sound = instrument->sounds[sound_count];
-                        
-                        if (sound != NULL && sound->visited == 0)
-                        {
-                            sound->visited = 1;
-                            instrument->sound_offsets[sound_count] = pos;
-                            sound->self_offset = pos;
-                            ALSound_write_ctl(sound, buffer, buffer_size, &pos);
-                        }
-                    }
-                }
-            }
+            sound->wavetable_offset = pos;
+            pos = ALWaveTable_plan_ctl(wavetable, pos);
         }
     }
 
-    *pos_ptr = pos;
-
-    TRACE_LEAVE(__func__)
-}
-
-/**
- * Collects all sounds in the bank file, then sorts them according
- * to the ctl_write_order property. Then writes them to the buffer
- * in this order.
- * No child information is written.
- * @param bank_file: bank file containing sounds.
- * @param buffer: buffer to write to.
- * @param buffer_size: max size in bytes of the buffer.
- * @param pos_ptr: in/out parameter. Start position of buffer to write
- * to, will contain offset of next position to write to.
-*/
-static void ALBankFile_write_meta_order_sound_ctl(struct ALBankFile *bank_file, uint8_t *buffer, size_t buffer_size, int *pos_ptr)
-{
-    TRACE_ENTER(__func__)
-
-    if (bank_file == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: bank_file is NULL\n", __func__, __LINE__);
-    }
-
-    if (buffer == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: buffer is NULL\n", __func__, __LINE__);
-    }
-
-    if (pos_ptr == NULL)
+    for (i=0; i<layout->instrument_count; i++)
     {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: pos_ptr is NULL\n", __func__, __LINE__);
-    }
+        struct ALInstrument *instrument = (struct ALInstrument *)layout->instruments[i].item;
+        struct ALBank *bank = (struct ALBank *)layout->instruments[i].parent;
 
-    int bank_count;
-    int pos = *pos_ptr;
-    struct LinkedList *list_sounds = LinkedList_new();
-    struct LinkedListNode *node;
+        bank->inst_offsets[layout->instruments[i].parent_index] = pos;
+        instrument->self_offset = pos;
 
-    ALBankFile_clear_visited_flags(bank_file);
+        pos += 16 + (4 * instrument->sound_count);
 
-    if (g_verbosity >= VERBOSE_DEBUG)
-    {
-        printf(".ctl begin writing sounds position %d\n", pos);
+        // pad to 8-byte align
+        if ((pos % 8) > 0)
+        {
+            pos += 8 - (pos % 8);
+        }
     }
 
     for (bank_count=0; bank_count<bank_file->bank_count; bank_count++)
@@ -2215,256 +1909,79 @@ static void ALBankFile_write_meta_order_sound_ctl(struct ALBankFile *bank_file,
 
         if (bank != NULL)
         {
-            int inst_count;
-
-            for (inst_count=0; inst_count<bank->inst_count; inst_count++)
-            {
-                struct ALInstrument *instrument = bank->instruments[inst_count];
-
-                if (instrument != NULL && instrument->visited == 0)
-                {
-                    int sound_count;
-
-                    instrument->visited = 1;
-
-                    for (sound_count=0; sound_count<instrument->sound_count; sound_count++)
-                    {
-                        struct ALSound *sound = instrument->sounds[sound_count];
-                        
-                        if (sound != NULL && sound->visited == 0)
-                        {
-                            sound->visited = 1;
-
-                            node = LinkedListNode_new();
-                            node->data = sound;
-                            LinkedList_append_node(list_sounds, node);
-                        }
-                    }
-                }
-            }
-        }
-    }
-
-    LinkedList_merge_sort(list_sounds, LinkedListNode_sound_write_order_compare_smaller);
-    ALBankFile_clear_visited_flags(bank_file);
-
-    node = list_sounds->head;
-    while (node != NULL)
-    {
-        struct ALSound *sound = (struct ALSound *)node->data;
-
-        if (sound->visited == 0)
-        {
-            sound->visited = 1;
-
-            // no reference to parent, so skip setting that.
+            bank_file->bank_offsets[bank_count] = pos;
 
-            // set offset available to all parents.
-            sound->self_offset = pos;
+            // header, instrument offsets, empty instrument offset
+            pos += 12 + (4 * bank->inst_count) + 4;
 
-            ALSound_write_ctl(sound, buffer, buffer_size, &pos);
+            // pad to 16-byte align. This always adds padding, even if already aligned.
+            pos += 16 - (pos % 16);
         }
-
-        node = node->next;
     }
 
-    *pos_ptr = pos;
-
-    // cleanup
-    LinkedList_free(list_sounds);
-
     TRACE_LEAVE(__func__)
+
+    return (size_t)pos;
 }
 
 /**
- * Iterates the bank file and writes all instruments
- * into the buffer in the order encountered.
- * No child information is written.
- * @param bank_file: bank file containing instruments.
- * @param buffer: buffer to write to.
- * @param buffer_size: max size in bytes of the buffer.
- * @param pos_ptr: in/out parameter. Start position of buffer to write
- * to, will contain offset of next position to write to.
+ * Fill pass for writing .ctl. Writes every object in the layout at the
+ * offset set by {@code ALBankFileLayout_plan_ctl}. Objects don't depend
+ * on each other's position in the buffer, so the order here doesn't matter.
+ * @param bank_file: bank file being written.
+ * @param layout: planned write order.
+ * @param buffer: zeroed buffer, at least as large as the planned size.
 */
-static void ALBankFile_write_instrument_ctl(struct ALBankFile *bank_file, uint8_t *buffer, size_t buffer_size, int *pos_ptr)
+void ALBankFileLayout_fill_ctl(struct ALBankFile *bank_file, struct ALBankFileLayout *layout, uint8_t *buffer)
 {
     TRACE_ENTER(__func__)
 
-    if (bank_file == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: bank_file is NULL\n", __func__, __LINE__);
-    }
-
-    if (buffer == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: buffer is NULL\n", __func__, __LINE__);
-    }
+    uint32_t t32; // temp
+    uint16_t t16; // temp
+    int pos;
+    size_t i;
+    int bank_count;
 
-    if (pos_ptr == NULL)
-    {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: pos_ptr is NULL\n", __func__, __LINE__);
-    }
+    pos = 0;
 
-    int bank_count;
-    uint32_t t32;
-    uint16_t t16;
-    int pos = *pos_ptr;
+    t16 = BSWAP16_INLINE(BANKFILE_MAGIC_BYTES);
+    memcpy(&buffer[pos], &t16, 2);
+    pos += 2;
 
-    ALBankFile_clear_visited_flags(bank_file);
+    t16 = BSWAP16_INLINE(bank_file->bank_count);
+    memcpy(&buffer[pos], &t16, 2);
+    pos += 2;
 
-    if (g_verbosity >= VERBOSE_DEBUG)
+    for (bank_count=0; bank_count<bank_file->bank_count; bank_count++)
     {
-        printf(".ctl begin writing instruments position %d\n", pos);
+        t32 = BSWAP32_INLINE(bank_file->bank_offsets[bank_count]);
+        memcpy(&buffer[pos], &t32, 4);
+        pos += 4;
     }
 
-    for (bank_count=0; bank_count<bank_file->bank_count; bank_count++)
+    for (i=0; i<layout->envelope_count; i++)
     {
-        struct ALBank *bank = bank_file->banks[bank_count];
-
-        if (bank != NULL)
-        {
-            int inst_count;
-
-            for (inst_count=0; inst_count<bank->inst_count; inst_count++)
-            {
-                struct ALInstrument *instrument = bank->instruments[inst_count];
-
-                if (instrument != NULL && instrument->visited == 0)
-                {
-                    size_t size_check;
-                    int sound_count;
-
-                    instrument->visited = 1;
-                    bank->inst_offsets[inst_count] = pos;
-                    instrument->self_offset = pos;
-
-                    // check for buffer overflow
-                    size_check = 16 + (4 * instrument->sound_count);
-                    // adjust for current position
-                    size_check += pos;
-                    // adjust for 8 byte align.
-                    if ((size_check % 8) > 0)
-                    {
-                        int remaining = 8 - (size_check - (int)((uint32_t)size_check & (uint32_t)(~0x7)));
-                        size_check += remaining;
-                    }
-
-                    if (size_check > buffer_size)
-                    {
-                        stderr_exit(EXIT_CODE_GENERAL, "%s %d> exceed buffer length at position %ld writing instrument \"%s\"\n", __func__, __LINE__, pos, instrument->text_id);
-                    }
-
-                    buffer[pos] = instrument->volume;
-                    pos++;
-
-                    buffer[pos] = instrument->pan;
-                    pos++;
-
-                    buffer[pos] = instrument->priority;
-                    pos++;
-
-                    buffer[pos] = instrument->flags;
-                    pos++;
-
-                    buffer[pos] = instrument->trem_type;
-                    pos++;
-
-                    buffer[pos] = instrument->trem_rate;
-                    pos++;
-
-                    buffer[pos] = instrument->trem_depth;
-                    pos++;
-
-                    buffer[pos] = instrument->trem_delay;
-                    pos++;
-
-                    buffer[pos] = instrument->vib_type;
-                    pos++;
-
-                    buffer[pos] = instrument->vib_rate;
-                    pos++;
-
-                    buffer[pos] = instrument->vib_depth;
-                    pos++;
-
-                    buffer[pos] = instrument->vib_delay;
-                    pos++;
-
-                    t16 = BSWAP16_INLINE(instrument->bend_range);
-                    memcpy(&buffer[pos], &t16, 2);
-                    pos += 2;
-
-                    t16 = BSWAP16_INLINE(instrument->sound_count);
-                    memcpy(&buffer[pos], &t16, 2);
-                    pos += 2;
-
-                    for (sound_count=0; sound_count<instrument->sound_count; sound_count++)
-                    {
-                        if (instrument->sounds[sound_count] != NULL)
-                        {
-                            t32 = BSWAP32_INLINE(instrument->sounds[sound_count]->self_offset);
-                        }
-                        else
-                        {
-                            t32 = BSWAP32_INLINE(instrument->sound_offsets[sound_count]);
-                        }
-                        memcpy(&buffer[pos], &t32, 4);
-                        pos += 4;
-                    }
-
-                    // pad to 8-byte align
-                    if ((pos % 8) > 0)
-                    {
-                        int remaining = 8 - (pos - (int)((uint32_t)pos & (uint32_t)(~0x7)));
-                        pos += remaining;
-                    }
-                }
-            }
-        }
+        ALEnvelope_write_ctl((struct ALEnvelope *)layout->envelopes[i].item, buffer);
     }
 
-    *pos_ptr = pos;
-
-    TRACE_LEAVE(__func__)
-}
-
-/**
- * Iterates the bank file and writes all banks
- * into the buffer in the order encountered.
- * No child information is written.
- * @param bank_file: bank file containing banks.
- * @param buffer: buffer to write to.
- * @param buffer_size: max size in bytes of the buffer.
- * @param pos_ptr: in/out parameter. Start position of buffer to write
- * to, will contain offset of next position to write to.
-*/
-static void ALBankFile_write_bank_ctl(struct ALBankFile *bank_file, uint8_t *buffer, size_t buffer_size, int *pos_ptr)
-{
-    TRACE_ENTER(__func__)
-
-    if (bank_file == NULL)
+    for (i=0; i<layout->keymap_count; i++)
     {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: bank_file is NULL\n", __func__, __LINE__);
+        ALKeyMap_write_ctl((struct ALKeyMap *)layout->keymaps[i].item, buffer);
     }
 
-    if (buffer == NULL)
+    for (i=0; i<layout->sound_count; i++)
     {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: buffer is NULL\n", __func__, __LINE__);
+        ALSound_write_ctl((struct ALSound *)layout->sounds[i].item, buffer);
     }
 
-    if (pos_ptr == NULL)
+    for (i=0; i<layout->wavetable_count; i++)
     {
-        stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: pos_ptr is NULL\n", __func__, __LINE__);
+        ALWaveTable_write_ctl((struct ALWaveTable *)layout->wavetables[i].item, buffer);
     }
 
-    int bank_count;
-    uint32_t t32;
-    uint16_t t16;
-    int pos = *pos_ptr;
-
-    if (g_verbosity >= VERBOSE_DEBUG)
+    for (i=0; i<layout->instrument_count; i++)
     {
-        printf(".ctl begin writing banks position %d\n", pos);
+        ALInstrument_write_ctl((struct ALInstrument *)layout->instruments[i].item, buffer);
     }
 
     for (bank_count=0; bank_count<bank_file->bank_count; bank_count++)
@@ -2473,57 +1990,10 @@ static void ALBankFile_write_bank_ctl(struct ALBankFile *bank_file, uint8_t *buf
 
         if (bank != NULL)
         {
-            int inst_count;
-            size_t size_check;
-
-            // can finally resolve bank offsets needed at start of file.
-            bank_file->bank_offsets[bank_count] = pos;
-
-            size_check = 14 + (4 * bank->inst_count) + 4;
-            size_check += pos;
-            size_check = (size_t)((uint32_t)(size_check + 16) & (uint32_t)(~ 0xf));
-
-            if (size_check > buffer_size)
-            {
-                stderr_exit(EXIT_CODE_GENERAL, "%s %d> exceed buffer length at position %ld writing bank \"%s\"\n", __func__, __LINE__, pos, bank->text_id);
-            }
-
-            t16 = BSWAP16_INLINE(bank->inst_count);
-            memcpy(&buffer[pos], &t16, 2);
-            pos += 2;
-
-            buffer[pos] = bank->flags;
-            pos++;
-
-            // unused padding.
-            pos++;
-
-            t32 = BSWAP32_INLINE(bank->sample_rate);
-            memcpy(&buffer[pos], &t32, 4);
-            pos += 4;
-
-            t32 = BSWAP32_INLINE(bank->percussion);
-            memcpy(&buffer[pos], &t32, 4);
-            pos += 4;
-
-            for (inst_count=0; inst_count<bank->inst_count; inst_count++)
-            {
-                t32 = BSWAP32_INLINE(bank->inst_offsets[inst_count]);
-                memcpy(&buffer[pos], &t32, 4);
-                pos += 4;
-            }
-
-            // write an empty inst offset, maybe?
-            pos += 4;
-
-            // pad to 16-byte align
-            int remaining = 16 - (pos - (int)((uint32_t)pos & (uint32_t)(~0xf)));
-            pos += remaining;
+            ALBank_write_ctl(bank, buffer, bank_file->bank_offsets[bank_count]);
         }
     }
 
-    *pos_ptr = pos;
-
     TRACE_LEAVE(__func__)
 }
 
@@ -2624,9 +2094,10 @@ static void ALBankFile_populate_wavetables_from_aifc(struct ALBankFile *bank_fil
         stderr_exit(EXIT_CODE_NULL_REFERENCE_EXCEPTION, "%s %d>: bank_file is NULL\n", __func__, __LINE__);
     }
 
-    ALBankFile_clear_visited_flags(bank_file);
-
     int bank_count;
+    uint32_t generation;
+
+    generation = ALBankFile_begin_visit(bank_file);
 
     for (bank_count=0; bank_count<bank_file->bank_count; bank_count++)
     {
@@ -2657,12 +2128,12 @@ static void ALBankFile_populate_wavetables_from_aifc(struct ALBankFile *bank_fil
                                 struct FileInfo *aifc_fi;
                                 struct AdpcmAifcFile *aifc_file;
 
-                                if (wavetable->visited == 1)
+                                if (wavetable->visited_generation == generation)
                                 {
                                     continue;
                                 }
 
-                                wavetable->visited = 1;
+                                wavetable->visited_generation = generation;
 
                                 aifc_fi = FileInfo_fopen(wavetable->aifc_path, "rb");
                                 aifc_file = AdpcmAifcFile_new_from_file(aifc_fi);
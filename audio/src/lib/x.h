@@ -20,19 +20,58 @@
 
 #include "naudio.h"
 #include "adpcm_aifc.h"
+#include "wav.h"
+#include "wav_convert.h"
 
+/**
+ * Result of encoding .wav sound data with one codebook, see {@code AdpcmAifcFile_new_from_wav_trials}.
+*/
+struct AdpcmAifcCodebookTrial {
+    /**
+     * Codebook used. Not owned.
+    */
+    struct ALADPCMBook *book;
+
+    /**
+     * Encoded .aifc. Owned by the caller once the trials are done.
+    */
+    struct AdpcmAifcFile *aaf;
+
+    /**
+     * Sum of squared difference between decoded and source samples.
+    */
+    int64_t square_error;
+
+    /**
+     * Largest amount an encoded value was clipped by.
+    */
+    int32_t max_clip;
+
+    /**
+     * Size in bytes of the .aifc file.
+    */
+    size_t aifc_size;
+};
 
 struct WavFile *WavFile_new_from_aifc(struct AdpcmAifcFile *aifc_file);
 struct AdpcmAifcFile *AdpcmAifcFile_new_from_wav(struct WavFile *wav_file, struct ALADPCMBook *book);
+int AdpcmAifcFile_new_from_wav_trials(struct WavFile *wav_file, struct ALADPCMBook **books, int book_count, struct AdpcmAifcCodebookTrial *trials);
+size_t AdpcmAifcFile_fwrite_from_wav_reader(struct WavReader *reader, struct ALADPCMBook *book, const struct WavConvertOptions *options, struct FileInfo *fi);
+struct WavFmtChunk *WavFmtChunk_new_from_aifc(struct AdpcmAifcFile *aifc_file);
 struct AdpcmAifcFile *AdpcmAifcFile_new_full(struct ALSound *sound, struct ALBank *bank);
 void load_aifc_from_sound(struct AdpcmAifcFile *aaf, struct ALSound *sound, uint8_t *tbl_file_contents, struct ALBank *bank);
 void write_sound_to_aifc(struct ALSound *sound, struct ALBank *bank, uint8_t *tbl_file_contents, struct FileInfo *fi);
 void write_bank_to_aifc(struct ALBankFile *bank_file, uint8_t *tbl_file_contents);
 void ALBankFile_write_tbl(struct ALBankFile *bank_file, char* tbl_filename);
 void ALBankFile_write_ctl(struct ALBankFile *bank_file, char* ctl_filename);
+struct ALBankFileLayout *ALBankFile_new_ctl_layout(struct ALBankFile *bank_file);
+size_t ALBankFileLayout_plan_ctl(struct ALBankFile *bank_file, struct ALBankFileLayout *layout);
+void ALBankFileLayout_fill_ctl(struct ALBankFile *bank_file, struct ALBankFileLayout *layout, uint8_t *buffer);
 
 void WavFile_check_append_aifc_loop(struct WavFile *wav, struct AdpcmAifcFile *aaf);
 void AdpcmAifcFile_add_partial_loop_from_wav(struct AdpcmAifcFile *aaf, struct WavFile *wav);
+void AdpcmAifcFile_add_partial_loop_from_smpl(struct AdpcmAifcFile *aaf, struct WavSampleChunk *smpl_chunk);
+struct WavSampleChunk *WavSampleChunk_new_from_aifc_loop(struct AdpcmAifcFile *aaf);
 
 struct ALADPCMLoop *ALADPCMLoop_new_from_aifc_loop(struct AdpcmAifcLoopChunk *loop_chunk);
 struct ALADPCMBook *ALADPCMBook_new_from_aifc_book(struct AdpcmAifcCodebookChunk *book_chunk);
@@ -57,6 +57,10 @@ int main(int argc, char **argv)
     test_md5_all(&sub_count, &pass_count, &fail_count);
     total_run_count += sub_count;
 
+    sub_count = 0;
+    utility_all(&sub_count, &pass_count, &fail_count);
+    total_run_count += sub_count;
+
     sub_count = 0;
     linked_list_all(&sub_count, &pass_count, &fail_count);
     total_run_count += sub_count;
@@ -89,6 +93,38 @@ int main(int argc, char **argv)
     midi_all(&sub_count, &pass_count, &fail_count);
     total_run_count += sub_count;
 
+    sub_count = 0;
+    render_all(&sub_count, &pass_count, &fail_count);
+    total_run_count += sub_count;
+
+    sub_count = 0;
+    trace_all(&sub_count, &pass_count, &fail_count);
+    total_run_count += sub_count;
+
+    sub_count = 0;
+    stats_all(&sub_count, &pass_count, &fail_count);
+    total_run_count += sub_count;
+
+    sub_count = 0;
+    ipc_all(&sub_count, &pass_count, &fail_count);
+    total_run_count += sub_count;
+
+    sub_count = 0;
+    gaudio_error_all(&sub_count, &pass_count, &fail_count);
+    total_run_count += sub_count;
+
+    sub_count = 0;
+    api_all(&sub_count, &pass_count, &fail_count);
+    total_run_count += sub_count;
+
+    sub_count = 0;
+    wav_convert_all(&sub_count, &pass_count, &fail_count);
+    total_run_count += sub_count;
+
+    sub_count = 0;
+    wav_stream_all(&sub_count, &pass_count, &fail_count);
+    total_run_count += sub_count;
+
     printf("%d tests run, %d pass, %d fail\n", total_run_count, pass_count, fail_count);
 
     return 0;
@@ -328,4 +328,361 @@ void aifc_all(int *run_count, int *pass_count, int *fail_count)
             *fail_count = *fail_count + 1;
         }
     }
+
+    {
+        printf("aifc test: AdpcmAifcFile_encode_frame silence and repeated frame\n");
+        *run_count = *run_count + 1;
+        int check = 1;
+        int single_check;
+        int i;
+        int pass_index;
+
+        int32_t apc_state[2];
+        size_t ssnd_chunk_pos = 0;
+        size_t frame_start[3];
+
+        struct AdpcmAifcFile *aaf = AdpcmAifcFile_new_simple(2);
+        struct AdpcmAifcSoundChunk *snd = AdpcmAifcSoundChunk_new(128);
+        struct AdpcmAifcCodebookChunk *codes = AdpcmAifcCodebookChunk_new(2, 4);
+
+        aaf->chunks[0] = snd;
+        aaf->chunks[1] = codes;
+        aaf->sound_chunk = snd;
+        aaf->codes_chunk = codes;
+
+        // same codebook and frame as AdpcmAifcFile_encode_frame test.
+        uint8_t raw_coef[] = {
+            0x00, 0x30, 0xFF, 0xDC, 0x00, 0x1C, 0xFF, 0xEA,
+            0x00, 0x12, 0xFF, 0xF2, 0x00, 0x0B, 0xFF, 0xF7,
+
+            0xF9, 0xF1, 0x04, 0xC7, 0xFC, 0x3E, 0x02, 0xF5,
+            0xFD, 0xAC, 0x01, 0xD5, 0xFE, 0x8F, 0x01, 0x23,
+
+            0xF9, 0x46, 0xF4, 0x8E, 0xF2, 0x2C, 0xF2, 0x17,
+            0xF3, 0xF2, 0xF7, 0x2D, 0xFB, 0x1E, 0xFF, 0x1B,
+
+            0x0D, 0x9E, 0x10, 0x73, 0x10, 0x8D, 0x0E, 0x57,
+            0x0A, 0x7F, 0x05, 0xCF, 0x01, 0x10, 0xFC, 0xED,
+
+            0x01, 0x82, 0x01, 0x1E, 0x01, 0x1D, 0x01, 0x09,
+            0x00, 0xFA, 0x00, 0xEB, 0x00, 0xDD, 0x00, 0xD0,
+
+            0x05, 0xED, 0x05, 0xE6, 0x05, 0x7C, 0x05, 0x2D,
+            0x04, 0xDE, 0x04, 0x95, 0x04, 0x50, 0x04, 0x0F,
+
+            0xF9, 0x2A, 0xF3, 0x8E, 0xEF, 0x2F, 0xEC, 0x06,
+            0xE9, 0xFF, 0xE9, 0x04, 0xE8, 0xF5, 0xE9, 0xB0,
+
+            0x0E, 0x90, 0x13, 0xAE, 0x17, 0x61, 0x19, 0xC0,
+            0x1A, 0xE6, 0x1A, 0xF8, 0x1A, 0x1C, 0x18, 0x7D
+        };
+
+        memcpy(codes->table_data, raw_coef, 8*16);
+
+        AdpcmAifcCodebookChunk_decode_aifc_codebook(codes);
+
+        uint8_t sound_data_raw[] = { 
+            0xed, 0x15, 0xef, 0xc0, 0xf2, 0xc5, 0xf6, 0x2a,
+            0xf9, 0x0c, 0xfb, 0x0b, 0xfc, 0x8c, 0xfd, 0xb0,
+            0xfe, 0x35, 0xfd, 0xa0, 0xfb, 0xa7, 0xf8, 0x6e,
+            0xf4, 0xf6, 0xf1, 0xe5, 0xee, 0xed, 0xeb, 0xbe
+        };
+        size_t sound_data_raw_len = 32;
+        size_t sound_data_pos = 0;
+
+        int16_t samples_in[FRAME_DECODE_BUFFER_LEN];
+        int16_t silence[FRAME_DECODE_BUFFER_LEN];
+        memset(samples_in, 0, FRAME_DECODE_BUFFER_LEN * sizeof(int16_t));
+        memset(silence, 0, FRAME_DECODE_BUFFER_LEN * sizeof(int16_t));
+
+        fill_16bit_buffer(
+                samples_in,
+                FRAME_DECODE_BUFFER_LEN,
+                sound_data_raw,
+                &sound_data_pos,
+                sound_data_raw_len);
+
+        bswap16_chunk(samples_in, samples_in, FRAME_DECODE_BUFFER_LEN); // inplace swap is ok
+
+        int32_t starting_apc_state[] = {
+            0xffffe7b0, 0xffffe9fc
+        };
+
+        uint8_t expected_ssnd_chunk_data[] = {
+            0x63,
+            0x2d, 0x11, 0xfd, 0xfe, 0xfb, 0xa9, 0xce, 0xdb
+        };
+
+        int32_t expected_apc_state[] = {
+            0xffffeed4, 0xffffeba3
+        };
+
+        // done with setup.
+
+        // first frame is searched, second frame is silence, third frame is the same as the first.
+        for (pass_index=0; pass_index<3; pass_index++)
+        {
+            frame_start[pass_index] = ssnd_chunk_pos;
+
+            if (pass_index == 1)
+            {
+                memset(apc_state, 0, 2 * sizeof(int32_t));
+                AdpcmAifcFile_encode_frame(aaf, silence, apc_state, &ssnd_chunk_pos);
+
+                single_check = apc_state[0] == 0 && apc_state[1] == 0;
+                for (i=0; i<9; i++)
+                {
+                    single_check &= aaf->sound_chunk->sound_data[frame_start[pass_index] + i] == 0;
+                }
+            }
+            else
+            {
+                memcpy(apc_state, starting_apc_state, 2 * sizeof(int32_t));
+                AdpcmAifcFile_encode_frame(aaf, samples_in, apc_state, &ssnd_chunk_pos);
+
+                single_check = apc_state[0] == expected_apc_state[0] && apc_state[1] == expected_apc_state[1];
+                for (i=0; i<9; i++)
+                {
+                    single_check &= aaf->sound_chunk->sound_data[frame_start[pass_index] + i] == expected_ssnd_chunk_data[i];
+                }
+            }
+
+            single_check &= (frame_start[pass_index] + 9) == ssnd_chunk_pos;
+            check &= single_check;
+
+            if (!single_check)
+            {
+                printf("%s %d> frame %d mismatch\n", __func__, __LINE__, pass_index);
+
+                printf("aaf->sound_chunk->sound_data:\n");
+                for (i=0; i<9; i++)
+                {
+                    printf("0x%02x ", (uint8_t)aaf->sound_chunk->sound_data[frame_start[pass_index] + i]);
+                }
+                printf("\n");
+            }
+        }
+
+        AdpcmAifcFile_free(aaf);
+
+        if (check == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+    {
+        printf("aifc test: pruned scale search and integer error metric same as reference (random)\n");
+        *run_count = *run_count + 1;
+        int check = 1;
+        int single_check;
+        int i;
+        int mode;
+        int book_index;
+        int frame_index;
+        int order;
+        int npredictors;
+        int coef_shift;
+        int sample_shift;
+        uint32_t seed = 0x4750524e;
+        uint32_t r;
+
+        int num_books = 40;
+        int num_frames = 400;
+
+        // mode 0 is the reference: every scale in order, float error metric.
+        // mode 1 is the pruned scale search, mode 2 adds the integer error metric.
+        #define TEST_AIFC_NUM_MODES 3
+        int mode_exhaustive[TEST_AIFC_NUM_MODES] = { 1, 0, 0 };
+        int mode_integer[TEST_AIFC_NUM_MODES] = { 0, 0, 1 };
+        const char *mode_name[TEST_AIFC_NUM_MODES] = { "reference", "pruned", "integer" };
+
+        int16_t samples_in[FRAME_DECODE_BUFFER_LEN];
+        int32_t state[TEST_AIFC_NUM_MODES][ADPCM_ENCODE_MEMO_MAX_ORDER];
+        size_t ssnd_chunk_pos;
+
+        // same codebook as AdpcmAifcFile_encode_frame test, used for the first book.
+        uint8_t raw_coef[] = {
+            0x00, 0x30, 0xFF, 0xDC, 0x00, 0x1C, 0xFF, 0xEA,
+            0x00, 0x12, 0xFF, 0xF2, 0x00, 0x0B, 0xFF, 0xF7,
+
+            0xF9, 0xF1, 0x04, 0xC7, 0xFC, 0x3E, 0x02, 0xF5,
+            0xFD, 0xAC, 0x01, 0xD5, 0xFE, 0x8F, 0x01, 0x23,
+
+            0xF9, 0x46, 0xF4, 0x8E, 0xF2, 0x2C, 0xF2, 0x17,
+            0xF3, 0xF2, 0xF7, 0x2D, 0xFB, 0x1E, 0xFF, 0x1B,
+
+            0x0D, 0x9E, 0x10, 0x73, 0x10, 0x8D, 0x0E, 0x57,
+            0x0A, 0x7F, 0x05, 0xCF, 0x01, 0x10, 0xFC, 0xED,
+
+            0x01, 0x82, 0x01, 0x1E, 0x01, 0x1D, 0x01, 0x09,
+            0x00, 0xFA, 0x00, 0xEB, 0x00, 0xDD, 0x00, 0xD0,
+
+            0x05, 0xED, 0x05, 0xE6, 0x05, 0x7C, 0x05, 0x2D,
+            0x04, 0xDE, 0x04, 0x95, 0x04, 0x50, 0x04, 0x0F,
+
+            0xF9, 0x2A, 0xF3, 0x8E, 0xEF, 0x2F, 0xEC, 0x06,
+            0xE9, 0xFF, 0xE9, 0x04, 0xE8, 0xF5, 0xE9, 0xB0,
+
+            0x0E, 0x90, 0x13, 0xAE, 0x17, 0x61, 0x19, 0xC0,
+            0x1A, 0xE6, 0x1A, 0xF8, 0x1A, 0x1C, 0x18, 0x7D
+        };
+
+        // same LCG as bench, so the corpus is the same every run.
+        #define TEST_AIFC_RAND() (seed = seed * 1664525u + 1013904223u, seed >> 8)
+
+        for (book_index = 0; book_index < num_books && check; book_index++)
+        {
+            // separate files for each mode, otherwise a memoised frame could hide a difference.
+            struct AdpcmAifcFile *aaf[TEST_AIFC_NUM_MODES];
+
+            if (book_index == 0)
+            {
+                order = 2;
+                npredictors = 4;
+                coef_shift = 0;
+            }
+            else
+            {
+                order = 1 + (int)(TEST_AIFC_RAND() % 4);
+                npredictors = 1 + (int)(TEST_AIFC_RAND() % 8);
+                coef_shift = 7 + (int)(TEST_AIFC_RAND() % 4);
+            }
+
+            for (mode = 0; mode < TEST_AIFC_NUM_MODES; mode++)
+            {
+                struct AdpcmAifcSoundChunk *snd = AdpcmAifcSoundChunk_new(32);
+                struct AdpcmAifcCodebookChunk *codes = AdpcmAifcCodebookChunk_new(order, npredictors);
+
+                if (mode > 0)
+                {
+                    memcpy(codes->table_data, aaf[0]->codes_chunk->table_data, order * npredictors * 16);
+                }
+                else if (book_index == 0)
+                {
+                    memcpy(codes->table_data, raw_coef, 8*16);
+                }
+                else
+                {
+                    // big endian 16 bit coefficients, small enough that predictions can't overflow.
+                    for (i = 0; i < order * npredictors * 8; i++)
+                    {
+                        r = TEST_AIFC_RAND();
+                        int16_t coef = (int16_t)((int32_t)(r % (2u << coef_shift)) - (1 << coef_shift));
+                        codes->table_data[2*i] = (uint8_t)(((uint16_t)coef) >> 8);
+                        codes->table_data[2*i + 1] = (uint8_t)(((uint16_t)coef) & 0xff);
+                    }
+                }
+
+                AdpcmAifcCodebookChunk_decode_aifc_codebook(codes);
+
+                aaf[mode] = AdpcmAifcFile_new_simple(2);
+                aaf[mode]->chunks[0] = snd;
+                aaf[mode]->chunks[1] = codes;
+                aaf[mode]->sound_chunk = snd;
+                aaf[mode]->codes_chunk = codes;
+            }
+
+            for (frame_index = 0; frame_index < num_frames && check; frame_index++)
+            {
+                // quiet to full range input. Larger coefficients get quieter input, same reason as above.
+                sample_shift = (int)(TEST_AIFC_RAND() % 16);
+                if (book_index == 0)
+                {
+                    if (sample_shift > 11)
+                    {
+                        sample_shift = 11;
+                    }
+                }
+                else if (sample_shift > 22 - coef_shift)
+                {
+                    sample_shift = 22 - coef_shift;
+                }
+
+                for (i = 0; i < FRAME_DECODE_BUFFER_LEN; i++)
+                {
+                    r = TEST_AIFC_RAND();
+                    samples_in[i] = (int16_t)clamp((int32_t)(r % (2u << sample_shift)) - (1 << sample_shift), INT16_MIN, INT16_MAX);
+                }
+
+                // mostly carry the state forward like a real encode, sometimes start over from a new state.
+                if ((frame_index & 3) == 0)
+                {
+                    for (i = 0; i < order; i++)
+                    {
+                        r = TEST_AIFC_RAND();
+                        state[0][i] = (int32_t)(r % (2u << sample_shift)) - (1 << sample_shift);
+                    }
+                }
+
+                for (mode = 1; mode < TEST_AIFC_NUM_MODES; mode++)
+                {
+                    memcpy(state[mode], state[0], order * sizeof(int32_t));
+                }
+
+                for (mode = 0; mode < TEST_AIFC_NUM_MODES; mode++)
+                {
+                    g_AdpcmEncodeExhaustiveScaleSearch = mode_exhaustive[mode];
+                    g_AdpcmEncodeIntegerErrorMetric = mode_integer[mode];
+
+                    ssnd_chunk_pos = 0;
+                    AdpcmAifcFile_encode_frame(aaf[mode], samples_in, state[mode], &ssnd_chunk_pos);
+                }
+
+                for (mode = 1; mode < TEST_AIFC_NUM_MODES; mode++)
+                {
+                    single_check = memcmp(aaf[0]->sound_chunk->sound_data, aaf[mode]->sound_chunk->sound_data, ADPCM_ENCODE_FRAME_LEN) == 0;
+                    single_check &= memcmp(state[0], state[mode], order * sizeof(int32_t)) == 0;
+
+                    if (!single_check)
+                    {
+                        printf("%s %d> book %d frame %d %s mismatch\n", __func__, __LINE__, book_index, frame_index, mode_name[mode]);
+
+                        printf("%s:\n", mode_name[0]);
+                        for (i=0; i<ADPCM_ENCODE_FRAME_LEN; i++)
+                        {
+                            printf("0x%02x ", aaf[0]->sound_chunk->sound_data[i]);
+                        }
+                        printf("\n");
+
+                        printf("%s:\n", mode_name[mode]);
+                        for (i=0; i<ADPCM_ENCODE_FRAME_LEN; i++)
+                        {
+                            printf("0x%02x ", aaf[mode]->sound_chunk->sound_data[i]);
+                        }
+                        printf("\n");
+
+                        check = 0;
+                    }
+                }
+            }
+
+            for (mode = 0; mode < TEST_AIFC_NUM_MODES; mode++)
+            {
+                AdpcmAifcFile_free(aaf[mode]);
+            }
+        }
+
+        #undef TEST_AIFC_RAND
+        #undef TEST_AIFC_NUM_MODES
+
+        g_AdpcmEncodeExhaustiveScaleSearch = 0;
+        g_AdpcmEncodeIntegerErrorMetric = 1;
+
+        if (check == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
 }
\ No newline at end of file
@@ -0,0 +1,244 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "machine_config.h"
+#include "debug.h"
+#include "common.h"
+#include "utility.h"
+#include "gaudio.h"
+#include "test_common.h"
+
+/**
+ * Number of samples in generated test audio.
+*/
+#define TEST_API_SAMPLE_COUNT 4096
+
+/**
+ * Sample rate of generated test audio.
+*/
+#define TEST_API_SAMPLE_RATE 22050
+
+void api_all(int *run_count, int *pass_count, int *fail_count)
+{
+    {
+        printf("api test: midi to cseq to midi buffer round trip\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        struct GaudioError error;
+        uint8_t *midi;
+        size_t midi_len;
+        uint8_t *cseq = NULL;
+        size_t cseq_len = 0;
+        uint8_t *midi2 = NULL;
+        size_t midi2_len = 0;
+        uint8_t *cseq2 = NULL;
+        size_t cseq2_len = 0;
+        int code;
+
+        midi_len = get_file_contents("test_cases/midi/entertainer_short.midi", &midi);
+
+        code = gaudio_midi_to_cseq(midi, midi_len, NULL, &cseq, &cseq_len, &error);
+        pass_single = code == GAUDIO_OK && cseq != NULL && cseq_len > 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: midi to cseq, code=%d, message=%s\n", __func__, __LINE__, code, error.message);
+        }
+
+        if (pass)
+        {
+            code = gaudio_cseq_to_midi(cseq, cseq_len, NULL, &midi2, &midi2_len, &error);
+            pass_single = code == GAUDIO_OK && midi2 != NULL;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail: cseq to midi, code=%d, message=%s\n", __func__, __LINE__, code, error.message);
+            }
+        }
+
+        if (pass)
+        {
+            code = gaudio_midi_to_cseq(midi2, midi2_len, NULL, &cseq2, &cseq2_len, &error);
+            pass_single = code == GAUDIO_OK && cseq2_len == cseq_len && memcmp(cseq, cseq2, cseq_len) == 0;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail: round trip, code=%d, len=%ld, expected len=%ld\n", __func__, __LINE__, code, cseq2_len, cseq_len);
+            }
+        }
+
+        gaudio_buffer_free(cseq2);
+        gaudio_buffer_free(midi2);
+        gaudio_buffer_free(cseq);
+        free(midi);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("api test: pcm to aifc to pcm\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        struct GaudioError error;
+        int16_t *samples;
+        int16_t *decoded = NULL;
+        size_t decoded_count = 0;
+        int decoded_rate = 0;
+        uint8_t *coef;
+        size_t coef_len;
+        uint8_t *aifc = NULL;
+        size_t aifc_len = 0;
+        uint8_t *wav = NULL;
+        size_t wav_len = 0;
+        int code;
+        int i;
+
+        samples = (int16_t *)malloc_zero(TEST_API_SAMPLE_COUNT, sizeof(int16_t));
+        for (i=0; i<TEST_API_SAMPLE_COUNT; i++)
+        {
+            samples[i] = (int16_t)(8000.0 * sin((double)i * 0.05));
+        }
+
+        coef_len = get_file_contents("test_cases/coef_parse/0001.coef", &coef);
+
+        code = gaudio_pcm_to_aifc(samples, TEST_API_SAMPLE_COUNT, TEST_API_SAMPLE_RATE, coef, coef_len, &aifc, &aifc_len, &error);
+        pass_single = code == GAUDIO_OK && aifc != NULL && aifc_len > 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: pcm to aifc, code=%d, message=%s\n", __func__, __LINE__, code, error.message);
+        }
+
+        if (pass)
+        {
+            code = gaudio_aifc_to_pcm(aifc, aifc_len, &decoded, &decoded_count, &decoded_rate, &error);
+            pass_single = code == GAUDIO_OK
+                && decoded != NULL
+                && decoded_rate == TEST_API_SAMPLE_RATE
+                && decoded_count >= TEST_API_SAMPLE_COUNT - 16
+                && decoded_count <= TEST_API_SAMPLE_COUNT + 16;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail: aifc to pcm, code=%d, count=%ld, rate=%d, message=%s\n", __func__, __LINE__, code, decoded_count, decoded_rate, error.message);
+            }
+        }
+
+        // .wav contains the same samples after the 44 byte header.
+        if (pass)
+        {
+            code = gaudio_aifc_to_wav(aifc, aifc_len, NULL, &wav, &wav_len, &error);
+            pass_single = code == GAUDIO_OK
+                && wav_len == 44 + decoded_count * sizeof(int16_t)
+                && memcmp(wav, "RIFF", 4) == 0
+                && memcmp(wav + 44, decoded, decoded_count * sizeof(int16_t)) == 0;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail: aifc to wav, code=%d, len=%ld\n", __func__, __LINE__, code, wav_len);
+            }
+        }
+
+        gaudio_buffer_free(decoded);
+        gaudio_buffer_free(wav);
+        gaudio_buffer_free(aifc);
+        free(coef);
+        free(samples);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("api test: error returned, no output\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        struct GaudioError error;
+        uint8_t garbage[64];
+        uint8_t *wav = (uint8_t *)&pass;
+        size_t wav_len = 1;
+        int code;
+
+        memset(garbage, 0x5a, sizeof(garbage));
+
+        code = gaudio_aifc_to_wav(garbage, sizeof(garbage), NULL, &wav, &wav_len, &error);
+        pass_single = code != GAUDIO_OK
+            && error.code == code
+            && error.message[0] != '\0'
+            && wav == NULL
+            && wav_len == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: code=%d, message=%s\n", __func__, __LINE__, code, error.message);
+        }
+
+        code = gaudio_aifc_to_wav(NULL, 0, NULL, &wav, &wav_len, &error);
+        pass_single = code == EXIT_CODE_NULL_REFERENCE_EXCEPTION && wav == NULL;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: NULL input, code=%d\n", __func__, __LINE__, code);
+        }
+
+        pass_single = gaudio_version_number() == GAUDIO_VERSION_NUMBER && strcmp(gaudio_version(), GAUDIO_VERSION_STRING) == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: version %s\n", __func__, __LINE__, gaudio_version());
+        }
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+}
@@ -44,6 +44,7 @@ void parse_seq_bytes_to_event_list(uint8_t *data, size_t buffer_len, struct Link
 // top level test entry points.
 
 void test_md5_all(int *run_count, int *pass_count, int *fail_count);
+void utility_all(int *run_count, int *pass_count, int *fail_count);
 void linked_list_all(int *run_count, int *pass_count, int *fail_count);
 void int_hash_all(int *run_count, int *pass_count, int *fail_count);
 void string_hash_all(int *run_count, int *pass_count, int *fail_count);
@@ -52,6 +53,14 @@ void parse_coef_all(int *run_count, int *pass_count, int *fail_count);
 void aifc_all(int *run_count, int *pass_count, int *fail_count);
 void magic_all(int *run_count, int *pass_count, int *fail_count);
 void midi_all(int *run_count, int *pass_count, int *fail_count);
+void render_all(int *run_count, int *pass_count, int *fail_count);
+void trace_all(int *run_count, int *pass_count, int *fail_count);
+void stats_all(int *run_count, int *pass_count, int *fail_count);
+void ipc_all(int *run_count, int *pass_count, int *fail_count);
+void gaudio_error_all(int *run_count, int *pass_count, int *fail_count);
+void api_all(int *run_count, int *pass_count, int *fail_count);
+void wav_convert_all(int *run_count, int *pass_count, int *fail_count);
+void wav_stream_all(int *run_count, int *pass_count, int *fail_count);
 
 // child test entry points
 
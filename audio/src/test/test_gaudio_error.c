@@ -0,0 +1,338 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "machine_config.h"
+#include "debug.h"
+#include "common.h"
+#include "utility.h"
+#include "gaudio_error.h"
+#include "parallel.h"
+#include "gaudio_try.h"
+#include "test_common.h"
+
+// forward declarations
+
+static void test_gaudio_error_ok_callback(void *state);
+static void test_gaudio_error_raise_callback(void *state);
+static void test_gaudio_error_nested_callback(void *state);
+static void test_gaudio_error_parallel_callback(void *state);
+static void test_gaudio_error_parallel_item(int index, void *state);
+
+/**
+ * Number of work items in parallel test.
+*/
+#define TEST_GAUDIO_ERROR_PARALLEL_COUNT 64
+
+/**
+ * State for parallel test.
+*/
+struct TestGaudioErrorParallel {
+    // index of item that reports an error, or -1.
+    int fail_index;
+
+    // allocated by each item.
+    uint8_t *buffers[TEST_GAUDIO_ERROR_PARALLEL_COUNT];
+};
+
+// end forward declarations
+
+void gaudio_error_all(int *run_count, int *pass_count, int *fail_count)
+{
+    {
+        printf("gaudio_error test: return code and message\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        struct GaudioError error;
+        int value = 0;
+        int code;
+
+        code = gaudio_try(test_gaudio_error_ok_callback, &value, &error);
+
+        pass_single = code == GAUDIO_OK && error.code == GAUDIO_OK && error.message[0] == '\0' && value == 1;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: success, code=%d\n", __func__, __LINE__, code);
+        }
+
+        code = gaudio_try(test_gaudio_error_raise_callback, &value, &error);
+
+        pass_single = code == EXIT_CODE_IO
+            && error.code == EXIT_CODE_IO
+            && strcmp(error.message, "cannot read 7") == 0
+            && gaudio_error_trap_active() == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: error, code=%d, message=%s\n", __func__, __LINE__, code, error.message);
+        }
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("gaudio_error test: nested\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        struct GaudioError error;
+        int inner_code = 0;
+        int code;
+
+        code = gaudio_try(test_gaudio_error_nested_callback, &inner_code, &error);
+
+        pass_single = code == GAUDIO_OK && inner_code == EXIT_CODE_IO;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: code=%d, inner_code=%d\n", __func__, __LINE__, code, inner_code);
+        }
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("gaudio_error test: parallel_for\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        struct GaudioError error;
+        struct TestGaudioErrorParallel parallel;
+        int save_num_threads = g_parallel_num_threads;
+        int code;
+        int i;
+
+        g_parallel_num_threads = 4;
+
+        memset(&parallel, 0, sizeof(struct TestGaudioErrorParallel));
+        parallel.fail_index = -1;
+
+        code = gaudio_try(test_gaudio_error_parallel_callback, &parallel, &error);
+
+        pass_single = code == GAUDIO_OK;
+        for (i=0; i<TEST_GAUDIO_ERROR_PARALLEL_COUNT; i++)
+        {
+            pass_single &= parallel.buffers[i] != NULL && parallel.buffers[i][0] == (uint8_t)i;
+            free(parallel.buffers[i]);
+        }
+
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: success, code=%d\n", __func__, __LINE__, code);
+        }
+
+        // buffers allocated by items on any thread are released.
+        memset(&parallel, 0, sizeof(struct TestGaudioErrorParallel));
+        parallel.fail_index = TEST_GAUDIO_ERROR_PARALLEL_COUNT / 2;
+
+        code = gaudio_try(test_gaudio_error_parallel_callback, &parallel, &error);
+
+        pass_single = code == EXIT_CODE_IO && strcmp(error.message, "cannot read 32") == 0 && gaudio_error_trap_active() == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: error, code=%d, message=%s\n", __func__, __LINE__, code, error.message);
+        }
+
+        g_parallel_num_threads = save_num_threads;
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("gaudio_error test: library entry points\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        struct GaudioError error;
+        struct FileInfo *fi = NULL;
+        struct ALADPCMBook *book = (struct ALADPCMBook *)&error;
+        struct MidiFile *midi_file = NULL;
+        struct CseqFile *cseq_file = NULL;
+        struct MidiConvertOptions *options;
+        int code;
+
+        code = FileInfo_fopen_try("test_cases/does_not_exist.bin", "rb", &fi, &error);
+
+        pass_single = code == EXIT_CODE_IO && fi == NULL && strstr(error.message, "does_not_exist.bin") != NULL;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: missing file, code=%d\n", __func__, __LINE__, code);
+        }
+
+        // not a .coef file
+        code = FileInfo_fopen_try("test_cases/midi/entertainer_short.midi", "rb", &fi, &error);
+        pass_single = code == GAUDIO_OK && fi != NULL;
+        pass &= pass_single;
+
+        if (pass_single)
+        {
+            code = ALADPCMBook_new_from_coef_try(fi, &book, &error);
+
+            pass_single = code != GAUDIO_OK && book == NULL && error.message[0] != '\0';
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail: invalid coef, code=%d\n", __func__, __LINE__, code);
+            }
+
+            // same file handle can still be used after an error
+            code = MidiFile_new_from_file_try(fi, &midi_file, &error);
+
+            pass_single = code == GAUDIO_OK && midi_file != NULL;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail: read midi, code=%d, message=%s\n", __func__, __LINE__, code, error.message);
+            }
+
+            FileInfo_free(fi);
+        }
+        else
+        {
+            printf("%s %d> fail: open midi, code=%d\n", __func__, __LINE__, code);
+        }
+
+        if (midi_file != NULL)
+        {
+            options = MidiConvertOptions_new();
+            code = CseqFile_from_MidiFile_try(midi_file, options, &cseq_file, &error);
+
+            pass_single = code == GAUDIO_OK && cseq_file != NULL;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail: convert midi, code=%d, message=%s\n", __func__, __LINE__, code, error.message);
+            }
+
+            CseqFile_free(cseq_file);
+            MidiConvertOptions_free(options);
+            MidiFile_free(midi_file);
+        }
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+}
+
+static void test_gaudio_error_ok_callback(void *state)
+{
+    *(int *)state = 1;
+}
+
+/**
+ * Allocates memory then reports error. Memory is released by {@code gaudio_try}.
+*/
+static void test_gaudio_error_raise_callback(void *state)
+{
+    uint8_t *buffer = (uint8_t *)malloc_zero(1, 100);
+    uint8_t *freed = (uint8_t *)malloc_zero(1, 100);
+
+    gaudio_free(freed);
+    buffer[0] = 1;
+
+    stderr_exit(EXIT_CODE_IO, "cannot read %d\n", 7);
+}
+
+/**
+ * Allocates memory, runs nested call that fails, then frees memory.
+*/
+static void test_gaudio_error_nested_callback(void *state)
+{
+    struct GaudioError inner_error;
+    uint8_t *buffer = (uint8_t *)malloc_zero(1, 100);
+    int value = 0;
+
+    *(int *)state = gaudio_try(test_gaudio_error_raise_callback, &value, &inner_error);
+
+    buffer[0] = 1;
+    gaudio_free(buffer);
+}
+
+/**
+ * Runs parallel test items.
+*/
+static void test_gaudio_error_parallel_callback(void *state)
+{
+    parallel_for(TEST_GAUDIO_ERROR_PARALLEL_COUNT, test_gaudio_error_parallel_item, state);
+}
+
+/**
+ * Allocates memory for the item, frees a temporary buffer, and reports error
+ * for the failing item.
+*/
+static void test_gaudio_error_parallel_item(int index, void *state)
+{
+    struct TestGaudioErrorParallel *parallel = (struct TestGaudioErrorParallel *)state;
+    uint8_t *temp = (uint8_t *)malloc_zero(1, 32);
+
+    parallel->buffers[index] = (uint8_t *)malloc_zero(1, 64);
+    parallel->buffers[index][0] = (uint8_t)index;
+
+    gaudio_free(temp);
+
+    if (index == parallel->fail_index)
+    {
+        stderr_exit(EXIT_CODE_IO, "cannot read %d\n", index);
+    }
+}
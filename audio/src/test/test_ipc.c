@@ -0,0 +1,315 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include "machine_config.h"
+#include "debug.h"
+#include "common.h"
+#include "utility.h"
+#include "ipc.h"
+#include "test_common.h"
+
+void ipc_all(int *run_count, int *pass_count, int *fail_count)
+{
+    {
+        printf("ipc test: pack/unpack strings\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        char *strings[] = { "/tmp", "wav2aifc", "", "--in", "file name.wav" };
+        char **unpacked;
+        uint8_t *buffer;
+        size_t len;
+        int count = 0;
+        int i;
+
+        buffer = ipc_pack_strings(5, strings, &len);
+        unpacked = ipc_unpack_strings(buffer, len, &count);
+
+        pass_single = unpacked != NULL && count == 5 && unpacked[5] == NULL;
+        for (i=0; pass_single && i<5; i++)
+        {
+            pass_single = strcmp(unpacked[i], strings[i]) == 0;
+        }
+
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: unpacked strings don't match\n", __func__, __LINE__);
+        }
+
+        if (unpacked != NULL)
+        {
+            free(unpacked);
+        }
+
+        // truncated buffer is rejected
+        unpacked = ipc_unpack_strings(buffer, len - 1, &count);
+        pass_single = unpacked == NULL;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: truncated buffer accepted\n", __func__, __LINE__);
+            free(unpacked);
+        }
+
+        free(buffer);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("ipc test: message roundtrip\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        uint8_t payload[] = { 0x00, 0x01, 0xff, 0x80, 0x7f };
+        uint8_t *received = NULL;
+        size_t received_len = 0;
+        int fds[2];
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        {
+            stderr_exit(EXIT_CODE_IO, "%s %d> socketpair failed\n", __func__, __LINE__);
+        }
+
+        pass_single = ipc_write_message(fds[0], payload, sizeof(payload)) == IPC_OK
+            && ipc_write_message(fds[0], payload, 0) == IPC_OK;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: write message\n", __func__, __LINE__);
+        }
+
+        pass_single = ipc_read_message(fds[1], &received, &received_len) == IPC_OK
+            && received_len == sizeof(payload)
+            && memcmp(received, payload, sizeof(payload)) == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: read message\n", __func__, __LINE__);
+        }
+
+        free(received);
+        received = NULL;
+
+        pass_single = ipc_read_message(fds[1], &received, &received_len) == IPC_OK
+            && received_len == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: read empty message\n", __func__, __LINE__);
+        }
+
+        free(received);
+        received = NULL;
+
+        // peer closed
+        close(fds[0]);
+        pass_single = ipc_read_message(fds[1], &received, &received_len) == IPC_CLOSED;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: closed connection not detected\n", __func__, __LINE__);
+        }
+
+        close(fds[1]);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("ipc test: listen only replaces existing socket\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        char path[] = "/tmp/gaudio_ipc_test_XXXXXX";
+        int file_fd;
+        int fd;
+
+        file_fd = mkstemp(path);
+        if (file_fd < 0)
+        {
+            stderr_exit(EXIT_CODE_IO, "%s %d> mkstemp failed\n", __func__, __LINE__);
+        }
+
+        close(file_fd);
+
+        // regular file, must not be removed
+        pass_single = ipc_listen_unix(path, 1) == IPC_ERROR
+            && access(path, F_OK) == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: regular file at socket path\n", __func__, __LINE__);
+        }
+
+        unlink(path);
+
+        fd = ipc_listen_unix(path, 1);
+        pass_single = fd >= 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: listen on new path\n", __func__, __LINE__);
+        }
+        else
+        {
+            close(fd);
+        }
+
+        // stale socket left behind
+        fd = ipc_listen_unix(path, 1);
+        pass_single = fd >= 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: listen on stale socket\n", __func__, __LINE__);
+        }
+        else
+        {
+            close(fd);
+        }
+
+        unlink(path);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("ipc test: default socket path and permissions\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        char dir[] = "/tmp/gaudio_ipc_test_XXXXXX";
+        char expected[PATH_MAX];
+        char path[PATH_MAX];
+        char *saved_runtime_dir = NULL;
+        const char *env;
+        struct stat st;
+        int fd;
+
+        if (mkdtemp(dir) == NULL)
+        {
+            stderr_exit(EXIT_CODE_IO, "%s %d> mkdtemp failed\n", __func__, __LINE__);
+        }
+
+        env = getenv(IPC_RUNTIME_DIR_ENV);
+        if (env != NULL)
+        {
+            saved_runtime_dir = strdup(env);
+        }
+
+        setenv(IPC_RUNTIME_DIR_ENV, dir, 1);
+        snprintf(expected, PATH_MAX, "%s/%s", dir, IPC_SOCKET_NAME);
+
+        pass_single = ipc_default_socket_path(path, PATH_MAX, 1) == IPC_OK
+            && strcmp(path, expected) == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: default path, expected %s\n", __func__, __LINE__, expected);
+        }
+
+        // too small for the path
+        pass_single = ipc_default_socket_path(path, 4, 0) == IPC_ERROR;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: short buffer\n", __func__, __LINE__);
+        }
+
+        // only current user can connect, regardless of umask
+        fd = ipc_listen_unix(expected, 1);
+        pass_single = fd >= 0
+            && lstat(expected, &st) == 0
+            && S_ISSOCK(st.st_mode)
+            && (st.st_mode & 077) == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: socket permissions\n", __func__, __LINE__);
+        }
+
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        unlink(expected);
+        rmdir(dir);
+
+        if (saved_runtime_dir != NULL)
+        {
+            setenv(IPC_RUNTIME_DIR_ENV, saved_runtime_dir, 1);
+            free(saved_runtime_dir);
+        }
+        else
+        {
+            unsetenv(IPC_RUNTIME_DIR_ENV);
+        }
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+}
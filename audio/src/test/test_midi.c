@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "test_common.h"
 #include "machine_config.h"
 #include "debug.h"
@@ -27,11 +28,32 @@
 #include "utility.h"
 #include "llist.h"
 #include "naudio.h"
+#include "parallel.h"
 #include "midi.h"
+#include "gaudio_error.h"
+
+/**
+ * State for {@code test_cseq_unroll_callback}.
+*/
+struct TestCseqUnroll {
+    struct CseqFile *cseq;
+    struct GmidTrack *track;
+    struct LinkedList *patterns;
+};
 
 // forward declarations
 
 static void test_midi_parser(int *run_count, int *pass_count, int *fail_count);
+static void test_midi_stream(int *run_count, int *pass_count, int *fail_count);
+static void test_midi_transform_pipeline(int *run_count, int *pass_count, int *fail_count);
+static void test_midi_parallel(int *run_count, int *pass_count, int *fail_count);
+static void test_midi_varint(int *run_count, int *pass_count, int *fail_count);
+static void test_midi_cseq_unroll(int *run_count, int *pass_count, int *fail_count);
+static int test_cseq_unroll(uint8_t *data, size_t data_len, size_t track_start, size_t track_len, struct GmidTrack *track, int *pattern_count);
+static void test_cseq_unroll_callback(void *state);
+static int test_stream_make_channel_track(struct GmidEvent *event, int track_index, void *state);
+static int test_stream_set_channel_instrument(struct GmidEvent *event, int track_index, void *state);
+static size_t test_capture_midi_parse(struct FileInfo *fi, int stream, int parse_track_arg, char **out);
 
 // end forward declarations
 
@@ -40,10 +62,30 @@ void midi_all(int *run_count, int *pass_count, int *fail_count)
     int sub_count;
     int local_run_count = 0;
 
+    sub_count = 0;
+    test_midi_varint(&sub_count, pass_count, fail_count);
+    local_run_count += sub_count;
+
+    sub_count = 0;
+    test_midi_cseq_unroll(&sub_count, pass_count, fail_count);
+    local_run_count += sub_count;
+
     sub_count = 0;
     test_midi_parser(&sub_count, pass_count, fail_count);
     local_run_count += sub_count;
 
+    sub_count = 0;
+    test_midi_stream(&sub_count, pass_count, fail_count);
+    local_run_count += sub_count;
+
+    sub_count = 0;
+    test_midi_transform_pipeline(&sub_count, pass_count, fail_count);
+    local_run_count += sub_count;
+
+    sub_count = 0;
+    test_midi_parallel(&sub_count, pass_count, fail_count);
+    local_run_count += sub_count;
+
     sub_count = 0;
     midi_convert_all(&sub_count, pass_count, fail_count);
     local_run_count += sub_count;
@@ -6422,4 +6464,807 @@ void test_midi_parser(int *run_count, int *pass_count, int *fail_count)
             *fail_count = *fail_count + 1;
         }
     }
-}
\ No newline at end of file
+}
+
+static int test_stream_make_channel_track(struct GmidEvent *event, int track_index, void *state)
+{
+    if (event->midi_valid)
+    {
+        event->command_channel = track_index;
+    }
+
+    return 1;
+}
+
+/**
+ * Same as miditool set-channel-instrument stream callback.
+ * @param state: int array of channel, instrument.
+*/
+static int test_stream_set_channel_instrument(struct GmidEvent *event, int track_index, void *state)
+{
+    int *channel_instrument = (int *)state;
+
+    (void)track_index;
+
+    if (event->midi_valid
+        && event->command == MIDI_COMMAND_BYTE_PROGRAM_CHANGE
+        && event->command_channel == channel_instrument[0])
+    {
+        event->midi_command_parameters[0] = channel_instrument[1];
+        event->midi_command_parameters_raw[0] = channel_instrument[1];
+    }
+
+    return 1;
+}
+
+/**
+ * Runs {@code MidiFile_parse} or {@code MidiFile_stream_parse} and captures stdout.
+ * @param fi: MIDI file to parse.
+ * @param stream: whether to use the streaming version.
+ * @param parse_track_arg: parse_track_arg argument.
+ * @param out: out parameter. Captured output, caller frees.
+ * @returns: length of captured output, without event ids.
+*/
+static size_t test_capture_midi_parse(struct FileInfo *fi, int stream, int parse_track_arg, char **out)
+{
+    FILE *fp;
+    struct MidiFile *midi_file;
+    int saved_stdout;
+    long len;
+    size_t i;
+    size_t j;
+
+    fflush(stdout);
+    saved_stdout = dup(fileno(stdout));
+    fp = tmpfile();
+    dup2(fileno(fp), fileno(stdout));
+
+    if (stream)
+    {
+        MidiFile_stream_parse(fi, parse_track_arg);
+    }
+    else
+    {
+        midi_file = MidiFile_new_from_file(fi);
+        MidiFile_parse(midi_file, parse_track_arg);
+        MidiFile_free(midi_file);
+    }
+
+    fflush(stdout);
+    dup2(saved_stdout, fileno(stdout));
+    close(saved_stdout);
+
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    rewind(fp);
+
+    *out = (char *)malloc_zero(1, (size_t)len + 1);
+    if (len > 0 && fread(*out, (size_t)len, 1, fp) != 1)
+    {
+        len = 0;
+    }
+
+    fclose(fp);
+
+    // event ids come from a global counter, remove them so output can be compared.
+    for (i=0, j=0; i<(size_t)len; i++)
+    {
+        if (strncmp(&(*out)[i], "id=", 3) == 0 && (i == 0 || (*out)[i-1] == '\n'))
+        {
+            while (i < (size_t)len && (*out)[i] != ',')
+            {
+                i++;
+            }
+
+            continue;
+        }
+
+        (*out)[j++] = (*out)[i];
+    }
+
+    (*out)[j] = '\0';
+
+    return j;
+}
+
+void test_midi_stream(int *run_count, int *pass_count, int *fail_count)
+{
+    {
+        printf("MIDI stream: reader events match GmidFile_new_from_midi\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        struct FileInfo *fi;
+        struct MidiFile *midi_file;
+        struct GmidFile *gmid_file;
+        struct MidiEventReader *reader;
+        struct GmidEvent *event;
+        struct GmidEvent *expected_event;
+        struct LinkedListNode *node;
+        int num_tracks = 0;
+
+        fi = FileInfo_fopen("test_cases/midi/entertainer_short.midi", "rb");
+        midi_file = MidiFile_new_from_file(fi);
+        gmid_file = GmidFile_new_from_midi(midi_file, 1);
+
+        reader = MidiEventReader_new(fi);
+
+        while (MidiEventReader_next_track(reader))
+        {
+            node = gmid_file->tracks[reader->track_index]->events->head;
+
+            while ((event = MidiEventReader_next_event(reader)) != NULL)
+            {
+                if (node == NULL)
+                {
+                    printf("%s %d> fail: track %d has more streamed events than expected\n", __func__, __LINE__, reader->track_index);
+                    pass = 0;
+                    GmidEvent_free(event);
+                    break;
+                }
+
+                expected_event = (struct GmidEvent *)node->data;
+
+                pass_single = event->absolute_time == expected_event->absolute_time
+                    && event->file_offset == expected_event->file_offset
+                    && event->command == expected_event->command
+                    && event->command_channel == expected_event->command_channel
+                    && event->midi_command_parameters_raw_len == expected_event->midi_command_parameters_raw_len
+                    && memcmp(event->midi_command_parameters_raw, expected_event->midi_command_parameters_raw, (size_t)event->midi_command_parameters_raw_len) == 0;
+                pass &= pass_single;
+                if (!pass_single)
+                {
+                    printf("%s %d> fail: track %d, event at offset %ld does not match\n", __func__, __LINE__, reader->track_index, (long)expected_event->file_offset);
+                }
+
+                GmidEvent_free(event);
+                node = node->next;
+            }
+
+            pass_single = node == NULL;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail: track %d has fewer streamed events than expected\n", __func__, __LINE__, reader->track_index);
+            }
+
+            num_tracks++;
+        }
+
+        pass_single = num_tracks == midi_file->num_tracks;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail num_tracks: expected %d, actual %d\n", __func__, __LINE__, midi_file->num_tracks, num_tracks);
+        }
+
+        // cleanup
+        MidiEventReader_free(reader);
+        GmidFile_free(gmid_file);
+        MidiFile_free(midi_file);
+        FileInfo_free(fi);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("MIDI stream: transform make-channel-track matches MidiFile_transform_make_channel_track\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        char *expected_filename = "test_cases/midi/stream_expected.midi~";
+        char *actual_filename = "test_cases/midi/stream_actual.midi~";
+        struct FileInfo *fi;
+        struct FileInfo *output;
+        struct MidiFile *midi_file;
+        struct MidiFile *transformed;
+        uint8_t *expected = NULL;
+        uint8_t *actual = NULL;
+        size_t expected_len;
+        size_t actual_len;
+
+        fi = FileInfo_fopen("test_cases/midi/entertainer_short.midi", "rb");
+
+        midi_file = MidiFile_new_from_file(fi);
+        transformed = MidiFile_transform_make_channel_track(midi_file);
+        output = FileInfo_fopen(expected_filename, "wb");
+        MidiFile_fwrite(transformed, output);
+        FileInfo_free(output);
+
+        output = FileInfo_fopen(actual_filename, "wb");
+        MidiFile_stream_transform(fi, output, 1, test_stream_make_channel_track, NULL);
+        FileInfo_free(output);
+
+        expected_len = get_file_contents(expected_filename, &expected);
+        actual_len = get_file_contents(actual_filename, &actual);
+
+        pass_single = expected_len == actual_len && memcmp(expected, actual, expected_len) == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail streamed output\n", __func__, __LINE__);
+            print_expected_vs_actual_arr(expected, expected_len, actual, actual_len);
+        }
+
+        // cleanup
+        remove(expected_filename);
+        remove(actual_filename);
+        free(expected);
+        free(actual);
+        MidiFile_free(transformed);
+        MidiFile_free(midi_file);
+        FileInfo_free(fi);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("MIDI stream: transform set-channel-instrument matches MidiFile_transform_set_channel_instrument\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        char *expected_filename = "test_cases/midi/stream_expected.midi~";
+        char *actual_filename = "test_cases/midi/stream_actual.midi~";
+        struct FileInfo *fi;
+        struct FileInfo *output;
+        struct MidiFile *midi_file;
+        struct MidiFile *transformed;
+        uint8_t *expected = NULL;
+        uint8_t *actual = NULL;
+        size_t expected_len;
+        size_t actual_len;
+        int channel_instrument[2] = { 1, 7 };
+
+        fi = FileInfo_fopen("test_cases/midi/entertainer_short.midi", "rb");
+
+        midi_file = MidiFile_new_from_file(fi);
+        transformed = MidiFile_transform_set_channel_instrument(midi_file, channel_instrument[0], channel_instrument[1]);
+        output = FileInfo_fopen(expected_filename, "wb");
+        MidiFile_fwrite(transformed, output);
+        FileInfo_free(output);
+
+        output = FileInfo_fopen(actual_filename, "wb");
+        MidiFile_stream_transform(fi, output, 0, test_stream_set_channel_instrument, channel_instrument);
+        FileInfo_free(output);
+
+        expected_len = get_file_contents(expected_filename, &expected);
+        actual_len = get_file_contents(actual_filename, &actual);
+
+        pass_single = expected_len == actual_len && memcmp(expected, actual, expected_len) == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail streamed output\n", __func__, __LINE__);
+            print_expected_vs_actual_arr(expected, expected_len, actual, actual_len);
+        }
+
+        // cleanup
+        remove(expected_filename);
+        remove(actual_filename);
+        free(expected);
+        free(actual);
+        MidiFile_free(transformed);
+        MidiFile_free(midi_file);
+        FileInfo_free(fi);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("MIDI stream: parse and parse-track match MidiFile_parse\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        struct FileInfo *fi;
+        char *expected;
+        char *actual;
+        size_t expected_len;
+        size_t actual_len;
+        int parse_track_args[] = { -1, 1 };
+        int i;
+
+        fi = FileInfo_fopen("test_cases/midi/entertainer_short.midi", "rb");
+
+        for (i=0; i<2; i++)
+        {
+            expected_len = test_capture_midi_parse(fi, 0, parse_track_args[i], &expected);
+            actual_len = test_capture_midi_parse(fi, 1, parse_track_args[i], &actual);
+
+            pass_single = expected_len > 0 && expected_len == actual_len && memcmp(expected, actual, expected_len) == 0;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail parse track %d\n", __func__, __LINE__, parse_track_args[i]);
+                printf("expected:\n%s\n", expected);
+                printf("actual:\n%s\n", actual);
+            }
+
+            free(expected);
+            free(actual);
+        }
+
+        // cleanup
+        FileInfo_free(fi);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+}
+
+void test_midi_transform_pipeline(int *run_count, int *pass_count, int *fail_count)
+{
+    {
+        printf("MIDI transform pipeline: same result as applying transforms one at a time\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        struct FileInfo *fi;
+        struct MidiFile *midi_file;
+        struct MidiFile *expected;
+        struct MidiFile *actual;
+        struct MidiFile *temp;
+        int i;
+
+        struct MidiTransformStep steps[] = {
+            { .transform = MIDI_TRANSFORM_SET_CHANNEL_INSTRUMENT, .channel = 0, .instrument = 5 },
+            { .transform = MIDI_TRANSFORM_ADD_NOTE_LOOP, .track = 0, .loop_number = 1 },
+            { .transform = MIDI_TRANSFORM_MAKE_CHANNEL_TRACK },
+            { .transform = MIDI_TRANSFORM_ADD_NOTE_LOOP, .track = 0, .loop_number = 2 },
+            { .transform = MIDI_TRANSFORM_REMOVE_LOOP, .track = 0, .loop_number = 1 },
+            { .transform = MIDI_TRANSFORM_SET_CHANNEL_INSTRUMENT, .channel = 0, .instrument = 9 },
+        };
+
+        fi = FileInfo_fopen("test_cases/midi/entertainer_short.midi", "rb");
+        midi_file = MidiFile_new_from_file(fi);
+
+        expected = MidiFile_transform_set_channel_instrument(midi_file, 0, 5);
+        temp = MidiFile_transform_add_note_loop(expected, 1, 0);
+        MidiFile_free(expected);
+        expected = MidiFile_transform_make_channel_track(temp);
+        MidiFile_free(temp);
+        temp = MidiFile_transform_add_note_loop(expected, 2, 0);
+        MidiFile_free(expected);
+        expected = MidiFile_transform_remove_loop(temp, 1, 0);
+        MidiFile_free(temp);
+        temp = MidiFile_transform_set_channel_instrument(expected, 0, 9);
+        MidiFile_free(expected);
+        expected = temp;
+
+        actual = MidiFile_transform_pipeline(midi_file, steps, sizeof(steps) / sizeof(steps[0]));
+
+        pass_single = expected->num_tracks == actual->num_tracks;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail num_tracks: expected %d, actual %d\n", __func__, __LINE__, expected->num_tracks, actual->num_tracks);
+        }
+
+        for (i=0; pass_single && i<expected->num_tracks; i++)
+        {
+            int track_pass = expected->tracks[i]->ck_data_size == actual->tracks[i]->ck_data_size
+                && memcmp(expected->tracks[i]->data, actual->tracks[i]->data, expected->tracks[i]->ck_data_size) == 0;
+            pass &= track_pass;
+            if (!track_pass)
+            {
+                printf("%s %d> fail track %d\n", __func__, __LINE__, i);
+                print_expected_vs_actual_arr(expected->tracks[i]->data, expected->tracks[i]->ck_data_size, actual->tracks[i]->data, actual->tracks[i]->ck_data_size);
+            }
+        }
+
+        // cleanup
+        MidiFile_free(actual);
+        MidiFile_free(expected);
+        MidiFile_free(midi_file);
+        FileInfo_free(fi);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+}
+
+void test_midi_parallel(int *run_count, int *pass_count, int *fail_count)
+{
+    {
+        printf("MIDI convert: parallel tracks same result as single thread\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        struct FileInfo *fi;
+        struct MidiFile *midi_file;
+        struct CseqFile *expected_cseq;
+        struct CseqFile *actual_cseq;
+        struct MidiFile *expected_midi;
+        struct MidiFile *actual_midi;
+        struct CseqFile *seq_file;
+        struct FileInfo *output;
+        char *seq_filename = "test_cases/midi/parallel.seq~";
+        int previous_num_threads = g_parallel_num_threads;
+        int i;
+
+        fi = FileInfo_fopen("test_cases/midi/entertainer_short.midi", "rb");
+        midi_file = MidiFile_new_from_file(fi);
+
+        g_parallel_num_threads = 1;
+        expected_cseq = CseqFile_from_MidiFile(midi_file, NULL);
+
+        // track lengths are only known when reading cseq from file.
+        output = FileInfo_fopen(seq_filename, "wb");
+        CseqFile_fwrite(expected_cseq, output);
+        FileInfo_free(output);
+        output = FileInfo_fopen(seq_filename, "rb");
+        seq_file = CseqFile_new_from_file(output);
+        FileInfo_free(output);
+        remove(seq_filename);
+
+        expected_midi = MidiFile_from_CseqFile(seq_file, NULL);
+
+        g_parallel_num_threads = 4;
+        actual_cseq = CseqFile_from_MidiFile(midi_file, NULL);
+        actual_midi = MidiFile_from_CseqFile(seq_file, NULL);
+
+        g_parallel_num_threads = previous_num_threads;
+
+        pass_single = expected_cseq->compressed_data_len == actual_cseq->compressed_data_len
+            && memcmp(expected_cseq->compressed_data, actual_cseq->compressed_data, expected_cseq->compressed_data_len) == 0
+            && memcmp(expected_cseq->track_offset, actual_cseq->track_offset, sizeof(expected_cseq->track_offset)) == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail cseq\n", __func__, __LINE__);
+            print_expected_vs_actual_arr(expected_cseq->compressed_data, expected_cseq->compressed_data_len, actual_cseq->compressed_data, actual_cseq->compressed_data_len);
+        }
+
+        pass_single = expected_midi->num_tracks == actual_midi->num_tracks;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail num_tracks: expected %d, actual %d\n", __func__, __LINE__, expected_midi->num_tracks, actual_midi->num_tracks);
+        }
+
+        for (i=0; pass_single && i<expected_midi->num_tracks; i++)
+        {
+            int track_pass = expected_midi->tracks[i]->ck_data_size == actual_midi->tracks[i]->ck_data_size
+                && memcmp(expected_midi->tracks[i]->data, actual_midi->tracks[i]->data, expected_midi->tracks[i]->ck_data_size) == 0;
+            pass &= track_pass;
+            if (!track_pass)
+            {
+                printf("%s %d> fail track %d\n", __func__, __LINE__, i);
+                print_expected_vs_actual_arr(expected_midi->tracks[i]->data, expected_midi->tracks[i]->ck_data_size, actual_midi->tracks[i]->data, actual_midi->tracks[i]->ck_data_size);
+            }
+        }
+
+        // cleanup
+        MidiFile_free(actual_midi);
+        MidiFile_free(expected_midi);
+        CseqFile_free(seq_file);
+        CseqFile_free(actual_cseq);
+        CseqFile_free(expected_cseq);
+        MidiFile_free(midi_file);
+        FileInfo_free(fi);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+}
+
+void test_midi_varint(int *run_count, int *pass_count, int *fail_count)
+{
+    {
+        printf("MIDI varint: buffer encode/decode same as VarLengthInt\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        // values on each side of the byte length boundaries.
+        int32_t values[] = {
+            0, 1, 0x7f, 0x80, 0x3fff, 0x4000, 0x1fffff, 0x200000, 0xfffffff, 0x10000000, 0x7fffffff
+        };
+        struct VarLengthInt varint;
+        uint8_t expected[VAR_INT_MAX_BYTES];
+        uint8_t actual[VAR_INT_MAX_BYTES];
+        int32_t read_value;
+        int write_len;
+        int read_len;
+        size_t i;
+
+        for (i=0; i<ARRAY_LENGTH(values); i++)
+        {
+            memset(&varint, 0, sizeof(struct VarLengthInt));
+            memset(expected, 0, VAR_INT_MAX_BYTES);
+            memset(actual, 0, VAR_INT_MAX_BYTES);
+
+            int32_to_VarLengthInt(values[i], &varint);
+            VarLengthInt_write_value_big(expected, &varint);
+
+            write_len = varint_write_int32(actual, values[i]);
+
+            pass_single = write_len == varint.num_bytes
+                && write_len == varint_length(values[i])
+                && memcmp(expected, actual, VAR_INT_MAX_BYTES) == 0;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail write value=0x%08x\n", __func__, __LINE__, values[i]);
+                print_expected_vs_actual_arr(expected, varint.num_bytes, actual, write_len);
+            }
+
+            read_value = -1;
+            read_len = varint_read_int32(actual, (size_t)write_len, &read_value);
+
+            pass_single = read_len == write_len && read_value == values[i];
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail read value: expected 0x%08x, actual 0x%08x, len=%d\n", __func__, __LINE__, values[i], read_value, read_len);
+            }
+
+            // unterminated when cut one byte short.
+            read_len = varint_read_int32(actual, (size_t)(write_len - 1), &read_value);
+
+            pass_single = read_len == 0;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail truncated read value=0x%08x, len=%d\n", __func__, __LINE__, values[i], read_len);
+            }
+        }
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+}
+
+/**
+ * Unrolls first track of a cseq built from {@code data}, in {@code gaudio_try}.
+ * @param data: compressed data, copied.
+ * @param data_len: length of data.
+ * @param track_start: offset of track in data.
+ * @param track_len: length of track.
+ * @param track: out parameter. Unrolled track.
+ * @param pattern_count: out parameter. Number of patterns (including escape sequences) found.
+ * @returns: {@code gaudio_try} result.
+*/
+static int test_cseq_unroll(uint8_t *data, size_t data_len, size_t track_start, size_t track_len, struct GmidTrack *track, int *pattern_count)
+{
+    struct TestCseqUnroll unroll;
+    struct GaudioError error;
+    struct LinkedListNode *node;
+    int code;
+
+    unroll.cseq = CseqFile_new();
+    unroll.cseq->compressed_data = (uint8_t *)malloc_zero(1, data_len);
+    memcpy(unroll.cseq->compressed_data, data, data_len);
+    unroll.cseq->compressed_data_len = data_len;
+    unroll.cseq->track_offset[0] = (int32_t)(CSEQ_FILE_HEADER_SIZE_BYTES + track_start);
+    unroll.cseq->track_lengths[0] = track_len;
+    unroll.track = track;
+    unroll.track->cseq_track_index = 0;
+    unroll.patterns = LinkedList_new();
+
+    code = gaudio_try(test_cseq_unroll_callback, &unroll, &error);
+
+    *pattern_count = (int)unroll.patterns->count;
+
+    node = unroll.patterns->head;
+    while (node != NULL)
+    {
+        free(node->data);
+        node->data = NULL;
+        node = node->next;
+    }
+
+    LinkedList_free(unroll.patterns);
+    CseqFile_free(unroll.cseq);
+
+    return code;
+}
+
+static void test_cseq_unroll_callback(void *state)
+{
+    struct TestCseqUnroll *unroll = (struct TestCseqUnroll *)state;
+
+    CseqFile_unroll(unroll->cseq, unroll->track, unroll->patterns);
+}
+
+void test_midi_cseq_unroll(int *run_count, int *pass_count, int *fail_count)
+{
+    {
+        printf("MIDI cseq unroll: pattern marker copies earlier bytes\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        // two bytes of a previous track, then the track.
+        uint8_t data[] = {
+            0x11, 0x22,
+            0x90, 0x3c, 0x64, 0x00, 0xfe, 0x00, 0x04, 0x03, 0x80
+        };
+        uint8_t expected[] = { 0x90, 0x3c, 0x64, 0x00, 0x90, 0x3c, 0x64, 0x80 };
+        struct GmidTrack *track = GmidTrack_new();
+        int pattern_count = 0;
+        int code;
+
+        code = test_cseq_unroll(data, sizeof(data), 2, sizeof(data) - 2, track, &pattern_count);
+
+        pass_single = code == GAUDIO_OK
+            && pattern_count == 1
+            && track->cseq_data_len == sizeof(expected)
+            && memcmp(expected, track->cseq_data, sizeof(expected)) == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: code=%d, pattern_count=%d\n", __func__, __LINE__, code, pattern_count);
+            print_expected_vs_actual_arr(expected, sizeof(expected), track->cseq_data, track->cseq_data_len);
+        }
+
+        GmidTrack_free(track);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("MIDI cseq unroll: escape sequence 0xfe 0xfe\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        uint8_t data[] = { 0x01, 0xfe, 0xfe, 0x02 };
+        uint8_t expected[] = { 0x01, 0xfe, 0x02 };
+        struct GmidTrack *track = GmidTrack_new();
+        int pattern_count = 0;
+        int code;
+
+        code = test_cseq_unroll(data, sizeof(data), 0, sizeof(data), track, &pattern_count);
+
+        pass_single = code == GAUDIO_OK
+            && pattern_count == 1
+            && track->cseq_data_len == sizeof(expected)
+            && memcmp(expected, track->cseq_data, sizeof(expected)) == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: code=%d, pattern_count=%d\n", __func__, __LINE__, code, pattern_count);
+            print_expected_vs_actual_arr(expected, sizeof(expected), track->cseq_data, track->cseq_data_len);
+        }
+
+        GmidTrack_free(track);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("MIDI cseq unroll: invalid markers are rejected\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        // Each track is followed by bytes of a next track, which must not be read
+        // as part of the marker or pattern.
+
+        // marker cut off by end of track
+        uint8_t truncated[] = { 0x01, 0xfe, 0x00, 0x01, 0x02, 0x03 };
+        // last byte of track is 0xfe, next track starts with 0xfe
+        uint8_t truncated_escape[] = { 0x01, 0xfe, 0xfe, 0x02 };
+        // diff before start of data
+        uint8_t before_start[] = { 0x01, 0xfe, 0x00, 0x10, 0x01, 0x02 };
+        // pattern ends past end of track
+        uint8_t past_end[] = { 0x90, 0x3c, 0xfe, 0x00, 0x02, 0x08, 0x01, 0x02, 0x03, 0x04 };
+
+        uint8_t *cases[] = { truncated, truncated_escape, before_start, past_end };
+        size_t data_lens[] = { sizeof(truncated), sizeof(truncated_escape), sizeof(before_start), sizeof(past_end) };
+        size_t track_lens[] = { 4, 2, 4, 6 };
+        size_t i;
+
+        for (i=0; i<ARRAY_LENGTH(cases); i++)
+        {
+            struct GmidTrack *track = GmidTrack_new();
+            int pattern_count = 0;
+            int code;
+
+            code = test_cseq_unroll(cases[i], data_lens[i], 0, track_lens[i], track, &pattern_count);
+
+            pass_single = code == EXIT_CODE_GENERAL && track->cseq_data == NULL;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail case %ld: code=%d\n", __func__, __LINE__, i, code);
+            }
+
+            GmidTrack_free(track);
+        }
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+}
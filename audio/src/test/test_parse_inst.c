@@ -29,11 +29,15 @@
 #include "int_hash.h"
 #include "md5.h"
 #include "naudio.h"
+#include "x.h"
 #include "test_common.h"
 
+#define TEST_CTL_LAYOUT_FILENAME "test_cases/inst_parse/layout.ctl~"
+
 // forward declarations
 
 int parse_inst_default(struct FileInfo *fi);
+static struct ALBankFile *test_ctl_layout_bank_new(void);
 
 // end forward declarations
 
@@ -946,4 +950,528 @@ void parse_inst_all(int *run_count, int *pass_count, int *fail_count)
             *fail_count = *fail_count + 1;
         }
     }
-}
\ No newline at end of file
+
+    {
+        /**
+         * lookups by name and aifc filename
+        */
+        printf("parse inst test: 0008 (0002.inst) - find sound and keymap by name, sound by aifc filename\n");
+        int pass = 1;
+        *run_count = *run_count + 1;
+
+        struct FileInfo *fi = FileInfo_fopen("test_cases/inst_parse/0002.inst", "rb");
+        struct ALBankFile *bank_file = ALBankFile_new_from_inst(fi);
+
+        struct ALInstrument *instrument = bank_file->banks[0]->instruments[0];
+        struct ALSound *sound;
+        struct ALKeyMap *keymap;
+
+        sound = ALBankFile_find_sound_with_name(bank_file, "glass_sound");
+        if (sound != instrument->sounds[1])
+        {
+            pass = 0;
+            printf("%s %d>fail: find_sound_with_name glass_sound, expected sounds[1]\n", __func__, __LINE__);
+        }
+
+        keymap = ALBankFile_find_keymap_with_name(bank_file, "Keymap0138");
+        if (keymap != instrument->sounds[2]->keymap)
+        {
+            pass = 0;
+            printf("%s %d>fail: find_keymap_with_name Keymap0138, expected sounds[2]->keymap\n", __func__, __LINE__);
+        }
+
+        if (ALBankFile_find_sound_with_name(bank_file, "missing") != NULL
+            || ALBankFile_find_keymap_with_name(bank_file, "") != NULL)
+        {
+            pass = 0;
+            printf("%s %d>fail: expected NULL for name not found\n", __func__, __LINE__);
+        }
+
+        sound = ALBankFile_find_sound_by_aifc_filename(bank_file, "glass.aifc");
+        if (sound != instrument->sounds[1])
+        {
+            pass = 0;
+            printf("%s %d>fail: find_sound_by_aifc_filename glass.aifc, expected sounds[1]\n", __func__, __LINE__);
+        }
+
+        sound = ALBankFile_find_sound_by_aifc_filename(bank_file, "../sounds/thunk.aifc");
+        if (sound != instrument->sounds[0])
+        {
+            pass = 0;
+            printf("%s %d>fail: find_sound_by_aifc_filename ../sounds/thunk.aifc, expected sounds[0]\n", __func__, __LINE__);
+        }
+
+        // end of filename only, not in index
+        sound = ALBankFile_find_sound_by_aifc_filename(bank_file, "it.aifc");
+        if (sound != instrument->sounds[2])
+        {
+            pass = 0;
+            printf("%s %d>fail: find_sound_by_aifc_filename it.aifc, expected sounds[2]\n", __func__, __LINE__);
+        }
+
+        if (ALBankFile_find_sound_by_aifc_filename(bank_file, "other/glass.aifc") != NULL)
+        {
+            pass = 0;
+            printf("%s %d>fail: find_sound_by_aifc_filename other/glass.aifc, expected NULL\n", __func__, __LINE__);
+        }
+
+        // rename, lookup should reflect the new name after the index is invalidated
+        strcpy(instrument->sounds[1]->text_id, "renamed");
+        ALBankFile_invalidate_index(bank_file);
+
+        if (ALBankFile_find_sound_with_name(bank_file, "renamed") != instrument->sounds[1]
+            || ALBankFile_find_sound_with_name(bank_file, "glass_sound") != NULL)
+        {
+            pass = 0;
+            printf("%s %d>fail: find_sound_with_name after invalidate\n", __func__, __LINE__);
+        }
+
+        // more than one sound ends with the search filename, first one wins
+        strcpy(instrument->sounds[0]->wavetable->aifc_path, "../sounds/box.aifc");
+        strcpy(instrument->sounds[2]->wavetable->aifc_path, "x.aifc");
+        ALBankFile_invalidate_index(bank_file);
+
+        sound = ALBankFile_find_sound_by_aifc_filename(bank_file, "x.aifc");
+        if (sound != instrument->sounds[0])
+        {
+            pass = 0;
+            printf("%s %d>fail: find_sound_by_aifc_filename x.aifc, expected sounds[0]\n", __func__, __LINE__);
+        }
+
+        if (ALBankFile_find_sound_by_aifc_filename(bank_file, "sounds/x.aifc") != NULL)
+        {
+            pass = 0;
+            printf("%s %d>fail: find_sound_by_aifc_filename sounds/x.aifc, expected NULL\n", __func__, __LINE__);
+        }
+
+        // freeing a sound updates the index without an explicit invalidate
+        ALSound_free(instrument->sounds[0]);
+
+        sound = ALBankFile_find_sound_by_aifc_filename(bank_file, "x.aifc");
+        if (instrument->sounds[0] != NULL || sound != instrument->sounds[2])
+        {
+            pass = 0;
+            printf("%s %d>fail: find_sound_by_aifc_filename x.aifc after free, expected sounds[2]\n", __func__, __LINE__);
+        }
+
+        if (ALBankFile_find_sound_with_name(bank_file, "sound1") != NULL)
+        {
+            pass = 0;
+            printf("%s %d>fail: find_sound_with_name sound1 after free, expected NULL\n", __func__, __LINE__);
+        }
+
+        // changes are only reported to the bank file that contains the object
+        struct ALBankFile *other_bank_file;
+        uint32_t change_count;
+        uint32_t other_change_count;
+
+        FileInfo_fseek(fi, 0, SEEK_SET);
+        other_bank_file = ALBankFile_new_from_inst(fi);
+        ALBankFile_find_sound_with_name(other_bank_file, "glass_sound");
+        change_count = bank_file->change_count;
+        other_change_count = other_bank_file->change_count;
+
+        ALSound_free(other_bank_file->banks[0]->instruments[0]->sounds[1]);
+
+        if (bank_file->change_count != change_count
+            || other_bank_file->change_count == other_change_count
+            || ALBankFile_find_sound_with_name(other_bank_file, "glass_sound") != NULL)
+        {
+            pass = 0;
+            printf("%s %d>fail: change_count after free in other bank file\n", __func__, __LINE__);
+        }
+
+        ALBankFile_free(other_bank_file);
+        ALBankFile_free(bank_file);
+        FileInfo_free(fi);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        /**
+         * traversal generation
+        */
+        printf("parse inst test: 0009 (0002.inst) - ALBankFile_begin_visit\n");
+        int pass = 1;
+        *run_count = *run_count + 1;
+
+        struct FileInfo *fi = FileInfo_fopen("test_cases/inst_parse/0002.inst", "rb");
+        struct ALBankFile *bank_file = ALBankFile_new_from_inst(fi);
+
+        struct ALSound *sound = bank_file->banks[0]->instruments[0]->sounds[0];
+        uint32_t first;
+        uint32_t second;
+
+        first = ALBankFile_begin_visit(bank_file);
+        sound->visited_generation = first;
+        second = ALBankFile_begin_visit(bank_file);
+
+        if (first == 0 || second == first || sound->visited_generation == second)
+        {
+            pass = 0;
+            printf("%s %d>fail: first=%u, second=%u, sound->visited_generation=%u\n", __func__, __LINE__, first, second, sound->visited_generation);
+        }
+
+        // wrap around should reset every stamp
+        sound->visited_generation = UINT32_MAX;
+        sound->keymap->visited_generation = UINT32_MAX;
+        bank_file->visit_generation = UINT32_MAX;
+        first = ALBankFile_begin_visit(bank_file);
+
+        if (first != 1 || sound->visited_generation != 0 || sound->keymap->visited_generation != 0)
+        {
+            pass = 0;
+            printf("%s %d>fail: after wrap generation=%u, sound->visited_generation=%u, keymap->visited_generation=%u\n", __func__, __LINE__, first, sound->visited_generation, sound->keymap->visited_generation);
+        }
+
+        ALBankFile_free(bank_file);
+        FileInfo_free(fi);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+    {
+        printf("parse inst test: 0010 (0007.inst) - ALBankFileLayout_new\n");
+        int pass = 1;
+        *run_count = *run_count + 1;
+
+        struct FileInfo *fi = FileInfo_fopen("test_cases/inst_parse/0007.inst", "rb");
+        struct ALBankFile *bank_file = ALBankFile_new_from_inst(fi);
+        struct ALBankFileLayout *layout = ALBankFileLayout_new(bank_file);
+
+        struct ALInstrument *instrument0 = bank_file->banks[0]->instruments[0];
+        struct ALSound *sound0 = instrument0->sounds[0];
+        struct ALSound *sound1 = instrument0->sounds[1];
+
+        // shared objects are only listed once
+        if (layout->instrument_count != 2 || layout->sound_count != 2 || layout->envelope_count != 1 || layout->keymap_count != 1)
+        {
+            pass = 0;
+            printf("%s %d>fail: instrument_count=%ld, sound_count=%ld, envelope_count=%ld, keymap_count=%ld\n", __func__, __LINE__, layout->instrument_count, layout->sound_count, layout->envelope_count, layout->keymap_count);
+        }
+        else
+        {
+            if (layout->sounds[0].item != sound0 || layout->sounds[1].item != sound1)
+            {
+                pass = 0;
+                printf("%s %d>fail: sounds not in natural order\n", __func__, __LINE__);
+            }
+
+            if (layout->sounds[1].parent != instrument0 || layout->sounds[1].parent_index != 1)
+            {
+                pass = 0;
+                printf("%s %d>fail: sounds[1] parent_index=%d, expected %d\n", __func__, __LINE__, layout->sounds[1].parent_index, 1);
+            }
+
+            if (layout->envelopes[0].parent != sound0 || layout->keymaps[0].parent != sound0)
+            {
+                pass = 0;
+                printf("%s %d>fail: envelope/keymap parent should be first sound\n", __func__, __LINE__);
+            }
+
+            // same key keeps order
+            layout->sounds[0].sort_key = 1;
+            layout->sounds[1].sort_key = 1;
+            ALBankFileLayoutEntry_sort(layout->sounds, layout->sound_count);
+
+            if (layout->sounds[0].item != sound0 || layout->sounds[1].item != sound1)
+            {
+                pass = 0;
+                printf("%s %d>fail: sort with equal keys is not stable\n", __func__, __LINE__);
+            }
+
+            layout->sounds[0].sort_key = 2;
+            layout->sounds[1].sort_key = 1;
+            ALBankFileLayoutEntry_sort(layout->sounds, layout->sound_count);
+
+            if (layout->sounds[0].item != sound1 || layout->sounds[1].item != sound0 || layout->sounds[1].position != 1)
+            {
+                pass = 0;
+                printf("%s %d>fail: sort by key\n", __func__, __LINE__);
+            }
+        }
+
+        ALBankFileLayout_free(layout);
+        ALBankFile_free(bank_file);
+        FileInfo_free(fi);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("parse inst test: 0011 - .ctl layout plan and fill\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        struct ALBankFile *bank_file = test_ctl_layout_bank_new();
+        struct ALBank *bank = bank_file->banks[0];
+        struct ALInstrument *instrument0 = bank->instruments[0];
+        struct ALInstrument *instrument1 = bank->instruments[1];
+        struct ALSound *sound0 = instrument0->sounds[0];
+        struct ALSound *sound1 = instrument0->sounds[1];
+        struct ALWaveTable *wavetable0 = sound0->wavetable;
+        struct ALWaveTable *wavetable1 = sound1->wavetable;
+        struct ALBankFileLayout *layout;
+        size_t file_size;
+        size_t guard_len = 16;
+        uint8_t *buffer;
+        uint8_t *file_contents = NULL;
+        size_t file_len;
+        size_t i;
+        uint32_t t32;
+
+        layout = ALBankFile_new_ctl_layout(bank_file);
+        file_size = ALBankFileLayout_plan_ctl(bank_file, layout);
+
+        // Expected .ctl layout:
+        // header (magic, bank count, one bank offset): 0-8
+        // envelope: 8-24
+        // keymap0, keymap1: 24-32, 32-40
+        // sound0: 40-56, wavetable0: 56-80, adpcm loop: 80-128, book (order 2, 1 predictor): 128-176
+        // sound1: 176-192, wavetable1 (raw, no loop): 192-216
+        // instrument0 (2 sounds): 216-240
+        // instrument1 (1 sound): 240-260, padded to 264
+        // bank (2 instruments): 264-288, always padded to 16 bytes, 304
+        pass_single = file_size == 304
+            && bank_file->bank_offsets[0] == 264
+            && sound0->envelope->self_offset == 8
+            && sound0->envelope_offset == 8
+            && sound0->keymap->self_offset == 24
+            && sound0->keymap_offset == 24
+            && sound1->keymap->self_offset == 32
+            && sound0->self_offset == 40
+            && wavetable0->self_offset == 56
+            && sound0->wavetable_offset == 56
+            && wavetable0->wave_info.adpcm_wave.loop_offset == 80
+            && wavetable0->wave_info.adpcm_wave.book_offset == 128
+            && sound1->self_offset == 176
+            && wavetable1->self_offset == 192
+            && instrument0->self_offset == 216
+            && instrument1->self_offset == 240
+            && bank->inst_offsets[0] == 216
+            && bank->inst_offsets[1] == 240
+            && instrument0->sound_offsets[0] == 40
+            && instrument0->sound_offsets[1] == 176;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d>fail: plan offsets, file_size=%ld, bank=%d, instrument0=%d, instrument1=%d, sound0=%d, sound1=%d, wavetable0=%d, wavetable1=%d\n",
+                __func__, __LINE__, file_size, bank_file->bank_offsets[0], instrument0->self_offset, instrument1->self_offset,
+                sound0->self_offset, sound1->self_offset, wavetable0->self_offset, wavetable1->self_offset);
+        }
+
+        // book, instruments, and bank must be 8-byte aligned, file size 16-byte aligned.
+        pass_single = (wavetable0->wave_info.adpcm_wave.book_offset % 8) == 0
+            && (instrument0->self_offset % 8) == 0
+            && (instrument1->self_offset % 8) == 0
+            && (bank_file->bank_offsets[0] % 8) == 0
+            && (file_size % 16) == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d>fail: alignment\n", __func__, __LINE__);
+        }
+
+        // fill pass stays within the planned size.
+        buffer = (uint8_t *)malloc_zero(1, file_size + guard_len);
+        memset(&buffer[file_size], 0xcd, guard_len);
+
+        ALBankFileLayout_fill_ctl(bank_file, layout, buffer);
+
+        for (i=0; i<guard_len; i++)
+        {
+            if (buffer[file_size + i] != 0xcd)
+            {
+                pass = 0;
+                printf("%s %d>fail: wrote past planned size at %ld\n", __func__, __LINE__, file_size + i);
+                break;
+            }
+        }
+
+        // bank offset in header, and sound offsets of shared sound
+        memcpy(&t32, &buffer[4], 4);
+        pass_single = BSWAP32_INLINE(t32) == 264;
+        memcpy(&t32, &buffer[instrument1->self_offset + 16], 4);
+        pass_single &= BSWAP32_INLINE(t32) == 40;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d>fail: offsets in filled buffer\n", __func__, __LINE__);
+        }
+
+        // written file is the planned size, same contents.
+        ALBankFile_write_ctl(bank_file, TEST_CTL_LAYOUT_FILENAME);
+        file_len = get_file_contents(TEST_CTL_LAYOUT_FILENAME, &file_contents);
+
+        pass_single = file_len == file_size && memcmp(buffer, file_contents, file_size) == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d>fail: written .ctl size=%ld, planned size=%ld\n", __func__, __LINE__, file_len, file_size);
+        }
+
+        // read back
+        if (pass)
+        {
+            struct FileInfo *fi = FileInfo_fopen(TEST_CTL_LAYOUT_FILENAME, "rb");
+            struct ALBankFile *ctl_bank_file = ALBankFile_new_from_ctl(fi);
+            struct ALInstrument *ctl_instrument1 = ctl_bank_file->banks[0]->instruments[1];
+
+            pass_single = ctl_bank_file->bank_count == 1
+                && ctl_bank_file->banks[0]->inst_count == 2
+                && ctl_bank_file->banks[0]->instruments[0]->sound_count == 2
+                && ctl_instrument1->sound_count == 1
+                && ctl_instrument1->sounds[0]->wavetable->type == AL_ADPCM_WAVE
+                && ctl_instrument1->sounds[0]->wavetable->wave_info.adpcm_wave.book->order == 2;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d>fail: read back .ctl\n", __func__, __LINE__);
+            }
+
+            ALBankFile_free(ctl_bank_file);
+            FileInfo_free(fi);
+        }
+
+        remove(TEST_CTL_LAYOUT_FILENAME);
+        free(file_contents);
+        free(buffer);
+        ALBankFileLayout_free(layout);
+        ALBankFile_free(bank_file);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+}
+
+/**
+ * Creates a bank file with two instruments. The first has two sounds, the second
+ * shares the first sound. Both sounds share an envelope, each has its own keymap.
+ * The first sound has an ADPCM wavetable with loop and book, the second a raw
+ * wavetable without loop.
+ * @returns: new bank file.
+*/
+static struct ALBankFile *test_ctl_layout_bank_new(void)
+{
+    struct ALBankFile *bank_file;
+    struct ALBank *bank;
+    struct ALInstrument *instrument0;
+    struct ALInstrument *instrument1;
+    struct ALSound *sound0;
+    struct ALSound *sound1;
+    struct ALEnvelope *envelope;
+    struct ALKeyMap *keymap;
+    struct ALWaveTable *wavetable;
+    struct ALADPCMBook *book;
+
+    bank_file = ALBankFile_new();
+    bank_file->bank_count = 1;
+    bank_file->banks = (struct ALBank **)malloc_zero(1, sizeof(struct ALBank *));
+    bank_file->bank_offsets = (int32_t *)malloc_zero(1, sizeof(int32_t));
+
+    bank = ALBank_new();
+    bank_file->banks[0] = bank;
+    bank->sample_rate = 22050;
+    bank->inst_count = 2;
+    bank->instruments = (struct ALInstrument **)malloc_zero(2, sizeof(struct ALInstrument *));
+    bank->inst_offsets = (int32_t *)malloc_zero(2, sizeof(int32_t));
+
+    instrument0 = ALInstrument_new();
+    bank->instruments[0] = instrument0;
+    ALInstrument_add_parent(instrument0, bank);
+    instrument0->sound_count = 2;
+    instrument0->sounds = (struct ALSound **)malloc_zero(2, sizeof(struct ALSound *));
+    instrument0->sound_offsets = (int32_t *)malloc_zero(2, sizeof(int32_t));
+
+    instrument1 = ALInstrument_new();
+    bank->instruments[1] = instrument1;
+    ALInstrument_add_parent(instrument1, bank);
+    instrument1->sound_count = 1;
+    instrument1->sounds = (struct ALSound **)malloc_zero(1, sizeof(struct ALSound *));
+    instrument1->sound_offsets = (int32_t *)malloc_zero(1, sizeof(int32_t));
+
+    sound0 = ALSound_new();
+    instrument0->sounds[0] = sound0;
+    ALSound_add_parent(sound0, instrument0);
+    instrument1->sounds[0] = sound0;
+    ALSound_add_parent(sound0, instrument1);
+
+    sound1 = ALSound_new();
+    instrument0->sounds[1] = sound1;
+    ALSound_add_parent(sound1, instrument0);
+
+    envelope = ALEnvelope_new();
+    envelope->attack_volume = 127;
+    sound0->envelope = envelope;
+    ALEnvelope_add_parent(envelope, sound0);
+    sound1->envelope = envelope;
+    ALEnvelope_add_parent(envelope, sound1);
+
+    keymap = ALKeyMap_new();
+    keymap->key_max = 127;
+    sound0->keymap = keymap;
+    ALKeyMap_add_parent(keymap, sound0);
+
+    keymap = ALKeyMap_new();
+    keymap->key_max = 127;
+    sound1->keymap = keymap;
+    ALKeyMap_add_parent(keymap, sound1);
+
+    wavetable = ALWaveTable_new();
+    wavetable->type = AL_ADPCM_WAVE;
+    wavetable->len = 0x90;
+    wavetable->wave_info.adpcm_wave.loop = (struct ALADPCMLoop *)malloc_zero(1, sizeof(struct ALADPCMLoop));
+    wavetable->wave_info.adpcm_wave.loop->end = 0x100;
+    book = (struct ALADPCMBook *)malloc_zero(1, sizeof(struct ALADPCMBook));
+    book->order = 2;
+    book->npredictors = 1;
+    book->book = (int16_t *)malloc_zero(book->order * book->npredictors * 8, sizeof(int16_t));
+    wavetable->wave_info.adpcm_wave.book = book;
+    sound0->wavetable = wavetable;
+    ALWaveTable_add_parent(wavetable, sound0);
+
+    wavetable = ALWaveTable_new();
+    wavetable->type = AL_RAW16_WAVE;
+    wavetable->base = 0x90;
+    wavetable->len = 0x40;
+    sound1->wavetable = wavetable;
+    ALWaveTable_add_parent(wavetable, sound1);
+
+    return bank_file;
+}
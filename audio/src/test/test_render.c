@@ -0,0 +1,581 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include <unistd.h>
+#include "machine_config.h"
+#include "debug.h"
+#include "common.h"
+#include "utility.h"
+#include "naudio.h"
+#include "midi.h"
+#include "wav.h"
+#include "pcm_cache.h"
+#include "render.h"
+#include "test_common.h"
+
+#define TEST_RENDER_SAMPLE_RATE 22050
+#define TEST_RENDER_WAVE_LEN 100
+#define TEST_RENDER_DIVISION 480
+#define TEST_RENDER_CACHE_DIR "test_cases/pcm_cache~"
+
+// forward declarations
+
+static struct ALBankFile *test_render_bank_new(uint8_t **tbl_file_contents);
+static struct CseqFile *test_render_seq_new(int note);
+static int test_render_zero_crossings(int16_t *data, size_t start, size_t end);
+static int test_render_peak(int16_t *data, size_t start, size_t end, int channel);
+static void test_render_remove_dir(const char *path);
+static void test_render_truncate_dir(const char *path, off_t len);
+
+// end forward declarations
+
+void render_all(int *run_count, int *pass_count, int *fail_count)
+{
+    {
+        printf("render test: WavFile_new_from_cseq note on, note off, end of track\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        struct ALBankFile *bank_file;
+        struct CseqFile *cseq_file;
+        struct RenderOptions *options;
+        struct WavFile *wav;
+        uint8_t *tbl_file_contents;
+        int16_t *data;
+        size_t num_samples;
+        int peak_left;
+        int peak_right;
+        int tail_peak;
+
+        bank_file = test_render_bank_new(&tbl_file_contents);
+        cseq_file = test_render_seq_new(60);
+
+        options = RenderOptions_new();
+        options->tail_ms = 100;
+
+        wav = WavFile_new_from_cseq(cseq_file, bank_file, tbl_file_contents, options);
+
+        pass_single = wav->fmt_chunk->num_channels == 2
+            && wav->fmt_chunk->bits_per_sample == 16
+            && wav->fmt_chunk->sample_rate == TEST_RENDER_SAMPLE_RATE
+            && wav->fmt_chunk->block_align == 4;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail fmt chunk: channels=%d, bits=%d, rate=%d\n", __func__, __LINE__, wav->fmt_chunk->num_channels, wav->fmt_chunk->bits_per_sample, wav->fmt_chunk->sample_rate);
+        }
+
+        // end of track is one second, all notes are finished by then.
+        num_samples = (size_t)wav->data_chunk->ck_data_size / 4;
+        pass_single = num_samples >= TEST_RENDER_SAMPLE_RATE && num_samples <= TEST_RENDER_SAMPLE_RATE + 1;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail length: expected %d, actual %ld\n", __func__, __LINE__, TEST_RENDER_SAMPLE_RATE, (long)num_samples);
+        }
+
+        if (pass)
+        {
+            data = (int16_t *)wav->data_chunk->data;
+
+            // note is held from 0 to 0.5 seconds
+            peak_left = test_render_peak(data, TEST_RENDER_SAMPLE_RATE / 10, (TEST_RENDER_SAMPLE_RATE * 4) / 10, 0);
+            peak_right = test_render_peak(data, TEST_RENDER_SAMPLE_RATE / 10, (TEST_RENDER_SAMPLE_RATE * 4) / 10, 1);
+
+            pass_single = peak_left > 4000 && peak_right > 4000 && abs(peak_left - peak_right) < 500;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail note peak: left=%d, right=%d\n", __func__, __LINE__, peak_left, peak_right);
+            }
+
+            // release is 50ms
+            tail_peak = test_render_peak(data, (TEST_RENDER_SAMPLE_RATE * 6) / 10, num_samples, 0);
+            tail_peak |= test_render_peak(data, (TEST_RENDER_SAMPLE_RATE * 6) / 10, num_samples, 1);
+
+            pass_single = tail_peak == 0;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail silence after release: peak=%d\n", __func__, __LINE__, tail_peak);
+            }
+        }
+
+        // cleanup
+        WavFile_free(wav);
+        RenderOptions_free(options);
+        CseqFile_free(cseq_file);
+        ALBankFile_free(bank_file);
+        free(tbl_file_contents);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("render test: WavFile_new_from_cseq note pitch\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        struct ALBankFile *bank_file;
+        struct CseqFile *base_cseq;
+        struct CseqFile *octave_cseq;
+        struct WavFile *base_wav;
+        struct WavFile *octave_wav;
+        uint8_t *tbl_file_contents;
+        int base_crossings;
+        int octave_crossings;
+        size_t start = TEST_RENDER_SAMPLE_RATE / 10;
+        size_t end = (TEST_RENDER_SAMPLE_RATE * 4) / 10;
+
+        bank_file = test_render_bank_new(&tbl_file_contents);
+        base_cseq = test_render_seq_new(60);
+        octave_cseq = test_render_seq_new(72);
+
+        // default options
+        base_wav = WavFile_new_from_cseq(base_cseq, bank_file, tbl_file_contents, NULL);
+        octave_wav = WavFile_new_from_cseq(octave_cseq, bank_file, tbl_file_contents, NULL);
+
+        // wavetable is one cycle over 100 samples, so keybase note is 220.5 Hz.
+        base_crossings = test_render_zero_crossings((int16_t *)base_wav->data_chunk->data, start, end);
+        octave_crossings = test_render_zero_crossings((int16_t *)octave_wav->data_chunk->data, start, end);
+
+        pass_single = abs(base_crossings - 132) <= 2;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail base note zero crossings: expected 132, actual %d\n", __func__, __LINE__, base_crossings);
+        }
+
+        pass_single = abs(octave_crossings - (2 * base_crossings)) <= 2;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail octave zero crossings: base %d, octave %d\n", __func__, __LINE__, base_crossings, octave_crossings);
+        }
+
+        // cleanup
+        WavFile_free(octave_wav);
+        WavFile_free(base_wav);
+        CseqFile_free(octave_cseq);
+        CseqFile_free(base_cseq);
+        ALBankFile_free(bank_file);
+        free(tbl_file_contents);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("render test: PcmCache memory hit, disk hit, LRU eviction\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        struct ALBankFile *bank_file;
+        struct ALBank *bank;
+        struct ALSound *sound;
+        struct PcmCache *cache;
+        struct PcmCache *disk_cache;
+        struct PcmCacheEntry *first;
+        struct PcmCacheEntry *second;
+        struct PcmCacheEntry *disk_entry;
+        uint8_t *tbl_file_contents;
+        int i;
+
+        bank_file = test_render_bank_new(&tbl_file_contents);
+        bank = bank_file->banks[0];
+        sound = bank->instruments[0]->sounds[0];
+
+        // memory hit
+        cache = PcmCache_new(0, NULL);
+        first = PcmCache_get(cache, sound, bank, tbl_file_contents);
+        second = PcmCache_get(cache, sound, bank, tbl_file_contents);
+
+        pass_single = first == second && cache->hits == 1 && cache->misses == 1 && first->ref_count == 2;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail memory hit: hits=%d, misses=%d\n", __func__, __LINE__, cache->hits, cache->misses);
+        }
+
+        pass_single = first->num_samples == TEST_RENDER_WAVE_LEN;
+        for (i=0; pass_single && i<TEST_RENDER_WAVE_LEN; i++)
+        {
+            int16_t expected = (int16_t)((tbl_file_contents[i * 2] << 8) | tbl_file_contents[i * 2 + 1]);
+            pass_single &= first->samples[i] == expected;
+        }
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail decoded samples, num_samples=%ld\n", __func__, __LINE__, (long)first->num_samples);
+        }
+
+        PcmCache_release(cache, second);
+        PcmCache_release(cache, first);
+        PcmCache_free(cache);
+
+        // LRU eviction, budget only fits one wavetable
+        cache = PcmCache_new(TEST_RENDER_WAVE_LEN * 2 + 10, NULL);
+        first = PcmCache_get(cache, sound, bank, tbl_file_contents);
+        PcmCache_release(cache, first);
+
+        // different key, first half of the same wave
+        sound->wavetable->len = TEST_RENDER_WAVE_LEN;
+        second = PcmCache_get(cache, sound, bank, tbl_file_contents);
+
+        pass_single = cache->evictions == 1 && cache->used_bytes == TEST_RENDER_WAVE_LEN && second->num_samples == TEST_RENDER_WAVE_LEN / 2;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail eviction: evictions=%d, used_bytes=%ld\n", __func__, __LINE__, cache->evictions, (long)cache->used_bytes);
+        }
+
+        PcmCache_release(cache, second);
+        sound->wavetable->len = TEST_RENDER_WAVE_LEN * 2;
+
+        // evicted entry is decoded again
+        first = PcmCache_get(cache, sound, bank, tbl_file_contents);
+        pass_single = cache->misses == 3 && cache->hits == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail lookup after eviction: hits=%d, misses=%d\n", __func__, __LINE__, cache->hits, cache->misses);
+        }
+
+        PcmCache_release(cache, first);
+        PcmCache_free(cache);
+
+        // disk cache, second cache should load from disk instead of decoding
+        test_render_remove_dir(TEST_RENDER_CACHE_DIR);
+
+        cache = PcmCache_new(0, TEST_RENDER_CACHE_DIR);
+        first = PcmCache_get(cache, sound, bank, tbl_file_contents);
+
+        disk_cache = PcmCache_new(0, TEST_RENDER_CACHE_DIR);
+        disk_entry = PcmCache_get(disk_cache, sound, bank, tbl_file_contents);
+
+        pass_single = cache->misses == 1
+            && disk_cache->misses == 0
+            && disk_cache->disk_hits == 1
+            && disk_entry->num_samples == first->num_samples
+            && memcmp(disk_entry->samples, first->samples, first->num_samples * sizeof(int16_t)) == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail disk cache: misses=%d, disk_hits=%d\n", __func__, __LINE__, disk_cache->misses, disk_cache->disk_hits);
+        }
+
+        PcmCache_release(disk_cache, disk_entry);
+        PcmCache_free(disk_cache);
+
+        // truncated disk cache file is ignored and decoded again
+        test_render_truncate_dir(TEST_RENDER_CACHE_DIR, 100);
+
+        disk_cache = PcmCache_new(0, TEST_RENDER_CACHE_DIR);
+        disk_entry = PcmCache_get(disk_cache, sound, bank, tbl_file_contents);
+
+        pass_single = disk_cache->misses == 1
+            && disk_cache->disk_hits == 0
+            && disk_entry->num_samples == first->num_samples
+            && memcmp(disk_entry->samples, first->samples, first->num_samples * sizeof(int16_t)) == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail truncated disk cache: misses=%d, disk_hits=%d\n", __func__, __LINE__, disk_cache->misses, disk_cache->disk_hits);
+        }
+
+        PcmCache_release(disk_cache, disk_entry);
+        PcmCache_release(cache, first);
+        PcmCache_free(disk_cache);
+        PcmCache_free(cache);
+
+        test_render_remove_dir(TEST_RENDER_CACHE_DIR);
+
+        // cleanup
+        ALBankFile_free(bank_file);
+        free(tbl_file_contents);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+}
+
+/**
+ * Creates a bank file with a single instrument. The instrument has one sound,
+ * a looped raw wavetable containing one cycle of a sine wave.
+ * @param tbl_file_contents: out parameter. Will be set to new .tbl contents.
+ * @returns: new bank file.
+*/
+static struct ALBankFile *test_render_bank_new(uint8_t **tbl_file_contents)
+{
+    struct ALBankFile *bank_file;
+    struct ALBank *bank;
+    struct ALInstrument *instrument;
+    struct ALSound *sound;
+    struct ALEnvelope *envelope;
+    struct ALKeyMap *keymap;
+    struct ALWaveTable *wavetable;
+    struct ALRawLoop *loop;
+    int i;
+
+    // .tbl data is big endian
+    *tbl_file_contents = (uint8_t *)malloc_zero(TEST_RENDER_WAVE_LEN, 2);
+    for (i=0; i<TEST_RENDER_WAVE_LEN; i++)
+    {
+        int16_t value = (int16_t)(10000.0 * sin(((double)i / TEST_RENDER_WAVE_LEN) * 2.0 * 3.14159265358979323846));
+        (*tbl_file_contents)[i * 2] = (uint8_t)((value >> 8) & 0xff);
+        (*tbl_file_contents)[i * 2 + 1] = (uint8_t)(value & 0xff);
+    }
+
+    bank_file = ALBankFile_new();
+    bank_file->bank_count = 1;
+    bank_file->banks = (struct ALBank **)malloc_zero(1, sizeof(struct ALBank *));
+
+    bank = ALBank_new();
+    bank_file->banks[0] = bank;
+    bank->sample_rate = TEST_RENDER_SAMPLE_RATE;
+    bank->inst_count = 1;
+    bank->instruments = (struct ALInstrument **)malloc_zero(1, sizeof(struct ALInstrument *));
+
+    instrument = ALInstrument_new();
+    bank->instruments[0] = instrument;
+    ALInstrument_add_parent(instrument, bank);
+    instrument->volume = 127;
+    instrument->pan = 64;
+    instrument->bend_range = 200;
+    instrument->sound_count = 1;
+    instrument->sounds = (struct ALSound **)malloc_zero(1, sizeof(struct ALSound *));
+
+    sound = ALSound_new();
+    instrument->sounds[0] = sound;
+    ALSound_add_parent(sound, instrument);
+    sound->sample_pan = 64;
+    sound->sample_volume = 127;
+
+    envelope = ALEnvelope_new();
+    sound->envelope = envelope;
+    ALEnvelope_add_parent(envelope, sound);
+    envelope->attack_time = 1000;
+    envelope->attack_volume = 127;
+    envelope->decay_time = 1000;
+    envelope->decay_volume = 127;
+    envelope->release_time = 50000;
+
+    keymap = ALKeyMap_new();
+    sound->keymap = keymap;
+    ALKeyMap_add_parent(keymap, sound);
+    keymap->velocity_min = 0;
+    keymap->velocity_max = 127;
+    keymap->key_min = 0;
+    keymap->key_max = 127;
+    keymap->key_base = 60;
+    keymap->detune = 0;
+
+    wavetable = ALWaveTable_new();
+    sound->wavetable = wavetable;
+    ALWaveTable_add_parent(wavetable, sound);
+    wavetable->base = 0;
+    wavetable->len = TEST_RENDER_WAVE_LEN * 2;
+    wavetable->type = AL_RAW16_WAVE;
+
+    loop = (struct ALRawLoop *)malloc_zero(1, sizeof(struct ALRawLoop));
+    loop->start = 0;
+    loop->end = TEST_RENDER_WAVE_LEN;
+    loop->count = 0xffffffff;
+    wavetable->wave_info.raw_wave.loop = loop;
+
+    return bank_file;
+}
+
+/**
+ * Creates a single track seq: program change, note on (quarter note), end of track after two quarter notes.
+ * @param note: MIDI note to play.
+ * @returns: new seq file.
+*/
+static struct CseqFile *test_render_seq_new(int note)
+{
+    struct CseqFile *cseq_file;
+    size_t seq_track_len;
+
+    uint8_t seq_track[] = {
+        0x00, 0xC0, 0x00,
+        0x00, 0x90, 0x3C, 0x7F, 0x83, 0x60,
+        0x87, 0x40, 0xFF, 0x2F
+    };
+    seq_track_len = sizeof(seq_track);
+
+    seq_track[5] = (uint8_t)note;
+
+    cseq_file = CseqFile_new();
+    cseq_file->division = TEST_RENDER_DIVISION;
+    cseq_file->non_empty_num_tracks = 1;
+    cseq_file->track_lengths[0] = seq_track_len;
+    cseq_file->compressed_data_len = seq_track_len;
+    cseq_file->compressed_data = (uint8_t *)malloc_zero(1, cseq_file->compressed_data_len);
+    cseq_file->track_offset[0] = CSEQ_FILE_HEADER_SIZE_BYTES;
+    memcpy(cseq_file->compressed_data, seq_track, seq_track_len);
+
+    return cseq_file;
+}
+
+/**
+ * Counts sign changes in the left channel of interleaved stereo data.
+ * @param data: stereo 16 bit samples.
+ * @param start: first sample frame.
+ * @param end: last sample frame (exclusive).
+ * @returns: number of zero crossings.
+*/
+static int test_render_zero_crossings(int16_t *data, size_t start, size_t end)
+{
+    int count = 0;
+    size_t i;
+
+    for (i=start + 1; i<end; i++)
+    {
+        if ((data[(i - 1) * 2] < 0) != (data[i * 2] < 0))
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Gets max absolute sample value of one channel of interleaved stereo data.
+ * @param data: stereo 16 bit samples.
+ * @param start: first sample frame.
+ * @param end: last sample frame (exclusive).
+ * @param channel: 0 for left, 1 for right.
+ * @returns: peak value.
+*/
+static int test_render_peak(int16_t *data, size_t start, size_t end, int channel)
+{
+    int peak = 0;
+    size_t i;
+
+    for (i=start; i<end; i++)
+    {
+        int value = abs((int)data[i * 2 + channel]);
+
+        if (value > peak)
+        {
+            peak = value;
+        }
+    }
+
+    return peak;
+}
+
+/**
+ * Deletes all files in a directory, then the directory.
+ * @param path: directory to remove.
+*/
+static void test_render_remove_dir(const char *path)
+{
+    DIR *dir;
+    struct dirent *ent;
+    char filename[MAX_FILENAME_LEN * 2];
+
+    dir = opendir(path);
+    if (dir == NULL)
+    {
+        return;
+    }
+
+    while ((ent = readdir(dir)) != NULL)
+    {
+        if (ent->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        snprintf(filename, MAX_FILENAME_LEN * 2, "%s%c%s", path, PATH_SEPERATOR, ent->d_name);
+        remove(filename);
+    }
+
+    closedir(dir);
+    remove(path);
+}
+
+/**
+ * Truncates every file in a directory.
+ * @param path: directory.
+ * @param len: new file length.
+*/
+static void test_render_truncate_dir(const char *path, off_t len)
+{
+    DIR *dir;
+    struct dirent *ent;
+    char filename[MAX_FILENAME_LEN * 2];
+
+    dir = opendir(path);
+    if (dir == NULL)
+    {
+        return;
+    }
+
+    while ((ent = readdir(dir)) != NULL)
+    {
+        if (ent->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        snprintf(filename, MAX_FILENAME_LEN * 2, "%s%c%s", path, PATH_SEPERATOR, ent->d_name);
+
+        if (truncate(filename, len) != 0)
+        {
+            printf("%s %d> could not truncate %s\n", __func__, __LINE__, filename);
+        }
+    }
+
+    closedir(dir);
+}
@@ -0,0 +1,171 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "machine_config.h"
+#include "debug.h"
+#include "common.h"
+#include "utility.h"
+#include "stats.h"
+#include "test_common.h"
+
+#define TEST_STATS_OUTPUT_LEN 4096
+
+void stats_all(int *run_count, int *pass_count, int *fail_count)
+{
+    {
+        printf("stats test: phase counters\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        struct StatsPhase *phase;
+
+        stats_reset();
+
+        // disabled, nothing recorded
+        stats_phase_begin("encode");
+        stats_add_bytes("encode", 100);
+        stats_phase_end("encode");
+
+        pass_single = stats_get_phase("encode") == NULL;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: phase recorded while disabled\n", __func__, __LINE__);
+        }
+
+        stats_enable(STATS_FORMAT_TEXT);
+
+        stats_phase_begin("encode");
+        // nested begin/end of the same phase counts once
+        stats_phase_begin("encode");
+        stats_add_bytes("encode", 100);
+        stats_add_items("encode", "frames", 7);
+        stats_phase_end("encode");
+        stats_phase_end("encode");
+
+        stats_phase_begin("encode");
+        stats_add_bytes("encode", 50);
+        stats_phase_end("encode");
+
+        // end without begin is ignored
+        stats_phase_end("write");
+
+        phase = stats_get_phase("encode");
+
+        pass_single = phase != NULL
+            && phase->calls == 2
+            && phase->running == 0
+            && phase->bytes == 150
+            && phase->items == 7
+            && strcmp(phase->item_unit, "frames") == 0
+            && phase->wall_ns > 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: encode phase counters\n", __func__, __LINE__);
+        }
+
+        pass_single = stats_get_phase("write") == NULL;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: write phase should not exist\n", __func__, __LINE__);
+        }
+
+        stats_reset();
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("stats test: json report\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        char output[TEST_STATS_OUTPUT_LEN];
+        size_t len;
+        FILE *fp;
+
+        pass_single = stats_parse_format(NULL) == STATS_FORMAT_TEXT
+            && stats_parse_format("json") == STATS_FORMAT_JSON
+            && stats_parse_format("xml") == -1;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail: stats_parse_format\n", __func__, __LINE__);
+        }
+
+        stats_enable(STATS_FORMAT_JSON);
+
+        stats_phase_begin("read");
+        stats_add_bytes("read", 1234);
+        stats_phase_end("read");
+
+        stats_phase_begin("decode");
+        stats_add_items("decode", "frames", 16);
+        stats_phase_end("decode");
+
+        fp = tmpfile();
+        stats_print(fp, "test");
+        fflush(fp);
+        rewind(fp);
+        len = fread(output, 1, TEST_STATS_OUTPUT_LEN - 1, fp);
+        output[len] = '\0';
+        fclose(fp);
+
+        pass_single = strncmp(output, "{\"app\":\"test\",", 14) == 0
+            && strstr(output, "\"peak_rss_kb\":") != NULL
+            && strstr(output, "{\"name\":\"read\",\"calls\":1,") != NULL
+            && strstr(output, "\"bytes\":1234,") != NULL
+            && strstr(output, "{\"name\":\"decode\",\"calls\":1,") != NULL
+            && strstr(output, "\"items\":16,\"item_unit\":\"frames\"") != NULL
+            && strstr(output, "]}\n") != NULL;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail json output:\n%s\n", __func__, __LINE__, output);
+        }
+
+        stats_reset();
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+}
@@ -0,0 +1,224 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "machine_config.h"
+#include "debug.h"
+#include "common.h"
+#include "utility.h"
+#include "trace.h"
+#include "test_common.h"
+
+#define TEST_TRACE_OUTPUT_LEN 4096
+
+// forward declarations
+
+static void test_trace_sleep_ms(int ms);
+static size_t test_trace_read_output(FILE *fp, char *buffer, size_t max_len);
+static int test_trace_count(const char *haystack, const char *needle);
+static long test_trace_folded_value(const char *output, const char *stack);
+
+// end forward declarations
+
+void trace_all(int *run_count, int *pass_count, int *fail_count)
+{
+    {
+        printf("trace test: chrome json export\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        char output[TEST_TRACE_OUTPUT_LEN];
+        FILE *fp;
+
+        trace_reset();
+        trace_start(NULL, TRACE_FORMAT_CHROME_JSON);
+
+        trace_event("outer", TRACE_EVENT_ENTER);
+        trace_event("inner", TRACE_EVENT_ENTER);
+        trace_event("inner", TRACE_EVENT_LEAVE);
+        trace_event("outer", TRACE_EVENT_LEAVE);
+
+        trace_stop();
+
+        // stopped, should not be recorded
+        trace_event("outer", TRACE_EVENT_ENTER);
+
+        fp = tmpfile();
+        trace_write_chrome_json(fp);
+        test_trace_read_output(fp, output, TEST_TRACE_OUTPUT_LEN);
+        fclose(fp);
+
+        pass_single = strncmp(output, "{\"traceEvents\":[", 16) == 0
+            && test_trace_count(output, "\"ph\":\"B\"") == 2
+            && test_trace_count(output, "\"ph\":\"E\"") == 2
+            && test_trace_count(output, "\"name\":\"inner\"") == 2
+            && test_trace_count(output, "\"name\":\"outer\"") == 2;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail chrome json output:\n%s\n", __func__, __LINE__, output);
+        }
+
+        trace_reset();
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("trace test: folded stacks export\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        char output[TEST_TRACE_OUTPUT_LEN];
+        FILE *fp;
+        long outer_time;
+        long inner_time;
+        long missing_leave_time;
+
+        trace_reset();
+        trace_start(NULL, TRACE_FORMAT_FOLDED);
+
+        // leave without enter is ignored
+        trace_event("orphan", TRACE_EVENT_LEAVE);
+
+        trace_event("outer", TRACE_EVENT_ENTER);
+        test_trace_sleep_ms(20);
+        trace_event("inner", TRACE_EVENT_ENTER);
+        test_trace_sleep_ms(40);
+        trace_event("inner", TRACE_EVENT_LEAVE);
+
+        // returns without leave event, closed when outer leaves.
+        trace_event("early_return", TRACE_EVENT_ENTER);
+        test_trace_sleep_ms(20);
+        trace_event("outer", TRACE_EVENT_LEAVE);
+
+        trace_stop();
+
+        fp = tmpfile();
+        trace_write_folded(fp);
+        test_trace_read_output(fp, output, TEST_TRACE_OUTPUT_LEN);
+        fclose(fp);
+
+        outer_time = test_trace_folded_value(output, "outer");
+        inner_time = test_trace_folded_value(output, "outer;inner");
+        missing_leave_time = test_trace_folded_value(output, "outer;early_return");
+
+        // sleep is at least the requested time, allow for slow machines.
+        pass_single = outer_time >= 20000 && outer_time < 40000
+            && inner_time >= 40000 && inner_time < 80000
+            && missing_leave_time >= 20000 && missing_leave_time < 40000
+            && strstr(output, "orphan") == NULL;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail folded output:\n%s\n", __func__, __LINE__, output);
+        }
+
+        trace_reset();
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+}
+
+static void test_trace_sleep_ms(int ms)
+{
+    struct timespec ts;
+
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+
+    nanosleep(&ts, NULL);
+}
+
+static size_t test_trace_read_output(FILE *fp, char *buffer, size_t max_len)
+{
+    size_t len;
+
+    fflush(fp);
+    rewind(fp);
+
+    len = fread(buffer, 1, max_len - 1, fp);
+    buffer[len] = '\0';
+
+    return len;
+}
+
+static int test_trace_count(const char *haystack, const char *needle)
+{
+    int count = 0;
+    const char *p = haystack;
+
+    while ((p = strstr(p, needle)) != NULL)
+    {
+        count++;
+        p += strlen(needle);
+    }
+
+    return count;
+}
+
+/**
+ * Finds the line for the exact stack in folded output and returns the value.
+ * @param output: folded output.
+ * @param stack: stack to find.
+ * @returns: value, or -1 if not found.
+*/
+static long test_trace_folded_value(const char *output, const char *stack)
+{
+    const char *line = output;
+    size_t stack_len = strlen(stack);
+
+    while (line != NULL && *line != '\0')
+    {
+        if (strncmp(line, stack, stack_len) == 0 && line[stack_len] == ' ')
+        {
+            return strtol(&line[stack_len + 1], NULL, 10);
+        }
+
+        line = strchr(line, '\n');
+        if (line != NULL)
+        {
+            line++;
+        }
+    }
+
+    return -1;
+}
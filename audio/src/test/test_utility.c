@@ -0,0 +1,293 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ *
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "machine_config.h"
+#include "debug.h"
+#include "common.h"
+#include "utility.h"
+#include "test_common.h"
+
+/**
+ * Largest element count used when comparing chunk swaps. Covers every
+ * remainder of the vector and 64 bit paths.
+*/
+#define TEST_BSWAP_MAX_ELEMENTS 80
+
+/**
+ * Source and destination are offset by up to this many bytes, so
+ * no alignment is assumed.
+*/
+#define TEST_BSWAP_MAX_OFFSET 4
+
+#define TEST_FILEINFO_FILENAME "test_cases/fileinfo_write.bin~"
+
+// forward declarations
+
+static void test_bswap_reference(uint8_t *dest, const uint8_t *src, size_t size, size_t num);
+static void test_fill_pattern(uint8_t *buffer, size_t len, int seed);
+
+// end forward declarations
+
+/**
+ * Scalar swap, one element at a time.
+ * @param dest: destination.
+ * @param src: source.
+ * @param size: element size, 2 or 4.
+ * @param num: number of elements.
+*/
+static void test_bswap_reference(uint8_t *dest, const uint8_t *src, size_t size, size_t num)
+{
+    size_t i;
+
+    for (i=0; i<num; i++)
+    {
+        if (size == 2)
+        {
+            uint16_t v;
+            memcpy(&v, &src[i * 2], 2);
+            v = BSWAP16_INLINE(v);
+            memcpy(&dest[i * 2], &v, 2);
+        }
+        else
+        {
+            uint32_t v;
+            memcpy(&v, &src[i * 4], 4);
+            v = BSWAP32_INLINE(v);
+            memcpy(&dest[i * 4], &v, 4);
+        }
+    }
+}
+
+static void test_fill_pattern(uint8_t *buffer, size_t len, int seed)
+{
+    size_t i;
+
+    for (i=0; i<len; i++)
+    {
+        buffer[i] = (uint8_t)((i * 7 + (size_t)seed * 13 + 3) & 0xff);
+    }
+}
+
+void utility_all(int *run_count, int *pass_count, int *fail_count)
+{
+    {
+        printf("utility test: bswap16_chunk and bswap32_chunk same as scalar swap\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        size_t buffer_len = TEST_BSWAP_MAX_ELEMENTS * 4 + TEST_BSWAP_MAX_OFFSET;
+        uint8_t *src = (uint8_t *)malloc_zero(1, buffer_len);
+        uint8_t *expected = (uint8_t *)malloc_zero(1, buffer_len);
+        uint8_t *actual = (uint8_t *)malloc_zero(1, buffer_len);
+        size_t sizes[] = { 2, 4 };
+        size_t size_index;
+        size_t num;
+        size_t src_offset;
+        size_t dest_offset;
+
+        test_fill_pattern(src, buffer_len, 1);
+
+        for (size_index=0; size_index<2; size_index++)
+        {
+            size_t size = sizes[size_index];
+
+            for (num=0; pass && num<=TEST_BSWAP_MAX_ELEMENTS; num++)
+            {
+                for (src_offset=0; src_offset<TEST_BSWAP_MAX_OFFSET; src_offset++)
+                {
+                    for (dest_offset=0; dest_offset<TEST_BSWAP_MAX_OFFSET; dest_offset++)
+                    {
+                        // bytes outside the destination range must not change.
+                        memset(expected, 0xcc, buffer_len);
+                        memset(actual, 0xcc, buffer_len);
+
+                        test_bswap_reference(&expected[dest_offset], &src[src_offset], size, num);
+
+                        if (size == 2)
+                        {
+                            bswap16_chunk(&actual[dest_offset], &src[src_offset], num);
+                        }
+                        else
+                        {
+                            bswap32_chunk(&actual[dest_offset], &src[src_offset], num);
+                        }
+
+                        pass_single = memcmp(expected, actual, buffer_len) == 0;
+                        pass &= pass_single;
+                        if (!pass_single)
+                        {
+                            printf("%s %d> fail: size=%ld, num=%ld, src_offset=%ld, dest_offset=%ld\n", __func__, __LINE__, size, num, src_offset, dest_offset);
+                            print_expected_vs_actual_arr(expected, buffer_len, actual, buffer_len);
+                        }
+                    }
+
+                    // in place
+                    memcpy(expected, src, buffer_len);
+                    memcpy(actual, src, buffer_len);
+
+                    test_bswap_reference(&expected[src_offset], &src[src_offset], size, num);
+
+                    if (size == 2)
+                    {
+                        bswap16_chunk(&actual[src_offset], &actual[src_offset], num);
+                    }
+                    else
+                    {
+                        bswap32_chunk(&actual[src_offset], &actual[src_offset], num);
+                    }
+
+                    pass_single = memcmp(expected, actual, buffer_len) == 0;
+                    pass &= pass_single;
+                    if (!pass_single)
+                    {
+                        printf("%s %d> fail in place: size=%ld, num=%ld, offset=%ld\n", __func__, __LINE__, size, num, src_offset);
+                        print_expected_vs_actual_arr(expected, buffer_len, actual, buffer_len);
+                    }
+                }
+            }
+        }
+
+        // cleanup
+        free(src);
+        free(expected);
+        free(actual);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("utility test: FileInfo buffered writes flush before read, seek, and free\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        // several writes, some larger than the write buffer.
+        size_t num16 = 5;
+        size_t num32 = (FILEINFO_WRITE_BUFFER_LEN / 4) * 2 + 3;
+        size_t plain_len = FILEINFO_WRITE_BUFFER_LEN + 5;
+        size_t src_len = num32 * 4 + plain_len + 8;
+        size_t expected_len = 3 + (num16 * 2) + (num32 * 4) + plain_len + 2 + 7;
+        uint8_t *src = (uint8_t *)malloc_zero(1, src_len);
+        uint8_t *expected = (uint8_t *)malloc_zero(1, expected_len);
+        uint8_t *actual = (uint8_t *)malloc_zero(1, expected_len);
+        uint8_t *file_contents = NULL;
+        size_t file_len;
+        size_t pos = 0;
+        struct FileInfo *fi;
+        long tell;
+
+        test_fill_pattern(src, src_len, 2);
+
+        fi = FileInfo_fopen(TEST_FILEINFO_FILENAME, "w+b");
+
+        // odd length plain write
+        FileInfo_fwrite(fi, src, 1, 3);
+        memcpy(&expected[pos], src, 3);
+        pos += 3;
+
+        // unaligned source
+        FileInfo_fwrite_bswap(fi, &src[1], 2, num16);
+        test_bswap_reference(&expected[pos], &src[1], 2, num16);
+        pos += num16 * 2;
+
+        // swap larger than the write buffer, starting part way into it.
+        FileInfo_fwrite_bswap(fi, &src[3], 4, num32);
+        test_bswap_reference(&expected[pos], &src[3], 4, num32);
+        pos += num32 * 4;
+
+        // plain write larger than the write buffer goes straight to the file.
+        FileInfo_fwrite(fi, &src[5], 1, plain_len);
+        memcpy(&expected[pos], &src[5], plain_len);
+        pos += plain_len;
+
+        // left in the write buffer
+        FileInfo_fwrite_bswap(fi, &src[7], 2, 1);
+        test_bswap_reference(&expected[pos], &src[7], 2, 1);
+        pos += 2;
+
+        tell = FileInfo_ftell(fi);
+        pass_single = tell == (long)pos;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail ftell: expected %ld, actual %ld\n", __func__, __LINE__, pos, tell);
+        }
+
+        // read back what was written so far.
+        FileInfo_fwrite(fi, &src[11], 1, 7);
+        memcpy(&expected[pos], &src[11], 7);
+        pos += 7;
+
+        FileInfo_fseek(fi, 0, SEEK_SET);
+        FileInfo_fread(fi, actual, 1, pos);
+
+        pass_single = memcmp(expected, actual, pos) == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail read after seek\n", __func__, __LINE__);
+        }
+
+        // overwrite the last 7 bytes, still pending when released.
+        FileInfo_fseek(fi, -7, SEEK_END);
+        FileInfo_fwrite(fi, &src[13], 1, 7);
+        memcpy(&expected[pos - 7], &src[13], 7);
+
+        FileInfo_free(fi);
+
+        file_len = get_file_contents(TEST_FILEINFO_FILENAME, &file_contents);
+
+        pass_single = file_len == expected_len && memcmp(expected, file_contents, expected_len) == 0;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail contents after free: expected len %ld, actual %ld\n", __func__, __LINE__, expected_len, file_len);
+        }
+
+        // cleanup
+        remove(TEST_FILEINFO_FILENAME);
+        free(file_contents);
+        free(src);
+        free(expected);
+        free(actual);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+}
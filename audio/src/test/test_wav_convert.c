@@ -0,0 +1,480 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ * 
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ * 
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>. 
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "machine_config.h"
+#include "debug.h"
+#include "common.h"
+#include "utility.h"
+#include "wav.h"
+#include "wav_convert.h"
+#include "test_common.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define TEST_WAV_CONVERT_MAX_FILE_LEN 0x10000
+
+// forward declarations
+
+static uint8_t *test_wav_convert_file_new(int16_t audio_format, int extensible, int num_channels, int sample_rate, int bits_per_sample, const uint8_t *data, size_t data_len, int loop_start, int loop_end, size_t *file_len);
+static struct WavFile *test_wav_convert_parse(uint8_t *file, size_t file_len);
+static void test_wav_convert_append(uint8_t *file, size_t *pos, const void *data, size_t len);
+static double test_wav_convert_sine_error(int16_t *data, size_t start, size_t end, double amplitude, double freq, double sample_rate);
+static int test_wav_convert_peak(int16_t *data, size_t start, size_t end);
+
+// end forward declarations
+
+void wav_convert_all(int *run_count, int *pass_count, int *fail_count)
+{
+    {
+        printf("wav_convert test: read extensible 24 bit, odd chunk sizes, convert to 16 bit\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        int32_t values[] = { 100, -200, 32767, -32768, 0 };
+        uint8_t data[15];
+        uint8_t *file;
+        size_t file_len;
+        struct WavFile *wav;
+        struct WavConvertOptions *options;
+        int16_t *samples;
+        int i;
+
+        for (i=0; i<5; i++)
+        {
+            int32_t value = values[i] * 256;
+            memcpy(&data[i * 3], &value, 3);
+        }
+
+        file = test_wav_convert_file_new(WAV_AUDIO_FORMAT, 1, 1, 22050, 24, data, sizeof(data), 1, 4, &file_len);
+        wav = test_wav_convert_parse(file, file_len);
+
+        pass_single = wav->fmt_chunk->audio_format == WAV_AUDIO_FORMAT
+            && wav->fmt_chunk->bits_per_sample == 24
+            && wav->data_chunk->ck_data_size == (int32_t)sizeof(data)
+            && wav->smpl_chunk != NULL
+            && wav->smpl_chunk->num_sample_loops == 1
+            && wav->smpl_chunk->loops[0]->start == 1
+            && wav->smpl_chunk->loops[0]->end == 4;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail parse: format=%d, bits=%d, data size=%d, smpl=%p\n", __func__, __LINE__, wav->fmt_chunk->audio_format, wav->fmt_chunk->bits_per_sample, wav->data_chunk->ck_data_size, (void *)wav->smpl_chunk);
+        }
+
+        if (pass)
+        {
+            options = WavConvertOptions_new();
+            options->dither = 0;
+
+            pass_single = WavFile_needs_convert(wav, options) == 1;
+            pass &= pass_single;
+
+            WavFile_convert(wav, options);
+
+            pass_single = wav->fmt_chunk->bits_per_sample == 16
+                && wav->fmt_chunk->block_align == 2
+                && wav->fmt_chunk->sample_rate == 22050
+                && wav->data_chunk->ck_data_size == 10
+                && WavFile_needs_convert(wav, options) == 0;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail converted format: bits=%d, data size=%d\n", __func__, __LINE__, wav->fmt_chunk->bits_per_sample, wav->data_chunk->ck_data_size);
+            }
+
+            samples = (int16_t *)wav->data_chunk->data;
+
+            for (i=0; i<5 && pass; i++)
+            {
+                pass_single = samples[i] == values[i];
+                pass &= pass_single;
+                if (!pass_single)
+                {
+                    printf("%s %d> fail sample %d: expected %d, actual %d\n", __func__, __LINE__, i, values[i], samples[i]);
+                }
+            }
+
+            WavConvertOptions_free(options);
+        }
+
+        // cleanup
+        WavFile_free(wav);
+        free(file);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("wav_convert test: WavFile_convert stereo float 48000 Hz to mono 22050 Hz\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        size_t frame_count = 4800;
+        float *data;
+        uint8_t *file;
+        size_t file_len;
+        struct WavFile *wav;
+        struct WavConvertOptions *options;
+        double error;
+        size_t i;
+
+        data = (float *)malloc_zero(frame_count * 2, sizeof(float));
+
+        for (i=0; i<frame_count; i++)
+        {
+            double x = sin(2.0 * M_PI * 1000.0 * (double)i / 48000.0);
+            data[i * 2] = (float)(0.5 * x);
+            data[i * 2 + 1] = (float)(0.25 * x);
+        }
+
+        file = test_wav_convert_file_new(WAV_AUDIO_FORMAT_IEEE_FLOAT, 0, 2, 48000, 32, (uint8_t *)data, frame_count * 8, 480, 4320, &file_len);
+        wav = test_wav_convert_parse(file, file_len);
+
+        options = WavConvertOptions_new();
+        options->sample_rate = 22050;
+
+        WavFile_convert(wav, options);
+
+        pass_single = wav->fmt_chunk->num_channels == 1
+            && wav->fmt_chunk->bits_per_sample == 16
+            && wav->fmt_chunk->sample_rate == 22050
+            && wav->fmt_chunk->byte_rate == 44100
+            && wav->data_chunk->ck_data_size == 2205 * 2;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail converted format: channels=%d, bits=%d, rate=%d, data size=%d\n", __func__, __LINE__, wav->fmt_chunk->num_channels, wav->fmt_chunk->bits_per_sample, wav->fmt_chunk->sample_rate, wav->data_chunk->ck_data_size);
+        }
+
+        pass_single = wav->smpl_chunk->loops[0]->start == 221 && wav->smpl_chunk->loops[0]->end == 1985;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail loop: start=%d, end=%d\n", __func__, __LINE__, wav->smpl_chunk->loops[0]->start, wav->smpl_chunk->loops[0]->end);
+        }
+
+        if (pass)
+        {
+            // mix of both channels, away from the zero padded ends. Allow dither plus rounding.
+            error = test_wav_convert_sine_error((int16_t *)wav->data_chunk->data, 100, 2100, 0.375 * 32768.0, 1000.0, 22050.0);
+
+            pass_single = error <= 3.0;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail sine error: %f\n", __func__, __LINE__, error);
+            }
+        }
+
+        // cleanup
+        WavConvertOptions_free(options);
+        WavFile_free(wav);
+        free(file);
+        free(data);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("wav_convert test: WavResampler passband and alias rejection\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        size_t frame_count = 9600;
+        int16_t *data;
+        uint8_t *file;
+        size_t file_len;
+        struct WavFile *wav;
+        struct WavConvertOptions *options;
+        double freqs[] = { 5000.0, 15000.0 };
+        double error;
+        int peak;
+        size_t i;
+        int f;
+
+        options = WavConvertOptions_new();
+        options->sample_rate = 22050;
+        options->dither = 0;
+
+        data = (int16_t *)malloc_zero(frame_count, sizeof(int16_t));
+
+        for (f=0; f<2; f++)
+        {
+            for (i=0; i<frame_count; i++)
+            {
+                data[i] = (int16_t)lrint(16000.0 * sin(2.0 * M_PI * freqs[f] * (double)i / 48000.0));
+            }
+
+            file = test_wav_convert_file_new(WAV_AUDIO_FORMAT, 0, 1, 48000, 16, (uint8_t *)data, frame_count * 2, -1, -1, &file_len);
+            wav = test_wav_convert_parse(file, file_len);
+
+            WavFile_convert(wav, options);
+
+            if (f == 0)
+            {
+                // 5 kHz is in the passband, should come through unchanged.
+                error = test_wav_convert_sine_error((int16_t *)wav->data_chunk->data, 200, 4200, 16000.0, freqs[f], 22050.0);
+
+                pass_single = error <= 2.0;
+                pass &= pass_single;
+                if (!pass_single)
+                {
+                    printf("%s %d> fail passband error: %f\n", __func__, __LINE__, error);
+                }
+            }
+            else
+            {
+                // 15 kHz is above the output nyquist frequency, should be removed instead of aliased to 7050 Hz.
+                peak = test_wav_convert_peak((int16_t *)wav->data_chunk->data, 200, 4200);
+
+                pass_single = peak <= 2;
+                pass &= pass_single;
+                if (!pass_single)
+                {
+                    printf("%s %d> fail alias peak: %d\n", __func__, __LINE__, peak);
+                }
+            }
+
+            WavFile_free(wav);
+            free(file);
+        }
+
+        // cleanup
+        WavConvertOptions_free(options);
+        free(data);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+}
+
+/**
+ * Builds .wav file contents. A "LIST" chunk with odd size is added before the
+ * data chunk, to check pad bytes are skipped.
+ * @param audio_format: fmt chunk audio format.
+ * @param extensible: flag, write WAVE_FORMAT_EXTENSIBLE fmt chunk.
+ * @param num_channels: number of channels.
+ * @param sample_rate: sample rate.
+ * @param bits_per_sample: bits per sample.
+ * @param data: sound data.
+ * @param data_len: length of data in bytes.
+ * @param loop_start: "smpl" chunk loop start, or -1 for no "smpl" chunk.
+ * @param loop_end: "smpl" chunk loop end.
+ * @param file_len: out parameter. Length of file in bytes.
+ * @returns: file contents.
+*/
+static uint8_t *test_wav_convert_file_new(int16_t audio_format, int extensible, int num_channels, int sample_rate, int bits_per_sample, const uint8_t *data, size_t data_len, int loop_start, int loop_end, size_t *file_len)
+{
+    uint8_t *file = (uint8_t *)malloc_zero(1, data_len + TEST_WAV_CONVERT_MAX_FILE_LEN);
+    size_t pos = 0;
+    uint32_t u32;
+    uint16_t u16;
+    int16_t block_align = (int16_t)(num_channels * bits_per_sample / 8);
+    int32_t byte_rate = sample_rate * block_align;
+    uint8_t zero = 0;
+
+    test_wav_convert_append(file, &pos, "RIFF", 4);
+    u32 = 0; // size, set below
+    test_wav_convert_append(file, &pos, &u32, 4);
+    test_wav_convert_append(file, &pos, "WAVE", 4);
+
+    test_wav_convert_append(file, &pos, "fmt ", 4);
+    u32 = extensible ? WAV_FMT_CHUNK_EXTENSIBLE_BODY_SIZE : WAV_FMT_CHUNK_BODY_SIZE;
+    test_wav_convert_append(file, &pos, &u32, 4);
+    u16 = extensible ? (uint16_t)WAV_AUDIO_FORMAT_EXTENSIBLE : (uint16_t)audio_format;
+    test_wav_convert_append(file, &pos, &u16, 2);
+    test_wav_convert_append(file, &pos, &num_channels, 2);
+    test_wav_convert_append(file, &pos, &sample_rate, 4);
+    test_wav_convert_append(file, &pos, &byte_rate, 4);
+    test_wav_convert_append(file, &pos, &block_align, 2);
+    test_wav_convert_append(file, &pos, &bits_per_sample, 2);
+
+    if (extensible)
+    {
+        // cbSize, valid bits, channel mask, then sub format GUID.
+        u16 = 22;
+        test_wav_convert_append(file, &pos, &u16, 2);
+        test_wav_convert_append(file, &pos, &bits_per_sample, 2);
+        u32 = 4;
+        test_wav_convert_append(file, &pos, &u32, 4);
+        test_wav_convert_append(file, &pos, &audio_format, 2);
+        test_wav_convert_append(file, &pos, "\x00\x00\x00\x00\x10\x00\x80\x00\x00\xaa\x00\x38\x9b\x71", 14);
+    }
+
+    test_wav_convert_append(file, &pos, "LIST", 4);
+    u32 = 3;
+    test_wav_convert_append(file, &pos, &u32, 4);
+    test_wav_convert_append(file, &pos, "abc", 4);
+
+    test_wav_convert_append(file, &pos, "data", 4);
+    u32 = (uint32_t)data_len;
+    test_wav_convert_append(file, &pos, &u32, 4);
+    test_wav_convert_append(file, &pos, data, data_len);
+    if (data_len & 1)
+    {
+        test_wav_convert_append(file, &pos, &zero, 1);
+    }
+
+    if (loop_start >= 0)
+    {
+        int32_t smpl[9];
+        int32_t loop[6];
+
+        memset(smpl, 0, sizeof(smpl));
+        memset(loop, 0, sizeof(loop));
+
+        smpl[3] = 60; // unity note
+        smpl[7] = 1; // number of loops
+        smpl[8] = WAV_SAMPLE_LOOP_SIZE;
+        loop[2] = loop_start;
+        loop[3] = loop_end;
+
+        test_wav_convert_append(file, &pos, "smpl", 4);
+        u32 = WAV_SMPL_CHUNK_BODY_SIZE + WAV_SAMPLE_LOOP_SIZE;
+        test_wav_convert_append(file, &pos, &u32, 4);
+        test_wav_convert_append(file, &pos, smpl, sizeof(smpl));
+        test_wav_convert_append(file, &pos, loop, sizeof(loop));
+    }
+
+    u32 = (uint32_t)(pos - 8);
+    memcpy(&file[4], &u32, 4);
+
+    *file_len = pos;
+
+    return file;
+}
+
+/**
+ * Parses .wav file contents.
+ * @param file: file contents.
+ * @param file_len: length of file in bytes.
+ * @returns: new wav file.
+*/
+static struct WavFile *test_wav_convert_parse(uint8_t *file, size_t file_len)
+{
+    struct FileInfo *fi;
+    struct WavFile *wav;
+
+    fi = FileInfo_fmemopen(file, file_len);
+    wav = WavFile_new_from_file(fi);
+    FileInfo_free(fi);
+
+    return wav;
+}
+
+/**
+ * Appends bytes to buffer.
+ * @param file: buffer.
+ * @param pos: in/out parameter. Current position in buffer.
+ * @param data: data to append.
+ * @param len: number of bytes.
+*/
+static void test_wav_convert_append(uint8_t *file, size_t *pos, const void *data, size_t len)
+{
+    memcpy(&file[*pos], data, len);
+    *pos += len;
+}
+
+/**
+ * Gets max absolute difference from a sine wave.
+ * @param data: mono 16 bit samples.
+ * @param start: first sample.
+ * @param end: last sample (exclusive).
+ * @param amplitude: sine amplitude.
+ * @param freq: sine frequency.
+ * @param sample_rate: sample rate of data.
+ * @returns: max error.
+*/
+static double test_wav_convert_sine_error(int16_t *data, size_t start, size_t end, double amplitude, double freq, double sample_rate)
+{
+    double error = 0.0;
+    size_t i;
+
+    for (i=start; i<end; i++)
+    {
+        double expected = amplitude * sin(2.0 * M_PI * freq * (double)i / sample_rate);
+        double diff = fabs((double)data[i] - expected);
+
+        if (diff > error)
+        {
+            error = diff;
+        }
+    }
+
+    return error;
+}
+
+/**
+ * Gets max absolute sample value.
+ * @param data: mono 16 bit samples.
+ * @param start: first sample.
+ * @param end: last sample (exclusive).
+ * @returns: peak value.
+*/
+static int test_wav_convert_peak(int16_t *data, size_t start, size_t end)
+{
+    int peak = 0;
+    size_t i;
+
+    for (i=start; i<end; i++)
+    {
+        int value = abs((int)data[i]);
+
+        if (value > peak)
+        {
+            peak = value;
+        }
+    }
+
+    return peak;
+}
@@ -0,0 +1,524 @@
+/**
+ * Copyright 2022 Ben Burns
+*/
+/**
+ * This file is part of Gaudio.
+ *
+ * Gaudio is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later version.
+ *
+ * Gaudio is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Gaudio. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "machine_config.h"
+#include "debug.h"
+#include "common.h"
+#include "utility.h"
+#include "naudio.h"
+#include "adpcm_aifc.h"
+#include "wav.h"
+#include "wav_convert.h"
+#include "x.h"
+#include "test_common.h"
+
+#define TEST_WAV_STREAM_NUM_SAMPLES 5003
+#define TEST_WAV_STREAM_LOOP_START 1000
+#define TEST_WAV_STREAM_LOOP_END 4000
+#define TEST_WAV_STREAM_HEADER_LEN 0x100
+
+// forward declarations
+
+static uint8_t *test_wav_stream_file_new(size_t *file_len);
+static void test_wav_stream_append(uint8_t *file, size_t *pos, const void *data, size_t len);
+static int test_wav_stream_compare(const char *name, uint8_t *expected, size_t expected_len, uint8_t *actual, size_t actual_len);
+static struct ALADPCMBook *test_wav_stream_book_new(void);
+
+// end forward declarations
+
+void wav_stream_all(int *run_count, int *pass_count, int *fail_count)
+{
+    {
+        printf("wav_stream test: WavReader block reads same as WavFile_new_from_file\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        uint8_t *file;
+        size_t file_len;
+        struct FileInfo *fi;
+        struct WavFile *wav;
+        struct WavReader *reader;
+        uint8_t *data;
+        size_t data_pos = 0;
+        size_t read_len;
+
+        file = test_wav_stream_file_new(&file_len);
+
+        fi = FileInfo_fmemopen(file, file_len);
+        wav = WavFile_new_from_file(fi);
+        FileInfo_free(fi);
+
+        fi = FileInfo_fmemopen(file, file_len);
+        reader = WavReader_new(fi);
+
+        pass_single = reader->data_len == (size_t)wav->data_chunk->ck_data_size
+            && reader->fmt_chunk->num_channels == 1
+            && reader->fmt_chunk->bits_per_sample == 16
+            && reader->fmt_chunk->sample_rate == wav->fmt_chunk->sample_rate
+            && reader->smpl_chunk != NULL
+            && reader->smpl_chunk->num_sample_loops == 1
+            && reader->smpl_chunk->loops[0]->start == TEST_WAV_STREAM_LOOP_START
+            && reader->smpl_chunk->loops[0]->end == TEST_WAV_STREAM_LOOP_END;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail header: data len=%zu, smpl=%p\n", __func__, __LINE__, reader->data_len, (void *)reader->smpl_chunk);
+        }
+
+        data = (uint8_t *)malloc_zero(1, reader->data_len + 7);
+
+        // odd block size to check reads that don't line up with sample boundaries
+        while ((read_len = WavReader_read(reader, &data[data_pos], 7)) > 0)
+        {
+            data_pos += read_len;
+        }
+
+        pass &= test_wav_stream_compare("data", wav->data_chunk->data, (size_t)wav->data_chunk->ck_data_size, data, data_pos);
+
+        // cleanup
+        free(data);
+        WavReader_free(reader);
+        FileInfo_free(fi);
+        WavFile_free(wav);
+        free(file);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("wav_stream test: WavWriter output same as WavFile_fwrite\n");
+        int pass = 1;
+        *run_count = *run_count + 1;
+
+        uint8_t *file;
+        size_t file_len;
+        struct FileInfo *fi;
+        struct WavFile *wav;
+        struct WavWriter *writer;
+        uint8_t *expected;
+        size_t expected_len;
+        uint8_t *actual;
+        size_t actual_len;
+        size_t data_len;
+        size_t pos;
+
+        file = test_wav_stream_file_new(&file_len);
+
+        fi = FileInfo_fmemopen(file, file_len);
+        wav = WavFile_new_from_file(fi);
+        FileInfo_free(fi);
+
+        fi = FileInfo_open_memstream();
+        WavFile_fwrite(wav, fi);
+        expected_len = FileInfo_memstream_take(fi, &expected);
+        FileInfo_free(fi);
+
+        fi = FileInfo_open_memstream();
+        writer = WavWriter_new(fi, wav->fmt_chunk);
+
+        data_len = (size_t)wav->data_chunk->ck_data_size;
+        for (pos = 0; pos < data_len; pos += 100)
+        {
+            WavWriter_write(writer, &wav->data_chunk->data[pos], data_len - pos < 100 ? data_len - pos : 100);
+        }
+
+        pass &= WavWriter_close(writer, wav->smpl_chunk) == data_len;
+        WavWriter_free(writer);
+        actual_len = FileInfo_memstream_take(fi, &actual);
+        FileInfo_free(fi);
+
+        pass &= test_wav_stream_compare("wav", expected, expected_len, actual, actual_len);
+
+        // cleanup
+        free(actual);
+        free(expected);
+        WavFile_free(wav);
+        free(file);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("wav_stream test: AdpcmAifcFile_fwrite_from_wav_reader same as AdpcmAifcFile_new_from_wav, with loop\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        uint8_t *file;
+        size_t file_len;
+        struct FileInfo *fi;
+        struct WavFile *wav;
+        struct WavReader *reader;
+        struct ALADPCMBook *book;
+        struct AdpcmAifcFile *aifc;
+        struct WavConvertOptions *options;
+        uint8_t *expected;
+        size_t expected_len;
+        uint8_t *actual;
+        size_t actual_len;
+        size_t num_sample_frames;
+
+        file = test_wav_stream_file_new(&file_len);
+        book = test_wav_stream_book_new();
+        options = WavConvertOptions_new();
+
+        fi = FileInfo_fmemopen(file, file_len);
+        wav = WavFile_new_from_file(fi);
+        FileInfo_free(fi);
+
+        aifc = AdpcmAifcFile_new_from_wav(wav, book);
+        fi = FileInfo_open_memstream();
+        AdpcmAifcFile_fwrite(aifc, fi);
+        expected_len = FileInfo_memstream_take(fi, &expected);
+        FileInfo_free(fi);
+
+        fi = FileInfo_fmemopen(file, file_len);
+        reader = WavReader_new(fi);
+
+        struct FileInfo *output = FileInfo_open_memstream();
+        num_sample_frames = AdpcmAifcFile_fwrite_from_wav_reader(reader, book, options, output);
+        actual_len = FileInfo_memstream_take(output, &actual);
+        FileInfo_free(output);
+
+        pass_single = num_sample_frames == (size_t)aifc->comm_chunk->num_sample_frames;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail num_sample_frames: expected %d, actual %zu\n", __func__, __LINE__, aifc->comm_chunk->num_sample_frames, num_sample_frames);
+        }
+
+        pass &= test_wav_stream_compare("aifc", expected, expected_len, actual, actual_len);
+
+        // cleanup
+        free(actual);
+        free(expected);
+        WavReader_free(reader);
+        FileInfo_free(fi);
+        AdpcmAifcFile_free(aifc);
+        WavFile_free(wav);
+        WavConvertOptions_free(options);
+        ALADPCMBook_free(book);
+        free(file);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("wav_stream test: AdpcmAifcFile_decode_fwrite same as AdpcmAifcFile_decode\n");
+        int pass = 1;
+        *run_count = *run_count + 1;
+
+        uint8_t *file;
+        size_t file_len;
+        struct FileInfo *fi;
+        struct WavFile *wav;
+        struct ALADPCMBook *book;
+        struct AdpcmAifcFile *aifc;
+        uint8_t *expected;
+        size_t expected_len;
+        size_t buffer_len;
+        uint8_t *actual;
+        size_t actual_len;
+        size_t write_len;
+
+        file = test_wav_stream_file_new(&file_len);
+        book = test_wav_stream_book_new();
+
+        fi = FileInfo_fmemopen(file, file_len);
+        wav = WavFile_new_from_file(fi);
+        FileInfo_free(fi);
+
+        aifc = AdpcmAifcFile_new_from_wav(wav, book);
+
+        buffer_len = AdpcmAifcFile_estimate_inflate_size(aifc);
+        expected = (uint8_t *)malloc_zero(1, buffer_len);
+        expected_len = AdpcmAifcFile_decode(aifc, expected, buffer_len);
+
+        fi = FileInfo_open_memstream();
+        write_len = AdpcmAifcFile_decode_fwrite(aifc, fi);
+        actual_len = FileInfo_memstream_take(fi, &actual);
+        FileInfo_free(fi);
+
+        pass &= write_len == actual_len;
+        pass &= test_wav_stream_compare("pcm", expected, expected_len, actual, actual_len);
+
+        // cleanup
+        free(actual);
+        free(expected);
+        AdpcmAifcFile_free(aifc);
+        WavFile_free(wav);
+        ALADPCMBook_free(book);
+        free(file);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+
+    {
+        printf("wav_stream test: AdpcmAifcFile_new_from_wav_trials same as AdpcmAifcFile_new_from_wav, best codebook\n");
+        int pass = 1;
+        int pass_single;
+        *run_count = *run_count + 1;
+
+        uint8_t *file;
+        size_t file_len;
+        struct FileInfo *fi;
+        struct WavFile *wav;
+        struct ALADPCMBook *books[2];
+        struct AdpcmAifcCodebookTrial trials[2];
+        struct AdpcmAifcFile *aifc;
+        uint8_t *expected;
+        size_t expected_len;
+        uint8_t *actual;
+        size_t actual_len;
+        int best_index;
+        int i;
+
+        file = test_wav_stream_file_new(&file_len);
+        books[0] = test_wav_stream_book_new();
+        // no prediction, only the scaled residual.
+        books[1] = ALADPCMBook_new(2, 1);
+
+        fi = FileInfo_fmemopen(file, file_len);
+        wav = WavFile_new_from_file(fi);
+        FileInfo_free(fi);
+
+        best_index = AdpcmAifcFile_new_from_wav_trials(wav, books, 2, trials);
+
+        for (i=0; i<2; i++)
+        {
+            aifc = AdpcmAifcFile_new_from_wav(wav, books[i]);
+            fi = FileInfo_open_memstream();
+            AdpcmAifcFile_fwrite(aifc, fi);
+            expected_len = FileInfo_memstream_take(fi, &expected);
+            FileInfo_free(fi);
+
+            fi = FileInfo_open_memstream();
+            AdpcmAifcFile_fwrite(trials[i].aaf, fi);
+            actual_len = FileInfo_memstream_take(fi, &actual);
+            FileInfo_free(fi);
+
+            pass_single = trials[i].book == books[i]
+                && trials[i].aifc_size == actual_len
+                && trials[i].square_error > 0
+                && trials[i].max_clip >= 0;
+            pass &= pass_single;
+            if (!pass_single)
+            {
+                printf("%s %d> fail trial %d: aifc_size %zu, file len %zu, square_error %lld, max_clip %d\n", __func__, __LINE__, i, trials[i].aifc_size, actual_len, (long long)trials[i].square_error, trials[i].max_clip);
+            }
+
+            pass &= test_wav_stream_compare("aifc", expected, expected_len, actual, actual_len);
+
+            free(actual);
+            free(expected);
+            AdpcmAifcFile_free(aifc);
+        }
+
+        pass_single = trials[0].square_error != trials[1].square_error
+            && trials[best_index].square_error < trials[1 - best_index].square_error;
+        pass &= pass_single;
+        if (!pass_single)
+        {
+            printf("%s %d> fail best_index %d: square_error %lld, %lld\n", __func__, __LINE__, best_index, (long long)trials[0].square_error, (long long)trials[1].square_error);
+        }
+
+        // cleanup
+        for (i=0; i<2; i++)
+        {
+            AdpcmAifcFile_free(trials[i].aaf);
+            ALADPCMBook_free(books[i]);
+        }
+
+        WavFile_free(wav);
+        free(file);
+
+        if (pass == 1)
+        {
+            printf("pass\n");
+            *pass_count = *pass_count + 1;
+        }
+        else
+        {
+            printf("%s %d> fail\n", __func__, __LINE__);
+            *fail_count = *fail_count + 1;
+        }
+    }
+}
+
+/**
+ * Builds .wav file contents, 16 bit mono, with a smpl chunk containing one loop.
+ * Samples are from a fixed seed, a slow ramp plus noise.
+ * @param file_len: out parameter. Will contain length of file in bytes.
+ * @returns: new buffer with file contents.
+*/
+static uint8_t *test_wav_stream_file_new(size_t *file_len)
+{
+    size_t data_len = TEST_WAV_STREAM_NUM_SAMPLES * 2;
+    uint8_t *file = (uint8_t *)malloc_zero(1, data_len + TEST_WAV_STREAM_HEADER_LEN);
+    size_t pos = 0;
+    uint32_t u32;
+    uint16_t u16;
+    uint32_t seed = 0x1234;
+    int32_t smpl[9];
+    int32_t loop[6];
+    int i;
+
+    test_wav_stream_append(file, &pos, "RIFF", 4);
+    u32 = 0; // size, set below
+    test_wav_stream_append(file, &pos, &u32, 4);
+    test_wav_stream_append(file, &pos, "WAVE", 4);
+
+    test_wav_stream_append(file, &pos, "fmt ", 4);
+    u32 = WAV_FMT_CHUNK_BODY_SIZE;
+    test_wav_stream_append(file, &pos, &u32, 4);
+    u16 = WAV_AUDIO_FORMAT;
+    test_wav_stream_append(file, &pos, &u16, 2);
+    u16 = 1; // num channels
+    test_wav_stream_append(file, &pos, &u16, 2);
+    u32 = 22050; // sample rate
+    test_wav_stream_append(file, &pos, &u32, 4);
+    u32 = 22050 * 2; // byte rate
+    test_wav_stream_append(file, &pos, &u32, 4);
+    u16 = 2; // block align
+    test_wav_stream_append(file, &pos, &u16, 2);
+    u16 = 16; // bits per sample
+    test_wav_stream_append(file, &pos, &u16, 2);
+
+    test_wav_stream_append(file, &pos, "data", 4);
+    u32 = (uint32_t)data_len;
+    test_wav_stream_append(file, &pos, &u32, 4);
+
+    for (i=0; i<TEST_WAV_STREAM_NUM_SAMPLES; i++)
+    {
+        int16_t sample;
+
+        seed = seed * 1103515245 + 12345;
+        sample = (int16_t)(((i * 37) % 16384) - 8192 + (int)((seed >> 16) & 0x3ff) - 512);
+        test_wav_stream_append(file, &pos, &sample, 2);
+    }
+
+    memset(smpl, 0, sizeof(smpl));
+    memset(loop, 0, sizeof(loop));
+
+    smpl[3] = 60; // unity note
+    smpl[7] = 1; // number of loops
+    loop[2] = TEST_WAV_STREAM_LOOP_START;
+    loop[3] = TEST_WAV_STREAM_LOOP_END;
+
+    test_wav_stream_append(file, &pos, "smpl", 4);
+    u32 = WAV_SMPL_CHUNK_BODY_SIZE + WAV_SAMPLE_LOOP_SIZE;
+    test_wav_stream_append(file, &pos, &u32, 4);
+    test_wav_stream_append(file, &pos, smpl, sizeof(smpl));
+    test_wav_stream_append(file, &pos, loop, sizeof(loop));
+
+    u32 = (uint32_t)(pos - 8);
+    memcpy(&file[4], &u32, 4);
+
+    *file_len = pos;
+
+    return file;
+}
+
+static void test_wav_stream_append(uint8_t *file, size_t *pos, const void *data, size_t len)
+{
+    memcpy(&file[*pos], data, len);
+    *pos += len;
+}
+
+/**
+ * Compares two buffers, prints the first difference.
+ * @param name: name printed on failure.
+ * @param expected: expected buffer.
+ * @param expected_len: length of expected buffer.
+ * @param actual: actual buffer.
+ * @param actual_len: length of actual buffer.
+ * @returns: 1 if same, zero otherwise.
+*/
+static int test_wav_stream_compare(const char *name, uint8_t *expected, size_t expected_len, uint8_t *actual, size_t actual_len)
+{
+    size_t i;
+
+    if (expected_len != actual_len)
+    {
+        printf("%s %d> fail %s: expected len %zu, actual len %zu\n", __func__, __LINE__, name, expected_len, actual_len);
+        return 0;
+    }
+
+    for (i=0; i<expected_len; i++)
+    {
+        if (expected[i] != actual[i])
+        {
+            printf("%s %d> fail %s: first difference at offset %zu, expected 0x%02x, actual 0x%02x\n", __func__, __LINE__, name, i, expected[i], actual[i]);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static struct ALADPCMBook *test_wav_stream_book_new(void)
+{
+    struct FileInfo *fi;
+    struct ALADPCMBook *book;
+
+    fi = FileInfo_fopen("test_cases/coef_parse/0001.coef", "rb");
+    book = ALADPCMBook_new_from_coef(fi);
+    FileInfo_free(fi);
+
+    return book;
+}